@@ -36,6 +36,7 @@
 #include "ProfileManager.h"
 #include "MainWindow.h"
 #include "Session.h"
+#include "StartupTrace.h"
 
 using namespace Konsole;
 
@@ -92,6 +93,8 @@ void Application::detachView(Session* session)
 
 int Application::newInstance()
 {
+    StartupTrace::mark("Application::newInstance()");
+
     static bool firstInstance = true;
 
     KCmdLineArgs* args = KCmdLineArgs::parsedArgs();
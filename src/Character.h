@@ -23,6 +23,9 @@
 #ifndef CHARACTER_H
 #define CHARACTER_H
 
+// Standard
+#include <string.h>
+
 // Konsole
 #include "CharacterColor.h"
 
@@ -95,11 +98,16 @@ public:
                               bool _real = true)
         : character(_c)
         , rendition(_r)
+        , isRealCharacter(_real)
+        , plane(0)
+        , reservedBits(0)
         , foregroundColor(_f)
-        , backgroundColor(_b)
-        , isRealCharacter(_real) { }
+        , backgroundColor(_b) { }
 
     /** The unicode character value for this character.
+     *
+     * For characters outside of the basic multilingual plane this holds the
+     * lower 16 bits of the code point, see plane and codePoint().
      *
      * if RE_EXTENDED_CHAR is set, character is a hash code which can be used to
      * look up the unicode character sequence in the ExtendedCharTable used to
@@ -110,12 +118,6 @@ public:
     /** A combination of RENDITION flags which specify options for drawing the character. */
     quint8  rendition;
 
-    /** The foreground color used to draw this character. */
-    CharacterColor  foregroundColor;
-
-    /** The color used to draw this character's background. */
-    CharacterColor  backgroundColor;
-
     /** Indicate whether this character really exists, or exists simply as place holder.
      *
      *  TODO: this boolean filed can be further improved to become a enum filed, which
@@ -125,7 +127,33 @@ public:
      *    PlaceHolderCharacter: a character which exists as place holder
      *    TabStopCharacter: a special place holder for HT("\t")
      */
-    bool isRealCharacter;
+    quint8 isRealCharacter : 1;
+
+    /**
+     * The plane of a character outside of the basic multilingual plane, or 0.
+     *
+     * The few code points whose lower 16 bits are all 0 are stored in the
+     * ExtendedCharTable instead, so that a character value of 0 always marks
+     * the second half of a double width character.
+     */
+    quint8 plane : 5;
+
+    // the rest of the fourth byte, always 0
+    quint8 reservedBits : 2;
+
+    /** The foreground color used to draw this character. */
+    CharacterColor  foregroundColor;
+
+    /** The color used to draw this character's background. */
+    CharacterColor  backgroundColor;
+
+    /**
+     * Returns the unicode code point of this character.  This is only
+     * meaningful if RE_EXTENDED_CHAR is not set.
+     */
+    inline uint codePoint() const {
+        return (uint(plane) << 16) | character;
+    }
 
     /**
      * Returns true if this character should always be drawn in bold when
@@ -155,7 +183,7 @@ public:
         if (rendition & RE_EXTENDED_CHAR) {
             return false;
         } else {
-            return isSupportedLineChar(character);
+            return plane == 0 && isSupportedLineChar(character);
         }
     }
 
@@ -163,14 +191,28 @@ public:
         if (rendition & RE_EXTENDED_CHAR) {
             return false;
         } else {
-            return QChar(character).isSpace();
+            return plane == 0 && QChar(character).isSpace();
         }
     }
+
+private:
+    // The fields above are laid out so that a character fits into 8 bytes,
+    // which allows two characters to be compared as single 64-bit words.
+    // isRealCharacter, which shares the fourth byte with plane, is not
+    // taken into account.
+    quint64 comparisonValue() const {
+        Character other(*this);
+        other.isRealCharacter = true;
+
+        quint64 value;
+        memcpy(&value, &other, sizeof(value));
+        return value;
+    }
 };
 
 inline bool operator == (const Character& a, const Character& b)
 {
-    return a.character == b.character && a.equalsFormat(b);
+    return a.comparisonValue() == b.comparisonValue();
 }
 
 inline bool operator != (const Character& a, const Character& b)
@@ -185,12 +227,34 @@ inline bool Character::equalsFormat(const Character& other) const
            rendition == other.rendition;
 }
 
+/**
+ * Sets @p count characters starting at @p dest to @p ch.
+ *
+ * Rather than assigning one character at a time, the filled part of the
+ * buffer is doubled with memcpy() until it is complete.
+ */
+inline void fillCharacters(Character* dest, int count, const Character& ch)
+{
+    if (count <= 0)
+        return;
+
+    dest[0] = ch;
+    int filled = 1;
+    while (filled < count) {
+        const int n = qMin(filled, count - filled);
+        memcpy(dest + filled, dest, n * sizeof(Character));
+        filled += n;
+    }
+}
+
 inline ColorEntry::FontWeight Character::fontWeight(const ColorEntry* base) const
 {
-    if (foregroundColor._colorSpace == COLOR_SPACE_DEFAULT)
-        return base[foregroundColor._u + 0 + (foregroundColor._v ? BASE_COLORS : 0)].fontWeight;
-    else if (foregroundColor._colorSpace == COLOR_SPACE_SYSTEM)
-        return base[foregroundColor._u + 2 + (foregroundColor._v ? BASE_COLORS : 0)].fontWeight;
+    const int intensive = foregroundColor.isIntensive() ? BASE_COLORS : 0;
+
+    if (foregroundColor.colorSpace() == COLOR_SPACE_DEFAULT)
+        return base[(foregroundColor.index() & 1) + 0 + intensive].fontWeight;
+    else if (foregroundColor.colorSpace() == COLOR_SPACE_SYSTEM)
+        return base[(foregroundColor.index() & 7) + 2 + intensive].fontWeight;
     else
         return ColorEntry::UseCurrentFormat;
 }
@@ -24,10 +24,16 @@
 #define CHARACTERCOLOR_H
 
 // Qt
+#include <QtCore/QVector>
 #include <QtGui/QColor>
 
+// Konsole
+#include "konsole_export.h"
+
 namespace Konsole
 {
+class Screen;
+
 /**
  * An entry in a terminal display's color palette.
  *
@@ -98,6 +104,10 @@ public:
 #define DEFAULT_FORE_COLOR 0
 #define DEFAULT_BACK_COLOR 1
 
+// the colors of a color table followed by the 256 indexed colors,
+// see CharacterColor::paletteIndex()
+#define PALETTE_COLORS (TABLE_COLORS + 256)
+
 /* CharacterColor is a union of the various color spaces.
 
    Assignment is as follows:
@@ -112,6 +122,12 @@ public:
 
    Default color space has two separate colors, namely
    default foreground and default background color.
+
+   To keep the characters of the screen and the history small, a color is
+   packed into 16 bits: the color space is kept in the top 3 bits, and the
+   u and v values of the Default, System and Index(256) spaces in the lower
+   ones.  RGB colors are stored as an index into a table shared by all
+   terminals, see rgbColorIndex().
 */
 
 #define COLOR_SPACE_UNDEFINED   0
@@ -120,6 +136,48 @@ public:
 #define COLOR_SPACE_256         3
 #define COLOR_SPACE_RGB         4
 
+/**
+ * Returns the index of the color @p rgb (in 0xRRGGBB form) in the table of
+ * RGB colors used by CharacterColor, adding it to the table if necessary.
+ *
+ * The table can hold 8192 colors.  Once it is full, the colors which are
+ * not used by any of the screens added with addRgbColorScreen() are freed
+ * and their indexes reused, see rgbColorGeneration().  -1 is returned when
+ * no index is free.
+ */
+KONSOLEPRIVATE_EXPORT int rgbColorIndex(int rgb);
+
+/** Returns the color at @p index in the table of RGB colors.  See rgbColorIndex() */
+KONSOLEPRIVATE_EXPORT QColor rgbColorAt(int index);
+/** Returns the QRgb value of the color at @p index in the table of RGB colors */
+KONSOLEPRIVATE_EXPORT QRgb rgbColorValue(int index);
+/**
+ * Returns a copy of the table of RGB colors, indexed as rgbColorValue().
+ * The table may only be used on the GUI thread, readers on other threads
+ * look the colors up in a copy of it, see ScreenSnapshot.
+ */
+KONSOLEPRIVATE_EXPORT QVector<QRgb> rgbColorValues();
+
+/**
+ * Returns a number which changes each time colors are freed from the table
+ * of RGB colors.  Caches of what the indexes stand for must be cleared
+ * when it changes.
+ */
+KONSOLEPRIVATE_EXPORT quint64 rgbColorGeneration();
+/**
+ * Adds a screen whose characters, including those in its history, use the
+ * table of RGB colors, see Screen::usedRgbColors()
+ */
+KONSOLEPRIVATE_EXPORT void addRgbColorScreen(const Screen* screen);
+/** Removes a screen added with addRgbColorScreen() */
+KONSOLEPRIVATE_EXPORT void removeRgbColorScreen(const Screen* screen);
+
+/**
+ * The QRgb values of the indexed colors 16 to 255, which do not depend on
+ * the color table: the 6x6x6 color cube followed by 24 shades of gray.
+ */
+extern KONSOLEPRIVATE_EXPORT const QRgb color256Values[256 - 16];
+
 /**
  * Describes the color of a single character in the terminal.
  */
@@ -130,10 +188,7 @@ class CharacterColor
 public:
     /** Constructs a new CharacterColor whose color and color space are undefined. */
     CharacterColor()
-        : _colorSpace(COLOR_SPACE_UNDEFINED),
-          _u(0),
-          _v(0),
-          _w(0)
+        : _data(0)
     {}
 
     /**
@@ -147,28 +202,27 @@ public:
      * TODO : Add documentation about available color spaces.
      */
     CharacterColor(quint8 colorSpace, int co)
-        : _colorSpace(colorSpace),
-          _u(0),
-          _v(0),
-          _w(0) {
+        : _data(0) {
         switch (colorSpace) {
         case COLOR_SPACE_DEFAULT:
-            _u = co & 1;
+            _data = pack(colorSpace, co & 1);
             break;
         case COLOR_SPACE_SYSTEM:
-            _u = co & 7;
-            _v = (co >> 3) & 1;
+            _data = pack(colorSpace, (co & 7) | (((co >> 3) & 1) ? INTENSIVE_BIT : 0));
             break;
         case COLOR_SPACE_256:
-            _u = co & 255;
-            break;
-        case COLOR_SPACE_RGB:
-            _u = co >> 16;
-            _v = co >> 8;
-            _w = co;
+            _data = pack(colorSpace, co & 255);
             break;
+        case COLOR_SPACE_RGB: {
+            const int index = rgbColorIndex(co & 0xffffff);
+            if (index >= 0)
+                _data = pack(colorSpace, index);
+            else
+                _data = pack(COLOR_SPACE_256, nearestColor256(co));
+        }
+        break;
         default:
-            _colorSpace = COLOR_SPACE_UNDEFINED;
+            _data = 0;
         }
     }
 
@@ -176,7 +230,7 @@ public:
      * Returns true if this character color entry is valid.
      */
     bool isValid() const {
-        return _colorSpace != COLOR_SPACE_UNDEFINED;
+        return colorSpace() != COLOR_SPACE_UNDEFINED;
     }
 
     /**
@@ -195,6 +249,57 @@ public:
      */
     QColor color(const ColorEntry* palette) const;
 
+    /**
+     * Returns the same color as color() as a QRgb value, which avoids
+     * constructing a QColor.  0 is returned for undefined colors.
+     */
+    QRgb rgb(const ColorEntry* palette) const;
+
+    /**
+     * Returns the index of this color in a palette made of the TABLE_COLORS
+     * entries of a color table followed by the 256 indexed colors, or -1 if
+     * this is an RGB or undefined color.
+     *
+     * The palette can be resolved once for a color table, so that looking up
+     * a color is a single array access.
+     */
+    int paletteIndex() const;
+
+    /**
+     * Returns the packed value of this color.  Two colors have the same
+     * packed value if and only if they are equal, which makes it suitable
+     * as a key.
+     */
+    quint16 packedValue() const {
+        return _data;
+    }
+
+    /** Returns true if this color is in the RGB color space. */
+    bool isRgb() const {
+        return colorSpace() == COLOR_SPACE_RGB;
+    }
+    /**
+     * Returns the index of an RGB color in the table of RGB colors, see
+     * rgbColorIndex().  Only applicable if isRgb() is true.
+     */
+    int rgbIndex() const {
+        return _data & VALUE_MASK;
+    }
+    /**
+     * Returns the RGB color at @p index in the table of RGB colors.
+     *
+     * This is for storage which keeps the colors in a table of its own, see
+     * HistoryScrollFile, and uses the color spaces and ranges of
+     * CharacterColor for its indexes.
+     */
+    static CharacterColor fromRgbIndex(int index) {
+        CharacterColor color;
+        color._data = pack(COLOR_SPACE_RGB, index & VALUE_MASK);
+        return color;
+    }
+    /** The number of colors which can be addressed by rgbIndex() */
+    static const int MAX_RGB_INDEX = 1 << 13;
+
     /**
      * Compares two colors and returns true if they represent the same color value and
      * use the same color space.
@@ -207,20 +312,40 @@ public:
     friend bool operator != (const CharacterColor& a, const CharacterColor& b);
 
 private:
-    quint8 _colorSpace;
+    static const int COLOR_SPACE_SHIFT = 13;
+    static const int VALUE_MASK = (1 << COLOR_SPACE_SHIFT) - 1;
+    // marks intensive colors of the Default and System color spaces
+    static const int INTENSIVE_BIT = 0x100;
 
-    // bytes storing the character color
-    quint8 _u;
-    quint8 _v;
-    quint8 _w;
+    static quint16 pack(int colorSpace, int value) {
+        return (colorSpace << COLOR_SPACE_SHIFT) | value;
+    }
+    // returns the index of the color in the 6x6x6 cube of the 256 color
+    // palette which is closest to the 0xRRGGBB color 'rgb'
+    static int nearestColor256(int rgb) {
+        const int r = (((rgb >> 16) & 0xff) * 5 + 127) / 255;
+        const int g = (((rgb >> 8) & 0xff) * 5 + 127) / 255;
+        const int b = ((rgb & 0xff) * 5 + 127) / 255;
+        return 16 + 36 * r + 6 * g + b;
+    }
+
+    quint8 colorSpace() const {
+        return _data >> COLOR_SPACE_SHIFT;
+    }
+    // the u value of the Default, System and Index(256) color spaces
+    quint8 index() const {
+        return _data & 0xff;
+    }
+    bool isIntensive() const {
+        return _data & INTENSIVE_BIT;
+    }
+
+    quint16 _data;
 };
 
 inline bool operator == (const CharacterColor& a, const CharacterColor& b)
 {
-    return     a._colorSpace == b._colorSpace &&
-               a._u == b._u &&
-               a._v == b._v &&
-               a._w == b._w;
+    return a._data == b._data;
 }
 inline bool operator != (const CharacterColor& a, const CharacterColor& b)
 {
@@ -239,31 +364,21 @@ inline const QColor color256(quint8 u, const ColorEntry* base)
     }
     u -= 8;
 
-    //  16..231: 6x6x6 rgb color cube
-    if (u < 216) {
-        return QColor(((u / 36) % 6) ? (40 * ((u / 36) % 6) + 55) : 0,
-                      ((u / 6) % 6) ? (40 * ((u / 6) % 6) + 55) : 0,
-                      ((u / 1) % 6) ? (40 * ((u / 1) % 6) + 55) : 0);
-    }
-    u -= 216;
-
-    // 232..255: gray, leaving out black and white
-    int gray = u * 10 + 8;
-
-    return QColor(gray, gray, gray);
+    // 16..231: 6x6x6 rgb color cube, 232..255: gray
+    return QColor(color256Values[u]);
 }
 
 inline QColor CharacterColor::color(const ColorEntry* base) const
 {
-    switch (_colorSpace) {
+    switch (colorSpace()) {
     case COLOR_SPACE_DEFAULT:
-        return base[_u + 0 + (_v ? BASE_COLORS : 0)].color;
+        return base[(index() & 1) + 0 + (isIntensive() ? BASE_COLORS : 0)].color;
     case COLOR_SPACE_SYSTEM:
-        return base[_u + 2 + (_v ? BASE_COLORS : 0)].color;
+        return base[(index() & 7) + 2 + (isIntensive() ? BASE_COLORS : 0)].color;
     case COLOR_SPACE_256:
-        return color256(_u, base);
+        return color256(index(), base);
     case COLOR_SPACE_RGB:
-        return QColor(_u, _v, _w);
+        return rgbColorAt(_data & VALUE_MASK);
     case COLOR_SPACE_UNDEFINED:
         return QColor();
     }
@@ -273,10 +388,41 @@ inline QColor CharacterColor::color(const ColorEntry* base) const
     return QColor();
 }
 
+inline QRgb CharacterColor::rgb(const ColorEntry* base) const
+{
+    switch (colorSpace()) {
+    case COLOR_SPACE_DEFAULT:
+    case COLOR_SPACE_SYSTEM:
+        return base[paletteIndex()].color.rgb();
+    case COLOR_SPACE_256:
+        if (index() < 16)
+            return base[(index() & 7) + 2 + (index() >= 8 ? BASE_COLORS : 0)].color.rgb();
+        return color256Values[index() - 16];
+    case COLOR_SPACE_RGB:
+        return rgbColorValue(_data & VALUE_MASK);
+    default:
+        return 0;
+    }
+}
+
+inline int CharacterColor::paletteIndex() const
+{
+    switch (colorSpace()) {
+    case COLOR_SPACE_DEFAULT:
+        return (index() & 1) + 0 + (isIntensive() ? BASE_COLORS : 0);
+    case COLOR_SPACE_SYSTEM:
+        return (index() & 7) + 2 + (isIntensive() ? BASE_COLORS : 0);
+    case COLOR_SPACE_256:
+        return TABLE_COLORS + index();
+    default:
+        return -1;
+    }
+}
+
 inline void CharacterColor::setIntensive()
 {
-    if (_colorSpace == COLOR_SPACE_SYSTEM || _colorSpace == COLOR_SPACE_DEFAULT) {
-        _v = 1;
+    if (colorSpace() == COLOR_SPACE_SYSTEM || colorSpace() == COLOR_SPACE_DEFAULT) {
+        _data |= INTENSIVE_BIT;
     }
 }
 }
@@ -0,0 +1,82 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ColorPalette.h"
+
+// Qt
+#include <QtCore/QHash>
+
+// KDE
+#include <KGlobal>
+
+using Konsole::ColorPalette;
+
+typedef QHash<QByteArray, ColorPalette*> ColorPaletteHash;
+K_GLOBAL_STATIC(ColorPaletteHash, palettes)
+
+ColorPalette::ColorPalette(const ColorEntry* table, const QByteArray& key)
+    : _key(key)
+    , _refCount(0)
+{
+    for (int i = 0; i < TABLE_COLORS; i++) {
+        _table[i] = table[i];
+        _colors[i] = table[i].color;
+    }
+    for (int i = 0; i < 256; i++)
+        _colors[TABLE_COLORS + i] = color256(i, _table);
+}
+
+QByteArray ColorPalette::keyFor(const ColorEntry* table)
+{
+    QByteArray key;
+    key.reserve(TABLE_COLORS * (sizeof(QRgb) + 1));
+
+    for (int i = 0; i < TABLE_COLORS; i++) {
+        const QRgb rgb = table[i].color.rgba();
+        key.append(reinterpret_cast<const char*>(&rgb), sizeof(rgb));
+        key.append(static_cast<char>(table[i].fontWeight));
+    }
+
+    return key;
+}
+
+ColorPalette* ColorPalette::acquire(const ColorEntry* table)
+{
+    const QByteArray key = keyFor(table);
+
+    ColorPalette* palette = palettes->value(key);
+    if (!palette) {
+        palette = new ColorPalette(table, key);
+        palettes->insert(key, palette);
+    }
+
+    palette->_refCount++;
+    return palette;
+}
+
+void ColorPalette::release(ColorPalette* palette)
+{
+    if (!palette || --palette->_refCount > 0)
+        return;
+
+    if (!palettes.isDestroyed())
+        palettes->remove(palette->_key);
+    delete palette;
+}
@@ -0,0 +1,77 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef COLORPALETTE_H
+#define COLORPALETTE_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtGui/QColor>
+
+// Konsole
+#include "CharacterColor.h"
+
+namespace Konsole
+{
+/**
+ * A color table together with the resolved colors of all the palette
+ * entries (see CharacterColor::paletteIndex()), shared by all the terminal
+ * displays which use the same colors.
+ *
+ * Use acquire() to get the palette for a color table and release() once it
+ * is no longer needed.  The palette is created when it is first acquired
+ * and deleted when the last display releases it.  Palettes are immutable,
+ * a display whose colors change acquires the palette for the new table
+ * instead.  Palettes must only be used from the GUI thread.
+ */
+class ColorPalette
+{
+public:
+    /**
+     * Returns the palette for the TABLE_COLORS entries of @p table,
+     * creating it if no display uses it yet.  Each call must be matched by
+     * a call to release().
+     */
+    static ColorPalette* acquire(const ColorEntry* table);
+    /** Releases a palette returned by acquire() */
+    static void release(ColorPalette* palette);
+
+    /** Returns the TABLE_COLORS entries of the color table */
+    const ColorEntry* colorTable() const {
+        return _table;
+    }
+    /** Returns the color of the palette entry @p index */
+    const QColor& color(int index) const {
+        return _colors[index];
+    }
+
+private:
+    ColorPalette(const ColorEntry* table, const QByteArray& key);
+
+    static QByteArray keyFor(const ColorEntry* table);
+
+    QByteArray _key;
+    int _refCount;
+
+    ColorEntry _table[TABLE_COLORS];
+    QColor _colors[PALETTE_COLORS];
+};
+}
+
+#endif // COLORPALETTE_H
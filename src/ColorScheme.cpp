@@ -23,7 +23,9 @@
 #include "ColorScheme.h"
 
 // Qt
+#include <QtCore/QDataStream>
 #include <QtGui/QPainter>
+#include <QtGui/QPixmapCache>
 
 // KDE
 #include <KConfig>
@@ -369,6 +371,61 @@ void ColorScheme::writeColorEntry(KConfig& config , int index) const
     }
 }
 
+bool ColorScheme::read(QDataStream& stream)
+{
+    QString wallpaper;
+    bool hasTable = false;
+    bool hasRandomTable = false;
+
+    stream >> _name >> _description >> _opacity >> wallpaper >> hasTable;
+
+    if (hasTable) {
+        for (int i = 0 ; i < TABLE_COLORS ; i++) {
+            ColorEntry entry;
+            qint8 fontWeight = 0;
+            stream >> entry.color >> fontWeight;
+            entry.fontWeight = static_cast<ColorEntry::FontWeight>(fontWeight);
+            setColorTableEntry(i, entry);
+        }
+    }
+
+    stream >> hasRandomTable;
+    if (hasRandomTable) {
+        for (int i = 0 ; i < TABLE_COLORS ; i++) {
+            quint16 hue = 0;
+            quint8 saturation = 0;
+            quint8 value = 0;
+            stream >> hue >> saturation >> value;
+            if (hue > MAX_HUE)
+                hue = MAX_HUE;
+            setRandomizationRange(i, hue, saturation, value);
+        }
+    }
+
+    setWallpaper(wallpaper);
+
+    return stream.status() == QDataStream::Ok;
+}
+
+void ColorScheme::write(QDataStream& stream) const
+{
+    stream << _name << _description << _opacity << _wallpaper->path()
+           << (_table != 0);
+
+    if (_table) {
+        for (int i = 0 ; i < TABLE_COLORS ; i++)
+            stream << _table[i].color << qint8(_table[i].fontWeight);
+    }
+
+    stream << (_randomTable != 0);
+    if (_randomTable) {
+        for (int i = 0 ; i < TABLE_COLORS ; i++) {
+            const RandomizationRange& range = _randomTable[i];
+            stream << range.hue << range.saturation << range.value;
+        }
+    }
+}
+
 void ColorScheme::setWallpaper(const QString& path)
 {
     _wallpaper = new ColorSchemeWallpaper(path);
@@ -392,15 +449,15 @@ ColorSchemeWallpaper::~ColorSchemeWallpaper()
 
 void ColorSchemeWallpaper::load()
 {
-    if (_path.isEmpty())
+    if (_path.isEmpty() || _picture)
         return;
 
-    // Create and load original pixmap
-    if (!_picture)
-        _picture = new QPixmap();
-
-    if (_picture->isNull())
-        _picture->load(_path);
+    // the picture is only loaded once, even if that fails.  Wallpapers
+    // with the same path share the decoded pixmap by way of the cache
+    const QString key = QLatin1String("konsole-wallpaper:") + _path;
+    _picture = new QPixmap();
+    if (!QPixmapCache::find(key, _picture) && _picture->load(_path))
+        QPixmapCache::insert(key, *_picture);
 }
 
 bool ColorSchemeWallpaper::isNull() const
@@ -30,8 +30,10 @@
 
 // Konsole
 #include "CharacterColor.h"
+#include "konsole_export.h"
 
 class KConfig;
+class QDataStream;
 class QPixmap;
 class QPainter;
 
@@ -41,7 +43,7 @@ namespace Konsole
  * This class holds the wallpaper pixmap associated with a color scheme.
  * The wallpaper object is shared between multiple TerminalDisplay.
  */
-class ColorSchemeWallpaper : public QSharedData
+class KONSOLEPRIVATE_EXPORT ColorSchemeWallpaper : public QSharedData
 {
 public:
     typedef KSharedPtr<ColorSchemeWallpaper> Ptr;
@@ -95,6 +97,17 @@ public:
     /** Writes the color scheme to the specified configuration source */
     void write(KConfig& config) const;
 
+    /**
+     * Reads the color scheme in the binary form written by
+     * write(QDataStream&).  Returns false if the data is incomplete.
+     */
+    bool read(QDataStream& stream);
+    /**
+     * Writes the color scheme in a compact binary form, which can be read
+     * back much faster than a configuration file.
+     */
+    void write(QDataStream& stream) const;
+
     /** Sets a single entry within the color palette. */
     void setColorTableEntry(int index , const ColorEntry& entry);
 
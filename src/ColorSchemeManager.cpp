@@ -24,8 +24,11 @@
 
 // Qt
 #include <QtCore/QIODevice>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
 #include <QtCore/QFileInfo>
 #include <QtCore/QFile>
+#include <QtCore/QSet>
 
 // KDE
 #include <KStandardDirs>
@@ -33,9 +36,20 @@
 #include <KConfig>
 #include <KLocalizedString>
 #include <KDebug>
+#include <KLocale>
+#include <KSaveFile>
 
 using namespace Konsole;
 
+static const quint32 CACHE_MAGIC = 0x4b435343; // "KCSC"
+// increase this whenever the layout of the cache changes
+static const quint32 CACHE_VERSION = 1;
+
+static QString cacheFileName()
+{
+    return KStandardDirs::locateLocal("cache", "konsole/colorschemes.cache");
+}
+
 /**
  * Reads a color scheme stored in the .schema format used in the KDE 3 incarnation
  * of Konsole
@@ -155,6 +169,8 @@ bool KDE3ColorSchemeReader::readTitleLine(const QString& line, ColorScheme* sche
 
 ColorSchemeManager::ColorSchemeManager()
     : _haveLoadedAll(false)
+    , _cacheRead(false)
+    , _cacheChanged(false)
 {
 #if defined(Q_WS_X11)
     // Allow looking up colors in the X11 color database
@@ -198,6 +214,17 @@ void ColorSchemeManager::loadAllColorSchemes()
     if (failed > 0)
         kWarning() << "failed to load " << failed << " color schemes.";
 
+    // forget about the color schemes which have been removed
+    const QSet<QString> paths = QSet<QString>::fromList(nativeColorSchemes);
+    QMutableHashIterator<QString, CachedColorScheme> iter(_cache);
+    while (iter.hasNext()) {
+        if (!paths.contains(iter.next().key())) {
+            iter.remove();
+            _cacheChanged = true;
+        }
+    }
+    writeCache();
+
     _haveLoadedAll = true;
 }
 
@@ -217,15 +244,20 @@ bool ColorSchemeManager::loadColorScheme(const QString& filePath)
 
     QFileInfo info(filePath);
 
-    KConfig config(filePath , KConfig::NoGlobals);
-    ColorScheme* scheme = new ColorScheme();
-    scheme->setName(info.baseName());
-    scheme->read(config);
+    ColorScheme* scheme = readCachedColorScheme(info);
+    if (!scheme) {
+        KConfig config(filePath , KConfig::NoGlobals);
+        scheme = new ColorScheme();
+        scheme->setName(info.baseName());
+        scheme->read(config);
+
+        if (scheme->name().isEmpty()) {
+            kWarning() << "Color scheme in" << filePath << "does not have a valid name and was not loaded.";
+            delete scheme;
+            return false;
+        }
 
-    if (scheme->name().isEmpty()) {
-        kWarning() << "Color scheme in" << filePath << "does not have a valid name and was not loaded.";
-        delete scheme;
-        return false;
+        cacheColorScheme(info, scheme);
     }
 
     if (!_colorSchemes.contains(info.baseName())) {
@@ -305,6 +337,10 @@ void ColorSchemeManager::addColorScheme(ColorScheme* scheme)
     KConfig config(path , KConfig::NoGlobals);
 
     scheme->write(config);
+
+    // the file may change again within the resolution of its modification
+    // time, so the cached version is dropped rather than relying on that
+    uncacheColorScheme(path);
 }
 
 bool ColorSchemeManager::deleteColorScheme(const QString& name)
@@ -316,6 +352,7 @@ bool ColorSchemeManager::deleteColorScheme(const QString& name)
     if (QFile::remove(path)) {
         delete _colorSchemes[name];
         _colorSchemes.remove(name);
+        uncacheColorScheme(path);
         return true;
     } else {
         kWarning() << "Failed to remove color scheme -" << path;
@@ -334,6 +371,7 @@ const ColorScheme* ColorSchemeManager::findColorScheme(const QString& name)
         // look for this color scheme
         QString path = findColorSchemePath(name);
         if (!path.isEmpty() && loadColorScheme(path)) {
+            writeCache();
             return findColorScheme(name);
         } else {
             if (!path.isEmpty() && loadKDE3ColorScheme(path))
@@ -358,3 +396,113 @@ QString ColorSchemeManager::findColorSchemePath(const QString& name) const
     return path;
 }
 
+ColorScheme* ColorSchemeManager::readCachedColorScheme(const QFileInfo& info)
+{
+    if (!_cacheRead) {
+        _cacheRead = true;
+
+        QFile file(cacheFileName());
+        if (file.open(QIODevice::ReadOnly)) {
+            QDataStream stream(&file);
+            stream.setVersion(QDataStream::Qt_4_6);
+
+            quint32 magic = 0;
+            quint32 version = 0;
+            QString language;
+            stream >> magic >> version >> language;
+
+            // the descriptions are translated, so the cache is only valid
+            // for the language it was written in
+            if (magic == CACHE_MAGIC && version == CACHE_VERSION &&
+                    language == KGlobal::locale()->language()) {
+                quint32 count = 0;
+                stream >> count;
+
+                for (quint32 i = 0; i < count; i++) {
+                    QString path;
+                    CachedColorScheme cached;
+                    stream >> path >> cached.modified >> cached.size >> cached.data;
+
+                    if (stream.status() != QDataStream::Ok) {
+                        kWarning() << "Ignoring damaged color scheme cache" << file.fileName();
+                        _cache.clear();
+                        break;
+                    }
+
+                    _cache.insert(path, cached);
+                }
+            }
+        }
+    }
+
+    const QString path = info.absoluteFilePath();
+    if (!_cache.contains(path))
+        return 0;
+
+    const CachedColorScheme& cached = _cache[path];
+    if (cached.modified != info.lastModified().toTime_t() || cached.size != info.size())
+        return 0;
+
+    QDataStream stream(cached.data);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    ColorScheme* scheme = new ColorScheme();
+    if (!scheme->read(stream) || scheme->name() != info.baseName()) {
+        delete scheme;
+        return 0;
+    }
+
+    return scheme;
+}
+
+void ColorSchemeManager::cacheColorScheme(const QFileInfo& info, const ColorScheme* scheme)
+{
+    CachedColorScheme cached;
+    cached.modified = info.lastModified().toTime_t();
+    cached.size = info.size();
+
+    QDataStream stream(&cached.data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    scheme->write(stream);
+
+    _cache.insert(info.absoluteFilePath(), cached);
+    _cacheChanged = true;
+}
+
+void ColorSchemeManager::uncacheColorScheme(const QString& path)
+{
+    if (_cache.remove(QFileInfo(path).absoluteFilePath()) > 0) {
+        _cacheChanged = true;
+        writeCache();
+    }
+}
+
+void ColorSchemeManager::writeCache()
+{
+    if (!_cacheChanged)
+        return;
+
+    _cacheChanged = false;
+
+    KSaveFile file(cacheFileName());
+    if (!file.open()) {
+        kWarning() << "Unable to write the color scheme cache" << file.fileName()
+                   << ":" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << CACHE_MAGIC << CACHE_VERSION << KGlobal::locale()->language()
+           << quint32(_cache.count());
+
+    QHashIterator<QString, CachedColorScheme> iter(_cache);
+    while (iter.hasNext()) {
+        iter.next();
+        const CachedColorScheme& cached = iter.value();
+        stream << iter.key() << cached.modified << cached.size << cached.data;
+    }
+
+    if (!file.finalize())
+        kWarning() << "Unable to write the color scheme cache" << file.fileName();
+}
@@ -29,6 +29,8 @@
 // Konsole
 #include "ColorScheme.h"
 
+class QFileInfo;
+
 namespace Konsole
 {
 /**
@@ -44,6 +46,9 @@ public:
      *
      * The color schemes themselves are not loaded until they are first
      * requested via a call to findColorScheme()
+     *
+     * Color schemes which have been loaded are kept in a cache on disk,
+     * so later on they can be loaded without parsing their files again.
      */
     ColorSchemeManager();
     /**
@@ -104,10 +109,31 @@ private:
     // finds the path of a color scheme
     QString findColorSchemePath(const QString& name) const;
 
+    // returns the color scheme from the file @p info as it was cached,
+    // or 0 if the file is not in the cache or has changed since
+    ColorScheme* readCachedColorScheme(const QFileInfo& info);
+    // adds the color scheme from the file @p info to the cache
+    void cacheColorScheme(const QFileInfo& info, const ColorScheme* scheme);
+    // removes the color scheme file at @p path from the cache
+    void uncacheColorScheme(const QString& path);
+    // writes the cache to disk if it has changed
+    void writeCache();
+
     QHash<QString, const ColorScheme*> _colorSchemes;
 
     bool _haveLoadedAll;
 
+    // a color scheme file as it was cached.  The scheme is only decoded
+    // when it is needed
+    struct CachedColorScheme {
+        uint modified;
+        qint64 size;
+        QByteArray data;
+    };
+    QHash<QString, CachedColorScheme> _cache; // path -> cached scheme
+    bool _cacheRead;
+    bool _cacheChanged;
+
     static const ColorScheme _defaultColorScheme;
 };
 }
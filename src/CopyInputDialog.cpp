@@ -48,6 +48,8 @@ CopyInputDialog::CopyInputDialog(QWidget* parent)
     _model = new CheckableSessionModel(parent);
     _model->setCheckColumn(1);
     _model->setSessions(SessionManager::instance()->sessions());
+    connect(SessionManager::instance(), SIGNAL(sessionAdded(Session*)),
+            _model, SLOT(addSession(Session*)));
 
     QSortFilterProxyModel* filterProxyModel = new QSortFilterProxyModel(this);
     filterProxyModel->setDynamicSortFilter(true);
@@ -471,6 +471,9 @@ void EditProfileDialog::setupAppearancePage(const Profile::Ptr profile)
     _ui->boldIntenseButton->setChecked(profile->boldIntense());
     connect(_ui->boldIntenseButton, SIGNAL(toggled(bool)), this,
             SLOT(setBoldIntense(bool)));
+    _ui->lowBandwidthRenderingButton->setChecked(profile->lowBandwidthRendering());
+    connect(_ui->lowBandwidthRenderingButton, SIGNAL(toggled(bool)), this,
+            SLOT(setLowBandwidthRendering(bool)));
     _ui->enableMouseWheelZoomButton->setChecked(profile->mouseWheelZoomEnabled());
     connect(_ui->enableMouseWheelZoomButton, SIGNAL(toggled(bool)), this,
             SLOT(toggleMouseWheelZoom(bool)));
@@ -489,6 +492,11 @@ void EditProfileDialog::setBoldIntense(bool enable)
     preview(Profile::BoldIntense, enable);
     updateTempProfileProperty(Profile::BoldIntense, enable);
 }
+void EditProfileDialog::setLowBandwidthRendering(bool enable)
+{
+    preview(Profile::LowBandwidthRendering, enable);
+    updateTempProfileProperty(Profile::LowBandwidthRendering, enable);
+}
 void EditProfileDialog::toggleMouseWheelZoom(bool enable)
 {
     updateTempProfileProperty(Profile::MouseWheelZoomEnabled, enable);
@@ -1054,6 +1062,18 @@ void EditProfileDialog::setupAdvancedPage(const Profile::Ptr profile)
             _ui->enableFlowControlButton , Profile::FlowControlEnabled ,
             SLOT(toggleFlowControl(bool))
         },
+        {
+            _ui->enableZModemDetectionButton , Profile::ZModemDetectionEnabled ,
+            SLOT(toggleZModemDetection(bool))
+        },
+        {
+            _ui->enableBinaryOutputDetectionButton , Profile::BinaryOutputDetectionEnabled ,
+            SLOT(toggleBinaryOutputDetection(bool))
+        },
+        {
+            _ui->enableFastForwardButton , Profile::FastForwardEnabled ,
+            SLOT(toggleFastForward(bool))
+        },
         {
             _ui->enableBlinkingCursorButton , Profile::BlinkingCursorEnabled ,
             SLOT(toggleBlinkingCursor(bool))
@@ -1180,6 +1200,18 @@ void EditProfileDialog::toggleFlowControl(bool enable)
 {
     updateTempProfileProperty(Profile::FlowControlEnabled, enable);
 }
+void EditProfileDialog::toggleZModemDetection(bool enable)
+{
+    updateTempProfileProperty(Profile::ZModemDetectionEnabled, enable);
+}
+void EditProfileDialog::toggleBinaryOutputDetection(bool enable)
+{
+    updateTempProfileProperty(Profile::BinaryOutputDetectionEnabled, enable);
+}
+void EditProfileDialog::toggleFastForward(bool enable)
+{
+    updateTempProfileProperty(Profile::FastForwardEnabled, enable);
+}
 void EditProfileDialog::fontSelected(const QFont& aFont)
 {
     QFont previewFont = aFont;
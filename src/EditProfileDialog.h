@@ -122,6 +122,7 @@ private slots:
     void setFontInputValue(const QFont&);
     void setAntialiasText(bool enable);
     void setBoldIntense(bool enable);
+    void setLowBandwidthRendering(bool enable);
     void showFontDialog();
     void newColorScheme();
     void editColorScheme();
@@ -163,6 +164,9 @@ private slots:
     // advanced page
     void toggleBlinkingText(bool);
     void toggleFlowControl(bool);
+    void toggleZModemDetection(bool);
+    void toggleBinaryOutputDetection(bool);
+    void toggleFastForward(bool);
     void togglebidiRendering(bool);
     void lineSpacingChanged(int);
     void toggleBlinkingCursor(bool);
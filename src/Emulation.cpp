@@ -22,36 +22,111 @@
 // Own
 #include "Emulation.h"
 
+// Standard
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 // Qt
+#include <QtCore/QVarLengthArray>
 #include <QtGui/QKeyEvent>
 
 // Konsole
+#include "ExtendedCharTable.h"
 #include "KeyboardTranslator.h"
 #include "KeyboardTranslatorManager.h"
+#include "PerformanceClock.h"
 #include "Screen.h"
+#include "ScreenSnapshot.h"
 #include "ScreenWindow.h"
 
 using namespace Konsole;
 
+// the time, in milliseconds, after which a synchronized update which the
+// program did not end is shown anyway
+static const int SYNCHRONIZED_UPDATE_TIMEOUT = 150;
+
 Emulation::Emulation() :
     _currentScreen(0),
     _codec(0),
     _decoder(0),
     _keyTranslator(0),
+    _utf8FastPath(false),
+    _utf8Remaining(0),
+    _utf8CodePoint(0),
+    _utf8MinCodePoint(0),
+    _zmodemDetection(true),
+    _fastForward(false),
+    _binaryOutputDetection(true),
+    _binaryOutput(false),
+    _textualBytes(0),
     _usesMouse(false),
-    _imageSizeInitialized(false)
+    _bracketedPasteMode(false),
+    _updateDeferred(false),
+    _updateLatency(10),
+    _maximumUpdateInterval(40),
+    _highOutputRate(1024 * 1024),
+    _floodOutputRate(0),
+    _floodFrameRate(30),
+    _receivedBytes(0),
+    _imageSizeInitialized(false),
+    _alternateScreenReleaseDelay(60)
 {
-    // create screens with a default size
+    // create the primary screen with a default size, the alternate
+    // screen is only created when a program switches to it
     _screen[0] = new Screen(40, 80);
-    _screen[1] = new Screen(40, 80);
+    _screen[1] = 0;
     _currentScreen = _screen[0];
 
+    _updateStatistics.outputRate = 0;
+    _updateStatistics.updateCost = 0;
+    _updateStatistics.updateInterval = 0;
+    _updateStatistics.throttled = false;
+    _updateStatistics.floodMode = false;
+    _updateStatistics.updateCount = 0;
+    chooseUpdateInterval();
+
+    _processingStatistics.receivedBytes = 0;
+    _processingStatistics.blockCount = 0;
+    _processingStatistics.processingTime = 0;
+    _processingStatistics.tokenCount = 0;
+
+    _bulkTimer1.setSingleShot(true);
+    _bulkTimer2.setSingleShot(true);
     QObject::connect(&_bulkTimer1, SIGNAL(timeout()), this, SLOT(showBulk()));
     QObject::connect(&_bulkTimer2, SIGNAL(timeout()), this, SLOT(showBulk()));
 
+    _synchronizedUpdateTimer.setSingleShot(true);
+    _synchronizedUpdateTimer.setInterval(SYNCHRONIZED_UPDATE_TIMEOUT);
+    QObject::connect(&_synchronizedUpdateTimer, SIGNAL(timeout()),
+                     this, SLOT(synchronizedUpdateTimeout()));
+
+    // while a selection is dragged, the selected text is collected once
+    // per pass through the event loop rather than for each step
+    _selectedTextTimer.setSingleShot(true);
+    _selectedTextTimer.setInterval(0);
+    QObject::connect(&_selectedTextTimer, SIGNAL(timeout()), this, SLOT(checkSelectedText()));
+
+    _alternateScreenTimer.setSingleShot(true);
+    QObject::connect(&_alternateScreenTimer, SIGNAL(timeout()),
+                     this, SLOT(releaseAlternateScreen()));
+
+    _historyCompactionTimer.setSingleShot(true);
+    QObject::connect(&_historyCompactionTimer, SIGNAL(timeout()),
+                     this, SLOT(compactHistory()));
+
+    _historyConversionTimer.setSingleShot(true);
+    QObject::connect(&_historyConversionTimer, SIGNAL(timeout()),
+                     this, SLOT(convertHistory()));
+
     // listen for mouse status changes
     connect(this , SIGNAL(programUsesMouseChanged(bool)) ,
             SLOT(usesMouseChanged(bool)));
+    connect(this , SIGNAL(programBracketedPasteModeChanged(bool)) ,
+            SLOT(bracketedPasteModeChanged(bool)));
 }
 
 bool Emulation::programUsesMouse() const
@@ -64,6 +139,16 @@ void Emulation::usesMouseChanged(bool usesMouse)
     _usesMouse = usesMouse;
 }
 
+bool Emulation::programBracketedPasteMode() const
+{
+    return _bracketedPasteMode;
+}
+
+void Emulation::bracketedPasteModeChanged(bool bracketedPasteMode)
+{
+    _bracketedPasteMode = bracketedPasteMode;
+}
+
 ScreenWindow* Emulation::createWindow()
 {
     ScreenWindow* window = new ScreenWindow();
@@ -73,7 +158,7 @@ ScreenWindow* Emulation::createWindow()
     connect(window , SIGNAL(selectionChanged()),
             this , SLOT(bufferedUpdate()));
     connect(window, SIGNAL(selectionChanged()),
-            this, SLOT(checkSelectedText()));
+            &_selectedTextTimer, SLOT(start()));
 
     connect(this , SIGNAL(outputChanged()),
             window , SLOT(notifyOutputChanged()));
@@ -106,26 +191,86 @@ Emulation::~Emulation()
 void Emulation::setScreen(int index)
 {
     Screen* oldScreen = _currentScreen;
-    _currentScreen = _screen[index & 1];
+    _currentScreen = (index & 1) ? alternateScreen() : _screen[0];
     if (_currentScreen != oldScreen) {
         // tell all windows onto this emulation to switch to the newly active screen
         foreach(ScreenWindow * window, _windows) {
             window->setScreen(_currentScreen);
         }
 
+        if (_currentScreen == _screen[0] && _alternateScreenReleaseDelay > 0)
+            _alternateScreenTimer.start(_alternateScreenReleaseDelay * 1000);
+        else
+            _alternateScreenTimer.stop();
+
         checkScreenInUse();
         checkSelectedText();
     }
 }
 
+Screen* Emulation::alternateScreen()
+{
+    if (!_screen[1]) {
+        const Screen* primary = _screen[0];
+        Screen* screen = new Screen(primary->getLines(), primary->getColumns());
+
+        // margins and screen modes are always applied to both screens,
+        // see Vt102Emulation::setMargins() and Vt102Emulation::setMode()
+        screen->setMargins(primary->topMargin() + 1, primary->bottomMargin() + 1);
+        for (int mode = 0; mode < MODES_SCREEN; mode++) {
+            if (primary->getMode(mode))
+                screen->setMode(mode);
+            else
+                screen->resetMode(mode);
+        }
+
+        _screen[1] = screen;
+    }
+
+    return _screen[1];
+}
+
+void Emulation::releaseAlternateScreen()
+{
+    // the windows only ever refer to the current screen
+    if (!_screen[1] || _currentScreen == _screen[1])
+        return;
+
+    delete _screen[1];
+    _screen[1] = 0;
+}
+
+void Emulation::setAlternateScreenReleaseDelay(int seconds)
+{
+    _alternateScreenReleaseDelay = qMax(0, seconds);
+
+    if (_alternateScreenReleaseDelay == 0)
+        _alternateScreenTimer.stop();
+    else if (_screen[1] && _currentScreen == _screen[0])
+        _alternateScreenTimer.start(_alternateScreenReleaseDelay * 1000);
+}
+
 void Emulation::clearHistory()
 {
-    _screen[0]->setScroll(_screen[0]->getScroll() , false);
+    _screen[0]->clearHistory();
+}
+void Emulation::setHistoryIndexEnabled(bool enable)
+{
+    _screen[0]->setHistoryIndexEnabled(enable);
+}
+bool Emulation::findCandidateLines(const QString& text, int& startLine, int& endLine) const
+{
+    return _currentScreen->findCandidateLines(text, startLine, endLine);
 }
 void Emulation::setHistory(const HistoryType& history)
 {
     _screen[0]->setScroll(history);
 
+    // large histories are copied in batches between the processing of
+    // other events, which keeps the terminal responsive meanwhile
+    if (_screen[0]->isConvertingHistory())
+        _historyConversionTimer.start(0);
+
     showBulk();
 }
 
@@ -134,6 +279,74 @@ const HistoryType& Emulation::history() const
     return _screen[0]->getScroll();
 }
 
+qint64 Emulation::historyMemoryUsage() const
+{
+    return _screen[0]->historyMemoryUsage();
+}
+
+qint64 Emulation::retainedHistoryMemoryUsage() const
+{
+    return _screen[0]->retainedHistoryMemoryUsage();
+}
+
+int Emulation::historyLineCount() const
+{
+    return _screen[0]->getHistLines();
+}
+
+qint64 Emulation::historyFileSize() const
+{
+    return _screen[0]->historyFileSize();
+}
+
+qint64 Emulation::screenMemoryUsage() const
+{
+    // the alternate screen is deleted while it is not used
+    qint64 usage = _screen[0]->screenMemoryUsage();
+    if (_screen[1])
+        usage += _screen[1]->screenMemoryUsage();
+    return usage;
+}
+
+qint64 Emulation::extendedCharMemoryUsage() const
+{
+    QSet<ushort> hashes = _screen[0]->usedExtendedChars(true);
+    if (_screen[1])
+        hashes += _screen[1]->usedExtendedChars(true);
+    return ExtendedCharTable::instance.memoryUsage(hashes);
+}
+
+void Emulation::releaseMemory()
+{
+    releaseAlternateScreen();
+
+    for (int i = 0; i < 2; i++) {
+        if (_screen[i])
+            _screen[i]->squeezeLines();
+    }
+    compactHistory();
+}
+
+// time without output after which the history is compacted
+static const int HISTORY_COMPACTION_DELAY = 30 * 1000;
+
+void Emulation::compactHistory()
+{
+    _screen[0]->compactHistory();
+}
+
+// number of lines copied each time the event loop is entered while the
+// history is converted to another type
+static const int HISTORY_CONVERSION_BATCH = 5000;
+
+void Emulation::convertHistory()
+{
+    if (_screen[0]->convertHistory(HISTORY_CONVERSION_BATCH))
+        _historyConversionTimer.start(0);
+    else
+        showBulk();
+}
+
 void Emulation::setCodec(const QTextCodec * codec)
 {
     if (codec) {
@@ -142,6 +355,9 @@ void Emulation::setCodec(const QTextCodec * codec)
         delete _decoder;
         _decoder = _codec->makeDecoder();
 
+        _utf8FastPath = utf8();
+        _utf8Remaining = 0;
+
         emit useUtf8Request(utf8());
     } else {
         setCodec(LocaleCodec);
@@ -156,6 +372,59 @@ void Emulation::setCodec(EmulationCodec codec)
         setCodec(QTextCodec::codecForLocale());
 }
 
+void Emulation::setZModemDetectionEnabled(bool enabled)
+{
+    _zmodemDetection = enabled;
+}
+
+bool Emulation::zmodemDetectionEnabled() const
+{
+    return _zmodemDetection;
+}
+
+void Emulation::setBinaryOutputDetectionEnabled(bool enabled)
+{
+    _binaryOutputDetection = enabled;
+    if (!enabled)
+        _binaryOutput = false;
+}
+
+bool Emulation::binaryOutputDetectionEnabled() const
+{
+    return _binaryOutputDetection;
+}
+
+bool Emulation::binaryOutputMode() const
+{
+    return _binaryOutput;
+}
+
+void Emulation::setFastForwardEnabled(bool enabled)
+{
+    _fastForward = enabled;
+}
+
+bool Emulation::fastForwardEnabled() const
+{
+    return _fastForward;
+}
+
+bool Emulation::skipScrolledOutput(const char*, int, int)
+{
+    return false;
+}
+
+void Emulation::resetParser()
+{
+}
+
+void Emulation::setReflowLines(bool enable)
+{
+    // full screen applications on the alternate screen redraw
+    // themselves when they are resized
+    _screen[0]->setReflowLines(enable);
+}
+
 void Emulation::setKeyBindings(const QString& name)
 {
     _keyTranslator = KeyboardTranslatorManager::instance()->findTranslator(name);
@@ -184,9 +453,16 @@ void Emulation::receiveChar(int c)
     }
 }
 
+void Emulation::receiveChars(const ushort* chars, int count)
+{
+    for (int i = 0; i < count; i++)
+        receiveChar(chars[i]);
+}
+
 void Emulation::sendKeyEvent(QKeyEvent* ev)
 {
     emit stateSet(NOTIFYNORMAL);
+    keyPressSent();
 
     if (!ev->text().isEmpty()) {
         // A block of text
@@ -196,6 +472,12 @@ void Emulation::sendKeyEvent(QKeyEvent* ev)
     }
 }
 
+void Emulation::sendKeyEvents(QKeyEvent* event, int count)
+{
+    for (int i = 0; i < count; i++)
+        sendKeyEvent(event);
+}
+
 void Emulation::sendString(const char*, int)
 {
     // default implementation does nothing
@@ -206,33 +488,438 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/, int
     // default implementation does nothing
 }
 
+// returns true if the buffer contains the "\030B00" sequence sent by
+// 'sz' when it starts a transfer.  Since the sequence is rare, memchr()
+// is used to skip over the data between CAN bytes.
+static bool containsZModemStart(const char* text, int length)
+{
+    const char* const end = text + length;
+    const char* p = text;
+
+    while ((p = static_cast<const char*>(memchr(p, '\030', end - p))) != 0) {
+        if ((end - p - 1 > 3) && (qstrncmp(p + 1, "B00", 3) == 0))
+            return true;
+        p++;
+    }
+
+    return false;
+}
+
+// returns the end of the escape sequence which starts at 'start', and
+// whether it is an SGR sequence without private parameters.  Sequences which
+// are incomplete or interrupted by another character end early
+static int escapeSequenceEnd(const uchar* data, int start, int length, bool* graphicRendition)
+{
+    *graphicRendition = false;
+
+    int i = start + 1;
+    if (i < length && data[i] == '[') {
+        bool plainParameters = true;
+        for (i++; i < length && data[i] >= 0x30 && data[i] <= 0x3f; i++)
+            plainParameters = plainParameters && data[i] <= ';';
+
+        const int intermediates = i;
+        while (i < length && data[i] >= 0x20 && data[i] <= 0x2f)
+            i++;
+
+        if (i < length && data[i] >= 0x40 && data[i] <= 0x7e) {
+            *graphicRendition = data[i] == 'm' && plainParameters && i == intermediates;
+            i++;
+        }
+        return i;
+    }
+
+    while (i < length && data[i] >= 0x20 && data[i] <= 0x2f)
+        i++;
+    if (i < length && data[i] >= 0x30 && data[i] <= 0x7e)
+        i++;
+    return i;
+}
+
+namespace
+{
+// a carriage return and the number of line feeds before it, see findScrolledOutput()
+struct CarriageReturn {
+    int position;
+    int lineFeeds;
+};
+}
+
+// Looks for output in 'text' which scrolls off a screen of 'lines' lines
+// without a history before it could be seen.  This is a part of the output
+// which only contains text, line feeds and SGR sequences, which is followed
+// by a carriage return and at least 'lines' line feeds before the next
+// control function which could move the cursor back up.  Returns the part
+// with the most output in ['begin', 'end'), and the number of line feeds in
+// it in 'lineFeeds', or false if there is none.
+static bool findScrolledOutput(const char* text, int length, int lines,
+                               int& begin, int& end, int& lineFeeds)
+{
+    const uchar* const data = reinterpret_cast<const uchar*>(text);
+
+    // the last carriage return before each of the last 'lines' line feeds
+    // of the current part
+    QVarLengthArray<CarriageReturn, 128> returns(lines);
+    CarriageReturn lastReturn = { -1, 0 };
+
+    int partStart = 0;
+    int partLineFeeds = 0;
+    begin = end = lineFeeds = 0;
+
+    int i = 0;
+    for (;;) {
+        int next = i + 1;
+        bool plain = true;
+
+        if (i < length) {
+            const uchar c = data[i];
+            if (c == '\n') {
+                returns[partLineFeeds % lines] = lastReturn;
+                partLineFeeds++;
+            } else if (c == '\r') {
+                lastReturn.position = i;
+                lastReturn.lineFeeds = partLineFeeds;
+            } else if (c == 0x1b) {
+                next = escapeSequenceEnd(data, i, length, &plain);
+            } else if (c < 0x20) {
+                plain = (c == '\t' || c == '\b');
+            } else if (c == 0xc2 && i + 1 < length && data[i + 1] >= 0x80 && data[i + 1] <= 0x9f) {
+                // C1 control characters
+                plain = false;
+                next = i + 2;
+            }
+
+            if (plain) {
+                i = next;
+                continue;
+            }
+        }
+
+        // the current part ends here
+        if (partLineFeeds >= lines) {
+            const CarriageReturn& resume = returns[partLineFeeds % lines];
+            if (resume.position > partStart && resume.position - partStart > end - begin) {
+                begin = partStart;
+                end = resume.position;
+                lineFeeds = resume.lineFeeds;
+            }
+        }
+
+        if (i >= length)
+            break;
+
+        i = partStart = next;
+        partLineFeeds = 0;
+        lastReturn.position = -1;
+    }
+
+    return end > begin;
+}
+
 /*
    We are doing code conversion from locale to unicode first.
 */
 
 void Emulation::receiveData(const char* text, int length)
 {
-    emit stateSet(NOTIFYACTIVITY);
+    const PerformanceClock clock;
 
+    _receivedBytes += length;
     bufferedUpdate();
 
-    QString unicodeText = _decoder->toUnicode(text, length);
+    int begin;
+    int end;
+    int lineFeeds;
+    const int lines = _currentScreen->getLines();
+
+    if (_binaryOutputDetection)
+        detectBinaryOutput(text, length);
+
+    if (_binaryOutput) {
+        receiveBinaryData(text, length);
+    } else if (_utf8FastPath && _fastForward && !_currentScreen->hasScroll() &&
+            findScrolledOutput(text, length, lines, begin, end, lineFeeds)) {
+        receiveUtf8Data(text, begin);
 
-    //send characters to terminal emulator
-    for (int i = 0; i < unicodeText.length(); i++)
-        receiveChar(unicodeText[i].unicode());
+        // the output before the skipped part may have changed the screen
+        if (_currentScreen->hasScroll() || _currentScreen->getLines() != lines ||
+                !skipScrolledOutput(text + begin, end - begin, lineFeeds))
+            receiveUtf8Data(text + begin, end - begin);
+
+        receiveUtf8Data(text + end, length - end);
+    } else if (_utf8FastPath) {
+        receiveUtf8Data(text, length);
+    } else {
+        QString unicodeText = _decoder->toUnicode(text, length);
+
+        //send characters to terminal emulator
+        receiveChars(unicodeText.utf16(), unicodeText.length());
+    }
 
-    //look for z-modem indicator
-    //-- someone who understands more about z-modems that I do may be able to move
-    //this check into the above for loop?
+    if (_zmodemDetection && containsZModemStart(text, length))
+        emit zmodemDetected();
+
+    _processingStatistics.receivedBytes += length;
+    _processingStatistics.blockCount++;
+    _processingStatistics.processingTime += clock.elapsed();
+}
+
+// blocks of output shorter than this are not taken as binary output, since
+// there is too little of it to tell
+static const int BINARY_DETECTION_MINIMUM = 256;
+// output is binary if at least one in this many bytes is unlikely in text
+static const int BINARY_BYTE_RATIO = 16;
+// binary output mode ends after this many bytes of text
+static const int TEXTUAL_BYTES_MINIMUM = 4096;
+
+// returns true for the bytes which text hardly ever contains: the control
+// characters other than BEL, BS, TAB, LF, VT, FF, CR, SO, SI and ESC, DEL and
+// with UTF-8 the bytes which never occur in it
+static bool isUnlikelyInText(uchar c, bool utf8)
+{
+    if (c < 0x20)
+        return c < 0x07 || (c > 0x0f && c != 0x1b);
+    if (c == 0x7f)
+        return true;
+    return utf8 && (c == 0xc0 || c == 0xc1 || c >= 0xf5);
+}
+
+void Emulation::detectBinaryOutput(const char* text, int length)
+{
+    int unlikelyBytes = 0;
     for (int i = 0; i < length; i++) {
-        if (text[i] == '\030') {
-            if ((length - i - 1 > 3) && (qstrncmp(text + i + 1, "B00", 3) == 0))
-                emit zmodemDetected();
+        if (isUnlikelyInText(text[i], _utf8FastPath))
+            unlikelyBytes++;
+    }
+
+    if (!_binaryOutput) {
+        // full screen programs do not print files, and they are the ones
+        // which might send unusual control characters
+        if (_currentScreen == _screen[0] && length >= BINARY_DETECTION_MINIMUM &&
+                unlikelyBytes * BINARY_BYTE_RATIO >= length) {
+            _binaryOutput = true;
+            _textualBytes = 0;
+            resetParser();
         }
+    } else if (unlikelyBytes > 0) {
+        _textualBytes = 0;
+    } else {
+        // a short block of text is most likely the prompt of the shell
+        // after the file was printed
+        _textualBytes += length;
+        if (length < BINARY_DETECTION_MINIMUM || _textualBytes >= TEXTUAL_BYTES_MINIMUM)
+            _binaryOutput = false;
     }
 }
 
+void Emulation::receiveBinaryData(const char* text, int length)
+{
+    static const int BufferSize = 1024;
+    ushort buffer[BufferSize];
+
+    // a sequence which was interrupted by the binary output is dropped
+    _utf8Remaining = 0;
+
+    while (length > 0) {
+        const int count = qMin(length, BufferSize);
+        for (int i = 0; i < count; i++) {
+            const uchar c = text[i];
+            if ((c >= 0x20 && c < 0x7f) || c == '\t' || c == '\r' || c == '\n')
+                buffer[i] = c;
+            else
+                buffer[i] = '.';
+        }
+
+        receiveChars(buffer, count);
+        text += count;
+        length -= count;
+    }
+}
+
+// widens the 7-bit ASCII at the start of the 'length' bytes at 'text' to
+// UTF-16 in 'out' and returns the number of bytes widened.  The bulk of
+// them is tested and widened sixteen bytes at a time with SSE2 or NEON,
+// which every x86-64 and ARMv8 processor has, and tested eight bytes at a
+// time elsewhere
+static int widenAscii(const char* text, int length, ushort* out)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; length - i >= 16; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        if (_mm_movemask_epi8(bytes) != 0)
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(bytes, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(bytes, zero));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; length - i >= 16; i += 16) {
+        const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(text + i));
+        if (vmaxvq_u8(bytes) & 0x80)
+            break;
+        vst1q_u16(out + i, vmovl_u8(vget_low_u8(bytes)));
+        vst1q_u16(out + i + 8, vmovl_u8(vget_high_u8(bytes)));
+    }
+#else
+    const quint64 highBits = Q_UINT64_C(0x8080808080808080);
+    for (; length - i >= 8; i += 8) {
+        quint64 word;
+        memcpy(&word, text + i, sizeof(word));
+        if (word & highBits)
+            break;
+        for (int j = 0; j < 8; j++)
+            out[i + j] = uchar(text[i + j]);
+    }
+#endif
+
+    for (; i < length && !(text[i] & 0x80); i++)
+        out[i] = uchar(text[i]);
+
+    return i;
+}
+
+static const uint ReplacementChar = 0xfffd;
+
+// decodes the UTF-8 sequence at 'p' if all of its bytes are there and
+// moves 'p' past it, with the same result as decoding it a byte at a time
+// in receiveUtf8Data().  Returns false for a sequence which is incomplete
+// or broken off, which is left to the decoding a byte at a time
+static inline bool decodeUtf8Sequence(const char*& p, const char* end, uint& codePoint)
+{
+    const uchar lead = *p;
+    int length;
+    uint minCodePoint;
+
+    if ((lead & 0xe0) == 0xc0) {
+        length = 2;
+        codePoint = lead & 0x1f;
+        minCodePoint = 0x80;
+    } else if ((lead & 0xf0) == 0xe0) {
+        length = 3;
+        codePoint = lead & 0x0f;
+        minCodePoint = 0x800;
+    } else if ((lead & 0xf8) == 0xf0) {
+        length = 4;
+        codePoint = lead & 0x07;
+        minCodePoint = 0x10000;
+    } else {
+        return false;
+    }
+
+    if (end - p < length)
+        return false;
+
+    for (int i = 1; i < length; i++) {
+        const uchar byte = p[i];
+        if ((byte & 0xc0) != 0x80)
+            return false;
+        codePoint = (codePoint << 6) | (byte & 0x3f);
+    }
+
+    // reject overlong forms, surrogates and values beyond U+10FFFF
+    if (codePoint < minCodePoint || codePoint > 0x10ffff ||
+            (codePoint >= 0xd800 && codePoint <= 0xdfff))
+        codePoint = ReplacementChar;
+
+    p += length;
+    return true;
+}
+
+void Emulation::receiveUtf8Data(const char* text, int length)
+{
+    static const int BufferSize = 1024;
+
+    // decoded characters are collected here and passed on in blocks,
+    // with room for the second half of a surrogate pair at the end
+    ushort buffer[BufferSize + 1];
+    int count = 0;
+
+    const char* p = text;
+    const char* const end = text + length;
+
+    while (p < end) {
+        if (_utf8Remaining == 0) {
+            // plain ASCII is widened without any decoding
+            while (p < end) {
+                const int n = widenAscii(p, qMin(int(end - p), BufferSize - count), buffer + count);
+                count += n;
+                p += n;
+
+                if (count < BufferSize)
+                    break;
+                receiveChars(buffer, count);
+                count = 0;
+            }
+
+            if (p == end)
+                break;
+        }
+
+        const uchar byte = *p;
+        uint codePoint = 0;
+
+        if (_utf8Remaining == 0 && decodeUtf8Sequence(p, end, codePoint)) {
+            // the whole sequence was in the buffer
+        } else if (_utf8Remaining > 0) {
+            if ((byte & 0xc0) == 0x80) {
+                p++;
+                _utf8CodePoint = (_utf8CodePoint << 6) | (byte & 0x3f);
+                if (--_utf8Remaining > 0)
+                    continue;
+
+                codePoint = _utf8CodePoint;
+                // reject overlong forms, surrogates and values beyond U+10FFFF
+                if (codePoint < _utf8MinCodePoint || codePoint > 0x10ffff ||
+                        (codePoint >= 0xd800 && codePoint <= 0xdfff))
+                    codePoint = ReplacementChar;
+            } else {
+                // truncated sequence, the current byte starts a new one
+                _utf8Remaining = 0;
+                codePoint = ReplacementChar;
+            }
+        } else {
+            p++;
+            if ((byte & 0xe0) == 0xc0) {
+                _utf8Remaining = 1;
+                _utf8CodePoint = byte & 0x1f;
+                _utf8MinCodePoint = 0x80;
+                continue;
+            } else if ((byte & 0xf0) == 0xe0) {
+                _utf8Remaining = 2;
+                _utf8CodePoint = byte & 0x0f;
+                _utf8MinCodePoint = 0x800;
+                continue;
+            } else if ((byte & 0xf8) == 0xf0) {
+                _utf8Remaining = 3;
+                _utf8CodePoint = byte & 0x07;
+                _utf8MinCodePoint = 0x10000;
+                continue;
+            } else {
+                codePoint = ReplacementChar;
+            }
+        }
+
+        // the rest of the emulation works with UTF-16 code units,
+        // so characters outside the BMP are passed on as surrogate pairs
+        if (codePoint >= 0x10000) {
+            buffer[count++] = QChar::highSurrogate(codePoint);
+            buffer[count++] = QChar::lowSurrogate(codePoint);
+        } else {
+            buffer[count++] = codePoint;
+        }
+
+        if (count >= BufferSize) {
+            receiveChars(buffer, count);
+            count = 0;
+        }
+    }
+
+    if (count > 0)
+        receiveChars(buffer, count);
+}
+
 //OLDER VERSION
 //This version of onRcvBlock was commented out because
 //    a)  It decoded incoming characters one-by-one, which is slow in the current version of Qt (4.2 tech preview)
@@ -288,6 +975,11 @@ void Emulation::writeToStream(TerminalCharacterDecoder* decoder ,
     _currentScreen->writeLinesToStream(decoder, startLine, endLine);
 }
 
+ScreenSnapshot Emulation::snapshot(int startLine, int endLine) const
+{
+    return _currentScreen->snapshot(startLine, endLine);
+}
+
 int Emulation::lineCount() const
 {
     // sum number of lines currently on _screen plus number of lines in history
@@ -298,26 +990,156 @@ void Emulation::showBulk()
 {
     _bulkTimer1.stop();
     _bulkTimer2.stop();
+    _echoClock.invalidate();
+
+    QElapsedTimer updateTimer;
+    updateTimer.start();
 
     emit outputChanged();
 
     _currentScreen->resetScrolledLines();
     _currentScreen->resetDroppedLines();
+
+    measureUpdate(updateTimer.elapsed());
+
+    _historyCompactionTimer.start(HISTORY_COMPACTION_DELAY);
+}
+
+// interval between updates while the output rate is low, which
+// matches the refresh rate of common displays
+static const int FRAME_INTERVAL = 16;
+// when throttled, updating the views should take at most
+// 1/UPDATE_COST_FACTOR of the time
+static const int UPDATE_COST_FACTOR = 4;
+static const int MAX_THROTTLED_INTERVAL = 250;
+
+void Emulation::setUpdateScheduling(int latency, int maximumInterval, int highOutputRate)
+{
+    _updateLatency = qMax(0, latency);
+    _maximumUpdateInterval = qMax(1, maximumInterval);
+    _highOutputRate = qMax(1, highOutputRate);
+
+    chooseUpdateInterval();
+}
+
+void Emulation::setFloodModeParameters(int floodOutputRate, int frameRate)
+{
+    _floodOutputRate = qMax(0, floodOutputRate);
+    _floodFrameRate = qMax(1, frameRate);
+
+    chooseUpdateInterval();
+}
+
+void Emulation::measureUpdate(int updateCost)
+{
+    UpdateStatistics& stats = _updateStatistics;
+
+    const qint64 elapsed = _updateClock.isValid() ? _updateClock.restart() : 0;
+    if (!_updateClock.isValid())
+        _updateClock.start();
+
+    // exponential moving averages, so that a single large block or slow
+    // update does not change the scheduling on its own
+    if (elapsed > 0)
+        stats.outputRate = (3 * stats.outputRate + _receivedBytes * 1000 / elapsed) / 4;
+    stats.updateCost = (3 * stats.updateCost + updateCost) / 4;
+    stats.updateCount++;
+    _receivedBytes = 0;
+
+    chooseUpdateInterval();
+}
+
+void Emulation::chooseUpdateInterval()
+{
+    UpdateStatistics& stats = _updateStatistics;
+
+    const bool floodMode = _floodOutputRate > 0 && stats.outputRate >= _floodOutputRate;
+    const bool throttled = floodMode || stats.outputRate >= _highOutputRate;
+    stats.throttled = throttled;
+
+    if (throttled) {
+        stats.updateInterval = qBound(_maximumUpdateInterval,
+                                      UPDATE_COST_FACTOR * stats.updateCost,
+                                      qMax(_maximumUpdateInterval, MAX_THROTTLED_INTERVAL));
+    } else {
+        stats.updateInterval = qMin(FRAME_INTERVAL, _maximumUpdateInterval);
+    }
+
+    // the views only build a new frame when outputChanged() is emitted,
+    // so capping the rate of updates also skips the intermediate frames
+    if (floodMode)
+        stats.updateInterval = qMax(stats.updateInterval, 1000 / _floodFrameRate);
+
+    if (floodMode != stats.floodMode) {
+        stats.floodMode = floodMode;
+        emit floodModeChanged(floodMode);
+    }
+}
+
+// time after a key press during which output is treated as its echo
+static const int ECHO_TIMEOUT = 100;
+
+void Emulation::keyPressSent()
+{
+    _echoClock.start();
 }
 
 void Emulation::bufferedUpdate()
 {
-    static const int BULK_TIMEOUT1 = 10;
-    static const int BULK_TIMEOUT2 = 40;
+    // the update is shown once the program has finished drawing the frame
+    if (_synchronizedUpdateTimer.isActive()) {
+        _updateDeferred = true;
+        return;
+    }
 
-    _bulkTimer1.setSingleShot(true);
-    _bulkTimer1.start(BULK_TIMEOUT1);
-    if (!_bulkTimer2.isActive()) {
-        _bulkTimer2.setSingleShot(true);
-        _bulkTimer2.start(BULK_TIMEOUT2);
+    // the echo of a key press is shown as soon as the events which are
+    // already waiting have been processed, which joins it with the rest
+    // of the output read with it
+    if (_echoClock.isValid() && !_updateStatistics.throttled) {
+        if (_echoClock.elapsed() < ECHO_TIMEOUT) {
+            _bulkTimer1.start(0);
+            return;
+        }
+        _echoClock.invalidate();
+    }
+
+    // at high output rates the display is updated at a fixed pace instead
+    // of waiting for the output to become quiet
+    if (!_updateStatistics.throttled)
+        _bulkTimer1.start(_updateLatency);
+    if (!_bulkTimer2.isActive())
+        _bulkTimer2.start(_updateStatistics.updateInterval);
+}
+
+void Emulation::setSynchronizedUpdate(bool enable)
+{
+    if (enable) {
+        if (_synchronizedUpdateTimer.isActive())
+            return;
+
+        // output which is waiting to be shown becomes part of the frame
+        _updateDeferred = _bulkTimer1.isActive() || _bulkTimer2.isActive();
+        _bulkTimer1.stop();
+        _bulkTimer2.stop();
+        _synchronizedUpdateTimer.start();
+    } else if (_synchronizedUpdateTimer.isActive()) {
+        _synchronizedUpdateTimer.stop();
+
+        // the frame is shown once the rest of the output read along
+        // with it has been processed
+        if (_updateDeferred)
+            _bulkTimer1.start(0);
+        _updateDeferred = false;
     }
 }
 
+void Emulation::synchronizedUpdateTimeout()
+{
+    if (_updateDeferred)
+        showBulk();
+    _updateDeferred = false;
+}
+
 char Emulation::eraseChar() const
 {
     return '\b';
@@ -330,8 +1152,9 @@ void Emulation::setImageSize(int lines, int columns)
 
     QSize screenSize[2] = { QSize(_screen[0]->getColumns(),
                                   _screen[0]->getLines()),
-                            QSize(_screen[1]->getColumns(),
-                                  _screen[1]->getLines())
+                            _screen[1] ? QSize(_screen[1]->getColumns(),
+                                               _screen[1]->getLines())
+                                       : QSize(columns, lines)
                           };
     QSize newSize(columns, lines);
 
@@ -344,7 +1167,8 @@ void Emulation::setImageSize(int lines, int columns)
         }
     } else {
         _screen[0]->resizeImage(lines, columns);
-        _screen[1]->resizeImage(lines, columns);
+        if (_screen[1])
+            _screen[1]->resizeImage(lines, columns);
 
         emit imageSizeChanged(lines, columns);
 
@@ -24,6 +24,7 @@
 #define EMULATION_H
 
 // Qt
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QSize>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTimer>
@@ -38,6 +39,7 @@ namespace Konsole
 class KeyboardTranslator;
 class HistoryType;
 class Screen;
+class ScreenSnapshot;
 class ScreenWindow;
 class TerminalCharacterDecoder;
 
@@ -151,6 +153,43 @@ public:
     const HistoryType& history() const;
     /** Clears the history scroll. */
     void clearHistory();
+    /**
+     * Sets whether an index of the history is kept, which speeds up
+     * searching it.  See Screen::setHistoryIndexEnabled()
+     */
+    void setHistoryIndexEnabled(bool enable);
+    /**
+     * Narrows the lines from @p startLine to @p endLine, numbered as in
+     * writeToStream(), down to those which may contain @p text.  Returns
+     * false if none of them can.  See Screen::findCandidateLines()
+     */
+    bool findCandidateLines(const QString& text, int& startLine, int& endLine) const;
+    /** Returns the number of bytes of memory used by the history store. */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Returns the number of bytes of memory which the history store keeps
+     * using once a conversion started by setHistory() has finished.
+     */
+    qint64 retainedHistoryMemoryUsage() const;
+    /** Returns the number of lines in the history of the primary screen. */
+    int historyLineCount() const;
+    /** Returns the number of bytes of the files the history is kept in. */
+    qint64 historyFileSize() const;
+    /** Returns the number of bytes of memory used by the images of both screens. */
+    qint64 screenMemoryUsage() const;
+    /**
+     * Returns the number of bytes of memory which the sequences of unicode
+     * characters used on the screens and in the history take up in the
+     * ExtendedCharTable.  This looks at every line of the history.
+     */
+    qint64 extendedCharMemoryUsage() const;
+
+    /**
+     * Gives back memory which the emulation does not need at the moment:
+     * the history is compacted, the lines of the screens are squeezed and
+     * the alternate screen is deleted unless it is in use.
+     */
+    void releaseMemory();
 
     /**
      * Copies the output history from @p startLine to @p endLine
@@ -165,6 +204,13 @@ public:
      */
     virtual void writeToStream(TerminalCharacterDecoder* decoder, int startLine, int endLine);
 
+    /**
+     * Returns a snapshot of the output from @p startLine to @p endLine,
+     * which can be written to a stream on another thread like
+     * writeToStream() does.  See Screen::snapshot()
+     */
+    ScreenSnapshot snapshot(int startLine, int endLine) const;
+
     /** Returns the codec used to decode incoming characters.  See setCodec() */
     const QTextCodec* codec() const {
         return _codec;
@@ -183,6 +229,119 @@ public:
     }
 
 
+    /**
+     * Sets whether the incoming data is searched for the sequence which
+     * starts a ZModem transfer.  When enabled, the zmodemDetected() signal
+     * is emitted when such a sequence is received.  Enabled by default.
+     */
+    void setZModemDetectionEnabled(bool enabled);
+    /** Returns true if ZModem detection is enabled.  See setZModemDetectionEnabled() */
+    bool zmodemDetectionEnabled() const;
+
+    /**
+     * Sets whether output which looks like the contents of a binary file is
+     * detected.  When enabled and a block of output written to the primary
+     * screen consists largely of bytes which text hardly ever contains, such
+     * as NUL and most other control characters, the emulation switches to
+     * binary output mode.  In this mode the output is not interpreted: the
+     * printable ASCII characters, tabs, carriage returns and line feeds are
+     * written to the screen and every other byte is shown as a dot.  The
+     * emulation switches back once the output looks like text again or when
+     * it is reset.  Enabled by default, see
+     * Profile::BinaryOutputDetectionEnabled.
+     */
+    void setBinaryOutputDetectionEnabled(bool enabled);
+    /** Returns true if binary output detection is enabled.  See setBinaryOutputDetectionEnabled() */
+    bool binaryOutputDetectionEnabled() const;
+    /** Returns true if the emulation is in binary output mode.  See setBinaryOutputDetectionEnabled() */
+    bool binaryOutputMode() const;
+
+    /**
+     * Sets whether output which scrolls off the screen before it could be
+     * seen is skipped.  When enabled and the current screen keeps no
+     * history, the text in a block of output which is followed by more
+     * than a screenful of lines is not written to the screen.  Only the
+     * changes of the rendition in it are still applied.  Disabled by default.
+     */
+    void setFastForwardEnabled(bool enabled);
+    /** Returns true if skipping scrolled off output is enabled.  See setFastForwardEnabled() */
+    bool fastForwardEnabled() const;
+
+    /**
+     * Sets whether the lines of the primary screen are rewrapped when the
+     * number of columns changes.  See Screen::setReflowLines()
+     */
+    void setReflowLines(bool enable);
+
+    /**
+     * Sets how long, in seconds, the alternate screen is kept after the
+     * terminal has switched back to the primary screen.  The alternate
+     * screen is only allocated when a program first switches to it and is
+     * released again once it has not been used for @p seconds.
+     * A value of 0 keeps the alternate screen until the emulation is destroyed.
+     */
+    void setAlternateScreenReleaseDelay(int seconds);
+
+    /**
+     * Sets the parameters used to decide when attached views are updated
+     * after output has been received.
+     *
+     * While less than @p highOutputRate bytes per second are received, views
+     * are updated once no output has arrived for @p latency milliseconds, and
+     * at least once per display frame.  Above that rate, updates are throttled
+     * to one every @p maximumInterval milliseconds, or fewer if updating the
+     * views is expensive.
+     */
+    void setUpdateScheduling(int latency, int maximumInterval, int highOutputRate);
+
+    /**
+     * Sets the parameters of flood mode.  While more than @p floodOutputRate
+     * bytes per second are received, the attached views are updated at most
+     * @p frameRate times per second, and the floodModeChanged() signal is
+     * emitted when this starts and stops.
+     *
+     * Flood mode is disabled if @p floodOutputRate is 0.
+     */
+    void setFloodModeParameters(int floodOutputRate, int frameRate);
+
+    /** Measurements used to schedule updates of the attached views. */
+    struct UpdateStatistics {
+        /** Smoothed rate of incoming output, in bytes per second */
+        qint64 outputRate;
+        /** Smoothed time taken to update the attached views, in milliseconds */
+        int updateCost;
+        /** The longest delay before the next update, in milliseconds */
+        int updateInterval;
+        /** True if updates are throttled because of a high output rate */
+        bool throttled;
+        /** True if the output rate is high enough to enter flood mode */
+        bool floodMode;
+        /** Number of updates performed so far */
+        int updateCount;
+    };
+
+    /** Returns the measurements used to schedule updates of the attached views. */
+    const UpdateStatistics& updateStatistics() const {
+        return _updateStatistics;
+    }
+
+    /** Totals about the output processed by the emulation. */
+    struct ProcessingStatistics {
+        /** Number of bytes received */
+        qint64 receivedBytes;
+        /** Number of blocks of output passed to receiveData() */
+        qint64 blockCount;
+        /** Time spent processing the output, in microseconds */
+        qint64 processingTime;
+        /** Number of characters and control functions in the output */
+        qint64 tokenCount;
+    };
+
+    /** Returns the totals about the output processed by the emulation. */
+    const ProcessingStatistics& processingStatistics() const {
+        return _processingStatistics;
+    }
+
     /** Returns the special character used for erasing character. */
     virtual char eraseChar() const;
 
@@ -215,6 +374,16 @@ public:
      */
     bool programUsesMouse() const;
 
+    /**
+     * Returns true if the active terminal program wants pasted text to be
+     * surrounded by ESC[200~ and ESC[201~, so that it can tell the text
+     * apart from typed input.
+     *
+     * The programBracketedPasteModeChanged() signal is emitted when this
+     * changes.
+     */
+    bool programBracketedPasteMode() const;
+
 public slots:
 
     /** Change the size of the emulation's image */
@@ -232,6 +401,14 @@ public slots:
      */
     virtual void sendKeyEvent(QKeyEvent*);
 
+    /**
+     * Interprets the key press @p event as if it happened @p count times in
+     * a row.  This is equivalent to calling sendKeyEvent() @p count times,
+     * but emulations can look up the key once and send the characters for
+     * all the presses at once.
+     */
+    virtual void sendKeyEvents(QKeyEvent* event, int count);
+
     /**
      * Converts information about a mouse event into an xterm-compatible escape
      * sequence and emits the character sequence via sendData()
@@ -252,6 +429,14 @@ public slots:
      * character buffer using the current codec(), and then calls receiveChar() for
      * each unicode character in the resulting buffer.
      *
+     * When the codec is UTF-8 the buffer is decoded directly without going
+     * through QTextCodec, and runs of 7-bit ASCII are passed on without any
+     * conversion.  Decoded characters are handed to receiveChars() in blocks.
+     *
+     * If zmodemDetectionEnabled() is true, receiveData() also checks @p buffer
+     * for the start of a ZModem transfer.  If fastForwardEnabled() is true,
+     * output which would scroll off the screen right away is skipped.
+     *
      * receiveData() also starts a timer which causes the outputChanged() signal
      * to be emitted when it expires.  The timer allows multiple updates in quick
      * succession to be buffered into a single outputChanged() signal emission.
@@ -283,8 +468,9 @@ signals:
     /**
      * Emitted when the activity state of the emulation is set.
      *
-     * @param state The new activity state, one of NOTIFYNORMAL, NOTIFYACTIVITY
-     * or NOTIFYBELL
+     * @param state The new activity state, NOTIFYNORMAL or NOTIFYBELL.
+     * The output is not signalled here for each block received, the
+     * session watches its activity itself.
      */
     void stateSet(int state);
 
@@ -314,6 +500,12 @@ signals:
      */
     void programUsesMouseChanged(bool usesMouse);
 
+    /**
+     * This is emitted when the program running in the shell turns the
+     * bracketed paste mode on or off.  See programBracketedPasteMode()
+     */
+    void programBracketedPasteModeChanged(bool bracketedPasteMode);
+
     /**
      * Emitted when the contents of the screen image change.
      * The emulation buffers the updates from successive image changes,
@@ -399,6 +591,12 @@ signals:
      */
     void flowControlKeyPressed(bool suspendKeyPressed);
 
+    /**
+     * Emitted when flood mode is entered or left.
+     * See setFloodModeParameters()
+     */
+    void floodModeChanged(bool floodMode);
+
     /**
      * Emitted when the active screen is switched, to indicate whether the primary
      * screen is in use.
@@ -414,12 +612,29 @@ protected:
     virtual void setMode(int mode) = 0;
     virtual void resetMode(int mode) = 0;
 
+    /**
+     * Called when a key press has been sent to the terminal.  The output
+     * which arrives shortly afterwards is most likely its echo, so the
+     * views are updated with it right away instead of after the usual delay.
+     */
+    void keyPressSent();
+
     /**
      * Processes an incoming character.  See receiveData()
      * @p ch A unicode character code.
      */
     virtual void receiveChar(int ch);
 
+    /**
+     * Processes a run of incoming UTF-16 code units.  The default
+     * implementation calls receiveChar() for each one in turn, emulations
+     * can reimplement this to handle runs of printable characters in bulk.
+     *
+     * @p chars The characters to process
+     * @p count The number of characters in @p chars
+     */
+    virtual void receiveChars(const ushort* chars, int count);
+
     /**
      * Sets the active screen.  The terminal has two screens, primary and alternate.
      * The primary screen is used by default.  When certain interactive programs such
@@ -429,6 +644,13 @@ protected:
      */
     void setScreen(int index);
 
+    /**
+     * Returns the alternate screen, creating it with the size, margins and
+     * modes of the primary screen if it has not been allocated yet or has
+     * been released.  See setAlternateScreenReleaseDelay()
+     */
+    Screen* alternateScreen();
+
     enum EmulationCodec {
         LocaleCodec = 0,
         Utf8Codec   = 1
@@ -436,6 +658,57 @@ protected:
 
     void setCodec(EmulationCodec codec);
 
+    /**
+     * Decodes a UTF-8 encoded buffer and passes the resulting UTF-16 code
+     * units on to receiveChars().  Incomplete sequences at the end of
+     * @p text are kept and completed by the next call.
+     */
+    void receiveUtf8Data(const char* text, int length);
+
+    /**
+     * Called with @p length bytes of UTF-8 encoded output from @p text
+     * when fastForwardEnabled() is true.  The output only contains
+     * printable characters, tabs, backspaces, carriage returns, @p lineFeeds
+     * line feeds and SGR sequences, and it is followed by a carriage return
+     * and enough line feeds to scroll everything on the screen out of sight.
+     *
+     * Emulations which can tell that this is still true in their current
+     * state can reimplement this to only apply the changes of the rendition
+     * and move the cursor to the bottom line, and return true.  The default
+     * implementation returns false, which processes the output as usual.
+     */
+    virtual bool skipScrolledOutput(const char* text, int length, int lineFeeds);
+
+    /**
+     * Discards any partly received control sequence, so that the output
+     * which follows is read from the start of a sequence.  This is called
+     * when binary output begins, whose bytes would otherwise be taken as
+     * the rest of the sequence.  The default implementation does nothing.
+     */
+    virtual void resetParser();
+
+    /**
+     * Updates the binary output mode for the next @p length bytes of output
+     * from @p text.  See setBinaryOutputDetectionEnabled()
+     */
+    void detectBinaryOutput(const char* text, int length);
+    /** Writes binary output to the screen without interpreting it */
+    void receiveBinaryData(const char* text, int length);
+
+    /** Adds to the number of tokens in processingStatistics(). */
+    void addProcessedTokens(int count) {
+        _processingStatistics.tokenCount += count;
+    }
+
+    /**
+     * Starts or ends a synchronized update.  While the program running in
+     * the terminal is drawing a new frame, which it announces with a
+     * control sequence, the attached views are not updated, so that they
+     * show each frame once it is complete.  If the program does not end
+     * the update within a short time, the views are updated anyway.
+     */
+    void setSynchronizedUpdate(bool enable);
+
     QList<ScreenWindow*> _windows;
 
     Screen* _currentScreen;  // pointer to the screen which is currently active,
@@ -445,6 +718,8 @@ protected:
     //                      scrollbars are enabled in this mode )
     // 1 = alternate      ( used by vi , emacs etc.
     //                      scrollbars are not enabled in this mode )
+    //                      this is 0 until a program switches to it,
+    //                      see alternateScreen()
 
 
     //decodes an incoming C-style character stream into a unicode QString using
@@ -453,6 +728,19 @@ protected:
     QTextDecoder* _decoder;
     const KeyboardTranslator* _keyTranslator; // the keyboard layout
 
+    // state of the built-in UTF-8 decoder used by receiveUtf8Data()
+    bool _utf8FastPath;       // true if the codec is UTF-8
+    int _utf8Remaining;       // continuation bytes still expected
+    uint _utf8CodePoint;      // code point decoded so far
+    uint _utf8MinCodePoint;   // smallest code point allowed for the sequence
+
+    bool _zmodemDetection;
+    bool _fastForward;
+
+    bool _binaryOutputDetection;
+    bool _binaryOutput;        // true in binary output mode
+    int _textualBytes;         // bytes of text received in binary output mode
+
 protected slots:
     /**
      * Schedules an update of attached views.
@@ -473,12 +761,48 @@ private slots:
     void showBulk();
 
     void usesMouseChanged(bool usesMouse);
+    void bracketedPasteModeChanged(bool bracketedPasteMode);
+
+    // deletes the alternate screen if the primary screen is in use
+    void releaseAlternateScreen();
+
+    // gives back memory which the history no longer needs
+    void compactHistory();
+
+    // copies another batch of lines into a new history, see Screen::setScroll()
+    void convertHistory();
+
+    // ends a synchronized update which took too long, see setSynchronizedUpdate()
+    void synchronizedUpdateTimeout();
 
 private:
     bool _usesMouse;
-    QTimer _bulkTimer1;
-    QTimer _bulkTimer2;
+    bool _bracketedPasteMode;
+    // recalculates _updateStatistics after an update which took 'updateCost' ms
+    void measureUpdate(int updateCost);
+    // selects the update interval suitable for the current output rate
+    void chooseUpdateInterval();
+
+    QTimer _bulkTimer1;  // restarted on each update request, fires once output is quiet
+    QTimer _bulkTimer2;  // limits the delay before an update
+    QTimer _synchronizedUpdateTimer;  // runs while a synchronized update is open
+    bool _updateDeferred;  // an update was requested during the synchronized update
+    int _updateLatency;
+    int _maximumUpdateInterval;
+    int _highOutputRate;
+    int _floodOutputRate;
+    int _floodFrameRate;
+    QElapsedTimer _updateClock;  // time since the last update
+    QElapsedTimer _echoClock;    // time since a key press, invalid once the next update was shown
+    qint64 _receivedBytes;       // bytes received since the last update
+    UpdateStatistics _updateStatistics;
+    ProcessingStatistics _processingStatistics;
     bool _imageSizeInitialized;
+    QTimer _selectedTextTimer;  // restarted on each selection change, see checkSelectedText()
+    QTimer _alternateScreenTimer;  // started when switching back to the primary screen
+    int _alternateScreenReleaseDelay;
+    QTimer _historyCompactionTimer;  // restarted on each update, fires once the terminal is idle
+    QTimer _historyConversionTimer;  // runs while the history is converted to another type
 };
 }
 
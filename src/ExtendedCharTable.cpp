@@ -22,29 +22,35 @@
 // Own
 #include "ExtendedCharTable.h"
 
+// Qt
+#include <QtCore/QVarLengthArray>
+
 // KDE
 #include <KDebug>
 
 // Konsole
-#include "TerminalDisplay.h"
-#include "SessionManager.h"
-#include "Session.h"
 #include "Screen.h"
 
 using namespace Konsole;
 
-ExtendedCharTable::ExtendedCharTable()
-{
-}
+// the smallest table which is checked for unused sequences
+static const int MINIMUM_SWEEP_THRESHOLD = 1024;
+
+// the histories are read in full when more sequences than this are left
+// after checking the lines which were added to them.  The hashes leave
+// room for 65535 sequences
+static const int EXACT_SWEEP_THRESHOLD = 16384;
 
-ExtendedCharTable::~ExtendedCharTable()
+// the longest sequence appendExtendedChar() creates.  Each mark copies the
+// sequence it is added to, so without a limit an endless run of combining
+// marks takes quadratic time and fills the table with its prefixes
+static const int MAXIMUM_APPENDED_LENGTH = 32;
+
+ExtendedCharTable::ExtendedCharTable()
+    : _sweepThreshold(MINIMUM_SWEEP_THRESHOLD)
+    , _generation(0)
+    , _sweeping(false)
 {
-    // free all allocated character buffers
-    QHashIterator<ushort, ushort*> iter(extendedCharTable);
-    while (iter.hasNext()) {
-        iter.next();
-        delete[] iter.value();
-    }
 }
 
 // global instance
@@ -52,6 +58,15 @@ ExtendedCharTable ExtendedCharTable::instance;
 
 ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushort length)
 {
+    if (extendedCharTable.count() >= _sweepThreshold && !_sweeping) {
+        removeUnusedChars(false);
+        if (extendedCharTable.count() >= EXACT_SWEEP_THRESHOLD)
+            removeUnusedChars(true);
+
+        // the next time is once the sequences which are left have doubled
+        _sweepThreshold = qMax(MINIMUM_SWEEP_THRESHOLD, 2 * extendedCharTable.count());
+    }
+
     // look for this sequence of points in the table
     ushort hash = extendedCharHash(unicodePoints, length);
     const ushort initialHash = hash;
@@ -69,27 +84,11 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
             hash++;
 
             if (hash == initialHash) {
-                if (!triedCleaningSolution) {
+                if (!triedCleaningSolution && !_sweeping) {
                     triedCleaningSolution = true;
-                    // All the hashes are full, go to all Screens and try to free any
-                    // This is slow but should happen very rarely
-                    QSet<ushort> usedExtendedChars;
-                    const SessionManager* sm = SessionManager::instance();
-                    foreach(const Session * s, sm->sessions()) {
-                        foreach(const TerminalDisplay * td, s->views()) {
-                            usedExtendedChars += td->screenWindow()->screen()->usedExtendedChars();
-                        }
-                    }
-
-                    QHash<ushort, ushort*>::iterator it = extendedCharTable.begin();
-                    QHash<ushort, ushort*>::iterator itEnd = extendedCharTable.end();
-                    while (it != itEnd) {
-                        if (usedExtendedChars.contains(it.key())) {
-                            ++it;
-                        } else {
-                            it = extendedCharTable.erase(it);
-                        }
-                    }
+                    // All the hashes are full, try to free any.
+                    // This should happen very rarely
+                    removeUnusedChars(true);
                 } else {
                     kWarning() << "Using all the extended char hashes, going to miss this extended character";
                     return 0;
@@ -100,31 +99,90 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
 
     // add the new sequence to the table and
     // return that index
-    ushort* buffer = new ushort[length + 1];
-    buffer[0] = length;
-    for (int i = 0 ; i < length ; i++)
-        buffer[i + 1] = unicodePoints[i];
+    QVector<ushort> sequence(length);
+    memcpy(sequence.data(), unicodePoints, sizeof(ushort) * length);
 
-    extendedCharTable.insert(hash, buffer);
+    extendedCharTable.insert(hash, sequence);
 
     return hash;
 }
 
-ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
+const ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
 {
     // look up index in table and if found, set the length
     // argument and return a pointer to the character sequence
 
-    ushort* buffer = extendedCharTable[hash];
-    if (buffer) {
-        length = buffer[0];
-        return buffer + 1;
+    QHash<ushort, QVector<ushort> >::const_iterator it = extendedCharTable.constFind(hash);
+    if (it != extendedCharTable.constEnd()) {
+        length = it->count();
+        return it->constData();
     } else {
         length = 0;
         return 0;
     }
 }
 
+void ExtendedCharTable::addScreen(const Screen* screen)
+{
+    _screens.insert(screen);
+}
+
+void ExtendedCharTable::removeScreen(const Screen* screen)
+{
+    _screens.remove(screen);
+}
+
+qint64 ExtendedCharTable::memoryUsage(const QSet<ushort>& hashes) const
+{
+    qint64 usage = 0;
+    foreach(ushort hash, hashes) {
+        QHash<ushort, QVector<ushort> >::const_iterator it = extendedCharTable.constFind(hash);
+        if (it != extendedCharTable.constEnd())
+            usage += (it->count() + 1) * sizeof(ushort);
+    }
+    return usage;
+}
+
+void ExtendedCharTable::removeUnusedChars(bool exact)
+{
+    QSet<ushort> usedExtendedChars;
+    _sweeping = true;
+    foreach(const Screen* screen, _screens) {
+        usedExtendedChars += screen->usedExtendedChars(exact);
+    }
+    _sweeping = false;
+
+    const int oldCount = extendedCharTable.count();
+
+    QHash<ushort, QVector<ushort> >::iterator it = extendedCharTable.begin();
+    while (it != extendedCharTable.end()) {
+        if (usedExtendedChars.contains(it.key()))
+            ++it;
+        else
+            it = extendedCharTable.erase(it);
+    }
+
+    if (extendedCharTable.count() != oldCount)
+        _generation++;
+}
+
+ushort ExtendedCharTable::appendExtendedChar(ushort hash , const ushort* unicodePoints , ushort length)
+{
+    ushort oldLength = 0;
+    const ushort* oldChars = lookupExtendedChar(hash, oldLength);
+    Q_ASSERT(oldChars);
+    if (!oldChars || oldLength + length > MAXIMUM_APPENDED_LENGTH)
+        return hash;
+
+    // the sequence fits on the stack.  The old sequence is copied, since
+    // it may be removed from the table now
+    QVarLengthArray<ushort, MAXIMUM_APPENDED_LENGTH> chars(oldLength + length);
+    memcpy(chars.data(), oldChars, sizeof(ushort) * oldLength);
+    memcpy(chars.data() + oldLength, unicodePoints, sizeof(ushort) * length);
+
+    return createExtendedChar(chars.constData(), chars.size());
+}
+
 ushort ExtendedCharTable::extendedCharHash(const ushort* unicodePoints , ushort length) const
 {
     ushort hash = 0;
@@ -136,18 +194,12 @@ ushort ExtendedCharTable::extendedCharHash(const ushort* unicodePoints , ushort
 
 bool ExtendedCharTable::extendedCharMatch(ushort hash , const ushort* unicodePoints , ushort length) const
 {
-    ushort* entry = extendedCharTable[hash];
+    QHash<ushort, QVector<ushort> >::const_iterator it = extendedCharTable.constFind(hash);
 
-    // compare given length with stored sequence length ( given as the first ushort in the
-    // stored buffer )
-    if (entry == 0 || entry[0] != length)
+    // compare given length with stored sequence length
+    if (it == extendedCharTable.constEnd() || it->count() != length)
         return false;
-    // if the lengths match, each character must be checked.  the stored buffer starts at
-    // entry[1]
-    for (int i = 0 ; i < length ; i++) {
-        if (entry[i + 1] != unicodePoints[i])
-            return false;
-    }
-    return true;
+    // if the lengths match, each character must be checked
+    return memcmp(it->constData(), unicodePoints, sizeof(ushort) * length) == 0;
 }
 
@@ -24,21 +24,35 @@
 
 // Qt
 #include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
 
 namespace Konsole
 {
+class Screen;
+
 /**
  * A table which stores sequences of unicode characters, referenced
  * by hash keys.  The hash key itself is the same size as a unicode
  * character ( ushort ) so that it can occupy the same space in
  * a structure.
+ *
+ * Sequences which are no longer used by any of the screens added with
+ * addScreen() are removed from the table each time it has doubled in
+ * size, which keeps the table small and its hash chains short.  The
+ * screens' histories are only read in full when that leaves the table
+ * large, see Screen::usedExtendedChars().  Once a sequence has been
+ * removed, its hash may stand for another sequence, see generation().
+ *
+ * The sequences are implicitly shared, so a copy of the table is cheap.
+ * A copy can be read on another thread while the original is changed,
+ * see ScreenSnapshot.
  */
 class ExtendedCharTable
 {
 public:
     /** Constructs a new character table. */
     ExtendedCharTable();
-    ~ExtendedCharTable();
 
     /**
      * Adds a sequences of unicode characters to the table and returns
@@ -62,7 +76,40 @@ public:
      *
      * @return A unicode character sequence of size @p length.
      */
-    ushort* lookupExtendedChar(ushort hash , ushort& length) const;
+    const ushort* lookupExtendedChar(ushort hash , ushort& length) const;
+    /**
+     * Returns the hash of the sequence which consists of the sequence
+     * specified by @p hash followed by @p length more unicode characters
+     * from @p unicodePoints, adding it to the table if necessary.
+     *
+     * If there is no sequence for @p hash, or if the new sequence would be
+     * longer than a base character with more combining marks than any
+     * script uses, @p hash is returned.
+     */
+    ushort appendExtendedChar(ushort hash , const ushort* unicodePoints , ushort length);
+
+    /**
+     * Adds a screen whose characters, including those in its history,
+     * use the sequences in the table.
+     */
+    void addScreen(const Screen* screen);
+    /** Removes a screen added with addScreen() */
+    void removeScreen(const Screen* screen);
+
+    /**
+     * Returns the number of bytes of memory used by the sequences specified
+     * by @p hashes, see Screen::usedExtendedChars()
+     */
+    qint64 memoryUsage(const QSet<ushort>& hashes) const;
+
+    /**
+     * Returns a number which changes each time sequences are removed from
+     * the table.  Caches of what the hashes stand for must be cleared when
+     * it changes.
+     */
+    quint64 generation() const {
+        return _generation;
+    }
 
     /** The global ExtendedCharTable instance. */
     static ExtendedCharTable instance;
@@ -72,10 +119,19 @@ private:
     // tests whether the entry in the table specified by 'hash' matches the
     // character sequence 'unicodePoints' of size 'length'
     bool extendedCharMatch(ushort hash , const ushort* unicodePoints , ushort length) const;
-    // internal, maps hash keys to character sequence buffers.  The first ushort
-    // in each value is the length of the buffer, followed by the ushorts in the buffer
-    // themselves.
-    QHash<ushort, ushort*> extendedCharTable;
+    // removes the sequences which are not used by any of the screens,
+    // reading their histories in full if 'exact' is true
+    void removeUnusedChars(bool exact);
+    // internal, maps hash keys to character sequences
+    QHash<ushort, QVector<ushort> > extendedCharTable;
+
+    QSet<const Screen*> _screens;
+    // the unused sequences are removed once the table has this many entries
+    int _sweepThreshold;
+    quint64 _generation;
+    // true while removeUnusedChars() reads the histories, which may add
+    // sequences but must not start another sweep, see HistoryScrollFile
+    bool _sweeping;
 };
 }
 #endif  // end of EXTENDEDCHARTABLE_H
@@ -20,14 +20,20 @@
 // Own
 #include "Filter.h"
 
+// System
+#include <limits.h>
+
 // Qt
 #include <QAction>
 #include <QApplication>
 #include <QtGui/QClipboard>
+#include <QtCore/QCache>
 #include <QtCore/QString>
 #include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
 
 // KDE
+#include <KGlobal>
 #include <KLocalizedString>
 #include <KRun>
 
@@ -51,10 +57,12 @@ FilterChain::~FilterChain()
 void FilterChain::addFilter(Filter* filter)
 {
     append(filter);
+    updateHotSpotIndex();
 }
 void FilterChain::removeFilter(Filter* filter)
 {
     removeAll(filter);
+    updateHotSpotIndex();
 }
 bool FilterChain::containsFilter(Filter* filter)
 {
@@ -65,35 +73,84 @@ void FilterChain::reset()
     QListIterator<Filter*> iter(*this);
     while (iter.hasNext())
         iter.next()->reset();
+
+    _hotSpotIndex.clear();
 }
-void FilterChain::setBuffer(const QString* buffer , const QList<int>* linePositions)
+void FilterChain::setBuffer(const QList<Filter::TextLine>* lines)
 {
     QListIterator<Filter*> iter(*this);
     while (iter.hasNext())
-        iter.next()->setBuffer(buffer, linePositions);
+        iter.next()->setBuffer(lines);
 }
 void FilterChain::process()
 {
+    // the hotspots are only replaced now rather than when the buffer is set,
+    // so that the old ones remain available while the searches for
+    // the new buffer are running
+    reset();
+
     QListIterator<Filter*> iter(*this);
     while (iter.hasNext())
         iter.next()->process();
+
+    updateHotSpotIndex();
+}
+QList<RegExpFilter::Search> FilterChain::searches() const
+{
+    QList<RegExpFilter::Search> list;
+    QListIterator<Filter*> iter(*this);
+    while (iter.hasNext()) {
+        RegExpFilter* filter = dynamic_cast<RegExpFilter*>(iter.next());
+        if (!filter)
+            continue;
+
+        const RegExpFilter::Search search = filter->search();
+        if (!search.lines.isEmpty())
+            list << search;
+    }
+    return list;
+}
+void FilterChain::addSearchResults(const QList<RegExpFilter::Search>& searches)
+{
+    // filters are matched up with searches by their regular expressions, as
+    // filters may have been added to or removed from the chain since
+    // the searches were made
+    QListIterator<Filter*> iter(*this);
+    while (iter.hasNext()) {
+        RegExpFilter* filter = dynamic_cast<RegExpFilter*>(iter.next());
+        if (!filter)
+            continue;
+
+        foreach(const RegExpFilter::Search& search, searches) {
+            filter->addSearchResults(search);
+        }
+    }
 }
 void FilterChain::clear()
 {
     QList<Filter*>::clear();
+    updateHotSpotIndex();
 }
-Filter::HotSpot* FilterChain::hotSpotAt(int line , int column) const
+void FilterChain::updateHotSpotIndex()
 {
+    // the hotspots of the filters earlier in the chain are added first, so
+    // that they are the ones found where hotspots of several filters overlap
+    _hotSpotIndex.clear();
+
     QListIterator<Filter*> iter(*this);
     while (iter.hasNext()) {
-        Filter* filter = iter.next();
-        Filter::HotSpot* spot = filter->hotSpotAt(line, column);
-        if (spot != 0) {
-            return spot;
+        foreach(Filter::HotSpot* spot, iter.next()->hotSpots()) {
+            _hotSpotIndex.addHotSpot(spot);
         }
     }
-
-    return 0;
+}
+Filter::HotSpot* FilterChain::hotSpotAt(int line , int column) const
+{
+    return _hotSpotIndex.hotSpotAt(line, column);
+}
+const HotSpotIndex& FilterChain::hotSpotIndex() const
+{
+    return _hotSpotIndex;
 }
 
 QList<Filter::HotSpot*> FilterChain::hotSpots() const
@@ -107,16 +164,137 @@ QList<Filter::HotSpot*> FilterChain::hotSpots() const
     return list;
 }
 
+void HotSpotIndex::clear()
+{
+    _lines.clear();
+}
+
+void HotSpotIndex::addHotSpot(Filter::HotSpot* spot)
+{
+    for (int line = spot->startLine() ; line <= spot->endLine() ; line++) {
+        const int startColumn = (line == spot->startLine()) ? spot->startColumn() : 0;
+        const int endColumn = (line == spot->endLine()) ? spot->endColumn() : INT_MAX;
+        addSpan(line, startColumn, endColumn, spot);
+    }
+}
+
+void HotSpotIndex::addSpan(int line, int startColumn, int endColumn, Filter::HotSpot* spot)
+{
+    if (line < 0 || endColumn < startColumn)
+        return;
+
+    if (line >= _lines.count())
+        _lines.resize(line + 1);
+
+    QVector<Span>& spans = _lines[line];
+
+    Span span;
+    span.startColumn = startColumn;
+    span.endColumn = endColumn;
+    span.type = spot->type();
+    span.hotSpot = spot;
+
+    // the hotspots of a filter are added in the order of their positions,
+    // so the new span usually comes after all the others
+    if (spans.isEmpty() || spans.last().endColumn < startColumn) {
+        spans << span;
+        return;
+    }
+
+    // otherwise only the parts of the new span which are not covered yet
+    // are added between the existing ones
+    QVector<Span> merged;
+    merged.reserve(spans.count() + 2);
+    bool done = false;
+
+    foreach(const Span& existing, spans) {
+        if (!done && existing.startColumn > span.startColumn) {
+            Span part = span;
+            part.endColumn = qMin(span.endColumn, existing.startColumn - 1);
+            merged << part;
+            done = span.endColumn < existing.startColumn;
+        }
+
+        merged << existing;
+
+        if (!done && existing.endColumn >= span.startColumn) {
+            if (existing.endColumn >= span.endColumn)
+                done = true;
+            else
+                span.startColumn = existing.endColumn + 1;
+        }
+    }
+
+    if (!done)
+        merged << span;
+
+    spans = merged;
+}
+
+// orders spans by the column where they start
+static bool startsBefore(const HotSpotIndex::Span& first, const HotSpotIndex::Span& second)
+{
+    return first.startColumn < second.startColumn;
+}
+
+Filter::HotSpot* HotSpotIndex::hotSpotAt(int line, int column) const
+{
+    if (line < 0 || line >= _lines.count())
+        return 0;
+
+    const QVector<Span>& spans = _lines.at(line);
+
+    // find the last span which starts at or before 'column'
+    Span position;
+    position.startColumn = column;
+    QVector<Span>::const_iterator iter = qUpperBound(spans.constBegin(), spans.constEnd(),
+                                         position, startsBefore);
+    if (iter == spans.constBegin())
+        return 0;
+
+    --iter;
+    return iter->endColumn >= column ? iter->hotSpot : 0;
+}
+
+QVector<HotSpotIndex::Span> HotSpotIndex::spans(int line) const
+{
+    return _lines.value(line);
+}
+
+int HotSpotIndex::lineCount() const
+{
+    return _lines.count();
+}
+
 TerminalImageFilterChain::TerminalImageFilterChain()
-    : _buffer(0)
-    , _linePositions(0)
 {
 }
 
 TerminalImageFilterChain::~TerminalImageFilterChain()
 {
-    delete _buffer;
-    delete _linePositions;
+}
+
+qint64 TerminalImageFilterChain::memoryUsage() const
+{
+    qint64 usage = 0;
+
+    QHash<QByteArray, QString>::const_iterator iter = _lineTexts.constBegin();
+    for (; iter != _lineTexts.constEnd(); ++iter)
+        usage += iter.key().capacity() + iter.value().capacity() * sizeof(QChar);
+    for (iter = _wrappedLineTexts.constBegin(); iter != _wrappedLineTexts.constEnd(); ++iter)
+        usage += iter.key().capacity() + iter.value().capacity() * sizeof(QChar);
+
+    // the text of a line is shared with _lineTexts unless it was joined
+    // with the lines it continues on
+    foreach(const Filter::TextLine& line, _buffer) {
+        usage += sizeof(Filter::TextLine) + line.wrapPositions.count() * sizeof(int);
+        if (!line.wrapPositions.isEmpty())
+            usage += line.text.capacity() * sizeof(QChar);
+    }
+
+    usage += hotSpots().count() * sizeof(Filter::HotSpot);
+
+    return usage;
 }
 
 void TerminalImageFilterChain::setImage(const Character* const image , int lines , int columns, const QVector<LineProperty>& lineProperties)
@@ -124,49 +302,64 @@ void TerminalImageFilterChain::setImage(const Character* const image , int lines
     if (empty())
         return;
 
-    // reset all filters and hotspots
-    reset();
-
     PlainTextDecoder decoder;
-    decoder.setTrailingWhitespace(false);
-
-    // setup new shared buffers for the filters to process on
-    QString* newBuffer = new QString();
-    QList<int>* newLinePositions = new QList<int>();
-    setBuffer(newBuffer , newLinePositions);
-
-    // free the old buffers
-    delete _buffer;
-    delete _linePositions;
 
-    _buffer = newBuffer;
-    _linePositions = newLinePositions;
+    _buffer.clear();
+    setBuffer(&_buffer);
 
-    QTextStream lineStream(_buffer);
-    decoder.begin(&lineStream);
+    // lines are only decoded if they were not part of the last image, which
+    // is the case for most lines when the output changes or scrolls
+    QHash<QByteArray, QString> lineTexts;
+    QHash<QByteArray, QString> wrappedLineTexts;
+    const int lineLength = columns * sizeof(Character);
 
     for (int i = 0 ; i < lines ; i++) {
-        _linePositions->append(_buffer->length());
-        decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
-
-        // pretend that each line ends with a newline character.
-        // this prevents a link that occurs at the end of one line
-        // being treated as part of a link that occurs at the start of the next line
-        //
-        // the downside is that links which are spread over more than one line are not
-        // highlighted.
-        //
-        // TODO - Use the "line wrapped" attribute associated with lines in a
-        // terminal image to avoid adding this imaginary character for wrapped
-        // lines
-        if (!(lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED))
-            lineStream << QChar('\n');
+        const QByteArray characters = QByteArray::fromRawData(
+                                          reinterpret_cast<const char*>(image + i * columns), lineLength);
+
+        // the whitespace at the end of a wrapped line belongs to the text
+        // which continues on the next line, as in Screen::copyLineToStream()
+        const bool wrapped = lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED;
+        const QHash<QByteArray, QString>& lastTexts = wrapped ? _wrappedLineTexts : _lineTexts;
+        QHash<QByteArray, QString>& texts = wrapped ? wrappedLineTexts : lineTexts;
+
+        QHash<QByteArray, QString>::const_iterator iter = lastTexts.constFind(characters);
+        if (iter != lastTexts.constEnd()) {
+            texts.insert(iter.key(), iter.value());
+        } else if (!texts.contains(characters)) {
+            QString text;
+            QTextStream textStream(&text);
+            decoder.setTrailingWhitespace(wrapped);
+            decoder.begin(&textStream);
+            decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
+            decoder.end();
+            textStream.flush();
+
+            // the key refers to the image, so a copy has to be stored
+            texts.insert(QByteArray(characters.constData(), lineLength), text);
+        }
+
+        // a line which continues a wrapped line is added to its text, so that
+        // a link which is spread over both is found.  every other line is
+        // a line of its own, whose text is shared with the decoded lines
+        // rather than copied
+        if (i > 0 && (lineProperties.value(i - 1, LINE_DEFAULT) & LINE_WRAPPED)) {
+            Filter::TextLine& line = _buffer.last();
+            line.wrapPositions << line.text.length();
+            line.text += texts.value(characters);
+        } else {
+            Filter::TextLine line;
+            line.text = texts.value(characters);
+            line.startLine = i;
+            _buffer << line;
+        }
     }
-    decoder.end();
+
+    _lineTexts = lineTexts;
+    _wrappedLineTexts = wrappedLineTexts;
 }
 
 Filter::Filter() :
-    _linePositions(0),
     _buffer(0)
 {
 }
@@ -184,31 +377,25 @@ void Filter::reset()
     _hotspotList.clear();
 }
 
-void Filter::setBuffer(const QString* buffer , const QList<int>* linePositions)
+void Filter::setBuffer(const QList<TextLine>* lines)
 {
-    _buffer = buffer;
-    _linePositions = linePositions;
+    _buffer = lines;
 }
 
-void Filter::getLineColumn(int position , int& startLine , int& startColumn)
+void Filter::getLineColumn(const TextLine& line, int position, int& startLine, int& startColumn)
 {
-    Q_ASSERT(_linePositions);
-    Q_ASSERT(_buffer);
-
-    for (int i = 0 ; i < _linePositions->count() ; i++) {
-        int nextLine = 0;
+    if (position > line.text.length())
+        return;
 
-        if (i == _linePositions->count() - 1)
-            nextLine = _buffer->length() + 1;
-        else
-            nextLine = _linePositions->value(i + 1);
+    // find how many lines of the image the text wraps onto before 'position'
+    QList<int>::const_iterator iter = qUpperBound(line.wrapPositions.constBegin(),
+                                      line.wrapPositions.constEnd(),
+                                      position);
+    const int wraps = iter - line.wrapPositions.constBegin();
+    const int lineStart = (wraps > 0) ? line.wrapPositions.at(wraps - 1) : 0;
 
-        if (_linePositions->value(i) <= position && position < nextLine) {
-            startLine = i;
-            startColumn = string_width(buffer()->mid(_linePositions->value(i), position - _linePositions->value(i)));
-            return;
-        }
-    }
+    startLine = line.startLine + wraps;
+    startColumn = string_width(line.text.mid(lineStart, position - lineStart));
 }
 
 /*void Filter::addLine(const QString& text)
@@ -217,7 +404,7 @@ void Filter::getLineColumn(int position , int& startLine , int& startColumn)
     _buffer.append(text);
 }*/
 
-const QString* Filter::buffer()
+const QList<Filter::TextLine>* Filter::buffer()
 {
     return _buffer;
 }
@@ -294,8 +481,28 @@ void Filter::HotSpot::setType(Type type)
     _type = type;
 }
 
+// the number of lines whose matches are shared between the filters
+static const int SHARED_MATCHES_SIZE = 8192;
+
+// the matches which filters found in lines, shared by the filters with the
+// same regular expression, such as the URL filters of several views which
+// show the same session.  Keyed by the filter's _matchesKey followed by the
+// text of the line
+typedef QCache<QString, QList<RegExpFilter::Match> > MatchCache;
+K_GLOBAL_STATIC_WITH_ARGS(MatchCache, sharedMatches, (SHARED_MATCHES_SIZE))
+// the number of regular expression filters which share the matches
+static int sharedMatchesUsers = 0;
+
 RegExpFilter::RegExpFilter()
 {
+    sharedMatchesUsers++;
+    updateMatchesKey();
+}
+
+RegExpFilter::~RegExpFilter()
+{
+    if (--sharedMatchesUsers == 0 && !sharedMatches.isDestroyed())
+        sharedMatches->clear();
 }
 
 RegExpFilter::HotSpot::HotSpot(int startLine, int startColumn, int endLine, int endColumn)
@@ -320,6 +527,23 @@ QStringList RegExpFilter::HotSpot::capturedTexts() const
 void RegExpFilter::setRegExp(const QRegExp& regExp)
 {
     _searchText = regExp;
+    _matches.clear();
+    updateMatchesKey();
+}
+void RegExpFilter::setRequiredTexts(const QStringList& texts)
+{
+    _requiredTexts = texts;
+    _matches.clear();
+    updateMatchesKey();
+}
+void RegExpFilter::updateMatchesKey()
+{
+    const QChar separator(0);
+    _matchesKey = QString::number(_searchText.patternSyntax()) +
+                  QString::number(_searchText.caseSensitivity()) +
+                  QString::number(_searchText.isMinimal()) + separator +
+                  _searchText.pattern() + separator +
+                  _requiredTexts.join(separator) + separator;
 }
 QRegExp RegExpFilter::regExp() const
 {
@@ -331,41 +555,155 @@ QRegExp RegExpFilter::regExp() const
 }*/
 void RegExpFilter::process()
 {
-    int pos = 0;
-    const QString* text = buffer();
+    const QList<TextLine>* lines = buffer();
 
-    Q_ASSERT(text);
+    Q_ASSERT(lines);
 
     // ignore any regular expressions which match an empty string.
-    // otherwise the while loop below will run indefinitely
+    // otherwise the loop in findMatches() will run indefinitely
     static const QString emptyString("");
     if (_searchText.exactMatch(emptyString))
         return;
 
-    while (pos >= 0) {
-        pos = _searchText.indexIn(*text, pos);
+    // search the buffer one line at a time, so that the matches of the lines
+    // which were searched by the last call can be reused.  this is the case
+    // for most lines when the output scrolls.  the lines may also have been
+    // searched on another thread already, in which case there is nothing
+    // left to search here
+    Search pending = search();
+    pending.run();
+    addSearchResults(pending);
 
-        if (pos >= 0) {
+    QHash<QString, QList<Match> > matches;
+
+    foreach(const TextLine& line, *lines) {
+        QHash<QString, QList<Match> >::const_iterator iter = matches.constFind(line.text);
+        if (iter == matches.constEnd())
+            iter = matches.insert(line.text, _matches.value(line.text));
+
+        foreach(const Match& match, iter.value()) {
             int startLine = 0;
             int endLine = 0;
             int startColumn = 0;
             int endColumn = 0;
 
-            getLineColumn(pos, startLine, startColumn);
-            getLineColumn(pos + _searchText.matchedLength(), endLine, endColumn);
+            getLineColumn(line, match.position, startLine, startColumn);
+            getLineColumn(line, match.position + match.length, endLine, endColumn);
 
             RegExpFilter::HotSpot* spot = newHotSpot(startLine, startColumn,
                                           endLine, endColumn);
-            spot->setCapturedTexts(_searchText.capturedTexts());
+            spot->setCapturedTexts(match.capturedTexts);
 
             addHotSpot(spot);
-            pos += _searchText.matchedLength();
+        }
+    }
+
+    _matches = matches;
+}
+
+RegExpFilter::Search RegExpFilter::search()
+{
+    Search search;
+    search.regExp = _searchText;
+    search.requiredTexts = _requiredTexts;
+
+    if (!buffer())
+        return search;
+
+    // lines which another filter has searched already need not be searched
+    foreach(const TextLine& line, *buffer()) {
+        if (_matches.contains(line.text))
+            continue;
+
+        const QList<Match>* matches = sharedMatches->object(_matchesKey + line.text);
+        if (matches)
+            _matches.insert(line.text, *matches);
+        else
+            search.lines << line.text;
+    }
+    search.lines.removeDuplicates();
+
+    return search;
+}
+void RegExpFilter::addSearchResults(const Search& search)
+{
+    if (search.regExp != _searchText || search.requiredTexts != _requiredTexts)
+        return;
+
+    QHashIterator<QString, QList<Match> > iter(search.matches);
+    while (iter.hasNext()) {
+        iter.next();
+        _matches.insert(iter.key(), iter.value());
+        sharedMatches->insert(_matchesKey + iter.key(), new QList<Match>(iter.value()));
+    }
+}
+void RegExpFilter::Search::run()
+{
+    // ignore any regular expressions which match an empty string.
+    // otherwise the loop in findMatches() will run indefinitely
+    if (regExp.exactMatch(QString()))
+        return;
+
+    foreach(const QString& line, lines) {
+        matches.insert(line, findMatches(line));
+    }
+}
+QList<RegExpFilter::Match> RegExpFilter::Search::findMatches(const QString& line)
+{
+    if (!requiredTexts.isEmpty()) {
+        bool required = false;
+        foreach(const QString& text, requiredTexts) {
+            if (line.contains(text)) {
+                required = true;
+                break;
+            }
+        }
+        if (!required)
+            return QList<Match>();
+    }
+
+    QList<Match> matches;
+
+    // fixed strings, which is what the search bar looks for unless regular
+    // expressions are enabled, are found with QString::indexOf() rather
+    // than by running the expression, which is much slower
+    if (regExp.patternSyntax() == QRegExp::FixedString) {
+        const QString pattern = regExp.pattern();
+
+        int pos = line.indexOf(pattern, 0, regExp.caseSensitivity());
+        while (pos != -1) {
+            Match match;
+            match.position = pos;
+            match.length = pattern.length();
+            match.capturedTexts << line.mid(pos, pattern.length());
+            matches << match;
+
+            pos = line.indexOf(pattern, pos + pattern.length(), regExp.caseSensitivity());
+        }
+
+        return matches;
+    }
+
+    int pos = 0;
+    while (pos >= 0) {
+        pos = regExp.indexIn(line, pos);
+
+        if (pos >= 0) {
+            Match match;
+            match.position = pos;
+            match.length = regExp.matchedLength();
+            match.capturedTexts = regExp.capturedTexts();
+            matches << match;
+
+            pos += regExp.matchedLength();
 
             // if matchedLength == 0, the program will get stuck in an infinite loop
-            if (_searchText.matchedLength() == 0)
+            if (regExp.matchedLength() == 0)
                 pos = -1;
         }
     }
+
+    return matches;
 }
 
 RegExpFilter::HotSpot* RegExpFilter::newHotSpot(int startLine, int startColumn,
@@ -447,6 +785,12 @@ const QRegExp UrlFilter::CompleteUrlRegExp('(' + FullUrlRegExp.pattern() + '|' +
 UrlFilter::UrlFilter()
 {
     setRegExp(CompleteUrlRegExp);
+
+    // every URL contains "://" or starts with "www.", and every email
+    // address contains '@'.  searching for these is much cheaper than
+    // running the regular expression, which is only done for the few lines
+    // which contain one of them
+    setRequiredTexts(QStringList() << "://" << "www." << "@");
 }
 UrlFilter::HotSpot::~HotSpot()
 {
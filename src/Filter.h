@@ -21,14 +21,17 @@
 #define FILTER_H
 
 // Qt
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
 #include <QtCore/QRegExp>
 #include <QtCore/QMultiHash>
+#include <QtCore/QVector>
 
 // Konsole
 #include "Character.h"
+#include "konsole_export.h"
 
 class QAction;
 
@@ -52,7 +55,7 @@ namespace Konsole
  * When processing the text they should create instances of Filter::HotSpot subclasses for sections of interest
  * and add them to the filter's list of hotspots using addHotSpot()
  */
-class Filter
+class KONSOLEPRIVATE_EXPORT Filter
 {
 public:
     /**
@@ -126,6 +129,19 @@ public:
         Type _type;
     };
 
+    /**
+     * A line of the text which a filter processes.  A line which was wrapped
+     * onto the following lines of a terminal image continues there, so
+     * the text of a line may cover several lines of the image.
+     */
+    struct TextLine {
+        QString text;
+        // the line of the image where the text starts
+        int startLine;
+        // the positions in text where each following line of the image starts
+        QList<int> wrapPositions;
+    };
+
     /** Constructs a new filter. */
     Filter();
     virtual ~Filter();
@@ -152,24 +168,27 @@ public:
     QList<HotSpot*> hotSpotsAtLine(int line) const;
 
     /**
-     * TODO: Document me
+     * Sets the lines of text for the filter to process.  The lines are not
+     * copied, they have to remain valid until the next call.
      */
-    void setBuffer(const QString* buffer , const QList<int>* linePositions);
+    void setBuffer(const QList<TextLine>* lines);
 
 protected:
     /** Adds a new hotspot to the list */
     void addHotSpot(HotSpot*);
-    /** Returns the internal buffer */
-    const QString* buffer();
-    /** Converts a character position within buffer() to a line and column */
-    void getLineColumn(int position , int& startLine , int& startColumn);
+    /** Returns the lines of text set with setBuffer() */
+    const QList<TextLine>* buffer();
+    /**
+     * Converts a character position within the text of @p line to a line and
+     * column of the terminal image
+     */
+    void getLineColumn(const TextLine& line, int position, int& startLine, int& startColumn);
 
 private:
     QMultiHash<int, HotSpot*> _hotspots;
     QList<HotSpot*> _hotspotList;
 
-    const QList<int>* _linePositions;
-    const QString* _buffer;
+    const QList<TextLine>* _buffer;
 };
 
 /**
@@ -179,7 +198,7 @@ private:
  * Subclasses can reimplement newHotSpot() to return custom hotspot types when matches for the regular expression
  * are found.
  */
-class RegExpFilter : public Filter
+class KONSOLEPRIVATE_EXPORT RegExpFilter : public Filter
 {
 public:
     /**
@@ -202,6 +221,11 @@ public:
 
     /** Constructs a new regular expression filter */
     RegExpFilter();
+    /**
+     * Destroys the filter.  The shared matches are given back once the last
+     * regular expression filter is destroyed.
+     */
+    virtual ~RegExpFilter();
 
     /**
      * Sets the regular expression which the filter searches for in blocks of text.
@@ -216,11 +240,56 @@ public:
     /**
      * Reimplemented to search the filter's text buffer for text matching regExp()
      *
+     * The buffer is searched one line at a time, a match does not extend past
+     * the end of a line unless the line is wrapped.  The matches of lines which were also in the buffer
+     * the last time process() was called, or which were found by a search()
+     * passed to addSearchResults() since, are reused instead of searching
+     * those lines again.
+     *
      * If regexp matches the empty string, then process() will return immediately
      * without finding results.
      */
     virtual void process();
 
+    /** A match for the regular expression within a line */
+    struct Match {
+        int position;
+        int length;
+        QStringList capturedTexts;
+    };
+
+    /**
+     * The search for the regular expression in the lines of the buffer
+     * which process() would have to search.  A search holds copies of
+     * everything it needs, so run() can be called on another thread while
+     * the filter is used, changed or deleted.
+     */
+    struct Search {
+        /** Searches each of the lines for the regular expression */
+        void run();
+
+        QRegExp regExp;
+        QStringList requiredTexts;
+        QStringList lines;
+        // the matches in each line, filled in by run()
+        QHash<QString, QList<Match> > matches;
+
+    private:
+        QList<Match> findMatches(const QString& line);
+    };
+
+    /**
+     * Returns the search for the lines of the buffer whose matches are not
+     * known yet.
+     */
+    Search search();
+    /**
+     * Adds the matches found by running @p search, so that process() does
+     * not have to search those lines itself.  The results are ignored if
+     * the regular expression has changed since search() was called.
+     */
+    void addSearchResults(const Search& search);
+
 protected:
     /**
      * Called when a match for the regular expression is encountered.  Subclasses should reimplement this
@@ -229,14 +298,29 @@ protected:
     virtual RegExpFilter::HotSpot* newHotSpot(int startLine, int startColumn,
             int endLine, int endColumn);
 
+    /**
+     * Sets strings of which a line has to contain at least one to match
+     * the regular expression.  Lines which contain none of them are skipped
+     * without running the regular expression, which is much more expensive.
+     */
+    void setRequiredTexts(const QStringList& texts);
+
 private:
+    // identifies the regular expression and the required texts in the
+    // matches shared with other filters
+    void updateMatchesKey();
+
     QRegExp _searchText;
+    QStringList _requiredTexts;
+    // the matches in each line of the buffer found by the last call to process()
+    QHash<QString, QList<Match> > _matches;
+    QString _matchesKey;
 };
 
 class FilterObject;
 
 /** A filter which matches URLs in blocks of text */
-class UrlFilter : public RegExpFilter
+class KONSOLEPRIVATE_EXPORT UrlFilter : public RegExpFilter
 {
 public:
     /**
@@ -292,6 +376,44 @@ private:
     Filter::HotSpot* _filter;
 };
 
+/**
+ * An index of hotspots by line, which finds the hotspot at a position
+ * with a binary search of the spans on its line.
+ *
+ * Where hotspots overlap, the part of a line which they share belongs to
+ * the hotspot which was added first.
+ */
+class KONSOLEPRIVATE_EXPORT HotSpotIndex
+{
+public:
+    /** The part of a line covered by a hotspot */
+    struct Span {
+        int startColumn;
+        // the last column, which is INT_MAX if the hotspot continues on
+        // the next line
+        int endColumn;
+        Filter::HotSpot::Type type;
+        Filter::HotSpot* hotSpot;
+    };
+
+    /** Removes all hotspots from the index */
+    void clear();
+    /** Adds @p spot to the index */
+    void addHotSpot(Filter::HotSpot* spot);
+
+    /** Returns the hotspot which covers the given @p line and @p column, or 0 if no hotspot covers that area */
+    Filter::HotSpot* hotSpotAt(int line, int column) const;
+    /** Returns the spans on @p line in order of their columns */
+    QVector<Span> spans(int line) const;
+    /** Returns the number of lines up to the last one with hotspots */
+    int lineCount() const;
+
+private:
+    void addSpan(int line, int startColumn, int endColumn, Filter::HotSpot* spot);
+
+    QVector<QVector<Span> > _lines;
+};
+
 /**
  * A chain which allows a group of filters to be processed as one.
  * The chain owns the filters added to it and deletes them when the chain itself is destroyed.
@@ -309,7 +431,7 @@ private:
  * The hotSpots() and hotSpotsAtLine() method return all of the hotspots in the text and on
  * a given line respectively.
  */
-class FilterChain : protected QList<Filter*>
+class KONSOLEPRIVATE_EXPORT FilterChain : protected QList<Filter*>
 {
 public:
     virtual ~FilterChain();
@@ -326,23 +448,43 @@ public:
     /** Resets each filter in the chain */
     void reset();
     /**
-     * Processes each filter in the chain
+     * Resets and processes each filter in the chain
      */
     void process();
 
+    /**
+     * Returns the searches which process() would have to do for the regular
+     * expression filters in the chain.  They can be run on another thread,
+     * and their results passed to addSearchResults() before process() is
+     * called.
+     */
+    QList<RegExpFilter::Search> searches() const;
+    /** Adds the results of running @p searches to the filters in the chain */
+    void addSearchResults(const QList<RegExpFilter::Search>& searches);
+
     /** Sets the buffer for each filter in the chain to process. */
-    void setBuffer(const QString* buffer , const QList<int>* linePositions);
+    void setBuffer(const QList<Filter::TextLine>* lines);
 
     /** Returns the first hotspot which occurs at @p line, @p column or 0 if no hotspot was found */
     Filter::HotSpot* hotSpotAt(int line , int column) const;
+    /**
+     * Returns the index of the hotspots of all the chain's filters, which is
+     * updated when the chain is processed or its filters change
+     */
+    const HotSpotIndex& hotSpotIndex() const;
     /** Returns a list of all the hotspots in all the chain's filters */
     QList<Filter::HotSpot*> hotSpots() const;
     /** Returns a list of all hotspots at the given line in all the chain's filters */
     QList<Filter::HotSpot> hotSpotsAtLine(int line) const;
+
+private:
+    void updateHotSpotIndex();
+
+    HotSpotIndex _hotSpotIndex;
 };
 
 /** A filter chain which processes character images from terminal displays */
-class TerminalImageFilterChain : public FilterChain
+class KONSOLEPRIVATE_EXPORT TerminalImageFilterChain : public FilterChain
 {
 public:
     TerminalImageFilterChain();
@@ -351,6 +493,11 @@ public:
     /**
      * Set the current terminal image to @p image.
      *
+     * Only lines which were not part of the previous image are decoded
+     * again, the text of the other lines is reused.  Lines which are
+     * wrapped are joined with the lines they continue on, so that matches
+     * can span them.
+     *
      * @param image The terminal image
      * @param lines The number of lines in the terminal image
      * @param columns The number of columns in the terminal image
@@ -359,9 +506,19 @@ public:
     void setImage(const Character* const image , int lines , int columns,
                   const QVector<LineProperty>& lineProperties);
 
+    /**
+     * Returns the number of bytes of memory used by the text of the image
+     * and the hotspots found in it.
+     */
+    qint64 memoryUsage() const;
+
 private:
-    QString* _buffer;
-    QList<int>* _linePositions;
+    QList<Filter::TextLine> _buffer;
+    // the decoded text of the lines of the last image, keyed by their
+    // characters.  Wrapped lines keep their trailing whitespace, so they
+    // are kept apart
+    QHash<QByteArray, QString> _lineTexts;
+    QHash<QByteArray, QString> _wrappedLineTexts;
 };
 }
 #endif //FILTER_H
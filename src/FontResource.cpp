@@ -0,0 +1,101 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "FontResource.h"
+
+// Qt
+#include <QtCore/QHash>
+#include <QtGui/QFontMetrics>
+
+// KDE
+#include <KGlobal>
+
+using Konsole::FontResource;
+
+typedef QHash<QString, FontResource*> FontResourceHash;
+K_GLOBAL_STATIC(FontResourceHash, resources)
+
+#define REPCHAR   "ABCDEFGHIJKLMNOPQRSTUVWXYZ" \
+    "abcdefgjijklmnopqrstuvwxyz" \
+    "0123456789./+@"
+
+FontResource::FontResource(const QFont& font, int lineSpacing, const QString& key)
+    : _key(key)
+    , _refCount(0)
+    , _font(font)
+{
+    QFontMetrics fm(font);
+    _fontHeight = fm.height() + lineSpacing;
+
+    // waba TerminalDisplay 1.123:
+    // "Base character width on widest ASCII character. This prevents too wide
+    //  characters in the presence of double wide (e.g. Japanese) characters."
+    // Get the width from representative normal width characters
+    _fontWidth = qRound((static_cast<double>(fm.width(REPCHAR)) / static_cast<double>(qstrlen(REPCHAR))));
+
+    _fixedFont = true;
+
+    const int fw = fm.width(REPCHAR[0]);
+    for (unsigned int i = 1; i < qstrlen(REPCHAR); i++) {
+        if (fw != fm.width(REPCHAR[i])) {
+            _fixedFont = false;
+            break;
+        }
+    }
+
+    if (_fontWidth < 1)
+        _fontWidth = 1;
+
+    _fontAscent = fm.ascent();
+
+    _glyphCache.setMaxCost(GLYPH_CACHE_SIZE);
+}
+
+QString FontResource::keyFor(const QFont& font, int lineSpacing)
+{
+    // QFont::key() does not cover the style strategy, which decides about
+    // the anti-aliasing of the glyphs
+    return font.key() + QLatin1Char('/') + QString::number(font.styleStrategy())
+           + QLatin1Char('/') + QString::number(lineSpacing);
+}
+
+FontResource* FontResource::acquire(const QFont& font, int lineSpacing)
+{
+    const QString key = keyFor(font, lineSpacing);
+
+    FontResource* resource = resources->value(key);
+    if (!resource) {
+        resource = new FontResource(font, lineSpacing, key);
+        resources->insert(key, resource);
+    }
+
+    resource->_refCount++;
+    return resource;
+}
+
+void FontResource::release(FontResource* resource)
+{
+    if (!resource || --resource->_refCount > 0)
+        return;
+
+    if (!resources.isDestroyed())
+        resources->remove(resource->_key);
+    delete resource;
+}
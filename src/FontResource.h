@@ -0,0 +1,106 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef FONTRESOURCE_H
+#define FONTRESOURCE_H
+
+// Qt
+#include <QtCore/QCache>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtGui/QFont>
+#include <QtGui/QPixmap>
+
+namespace Konsole
+{
+/**
+ * The metrics and rendered glyphs of a font, shared by all the terminal
+ * displays which use that font with the same line spacing.
+ *
+ * Use acquire() to get the resource for a font and release() once it is
+ * no longer needed.  The resource is created when it is first acquired
+ * and deleted when the last display releases it.  Resources must only be
+ * used from the GUI thread.
+ */
+class FontResource
+{
+public:
+    /**
+     * Returns the resource for @p font with @p lineSpacing pixels between
+     * lines, creating it if no display uses it yet.  Each call must be
+     * matched by a call to release().
+     */
+    static FontResource* acquire(const QFont& font, int lineSpacing);
+    /** Releases a resource returned by acquire() */
+    static void release(FontResource* resource);
+
+    /** Returns the font */
+    const QFont& font() const {
+        return _font;
+    }
+    /** Returns the height of a line, including the line spacing */
+    int fontHeight() const {
+        return _fontHeight;
+    }
+    /** Returns the width of a single-width character */
+    int fontWidth() const {
+        return _fontWidth;
+    }
+    /** Returns the ascent of the font */
+    int fontAscent() const {
+        return _fontAscent;
+    }
+    /** Returns true if all the characters of the font have the same width */
+    bool isFixedFont() const {
+        return _fixedFont;
+    }
+
+    /** The key of a glyph in glyphCache(), its meaning is up to the displays */
+    typedef QPair<quint64, quint32> GlyphKey;
+
+    /**
+     * Returns the cache of rendered glyphs.  Each glyph is a pixmap of
+     * fontWidth() or twice fontWidth() by fontHeight() pixels.
+     */
+    QCache<GlyphKey, QPixmap>& glyphCache() {
+        return _glyphCache;
+    }
+
+private:
+    FontResource(const QFont& font, int lineSpacing, const QString& key);
+
+    static QString keyFor(const QFont& font, int lineSpacing);
+
+    QString _key;
+    int _refCount;
+
+    QFont _font;
+    int _fontHeight;
+    int _fontWidth;
+    int _fontAscent;
+    bool _fixedFont;
+
+    QCache<GlyphKey, QPixmap> _glyphCache;
+
+    // the maximum number of glyphs kept in the glyph cache
+    static const int GLYPH_CACHE_SIZE = 4096;
+};
+}
+
+#endif // FONTRESOURCE_H
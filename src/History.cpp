@@ -26,14 +26,23 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+// Qt
+#include <QtCore/QVarLengthArray>
 
 // KDE
 #include <kde_file.h>
 #include <KDebug>
 #include <KStandardDirs>
 
+// Konsole
+#include "ExtendedCharTable.h"
+
 // Reasonable line size
 static const int LINE_SIZE = 1024;
 
@@ -55,12 +64,31 @@ using namespace Konsole;
 */
 
 // History File ///////////////////////////////////////////
-HistoryFile::HistoryFile()
+HistoryFile::HistoryFile(const QString& fileName)
     : _fd(-1),
       _length(0),
-      _fileMap(0),
-      _readWriteBalance(0)
+      _ownsFd(false),
+      _mapped(false),
+      _readWriteBalance(0),
+      _readAheadOffset(0),
+      _lastReadStart(-1),
+      _lastReadEnd(-1),
+      _sequentialReads(0)
 {
+    if (!fileName.isEmpty()) {
+        // the file is created with its permissions, so that the history is
+        // never readable by others
+        _fd = KDE_open(QFile::encodeName(fileName), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        if (_fd >= 0) {
+            _ownsFd = true;
+            fchmod(_fd, S_IRUSR | S_IWUSR);
+            _length = qMax(qint64(0), qint64(KDE_lseek(_fd, 0, SEEK_END)));
+        } else {
+            kWarning() << "Unable to open history file" << fileName;
+        }
+        return;
+    }
+
     const QString tmpFormat = KStandardDirs::locateLocal("tmp", QString())
                               + "konsole-XXXXXX.history";
     _tmpFile.setFileTemplate(tmpFormat);
@@ -72,46 +100,136 @@ HistoryFile::HistoryFile()
 
 HistoryFile::~HistoryFile()
 {
-    if (_fileMap)
-        unmap();
+    unmap();
+
+    if (_ownsFd)
+        close(_fd);
 }
 
-//TODO:  Mapping the entire file in will cause problems if the history file becomes exceedingly large,
-//(ie. larger than available memory).  HistoryFile::map() should only map in sections of the file at a time,
-//to avoid this.
 void HistoryFile::map()
 {
-    Q_ASSERT(_fileMap == 0);
-
-    _fileMap = (char*)mmap(0 , _length , PROT_READ , MAP_PRIVATE , _fd , 0);
+    // the windows are mmap'ed when they are first read from, so that only
+    // the parts of the file which are in use are mapped
+    _mapped = true;
+}
 
-    //if mmap'ing fails, fall back to the read-lseek combination
-    if (_fileMap == MAP_FAILED) {
-        _readWriteBalance = 0;
-        _fileMap = 0;
-        kWarning() << "mmap'ing history failed.  errno = " << errno;
+void HistoryFile::unmap()
+{
+    foreach(const MappedWindow& window, _windows) {
+        int result = munmap(window.data , window.length);
+        Q_ASSERT(result == 0);
+        Q_UNUSED(result);
     }
+    _windows.clear();
+
+    _mapped = false;
 }
 
-void HistoryFile::unmap()
+void HistoryFile::truncate(qint64 length)
+{
+    if (length >= _length)
+        return;
+
+    //the windows may extend past the new end of the file
+    const bool mapped = _mapped;
+    unmap();
+    _mapped = mapped;
+
+    _readAheadBlock.clear();
+
+    if (ftruncate(_fd, length) < 0)
+        perror("HistoryFile::truncate");
+    _length = length;
+}
+
+// the size of the pieces in which removeStart() moves the data
+static const int MOVE_BUFFER_SIZE = 256 * 1024;
+
+bool HistoryFile::removeStart(qint64 length)
 {
-    int result = munmap(_fileMap , _length);
-    Q_ASSERT(result == 0);
-    Q_UNUSED(result);
+    length = qMin(length, _length);
+    if (length <= 0)
+        return true;
+
+    Q_ASSERT(length >= _length - length);
+
+    //the data moves within the windows
+    const bool mapped = _mapped;
+    unmap();
+    _mapped = mapped;
+
+    _readAheadBlock.clear();
+
+    //the data is only written to the part of the file which is dropped,
+    //so nothing is lost if this fails halfway
+    QByteArray buffer(MOVE_BUFFER_SIZE, '\0');
+    for (qint64 from = length; from < _length; from += buffer.size()) {
+        const int count = qMin(qint64(buffer.size()), _length - from);
+        if (pread(_fd, buffer.data(), count, from) != count ||
+                pwrite(_fd, buffer.constData(), count, from - length) != count) {
+            perror("HistoryFile::removeStart");
+            return false;
+        }
+    }
 
-    _fileMap = 0;
+    truncate(_length - length);
+    return true;
 }
 
 bool HistoryFile::isMapped() const
 {
-    return (_fileMap != 0);
+    return _mapped;
 }
 
-void HistoryFile::add(const unsigned char* buffer, int count)
+const HistoryFile::MappedWindow* HistoryFile::mapWindow(qint64 loc)
 {
-    if (_fileMap)
+    const qint64 offset = loc - loc % MAP_WINDOW_SIZE;
+
+    for (int i = 0; i < _windows.count(); i++) {
+        if (_windows[i].offset != offset)
+            continue;
+
+        if (loc < offset + _windows[i].length) {
+            _windows.move(i, 0);
+            return &_windows.first();
+        }
+
+        // the last window of the file was mapped before the data at 'loc'
+        // was added, map it again with its current length
+        munmap(_windows[i].data, _windows[i].length);
+        _windows.removeAt(i);
+        break;
+    }
+
+    // only the part of the window which is already in the file is mapped,
+    // accessing mapped pages past the end of the file is an error
+    const qint64 length = qMin(qint64(MAP_WINDOW_SIZE), _length - offset);
+    char* data = (char*)mmap(0 , length , PROT_READ , MAP_PRIVATE , _fd , offset);
+
+    //if mmap'ing fails, fall back to the read-lseek combination
+    if (data == MAP_FAILED) {
         unmap();
+        _readWriteBalance = 0;
+        kWarning() << "mmap'ing history failed.  errno = " << errno;
+        return 0;
+    }
+
+    if (_windows.count() >= MAX_MAPPED_WINDOWS) {
+        munmap(_windows.last().data, _windows.last().length);
+        _windows.removeLast();
+    }
 
+    MappedWindow window;
+    window.offset = offset;
+    window.length = length;
+    window.data = data;
+    _windows.prepend(window);
+
+    return &_windows.first();
+}
+
+void HistoryFile::add(const unsigned char* buffer, int count)
+{
     _readWriteBalance++;
 
     int rc = 0;
@@ -129,38 +247,97 @@ void HistoryFile::add(const unsigned char* buffer, int count)
     _length += rc;
 }
 
-void HistoryFile::get(unsigned char* buffer, int size, int loc)
+void HistoryFile::get(unsigned char* buffer, int size, qint64 loc)
 {
     //count number of get() calls vs. number of add() calls.
     //If there are many more get() calls compared with add()
     //calls (decided by using MAP_THRESHOLD) then mmap the log
     //file to improve performance.
     _readWriteBalance--;
-    if (!_fileMap && _readWriteBalance < MAP_THRESHOLD)
+    if (!_mapped && _readWriteBalance < MAP_THRESHOLD)
         map();
 
-    if (_fileMap) {
-        for (int i = 0; i < size; i++)
-            buffer[i] = _fileMap[loc + i];
+    if (loc < 0 || size < 0 || loc + size > _length) {
+        fprintf(stderr, "getHist(...,%d,%lld): invalid args.\n", size, loc);
     } else {
-        int rc = 0;
+        // the data may span several windows
+        while (_mapped && size > 0) {
+            const MappedWindow* window = mapWindow(loc);
+            if (!window)
+                break;
+
+            const int count = qMin(qint64(size), window->offset + window->length - loc);
+            memcpy(buffer, window->data + (loc - window->offset), count);
+
+            buffer += count;
+            loc += count;
+            size -= count;
+        }
 
-        if (loc < 0 || size < 0 || loc + size > _length)
-            fprintf(stderr, "getHist(...,%d,%d): invalid args.\n", size, loc);
-        rc = KDE_lseek(_fd, loc, SEEK_SET);
-        if (rc < 0) {
-            perror("HistoryFile::get.seek");
+        if (size == 0)
             return;
-        }
-        rc = read(_fd, buffer, size);
-        if (rc < 0) {
-            perror("HistoryFile::get.read");
+
+        if (!_mapped && readAhead(buffer, size, loc))
             return;
+    }
+
+    qint64 rc = KDE_lseek(_fd, loc, SEEK_SET);
+    if (rc < 0) {
+        perror("HistoryFile::get.seek");
+        return;
+    }
+    rc = read(_fd, buffer, size);
+    if (rc < 0) {
+        perror("HistoryFile::get.read");
+        return;
+    }
+}
+
+bool HistoryFile::readAhead(unsigned char* buffer, int size, qint64 loc)
+{
+    // searching, saving and scrolling read lines which follow each other,
+    // forwards or backwards
+    if (qAbs(loc - _lastReadEnd) <= SEQUENTIAL_DISTANCE ||
+            qAbs(_lastReadStart - (loc + size)) <= SEQUENTIAL_DISTANCE)
+        _sequentialReads++;
+    else
+        _sequentialReads = 0;
+
+    const bool backwards = loc < _lastReadStart;
+    _lastReadStart = loc;
+    _lastReadEnd = loc + size;
+
+    const bool inBlock = loc >= _readAheadOffset &&
+                         loc + size <= _readAheadOffset + _readAheadBlock.size();
+
+    if (!inBlock) {
+        if (_sequentialReads < SEQUENTIAL_READS || size >= READ_AHEAD_SIZE)
+            return false;
+
+        // read the block which continues in the direction of the reads
+        const qint64 offset = backwards ? qMax(qint64(0), loc + size - READ_AHEAD_SIZE) : loc;
+        const int length = qMin(qint64(READ_AHEAD_SIZE), _length - offset);
+
+        _readAheadBlock.resize(length);
+        if (KDE_lseek(_fd, offset, SEEK_SET) < 0 ||
+                read(_fd, _readAheadBlock.data(), length) != length) {
+            _readAheadBlock.clear();
+            return false;
         }
+        _readAheadOffset = offset;
+
+#ifdef POSIX_FADV_WILLNEED
+        // let the kernel load the block after this one in the meantime
+        const qint64 next = backwards ? qMax(qint64(0), offset - READ_AHEAD_SIZE) : offset + length;
+        posix_fadvise(_fd, next, READ_AHEAD_SIZE, POSIX_FADV_WILLNEED);
+#endif
     }
+
+    memcpy(buffer, _readAheadBlock.constData() + (loc - _readAheadOffset), size);
+    return true;
 }
 
-int HistoryFile::len() const
+qint64 HistoryFile::len() const
 {
     return _length;
 }
@@ -177,6 +354,35 @@ HistoryScroll::~HistoryScroll()
     delete _historyType;
 }
 
+void HistoryScroll::readLines(int lineno, int count, HistoryLines& lines)
+{
+    Q_ASSERT(lineno >= 0 && count >= 0 && lineno + count <= getLines());
+
+    lines.firstLine = lineno;
+    lines.offsets.resize(count + 1);
+    lines.wrapped.resize(count);
+
+    int offset = 0;
+    for (int i = 0; i < count; i++) {
+        lines.offsets[i] = offset;
+        lines.wrapped[i] = isWrappedLine(lineno + i);
+        offset += getLineLen(lineno + i);
+    }
+    lines.offsets[count] = offset;
+
+    lines.cellData.resize(offset);
+    for (int i = 0; i < count; i++) {
+        getCells(lineno + i, 0, lines.offsets[i + 1] - lines.offsets[i],
+                 lines.cellData.data() + lines.offsets[i]);
+    }
+}
+
+void HistoryScroll::readWrappedLines(int lineno, int count, bool wrapped[])
+{
+    for (int i = 0; i < count; i++)
+        wrapped[i] = isWrappedLine(lineno + i);
+}
+
 bool HistoryScroll::hasScroll()
 {
     return true;
@@ -195,9 +401,308 @@ bool HistoryScroll::hasScroll()
    at 0 in cells.
 */
 
+// returns the name of the file of a history kept under 'logFileName'
+// which holds the part 'extension', or an empty string for temporary files
+static QString historyFileName(const QString& logFileName, const char* extension)
+{
+    if (logFileName.isEmpty())
+        return QString();
+    return logFileName + '.' + extension;
+}
+
+// The format of the files of a persistent history, which is kept in a file
+// of its own.  Files without it or in another format are started over, as
+// is any history when the format changes
+struct HistoryFileFormat {
+    char magic[8];
+    // differs between byte orders as well
+    quint32 version;
+    quint32 cellSize;
+};
+
+static const char HISTORY_FILE_MAGIC[8] = { 'K', 'O', 'N', 'S', 'H', 'I', 'S', 'T' };
+static const quint32 HISTORY_FILE_VERSION = 2;
+
+// returns true if the files of the history kept under 'logFileName' are in
+// the current format.  Otherwise the format is written, and the other files
+// of the history have to be cleared
+static bool checkHistoryFormat(const QString& logFileName)
+{
+    HistoryFileFormat format;
+    memcpy(format.magic, HISTORY_FILE_MAGIC, sizeof(format.magic));
+    format.version = HISTORY_FILE_VERSION;
+    format.cellSize = sizeof(Character);
+
+    HistoryFile file(historyFileName(logFileName, "format"));
+    if (file.len() == qint64(sizeof(format))) {
+        HistoryFileFormat fileFormat;
+        file.get((unsigned char*)&fileFormat, sizeof(fileFormat), 0);
+        if (memcmp(&format, &fileFormat, sizeof(format)) == 0)
+            return true;
+    }
+
+    file.truncate(0);
+    file.add((const unsigned char*)&format, sizeof(format));
+    return false;
+}
+
 HistoryScrollFile::HistoryScrollFile(const QString& logFileName)
     : HistoryScroll(new HistoryTypeFile(logFileName))
+    , _index(historyFileName(logFileName, "lengths"))
+    , _cells(historyFileName(logFileName, "cells"))
+    , _lineflags(historyFileName(logFileName, "flags"))
+    , _colors(historyFileName(logFileName, "colors"))
+    , _chars(historyFileName(logFileName, "chars"))
+    , _persistent(!logFileName.isEmpty())
+    , _fileColorsGeneration(rgbColorGeneration())
+    , _fileSequencesGeneration(ExtendedCharTable::instance.generation())
+    , _lineCache(LINE_CACHE_CELLS)
+    , _linesEnd(0)
+{
+    if (_persistent) {
+        if (checkHistoryFormat(logFileName)) {
+            readColors();
+            readSequences();
+        } else {
+            if (_cells.len() > 0)
+                kWarning() << "The history" << logFileName << "is in an unknown format and is discarded";
+            clear();
+        }
+
+        recoverLines();
+    }
+}
+
+void HistoryScrollFile::removeFiles(const QString& logFileName)
+{
+    QFile::remove(historyFileName(logFileName, "lengths"));
+    QFile::remove(historyFileName(logFileName, "cells"));
+    QFile::remove(historyFileName(logFileName, "flags"));
+    QFile::remove(historyFileName(logFileName, "colors"));
+    QFile::remove(historyFileName(logFileName, "chars"));
+    QFile::remove(historyFileName(logFileName, "format"));
+}
+
+// the number of entries of the index which are read at once while it is
+// scanned
+static const int INDEX_READ_BATCH = 64 * 1024;
+
+void HistoryScrollFile::recoverLines()
+{
+    // the cells of a line are written first, then its index entry and
+    // then its flags, so the last lines are complete once all three exist
+    // and their cells fit into the file
+    const qint64 indexedLines = qMin(_index.len() / qint64(sizeof(quint32)), _lineflags.len());
+    const qint64 cellsLength = _cells.len();
+
+    QVector<quint32> lengths(INDEX_READ_BATCH);
+    int lines = 0;
+    bool complete = true;
+    while (complete && lines < indexedLines) {
+        const int count = qMin(qint64(INDEX_READ_BATCH), indexedLines - lines);
+        _index.get((unsigned char*)lengths.data(), count * sizeof(quint32), qint64(lines) * sizeof(quint32));
+
+        for (int i = 0; i < count; i++) {
+            const qint64 end = _linesEnd + qint64(lengths[i]) * sizeof(Character);
+            if (end > cellsLength) {
+                complete = false;
+                break;
+            }
+
+            if (lines % LINES_PER_BLOCK == 0)
+                _blockStarts << _linesEnd;
+            _linesEnd = end;
+            lines++;
+        }
+    }
+
+    _index.truncate(qint64(lines) * sizeof(quint32));
+    _lineflags.truncate(lines);
+    _cells.truncate(_linesEnd);
+}
+
+void HistoryScrollFile::readColors()
+{
+    const int count = qMin(_colors.len() / qint64(sizeof(QRgb)), qint64(CharacterColor::MAX_RGB_INDEX));
+    _colors.truncate(count * sizeof(QRgb));
+
+    _fileRgbColors.resize(count);
+    if (count > 0)
+        _colors.get((unsigned char*)_fileRgbColors.data(), count * sizeof(QRgb), 0);
+
+    updateColorIndexes();
+}
+
+void HistoryScrollFile::updateColorIndexes()
+{
+    // as with the sequences, adding a color may free the unused colors of
+    // the table, including those added just before
+    do {
+        _fileColorsGeneration = rgbColorGeneration();
+        _fileColors.resize(_fileRgbColors.count());
+        _fileColorIndexes.clear();
+        for (int i = 0; i < _fileRgbColors.count(); i++) {
+            // once the table of this process is full, the closest indexed color is used
+            _fileColors[i] = CharacterColor(COLOR_SPACE_RGB, _fileRgbColors[i] & 0xffffff);
+            if (_fileColors[i].isRgb() && !_fileColorIndexes.contains(_fileColors[i].rgbIndex()))
+                _fileColorIndexes.insert(_fileColors[i].rgbIndex(), i);
+        }
+    } while (_fileColorsGeneration != rgbColorGeneration());
+}
+
+CharacterColor HistoryScrollFile::fileColor(const CharacterColor& color, int defaultColor)
+{
+    QHash<int, int>::const_iterator iter = _fileColorIndexes.constFind(color.rgbIndex());
+    if (iter != _fileColorIndexes.constEnd())
+        return CharacterColor::fromRgbIndex(iter.value());
+
+    // the files can hold as many colors as a process
+    const int index = _fileColors.count();
+    if (index >= CharacterColor::MAX_RGB_INDEX)
+        return CharacterColor(COLOR_SPACE_DEFAULT, defaultColor);
+
+    const QRgb rgb = rgbColorValue(color.rgbIndex());
+    _colors.add((const unsigned char*)&rgb, sizeof(QRgb));
+    _fileRgbColors << rgb;
+    _fileColors << color;
+    _fileColorIndexes.insert(color.rgbIndex(), index);
+
+    return CharacterColor::fromRgbIndex(index);
+}
+
+// the number of sequences the files can hold, as many as a cell can address
+static const int MAX_FILE_SEQUENCES = 0x10000;
+
+void HistoryScrollFile::readSequences()
+{
+    QVector<ushort> data(_chars.len() / sizeof(ushort));
+    if (!data.isEmpty())
+        _chars.get((unsigned char*)data.data(), data.count() * sizeof(ushort), 0);
+
+    int pos = 0;
+    while (pos < data.count() && _fileSequences.count() < MAX_FILE_SEQUENCES) {
+        const int length = data[pos];
+        if (pos + 1 + length > data.count())
+            break;
+
+        QVector<ushort> sequence(length);
+        memcpy(sequence.data(), data.constData() + pos + 1, length * sizeof(ushort));
+        _fileSequences << sequence;
+        pos += 1 + length;
+    }
+
+    // a sequence which was only partly written is dropped, the cells which
+    // use it are written after it
+    _chars.truncate(qint64(pos) * sizeof(ushort));
+
+    updateSequenceHashes();
+}
+
+void HistoryScrollFile::updateSequenceHashes()
+{
+    ExtendedCharTable& table = ExtendedCharTable::instance;
+
+    // adding a sequence may remove the unused sequences from the table,
+    // including those added just before, so this goes on until the
+    // sequences are added without any being removed
+    do {
+        _fileSequencesGeneration = table.generation();
+        _fileSequenceHashes.resize(_fileSequences.count());
+        _fileSequenceIndexes.clear();
+        for (int i = 0; i < _fileSequences.count(); i++) {
+            const QVector<ushort>& sequence = _fileSequences[i];
+            const ushort hash = table.createExtendedChar(sequence.constData(), sequence.count());
+            _fileSequenceHashes[i] = hash;
+            if (hash != 0)
+                _fileSequenceIndexes.insert(hash, i);
+        }
+    } while (_fileSequencesGeneration != table.generation());
+}
+
+void HistoryScrollFile::checkFileTables()
 {
+    if (!_persistent)
+        return;
+
+    // the cached lines use the colors and the hashes as well
+    if (_fileColorsGeneration != rgbColorGeneration()) {
+        const QVector<CharacterColor> colors = _fileColors;
+        updateColorIndexes();
+        if (_fileColors != colors)
+            _lineCache.clear();
+    }
+
+    if (_fileSequencesGeneration != ExtendedCharTable::instance.generation()) {
+        const QVector<ushort> hashes = _fileSequenceHashes;
+        updateSequenceHashes();
+        if (_fileSequenceHashes != hashes)
+            _lineCache.clear();
+    }
+}
+
+void HistoryScrollFile::fileSequence(Character& cell)
+{
+    QHash<ushort, int>::const_iterator iter = _fileSequenceIndexes.constFind(cell.character);
+    if (iter != _fileSequenceIndexes.constEnd()) {
+        cell.character = iter.value();
+        return;
+    }
+
+    ushort length = 0;
+    const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(cell.character, length);
+    if (!chars || length == 0 || _fileSequences.count() >= MAX_FILE_SEQUENCES) {
+        // only the base character is kept
+        cell.character = chars && length > 0 ? chars[0] : ' ';
+        cell.rendition &= ~RE_EXTENDED_CHAR;
+        return;
+    }
+
+    const ushort fileLength = length;
+    _chars.add((const unsigned char*)&fileLength, sizeof(ushort));
+    _chars.add((const unsigned char*)chars, length * sizeof(ushort));
+
+    QVector<ushort> sequence(length);
+    memcpy(sequence.data(), chars, length * sizeof(ushort));
+    const int index = _fileSequences.count();
+    _fileSequences << sequence;
+    _fileSequenceHashes << cell.character;
+    _fileSequenceIndexes.insert(cell.character, index);
+
+    cell.character = index;
+}
+
+void HistoryScrollFile::readCells(Character cells[], int count, qint64 loc)
+{
+    _cells.get((unsigned char*)cells, count * sizeof(Character), loc);
+
+    if (!_persistent)
+        return;
+
+    const int colorCount = _fileColors.count();
+    const int sequenceCount = _fileSequences.count();
+    for (int i = 0; i < count; i++) {
+        if (cells[i].rendition & RE_EXTENDED_CHAR) {
+            const int index = cells[i].character;
+            const ushort hash = index < sequenceCount ? _fileSequenceHashes[index] : 0;
+            if (hash != 0) {
+                cells[i].character = hash;
+            } else {
+                cells[i].character = index < sequenceCount ? _fileSequences[index][0] : ' ';
+                cells[i].rendition &= ~RE_EXTENDED_CHAR;
+            }
+        }
+
+        CharacterColor& foreground = cells[i].foregroundColor;
+        if (foreground.isRgb()) {
+            foreground = foreground.rgbIndex() < colorCount ? _fileColors[foreground.rgbIndex()] :
+                         CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR);
+        }
+        CharacterColor& background = cells[i].backgroundColor;
+        if (background.isRgb()) {
+            background = background.rgbIndex() < colorCount ? _fileColors[background.rgbIndex()] :
+                         CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR);
+        }
+    }
 }
 
 HistoryScrollFile::~HistoryScrollFile()
@@ -206,12 +711,20 @@ HistoryScrollFile::~HistoryScrollFile()
 
 int HistoryScrollFile::getLines()
 {
-    return _index.len() / sizeof(int);
+    return _index.len() / sizeof(quint32);
 }
 
 int HistoryScrollFile::getLineLen(int lineno)
 {
-    return (startOfLine(lineno + 1) - startOfLine(lineno)) / sizeof(Character);
+    if (lineno < 0 || lineno >= getLines())
+        return (startOfLine(lineno + 1) - startOfLine(lineno)) / sizeof(Character);
+
+    if (!_index.isMapped())
+        _index.map();
+
+    quint32 length;
+    _index.get((unsigned char*)&length, sizeof(quint32), qint64(lineno) * sizeof(quint32));
+    return length;
 }
 
 bool HistoryScrollFile::isWrappedLine(int lineno)
@@ -224,41 +737,179 @@ bool HistoryScrollFile::isWrappedLine(int lineno)
     return false;
 }
 
-int HistoryScrollFile::startOfLine(int lineno)
+qint64 HistoryScrollFile::startOfLine(int lineno)
 {
     if (lineno <= 0) return 0;
-    if (lineno <= getLines()) {
-        if (!_index.isMapped())
-            _index.map();
-
-        int res;
-        _index.get((unsigned char*)&res, sizeof(int), (lineno - 1)*sizeof(int));
-        return res;
+    const int lines = getLines();
+    if (lineno == lines) return _linesEnd;
+    if (lineno > lines) return _cells.len();
+
+    if (!_index.isMapped())
+        _index.map();
+
+    // add the lengths of the lines before 'lineno' in its block
+    const int block = lineno / LINES_PER_BLOCK;
+    const int firstLine = block * LINES_PER_BLOCK;
+    qint64 start = _blockStarts[block];
+    if (lineno > firstLine) {
+        quint32 lengths[LINES_PER_BLOCK];
+        const int count = lineno - firstLine;
+        _index.get((unsigned char*)lengths, count * sizeof(quint32), qint64(firstLine) * sizeof(quint32));
+        for (int i = 0; i < count; i++)
+            start += qint64(lengths[i]) * sizeof(Character);
     }
-    return _cells.len();
+    return start;
 }
 
 void HistoryScrollFile::getCells(int lineno, int colno, int count, Character res[])
 {
-    _cells.get((unsigned char*)res, count * sizeof(Character), startOfLine(lineno) + colno * sizeof(Character));
+    checkFileTables();
+
+    const QVector<Character>* cells = _lineCache.object(lineno);
+
+    if (!cells) {
+        const qint64 start = startOfLine(lineno);
+        const int length = (startOfLine(lineno + 1) - start) / sizeof(Character);
+
+        if (length > MAX_CACHED_LINE_LENGTH || colno + count > length) {
+            readCells(res, count, start + qint64(colno) * sizeof(Character));
+            return;
+        }
+
+        QVector<Character>* line = new QVector<Character>(length);
+        if (length > 0)
+            readCells(line->data(), length, start);
+        _lineCache.insert(lineno, line, qMax(1, length));
+        cells = line;
+    }
+
+    if (colno + count > cells->count()) {
+        _lineCache.remove(lineno);
+        getCells(lineno, colno, count, res);
+        return;
+    }
+
+    qCopy(cells->constData() + colno, cells->constData() + colno + count, res);
+}
+
+void HistoryScrollFile::readLines(int lineno, int count, HistoryLines& lines)
+{
+    Q_ASSERT(lineno >= 0 && count >= 0 && lineno + count <= getLines());
+
+    checkFileTables();
+
+    // the index holds the length of each line, read the lengths of all
+    // lines at once and then their cells and flags with a single read each
+    QVector<quint32> lengths(count);
+    const qint64 start = startOfLine(lineno);
+    if (count > 0)
+        _index.get((unsigned char*)lengths.data(), count * sizeof(quint32), qint64(lineno) * sizeof(quint32));
+
+    lines.firstLine = lineno;
+    lines.offsets.resize(count + 1);
+    lines.offsets[0] = 0;
+    for (int i = 0; i < count; i++)
+        lines.offsets[i + 1] = lines.offsets[i] + lengths[i];
+
+    lines.cellData.resize(lines.offsets[count]);
+    if (lines.offsets[count] > 0)
+        readCells(lines.cellData.data(), lines.offsets[count], start);
+
+    QVector<unsigned char> flags(count);
+    if (count > 0)
+        _lineflags.get(flags.data(), count * sizeof(unsigned char), qint64(lineno) * sizeof(unsigned char));
+
+    lines.wrapped.resize(count);
+    for (int i = 0; i < count; i++)
+        lines.wrapped[i] = flags[i] & 0x01;
+}
+
+void HistoryScrollFile::readWrappedLines(int lineno, int count, bool wrapped[])
+{
+    Q_ASSERT(lineno >= 0 && count >= 0 && lineno + count <= getLines());
+
+    QVarLengthArray<unsigned char, 128> flags(count);
+    if (count > 0)
+        _lineflags.get(flags.data(), count * sizeof(unsigned char), qint64(lineno) * sizeof(unsigned char));
+
+    for (int i = 0; i < count; i++)
+        wrapped[i] = flags[i] & 0x01;
 }
 
 void HistoryScrollFile::addCells(const Character text[], int count)
 {
-    _cells.add((unsigned char*)text, count * sizeof(Character));
+    if (!_persistent) {
+        _cells.add((unsigned char*)text, count * sizeof(Character));
+        return;
+    }
+
+    checkFileTables();
+
+    QVarLengthArray<Character, LINE_SIZE> cells(count);
+    for (int i = 0; i < count; i++) {
+        cells[i] = text[i];
+        if (cells[i].rendition & RE_EXTENDED_CHAR)
+            fileSequence(cells[i]);
+        if (cells[i].foregroundColor.isRgb())
+            cells[i].foregroundColor = fileColor(cells[i].foregroundColor, DEFAULT_FORE_COLOR);
+        if (cells[i].backgroundColor.isRgb())
+            cells[i].backgroundColor = fileColor(cells[i].backgroundColor, DEFAULT_BACK_COLOR);
+    }
+    _cells.add((unsigned char*)cells.constData(), count * sizeof(Character));
 }
 
 void HistoryScrollFile::addLine(bool previousWrapped)
 {
-    if (_index.isMapped())
-        _index.unmap();
+    if (getLines() % LINES_PER_BLOCK == 0)
+        _blockStarts << _linesEnd;
+
+    const qint64 end = _cells.len();
+    const quint32 length = (end - _linesEnd) / sizeof(Character);
+    _index.add((unsigned char*)&length, sizeof(quint32));
+    _linesEnd = end;
 
-    int locn = _cells.len();
-    _index.add((unsigned char*)&locn, sizeof(int));
     unsigned char flags = previousWrapped ? 0x01 : 0x00;
     _lineflags.add((unsigned char*)&flags, sizeof(unsigned char));
 }
 
+void HistoryScrollFile::clear()
+{
+    _lineCache.clear();
+    _index.truncate(0);
+    _cells.truncate(0);
+    _lineflags.truncate(0);
+    _colors.truncate(0);
+    _fileRgbColors.clear();
+    _fileColors.clear();
+    _fileColorIndexes.clear();
+    _fileColorsGeneration = rgbColorGeneration();
+    _chars.truncate(0);
+    _fileSequences.clear();
+    _fileSequenceHashes.clear();
+    _fileSequenceIndexes.clear();
+    _fileSequencesGeneration = ExtendedCharTable::instance.generation();
+    _blockStarts.clear();
+    _linesEnd = 0;
+}
+
+qint64 HistoryScrollFile::memoryUsage() const
+{
+    // the cost of a cached line is its number of cells
+    return _lineCache.totalCost() * sizeof(Character) +
+           _blockStarts.capacity() * sizeof(qint64);
+}
+
+qint64 HistoryScrollFile::fileSize() const
+{
+    return _index.len() + _cells.len() + _lineflags.len() + _colors.len() + _chars.len();
+}
+
+void HistoryScrollFile::compact()
+{
+    // the lines are read from the files again when they are needed
+    _lineCache.clear();
+}
+
 // History Scroll None //////////////////////////////////////
 
 HistoryScrollNone::HistoryScrollNone()
@@ -302,252 +953,1009 @@ void HistoryScrollNone::addLine(bool)
 {
 }
 
+void HistoryScrollNone::clear()
+{
+}
+
 ////////////////////////////////////////////////////////////////
 // Compact History Scroll //////////////////////////////////////
 ////////////////////////////////////////////////////////////////
-void* CompactHistoryBlock::allocate(size_t size)
+CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
+    : HistoryScroll(new CompactHistoryType(maxLineCount))
+    , _firstRecord(0)
+    , _lineCount(0)
+    , _arenaHead(0)
+    , _arenaUsed(0)
+    , _maxLineCount(0)
 {
-    Q_ASSERT(size > 0);
-    if (_tail - _blockStart + size > _blockLength)
-        return 0;
-
-    void* block = _tail;
-    _tail += size;
-    //kDebug() << "allocated " << length << " bytes at address " << block;
-    _allocCount++;
-    return block;
+    setMaxNbLines(maxLineCount);
 }
 
-void CompactHistoryBlock::deallocate()
+CompactHistoryScroll::~CompactHistoryScroll()
 {
-    _allocCount--;
-    Q_ASSERT(_allocCount >= 0);
 }
 
-void* CompactHistoryBlockList::allocate(size_t size)
+CompactHistoryScroll::LineRecord& CompactHistoryScroll::record(int lineNumber)
 {
-    CompactHistoryBlock* block;
-    if (list.isEmpty() || list.last()->remaining() < size) {
-        block = new CompactHistoryBlock();
-        list.append(block);
-        //kDebug() << "new block created, remaining " << block->remaining() << "number of blocks=" << list.size();
-    } else {
-        block = list.last();
-        //kDebug() << "old block used, remaining " << block->remaining();
-    }
-    return block->allocate(size);
+    Q_ASSERT(lineNumber >= 0 && lineNumber < _lineCount);
+    return _records[(_firstRecord + lineNumber) % _records.size()];
 }
 
-void CompactHistoryBlockList::deallocate(void* ptr)
+const CharacterFormat* CompactHistoryScroll::lineFormats(const LineRecord& line) const
 {
-    Q_ASSERT(!list.isEmpty());
-
-    int i = 0;
-    CompactHistoryBlock* block = list.at(i);
-    while (i < list.size() && !block->contains(ptr)) {
-        i++;
-        block = list.at(i);
-    }
-
-    Q_ASSERT(i < list.size());
-
-    block->deallocate();
-
-    if (!block->isInUse()) {
-        list.removeAt(i);
-        delete block;
-        //kDebug() << "block deleted, new size = " << list.size();
-    }
+    return reinterpret_cast<const CharacterFormat*>(_arena.constData() + line.start);
 }
 
-CompactHistoryBlockList::~CompactHistoryBlockList()
+const quint16* CompactHistoryScroll::lineText(const LineRecord& line) const
 {
-    qDeleteAll(list.begin(), list.end());
-    list.clear();
+    return _arena.constData() + line.start + line.formatCount * FORMAT_SIZE;
 }
 
-void* CompactHistoryLine::operator new(size_t size, CompactHistoryBlockList& blockList)
+int CompactHistoryScroll::recordSize(const LineRecord& line)
 {
-    return blockList.allocate(size);
+    return line.formatCount * FORMAT_SIZE + line.length;
 }
 
-CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlockList& bList)
-    : _blockListRef(bList),
-      _formatLength(0)
+void CompactHistoryScroll::addCellsVector(const TextLine& cells)
 {
-    _length = line.size();
+    appendLine(cells.constData(), cells.size());
+}
 
-    if (line.size() > 0) {
-        _formatLength = 1;
-        int k = 1;
+void CompactHistoryScroll::addCells(const Character a[], int count)
+{
+    appendLine(a, count);
+}
 
-        // count number of different formats in this text line
-        Character c = line[0];
-        while (k < _length) {
-            if (!(line[k].equalsFormat(c))) {
-                _formatLength++; // format change detected
-                c = line[k];
+void CompactHistoryScroll::appendLine(const Character* cells, int count)
+{
+    if (_lineCount > static_cast<int>(_maxLineCount))
+        removeFirstLine();
+
+    if (_lineCount == _records.size())
+        relocateRecords(qMin(qMax(2 * _records.size(), 64), static_cast<int>(_maxLineCount) + 1));
+
+    LineRecord line;
+    line.length = count;
+    line.formatCount = 0;
+    line.wrapped = false;
+
+    // count number of different formats in this text line
+    if (count > 0) {
+        line.formatCount = 1;
+        const Character* format = cells;
+        for (int i = 1; i < count; i++) {
+            if (!cells[i].equalsFormat(*format) || cells[i].plane != format->plane) {
+                line.formatCount++; // format change detected
+                format = cells + i;
             }
-            k++;
         }
+    }
 
-        //kDebug() << "number of different formats in string: " << _formatLength;
-        _formatArray = (CharacterFormat*) _blockListRef.allocate(sizeof(CharacterFormat) * _formatLength);
-        Q_ASSERT(_formatArray != 0);
-        _text = (quint16*) _blockListRef.allocate(sizeof(quint16) * line.size());
-        Q_ASSERT(_text != 0);
-
-        _length = line.size();
-        _wrapped = false;
+    line.start = allocate(recordSize(line));
 
-        // record formats and their positions in the format array
-        c = line[0];
-        _formatArray[0].setFormat(c);
-        _formatArray[0].startPos = 0;                      // there's always at least 1 format (for the entire line, unless a change happens)
+    if (count > 0) {
+        // record formats and their positions in the format array, there's
+        // always at least 1 format (for the entire line)
+        CharacterFormat* formats = reinterpret_cast<CharacterFormat*>(_arena.data() + line.start);
+        formats[0].setFormat(cells[0]);
+        formats[0].startPos = 0;
 
-        k = 1;                                            // look for possible format changes
+        const Character* format = cells;
         int j = 1;
-        while (k < _length && j < _formatLength) {
-            if (!(line[k].equalsFormat(c))) {
-                c = line[k];
-                _formatArray[j].setFormat(c);
-                _formatArray[j].startPos = k;
-                //kDebug() << "format entry " << j << " at pos " << _formatArray[j].startPos << " " << &(_formatArray[j].startPos) ;
+        for (int i = 1; i < count && j < line.formatCount; i++) {
+            if (!cells[i].equalsFormat(*format) || cells[i].plane != format->plane) {
+                format = cells + i;
+                formats[j].setFormat(*format);
+                formats[j].startPos = i;
                 j++;
             }
-            k++;
         }
 
         // copy character values
-        for (int i = 0; i < line.size(); i++) {
-            _text[i] = line[i].character;
-            //kDebug() << "char " << i << " at mem " << &(text[i]);
-        }
+        quint16* text = _arena.data() + line.start + line.formatCount * FORMAT_SIZE;
+        for (int i = 0; i < count; i++)
+            text[i] = cells[i].character;
     }
-    //kDebug() << "line created, length " << length << " at " << &(length);
-}
 
-CompactHistoryLine::~CompactHistoryLine()
-{
-    if (_length > 0) {
-        _blockListRef.deallocate(_text);
-        _blockListRef.deallocate(_formatArray);
-    }
-    _blockListRef.deallocate(this);
+    _records[(_firstRecord + _lineCount) % _records.size()] = line;
+    _lineCount++;
 }
 
-void CompactHistoryLine::getCharacter(int index, Character& r)
+void CompactHistoryScroll::removeFirstLine()
 {
-    Q_ASSERT(index < _length);
-    int formatPos = 0;
-    while ((formatPos + 1) < _formatLength && index >= _formatArray[formatPos + 1].startPos)
-        formatPos++;
+    Q_ASSERT(_lineCount > 0);
 
-    r.character = _text[index];
-    r.rendition = _formatArray[formatPos].rendition;
-    r.foregroundColor = _formatArray[formatPos].fgColor;
-    r.backgroundColor = _formatArray[formatPos].bgColor;
-    r.isRealCharacter = _formatArray[formatPos].isRealCharacter;
+    _arenaUsed -= recordSize(_records[_firstRecord]);
+    _firstRecord = (_firstRecord + 1) % _records.size();
+    _lineCount--;
 }
 
-void CompactHistoryLine::getCharacters(Character* array, int size, int startColumn)
+int CompactHistoryScroll::allocate(int size)
 {
-    Q_ASSERT(startColumn >= 0 && size >= 0);
-    Q_ASSERT(startColumn + size <= static_cast<int>(getLength()));
+    // the free space of the arena runs from _arenaHead up to the start of
+    // the oldest line, wrapping around at the end of the arena.  The data
+    // of a line is never split, so the space at the end of the arena is
+    // skipped if it is too small.  The free space is never used up entirely
+    // so that a full arena can be told apart from an empty one.
+    if (_arenaUsed == 0)
+        _arenaHead = 0;
+
+    const int tail = _arenaUsed > 0 ? _records[_firstRecord].start : 0;
+    const int capacity = _arena.size();
+
+    int start = -1;
+    if (_arenaHead >= tail) {
+        if (capacity - _arenaHead >= size)
+            start = _arenaHead;
+        else if (size < tail)
+            start = 0;
+    } else if (tail - _arenaHead > size) {
+        start = _arenaHead;
+    }
 
-    for (int i = startColumn; i < size + startColumn; i++) {
-        getCharacter(i, array[i - startColumn]);
+    if (start == -1) {
+        relocateArena(qMax(qMax(2 * capacity, 2 * (_arenaUsed + size)), 4096));
+        start = _arenaHead;
     }
-}
 
-CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
-    : HistoryScroll(new CompactHistoryType(maxLineCount))
-    , _lines()
-    , _blockList()
-{
-    //kDebug() << "scroll of length " << maxLineCount << " created";
-    setMaxNbLines(maxLineCount);
+    _arenaHead = start + size;
+    _arenaUsed += size;
+    return start;
 }
 
-CompactHistoryScroll::~CompactHistoryScroll()
+void CompactHistoryScroll::relocateRecords(int capacity)
 {
-    qDeleteAll(_lines.begin(), _lines.end());
-    _lines.clear();
-}
+    Q_ASSERT(capacity >= _lineCount);
 
-void CompactHistoryScroll::addCellsVector(const TextLine& cells)
-{
-    CompactHistoryLine* line;
-    line = new(_blockList) CompactHistoryLine(cells, _blockList);
+    QVector<LineRecord> records(capacity);
+    for (int i = 0; i < _lineCount; i++)
+        records[i] = record(i);
 
-    if (_lines.size() > static_cast<int>(_maxLineCount)) {
-        delete _lines.takeAt(0);
-    }
-    _lines.append(line);
+    _records = records;
+    _firstRecord = 0;
 }
 
-void CompactHistoryScroll::addCells(const Character a[], int count)
+void CompactHistoryScroll::relocateArena(int capacity)
 {
-    TextLine newLine(count);
-    qCopy(a, a + count, newLine.begin());
-    addCellsVector(newLine);
+    Q_ASSERT(capacity >= _arenaUsed);
+
+    // copy the lines to the beginning of the new arena, in order
+    QVector<quint16> arena(capacity);
+    int position = 0;
+    for (int i = 0; i < _lineCount; i++) {
+        LineRecord& line = record(i);
+        const int size = recordSize(line);
+        if (size > 0)
+            memcpy(arena.data() + position, _arena.constData() + line.start, size * sizeof(quint16));
+        line.start = position;
+        position += size;
+    }
+
+    _arena = arena;
+    _arenaHead = position;
 }
 
 void CompactHistoryScroll::addLine(bool previousWrapped)
 {
-    CompactHistoryLine* line = _lines.last();
-    //kDebug() << "last line at address " << line;
-    line->setWrapped(previousWrapped);
+    if (_lineCount > 0)
+        record(_lineCount - 1).wrapped = previousWrapped;
 }
 
 int CompactHistoryScroll::getLines()
 {
-    return _lines.size();
+    return _lineCount;
 }
 
 int CompactHistoryScroll::getLineLen(int lineNumber)
 {
-    Q_ASSERT(lineNumber >= 0 && lineNumber < _lines.size());
-    CompactHistoryLine* line = _lines[lineNumber];
-    //kDebug() << "request for line at address " << line;
-    return line->getLength();
+    return record(lineNumber).length;
 }
 
 void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count, Character buffer[])
 {
     if (count == 0) return;
-    Q_ASSERT(lineNumber < _lines.size());
-    CompactHistoryLine* line = _lines[lineNumber];
-    Q_ASSERT(startColumn >= 0);
-    Q_ASSERT((unsigned int)startColumn <= line->getLength() - count);
-    line->getCharacters(buffer, count, startColumn);
+    const LineRecord& line = record(lineNumber);
+    Q_ASSERT(startColumn >= 0 && count > 0);
+    Q_ASSERT(startColumn + count <= line.length);
+
+    const CharacterFormat* formats = lineFormats(line);
+    const quint16* text = lineText(line);
+
+    int formatPos = 0;
+    while ((formatPos + 1) < line.formatCount && startColumn >= formats[formatPos + 1].startPos)
+        formatPos++;
+
+    for (int i = startColumn; i < startColumn + count; i++) {
+        if ((formatPos + 1) < line.formatCount && i >= formats[formatPos + 1].startPos)
+            formatPos++;
+
+        const CharacterFormat& format = formats[formatPos];
+        Character& r = buffer[i - startColumn];
+        r.character = text[i];
+        r.rendition = format.rendition;
+        r.foregroundColor = format.fgColor;
+        r.backgroundColor = format.bgColor;
+        r.isRealCharacter = format.isRealCharacter;
+        r.plane = format.plane;
+    }
 }
 
 void CompactHistoryScroll::setMaxNbLines(unsigned int lineCount)
 {
     _maxLineCount = lineCount;
 
-    while (_lines.size() > static_cast<int>(lineCount)) {
-        delete _lines.takeAt(0);
-    }
-    //kDebug() << "set max lines to: " << _maxLineCount;
+    while (_lineCount > static_cast<int>(lineCount))
+        removeFirstLine();
+
+    // give back the memory which the lines removed above used
+    if (_records.size() > _lineCount + 1)
+        relocateRecords(qMin(_records.size(), static_cast<int>(lineCount) + 1));
+    if (_arena.size() > 2 * _arenaUsed)
+        relocateArena(2 * _arenaUsed);
 }
 
 bool CompactHistoryScroll::isWrappedLine(int lineNumber)
 {
-    Q_ASSERT(lineNumber < _lines.size());
-    return _lines[lineNumber]->isWrapped();
+    return record(lineNumber).wrapped;
 }
 
-//////////////////////////////////////////////////////////////////////
-// History Types
-//////////////////////////////////////////////////////////////////////
+void CompactHistoryScroll::clear()
+{
+    // the rings keep their size for the lines which come next
+    _firstRecord = 0;
+    _lineCount = 0;
+    _arenaHead = 0;
+    _arenaUsed = 0;
+}
 
-HistoryType::HistoryType()
+qint64 CompactHistoryScroll::memoryUsage() const
 {
+    return qint64(_records.size()) * sizeof(LineRecord) + qint64(_arena.size()) * sizeof(quint16);
 }
 
-HistoryType::~HistoryType()
+void CompactHistoryScroll::compact()
+{
+    // after a burst of long lines the arena may be far larger than the
+    // lines which are left need, move them into an arena of their size
+    // with some room to spare for new lines
+    const int capacity = _arenaUsed + _arenaUsed / 2;
+    if (_arena.size() > 2 * capacity)
+        relocateArena(capacity);
+}
+
+////////////////////////////////////////////////////////////////
+// Compressed History Scroll ///////////////////////////////////
+////////////////////////////////////////////////////////////////
+
+CompressedHistoryScroll::CompressedHistoryScroll(int maxLineCount)
+    : HistoryScroll(new CompressedHistoryType(maxLineCount))
+    , _firstLine(0)
+    , _maxLineCount(maxLineCount)
+{
+    _currentBlock.firstLine = 0;
+}
+
+CompressedHistoryScroll::~CompressedHistoryScroll()
+{
+}
+
+int CompressedHistoryScroll::getLines()
+{
+    return _currentBlock.firstLine + _currentBlock.lineOffsets.count() - _firstLine;
+}
+
+int CompressedHistoryScroll::getLineLen(int lineno)
+{
+    qint32 header[LINE_HEADER_SIZE];
+    lineData(lineno, header);
+    return header[LINE_LENGTH];
+}
+
+bool CompressedHistoryScroll::isWrappedLine(int lineno)
+{
+    if (lineno < 0 || lineno >= getLines())
+        return false;
+
+    qint32 header[LINE_HEADER_SIZE];
+    lineData(lineno, header);
+    return header[LINE_WRAPPED_FLAG];
+}
+
+void CompressedHistoryScroll::getCells(int lineno, int colno, int count, Character res[])
+{
+    qint32 header[LINE_HEADER_SIZE];
+    const char* line = lineData(lineno, header);
+
+    Q_ASSERT(colno >= 0 && count >= 0 && colno + count <= header[LINE_LENGTH]);
+
+    const int formatCount = header[LINE_FORMAT_COUNT];
+    const CharacterFormat* formats = reinterpret_cast<const CharacterFormat*>(line + sizeof(qint32) * LINE_HEADER_SIZE);
+    const quint16* text = reinterpret_cast<const quint16*>(formats + formatCount);
+
+    int format = 0;
+    for (int i = 0; i < count; i++) {
+        const int column = colno + i;
+        while (format + 1 < formatCount && formats[format + 1].startPos <= column)
+            format++;
+
+        res[i].character = text[column];
+        res[i].rendition = formats[format].rendition;
+        res[i].isRealCharacter = formats[format].isRealCharacter;
+        res[i].plane = formats[format].plane;
+        res[i].foregroundColor = formats[format].fgColor;
+        res[i].backgroundColor = formats[format].bgColor;
+    }
+}
+
+void CompressedHistoryScroll::addCells(const Character a[], int count)
+{
+    _pendingLine.resize(count);
+    memcpy(_pendingLine.data(), a, count * sizeof(Character));
+}
+
+void CompressedHistoryScroll::addCellsVector(const TextLine& cells)
+{
+    _pendingLine = cells;
+}
+
+void CompressedHistoryScroll::takeCellsVector(TextLine& cells)
+{
+    // the storage of the previous line is handed back for reuse
+    qSwap(_pendingLine, cells);
+}
+
+void CompressedHistoryScroll::addLine(bool previousWrapped)
+{
+    const Character* cells = _pendingLine.constData();
+    const int length = _pendingLine.count();
+
+    // unlike CompactHistoryLine, the runs also keep the RE_EXTENDED_CHAR
+    // flag and whether characters are real, so that lines come back unchanged
+    QVector<CharacterFormat> formats;
+    for (int i = 0; i < length; i++) {
+        if (i == 0 || !cells[i].equalsFormat(cells[i - 1]) ||
+                cells[i].isRealCharacter != cells[i - 1].isRealCharacter ||
+                cells[i].plane != cells[i - 1].plane) {
+            CharacterFormat format;
+            format.setFormat(cells[i]);
+            format.startPos = i;
+            formats << format;
+        }
+    }
+
+    QByteArray& data = _currentBlock.data;
+    _currentBlock.lineOffsets << data.size();
+
+    const qint32 header[LINE_HEADER_SIZE] = { length, formats.count(), previousWrapped };
+    data.append(reinterpret_cast<const char*>(header), sizeof(header));
+    data.append(reinterpret_cast<const char*>(formats.constData()), formats.count() * sizeof(CharacterFormat));
+
+    const int textStart = data.size();
+    data.resize(textStart + length * sizeof(quint16));
+    quint16* text = reinterpret_cast<quint16*>(data.data() + textStart);
+    for (int i = 0; i < length; i++)
+        text[i] = cells[i].character;
+
+    _pendingLine.clear();
+
+    if (data.size() >= BLOCK_SIZE)
+        flushBlock();
+
+    discardLines();
+}
+
+void CompressedHistoryScroll::clear()
+{
+    _file.truncate(0);
+    _blockPositions.clear();
+    _cache.clear();
+    _pendingLine.clear();
+
+    _currentBlock.firstLine = 0;
+    _currentBlock.lineOffsets.clear();
+    _currentBlock.data.clear();
+    _firstLine = 0;
+}
+
+void CompressedHistoryScroll::setMaxNbLines(int lineCount)
+{
+    delete _historyType;
+    _historyType = new CompressedHistoryType(lineCount);
+    _maxLineCount = lineCount;
+
+    discardLines();
+}
+
+void CompressedHistoryScroll::discardLines()
+{
+    if (_maxLineCount < 0 || getLines() <= _maxLineCount)
+        return;
+
+    _firstLine += getLines() - _maxLineCount;
+
+    // forget the blocks whose lines are all discarded
+    int discardedBlocks = 0;
+    while (discardedBlocks < _blockPositions.count()) {
+        const int nextFirstLine = (discardedBlocks + 1 < _blockPositions.count()) ?
+                                  _blockPositions[discardedBlocks + 1].firstLine : _currentBlock.firstLine;
+        if (nextFirstLine > _firstLine)
+            break;
+        discardedBlocks++;
+    }
+    _blockPositions.remove(0, discardedBlocks);
+
+    for (int i = _cache.count() - 1; i >= 0; i--) {
+        const Block& block = _cache[i];
+        if (block.firstLine + block.lineOffsets.count() <= _firstLine)
+            _cache.removeAt(i);
+    }
+
+    if (discardedBlocks > 0)
+        compactFile();
+}
+
+void CompressedHistoryScroll::compactFile()
+{
+    // the blocks are moved once the discarded ones take more space than
+    // the ones which are left, so each byte is moved at most once on
+    // average
+    const qint64 discarded = _blockPositions.isEmpty() ? _file.len() : _blockPositions.first().offset;
+    if (discarded < MIN_DISCARDED_FILE_SIZE || discarded < _file.len() - discarded)
+        return;
+
+    if (!_file.removeStart(discarded))
+        return;
+
+    for (int i = 0; i < _blockPositions.count(); i++)
+        _blockPositions[i].offset -= discarded;
+}
+
+const char* CompressedHistoryScroll::lineData(int lineno, qint32 header[LINE_HEADER_SIZE])
+{
+    Q_ASSERT(lineno >= 0 && lineno < getLines());
+    lineno += _firstLine;
+
+    const Block& block = findBlock(lineno);
+    const char* line = block.data.constData() + block.lineOffsets[lineno - block.firstLine];
+
+    // lines are only aligned to two bytes within a block
+    memcpy(header, line, sizeof(qint32) * LINE_HEADER_SIZE);
+    return line;
+}
+
+const CompressedHistoryScroll::Block& CompressedHistoryScroll::findBlock(int lineno)
+{
+    if (lineno >= _currentBlock.firstLine)
+        return _currentBlock;
+
+    for (int i = 0; i < _cache.count(); i++) {
+        const Block& block = _cache[i];
+        if (lineno >= block.firstLine && lineno < block.firstLine + block.lineOffsets.count()) {
+            _cache.move(i, 0);
+            return _cache.first();
+        }
+    }
+
+    // find the last block which starts at or before the line
+    int lower = 0;
+    int upper = _blockPositions.count() - 1;
+    while (lower < upper) {
+        const int middle = (lower + upper + 1) / 2;
+        if (_blockPositions[middle].firstLine <= lineno)
+            lower = middle;
+        else
+            upper = middle - 1;
+    }
+
+    const BlockPosition& position = _blockPositions[lower];
+    const int nextFirstLine = (lower + 1 < _blockPositions.count()) ?
+                              _blockPositions[lower + 1].firstLine : _currentBlock.firstLine;
+
+    QByteArray compressed;
+    compressed.resize(position.size);
+    _file.get(reinterpret_cast<unsigned char*>(compressed.data()), position.size, position.offset);
+    const QByteArray raw = qUncompress(compressed);
+
+    // a block starts with the number of lines and their offsets
+    Block block;
+    block.firstLine = position.firstLine;
+    qint32 lineCount = 0;
+    if (raw.size() >= int(sizeof(qint32)))
+        memcpy(&lineCount, raw.constData(), sizeof(qint32));
+
+    const int headerSize = sizeof(qint32) * (1 + lineCount);
+    if (lineCount == nextFirstLine - position.firstLine && raw.size() >= headerSize) {
+        block.lineOffsets.resize(lineCount);
+        memcpy(block.lineOffsets.data(), raw.constData() + sizeof(qint32), sizeof(qint32) * lineCount);
+        block.data = raw.mid(headerSize);
+    } else {
+        // the block could not be read back, show its lines as empty lines
+        kWarning() << "Unable to read compressed history block at" << position.offset;
+
+        const qint32 emptyLine[LINE_HEADER_SIZE] = { 0, 0, 0 };
+        block.data = QByteArray(reinterpret_cast<const char*>(emptyLine), sizeof(emptyLine));
+        block.lineOffsets.fill(0, nextFirstLine - position.firstLine);
+    }
+
+    if (_cache.count() >= MAX_CACHED_BLOCKS)
+        _cache.removeLast();
+    _cache.prepend(block);
+
+    return _cache.first();
+}
+
+qint64 CompressedHistoryScroll::memoryUsage() const
+{
+    qint64 usage = _blockPositions.capacity() * sizeof(BlockPosition) +
+                   _currentBlock.lineOffsets.capacity() * sizeof(int) +
+                   _currentBlock.data.capacity();
+    foreach(const Block& block, _cache) {
+        usage += block.lineOffsets.capacity() * sizeof(int) + block.data.capacity();
+    }
+    return usage;
+}
+
+qint64 CompressedHistoryScroll::fileSize() const
+{
+    return _file.len();
+}
+
+void CompressedHistoryScroll::compact()
+{
+    // the cached blocks are decompressed again when the lines are read
+    _cache.clear();
+}
+
+void CompressedHistoryScroll::flushBlock()
+{
+    const qint32 lineCount = _currentBlock.lineOffsets.count();
+    if (lineCount == 0)
+        return;
+
+    QByteArray raw;
+    raw.reserve(sizeof(qint32) * (1 + lineCount) + _currentBlock.data.size());
+    raw.append(reinterpret_cast<const char*>(&lineCount), sizeof(qint32));
+    raw.append(reinterpret_cast<const char*>(_currentBlock.lineOffsets.constData()), sizeof(qint32) * lineCount);
+    raw.append(_currentBlock.data);
+
+    const QByteArray compressed = qCompress(raw, COMPRESSION_LEVEL);
+
+    BlockPosition position;
+    position.firstLine = _currentBlock.firstLine;
+    position.offset = _file.len();
+    position.size = compressed.size();
+    _blockPositions << position;
+
+    _file.add(reinterpret_cast<const unsigned char*>(compressed.constData()), compressed.size());
+
+    _currentBlock.firstLine += lineCount;
+    _currentBlock.lineOffsets.clear();
+    _currentBlock.data.clear();
+}
+
+////////////////////////////////////////////////////////////////
+// Shared History Scroll ///////////////////////////////////////
+////////////////////////////////////////////////////////////////
+
+HistoryLinePool HistoryLinePool::instance;
+
+QByteArray HistoryLinePool::acquire(const Character cells[], int count)
+{
+    const QByteArray key = QByteArray::fromRawData(reinterpret_cast<const char*>(cells),
+                           count * sizeof(Character));
+
+    QHash<QByteArray, int>::iterator iter = _lines.find(key);
+    if (iter != _lines.end()) {
+        ++iter.value();
+        return iter.key();
+    }
+
+    // 'key' refers to the caller's cells, store a copy of them
+    const QByteArray line(key.constData(), key.size());
+    _lines.insert(line, 1);
+    return line;
+}
+
+void HistoryLinePool::release(const QByteArray& line)
+{
+    QHash<QByteArray, int>::iterator iter = _lines.find(line);
+    Q_ASSERT(iter != _lines.end());
+
+    if (--iter.value() == 0)
+        _lines.erase(iter);
+}
+
+int HistoryLinePool::referenceCount(const QByteArray& line) const
+{
+    return _lines.value(line, 0);
+}
+
+SharedHistoryScroll::SharedHistoryScroll(unsigned int maxLineCount)
+    : HistoryScroll(new SharedHistoryType(maxLineCount))
+    , _maxLineCount(0)
+{
+    setMaxNbLines(maxLineCount);
+}
+
+SharedHistoryScroll::~SharedHistoryScroll()
+{
+    while (!_lines.isEmpty())
+        removeFirstLine();
+}
+
+void SharedHistoryScroll::removeFirstLine()
+{
+    HistoryLinePool::instance.release(_lines.first().cells);
+    _lines.removeFirst();
+}
+
+void SharedHistoryScroll::addCells(const Character a[], int count)
+{
+    if (_lines.count() > static_cast<int>(_maxLineCount))
+        removeFirstLine();
+
+    Line line;
+    line.cells = HistoryLinePool::instance.acquire(a, count);
+    line.wrapped = false;
+    _lines.append(line);
+}
+
+void SharedHistoryScroll::addLine(bool previousWrapped)
+{
+    if (!_lines.isEmpty())
+        _lines.last().wrapped = previousWrapped;
+}
+
+int SharedHistoryScroll::getLines()
+{
+    return _lines.count();
+}
+
+int SharedHistoryScroll::getLineLen(int lineNumber)
+{
+    Q_ASSERT(lineNumber >= 0 && lineNumber < _lines.count());
+    return _lines[lineNumber].cells.size() / sizeof(Character);
+}
+
+void SharedHistoryScroll::getCells(int lineNumber, int startColumn, int count, Character buffer[])
+{
+    if (count == 0) return;
+    Q_ASSERT(startColumn >= 0 && startColumn + count <= getLineLen(lineNumber));
+
+    const Character* cells = reinterpret_cast<const Character*>(_lines[lineNumber].cells.constData());
+    memcpy(buffer, cells + startColumn, count * sizeof(Character));
+}
+
+bool SharedHistoryScroll::isWrappedLine(int lineNumber)
+{
+    Q_ASSERT(lineNumber >= 0 && lineNumber < _lines.count());
+    return _lines[lineNumber].wrapped;
+}
+
+qint64 SharedHistoryScroll::memoryUsage() const
+{
+    qint64 usage = qint64(_lines.count()) * sizeof(Line);
+    foreach(const Line& line, _lines) {
+        usage += line.cells.size() / qMax(1, HistoryLinePool::instance.referenceCount(line.cells));
+    }
+    return usage;
+}
+
+void SharedHistoryScroll::clear()
+{
+    while (!_lines.isEmpty())
+        removeFirstLine();
+}
+
+void SharedHistoryScroll::setMaxNbLines(unsigned int lineCount)
+{
+    _maxLineCount = lineCount;
+
+    while (_lines.count() > static_cast<int>(lineCount))
+        removeFirstLine();
+}
+
+////////////////////////////////////////////////////////////////
+// History Scroll Conversion ///////////////////////////////////
+////////////////////////////////////////////////////////////////
+
+// the type belongs to 'target', it is not deleted by ~HistoryScroll()
+HistoryScrollConversion::HistoryScrollConversion(HistoryScroll* source, HistoryScroll* target)
+    : HistoryScroll(const_cast<HistoryType*>(&target->getType()))
+    , _source(source)
+    , _target(target)
+    , _copiedLines(0)
+{
+    Q_ASSERT(_target->getLines() == 0);
+}
+
+HistoryScrollConversion::~HistoryScrollConversion()
+{
+    _historyType = 0;
+
+    delete _source;
+    delete _target;
+}
+
+int HistoryScrollConversion::getLines()
+{
+    return _source->getLines() + _pendingLines.count();
+}
+
+int HistoryScrollConversion::getLineLen(int lineno)
+{
+    const int sourceLines = _source->getLines();
+    if (lineno < sourceLines)
+        return _source->getLineLen(lineno);
+    else
+        return _pendingLines[lineno - sourceLines].cells.count();
+}
+
+void HistoryScrollConversion::getCells(int lineno, int colno, int count, Character res[])
+{
+    const int sourceLines = _source->getLines();
+    if (lineno < sourceLines) {
+        _source->getCells(lineno, colno, count, res);
+    } else {
+        const TextLine& cells = _pendingLines[lineno - sourceLines].cells;
+        Q_ASSERT(colno >= 0 && count >= 0 && colno + count <= cells.count());
+        memcpy(res, cells.constData() + colno, count * sizeof(Character));
+    }
+}
+
+bool HistoryScrollConversion::isWrappedLine(int lineno)
+{
+    const int sourceLines = _source->getLines();
+    if (lineno < sourceLines)
+        return _source->isWrappedLine(lineno);
+    else
+        return _pendingLines[lineno - sourceLines].wrapped;
+}
+
+void HistoryScrollConversion::addCells(const Character a[], int count)
+{
+    PendingLine line;
+    line.cells.resize(count);
+    memcpy(line.cells.data(), a, count * sizeof(Character));
+    line.wrapped = false;
+    _pendingLines << line;
+}
+
+void HistoryScrollConversion::addCellsVector(const TextLine& cells)
+{
+    PendingLine line;
+    line.cells = cells;
+    line.wrapped = false;
+    _pendingLines << line;
+}
+
+void HistoryScrollConversion::takeCellsVector(TextLine& cells)
+{
+    PendingLine line;
+    qSwap(line.cells, cells);
+    line.wrapped = false;
+    _pendingLines << line;
+}
+
+void HistoryScrollConversion::addLine(bool previousWrapped)
+{
+    if (!_pendingLines.isEmpty())
+        _pendingLines.last().wrapped = previousWrapped;
+}
+
+qint64 HistoryScrollConversion::retainedMemoryUsage() const
+{
+    qint64 usage = _target->memoryUsage();
+    foreach(const PendingLine& line, _pendingLines) {
+        usage += line.cells.count() * sizeof(Character);
+    }
+    return usage;
+}
+
+qint64 HistoryScrollConversion::memoryUsage() const
+{
+    qint64 usage = _source->memoryUsage() + _target->memoryUsage();
+    foreach(const PendingLine& line, _pendingLines) {
+        usage += line.cells.count() * sizeof(Character);
+    }
+    return usage;
+}
+
+qint64 HistoryScrollConversion::fileSize() const
+{
+    return _source->fileSize() + _target->fileSize();
+}
+
+void HistoryScrollConversion::clear()
+{
+    // nothing is left to convert
+    _source->clear();
+    _target->clear();
+    _pendingLines.clear();
+    _copiedLines = 0;
+}
+
+bool HistoryScrollConversion::convert(int count)
+{
+    const int sourceLines = _source->getLines();
+    const int lastLine = qMin(_copiedLines + count, getLines());
+
+    for (; _copiedLines < lastLine; _copiedLines++) {
+        if (_copiedLines < sourceLines) {
+            const int length = _source->getLineLen(_copiedLines);
+            if (_buffer.count() < length)
+                _buffer.resize(length);
+
+            _source->getCells(_copiedLines, 0, length, _buffer.data());
+            _target->addCells(_buffer.constData(), length);
+            _target->addLine(_source->isWrappedLine(_copiedLines));
+        } else {
+            const PendingLine& line = _pendingLines[_copiedLines - sourceLines];
+            _target->addCellsVector(line.cells);
+            _target->addLine(line.wrapped);
+        }
+    }
+
+    return _copiedLines == getLines();
+}
+
+HistoryScroll* HistoryScrollConversion::takeTarget()
+{
+    Q_ASSERT(_copiedLines == getLines());
+
+    HistoryScroll* target = _target;
+    _target = 0;
+    return target;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Index for searching the history
+//////////////////////////////////////////////////////////////////////
+
+// the trigrams are hashed onto the first 127 bits of a signature, the
+// last bit is set if the line is wrapped
+static const int SIGNATURE_BITS = 127;
+static const quint64 WRAPPED_BIT = Q_UINT64_C(1) << 63;
+
+HistorySearchIndex::HistorySearchIndex()
+    : _first(0)
+{
+}
+
+void HistorySearchIndex::addTrigrams(Signature& signature, const QString& text)
+{
+    for (int i = 0; i + 2 < text.length(); i++) {
+        uint hash = text[i].unicode();
+        hash = hash * 31 + text[i + 1].unicode();
+        hash = hash * 31 + text[i + 2].unicode();
+        hash *= 2654435761u;
+
+        const int bit = (hash >> 8) % SIGNATURE_BITS;
+        signature.bits[bit >> 6] |= Q_UINT64_C(1) << (bit & 63);
+    }
+}
+
+void HistorySearchIndex::addLine(const QString& text, bool wrapped)
+{
+    Signature signature;
+    signature.bits[0] = 0;
+    signature.bits[1] = 0;
+
+    QString foldedText = text.toCaseFolded();
+
+    // a line which continues a wrapped line adds to its signature, including
+    // the trigrams which span both lines
+    if (lineCount() > 0 && isWrapped(_signatures.count() - 1)) {
+        signature = _signatures.last();
+        signature.bits[1] &= ~WRAPPED_BIT;
+        foldedText.prepend(_wrappedText);
+    }
+
+    addTrigrams(signature, foldedText);
+
+    if (wrapped) {
+        signature.bits[1] |= WRAPPED_BIT;
+        _wrappedText = foldedText.right(2);
+    } else {
+        _wrappedText.clear();
+    }
+
+    _signatures << signature;
+}
+
+void HistorySearchIndex::keepLines(int count)
+{
+    const int excess = lineCount() - qMax(count, 0);
+    if (excess <= 0)
+        return;
+
+    _first += excess;
+
+    // the signatures of removed lines are only dropped once they take up
+    // half of the vector, so that removing a line does not move the others
+    // each time
+    if (_first >= _signatures.count() / 2) {
+        _signatures.remove(0, _first);
+        _first = 0;
+    }
+}
+
+void HistorySearchIndex::clear()
+{
+    _signatures.clear();
+    _first = 0;
+    _wrappedText.clear();
+}
+
+int HistorySearchIndex::lineCount() const
+{
+    return _signatures.count() - _first;
+}
+
+bool HistorySearchIndex::isWrapped(int index) const
+{
+    return _signatures[index].bits[1] & WRAPPED_BIT;
+}
+
+bool HistorySearchIndex::findCandidateLines(const QString& text, int historyLines,
+        int& startLine, int& endLine) const
+{
+    Signature query;
+    query.bits[0] = 0;
+    query.bits[1] = 0;
+    addTrigrams(query, text.toCaseFolded());
+
+    // text with less than three characters may be anywhere
+    if (query.bits[0] == 0 && query.bits[1] == 0)
+        return true;
+
+    // the lines before the indexed ones may contain the text as well
+    const int indexedLines = qMin(lineCount(), historyLines);
+    const int firstIndexedLine = historyLines - indexedLines;
+    // the index of the signature of the history line 0
+    const int base = _signatures.count() - indexedLines - firstIndexedLine;
+
+    int first = -1;
+    int last = -1;
+    for (int line = startLine; line <= endLine; line++) {
+        bool candidate = true;
+        if (line >= firstIndexedLine && line < historyLines) {
+            // the text of a wrapped line is only complete in the signature
+            // of the line where it ends
+            const Signature& signature = _signatures[base + line];
+            candidate = !(signature.bits[1] & WRAPPED_BIT) &&
+                        (signature.bits[0] & query.bits[0]) == query.bits[0] &&
+                        (signature.bits[1] & query.bits[1]) == query.bits[1];
+        }
+
+        if (candidate) {
+            if (first == -1)
+                first = line;
+            last = line;
+        }
+    }
+
+    if (first == -1)
+        return false;
+
+    // the text may start on the lines which the first line continues
+    while (first > firstIndexedLine && first - 1 < historyLines && isWrapped(base + first - 1))
+        first--;
+
+    startLine = first;
+    endLine = last;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// History Types
+//////////////////////////////////////////////////////////////////////
+
+HistoryType::HistoryType()
+{
+}
+
+HistoryType::~HistoryType()
 {
 }
 
@@ -587,7 +1995,8 @@ bool HistoryTypeFile::isEnabled() const
 
 HistoryScroll* HistoryTypeFile::scroll(HistoryScroll* old) const
 {
-    if (dynamic_cast<HistoryFile *>(old))
+    if (dynamic_cast<HistoryScrollFile*>(old) &&
+            static_cast<const HistoryTypeFile&>(old->getType()).fileName() == _fileName)
         return old; // Unchanged.
 
     HistoryScroll* newScroll = new HistoryScrollFile(_fileName);
@@ -620,6 +2029,55 @@ int HistoryTypeFile::maximumLineCount() const
 
 //////////////////////////////
 
+CompressedHistoryType::CompressedHistoryType(int nbLines)
+    : _maxLines(nbLines)
+{
+}
+
+bool CompressedHistoryType::isEnabled() const
+{
+    return true;
+}
+
+HistoryScroll* CompressedHistoryType::scroll(HistoryScroll* old) const
+{
+    CompressedHistoryScroll* oldBuffer = dynamic_cast<CompressedHistoryScroll*>(old);
+    if (oldBuffer) {
+        oldBuffer->setMaxNbLines(_maxLines);
+        return oldBuffer;
+    }
+
+    HistoryScroll* newScroll = new CompressedHistoryScroll(_maxLines);
+
+    Character line[LINE_SIZE];
+    int lines = (old != 0) ? old->getLines() : 0;
+    const int firstLine = (_maxLines >= 0) ? qMax(0, lines - _maxLines) : 0;
+    for (int i = firstLine; i < lines; i++) {
+        int size = old->getLineLen(i);
+        if (size > LINE_SIZE) {
+            Character* tmp_line = new Character[size];
+            old->getCells(i, 0, size, tmp_line);
+            newScroll->addCells(tmp_line, size);
+            newScroll->addLine(old->isWrappedLine(i));
+            delete [] tmp_line;
+        } else {
+            old->getCells(i, 0, size, line);
+            newScroll->addCells(line, size);
+            newScroll->addLine(old->isWrappedLine(i));
+        }
+    }
+
+    delete old;
+    return newScroll;
+}
+
+int CompressedHistoryType::maximumLineCount() const
+{
+    return _maxLines;
+}
+
+//////////////////////////////
+
 CompactHistoryType::CompactHistoryType(unsigned int nbLines)
     : _maxLines(nbLines)
 {
@@ -647,3 +2105,51 @@ HistoryScroll* CompactHistoryType::scroll(HistoryScroll* old) const
     }
     return new CompactHistoryScroll(_maxLines);
 }
+
+//////////////////////////////
+
+SharedHistoryType::SharedHistoryType(unsigned int nbLines)
+    : _maxLines(nbLines)
+{
+}
+
+bool SharedHistoryType::isEnabled() const
+{
+    return true;
+}
+
+int SharedHistoryType::maximumLineCount() const
+{
+    return _maxLines;
+}
+
+HistoryScroll* SharedHistoryType::scroll(HistoryScroll* old) const
+{
+    SharedHistoryScroll* oldBuffer = dynamic_cast<SharedHistoryScroll*>(old);
+    if (oldBuffer) {
+        oldBuffer->setMaxNbLines(_maxLines);
+        return oldBuffer;
+    }
+
+    SharedHistoryScroll* newScroll = new SharedHistoryScroll(_maxLines);
+
+    Character line[LINE_SIZE];
+    int lines = (old != 0) ? old->getLines() : 0;
+    for (int i = qMax(0, lines - int(_maxLines)); i < lines; i++) {
+        int size = old->getLineLen(i);
+        if (size > LINE_SIZE) {
+            Character* tmp_line = new Character[size];
+            old->getCells(i, 0, size, tmp_line);
+            newScroll->addCells(tmp_line, size);
+            newScroll->addLine(old->isWrappedLine(i));
+            delete [] tmp_line;
+        } else {
+            old->getCells(i, 0, size, line);
+            newScroll->addCells(line, size);
+            newScroll->addLine(old->isWrappedLine(i));
+        }
+    }
+
+    delete old;
+    return newScroll;
+}
@@ -21,11 +21,13 @@
 #ifndef HISTORY_H
 #define HISTORY_H
 
-// System
-#include <sys/mman.h>
-
 // Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QString>
 #include <QtCore/QVector>
 #include <QtCore/QTemporaryFile>
 
@@ -41,28 +43,58 @@ namespace Konsole
 class HistoryFile
 {
 public:
-    HistoryFile();
+    //uses an automatically removed temporary file, or the file 'fileName'
+    //which is kept and whose contents are appended to, if it is given.
+    //The file is only accessible to the user
+    explicit HistoryFile(const QString& fileName = QString());
     virtual ~HistoryFile();
 
     virtual void add(const unsigned char* bytes, int len);
-    virtual void get(unsigned char* bytes, int len, int loc);
-    virtual int  len() const;
+    virtual void get(unsigned char* bytes, int len, qint64 loc);
+    virtual qint64 len() const;
+
+    //drops the data past 'length' from the file
+    void truncate(qint64 length);
+    //drops the first 'length' bytes of the file, moving the data after them
+    //to the start.  'length' has to be at least as large as the data which
+    //is moved.  Returns false and leaves the file unchanged if this fails
+    bool removeStart(qint64 length);
 
-    //mmaps the file in read-only mode
+    //reads the file through read-only mmap'ed windows from now on
     void map();
-    //un-mmaps the file
+    //un-mmaps all windows and goes back to reading with lseek-read calls
     void unmap();
-    //returns true if the file is mmap'ed
+    //returns true if the file is read through mmap'ed windows
     bool isMapped() const;
 
 
 private:
+    //a section of the file which is mmap'ed in read-only mode
+    struct MappedWindow {
+        qint64 offset;
+        qint64 length;
+        char* data;
+    };
+
+    //returns the mmap'ed window which contains the byte at 'loc', mapping
+    //it if necessary, or 0 if mmap'ing failed
+    const MappedWindow* mapWindow(qint64 loc);
+
+    //copies the data from the block read ahead if it holds it, and reads
+    //a new block once several reads have followed each other.  Returns
+    //false if the data still has to be read from the file
+    bool readAhead(unsigned char* bytes, int len, qint64 loc);
+
     int  _fd;
-    int  _length;
+    qint64 _length;
     QTemporaryFile _tmpFile;
+    bool _ownsFd;  //true for the file which is kept, which is closed with the HistoryFile
 
-    //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
-    char* _fileMap;
+    //true if the file is read through mmap'ed windows, see map()
+    bool _mapped;
+    //the mmap'ed windows, most recently used first.  Data is only ever
+    //appended to the file, so windows stay valid while the file grows
+    QList<MappedWindow> _windows;
 
     //incremented whenever 'add' is called and decremented whenever
     //'get' is called.
@@ -72,6 +104,29 @@ private:
 
     //when _readWriteBalance goes below this threshold, the file will be mmap'ed automatically
     static const int MAP_THRESHOLD = -1000;
+
+    //the block read ahead while the file is not mmap'ed, see readAhead().
+    //Data is only ever appended to the file, so the block stays valid
+    //until the file is truncated
+    QByteArray _readAheadBlock;
+    qint64 _readAheadOffset;
+    //the range of the last read and the number of reads in a row which
+    //were close to the previous one
+    qint64 _lastReadStart;
+    qint64 _lastReadEnd;
+    int _sequentialReads;
+
+    //the size of the blocks which are read ahead, the distance within
+    //which a read counts as following the previous one, and the number
+    //of such reads after which a block is read
+    static const int READ_AHEAD_SIZE = 256 * 1024;
+    static const int SEQUENTIAL_DISTANCE = 4096;
+    static const int SEQUENTIAL_READS = 4;
+
+    //the size of the windows in which the file is mmap'ed and the number
+    //of windows which are kept mapped at the same time
+    static const qint64 MAP_WINDOW_SIZE = 64 * 1024 * 1024;
+    static const int MAX_MAPPED_WINDOWS = 4;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -81,6 +136,37 @@ private:
 //////////////////////////////////////////////////////////////////////
 class HistoryType;
 
+/*
+   A range of lines read from a history by HistoryScroll::readLines().  The
+   cells of the lines are kept one after the other, so that reading many
+   lines takes few allocations.
+*/
+class HistoryLines
+{
+public:
+    HistoryLines() : firstLine(0) {}
+
+    // returns true if the range holds line 'lineno' of the history
+    bool contains(int lineno) const {
+        return lineno >= firstLine && lineno < firstLine + wrapped.count();
+    }
+    // the following take the number of a line in the history
+    const Character* cells(int lineno) const {
+        return cellData.constData() + offsets[lineno - firstLine];
+    }
+    int lineLength(int lineno) const {
+        return offsets[lineno - firstLine + 1] - offsets[lineno - firstLine];
+    }
+    bool isWrapped(int lineno) const {
+        return wrapped[lineno - firstLine];
+    }
+
+    int firstLine;
+    QVector<Character> cellData;
+    QVector<int> offsets;   // [lines + 1], where each line starts in cellData
+    QVector<bool> wrapped;  // [lines]
+};
+
 class HistoryScroll
 {
 public:
@@ -94,6 +180,12 @@ public:
     virtual int  getLineLen(int lineno) = 0;
     virtual void getCells(int lineno, int colno, int count, Character res[]) = 0;
     virtual bool isWrappedLine(int lineno) = 0;
+    // reads 'count' lines starting at 'lineno' into 'lines', which is
+    // faster than reading them one at a time
+    virtual void readLines(int lineno, int count, HistoryLines& lines);
+    // sets 'wrapped' to whether each of the 'count' lines starting at
+    // 'lineno' is wrapped, which is faster than asking line by line
+    virtual void readWrappedLines(int lineno, int count, bool wrapped[]);
 
     // adding lines.
     virtual void addCells(const Character a[], int count) = 0;
@@ -102,9 +194,35 @@ public:
     virtual void addCellsVector(const QVector<Character>& cells) {
         addCells(cells.data(), cells.size());
     }
+    // like addCellsVector(), but the history may take the storage of
+    // 'cells' rather than copying it.  'cells' is left with storage which
+    // can be reused for a new line, its contents are undefined
+    virtual void takeCellsVector(QVector<Character>& cells) {
+        addCellsVector(cells);
+    }
 
     virtual void addLine(bool previousWrapped = false) = 0;
 
+    // removes all lines, keeping the storage for new lines where possible
+    virtual void clear() = 0;
+
+    // returns the number of bytes of memory used to store the history
+    // the memory which the history keeps using once a conversion into
+    // another history has finished, see HistoryScrollConversion
+    virtual qint64 retainedMemoryUsage() const {
+        return memoryUsage();
+    }
+    virtual qint64 memoryUsage() const {
+        return 0;
+    }
+    // returns the number of bytes of the files the history is stored in
+    virtual qint64 fileSize() const {
+        return 0;
+    }
+    // gives back memory which the history holds but no longer needs,
+    // this is called while the terminal is idle
+    virtual void compact() {}
+
     //
     // FIXME:  Passing around constant references to HistoryType instances
     // is very unsafe, because those references will no longer
@@ -125,23 +243,101 @@ protected:
 class HistoryScrollFile : public HistoryScroll
 {
 public:
+    // if 'logFileName' is given, the history is kept in files named after
+    // it, which survive the history and are reattached to when it is created
+    // again with the same name.  Otherwise temporary files are used.
     explicit HistoryScrollFile(const QString& logFileName);
     virtual ~HistoryScrollFile();
 
+    // removes the files of the history kept under 'logFileName'
+    static void removeFiles(const QString& logFileName);
+
     virtual int  getLines();
     virtual int  getLineLen(int lineno);
     virtual void getCells(int lineno, int colno, int count, Character res[]);
     virtual bool isWrappedLine(int lineno);
+    virtual void readLines(int lineno, int count, HistoryLines& lines);
+    virtual void readWrappedLines(int lineno, int count, bool wrapped[]);
 
     virtual void addCells(const Character a[], int count);
     virtual void addLine(bool previousWrapped = false);
+    virtual void clear();
 
-private:
-    int startOfLine(int lineno);
+    // the cached lines and the starts of the blocks are kept in memory
+    virtual qint64 memoryUsage() const;
+    virtual qint64 fileSize() const;
+    virtual void compact();
 
-    HistoryFile _index; // lines Row(int)
+private:
+    qint64 startOfLine(int lineno);
+    // reads the lengths of the lines in the files, builds the index of
+    // their blocks and drops the lines which were only partly written to
+    // the files when the history was last used, e.g. because Konsole crashed
+    void recoverLines();
+
+    // reads the RGB colors of the persistent files into _fileRgbColors
+    void readColors();
+    // looks the colors of the files up in the table of RGB colors
+    void updateColorIndexes();
+    // returns the color which stands for the RGB color 'color' in the files,
+    // adding it to the colors of the files if necessary
+    CharacterColor fileColor(const CharacterColor& color, int defaultColor);
+    // reads the sequences of extended characters of the persistent files
+    // into _fileSequences
+    void readSequences();
+    // replaces the extended character of 'cell' by its index in the files,
+    // adding it to the sequences of the files if necessary
+    void fileSequence(Character& cell);
+    void updateSequenceHashes();
+    // looks the colors and the sequences of the files up again once the
+    // table of RGB colors or ExtendedCharTable::instance has removed
+    // entries since they were last looked up
+    void checkFileTables();
+    // reads 'count' cells at 'loc' of _cells, with the RGB colors and the
+    // extended characters of the files replaced by those of this process
+    void readCells(Character cells[], int count, qint64 loc);
+
+    // the cells of the lines which were read recently, lines stay at
+    // the same number until the history is cleared
+    QCache<int, QVector<Character> > _lineCache;
+
+    // the number of cells kept in _lineCache, longer lines are not kept
+    static const int LINE_CACHE_CELLS = 256 * 1024;
+    static const int MAX_CACHED_LINE_LENGTH = 4096;
+
+    // the position of a line is found from the start of its block of
+    // LINES_PER_BLOCK lines and the lengths of the lines before it in
+    // the block, which keeps the index at 4 bytes per line
+    static const int LINES_PER_BLOCK = 256;
+
+    HistoryFile _index; // lengths Row(quint32), in cells
     HistoryFile _cells; // text  Row(Character)
     HistoryFile _lineflags; // flags Row(unsigned char)
+    HistoryFile _colors; // RGB colors of persistent files Row(QRgb)
+    HistoryFile _chars; // extended characters of persistent files Row(ushort length, ushort[length])
+
+    // the RGB colors of a process are indexes into a table of the process,
+    // see rgbColorIndex().  Persistent files, which outlast the process,
+    // use indexes into _colors instead.  These are the colors of this
+    // process for the indexes of the files, and the other way round, which
+    // stay valid as long as the generation of the table does
+    bool _persistent;
+    QVector<QRgb> _fileRgbColors;
+    QVector<CharacterColor> _fileColors;
+    QHash<int, int> _fileColorIndexes;
+    quint64 _fileColorsGeneration;
+
+    // the same goes for the extended characters, which are hashes into
+    // ExtendedCharTable::instance.  These are the sequences of the files,
+    // their hashes in the table and the other way round, which stay valid
+    // as long as the generation of the table does
+    QVector< QVector<ushort> > _fileSequences;
+    QVector<ushort> _fileSequenceHashes;
+    QHash<ushort, int> _fileSequenceIndexes;
+    quint64 _fileSequencesGeneration;
+
+    QVector<qint64> _blockStarts; // the position in _cells of each block
+    qint64 _linesEnd;             // the end of the last line in _cells
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -162,12 +358,15 @@ public:
 
     virtual void addCells(const Character a[], int count);
     virtual void addLine(bool previousWrapped = false);
+    virtual void clear();
 };
 
 //////////////////////////////////////////////////////////////////////
 // History using compact storage
-// This implementation uses a list of fixed-sized blocks
-// where history lines are allocated in (avoids heap fragmentation)
+// This implementation keeps the lines in a ring of line records, the
+// text and formats of the lines being stored in a circular arena.
+// Once the history is full, adding a line reuses the space of the
+// line it replaces instead of allocating memory
 //////////////////////////////////////////////////////////////////////
 typedef QVector<Character> TextLine;
 
@@ -187,109 +386,249 @@ public:
         fgColor = c.foregroundColor;
         bgColor = c.backgroundColor;
         isRealCharacter = c.isRealCharacter;
+        plane = c.plane;
     }
 
     CharacterColor fgColor, bgColor;
     quint16 startPos;
     quint8 rendition;
-    bool isRealCharacter;
+    // the plane of the characters is kept in the same byte, a run of
+    // characters never spans more than one plane
+    quint8 isRealCharacter : 1;
+    quint8 plane : 5;
 };
 
-class CompactHistoryBlock
+class CompactHistoryScroll : public HistoryScroll
 {
 public:
-    CompactHistoryBlock() {
-        _blockLength = 4096 * 64; // 256kb
-        _head = (quint8*) mmap(0, _blockLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
-        //_head = (quint8*) malloc(_blockLength);
-        Q_ASSERT(_head != MAP_FAILED);
-        _tail = _blockStart = _head;
-        _allocCount = 0;
-    }
+    explicit CompactHistoryScroll(unsigned int maxNbLines = 1000);
+    virtual ~CompactHistoryScroll();
 
-    virtual ~CompactHistoryBlock() {
-        //free(_blockStart);
-        munmap(_blockStart, _blockLength);
-    }
+    virtual int  getLines();
+    virtual int  getLineLen(int lineno);
+    virtual void getCells(int lineno, int colno, int count, Character res[]);
+    virtual bool isWrappedLine(int lineno);
 
-    virtual unsigned int remaining() {
-        return _blockStart + _blockLength - _tail;
-    }
-    virtual unsigned  length() {
-        return _blockLength;
-    }
-    virtual void* allocate(size_t length);
-    virtual bool contains(void* addr) {
-        return addr >= _blockStart && addr < (_blockStart + _blockLength);
-    }
-    virtual void deallocate();
-    virtual bool isInUse() {
-        return _allocCount != 0;
-    };
+    virtual void addCells(const Character a[], int count);
+    virtual void addCellsVector(const TextLine& cells);
+    virtual void addLine(bool previousWrapped = false);
+    virtual void clear();
+
+    virtual qint64 memoryUsage() const;
+    virtual void compact();
+
+    void setMaxNbLines(unsigned int nbLines);
 
 private:
-    size_t _blockLength;
-    quint8* _head;
-    quint8* _tail;
-    quint8* _blockStart;
-    int _allocCount;
+    // A line of the history.  Its formats, followed by its text, are
+    // stored in the arena at 'start'
+    struct LineRecord {
+        int start;
+        quint16 length;
+        quint16 formatCount;
+        bool wrapped;
+    };
+
+    // number of arena units which a CharacterFormat takes
+    enum { FORMAT_SIZE = sizeof(CharacterFormat) / sizeof(quint16) };
+
+    LineRecord& record(int lineNumber);
+    const CharacterFormat* lineFormats(const LineRecord& line) const;
+    const quint16* lineText(const LineRecord& line) const;
+    static int recordSize(const LineRecord& line);
+
+    void appendLine(const Character* cells, int count);
+    void removeFirstLine();
+    // returns the start of 'size' free units in the arena, which is
+    // grown if they can not be found
+    int allocate(int size);
+    void relocateRecords(int capacity);
+    void relocateArena(int capacity);
+
+    // ring of line records, starting at _firstRecord
+    QVector<LineRecord> _records;
+    int _firstRecord;
+    int _lineCount;
+
+    // circular storage of the lines, the data of the lines in the history
+    // lies between the start of the oldest line and _arenaHead
+    QVector<quint16> _arena;
+    int _arenaHead;
+    int _arenaUsed;
+
+    unsigned int _maxLineCount;
 };
 
-class CompactHistoryBlockList
+//////////////////////////////////////////////////////////////////////
+// Compressed file-based history (no limitation in length)
+//////////////////////////////////////////////////////////////////////
+
+/*
+   Lines are collected in blocks, each line being stored as its text and the
+   runs of characters which share the same format (see CharacterFormat).
+   Once a block is full it is compressed and appended to a temporary file.
+   An index of the compressed blocks is used to find the block containing a
+   line, a few recently used blocks are kept decompressed.
+*/
+class CompressedHistoryScroll : public HistoryScroll
 {
 public:
-    CompactHistoryBlockList() {}
-    ~CompactHistoryBlockList();
+    // keeps up to 'maxNbLines' lines, or all lines if it is negative
+    explicit CompressedHistoryScroll(int maxNbLines = -1);
+    virtual ~CompressedHistoryScroll();
+
+    virtual int  getLines();
+    virtual int  getLineLen(int lineno);
+    virtual void getCells(int lineno, int colno, int count, Character res[]);
+    virtual bool isWrappedLine(int lineno);
+
+    virtual void addCells(const Character a[], int count);
+    virtual void addCellsVector(const TextLine& cells);
+    virtual void takeCellsVector(TextLine& cells);
+    virtual void addLine(bool previousWrapped = false);
+    virtual void clear();
+
+    virtual qint64 memoryUsage() const;
+    virtual qint64 fileSize() const;
+    virtual void compact();
+
+    void setMaxNbLines(int nbLines);
+
+private:
+    // a block of lines, which are stored one after another in 'data'
+    struct Block {
+        int firstLine;
+        QVector<int> lineOffsets;  // position of each line in 'data'
+        QByteArray data;
+    };
+
+    // the position of a compressed block in the file
+    struct BlockPosition {
+        int firstLine;
+        qint64 offset;
+        int size;
+    };
+
+    // each line starts with its length, the number of formats and whether
+    // it is wrapped, followed by the formats and then the text
+    enum { LINE_LENGTH, LINE_FORMAT_COUNT, LINE_WRAPPED_FLAG, LINE_HEADER_SIZE };
+
+    // returns the serialized line 'lineno' and reads its header
+    const char* lineData(int lineno, qint32 header[LINE_HEADER_SIZE]);
+    // returns the block which contains line 'lineno', decompressing it if
+    // it is not in the cache
+    const Block& findBlock(int lineno);
+    // compresses the current block and appends it to the file
+    void flushBlock();
+    // discards the oldest lines which do not fit into the history
+    void discardLines();
+    // gives back the space of the discarded blocks in the file once they
+    // take more of it than the blocks which are left
+    void compactFile();
+
+    HistoryFile _file;
+    QVector<BlockPosition> _blockPositions;
+    Block _currentBlock;      // the block which new lines are added to
+    QList<Block> _cache;      // decompressed blocks, most recently used first
+    TextLine _pendingLine;    // the cells passed to addCells() for the next line
+
+    // the lines before _firstLine have been discarded.  Blocks are only
+    // forgotten once all of their lines are discarded, see compactFile()
+    // for the space they take in the file
+    int _firstLine;
+    int _maxLineCount;
+
+    // once a block holds this many bytes it is compressed
+    static const int BLOCK_SIZE = 64 * 1024;
+    // the file is not compacted before the discarded blocks take this much
+    static const int MIN_DISCARDED_FILE_SIZE = 4 * 1024 * 1024;
+    static const int MAX_CACHED_BLOCKS = 2;
+    // zlib compression level, favouring speed over size
+    static const int COMPRESSION_LEVEL = 1;
+};
+
+//////////////////////////////////////////////////////////////////////
+// History sharing identical lines between sessions
+//////////////////////////////////////////////////////////////////////
 
-    void* allocate(size_t size);
-    void deallocate(void *);
-    int length() {
-        return list.size();
+/*
+   A store which keeps a single copy of each distinct history line, however
+   many histories contain it.  Lines are reference counted and removed from
+   the store once the last history holding them releases them.
+*/
+class HistoryLinePool
+{
+public:
+    // returns the stored copy of the line made of 'count' cells, adding it
+    // to the pool if it is not there yet
+    QByteArray acquire(const Character cells[], int count);
+    // releases a line returned by acquire()
+    void release(const QByteArray& line);
+    // returns the number of histories holding 'line'
+    int referenceCount(const QByteArray& line) const;
+
+    // returns the number of distinct lines in the pool
+    int lineCount() const {
+        return _lines.count();
     }
+
+    /** The global HistoryLinePool instance. */
+    static HistoryLinePool instance;
+
 private:
-    QList<CompactHistoryBlock*> list;
+    QHash<QByteArray, int> _lines;  // the lines and their reference counts
 };
 
-class CompactHistoryLine
+class SharedHistoryScroll : public HistoryScroll
 {
 public:
-    CompactHistoryLine(const TextLine&, CompactHistoryBlockList& blockList);
-    virtual ~CompactHistoryLine();
+    explicit SharedHistoryScroll(unsigned int maxNbLines = 1000);
+    virtual ~SharedHistoryScroll();
 
-    // custom new operator to allocate memory from custom pool instead of heap
-    static void* operator new(size_t size, CompactHistoryBlockList& blockList);
-    static void operator delete(void *) {
-        /* do nothing, deallocation from pool is done in destructor*/
-    };
+    virtual int  getLines();
+    virtual int  getLineLen(int lineno);
+    virtual void getCells(int lineno, int colno, int count, Character res[]);
+    virtual bool isWrappedLine(int lineno);
 
-    virtual void getCharacters(Character* array, int length, int startColumn);
-    virtual void getCharacter(int index, Character& r);
-    virtual bool isWrapped() const {
-        return _wrapped;
-    };
-    virtual void setWrapped(bool value) {
-        _wrapped = value;
-    };
-    virtual unsigned int getLength() const {
-        return _length;
+    virtual void addCells(const Character a[], int count);
+    virtual void addLine(bool previousWrapped = false);
+    virtual void clear();
+
+    // the lines held by several histories count only for their share
+    virtual qint64 memoryUsage() const;
+
+    void setMaxNbLines(unsigned int nbLines);
+
+private:
+    struct Line {
+        QByteArray cells;  // the Character array, shared through HistoryLinePool
+        bool wrapped;
     };
 
-protected:
-    CompactHistoryBlockList& _blockListRef;
-    CharacterFormat* _formatArray;
-    quint16 _length;
-    quint16* _text;
-    quint16 _formatLength;
-    bool _wrapped;
+    void removeFirstLine();
+
+    QList<Line> _lines;
+    unsigned int _maxLineCount;
 };
 
-class CompactHistoryScroll : public HistoryScroll
-{
-    typedef QList<CompactHistoryLine*> HistoryArray;
+//////////////////////////////////////////////////////////////////////
+// History being converted to another type of history
+//////////////////////////////////////////////////////////////////////
+
+/*
+   Copies the lines of a history into a history of another type a batch at
+   a time, each call to convert() copying some more of them.  Until all
+   lines are copied they are read from the previous history, and the lines
+   added in the meantime are kept aside to be copied after them.
 
+   The type of the history is already the one of the new history.
+*/
+class HistoryScrollConversion : public HistoryScroll
+{
 public:
-    explicit CompactHistoryScroll(unsigned int maxNbLines = 1000);
-    virtual ~CompactHistoryScroll();
+    // takes ownership of 'source' and of 'target', which must be empty
+    HistoryScrollConversion(HistoryScroll* source, HistoryScroll* target);
+    virtual ~HistoryScrollConversion();
 
     virtual int  getLines();
     virtual int  getLineLen(int lineno);
@@ -298,16 +637,81 @@ public:
 
     virtual void addCells(const Character a[], int count);
     virtual void addCellsVector(const TextLine& cells);
+    virtual void takeCellsVector(TextLine& cells);
     virtual void addLine(bool previousWrapped = false);
+    virtual void clear();
 
-    void setMaxNbLines(unsigned int nbLines);
+    // the source is released once the conversion has finished
+    virtual qint64 retainedMemoryUsage() const;
+    virtual qint64 memoryUsage() const;
+    virtual qint64 fileSize() const;
+
+    // copies up to 'count' lines into the new history, returns true once
+    // all lines have been copied
+    bool convert(int count);
+    // returns the new history and gives up its ownership, this is only
+    // valid once convert() has returned true
+    HistoryScroll* takeTarget();
 
 private:
-    bool hasDifferentColors(const TextLine& line) const;
-    HistoryArray _lines;
-    CompactHistoryBlockList _blockList;
+    struct PendingLine {
+        TextLine cells;
+        bool wrapped;
+    };
 
-    unsigned int _maxLineCount;
+    HistoryScroll* _source;
+    HistoryScroll* _target;
+    int _copiedLines;
+    QList<PendingLine> _pendingLines;  // the lines added since the conversion started
+    TextLine _buffer;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Index for searching the history
+//////////////////////////////////////////////////////////////////////
+
+/*
+   An index of the latest lines of a history, which tells the lines which
+   may contain a piece of text apart from those which cannot, without
+   reading or decoding the lines again.
+
+   Each line has a signature with a bit set for every sequence of three
+   characters in its case folded text.  The text of a wrapped line is
+   continued by the next line, so the signature of the last line of a
+   wrapped line also covers the lines before it.
+*/
+class HistorySearchIndex
+{
+public:
+    HistorySearchIndex();
+
+    // adds the line with text 'text' after the other lines, 'wrapped' is
+    // true if the line continues on the next one
+    void addLine(const QString& text, bool wrapped);
+    // removes the oldest lines until at most 'count' lines are left
+    void keepLines(int count);
+    void clear();
+    int lineCount() const;
+
+    // narrows the lines from 'startLine' to 'endLine' down to the first and
+    // last of them which may contain 'text'.  the lines are numbered as in
+    // a history of 'historyLines' lines whose latest lines are those of the
+    // index, lines after the end of the history are always kept.  returns
+    // false if none of the lines can contain the text
+    bool findCandidateLines(const QString& text, int historyLines,
+                            int& startLine, int& endLine) const;
+
+private:
+    struct Signature {
+        quint64 bits[2];
+    };
+
+    static void addTrigrams(Signature& signature, const QString& text);
+    bool isWrapped(int index) const;
+
+    QVector<Signature> _signatures;
+    int _first;  // the signatures before this one belong to removed lines
+    QString _wrappedText;  // the end of the last line, if it is wrapped
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -363,10 +767,31 @@ public:
 
     virtual HistoryScroll* scroll(HistoryScroll *) const;
 
+    // the name of the files the history is kept in, or an empty string if
+    // it is kept in temporary files
+    const QString& fileName() const {
+        return _fileName;
+    }
+
 protected:
     QString _fileName;
 };
 
+class CompressedHistoryType : public HistoryType
+{
+public:
+    // the history keeps up to 'size' lines, or all lines if it is negative
+    explicit CompressedHistoryType(int size = -1);
+
+    virtual bool isEnabled() const;
+    virtual int maximumLineCount() const;
+
+    virtual HistoryScroll* scroll(HistoryScroll *) const;
+
+protected:
+    int _maxLines;
+};
+
 class CompactHistoryType : public HistoryType
 {
 public:
@@ -377,6 +802,20 @@ public:
 
     virtual HistoryScroll* scroll(HistoryScroll *) const;
 
+protected:
+    unsigned int _maxLines;
+};
+
+class SharedHistoryType : public HistoryType
+{
+public:
+    explicit SharedHistoryType(unsigned int size);
+
+    virtual bool isEnabled() const;
+    virtual int maximumLineCount() const;
+
+    virtual HistoryScroll* scroll(HistoryScroll *) const;
+
 protected:
     unsigned int _maxLines;
 };
@@ -40,9 +40,11 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     : QWidget(aParent)
     , _foundMatch(false)
     , _searchEdit(0)
+    , _matchCountLabel(0)
     , _caseSensitive(0)
     , _regExpression(0)
     , _highlightMatches(0)
+    , _findAll(0)
 {
     QHBoxLayout* barLayout = new QHBoxLayout(this);
 
@@ -75,6 +77,10 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     connect(_searchEdit , SIGNAL(clearButtonClicked()) , this , SLOT(clearLineEdit()));
     connect(_searchEdit , SIGNAL(textChanged(QString)) , _searchTimer , SLOT(start()));
 
+    _matchCountLabel = new QLabel(this);
+    _matchCountLabel->setObjectName(QLatin1String("match-count-label"));
+    _matchCountLabel->hide();
+
     QToolButton* findNext = new QToolButton(this);
     findNext->setObjectName(QLatin1String("find-next-button"));
     findNext->setText(i18nc("@action:button Go to the next phrase", "Next"));
@@ -103,6 +109,7 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     barLayout->addWidget(closeButton);
     barLayout->addWidget(findLabel);
     barLayout->addWidget(_searchEdit);
+    barLayout->addWidget(_matchCountLabel);
     barLayout->addWidget(findNext);
     barLayout->addWidget(findPrev);
     barLayout->addWidget(optionsButton);
@@ -129,6 +136,12 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     connect(_highlightMatches, SIGNAL(toggled(bool)),
             this, SIGNAL(highlightMatchesToggled(bool)));
 
+    _findAll = optionsMenu->addAction(i18nc("@item:inmenu", "Find all matches"));
+    _findAll->setCheckable(true);
+    _findAll->setToolTip(i18nc("@info:tooltip", "Sets whether all matches are found at once and counted"));
+    connect(_findAll, SIGNAL(toggled(bool)),
+            this, SIGNAL(findAllToggled(bool)));
+
     barLayout->addStretch();
 
     barLayout->setContentsMargins(4, 4, 4, 4);
@@ -208,6 +221,17 @@ void IncrementalSearchBar::setFoundMatch(bool match)
     }
 }
 
+void IncrementalSearchBar::setMatchCount(int current, int count)
+{
+    if (count < 0) {
+        _matchCountLabel->hide();
+    } else {
+        _matchCountLabel->setText(i18nc("@info:status index of the selected match and number of matches",
+                                        "%1 of %2", count > 0 ? current + 1 : 0, count));
+        _matchCountLabel->show();
+    }
+}
+
 void IncrementalSearchBar::clearLineEdit()
 {
     _searchEdit->setStyleSheet(QString());
@@ -215,11 +239,12 @@ void IncrementalSearchBar::clearLineEdit()
 
 const QBitArray IncrementalSearchBar::optionsChecked()
 {
-    QBitArray options(3, 0);
+    QBitArray options(4, 0);
 
     if (_caseSensitive->isChecked()) options.setBit(MatchCase);
     if (_regExpression->isChecked()) options.setBit(RegExp);
     if (_highlightMatches->isChecked()) options.setBit(HighlightMatches);
+    if (_findAll->isChecked()) options.setBit(FindAll);
 
     return options;
 }
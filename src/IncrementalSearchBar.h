@@ -51,6 +51,10 @@ namespace Konsole
  * The second indicates whether the search text should be treated as a plain string or
  * as a regular expression.
  * The matchRegExpToggled() signal is emitted when this is changed.
+ * The third indicates whether all matches in the document are found at once,
+ * after which the next and previous buttons step through them.  The number
+ * of matches is shown with setMatchCount().
+ * The findAllToggled() signal is emitted when this is changed.
  */
 class IncrementalSearchBar : public QWidget
 {
@@ -66,7 +70,9 @@ public:
         /** Searches are case-sensitive or not */
         MatchCase        = 1,
         /** Searches use regular expressions */
-        RegExp           = 2
+        RegExp           = 2,
+        /** Searches find all matches at once */
+        FindAll          = 3
     };
 
     /**
@@ -90,6 +96,16 @@ public:
      */
     void setFoundMatch(bool match);
 
+    /**
+     * Shows which of the matches for the current search text is selected,
+     * when all of them have been found at once.
+     *
+     * @param current The index of the selected match, starting from 0
+     * @param count The number of matches.  If this is negative, the matches
+     * have not been counted and the indicator is hidden.
+     */
+    void setMatchCount(int current, int count);
+
     /** Returns the current search text */
     QString searchText();
 
@@ -119,6 +135,11 @@ signals:
      * the search text should be treated as a plain string or a regular expression
      */
     void matchRegExpToggled(bool);
+    /**
+     * Emitted when the user toggles the checkbox to indicate whether
+     * all matches for the search text should be found at once
+     */
+    void findAllToggled(bool);
     /** Emitted when the close button is clicked */
     void closeClicked();
     /** Emitted when the return button is pressed in the search box */
@@ -139,9 +160,11 @@ private:
     bool _foundMatch;
 
     KLineEdit* _searchEdit;
+    QLabel* _matchCountLabel;
     QAction* _caseSensitive;
     QAction* _regExpression;
     QAction* _highlightMatches;
+    QAction* _findAll;
 
     QTimer* _searchTimer;
 };
@@ -426,20 +426,26 @@ bool KeyboardTranslator::Entry::matches(int testKeyCode,
     if (_keyCode != testKeyCode)
         return false;
 
-    if ((testKeyboardModifiers & _modifierMask) != (_modifiers & _modifierMask))
-        return false;
-
     // if testKeyboardModifiers is non-zero, the 'any modifier' state is implicit
     if (testKeyboardModifiers != 0)
         testState |= AnyModifierState;
 
+    // special handling for the 'Any Modifier' state, which checks for the presence of
+    // any or no modifiers.  In this context, the 'keypad' modifier does not count.
+    const bool anyModifiersSet = (testKeyboardModifiers != 0)
+                                 && (testKeyboardModifiers != Qt::KeypadModifier);
+
+    return matchesCondition(testKeyboardModifiers, testState, anyModifiersSet);
+}
+bool KeyboardTranslator::Entry::matchesCondition(Qt::KeyboardModifiers testKeyboardModifiers,
+        States testState, bool anyModifiersSet) const
+{
+    if ((testKeyboardModifiers & _modifierMask) != (_modifiers & _modifierMask))
+        return false;
+
     if ((testState & _stateMask) != (_state & _stateMask))
         return false;
 
-    // special handling for the 'Any Modifier' state, which checks for the presence of
-    // any or no modifiers.  In this context, the 'keypad' modifier does not count.
-    bool anyModifiersSet = (testKeyboardModifiers != 0)
-                           && (testKeyboardModifiers != Qt::KeypadModifier);
     bool wantAnyModifier = _state & KeyboardTranslator::AnyModifierState;
     if (_stateMask & KeyboardTranslator::AnyModifierState) {
         if (wantAnyModifier != anyModifiersSet)
@@ -662,27 +668,126 @@ void KeyboardTranslator::addEntry(const Entry& entry)
 {
     const int keyCode = entry.keyCode();
     _entries.insert(keyCode, entry);
+    compileKey(keyCode);
 }
 
 void KeyboardTranslator::replaceEntry(const Entry& existing , const Entry& replacement)
 {
-    if (!existing.isNull())
+    if (!existing.isNull()) {
         _entries.remove(existing.keyCode(), existing);
+        compileKey(existing.keyCode());
+    }
 
     _entries.insert(replacement.keyCode(), replacement);
+    compileKey(replacement.keyCode());
 }
 
 void KeyboardTranslator::removeEntry(const Entry& entry)
 {
     _entries.remove(entry.keyCode(), entry);
+    compileKey(entry.keyCode());
 }
 
-KeyboardTranslator::Entry KeyboardTranslator::findEntry(int keyCode, Qt::KeyboardModifiers modifiers, States state) const
+// returns the bits of 'value' selected by 'mask', moved next to each
+// other in the low bits of the result
+static int gatherBits(int value, int mask)
+{
+    int result = 0;
+    int bit = 1;
+    for (; mask != 0; mask &= mask - 1) {
+        if (value & mask & -mask)
+            result |= bit;
+        bit <<= 1;
+    }
+    return result;
+}
+
+// the reverse of gatherBits()
+static int scatterBits(int bits, int mask)
+{
+    int result = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        if (bits & 1)
+            result |= mask & -mask;
+        bits >>= 1;
+    }
+    return result;
+}
+
+static int countBits(int mask)
+{
+    int count = 0;
+    for (; mask != 0; mask &= mask - 1)
+        count++;
+    return count;
+}
+
+void KeyboardTranslator::compileKey(int keyCode)
 {
-    foreach(const Entry & entry, _entries.values(keyCode)) {
-        if (entry.matches(keyCode, modifiers, state))
-            return entry;
+    // the entries are tested in the order in which findEntry() used to
+    // test them before the tables were introduced, the most recently
+    // added entry first
+    const QList<Entry> entries = _entries.values(keyCode);
+    if (entries.isEmpty()) {
+        _tables.remove(keyCode);
+        return;
+    }
+
+    KeyTable table;
+    table.modifierMask = 0;
+    table.stateMask = 0;
+    foreach(const Entry& entry, entries) {
+        table.modifierMask |= entry.modifierMask();
+        table.stateMask |= entry.stateMask();
+    }
+    table.modifierBits = countBits(table.modifierMask);
+    table.stateBits = countBits(table.stateMask);
+    table.testsAnyModifier = table.stateMask & AnyModifierState;
+    table.entries = entries.toVector();
+
+    const int slotCount = 1 << (table.modifierBits + table.stateBits +
+                                (table.testsAnyModifier ? 1 : 0));
+    table.entryIndex.fill(-1, slotCount);
+
+    for (int slot = 0; slot < slotCount; slot++) {
+        const Qt::KeyboardModifiers modifiers(QFlag(scatterBits(slot, table.modifierMask)));
+        const States state(QFlag(scatterBits(slot >> table.modifierBits, table.stateMask)));
+        const bool anyModifiersSet = slot >> (table.modifierBits + table.stateBits);
+
+        for (int i = 0; i < table.entries.count(); i++) {
+            if (table.entries[i].matchesCondition(modifiers, state, anyModifiersSet)) {
+                table.entryIndex[slot] = i;
+                break;
+            }
+        }
     }
 
-    return Entry(); // No matching entry
+    _tables.insert(keyCode, table);
+}
+
+int KeyboardTranslator::slotIndex(const KeyTable& table, Qt::KeyboardModifiers modifiers,
+                                  States state, bool anyModifiersSet)
+{
+    int slot = gatherBits(modifiers, table.modifierMask);
+    slot |= gatherBits(state, table.stateMask) << table.modifierBits;
+    if (table.testsAnyModifier && anyModifiersSet)
+        slot |= 1 << (table.modifierBits + table.stateBits);
+    return slot;
+}
+
+KeyboardTranslator::Entry KeyboardTranslator::findEntry(int keyCode, Qt::KeyboardModifiers modifiers, States state) const
+{
+    QHash<int, KeyTable>::const_iterator iter = _tables.constFind(keyCode);
+    if (iter == _tables.constEnd())
+        return Entry(); // No matching entry
+
+    // see Entry::matches()
+    if (modifiers != 0)
+        state |= AnyModifierState;
+    const bool anyModifiersSet = (modifiers != 0) && (modifiers != Qt::KeypadModifier);
+
+    const KeyTable& table = iter.value();
+    const int index = table.entryIndex[slotIndex(table, modifiers, state, anyModifiersSet)];
+
+    return index >= 0 ? table.entries[index] : Entry();
 }
@@ -27,6 +27,7 @@
 #include <QtCore/QList>
 //#include <QtGui/QKeySequence>
 #include <QtCore/QMetaType>
+#include <QtCore/QVector>
 
 // Konsole
 #include "konsole_export.h"
@@ -49,7 +50,7 @@ namespace Konsole
  * (Shift,Ctrl,Alt,Meta etc.) and state flags which indicate the state
  * which the terminal must be in for the key sequence to apply.
  */
-class KeyboardTranslator
+class KONSOLEPRIVATE_EXPORT KeyboardTranslator
 {
 public:
     /**
@@ -241,6 +242,13 @@ public:
         bool operator==(const Entry& rhs) const;
 
     private:
+        friend class KeyboardTranslator;
+
+        // the part of matches() after the key code has been compared.
+        // @p testState includes the implicit 'any modifier' state
+        bool matchesCondition(Qt::KeyboardModifiers testKeyboardModifiers,
+                              States testState, bool anyModifiersSet) const;
+
         void insertModifier(QString& item , int modifier) const;
         void insertState(QString& item , int state) const;
         QByteArray unescape(const QByteArray& text) const;
@@ -308,8 +316,34 @@ public:
     QList<Entry> entries() const;
 
 private:
+    // The entries for one key code, compiled into a table which has a slot
+    // for every combination of the modifiers and states which the entries
+    // test, so that findEntry() only has to look up one slot.
+    struct KeyTable {
+        int modifierMask;
+        int stateMask;
+        // the number of bits in modifierMask and stateMask
+        int modifierBits;
+        int stateBits;
+        // whether any of the entries tests for the 'any modifier' state,
+        // which also depends on modifiers outside of modifierMask
+        bool testsAnyModifier;
+
+        QVector<Entry> entries;
+        // for each slot, the index of the matching entry or -1
+        QVector<qint16> entryIndex;
+    };
+
+    // rebuilds the table for @p keyCode from its entries
+    void compileKey(int keyCode);
+    // returns the slot of @p table which applies to the given modifiers and state
+    static int slotIndex(const KeyTable& table, Qt::KeyboardModifiers modifiers,
+                         States state, bool anyModifiersSet);
+
     // All entries in this translator, indexed by their keycode
     QMultiHash<int, Entry> _entries;
+    // The compiled tables of the entries, indexed by their keycode
+    QHash<int, KeyTable> _tables;
 
     QString _name;
     QString _description;
@@ -351,7 +385,7 @@ public:
  *  }
  * @endcode
  */
-class KeyboardTranslatorReader
+class KONSOLEPRIVATE_EXPORT KeyboardTranslatorReader
 {
 public:
     /** Constructs a new reader which parses the given @p source */
@@ -0,0 +1,88 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "LineCache.h"
+
+// Qt
+#include <QtCore/QHash>
+
+// KDE
+#include <KGlobal>
+
+using Konsole::LineCache;
+
+typedef QHash<QByteArray, LineCache*> LineCacheHash;
+K_GLOBAL_STATIC(LineCacheHash, caches)
+
+// the maximum number of pixels kept in each cache
+static const int LINE_CACHE_SIZE = 2 * 1024 * 1024;
+
+LineCache::LineCache(const QByteArray& key)
+    : _key(key)
+    , _refCount(0)
+    , _extendedCharsGeneration(ExtendedCharTable::instance.generation())
+    , _rgbColorsGeneration(rgbColorGeneration())
+    , _lines(LINE_CACHE_SIZE)
+{
+}
+
+LineCache* LineCache::acquire(const FontResource* font, const ColorPalette* palette, int flags)
+{
+    // the fonts and palettes are shared as well, so they are identified
+    // by their address
+    QByteArray key;
+    key.append(reinterpret_cast<const char*>(&font), sizeof(font));
+    key.append(reinterpret_cast<const char*>(&palette), sizeof(palette));
+    key.append(reinterpret_cast<const char*>(&flags), sizeof(flags));
+
+    LineCache* cache = caches->value(key);
+    if (!cache) {
+        cache = new LineCache(key);
+        caches->insert(key, cache);
+    }
+
+    cache->_refCount++;
+    return cache;
+}
+
+void LineCache::release(LineCache* cache)
+{
+    if (!cache || --cache->_refCount > 0)
+        return;
+
+    if (!caches.isDestroyed())
+        caches->remove(cache->_key);
+    delete cache;
+}
+
+bool LineCache::insert(const QByteArray& cells, QPixmap* pixmap)
+{
+    if (_extendedCharsGeneration != ExtendedCharTable::instance.generation() ||
+            _rgbColorsGeneration != rgbColorGeneration())
+        clearLines();
+    return _lines.insert(cells, pixmap, pixmap->width() * pixmap->height());
+}
+
+void LineCache::clearLines()
+{
+    _lines.clear();
+    _extendedCharsGeneration = ExtendedCharTable::instance.generation();
+    _rgbColorsGeneration = rgbColorGeneration();
+}
@@ -0,0 +1,107 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef LINECACHE_H
+#define LINECACHE_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtGui/QPixmap>
+
+// Konsole
+#include "CharacterColor.h"
+#include "ExtendedCharTable.h"
+
+namespace Konsole
+{
+class ColorPalette;
+class FontResource;
+
+/**
+ * The rendered lines of the terminal displays, keyed by the cells of the
+ * line, shared by all the displays which draw lines the same way.  When a
+ * session is shown in several views, each line is only rendered by the
+ * first view which draws it.
+ *
+ * Use acquire() to get the cache for a font, a palette and a combination
+ * of rendering flags, and release() once it is no longer needed.  A
+ * display whose settings change acquires the cache for the new settings
+ * instead.  Caches must only be used from the GUI thread.
+ *
+ * The cells of extended characters hold the hashes of their sequences and
+ * those of RGB colors the indexes of their colors, so the lines are cleared
+ * once the ExtendedCharTable removes sequences or the table of RGB colors
+ * frees colors, see rgbColorGeneration().
+ */
+class LineCache
+{
+public:
+    /** Flags which change how lines are rendered */
+    enum RenderFlag {
+        BoldIntense = 1,
+        Bidi = 2,
+        Antialias = 4
+    };
+
+    /**
+     * Returns the cache of the lines rendered with @p font, @p palette and
+     * @p flags, a combination of RenderFlag values, creating it if no
+     * display uses it yet.  Each call must be matched by a call to
+     * release().
+     */
+    static LineCache* acquire(const FontResource* font, const ColorPalette* palette, int flags);
+    /** Releases a cache returned by acquire() */
+    static void release(LineCache* cache);
+
+    /** Returns the rendered line whose cells are @p cells, or 0 */
+    QPixmap* object(const QByteArray& cells) {
+        if (_extendedCharsGeneration != ExtendedCharTable::instance.generation() ||
+                _rgbColorsGeneration != rgbColorGeneration())
+            clearLines();
+        return _lines.object(cells);
+    }
+    /**
+     * Adds the rendered line @p pixmap for @p cells, which the cache takes
+     * ownership of.  Returns false if the line is too large to be kept, in
+     * which case it has been deleted.
+     */
+    bool insert(const QByteArray& cells, QPixmap* pixmap);
+
+    /** Returns the number of pixels of the rendered lines */
+    int totalCost() const {
+        return _lines.totalCost();
+    }
+
+private:
+    explicit LineCache(const QByteArray& key);
+
+    // removes all of the rendered lines
+    void clearLines();
+
+    QByteArray _key;
+    int _refCount;
+    quint64 _extendedCharsGeneration;
+    quint64 _rgbColorsGeneration;
+
+    QCache<QByteArray, QPixmap> _lines;
+};
+}
+
+#endif // LINECACHE_H
@@ -1,4 +1,4 @@
-// WARNING: Autogenerated by "fontembedder ./linefont.src".
+// WARNING: Autogenerated by "fontembedder LineFont.src".
 // You probably do not want to hand-edit this!
 
 static const quint32 LineChars[] = {
@@ -19,3 +19,135 @@ static const quint32 LineChars[] = {
     0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00001c00, 0x00001084, 0x00007000, 0x00421000,
     0x00039ce0, 0x000039ce, 0x000e7380, 0x00e73800, 0x000e7f80, 0x00e73884, 0x0003fce0, 0x004239ce
 };
+
+static const uchar LineCharSegments[][4] = {
+    { 0, 2, 4, 2 }, // U+2500
+    { 1, 1, 1, 3 }, { 2, 1, 2, 3 }, { 3, 1, 3, 3 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+2501
+    { 2, 0, 2, 4 }, // U+2502
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, // U+2503
+    { 2, 2, 2, 4 }, { 2, 2, 4, 2 }, // U+250C
+    { 2, 1, 2, 4 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 2, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+250D
+    { 1, 2, 1, 4 }, { 2, 2, 2, 4 }, { 3, 2, 3, 4 }, { 1, 2, 4, 2 }, // U+250E
+    { 1, 1, 1, 4 }, { 2, 1, 2, 4 }, { 3, 1, 3, 4 }, { 1, 1, 4, 1 }, { 1, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+250F
+    { 2, 2, 2, 4 }, { 0, 2, 2, 2 }, // U+2510
+    { 1, 1, 1, 3 }, { 2, 1, 2, 4 }, { 0, 1, 2, 1 }, { 0, 2, 2, 2 }, { 0, 3, 2, 3 }, // U+2511
+    { 1, 2, 1, 4 }, { 2, 2, 2, 4 }, { 3, 2, 3, 4 }, { 0, 2, 3, 2 }, // U+2512
+    { 1, 1, 1, 4 }, { 2, 1, 2, 4 }, { 3, 1, 3, 4 }, { 0, 1, 3, 1 }, { 0, 2, 3, 2 }, { 0, 3, 3, 3 }, // U+2513
+    { 2, 0, 2, 2 }, { 2, 2, 4, 2 }, // U+2514
+    { 2, 0, 2, 3 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 2, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+2515
+    { 1, 0, 1, 2 }, { 2, 0, 2, 2 }, { 3, 0, 3, 2 }, { 1, 2, 4, 2 }, // U+2516
+    { 1, 0, 1, 3 }, { 2, 0, 2, 3 }, { 3, 0, 3, 3 }, { 1, 1, 4, 1 }, { 1, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+2517
+    { 2, 0, 2, 2 }, { 0, 2, 2, 2 }, // U+2518
+    { 1, 1, 1, 3 }, { 2, 0, 2, 3 }, { 0, 1, 2, 1 }, { 0, 2, 2, 2 }, { 0, 3, 2, 3 }, // U+2519
+    { 1, 0, 1, 2 }, { 2, 0, 2, 2 }, { 3, 0, 3, 2 }, { 0, 2, 3, 2 }, // U+251A
+    { 1, 0, 1, 3 }, { 2, 0, 2, 3 }, { 3, 0, 3, 3 }, { 0, 1, 3, 1 }, { 0, 2, 3, 2 }, { 0, 3, 3, 3 }, // U+251B
+    { 2, 0, 2, 4 }, { 2, 2, 4, 2 }, // U+251C
+    { 2, 0, 2, 4 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 2, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+251D
+    { 1, 0, 1, 2 }, { 2, 0, 2, 4 }, { 3, 0, 3, 2 }, { 1, 2, 4, 2 }, // U+251E
+    { 1, 2, 1, 4 }, { 2, 0, 2, 4 }, { 3, 2, 3, 4 }, { 1, 2, 4, 2 }, // U+251F
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 1, 2, 4, 2 }, // U+2520
+    { 1, 0, 1, 3 }, { 2, 0, 2, 4 }, { 3, 0, 3, 3 }, { 1, 1, 4, 1 }, { 1, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+2521
+    { 1, 1, 1, 4 }, { 2, 0, 2, 4 }, { 3, 1, 3, 4 }, { 1, 1, 4, 1 }, { 1, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+2522
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 1, 1, 4, 1 }, { 1, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+2523
+    { 2, 0, 2, 4 }, { 0, 2, 2, 2 }, // U+2524
+    { 1, 1, 1, 3 }, { 2, 0, 2, 4 }, { 0, 1, 2, 1 }, { 0, 2, 2, 2 }, { 0, 3, 2, 3 }, // U+2525
+    { 1, 0, 1, 2 }, { 2, 0, 2, 4 }, { 3, 0, 3, 2 }, { 0, 2, 3, 2 }, // U+2526
+    { 1, 2, 1, 4 }, { 2, 0, 2, 4 }, { 3, 2, 3, 4 }, { 0, 2, 3, 2 }, // U+2527
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 0, 2, 3, 2 }, // U+2528
+    { 1, 0, 1, 3 }, { 2, 0, 2, 4 }, { 3, 0, 3, 3 }, { 0, 1, 3, 1 }, { 0, 2, 3, 2 }, { 0, 3, 3, 3 }, // U+2529
+    { 1, 1, 1, 4 }, { 2, 0, 2, 4 }, { 3, 1, 3, 4 }, { 0, 1, 3, 1 }, { 0, 2, 3, 2 }, { 0, 3, 3, 3 }, // U+252A
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 0, 1, 3, 1 }, { 0, 2, 3, 2 }, { 0, 3, 3, 3 }, // U+252B
+    { 2, 2, 2, 4 }, { 0, 2, 4, 2 }, // U+252C
+    { 1, 1, 1, 3 }, { 2, 1, 2, 4 }, { 0, 1, 2, 1 }, { 0, 2, 4, 2 }, { 0, 3, 2, 3 }, // U+252D
+    { 2, 1, 2, 4 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 0, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+252E
+    { 1, 1, 1, 3 }, { 2, 1, 2, 4 }, { 3, 1, 3, 3 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+252F
+    { 1, 1, 1, 3 }, { 2, 1, 2, 4 }, { 3, 1, 3, 3 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+2530
+    { 1, 1, 1, 4 }, { 2, 1, 2, 4 }, { 3, 1, 3, 4 }, { 0, 1, 3, 1 }, { 0, 2, 4, 2 }, { 0, 3, 3, 3 }, // U+2531
+    { 1, 1, 1, 4 }, { 2, 1, 2, 4 }, { 3, 1, 3, 3 }, { 1, 1, 4, 1 }, { 0, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+2532
+    { 1, 1, 1, 4 }, { 2, 1, 2, 4 }, { 3, 1, 3, 4 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+2533
+    { 2, 0, 2, 2 }, { 0, 2, 4, 2 }, // U+2534
+    { 1, 1, 1, 3 }, { 2, 0, 2, 3 }, { 0, 1, 2, 1 }, { 0, 2, 4, 2 }, { 0, 3, 2, 3 }, // U+2535
+    { 2, 0, 2, 3 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 0, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+2536
+    { 1, 1, 1, 3 }, { 2, 0, 2, 3 }, { 3, 1, 3, 3 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+2537
+    { 1, 0, 1, 2 }, { 2, 0, 2, 2 }, { 3, 0, 3, 2 }, { 0, 2, 4, 2 }, // U+2538
+    { 1, 0, 1, 3 }, { 2, 0, 2, 3 }, { 3, 0, 3, 3 }, { 0, 1, 3, 1 }, { 0, 2, 4, 2 }, { 0, 3, 3, 3 }, // U+2539
+    { 1, 0, 1, 3 }, { 2, 0, 2, 3 }, { 3, 0, 3, 3 }, { 1, 1, 4, 1 }, { 0, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+253A
+    { 1, 0, 1, 3 }, { 2, 0, 2, 3 }, { 3, 0, 3, 3 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+253B
+    { 2, 0, 2, 4 }, { 0, 2, 4, 2 }, // U+253C
+    { 1, 1, 1, 3 }, { 2, 0, 2, 4 }, { 0, 1, 2, 1 }, { 0, 2, 4, 2 }, { 0, 3, 2, 3 }, // U+253D
+    { 2, 0, 2, 4 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 0, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+253E
+    { 1, 1, 1, 3 }, { 2, 0, 2, 4 }, { 3, 1, 3, 3 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+253F
+    { 1, 0, 1, 2 }, { 2, 0, 2, 4 }, { 3, 0, 3, 2 }, { 0, 2, 4, 2 }, // U+2540
+    { 1, 2, 1, 4 }, { 2, 0, 2, 4 }, { 3, 2, 3, 4 }, { 0, 2, 4, 2 }, // U+2541
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 0, 2, 4, 2 }, // U+2542
+    { 1, 0, 1, 3 }, { 2, 0, 2, 4 }, { 3, 0, 3, 3 }, { 0, 1, 3, 1 }, { 0, 2, 4, 2 }, { 0, 3, 3, 3 }, // U+2543
+    { 1, 0, 1, 2 }, { 2, 0, 2, 4 }, { 3, 0, 3, 3 }, { 1, 1, 4, 1 }, { 0, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+2544
+    { 1, 1, 1, 4 }, { 2, 0, 2, 4 }, { 3, 1, 3, 4 }, { 0, 1, 3, 1 }, { 0, 2, 4, 2 }, { 0, 3, 3, 3 }, // U+2545
+    { 1, 2, 1, 4 }, { 2, 0, 2, 4 }, { 3, 1, 3, 4 }, { 2, 1, 4, 1 }, { 0, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+2546
+    { 1, 0, 1, 3 }, { 2, 0, 2, 4 }, { 3, 0, 3, 3 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+2547
+    { 1, 1, 1, 4 }, { 2, 0, 2, 4 }, { 3, 1, 3, 4 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+2548
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 0, 1, 3, 1 }, { 0, 2, 4, 2 }, { 0, 3, 3, 3 }, // U+2549
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 1, 1, 4, 1 }, { 0, 2, 4, 2 }, { 1, 3, 4, 3 }, // U+254A
+    { 1, 0, 1, 4 }, { 2, 0, 2, 4 }, { 3, 0, 3, 4 }, { 0, 1, 4, 1 }, { 0, 2, 4, 2 }, { 0, 3, 4, 3 }, // U+254B
+    { 0, 1, 4, 1 }, { 0, 3, 4, 3 }, // U+2550
+    { 1, 0, 1, 4 }, { 3, 0, 3, 4 }, // U+2551
+    { 2, 1, 2, 4 }, { 2, 1, 4, 1 }, { 2, 3, 4, 3 }, // U+2552
+    { 1, 2, 1, 4 }, { 3, 2, 3, 4 }, { 1, 2, 4, 2 }, // U+2553
+    { 1, 1, 1, 4 }, { 3, 3, 3, 4 }, { 1, 1, 4, 1 }, { 3, 3, 4, 3 }, // U+2554
+    { 2, 1, 2, 4 }, { 0, 1, 2, 1 }, { 0, 3, 2, 3 }, // U+2555
+    { 1, 2, 1, 4 }, { 3, 2, 3, 4 }, { 0, 2, 3, 2 }, // U+2556
+    { 1, 3, 1, 4 }, { 3, 1, 3, 4 }, { 0, 1, 3, 1 }, { 0, 3, 1, 3 }, // U+2557
+    { 2, 0, 2, 3 }, { 2, 1, 4, 1 }, { 2, 3, 4, 3 }, // U+2558
+    { 1, 0, 1, 2 }, { 3, 0, 3, 2 }, { 1, 2, 4, 2 }, // U+2559
+    { 1, 0, 1, 3 }, { 3, 0, 3, 1 }, { 3, 1, 4, 1 }, { 1, 3, 4, 3 }, // U+255A
+    { 2, 0, 2, 3 }, { 0, 1, 2, 1 }, { 0, 3, 2, 3 }, // U+255B
+    { 1, 0, 1, 2 }, { 3, 0, 3, 2 }, { 0, 2, 3, 2 }, // U+255C
+    { 1, 0, 1, 1 }, { 3, 0, 3, 3 }, { 0, 1, 1, 1 }, { 0, 3, 3, 3 }, // U+255D
+    { 2, 0, 2, 4 }, { 2, 1, 4, 1 }, { 2, 3, 4, 3 }, // U+255E
+    { 1, 0, 1, 4 }, { 3, 0, 3, 4 }, { 3, 2, 4, 2 }, // U+255F
+    { 1, 0, 1, 4 }, { 3, 0, 3, 4 }, { 3, 1, 4, 1 }, { 3, 3, 4, 3 }, // U+2560
+    { 2, 0, 2, 4 }, { 0, 1, 2, 1 }, { 0, 3, 2, 3 }, // U+2561
+    { 1, 0, 1, 4 }, { 3, 0, 3, 4 }, { 0, 2, 1, 2 }, // U+2562
+    { 1, 0, 1, 1 }, { 1, 3, 1, 4 }, { 3, 0, 3, 4 }, { 0, 1, 1, 1 }, { 0, 3, 1, 3 }, // U+2563
+    { 2, 3, 2, 4 }, { 0, 1, 4, 1 }, { 0, 3, 4, 3 }, // U+2564
+    { 1, 2, 1, 4 }, { 3, 2, 3, 4 }, { 0, 2, 4, 2 }, // U+2565
+    { 1, 3, 1, 4 }, { 3, 3, 3, 4 }, { 0, 1, 4, 1 }, { 0, 3, 1, 3 }, { 3, 3, 4, 3 }, // U+2566
+    { 2, 0, 2, 1 }, { 0, 1, 4, 1 }, { 0, 3, 4, 3 }, // U+2567
+    { 1, 0, 1, 2 }, { 3, 0, 3, 2 }, { 0, 2, 4, 2 }, // U+2568
+    { 1, 0, 1, 1 }, { 3, 0, 3, 1 }, { 0, 1, 1, 1 }, { 3, 1, 4, 1 }, { 0, 3, 4, 3 }, // U+2569
+    { 2, 0, 2, 4 }, { 0, 1, 4, 1 }, { 0, 3, 4, 3 }, // U+256A
+    { 1, 0, 1, 4 }, { 3, 0, 3, 4 }, { 0, 2, 4, 2 }, // U+256B
+    { 1, 0, 1, 1 }, { 1, 3, 1, 4 }, { 3, 0, 3, 1 }, { 3, 3, 3, 4 }, { 0, 1, 1, 1 }, { 3, 1, 4, 1 }, { 0, 3, 1, 3 }, { 3, 3, 4, 3 }, // U+256C
+    { 0, 2, 2, 2 }, // U+2574
+    { 2, 0, 2, 2 }, // U+2575
+    { 2, 2, 4, 2 }, // U+2576
+    { 2, 2, 2, 4 }, // U+2577
+    { 1, 1, 1, 3 }, { 2, 1, 2, 3 }, { 0, 1, 2, 1 }, { 0, 2, 2, 2 }, { 0, 3, 2, 3 }, // U+2578
+    { 1, 0, 1, 2 }, { 2, 0, 2, 2 }, { 3, 0, 3, 2 }, // U+2579
+    { 2, 1, 2, 3 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 2, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+257A
+    { 1, 2, 1, 4 }, { 2, 2, 2, 4 }, { 3, 2, 3, 4 }, // U+257B
+    { 2, 1, 2, 3 }, { 3, 1, 3, 3 }, { 2, 1, 4, 1 }, { 0, 2, 4, 2 }, { 2, 3, 4, 3 }, // U+257C
+    { 1, 2, 1, 4 }, { 2, 0, 2, 4 }, { 3, 2, 3, 4 }, // U+257D
+    { 1, 1, 1, 3 }, { 2, 1, 2, 3 }, { 0, 1, 2, 1 }, { 0, 2, 4, 2 }, { 0, 3, 2, 3 }, // U+257E
+    { 1, 0, 1, 2 }, { 2, 0, 2, 4 }, { 3, 0, 3, 2 }, // U+257F
+};
+
+static const quint16 LineCharSegmentIndex[] = {
+      0,   1,   7,   8,  11,  11,  11,  11,
+     11,  11,  11,  11,  11,  13,  18,  22,
+     28,  30,  35,  39,  45,  47,  52,  56,
+     62,  64,  69,  73,  79,  81,  86,  90,
+     94,  98, 104, 110, 116, 118, 123, 127,
+    131, 135, 141, 147, 153, 155, 160, 165,
+    171, 177, 183, 189, 195, 197, 202, 207,
+    213, 217, 223, 229, 235, 237, 242, 247,
+    253, 257, 261, 265, 271, 277, 283, 289,
+    295, 301, 307, 313, 319, 319, 319, 319,
+    319, 321, 323, 326, 329, 333, 336, 339,
+    343, 346, 349, 353, 356, 359, 363, 366,
+    369, 373, 376, 379, 384, 387, 390, 395,
+    398, 401, 406, 409, 412, 420, 420, 420,
+    420, 420, 420, 420, 420, 421, 422, 423,
+    424, 429, 432, 437, 440, 445, 448, 453,
+    456
+};
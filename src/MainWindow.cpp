@@ -53,6 +53,7 @@
 #include "SessionManager.h"
 #include "ProfileManager.h"
 #include "KonsoleSettings.h"
+#include "StartupTrace.h"
 #include "settings/GeneralSettings.h"
 #include "settings/TabBarSettings.h"
 
@@ -131,6 +132,8 @@ MainWindow::MainWindow()
     // this must come at the end
     applyKonsoleSettings();
     connect(KonsoleSettings::self(), SIGNAL(configChanged()), this, SLOT(applyKonsoleSettings()));
+
+    StartupTrace::mark("MainWindow constructed");
 }
 
 void MainWindow::rememberMenuAccelerators()
@@ -232,6 +235,8 @@ void MainWindow::activeViewChanged(SessionController* controller)
             this, SLOT(updateWindowCaption()));
 
     controller->setShowMenuAction(_toggleMenuBarAction);
+    // the controllers of tabs which are never activated do without actions
+    controller->setupActions();
     guiFactory()->addClient(controller);
 
     // set the current session's search bar
@@ -455,12 +460,17 @@ Session* MainWindow::createSession(Profile::Ptr profile, const QString& director
     if (!profile)
         profile = ProfileManager::instance()->defaultProfile();
 
-    Session* session = SessionManager::instance()->createSession(profile);
+    // the shell of a spare session is already running, so it does not
+    // know about the window which it is shown in
+    Session* session = SessionManager::instance()->takeSpareSession(profile, directory);
+    if (!session) {
+        session = SessionManager::instance()->createSession(profile);
 
-    if (!directory.isEmpty() && profile->startInCurrentSessionDir())
-        session->setInitialWorkingDirectory(directory);
+        if (!directory.isEmpty() && profile->startInCurrentSessionDir())
+            session->setInitialWorkingDirectory(directory);
 
-    session->addEnvironmentEntry(QString("KONSOLE_DBUS_WINDOW=/Windows/%1").arg(_viewManager->managerId()));
+        session->addEnvironmentEntry(QString("KONSOLE_DBUS_WINDOW=/Windows/%1").arg(_viewManager->managerId()));
+    }
 
     // create view before starting the session process so that the session
     // doesn't suffer a change in terminal size right after the session
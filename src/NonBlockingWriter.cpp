@@ -0,0 +1,146 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "NonBlockingWriter.h"
+
+// Unix
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+// Qt
+#include <QtCore/QFile>
+#include <QtCore/QSocketNotifier>
+
+using Konsole::NonBlockingWriter;
+
+// the most data which is written at once, so that writing a regular file,
+// which always has room, leaves time for the other events in between
+static const int WRITE_SIZE = 64 * 1024;
+
+// writes to 'fd' like write(), but when the reader of a pipe has gone away
+// this fails with EPIPE instead of raising SIGPIPE, which would end Konsole
+static ssize_t writeWithoutSigPipe(int fd, const char* data, size_t length)
+{
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+
+    // a SIGPIPE which was already pending is not ours to take
+    sigset_t pending;
+    sigpending(&pending);
+    const bool wasPending = sigismember(&pending, SIGPIPE);
+
+    sigset_t oldMask;
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &oldMask);
+
+    const ssize_t result = ::write(fd, data, length);
+    if (result < 0 && errno == EPIPE && !wasPending) {
+        const int error = errno;
+        int number;
+        sigwait(&pipeSignal, &number);
+        errno = error;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &oldMask, 0);
+    return result;
+}
+
+NonBlockingWriter::NonBlockingWriter(const QString& fileName, const QByteArray& data,
+                                     QObject* parent)
+    : QObject(parent)
+    , _fileName(fileName)
+    , _data(data)
+    , _written(0)
+    , _fd(-1)
+    , _notifier(0)
+{
+}
+
+NonBlockingWriter::~NonBlockingWriter()
+{
+    delete _notifier;
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+bool NonBlockingWriter::start()
+{
+    // opening a named pipe without O_NONBLOCK would wait for a reader
+    _fd = ::open(QFile::encodeName(_fileName).constData(),
+                 O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0600);
+    if (_fd < 0) {
+        _errorString = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+    fcntl(_fd, F_SETFD, FD_CLOEXEC);
+
+    _notifier = new QSocketNotifier(_fd, QSocketNotifier::Write);
+    connect(_notifier, SIGNAL(activated(int)), this, SLOT(writeData()));
+    return true;
+}
+
+QString NonBlockingWriter::errorString() const
+{
+    return _errorString;
+}
+
+int NonBlockingWriter::bytesWritten() const
+{
+    return _written;
+}
+
+void NonBlockingWriter::writeData()
+{
+    if (_written < _data.size()) {
+        const int length = qMin(WRITE_SIZE, _data.size() - _written);
+        const ssize_t result = writeWithoutSigPipe(_fd, _data.constData() + _written, length);
+        if (result < 0) {
+            // the notifier tries again once the pipe has room
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            _errorString = QString::fromLocal8Bit(strerror(errno));
+            finish(false);
+            return;
+        }
+        _written += result;
+    }
+
+    if (_written == _data.size())
+        finish(true);
+}
+
+void NonBlockingWriter::finish(bool success)
+{
+    _notifier->setEnabled(false);
+
+    // the reader sees the end of the file once it is closed
+    ::close(_fd);
+    _fd = -1;
+
+    emit finished(success);
+    deleteLater();
+}
+
+#include "NonBlockingWriter.moc"
@@ -0,0 +1,97 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef NONBLOCKINGWRITER_H
+#define NONBLOCKINGWRITER_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+// Konsole
+#include "konsole_export.h"
+
+class QSocketNotifier;
+
+namespace Konsole
+{
+/**
+ * Writes data to a file as fast as the reader of the file takes it,
+ * without waiting for the reader.
+ *
+ * This is meant for handing large amounts of output to another program
+ * through a named pipe which it reads from.  The data is written from the
+ * event loop whenever the pipe has room for more of it, so a reader which
+ * is slow or stops reading holds up nothing but the writer.  Regular files
+ * can be written the same way.
+ *
+ * The writer deletes itself once all of the data has been written, or when
+ * writing fails, for example because the reader closed the pipe.  The
+ * reader sees the end of the file when the writer is done.
+ */
+class KONSOLEPRIVATE_EXPORT NonBlockingWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Constructs a new writer which writes @p data to @p fileName */
+    NonBlockingWriter(const QString& fileName, const QByteArray& data,
+                      QObject* parent = 0);
+    /** Closes the file, even if not all the data has been written */
+    ~NonBlockingWriter();
+
+    /**
+     * Opens the file and starts writing.  A file which does not exist is
+     * created, a regular file which exists is truncated.
+     *
+     * Returns false if the file cannot be opened.  This includes a named
+     * pipe which nobody has opened for reading yet.
+     */
+    bool start();
+
+    /** Returns a description of the last error, see start() */
+    QString errorString() const;
+
+    /** Returns the number of bytes written so far */
+    int bytesWritten() const;
+
+signals:
+    /**
+     * Emitted when the writer is done, just before it deletes itself.
+     * @p success is false if not all of the data could be written.
+     */
+    void finished(bool success);
+
+private slots:
+    void writeData();
+
+private:
+    void finish(bool success);
+
+    QString _fileName;
+    QByteArray _data;
+    int _written;
+    int _fd;
+    QSocketNotifier* _notifier;
+    QString _errorString;
+};
+}
+
+#endif // NONBLOCKINGWRITER_H
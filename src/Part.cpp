@@ -48,22 +48,30 @@ using namespace Konsole;
 K_PLUGIN_FACTORY(KonsolePartFactory, registerPlugin<Konsole::Part>();)
 K_EXPORT_PLUGIN(KonsolePartFactory("konsole"))
 
-Part::Part(QWidget* parentWidget , QObject* parent, const QVariantList&)
+Part::Part(QWidget* parentWidget , QObject* parent, const QVariantList& args)
     : KParts::ReadOnlyPart(parent)
     , _viewManager(0)
     , _pluggedController(0)
     , _manageProfilesAction(0)
+    , _minimalMode(false)
 {
+    foreach(const QVariant& arg, args) {
+        if (arg.toString() == QLatin1String("MinimalMode"))
+            _minimalMode = true;
+    }
+
     // make sure the konsole catalog is loaded
     KGlobal::locale()->insertCatalog("konsole");
     // make sure the libkonq catalog is loaded( needed for drag & drop )
     KGlobal::locale()->insertCatalog("libkonq");
 
     // setup global actions
-    createGlobalActions();
+    if (!_minimalMode)
+        createGlobalActions();
 
-    // create view widget
-    _viewManager = new ViewManager(this, actionCollection());
+    // create view widget.  without an action collection, the view manager
+    // does not create its actions for splitting and navigating views
+    _viewManager = new ViewManager(this, _minimalMode ? 0 : actionCollection());
     _viewManager->setNavigationMethod(ViewManager::NoNavigation);
 
     connect(_viewManager, SIGNAL(activeViewChanged(SessionController*)), this ,
@@ -237,16 +245,21 @@ void Part::activeViewChanged(SessionController* controller)
 
     // remove existing controller
     if (_pluggedController) {
-        removeChildClient(_pluggedController);
+        if (!_minimalMode)
+            removeChildClient(_pluggedController);
         disconnect(_pluggedController, SIGNAL(titleChanged(ViewProperties*)), this,
                    SLOT(activeViewTitleChanged(ViewProperties*)));
         disconnect(_pluggedController, SIGNAL(currentDirectoryChanged(QString)), this,
                    SIGNAL(currentDirectoryChanged(QString)));
     }
 
-    // insert new controller
-    insertChildClient(controller);
-    setupActionsForSession(controller);
+    // insert new controller.  in the minimal mode the host does not merge
+    // the actions, but their shortcuts work on the view all the same
+    controller->setupActions();
+    if (!_minimalMode) {
+        insertChildClient(controller);
+        setupActionsForSession(controller);
+    }
 
     connect(controller, SIGNAL(titleChanged(ViewProperties*)), this,
             SLOT(activeViewTitleChanged(ViewProperties*)));
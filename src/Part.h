@@ -44,6 +44,12 @@ class ViewProperties;
 /**
  * A re-usable terminal emulator component using the KParts framework which can
  * be used to embed terminal emulators into other applications.
+ *
+ * Hosts which only show the terminal and do not merge its actions into their
+ * own user interface can pass "MinimalMode" as one of the arguments of the
+ * part.  In that mode the part does not create the actions for managing views
+ * and profiles, and the actions of the session are not merged into the
+ * host's user interface.  Their shortcuts still work in the terminal.
  */
 class Part : public KParts::ReadOnlyPart , public TerminalInterfaceV2
 {
@@ -212,6 +218,7 @@ private:
     ViewManager* _viewManager;
     SessionController* _pluggedController;
     QAction* _manageProfilesAction;
+    bool _minimalMode;
 };
 }
 
@@ -0,0 +1,58 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef PERFORMANCECLOCK_H
+#define PERFORMANCECLOCK_H
+
+// Qt
+#include <QtCore/QtGlobal>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * Measures short durations in microseconds with a monotonic clock, for
+ * the performance statistics.  QElapsedTimer only measures milliseconds
+ * in the Qt versions supported.
+ */
+class KONSOLEPRIVATE_EXPORT PerformanceClock
+{
+public:
+    /** Constructs a clock which is started right away */
+    PerformanceClock() : _start(now()) {}
+
+    /** Returns the microseconds since the clock was started */
+    qint64 elapsed() const {
+        return now() - _start;
+    }
+
+    /** Restarts the clock and returns the microseconds since it was started */
+    qint64 restart();
+
+    /** Returns the current time of the monotonic clock in microseconds */
+    static qint64 now();
+
+private:
+    qint64 _start;
+};
+}
+
+#endif // PERFORMANCECLOCK_H
@@ -30,6 +30,10 @@
 #include <unistd.h>
 #include <pwd.h>
 #include <sys/param.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Qt
 #include <QtCore/QDir>
@@ -121,29 +125,96 @@ QString ProcessInfo::validCurrentDir() const
     return dir;
 }
 
+TitleFormat::TitleFormat()
+{
+}
+
+TitleFormat::TitleFormat(const QString& format)
+    : _text(format)
+{
+    Token token;
+    token.marker = 0;
+
+    int i = 0;
+    while (i < format.length()) {
+        const int markerPos = format.indexOf('%', i);
+        if (markerPos == -1 || markerPos + 1 == format.length()) {
+            token.text = format.mid(i);
+            _tokens << token;
+            break;
+        }
+
+        if (markerPos > i) {
+            token.text = format.mid(i, markerPos - i);
+            _tokens << token;
+        }
+
+        Token marker;
+        marker.marker = format[markerPos + 1].toLatin1();
+        marker.text = format.mid(markerPos, 2);
+        _tokens << marker;
+
+        i = markerPos + 2;
+    }
+}
+
+QString TitleFormat::text() const
+{
+    return _text;
+}
+
+bool TitleFormat::contains(char marker) const
+{
+    foreach(const Token& token, _tokens) {
+        if (token.marker == marker)
+            return true;
+    }
+    return false;
+}
+
 QString ProcessInfo::format(const QString& input) const
+{
+    return format(TitleFormat(input));
+}
+
+QString ProcessInfo::format(const TitleFormat& titleFormat) const
 {
     bool ok = false;
 
-    QString output(input);
-
-    // search for and replace known marker
-    output.replace("%u", userName());
-    output.replace("%h", localHost());
-    output.replace("%n", name(&ok));
-
-    QString dir = validCurrentDir();
-    if (output.contains("%D")) {
-        QString homeDir = userHomeDir();
-        QString tempDir = dir;
-        // Change User's Home Dir w/ ~ only at the beginning
-        if (tempDir.startsWith(homeDir)) {
-            tempDir.remove(0, homeDir.length());
-            tempDir.prepend('~');
+    // the directory is only looked up if it is used
+    QString dir;
+    if (titleFormat.contains('d') || titleFormat.contains('D'))
+        dir = validCurrentDir();
+
+    QString output;
+    foreach(const TitleFormat::Token& token, titleFormat._tokens) {
+        switch (token.marker) {
+        case 'u':
+            output += userName();
+            break;
+        case 'h':
+            output += localHost();
+            break;
+        case 'n':
+            output += name(&ok);
+            break;
+        case 'D': {
+            // Change User's Home Dir w/ ~ only at the beginning
+            const QString homeDir = userHomeDir();
+            if (dir.startsWith(homeDir))
+                output += '~' + dir.mid(homeDir.length());
+            else
+                output += dir;
+            break;
+        }
+        case 'd':
+            output += formatShortDir(dir);
+            break;
+        default:
+            output += token.text;
+            break;
         }
-        output.replace("%D", tempDir);
     }
-    output.replace("%d", formatShortDir(dir));
 
     return output;
 }
@@ -369,26 +440,36 @@ void NullProcessInfo::readUserName()
 
 UnixProcessInfo::UnixProcessInfo(int aPid, bool enableEnvironmentRead)
     : ProcessInfo(aPid, enableEnvironmentRead)
+    , _argumentsRead(false)
 {
 }
 
 bool UnixProcessInfo::readProcessInfo(int aPid , bool enableEnvironmentRead)
 {
-    // prevent _arguments from growing longer and longer each time this
-    // method is called.
-    clearArguments();
-
     bool ok = readProcInfo(aPid);
     if (ok) {
-        ok |= readArguments(aPid);
-        ok |= readCurrentDir(aPid);
-        if (enableEnvironmentRead) {
-            ok |= readEnvironment(aPid);
+        // the arguments and the environment only change when a new
+        // program is executed
+        if (!_argumentsRead || processChanged()) {
+            // prevent _arguments from growing longer and longer each time
+            // they are read
+            clearArguments();
+            ok |= readArguments(aPid);
+            if (enableEnvironmentRead) {
+                ok |= readEnvironment(aPid);
+            }
+            _argumentsRead = true;
         }
+        ok |= readCurrentDir(aPid);
     }
     return ok;
 }
 
+bool UnixProcessInfo::processChanged() const
+{
+    return true;
+}
+
 void UnixProcessInfo::readUserName()
 {
     bool ok = false;
@@ -422,20 +503,140 @@ class LinuxProcessInfo : public UnixProcessInfo
 {
 public:
     LinuxProcessInfo(int aPid, bool env) :
-        UnixProcessInfo(aPid, env) {
+        UnixProcessInfo(aPid, env),
+        _statFd(-1),
+        _statPid(0),
+        _startTime(0),
+        _statRead(false),
+        _changed(true) {
+    }
+
+    virtual ~LinuxProcessInfo() {
+        if (_statFd != -1)
+            ::close(_statFd);
     }
 
 private:
+    virtual bool processChanged() const {
+        return _changed;
+    }
+
     virtual bool readProcInfo(int aPid) {
+        int parentPid = 0;
+        int foregroundPid = 0;
+        qulonglong startTime = 0;
+        QString processName;
+
+        if (!readStat(aPid, processName, parentPid, foregroundPid, startTime))
+            return false;
+
+        // the name of the process changes when it executes a new program,
+        // the start time when the pid has been reused by another process
+        _changed = (!_statRead || startTime != _startTime || processName != _statName);
+        _statRead = true;
+        _startTime = startTime;
+        _statName = processName;
+
+        // the user id can only change along with the program, through a
+        // setuid program such as 'su'
+        if (_changed && !readUserId(aPid))
+            return false;
+
+        setForegroundPid(foregroundPid);
+        setParentPid(parentPid);
+        if (!processName.isEmpty())
+            setName(processName);
+
+        // update object state
+        setPid(aPid);
+
+        return true;
+    }
+
+    // reads the process status file ( /proc/<pid>/stat ), which is kept
+    // open so that reading it again only takes a single pread() call
+    bool readStat(int aPid, QString& processName, int& parentPid,
+                  int& foregroundPid, qulonglong& startTime) {
         // indicies of various fields within the process status file which
-        // contain various information about the process
-        const int PARENT_PID_FIELD = 3;
-        const int PROCESS_NAME_FIELD = 1;
-        const int GROUP_PROCESS_FIELD = 7;
-
-        QString parentPidString;
-        QString processNameString;
-        QString foregroundPidString;
+        // contain various information about the process, counted from
+        // the field after the process name
+        const int PARENT_PID_FIELD = 1;
+        const int GROUP_PROCESS_FIELD = 5;
+        const int START_TIME_FIELD = 19;
+
+        if (_statFd != -1 && _statPid != aPid) {
+            ::close(_statFd);
+            _statFd = -1;
+        }
+        if (_statFd == -1) {
+            const QByteArray fileName = QFile::encodeName(QString("/proc/%1/stat").arg(aPid));
+            _statFd = ::open(fileName.constData(), O_RDONLY);
+            if (_statFd == -1) {
+                setError(errno == EACCES ? PermissionsError : UnknownError);
+                return false;
+            }
+            fcntl(_statFd, F_SETFD, FD_CLOEXEC);
+            _statPid = aPid;
+        }
+
+        char buffer[1024];
+        const ssize_t length = pread(_statFd, buffer, sizeof(buffer) - 1, 0);
+        if (length <= 0) {
+            // the process is gone
+            setError(UnknownError);
+            ::close(_statFd);
+            _statFd = -1;
+            return false;
+        }
+        buffer[length] = '\0';
+
+        // the expected file format is a list of fields separated by spaces,
+        // with the process name, which may itself contain spaces and
+        // parentheses, in parentheses:
+        //
+        // PID (NAME WITH SPACES) FIELD FIELD ...
+        //
+        const char* nameStart = strchr(buffer, '(');
+        const char* nameEnd = strrchr(buffer, ')');
+        if (!nameStart || !nameEnd || nameEnd < nameStart) {
+            setError(UnknownError);
+            return false;
+        }
+        processName = QString::fromLocal8Bit(nameStart + 1, nameEnd - nameStart - 1);
+
+        bool parentPidRead = false;
+        int field = 0;
+        const char* pos = nameEnd + 1;
+        while (*pos && field <= START_TIME_FIELD) {
+            while (*pos == ' ')
+                pos++;
+            char* fieldEnd = 0;
+            const qulonglong value = strtoull(pos, &fieldEnd, 10);
+            if (fieldEnd != pos) {
+                switch (field) {
+                case PARENT_PID_FIELD:
+                    parentPid = int(value);
+                    parentPidRead = true;
+                    break;
+                case GROUP_PROCESS_FIELD:
+                    foregroundPid = int(value);
+                    break;
+                case START_TIME_FIELD:
+                    startTime = value;
+                    break;
+                }
+            }
+            while (*pos && *pos != ' ')
+                pos++;
+            field++;
+        }
+
+        if (!parentPidRead)
+            setError(UnknownError);
+        return parentPidRead;
+    }
+
+    bool readUserId(int aPid) {
         QString uidLine;
         QString uidString;
         QStringList uidStrings;
@@ -470,70 +671,7 @@ private:
             return false;
         }
 
-        // read process status file ( /proc/<pid/stat )
-        //
-        // the expected file format is a list of fields separated by spaces, using
-        // parenthesies to escape fields such as the process name which may itself contain
-        // spaces:
-        //
-        // FIELD FIELD (FIELD WITH SPACES) FIELD FIELD
-        //
-        QFile processInfo(QString("/proc/%1/stat").arg(aPid));
-        if (processInfo.open(QIODevice::ReadOnly)) {
-            QTextStream stream(&processInfo);
-            const QString& data = stream.readAll();
-
-            int stack = 0;
-            int field = 0;
-            int pos = 0;
-
-            while (pos < data.count()) {
-                QChar c = data[pos];
-
-                if (c == '(') {
-                    stack++;
-                } else if (c == ')') {
-                    stack--;
-                } else if (stack == 0 && c == ' ') {
-                    field++;
-                } else {
-                    switch (field) {
-                    case PARENT_PID_FIELD:
-                        parentPidString.append(c);
-                        break;
-                    case PROCESS_NAME_FIELD:
-                        processNameString.append(c);
-                        break;
-                    case GROUP_PROCESS_FIELD:
-                        foregroundPidString.append(c);
-                        break;
-                    }
-                }
-
-                pos++;
-            }
-        } else {
-            setFileError(processInfo.error());
-            return false;
-        }
-
-        // check that data was read successfully
-        bool ok = false;
-        const int foregroundPid = foregroundPidString.toInt(&ok);
-        if (ok)
-            setForegroundPid(foregroundPid);
-
-        const int parentPid = parentPidString.toInt(&ok);
-        if (ok)
-            setParentPid(parentPid);
-
-        if (!processNameString.isEmpty())
-            setName(processNameString);
-
-        // update object state
-        setPid(aPid);
-
-        return ok;
+        return true;
     }
 
     virtual bool readArguments(int aPid) {
@@ -607,6 +745,15 @@ private:
 
         return true;
     }
+
+    // the process status file, kept open for reading it again
+    int _statFd;
+    int _statPid;
+    // the start time and the name of the process at the last read
+    qulonglong _startTime;
+    QString _statName;
+    bool _statRead;
+    bool _changed;
 };
 
 #if defined(Q_OS_FREEBSD)
@@ -1032,12 +1179,11 @@ private:
 };
 
 SSHProcessInfo::SSHProcessInfo(const ProcessInfo& process)
-    : _process(process)
 {
     bool ok = false;
 
     // check that this is a SSH process
-    const QString& name = _process.name(&ok);
+    const QString& name = process.name(&ok);
 
     if (!ok || name != "ssh") {
         if (!ok)
@@ -1049,7 +1195,7 @@ SSHProcessInfo::SSHProcessInfo(const ProcessInfo& process)
     }
 
     // read arguments
-    const QVector<QString>& args = _process.arguments(&ok);
+    const QVector<QString>& args = process.arguments(&ok);
 
     // SSH options
     // these are taken from the SSH manual ( accessed via 'man ssh' )
@@ -1131,6 +1277,13 @@ SSHProcessInfo::SSHProcessInfo(const ProcessInfo& process)
 
         return;
     }
+
+    // the 'short host' of an ip address is the full address
+    struct in_addr address;
+    if (inet_aton(_host.toLocal8Bit().constData(), &address) != 0)
+        _shortHost = _host;
+    else
+        _shortHost = _host.left(_host.indexOf('.'));
 }
 
 QString SSHProcessInfo::userName() const
@@ -1151,30 +1304,32 @@ QString SSHProcessInfo::command() const
 }
 QString SSHProcessInfo::format(const QString& input) const
 {
-    QString output(input);
-
-    // test whether host is an ip address
-    // in which case 'short host' and 'full host'
-    // markers in the input string are replaced with
-    // the full address
-    bool isIpAddress = false;
-
-    struct in_addr address;
-    if (inet_aton(_host.toLocal8Bit().constData(), &address) != 0)
-        isIpAddress = true;
-    else
-        isIpAddress = false;
-
-    // search for and replace known markers
-    output.replace("%u", _user);
+    return format(TitleFormat(input));
+}
 
-    if (isIpAddress)
-        output.replace("%h", _host);
-    else
-        output.replace("%h", _host.left(_host.indexOf('.')));
+QString SSHProcessInfo::format(const TitleFormat& titleFormat) const
+{
+    QString output;
 
-    output.replace("%H", _host);
-    output.replace("%c", _command);
+    foreach(const TitleFormat::Token& token, titleFormat._tokens) {
+        switch (token.marker) {
+        case 'u':
+            output += _user;
+            break;
+        case 'h':
+            output += _shortHost;
+            break;
+        case 'H':
+            output += _host;
+            break;
+        case 'c':
+            output += _command;
+            break;
+        default:
+            output += token.text;
+            break;
+        }
+    }
 
     return output;
 }
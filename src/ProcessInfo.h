@@ -28,6 +28,44 @@
 
 namespace Konsole
 {
+/**
+ * A format for titles such as "%d : %n", which is split into its markers
+ * and the text between them once, so that it can be filled in with
+ * ProcessInfo::format() or SSHProcessInfo::format() over and over again
+ * without searching it each time.
+ *
+ * A marker is a '%' followed by a single character.  Markers which the
+ * process description does not know are left in the title as they are.
+ */
+class TitleFormat
+{
+public:
+    /** Constructs an empty format */
+    TitleFormat();
+    /** Constructs a format from the format string @p format */
+    explicit TitleFormat(const QString& format);
+
+    /** Returns the format string which the format was constructed from */
+    QString text() const;
+
+    /** Returns true if the format contains the marker '%' + @p marker */
+    bool contains(char marker) const;
+
+private:
+    friend class ProcessInfo;
+    friend class SSHProcessInfo;
+
+    // a marker, or the text between two markers if 'marker' is 0.  For
+    // markers, 'text' is the marker itself
+    struct Token {
+        char marker;
+        QString text;
+    };
+
+    QString _text;
+    QVector<Token> _tokens;
+};
+
 /**
  * Takes a snapshot of the state of a process and provides access to
  * information such as the process name, parent process,
@@ -189,6 +227,8 @@ public:
      * </ul>
      */
     QString format(const QString& text) const;
+    /** Same as format(), for a format which has already been split up */
+    QString format(const TitleFormat& titleFormat) const;
 
     /**
      * This enum describes the errors which can occur when trying to read
@@ -362,13 +402,25 @@ public:
 protected:
     /**
      * Implementation of ProcessInfo::readProcessInfo(); calls the
-     * four private methods below in turn.
+     * four private methods below in turn.  The arguments and the
+     * environment are only read again if processChanged() says so.
      */
     virtual bool readProcessInfo(int pid , bool readEnvironment);
 
     virtual void readUserName(void);
 
+    /**
+     * Returns true if the last call to readProcInfo() found that the
+     * process has executed a new program, or that it is a different
+     * process, since the previous call.  The default implementation
+     * cannot tell and always returns true.
+     */
+    virtual bool processChanged() const;
+
 private:
+    // true once the arguments have been read
+    bool _argumentsRead;
+
     /**
      * Read the standard process information -- PID, parent PID, foreground PID.
      * @param pid process ID to use
@@ -448,11 +500,13 @@ public:
      *      to execute when starting the SSH process.
      */
     QString format(const QString& input) const;
+    /** Same as format(), for a format which has already been split up */
+    QString format(const TitleFormat& titleFormat) const;
 
 private:
-    const ProcessInfo& _process;
     QString _user;
     QString _host;
+    QString _shortHost; // the host for the %h marker
     QString _port;
     QString _command;
 };
@@ -71,6 +71,9 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { SilenceSeconds, "SilenceSeconds" , GENERAL_GROUP , QVariant::Int }
     , { TerminalColumns, "TerminalColumns" , GENERAL_GROUP , QVariant::Int }
     , { TerminalRows, "TerminalRows" , GENERAL_GROUP , QVariant::Int }
+    , { OutputLogDirectory, "OutputLogDirectory" , GENERAL_GROUP , QVariant::String }
+    , { OutputLogPlainText, "OutputLogPlainText" , GENERAL_GROUP , QVariant::Bool }
+    , { SpareSessions, "SpareSessions" , GENERAL_GROUP , QVariant::Int }
 
     // Appearance
     , { Font , "Font" , APPEARANCE_GROUP , QVariant::Font }
@@ -78,6 +81,7 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { ColorScheme , "colors" , 0 , QVariant::String }
     , { AntiAliasFonts, "AntiAliasFonts" , APPEARANCE_GROUP , QVariant::Bool }
     , { BoldIntense, "BoldIntense", APPEARANCE_GROUP, QVariant::Bool }
+    , { LowBandwidthRendering, "LowBandwidthRendering", APPEARANCE_GROUP, QVariant::Bool }
     , { LineSpacing , "LineSpacing" , APPEARANCE_GROUP , QVariant::Int }
 
     // Keyboard
@@ -86,12 +90,30 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     // Scrolling
     , { HistoryMode , "HistoryMode" , SCROLLING_GROUP , QVariant::Int }
     , { HistorySize , "HistorySize" , SCROLLING_GROUP , QVariant::Int }
+    , { CompressHistory , "CompressHistory" , SCROLLING_GROUP , QVariant::Bool }
+    , { ShareHistory , "ShareHistory" , SCROLLING_GROUP , QVariant::Bool }
+    , { PersistentHistory , "PersistentHistory" , SCROLLING_GROUP , QVariant::Bool }
+    , { IndexHistory , "IndexHistory" , SCROLLING_GROUP , QVariant::Bool }
     , { ScrollBarPosition , "ScrollBarPosition" , SCROLLING_GROUP , QVariant::Int }
     , { ScrollFullPage , "ScrollFullPage" , SCROLLING_GROUP , QVariant::Bool }
 
     // Terminal Features
     , { BlinkingTextEnabled , "BlinkingTextEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { FlowControlEnabled , "FlowControlEnabled" , TERMINAL_GROUP , QVariant::Bool }
+    , { ZModemDetectionEnabled , "ZModemDetectionEnabled" , TERMINAL_GROUP , QVariant::Bool }
+    , { BinaryOutputDetectionEnabled , "BinaryOutputDetectionEnabled" , TERMINAL_GROUP , QVariant::Bool }
+    , { FastForwardEnabled , "FastForwardEnabled" , TERMINAL_GROUP , QVariant::Bool }
+    , { ReflowLines , "ReflowLines" , TERMINAL_GROUP , QVariant::Bool }
+    , { AlternateScreenReleaseDelay , "AlternateScreenReleaseDelay" , TERMINAL_GROUP , QVariant::Int }
+    , { UpdateLatency , "UpdateLatency" , TERMINAL_GROUP , QVariant::Int }
+    , { MaximumUpdateInterval , "MaximumUpdateInterval" , TERMINAL_GROUP , QVariant::Int }
+    , { HighOutputRate , "HighOutputRate" , TERMINAL_GROUP , QVariant::Int }
+    , { FloodOutputRate , "FloodOutputRate" , TERMINAL_GROUP , QVariant::Int }
+    , { FloodFrameRate , "FloodFrameRate" , TERMINAL_GROUP , QVariant::Int }
+    , { OutputTimeSlice , "OutputTimeSlice" , TERMINAL_GROUP , QVariant::Int }
+    , { BackgroundOutputInterval , "BackgroundOutputInterval" , TERMINAL_GROUP , QVariant::Int }
+    , { ReadBufferSize , "ReadBufferSize" , TERMINAL_GROUP , QVariant::Int }
+    , { OutputHighWaterMark , "OutputHighWaterMark" , TERMINAL_GROUP , QVariant::Int }
     , { BidiRenderingEnabled , "BidiRenderingEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BlinkingCursorEnabled , "BlinkingCursorEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BellMode , "BellMode" , TERMINAL_GROUP , QVariant::Int }
@@ -161,6 +183,9 @@ FallbackProfile::FallbackProfile()
     setProperty(SilenceSeconds, 10);
     setProperty(TerminalColumns, 80);
     setProperty(TerminalRows, 40);
+    setProperty(OutputLogDirectory, QString());
+    setProperty(OutputLogPlainText, false);
+    setProperty(SpareSessions, 0);
     setProperty(MouseWheelZoomEnabled, true);
 
     setProperty(KeyBindings, "default");
@@ -169,10 +194,28 @@ FallbackProfile::FallbackProfile()
 
     setProperty(HistoryMode, Enum::FixedSizeHistory);
     setProperty(HistorySize, 1000);
+    setProperty(CompressHistory, false);
+    setProperty(ShareHistory, false);
+    setProperty(PersistentHistory, false);
+    setProperty(IndexHistory, false);
     setProperty(ScrollBarPosition, Enum::ScrollBarRight);
     setProperty(ScrollFullPage, false);
 
     setProperty(FlowControlEnabled, true);
+    setProperty(ZModemDetectionEnabled, true);
+    setProperty(BinaryOutputDetectionEnabled, true);
+    setProperty(FastForwardEnabled, false);
+    setProperty(ReflowLines, false);
+    setProperty(AlternateScreenReleaseDelay, 60);
+    setProperty(UpdateLatency, 10);
+    setProperty(MaximumUpdateInterval, 40);
+    setProperty(HighOutputRate, 1024);
+    setProperty(FloodOutputRate, 8192);
+    setProperty(FloodFrameRate, 30);
+    setProperty(OutputTimeSlice, 20);
+    setProperty(BackgroundOutputInterval, 250);
+    setProperty(ReadBufferSize, 64);
+    setProperty(OutputHighWaterMark, 1024);
     setProperty(BlinkingTextEnabled, true);
     setProperty(UnderlineLinksEnabled, true);
     setProperty(OpenLinksByDirectClickEnabled, false);
@@ -195,6 +238,7 @@ FallbackProfile::FallbackProfile()
     setProperty(DefaultEncoding, QString(QTextCodec::codecForLocale()->name()));
     setProperty(AntiAliasFonts, true);
     setProperty(BoldIntense, true);
+    setProperty(LowBandwidthRendering, false);
 
     // default taken from KDE 3
     setProperty(WordCharacters, ":@-./_~?&=%+#");
@@ -145,6 +145,28 @@ public:
          * FixedSizeHistory
          */
         HistorySize,
+        /** (bool) Specifies whether the lines of an unlimited history are
+         * kept in compressed blocks rather than as plain characters.
+         * Only used if the HistoryMode property is UnlimitedHistory.
+         */
+        CompressHistory,
+        /** (bool) Specifies whether identical lines in the histories of
+         * different sessions are stored only once.
+         * Only used if the HistoryMode property is FixedSizeHistory.
+         */
+        ShareHistory,
+        /** (bool) Specifies whether the history is kept in files which
+         * survive restarting Konsole, so that restored sessions get their
+         * history back.
+         * Only used if the HistoryMode property is UnlimitedHistory and
+         * CompressHistory is false.
+         */
+        PersistentHistory,
+        /** (bool) Specifies whether an index of the lines in the history is
+         * kept, which makes searching very long output much faster at the
+         * cost of 16 bytes of memory for each line.
+         */
+        IndexHistory,
         /** (ScrollBarPositionEnum) Specifies the position of the scroll bar
          * in terminal displays using this profile.
          *
@@ -167,6 +189,67 @@ public:
          * Ctrl+Q) have any effect.  Also known as Xon/Xoff
          */
         FlowControlEnabled,
+        /** (bool) Specifies whether the output of terminal programs is
+         * checked for the start of a ZModem transfer.
+         */
+        ZModemDetectionEnabled,
+        /** (bool) Specifies whether output which looks like the contents
+         * of a binary file is shown without being interpreted.
+         */
+        BinaryOutputDetectionEnabled,
+        /** (bool) Specifies whether output which scrolls off the screen
+         * before it could be seen is skipped when there is no history.
+         */
+        FastForwardEnabled,
+        /** (bool) Specifies whether lines which were wrapped because they
+         * did not fit are rewrapped when the number of columns changes.
+         */
+        ReflowLines,
+        /** (int) Specifies how long, in seconds, the alternate screen used by
+         * full screen programs is kept in memory after the terminal has
+         * switched back to the primary screen.  0 keeps it indefinitely.
+         */
+        AlternateScreenReleaseDelay,
+        /** (int) Specifies how long, in milliseconds, the terminal display
+         * waits for more output before it is updated.
+         */
+        UpdateLatency,
+        /** (int) Specifies the interval, in milliseconds, between updates of
+         * the terminal display while the output rate exceeds the
+         * HighOutputRate property.
+         */
+        MaximumUpdateInterval,
+        /** (int) Specifies the output rate, in KiB per second, above which
+         * updates of the terminal display are throttled.
+         */
+        HighOutputRate,
+        /** (int) Specifies the output rate, in KiB per second, above which
+         * the terminal display enters flood mode, or 0 to never enter it.
+         */
+        FloodOutputRate,
+        /** (int) Specifies how many times per second the terminal display is
+         * updated at most while it is in flood mode.
+         */
+        FloodFrameRate,
+        /** (int) Specifies the longest time, in milliseconds, spent on
+         * processing output from the terminal program before other events
+         * are handled, or 0 to always process output as soon as it arrives.
+         */
+        OutputTimeSlice,
+        /** (int) Specifies the interval, in milliseconds, at which output
+         * is processed while none of the session's views are displayed, or
+         * 0 to process it like the output of other sessions.
+         */
+        BackgroundOutputInterval,
+        /** (int) Specifies the size, in KiB, of the buffer which output
+         * from the terminal program is read into.
+         */
+        ReadBufferSize,
+        /** (int) Specifies the amount of queued output, in KiB, at which
+         * reading from the terminal program is suspended until Konsole has
+         * caught up, or 0 to never suspend reading.
+         */
+        OutputHighWaterMark,
         /** (int) Specifies the pixels between the terminal lines.
          */
         LineSpacing,
@@ -243,6 +326,20 @@ public:
         TerminalColumns,
         /** (int) Specifies the preferred rows. */
         TerminalRows,
+        /** (QString) The directory in which the output of sessions using
+         * this profile is logged, one file per session.  The output is not
+         * logged if this is empty.
+         */
+        OutputLogDirectory,
+        /** (bool) Specifies whether escape sequences and control characters
+         * are removed from the logged output, see OutputLogDirectory.
+         */
+        OutputLogPlainText,
+        /** (int) The number of sessions with this profile which are started
+         * ahead of time while it is the default profile, so that a new tab
+         * can use a shell which is already running.  0 disables this.
+         */
+        SpareSessions,
         /** Index of profile in the File Menu
          * WARNING: this is currently an internal field, which is
          * expected to be zero on disk. Do not modify it manually.
@@ -253,7 +350,13 @@ public:
         /** (bool) If true, mouse wheel scroll with Ctrl key pressed
          * increases/decreases the terminal font size.
          */
-        MouseWheelZoomEnabled
+        MouseWheelZoomEnabled,
+        /** (bool) If true, the terminal display is drawn in a way which
+         * transfers fewer pixels when it is shown over a network, such as
+         * in a forwarded X11 or a remote desktop session.  See
+         * TerminalDisplay::setLowBandwidthRendering()
+         */
+        LowBandwidthRendering
     };
 
     /**
@@ -415,6 +518,26 @@ public:
         return property<int>(Profile::HistorySize);
     }
 
+    /** Convenience method for property<bool>(Profile::CompressHistory) */
+    bool compressHistory() const {
+        return property<bool>(Profile::CompressHistory);
+    }
+
+    /** Convenience method for property<bool>(Profile::ShareHistory) */
+    bool shareHistory() const {
+        return property<bool>(Profile::ShareHistory);
+    }
+
+    /** Convenience method for property<bool>(Profile::PersistentHistory) */
+    bool persistentHistory() const {
+        return property<bool>(Profile::PersistentHistory);
+    }
+
+    /** Convenience method for property<bool>(Profile::IndexHistory) */
+    bool indexHistory() const {
+        return property<bool>(Profile::IndexHistory);
+    }
+
     /** Convenience method for property<bool>(Profile::BidiRenderingEnabled) */
     bool bidiRenderingEnabled() const {
         return property<bool>(Profile::BidiRenderingEnabled);
@@ -446,6 +569,31 @@ public:
         return property<bool>(Profile::FlowControlEnabled);
     }
 
+    /** Convenience method for property<bool>(Profile::ZModemDetectionEnabled) */
+    bool zmodemDetectionEnabled() const {
+        return property<bool>(Profile::ZModemDetectionEnabled);
+    }
+
+    /** Convenience method for property<bool>(Profile::BinaryOutputDetectionEnabled) */
+    bool binaryOutputDetectionEnabled() const {
+        return property<bool>(Profile::BinaryOutputDetectionEnabled);
+    }
+
+    /** Convenience method for property<bool>(Profile::FastForwardEnabled) */
+    bool fastForwardEnabled() const {
+        return property<bool>(Profile::FastForwardEnabled);
+    }
+
+    /** Convenience method for property<bool>(Profile::ReflowLines) */
+    bool reflowLines() const {
+        return property<bool>(Profile::ReflowLines);
+    }
+
+    /** Convenience method for property<int>(Profile::AlternateScreenReleaseDelay) */
+    int alternateScreenReleaseDelay() const {
+        return property<int>(Profile::AlternateScreenReleaseDelay);
+    }
+
     /** Convenience method for property<bool>(Profile::UseCustomCursorColor) */
     bool useCustomCursorColor() const {
         return property<bool>(Profile::UseCustomCursorColor);
@@ -485,6 +633,11 @@ public:
         return property<bool>(Profile::BoldIntense);
     }
 
+    /** Convenience method for property<bool>(Profile::LowBandwidthRendering) */
+    bool lowBandwidthRendering() const {
+        return property<bool>(Profile::LowBandwidthRendering);
+    }
+
     /** Convenience method for property<bool>(Profile::StartInCurrentSessionDir) */
     bool startInCurrentSessionDir() const {
         return property<bool>(Profile::StartInCurrentSessionDir);
@@ -495,6 +648,21 @@ public:
         return property<int>(Profile::SilenceSeconds);
     }
 
+    /** Convenience method for property<QString>(Profile::OutputLogDirectory) */
+    QString outputLogDirectory() const {
+        return property<QString>(Profile::OutputLogDirectory);
+    }
+
+    /** Convenience method for property<bool>(Profile::OutputLogPlainText) */
+    bool outputLogPlainText() const {
+        return property<bool>(Profile::OutputLogPlainText);
+    }
+
+    /** Convenience method for property<int>(Profile::SpareSessions) */
+    int spareSessions() const {
+        return property<int>(Profile::SpareSessions);
+    }
+
     /** Convenience method for property<QString>(Profile::MenuIndex) */
     QString menuIndex() const {
         return property<QString>(Profile::MenuIndex);
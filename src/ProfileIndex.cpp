@@ -0,0 +1,177 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ProfileIndex.h"
+
+// Qt
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+// KDE
+#include <KConfig>
+#include <KConfigGroup>
+#include <KDebug>
+#include <KGlobal>
+#include <KLocale>
+#include <KSaveFile>
+
+using Konsole::ProfileIndex;
+
+static const quint32 INDEX_MAGIC = 0x4b504958; // "KPIX"
+// increase this whenever the layout of the cache changes
+static const quint32 INDEX_VERSION = 1;
+
+// the names in the profile files are translated, so the cache is only
+// valid for the language it was written in
+static QString indexLanguage()
+{
+    return KGlobal::locale()->language();
+}
+
+ProfileIndex::ProfileIndex(const QString& cacheFileName)
+    : _cacheFileName(cacheFileName)
+    , _cacheRead(false)
+{
+}
+
+void ProfileIndex::update(const QStringList& paths)
+{
+    if (!_cacheRead) {
+        readCache();
+        _cacheRead = true;
+    }
+
+    bool changed = (paths.count() != _entries.count());
+
+    QHash<QString, Entry> entries;
+    foreach(const QString& path, paths) {
+        const QFileInfo info(path);
+        Entry entry = _entries.value(path);
+
+        if (entry.path.isEmpty() ||
+                entry.modified != info.lastModified().toTime_t() ||
+                entry.size != info.size()) {
+            entry = readEntry(path);
+            changed = true;
+        }
+
+        entries.insert(path, entry);
+    }
+
+    _paths = paths;
+    _entries = entries;
+
+    if (changed)
+        writeCache();
+}
+
+QStringList ProfileIndex::paths() const
+{
+    return _paths;
+}
+
+ProfileIndex::Entry ProfileIndex::entry(const QString& path) const
+{
+    return _entries.value(path);
+}
+
+ProfileIndex::Entry ProfileIndex::readEntry(const QString& path)
+{
+    const QFileInfo info(path);
+
+    // only the General group is needed, this is still much less work
+    // than reading the whole profile
+    KConfig config(path, KConfig::NoGlobals);
+    const KConfigGroup general = config.group("General");
+
+    Entry entry;
+    entry.path = path;
+    entry.name = general.readEntry("Name", info.completeBaseName());
+    entry.icon = general.readEntry("Icon", QString());
+    entry.parent = general.readEntry("Parent", QString());
+    entry.modified = info.lastModified().toTime_t();
+    entry.size = info.size();
+
+    return entry;
+}
+
+void ProfileIndex::readCache()
+{
+    QFile file(_cacheFileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION)
+        return;
+
+    QString language;
+    quint32 count = 0;
+    stream >> language >> count;
+    if (language != indexLanguage())
+        return;
+
+    QHash<QString, Entry> entries;
+    for (quint32 i = 0; i < count; i++) {
+        Entry entry;
+        stream >> entry.path >> entry.name >> entry.icon >> entry.parent
+               >> entry.modified >> entry.size;
+
+        if (stream.status() != QDataStream::Ok) {
+            kWarning() << "Ignoring damaged profile index" << _cacheFileName;
+            return;
+        }
+
+        entries.insert(entry.path, entry);
+    }
+
+    _entries = entries;
+}
+
+void ProfileIndex::writeCache() const
+{
+    KSaveFile file(_cacheFileName);
+    if (!file.open()) {
+        kWarning() << "Unable to write the profile index" << _cacheFileName
+                   << ":" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    stream << INDEX_MAGIC << INDEX_VERSION << indexLanguage()
+           << quint32(_paths.count());
+    foreach(const QString& path, _paths) {
+        const Entry& entry = _entries[path];
+        stream << entry.path << entry.name << entry.icon << entry.parent
+               << entry.modified << entry.size;
+    }
+
+    if (!file.finalize())
+        kWarning() << "Unable to write the profile index" << _cacheFileName;
+}
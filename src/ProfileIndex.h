@@ -0,0 +1,94 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef PROFILEINDEX_H
+#define PROFILEINDEX_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * Provides the names and icons of profiles on disk without loading the
+ * profiles.
+ *
+ * The summaries of the profiles are kept in a binary cache file between
+ * runs.  update() only reads a profile file when it has been added or
+ * modified since its summary was cached, so listing profiles does
+ * not require parsing every profile file.  The summaries are read straight
+ * from the profile files, settings inherited from a parent profile are not
+ * resolved.
+ */
+class KONSOLEPRIVATE_EXPORT ProfileIndex
+{
+public:
+    /** A summary of the settings of a profile file */
+    struct Entry {
+        QString path;
+        QString name;
+        QString icon;
+        QString parent;
+        // the modification time and size of the file when it was read
+        uint modified;
+        qint64 size;
+    };
+
+    /**
+     * Constructs an index which caches the profile summaries in
+     * @p cacheFileName.  The cache is read when update() is first called.
+     */
+    explicit ProfileIndex(const QString& cacheFileName);
+
+    /**
+     * Updates the index to contain the profile files in @p paths.  Profile
+     * files which are new or have changed on disk are read, and the cache
+     * file is rewritten if anything changed.
+     */
+    void update(const QStringList& paths);
+
+    /** Returns the paths of the profiles in the index, see update() */
+    QStringList paths() const;
+
+    /**
+     * Returns the summary of the profile at @p path, or an entry with an
+     * empty path if the profile is not in the index.
+     */
+    Entry entry(const QString& path) const;
+
+private:
+    static Entry readEntry(const QString& path);
+
+    void readCache();
+    void writeCache() const;
+
+    QString _cacheFileName;
+    bool _cacheRead;
+
+    QStringList _paths;
+    QHash<QString, Entry> _entries;
+};
+}
+
+#endif // PROFILEINDEX_H
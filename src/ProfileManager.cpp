@@ -36,8 +36,10 @@
 #include <KStandardDirs>
 
 // Konsole
+#include "ProfileIndex.h"
 #include "ProfileReader.h"
 #include "ProfileWriter.h"
+#include "StartupTrace.h"
 
 using namespace Konsole;
 
@@ -69,6 +71,7 @@ static void sortByNameProfileList(QList<Profile::Ptr>& list)
 ProfileManager::ProfileManager()
     : _loadedAllProfiles(false)
     , _loadedFavorites(false)
+    , _index(new ProfileIndex(KStandardDirs::locateLocal("cache", "konsole/profiles.index")))
 {
     //load fallback profile
     _fallbackProfile = Profile::Ptr(new FallbackProfile);
@@ -104,10 +107,13 @@ ProfileManager::ProfileManager()
     // them - this doesn't load the shortcuts themselves,
     // that is done on-demand.
     loadShortcuts();
+
+    StartupTrace::mark("ProfileManager constructed");
 }
 
 ProfileManager::~ProfileManager()
 {
+    delete _index;
 }
 
 K_GLOBAL_STATIC(ProfileManager , theProfileManager)
@@ -202,11 +208,21 @@ QStringList ProfileManager::availableProfilePaths() const
 QStringList ProfileManager::availableProfileNames() const
 {
     QStringList names;
+    QSet<QString> loadedPaths;
 
-    foreach(Profile::Ptr profile, ProfileManager::instance()->allProfiles()) {
+    // the names of loaded profiles may have been changed since they were
+    // saved, so they take precedence over the index
+    foreach(const Profile::Ptr& profile, _profiles) {
         if (!profile->isHidden()) {
             names.push_back(profile->name());
         }
+        loadedPaths.insert(profile->path());
+    }
+
+    updateIndex();
+    foreach(const QString& path, _index->paths()) {
+        if (!loadedPaths.contains(path))
+            names.push_back(_index->entry(path).name);
     }
 
     qStableSort(names.begin(), names.end(), stringLessThan);
@@ -214,6 +230,30 @@ QStringList ProfileManager::availableProfileNames() const
     return names;
 }
 
+Profile::Ptr ProfileManager::findByName(const QString& name)
+{
+    QSet<QString> loadedPaths;
+
+    foreach(const Profile::Ptr& profile, _profiles) {
+        if (!profile->isHidden() && profile->name() == name)
+            return profile;
+        loadedPaths.insert(profile->path());
+    }
+
+    updateIndex();
+    foreach(const QString& path, _index->paths()) {
+        if (!loadedPaths.contains(path) && _index->entry(path).name == name)
+            return loadProfile(path);
+    }
+
+    return Profile::Ptr();
+}
+
+void ProfileManager::updateIndex() const
+{
+    _index->update(availableProfilePaths());
+}
+
 void ProfileManager::loadAllProfiles()
 {
     if (_loadedAllProfiles)
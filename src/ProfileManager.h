@@ -36,6 +36,8 @@
 
 namespace Konsole
 {
+class ProfileIndex;
+
 /**
  * Manages profiles which specify various settings for terminal sessions
  * and their displays.
@@ -114,9 +116,19 @@ public:
 
     /**
      * Returns a list of names of all available profiles
+     *
+     * The names of profiles which have not been loaded yet are taken from
+     * the profile index, so this does not load any profiles.
      */
     QStringList availableProfileNames() const;
 
+    /**
+     * Finds and loads the available profile named @p name and returns a
+     * pointer to it, or a null pointer if there is no such profile.
+     * Only the profile which is found is loaded.
+     */
+    Profile::Ptr findByName(const QString& name);
+
     /**
      * Registers a new type of session.
      * The favorite status of the session ( as returned by isFavorite() ) is set to false by default.
@@ -269,6 +281,9 @@ private:
     // otherwise
     QString saveProfile(Profile::Ptr profile);
 
+    // brings the profile index up to date with the profiles on disk
+    void updateIndex() const;
+
     QSet<Profile::Ptr> _profiles;  // list of all loaded profiles
     QSet<Profile::Ptr> _favorites; // list of favorite profiles
 
@@ -278,6 +293,9 @@ private:
     bool _loadedAllProfiles; // set to true after loadAllProfiles has been called
     bool _loadedFavorites; // set to true after loadFavorites has been called
 
+    // names of the available profiles, which are known without loading them
+    ProfileIndex* _index;
+
     struct ShortcutData {
         Profile::Ptr profileKey;
         QString profilePath;
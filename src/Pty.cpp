@@ -24,6 +24,8 @@
 // System
 #include <termios.h>
 #include <signal.h>
+#include <string.h>
+#include <unistd.h>
 
 // Qt
 #include <QtCore/QStringList>
@@ -55,6 +57,12 @@ void Pty::init()
     _xonXoff       = true;
     _utf8          = true;
 
+    setReadBufferSize(64 * 1024);
+
+    _pendingDataPos   = 0;
+    _pendingDataSent  = 0;
+    _pendingDataTotal = 0;
+
     setEraseChar(_eraseChar);
     setFlowControlEnabled(_xonXoff);
     setUtf8Mode(_utf8);
@@ -65,27 +73,156 @@ void Pty::init()
     setPtyChannels(KPtyProcess::AllChannels);
 
     connect(pty(), SIGNAL(readyRead()) , this , SLOT(dataReceived()));
+    connect(pty(), SIGNAL(bytesWritten(qint64)) , this , SLOT(sendPendingData()));
 }
 
 Pty::~Pty()
 {
 }
 
+// data is written to the pty device in chunks of this size, and only
+// while the device holds less than this amount which is yet to be written
+static const int SEND_CHUNK_SIZE = 16 * 1024;
+
 void Pty::sendData(const char* data, int length)
 {
     if (length == 0)
         return;
 
-    if (!pty()->write(data, length)) {
-        kWarning() << "Could not send input data to terminal process.";
+    if (_pendingData.isEmpty() && length <= SEND_CHUNK_SIZE) {
+        if (!writeData(data, length)) {
+            kWarning() << "Could not send input data to terminal process.";
+        }
         return;
     }
+
+    if (_pendingData.isEmpty()) {
+        _pendingDataSent = 0;
+        _pendingDataTotal = 0;
+    }
+    _pendingData.append(data, length);
+    _pendingDataTotal += length;
+
+    sendPendingData();
+}
+
+void Pty::sendPendingData()
+{
+    if (_pendingData.isEmpty())
+        return;
+
+    while (_pendingDataPos < _pendingData.size() && pty()->bytesToWrite() < SEND_CHUNK_SIZE) {
+        const int length = qMin(SEND_CHUNK_SIZE, _pendingData.size() - _pendingDataPos);
+        if (!writeData(_pendingData.constData() + _pendingDataPos, length)) {
+            kWarning() << "Could not send input data to terminal process.";
+            cancelSendData();
+            return;
+        }
+        _pendingDataPos += length;
+        _pendingDataSent += length;
+    }
+
+    if (_pendingDataPos == _pendingData.size()) {
+        _pendingData.clear();
+        _pendingDataPos = 0;
+    } else if (_pendingDataPos >= SEND_CHUNK_SIZE * 64) {
+        // release the memory of the data which has been written
+        _pendingData.remove(0, _pendingDataPos);
+        _pendingDataPos = 0;
+    }
+
+    emit sendDataProgress(_pendingDataSent, _pendingDataTotal);
+}
+
+bool Pty::writeData(const char* data, int length)
+{
+    if (!pty()->write(data, length))
+        return false;
+
+    if (resumesOutput(data, length))
+        emit outputResumeSent();
+
+    return true;
+}
+
+// returns true if the control character 'c' is enabled and in 'data'
+static bool containsControlChar(const char* data, int length, cc_t c)
+{
+    return c != _POSIX_VDISABLE && memchr(data, c, length);
+}
+
+bool Pty::resumesOutput(const char* data, int length) const
+{
+    if (length <= 0 || pty()->masterFd() < 0)
+        return false;
+
+    struct ::termios ttmode;
+    if (!pty()->tcGetAttr(&ttmode))
+        return false;
+
+    // the same rules as the terminal's line discipline: without IXON the
+    // output is not stopped, with IXANY any input restarts it, otherwise
+    // the start character does, and so do the characters which send
+    // signals if those are enabled
+    if (!(ttmode.c_iflag & IXON) || (ttmode.c_iflag & IXANY))
+        return true;
+    if (containsControlChar(data, length, ttmode.c_cc[VSTART]))
+        return true;
+
+    return (ttmode.c_lflag & ISIG) &&
+           (containsControlChar(data, length, ttmode.c_cc[VINTR]) ||
+            containsControlChar(data, length, ttmode.c_cc[VQUIT]) ||
+            containsControlChar(data, length, ttmode.c_cc[VSUSP]));
+}
+
+void Pty::cancelSendData()
+{
+    if (_pendingData.isEmpty())
+        return;
+
+    _pendingData.clear();
+    _pendingDataPos = 0;
+    _pendingDataTotal = _pendingDataSent;
+
+    emit sendDataProgress(_pendingDataSent, _pendingDataTotal);
+}
+
+void Pty::setReadBufferSize(int size)
+{
+    _readBuffer.resize(qMax(size, 1024));
+}
+
+int Pty::readBufferSize() const
+{
+    return _readBuffer.size();
+}
+
+void Pty::setReadSuspended(bool suspended)
+{
+    pty()->setSuspended(suspended);
+}
+
+bool Pty::isReadSuspended() const
+{
+    return pty()->isSuspended();
+}
+
+qint64 Pty::pendingDataSize() const
+{
+    return _pendingData.size() - _pendingDataPos + pty()->bytesToWrite();
 }
 
 void Pty::dataReceived()
 {
-    QByteArray data = pty()->readAll();
-    emit receivedData(data.constData(), data.count());
+    // read into the same buffer each time instead of allocating a new
+    // one with readAll()
+    while (pty()->bytesAvailable() > 0) {
+        const qint64 length = pty()->read(_readBuffer.data(), _readBuffer.size());
+        if (length <= 0)
+            break;
+
+        emit receivedData(_readBuffer.constData(), length);
+    }
 }
 
 void Pty::setWindowSize(int columns, int lines)
@@ -24,6 +24,7 @@
 #define PTY_H
 
 // Qt
+#include <QtCore/QByteArray>
 #include <QtCore/QSize>
 
 // KDE
@@ -141,6 +142,32 @@ public:
      */
     void closePty();
 
+    /**
+     * Sets the size of the buffer which incoming data is read into.  The
+     * buffer is reused for every read, and each receivedData() signal
+     * carries at most @p size bytes.
+     */
+    void setReadBufferSize(int size);
+
+    /** Returns the size of the read buffer.  See setReadBufferSize() */
+    int readBufferSize() const;
+
+    /**
+     * Sets whether reading from the pty is suspended.  While it is, no
+     * receivedData() signals are emitted and the terminal process is
+     * blocked by the kernel once the pty's buffer is full.
+     */
+    void setReadSuspended(bool suspended);
+
+    /** Returns true if reading from the pty is suspended. */
+    bool isReadSuspended() const;
+
+    /**
+     * Returns the number of bytes passed to sendData() which have not been
+     * written to the terminal process yet.
+     */
+    qint64 pendingDataSize() const;
+
 public slots:
     /**
      * Put the pty into UTF-8 mode on systems which support it.
@@ -151,11 +178,22 @@ public slots:
      * Sends data to the process currently controlling the
      * teletype ( whose id is returned by foregroundProcessGroup() )
      *
+     * Large amounts of data are queued and written in chunks as the pty
+     * becomes writable, reporting the progress with sendDataProgress().
+     * Data sent while a queue exists is appended to it, so the order of
+     * the data is kept.
+     *
      * @param buffer Pointer to the data to send.
      * @param length Length of @p buffer.
      */
     void sendData(const char* buffer, int length);
 
+    /**
+     * Discards the data queued by sendData() which has not been written
+     * to the pty yet.
+     */
+    void cancelSendData();
+
 signals:
     /**
      * Emitted when a new block of data is received from
@@ -166,16 +204,44 @@ signals:
      */
     void receivedData(const char* buffer, int length);
 
+    /**
+     * Emitted while queued data is written to the pty.
+     * See sendData()
+     *
+     * @param sent The number of bytes written so far
+     * @param total The number of bytes queued, including those
+     * written so far.  Once @p sent equals @p total, no data is
+     * left in the queue.
+     */
+    void sendDataProgress(qint64 sent, qint64 total);
+
+    /**
+     * Emitted when data which makes the terminal resume the output stopped
+     * with Xoff is written to the pty, no matter whether it was typed,
+     * pasted or sent by other means.  That is the start character (Ctrl+Q
+     * by default) or a character which sends a signal, such as Ctrl+C, or
+     * any data if the terminal's IXANY flag is set.
+     */
+    void outputResumeSent();
+
 protected:
     void setupChildProcess();
 
 private slots:
     // called when data is received from the terminal process
     void dataReceived();
+    // writes the next chunks of the queued input
+    void sendPendingData();
 
 private:
     void init();
 
+    // writes 'data' to the pty, returns false if that failed
+    bool writeData(const char* data, int length);
+    // returns true if writing 'data' resumes the output of the terminal,
+    // according to its current attributes
+    bool resumesOutput(const char* data, int length) const;
+
     // takes a list of key=value pairs and adds them
     // to the environment for the process
     void addEnvironmentVariables(const QStringList& environment);
@@ -185,6 +251,15 @@ private:
     char _eraseChar;
     bool _xonXoff;
     bool _utf8;
+
+    // persistent buffer which incoming data is read into
+    QByteArray _readBuffer;
+
+    // data queued by sendData(), starting at _pendingDataPos
+    QByteArray _pendingData;
+    int _pendingDataPos;
+    qint64 _pendingDataSent;
+    qint64 _pendingDataTotal;
 };
 }
 
@@ -23,14 +23,20 @@
 // Own
 #include "Screen.h"
 
+// Standard
+#include <algorithm>
+#include <typeinfo>
+
 // Qt
 #include <QtCore/QTextStream>
+#include <QtCore/QVarLengthArray>
 
 // Konsole
 #include "konsole_wcwidth.h"
 #include "TerminalCharacterDecoder.h"
 #include "History.h"
 #include "ExtendedCharTable.h"
+#include "ScreenSnapshot.h"
 
 using namespace Konsole;
 
@@ -61,36 +67,56 @@ Screen::Screen(int lines, int columns):
     _lines(lines),
     _columns(columns),
     _screenLines(new ImageLine[_lines + 1]),
+    _screenLinesOffset(0),
     _scrolledLines(0),
     _droppedLines(0),
+    _discardedLines(0),
+    _generation(0),
+    _imageGeneration(0),
+    _screenGeneration(0),
+    _lineGenerations(_lines + 1),
     _history(new HistoryScrollNone()),
+    _historyConversion(0),
+    _historyIndex(0),
+    _historyExtendedCharsKnown(true),
+    _historyRgbColors(CharacterColor::MAX_RGB_INDEX),
+    _historyRgbColorsKnown(true),
     _cuX(0),
     _cuY(0),
     _currentRendition(DEFAULT_RENDITION),
     _topMargin(0),
     _bottomMargin(0),
+    _writeModes(0),
     _selBegin(0),
     _selTopLeft(0),
     _selBottomRight(0),
     _blockSelectionMode(false),
-    _effectiveForeground(CharacterColor()),
-    _effectiveBackground(CharacterColor()),
-    _effectiveRendition(DEFAULT_RENDITION),
-    _lastPos(-1)
+    _selectionOnScreen(false),
+    _lastPos(-1),
+    _highSurrogate(0),
+    _reflowLines(false)
 {
     _lineProperties.resize(_lines + 1);
     for (int i = 0; i < _lines + 1; i++)
         _lineProperties[i] = LINE_DEFAULT;
+    _lineFill.fill(DefaultChar, _lines + 1);
 
     initTabStops();
     clearSelection();
     reset();
+
+    ExtendedCharTable::instance.addScreen(this);
+    addRgbColorScreen(this);
 }
 
 Screen::~Screen()
 {
+    ExtendedCharTable::instance.removeScreen(this);
+    removeRgbColorScreen(this);
+
     delete[] _screenLines;
     delete _history;
+    delete _historyIndex;
 }
 
 void Screen::cursorUp(int n)
@@ -193,29 +219,31 @@ void Screen::deleteChars(int n)
         n = 1;
 
     // if cursor is beyond the end of the line there is nothing to do
-    if (_cuX >= _screenLines[_cuY].count())
+    if (_cuX >= _screenLines[lineIndex(_cuY)].count())
         return;
 
-    if (_cuX + n > _screenLines[_cuY].count())
-        n = _screenLines[_cuY].count() - _cuX;
+    if (_cuX + n > _screenLines[lineIndex(_cuY)].count())
+        n = _screenLines[lineIndex(_cuY)].count() - _cuX;
 
     Q_ASSERT(n >= 0);
-    Q_ASSERT(_cuX + n <= _screenLines[_cuY].count());
+    Q_ASSERT(_cuX + n <= _screenLines[lineIndex(_cuY)].count());
 
-    _screenLines[_cuY].remove(_cuX, n);
+    _screenLines[lineIndex(_cuY)].remove(_cuX, n);
+    markLineDirty(_cuY);
 }
 
 void Screen::insertChars(int n)
 {
     if (n == 0) n = 1; // Default
 
-    if (_screenLines[_cuY].size() < _cuX)
-        _screenLines[_cuY].resize(_cuX);
+    extendLine(_cuY, _cuX);
 
-    _screenLines[_cuY].insert(_cuX, n, Character(' '));
+    _screenLines[lineIndex(_cuY)].insert(_cuX, n, Character(' '));
 
-    if (_screenLines[_cuY].count() > _columns)
-        _screenLines[_cuY].resize(_columns);
+    if (_screenLines[lineIndex(_cuY)].count() > _columns)
+        _screenLines[lineIndex(_cuY)].resize(_columns);
+
+    markLineDirty(_cuY);
 }
 
 void Screen::deleteLines(int n)
@@ -232,7 +260,11 @@ void Screen::insertLines(int n)
 
 void Screen::setMode(int m)
 {
+    if (!_currentModes[m])
+        markModeChanged(m);
+
     _currentModes[m] = true;
+    updateWriteModes();
     switch (m) {
     case MODE_Origin :
         _cuX = 0;
@@ -243,7 +275,11 @@ void Screen::setMode(int m)
 
 void Screen::resetMode(int m)
 {
+    if (_currentModes[m])
+        markModeChanged(m);
+
     _currentModes[m] = false;
+    updateWriteModes();
     switch (m) {
     case MODE_Origin :
         _cuX = 0;
@@ -259,7 +295,11 @@ void Screen::saveMode(int m)
 
 void Screen::restoreMode(int m)
 {
+    if (_currentModes[m] != _savedModes[m])
+        markModeChanged(m);
+
     _currentModes[m] = _savedModes[m];
+    updateWriteModes();
 }
 
 bool Screen::getMode(int m) const
@@ -290,31 +330,66 @@ void Screen::resizeImage(int new_lines, int new_columns)
 {
     if ((new_lines == _lines) && (new_columns == _columns)) return;
 
+    if (new_columns != _columns) {
+        // lines which were cleared with a non-default character are filled
+        // to the old width, the new columns are left blank
+        for (int y = 0; y < _lines; y++) {
+            if (_lineFill[lineIndex(y)] != DefaultChar) {
+                extendLine(y, _columns);
+                _lineFill[lineIndex(y)] = DefaultChar;
+            }
+        }
+
+        if (_reflowLines)
+            rewrapLines(new_columns);
+    }
+
     if (_cuY > new_lines - 1) {
         // attempt to preserve focus and _lines
         _bottomMargin = _lines - 1; //FIXME: margin lost
-        for (int i = 0; i < _cuY - (new_lines - 1); i++) {
-            addHistLine();
-            scrollUp(0, 1);
-        }
+        scrollUpIntoHistory(_cuY - (new_lines - 1));
     }
 
-    // create new screen _lines and copy from old to new
+    // the line arrays only need to be rebuilt if the number of lines
+    // changes, lines are not truncated when the number of columns does
+    if (new_lines != _lines) {
+        // bring the ring of screen lines back into order, so that the
+        // first screen line is at the start of the arrays again
+        if (_screenLinesOffset != 0) {
+            std::rotate(_screenLines, _screenLines + _screenLinesOffset, _screenLines + _lines);
+            std::rotate(_lineProperties.data(), _lineProperties.data() + _screenLinesOffset,
+                        _lineProperties.data() + _lines);
+            std::rotate(_lineGenerations.data(), _lineGenerations.data() + _screenLinesOffset,
+                        _lineGenerations.data() + _lines);
+            std::rotate(_lineFill.data(), _lineFill.data() + _screenLinesOffset,
+                        _lineFill.data() + _lines);
+            _screenLinesOffset = 0;
+        }
 
-    ImageLine* newScreenLines = new ImageLine[new_lines + 1];
-    for (int i = 0; i < qMin(_lines, new_lines + 1) ; i++)
-        newScreenLines[i] = _screenLines[i];
-    for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
-        newScreenLines[i].resize(new_columns);
+        // create new screen _lines and copy from old to new
 
-    _lineProperties.resize(new_lines + 1);
-    for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
-        _lineProperties[i] = LINE_DEFAULT;
+        ImageLine* newScreenLines = new ImageLine[new_lines + 1];
+        for (int i = 0; i < qMin(_lines, new_lines + 1) ; i++)
+            newScreenLines[i] = _screenLines[i];
+        for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
+            newScreenLines[i].resize(new_columns);
 
-    clearSelection();
+        _lineProperties.resize(new_lines + 1);
+        for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
+            _lineProperties[i] = LINE_DEFAULT;
 
-    delete[] _screenLines;
-    _screenLines = newScreenLines;
+        _lineGenerations.resize(new_lines + 1);
+
+        _lineFill.resize(new_lines + 1);
+        for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
+            _lineFill[i] = DefaultChar;
+
+        delete[] _screenLines;
+        _screenLines = newScreenLines;
+    }
+
+    markImageDirty();
+    clearSelection();
 
     _lines = new_lines;
     _columns = new_columns;
@@ -328,6 +403,121 @@ void Screen::resizeImage(int new_lines, int new_columns)
     clearSelection();
 }
 
+void Screen::setReflowLines(bool enable)
+{
+    _reflowLines = enable;
+}
+
+bool Screen::reflowLines() const
+{
+    return _reflowLines;
+}
+
+void Screen::rewrapLines(int newColumns)
+{
+    QVector<ImageLine> newLines;
+    QVector<LineProperty> newProperties;
+    int cursorLine = -1;
+    int cursorColumn = 0;
+
+    int y = 0;
+    while (y < _lines) {
+        // join the lines which make up one logical line
+        ImageLine logicalLine;
+        int cursorOffset = -1;
+        LineProperty properties = LINE_DEFAULT;
+        bool wrapped = false;
+        do {
+            const ImageLine& line = _screenLines[lineIndex(y)];
+            properties = _lineProperties[lineIndex(y)];
+            wrapped = properties & LINE_WRAPPED;
+
+            if (y == _cuY)
+                cursorOffset = logicalLine.count() + _cuX;
+
+            if (wrapped && line.count() > _columns)
+                logicalLine += line.mid(0, _columns);
+            else
+                logicalLine += line;
+
+            y++;
+        } while (wrapped && y < _lines);
+
+        // blank characters at the end are not needed, the screen is
+        // filled with them where lines are shorter than the screen
+        int length = logicalLine.count();
+        while (length > 0 && length > cursorOffset &&
+                logicalLine[length - 1] == Screen::DefaultChar)
+            length--;
+
+        // split the logical line again at the new width
+        int start = 0;
+        do {
+            int end = qMin(start + newColumns, length);
+
+            // do not separate double width characters from their second half
+            if (end < length && end - start > 1 && logicalLine[end].character == 0)
+                end--;
+
+            if (cursorOffset >= start && (cursorOffset < end || end == length)) {
+                cursorLine = newLines.count();
+                cursorColumn = qMin(cursorOffset - start, newColumns - 1);
+                cursorOffset = -1;
+            }
+
+            newLines << logicalLine.mid(start, end - start);
+            newProperties << ((end < length) ? LineProperty(properties | LINE_WRAPPED)
+                                             : LineProperty(properties & ~LINE_WRAPPED));
+            start = end;
+        } while (start < length);
+    }
+
+    // drop empty lines below the cursor first when the lines no longer
+    // fit, then move lines from the top of the screen into the history
+    while (newLines.count() > _lines && newLines.count() - 1 > cursorLine &&
+            newLines.last().isEmpty()) {
+        newLines.pop_back();
+        newProperties.pop_back();
+    }
+
+    const int excessLines = qMax(0, newLines.count() - _lines);
+    for (int i = 0; i < excessLines; i++) {
+        if (hasScroll()) {
+            const int oldHistLines = _history->getLines();
+
+            _history->addCellsVector(newLines[i]);
+            _history->addLine(newProperties[i] & LINE_WRAPPED);
+            indexHistoryLine(newLines[i], newProperties[i] & LINE_WRAPPED);
+            addHistoryExtendedChars(newLines[i]);
+            addHistoryRgbColors(newLines[i]);
+
+            if (_history->getLines() == oldHistLines) {
+                _droppedLines++;
+                _discardedLines++;
+            }
+        }
+    }
+    _scrolledLines -= excessLines;
+
+    for (int i = 0; i < _lines; i++) {
+        const int line = i + excessLines;
+        if (line < newLines.count()) {
+            _screenLines[i] = newLines[line];
+            _lineProperties[i] = newProperties[line];
+        } else {
+            _screenLines[i].clear();
+            _lineProperties[i] = LINE_DEFAULT;
+        }
+    }
+    _screenLinesOffset = 0;
+
+    if (cursorLine != -1) {
+        _cuY = qMax(0, cursorLine - excessLines);
+        _cuX = cursorColumn;
+    }
+    _lastPos = -1;
+}
+
 void Screen::setDefaultMargins()
 {
     _topMargin = 0;
@@ -379,40 +569,33 @@ void Screen::reverseRendition(Character& p) const
 
 void Screen::updateEffectiveRendition()
 {
-    _effectiveRendition = _currentRendition;
+    _effectiveCharacter.rendition = _currentRendition;
     if (_currentRendition & RE_REVERSE) {
-        _effectiveForeground = _currentBackground;
-        _effectiveBackground = _currentForeground;
+        _effectiveCharacter.foregroundColor = _currentBackground;
+        _effectiveCharacter.backgroundColor = _currentForeground;
     } else {
-        _effectiveForeground = _currentForeground;
-        _effectiveBackground = _currentBackground;
+        _effectiveCharacter.foregroundColor = _currentForeground;
+        _effectiveCharacter.backgroundColor = _currentBackground;
     }
 
     if (_currentRendition & RE_BOLD)
-        _effectiveForeground.setIntensive();
+        _effectiveCharacter.foregroundColor.setIntensive();
 }
 
 void Screen::copyFromHistory(Character* dest, int startLine, int count) const
 {
     Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _history->getLines());
 
+    HistoryLines lines;
+    _history->readLines(startLine, count, lines);
+
     for (int line = startLine; line < startLine + count; line++) {
-        const int length = qMin(_columns, _history->getLineLen(line));
+        const int length = qMin(_columns, lines.lineLength(line));
         const int destLineOffset  = (line - startLine) * _columns;
 
-        _history->getCells(line, 0, length, dest + destLineOffset);
+        memcpy(dest + destLineOffset, lines.cells(line), length * sizeof(Character));
 
-        for (int column = length; column < _columns; column++)
-            dest[destLineOffset + column] = Screen::DefaultChar;
-
-        // invert selected text
-        if (_selBegin != -1) {
-            for (int column = 0; column < _columns; column++) {
-                if (isSelected(column, line)) {
-                    reverseRendition(dest[destLineOffset + column]);
-                }
-            }
-        }
+        fillCharacters(dest + destLineOffset + length, _columns - length, Screen::DefaultChar);
     }
 }
 
@@ -421,19 +604,13 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
     Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _lines);
 
     for (int line = startLine; line < (startLine + count) ; line++) {
-        int srcLineStartIndex  = line * _columns;
-        int destLineStartIndex = (line - startLine) * _columns;
-
-        for (int column = 0; column < _columns; column++) {
-            int srcIndex = srcLineStartIndex + column;
-            int destIndex = destLineStartIndex + column;
-
-            dest[destIndex] = _screenLines[srcIndex / _columns].value(srcIndex % _columns, Screen::DefaultChar);
+        const ImageLine& imageLine = _screenLines[lineIndex(line)];
+        const int length = qMin(_columns, imageLine.count());
+        Character* destLine = dest + (line - startLine) * _columns;
 
-            // invert selected text
-            if (_selBegin != -1 && isSelected(column, line + _history->getLines()))
-                reverseRendition(dest[destIndex]);
-        }
+        // the cells past the end of the line are blank
+        memcpy(destLine, imageLine.constData(), length * sizeof(Character));
+        fillCharacters(destLine + length, _columns - length, _lineFill[lineIndex(line)]);
     }
 }
 
@@ -467,12 +644,19 @@ void Screen::getImage(Character* dest, int size, int startLine, int endLine) con
     }
 
     // mark the character at the current cursor position
-    int cursorIndex = loc(_cuX, _cuY + linesInHistoryBuffer);
-    if (getMode(MODE_Cursor) && cursorIndex < _columns * mergedLines)
-        dest[cursorIndex].rendition |= RE_CURSOR;
+    const int cursorLine = _history->getLines() + _cuY - startLine;
+    if (getMode(MODE_Cursor) && cursorLine >= 0 && cursorLine < mergedLines)
+        dest[loc(_cuX, cursorLine)].rendition |= RE_CURSOR;
 }
 
 QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) const
+{
+    QVector<LineProperty> result(endLine - startLine + 1);
+    getLineProperties(result.data(), startLine, endLine);
+    return result;
+}
+
+void Screen::getLineProperties(LineProperty* dest, int startLine, int endLine) const
 {
     Q_ASSERT(startLine >= 0);
     Q_ASSERT(endLine >= startLine && endLine < _history->getLines() + _lines);
@@ -481,26 +665,20 @@ QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) con
     const int linesInHistory = qBound(0, _history->getLines() - startLine, mergedLines);
     const int linesInScreen = mergedLines - linesInHistory;
 
-    QVector<LineProperty> result(mergedLines);
-    int index = 0;
-
-    // copy properties for _lines in history
-    for (int line = startLine; line < startLine + linesInHistory; line++) {
-        //TODO Support for line properties other than wrapped _lines
-        if (_history->isWrappedLine(line)) {
-            result[index] = (LineProperty)(result[index] | LINE_WRAPPED);
-        }
-        index++;
+    // copy properties for _lines in history, which are asked for at once
+    //TODO Support for line properties other than wrapped _lines
+    if (linesInHistory > 0) {
+        QVarLengthArray<bool, 128> wrapped(linesInHistory);
+        _history->readWrappedLines(startLine, linesInHistory, wrapped.data());
+        for (int i = 0; i < linesInHistory; i++)
+            dest[i] = wrapped[i] ? LINE_WRAPPED : LINE_DEFAULT;
     }
 
     // copy properties for _lines in screen buffer
     const int firstScreenLine = startLine + linesInHistory - _history->getLines();
-    for (int line = firstScreenLine; line < firstScreenLine + linesInScreen; line++) {
-        result[index] = _lineProperties[line];
-        index++;
-    }
-
-    return result;
+    LineProperty* screenDest = dest + linesInHistory;
+    for (int line = 0; line < linesInScreen; line++)
+        screenDest[line] = _lineProperties[lineIndex(firstScreenLine + line)];
 }
 
 void Screen::reset(bool clearScreen)
@@ -539,13 +717,15 @@ void Screen::backspace()
     _cuX = qMin(_columns - 1, _cuX); // nowrap!
     _cuX = qMax(0, _cuX - 1);
 
-    if (_screenLines[_cuY].size() < _cuX + 1)
-        _screenLines[_cuY].resize(_cuX + 1);
+    extendLine(_cuY, _cuX + 1);
 
     if (BS_CLEARS) {
-        _screenLines[_cuY][_cuX].character = ' ';
-        _screenLines[_cuY][_cuX].rendition = _screenLines[_cuY][_cuX].rendition & ~RE_EXTENDED_CHAR;
+        _screenLines[lineIndex(_cuY)][_cuX].character = ' ';
+        _screenLines[lineIndex(_cuY)][_cuX].plane = 0;
+        _screenLines[lineIndex(_cuY)][_cuX].rendition = _screenLines[lineIndex(_cuY)][_cuX].rendition & ~RE_EXTENDED_CHAR;
     }
+
+    markLineDirty(_cuY);
 }
 
 void Screen::tab(int n)
@@ -608,33 +788,53 @@ void Screen::newLine()
 
 void Screen::checkSelection(int from, int to)
 {
-    if (_selBegin == -1)
+    const qint64 scr_TL = absolutePosition(0, _history->getLines());
+
+    // the screen only moves on from the selection once it has been
+    // scrolled into the history, no write can reach it after that
+    if (_selBottomRight < scr_TL) {
+        _selectionOnScreen = false;
         return;
-    const int scr_TL = loc(0, _history->getLines());
+    }
+
     //Clear entire selection if it overlaps region [from, to]
     if ((_selBottomRight >= (from + scr_TL)) && (_selTopLeft <= (to + scr_TL)))
         clearSelection();
 }
 
-void Screen::displayCharacter(unsigned short c)
+template <bool InsertMode, bool WrapMode>
+void Screen::writeCharacter(unsigned short c)
 {
     // Note that VT100 does wrapping BEFORE putting the character.
     // This has impact on the assumption of valid cursor positions.
     // We indicate the fact that a newline has to be triggered by
     // putting the cursor one right to the last column of the screen.
 
-    int w = konsole_wcwidth(c);
+    // characters outside of the basic multilingual plane arrive as
+    // surrogate pairs, the high surrogate waits for the low one
+    uint codePoint = c;
+    if ((c & 0xfc00) == 0xd800) {
+        _highSurrogate = c;
+        return;
+    } else if ((c & 0xfc00) == 0xdc00) {
+        if (_highSurrogate == 0)
+            return;
+        codePoint = QChar::surrogateToUcs4(_highSurrogate, c);
+    }
+    _highSurrogate = 0;
+
+    int w = konsole_wcwidth_ucs4(codePoint);
     if (w < 0)
         return;
     else if (w == 0) {
-        if (QChar(c).category() != QChar::Mark_NonSpacing)
+        if (QChar::category(codePoint) != QChar::Mark_NonSpacing)
             return;
         int charToCombineWithX = -1;
         int charToCombineWithY = -1;
         if (_cuX == 0) {
             // We are at the beginning of a line, check
             // if previous line has a character at the end we can combine with
-            if (_cuY > 0 && _columns == _screenLines[_cuY - 1].size()) {
+            if (_cuY > 0 && _columns == _screenLines[lineIndex(_cuY - 1)].size()) {
                 charToCombineWithX = _columns - 1;
                 charToCombineWithY = _cuY - 1;
             } else {
@@ -649,35 +849,49 @@ void Screen::displayCharacter(unsigned short c)
         }
 
         // Prevent "cat"ing binary files from causing crashes.
-        if (charToCombineWithX >= _screenLines[charToCombineWithY].size()) {
+        if (charToCombineWithX >= _screenLines[lineIndex(charToCombineWithY)].size()) {
             return;
         }
 
-        Character& currentChar = _screenLines[charToCombineWithY][charToCombineWithX];
+        markLineDirty(charToCombineWithY);
+
+        // the mark is added to the sequence as UTF-16, like the characters
+        // of the basic multilingual plane
+        ushort mark[2];
+        int markLength = 0;
+        if (codePoint >= 0x10000) {
+            mark[markLength++] = QChar::highSurrogate(codePoint);
+            mark[markLength++] = QChar::lowSurrogate(codePoint);
+        } else {
+            mark[markLength++] = c;
+        }
+
+        Character& currentChar = _screenLines[lineIndex(charToCombineWithY)][charToCombineWithX];
         if ((currentChar.rendition & RE_EXTENDED_CHAR) == 0) {
-            const ushort chars[2] = { currentChar.character, c };
+            ushort chars[4];
+            int length = 0;
+            if (currentChar.plane != 0) {
+                chars[length++] = QChar::highSurrogate(currentChar.codePoint());
+                chars[length++] = QChar::lowSurrogate(currentChar.codePoint());
+            } else {
+                chars[length++] = currentChar.character;
+            }
+            for (int i = 0; i < markLength; i++)
+                chars[length++] = mark[i];
+
             currentChar.rendition |= RE_EXTENDED_CHAR;
-            currentChar.character = ExtendedCharTable::instance.createExtendedChar(chars, 2);
+            currentChar.plane = 0;
+            currentChar.character = ExtendedCharTable::instance.createExtendedChar(chars, length);
         } else {
-            ushort extendedCharLength;
-            const ushort* oldChars = ExtendedCharTable::instance.lookupExtendedChar(currentChar.character, extendedCharLength);
-            Q_ASSERT(oldChars);
-            if (oldChars) {
-                Q_ASSERT(extendedCharLength > 1);
-                Q_ASSERT(extendedCharLength < 65535);
-                ushort* chars = new ushort[extendedCharLength + 1];
-                memcpy(chars, oldChars, sizeof(ushort) * extendedCharLength);
-                chars[extendedCharLength] = c;
-                currentChar.character = ExtendedCharTable::instance.createExtendedChar(chars, extendedCharLength + 1);
-                delete[] chars;
-            }
+            currentChar.character = ExtendedCharTable::instance.appendExtendedChar(currentChar.character, mark, markLength);
         }
         return;
     }
 
     if (_cuX + w > _columns) {
-        if (getMode(MODE_Wrap)) {
-            _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | LINE_WRAPPED);
+        if (WrapMode) {
+            _lineProperties[lineIndex(_cuY)] = (LineProperty)(_lineProperties[lineIndex(_cuY)] | LINE_WRAPPED);
+            markLineDirty(_cuY);
             nextLine();
         } else {
             _cuX = _columns - w;
@@ -685,38 +899,42 @@ void Screen::displayCharacter(unsigned short c)
     }
 
     // ensure current line vector has enough elements
-    if (_screenLines[_cuY].size() < _cuX + w) {
-        _screenLines[_cuY].resize(_cuX + w);
-    }
+    extendLine(_cuY, _cuX + w);
 
-    if (getMode(MODE_Insert)) insertChars(w);
+    if (InsertMode) insertChars(w);
 
     _lastPos = loc(_cuX, _cuY);
 
     // check if selection is still valid.
-    checkSelection(_lastPos, _lastPos);
+    if (_selectionOnScreen)
+        checkSelection(_lastPos, _lastPos);
 
-    Character& currentChar = _screenLines[_cuY][_cuX];
+    markLineDirty(_cuY);
 
-    currentChar.character = c;
-    currentChar.foregroundColor = _effectiveForeground;
-    currentChar.backgroundColor = _effectiveBackground;
-    currentChar.rendition = _effectiveRendition;
-    currentChar.isRealCharacter = true;
+    Character& currentChar = _screenLines[lineIndex(_cuY)][_cuX];
+    currentChar = _effectiveCharacter;
+
+    if (codePoint < 0x10000 || (codePoint & 0xffff) != 0) {
+        currentChar.character = codePoint & 0xffff;
+        currentChar.plane = codePoint >> 16;
+    } else {
+        // a character value of 0 is taken by the second half of double
+        // width characters, so U+10000, U+20000 etc. are sequences instead
+        const ushort chars[2] = { QChar::highSurrogate(codePoint), QChar::lowSurrogate(codePoint) };
+        currentChar.character = ExtendedCharTable::instance.createExtendedChar(chars, 2);
+        currentChar.rendition |= RE_EXTENDED_CHAR;
+    }
 
     int i = 0;
     const int newCursorX = _cuX + w--;
     while (w) {
         i++;
 
-        if (_screenLines[_cuY].size() < _cuX + i + 1)
-            _screenLines[_cuY].resize(_cuX + i + 1);
+        extendLine(_cuY, _cuX + i + 1);
 
-        Character& ch = _screenLines[_cuY][_cuX + i];
+        Character& ch = _screenLines[lineIndex(_cuY)][_cuX + i];
+        ch = _effectiveCharacter;
         ch.character = 0;
-        ch.foregroundColor = _effectiveForeground;
-        ch.backgroundColor = _effectiveBackground;
-        ch.rendition = _effectiveRendition;
         ch.isRealCharacter = false;
 
         w--;
@@ -724,6 +942,185 @@ void Screen::displayCharacter(unsigned short c)
     _cuX = newCursorX;
 }
 
+template <bool InsertMode, bool WrapMode>
+void Screen::writeCharacters(const unsigned short* chars, int count)
+{
+    int i = 0;
+    while (i < count) {
+        // wrapping and surrogate pairs are left to writeCharacter(), as is
+        // insert mode, which moves the rest of the line for each character
+        if (InsertMode || _cuX >= _columns || _highSurrogate != 0) {
+            writeCharacter<InsertMode, WrapMode>(chars[i++]);
+            continue;
+        }
+
+        // find the run of single-width characters which fits on this line
+        const int available = qMin(_columns - _cuX, count - i);
+        int run = 0;
+        while (run < available) {
+            const unsigned short c = chars[i + run];
+            if ((c < 0x20 || c >= 0x7f) &&
+                    ((c & 0xf800) == 0xd800 || konsole_wcwidth(c) != 1))
+                break;
+            run++;
+        }
+
+        if (run == 0) {
+            writeCharacter<InsertMode, WrapMode>(chars[i++]);
+            continue;
+        }
+
+        extendLine(_cuY, _cuX + run);
+        ImageLine& line = _screenLines[lineIndex(_cuY)];
+
+        const int firstPos = loc(_cuX, _cuY);
+        _lastPos = firstPos + run - 1;
+
+        // check if selection is still valid, once for the whole run
+        if (_selectionOnScreen)
+            checkSelection(firstPos, _lastPos);
+
+        markLineDirty(_cuY);
+
+        // the whole run shares the current format, so each cell is
+        // written as a single 8 byte store of the same template
+        Character cell = _effectiveCharacter;
+        Character* data = line.data() + _cuX;
+        for (int j = 0; j < run; j++) {
+            cell.character = chars[i + j];
+            data[j] = cell;
+        }
+
+        _cuX += run;
+        i += run;
+    }
+}
+
+void Screen::displayCharacter(unsigned short c)
+{
+    switch (_writeModes) {
+    case 0:
+        writeCharacter<false, false>(c);
+        break;
+    case WriteWrap:
+        writeCharacter<false, true>(c);
+        break;
+    case WriteInsert:
+        writeCharacter<true, false>(c);
+        break;
+    case WriteInsert | WriteWrap:
+        writeCharacter<true, true>(c);
+        break;
+    }
+}
+
+void Screen::displayCharacters(const unsigned short* chars, int count)
+{
+    switch (_writeModes) {
+    case 0:
+        writeCharacters<false, false>(chars, count);
+        break;
+    case WriteWrap:
+        writeCharacters<false, true>(chars, count);
+        break;
+    case WriteInsert:
+        writeCharacters<true, false>(chars, count);
+        break;
+    case WriteInsert | WriteWrap:
+        writeCharacters<true, true>(chars, count);
+        break;
+    }
+}
+
+void Screen::updateWriteModes()
+{
+    _writeModes = 0;
+    if (_currentModes[MODE_Wrap])
+        _writeModes |= WriteWrap;
+    if (_currentModes[MODE_Insert])
+        _writeModes |= WriteInsert;
+}
+
+QSet<ushort> Screen::usedExtendedChars(bool exact) const
+{
+    QSet<ushort> result;
+    for (int i = 0; i < _lines + 1; ++i) {
+        const ImageLine& line = _screenLines[i];
+        for (int j = 0; j < line.size(); ++j) {
+            if (line[j].rendition & RE_EXTENDED_CHAR)
+                result << line[j].character;
+        }
+    }
+
+    if (exact || !_historyExtendedCharsKnown) {
+        _historyExtendedChars.clear();
+
+        QVector<Character> cells;
+        for (int i = 0; i < _history->getLines(); ++i) {
+            const int length = _history->getLineLen(i);
+            if (length == 0)
+                continue;
+
+            cells.resize(length);
+            _history->getCells(i, 0, length, cells.data());
+            for (int j = 0; j < length; ++j) {
+                if (cells[j].rendition & RE_EXTENDED_CHAR)
+                    _historyExtendedChars << cells[j].character;
+            }
+        }
+        _historyExtendedCharsKnown = true;
+    }
+
+    return result + _historyExtendedChars;
+}
+
+// sets the bit of 'used' for the RGB colors of 'count' cells
+static void addRgbColors(QBitArray& used, const Character* cells, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        if (cells[i].foregroundColor.isRgb())
+            used.setBit(cells[i].foregroundColor.rgbIndex());
+        if (cells[i].backgroundColor.isRgb())
+            used.setBit(cells[i].backgroundColor.rgbIndex());
+    }
+}
+
+void Screen::usedRgbColors(QBitArray& used, bool exact) const
+{
+    Q_ASSERT(used.size() == CharacterColor::MAX_RGB_INDEX);
+
+    for (int i = 0; i < _lines + 1; ++i)
+        addRgbColors(used, _screenLines[i].constData(), _screenLines[i].size());
+    addRgbColors(used, _lineFill.constData(), _lineFill.count());
+    addRgbColors(used, &_effectiveCharacter, 1);
+
+    const CharacterColor colors[] = { _currentForeground, _currentBackground,
+                                      _savedState.foreground, _savedState.background
+                                    };
+    for (int i = 0; i < 4; ++i) {
+        if (colors[i].isRgb())
+            used.setBit(colors[i].rgbIndex());
+    }
+
+    if (exact || !_historyRgbColorsKnown) {
+        _historyRgbColors.fill(false);
+
+        QVector<Character> cells;
+        for (int i = 0; i < _history->getLines(); ++i) {
+            const int length = _history->getLineLen(i);
+            if (length == 0)
+                continue;
+
+            cells.resize(length);
+            _history->getCells(i, 0, length, cells.data());
+            addHistoryRgbColors(cells);
+        }
+        _historyRgbColorsKnown = true;
+    }
+
+    used |= _historyRgbColors;
+}
+
 int Screen::scrolledLines() const
 {
     return _scrolledLines;
@@ -741,11 +1138,54 @@ void Screen::resetScrolledLines()
     _scrolledLines = 0;
 }
 
+quint64 Screen::lineGeneration(int line) const
+{
+    const int screenLine = line - _history->getLines();
+
+    if (screenLine < 0)
+        return _imageGeneration;
+    else
+        return qMax(qMax(_imageGeneration, _screenGeneration),
+                    _lineGenerations[lineIndex(screenLine)]);
+}
+
+void Screen::markLinesDirty(int first, int last)
+{
+    ++_generation;
+    for (int line = first; line <= last; line++)
+        _lineGenerations[lineIndex(line)] = _generation;
+}
+
+void Screen::markImageDirty()
+{
+    _imageGeneration = ++_generation;
+}
+
+void Screen::markScreenDirty()
+{
+    _screenGeneration = ++_generation;
+}
+
+void Screen::markModeChanged(int mode)
+{
+    // the image returned by getImage() is reversed in MODE_Screen and
+    // has the character at the cursor position marked in MODE_Cursor
+    if (mode == MODE_Screen)
+        markImageDirty();
+    else if (mode == MODE_Cursor)
+        markLineDirty(_cuY);
+}
+
 void Screen::scrollUp(int n)
 {
     if (n == 0) n = 1; // Default
-    if (_topMargin == 0) addHistLine(); // history.history
-    scrollUp(_topMargin, n);
+    if (_topMargin == 0 && hasScroll()) {
+        // the lines which scroll off the top of the screen are kept in the history
+        if (n <= _bottomMargin)
+            scrollUpIntoHistory(n);
+    } else {
+        scrollUp(_topMargin, n);
+    }
 }
 
 QRect Screen::lastScrolledRegion() const
@@ -762,9 +1202,51 @@ void Screen::scrollUp(int from, int n)
 
     //FIXME: make sure `topMargin', `bottomMargin', `from', `n' is in bounds.
     moveImage(loc(0, from), loc(0, from + n), loc(_columns - 1, _bottomMargin));
+    moveSelection(loc(0, from), loc(0, from + n), loc(_columns - 1, _bottomMargin));
     clearImage(loc(0, _bottomMargin - n + 1), loc(_columns - 1, _bottomMargin), ' ');
 }
 
+void Screen::scrollUpIntoHistory(int n)
+{
+    // more lines than the region holds above its last line are
+    // scrolled in several steps
+    while (n > 0) {
+        const int count = qMin(n, qMax(1, _bottomMargin));
+        n -= count;
+
+        if (!hasScroll()) {
+            scrollUp(0, count);
+            continue;
+        }
+
+        for (int line = 0; line < count; line++)
+            addHistLine(line);
+
+        // the top lines are now the last lines in the history and the lines
+        // above the bottom margin move up into their place, so all of them
+        // keep their absolute line numbers and the selection stays where it
+        // is.  Only the lines below the bottom margin have moved down.
+        if (_selBegin != -1 && _bottomMargin < _lines - 1) {
+            const qint64 belowMargin = absolutePosition(0, _history->getLines() + _bottomMargin - count + 1);
+            const bool beginIsTL = (_selBegin == _selTopLeft);
+
+            if (_selTopLeft >= belowMargin)
+                _selTopLeft += count * _columns;
+            if (_selBottomRight >= belowMargin)
+                _selBottomRight += count * _columns;
+
+            _selBegin = beginIsTL ? _selTopLeft : _selBottomRight;
+        }
+
+        _scrolledLines -= count;
+        _lastScrolledRegion = QRect(0, _topMargin, _columns - 1, (_bottomMargin - _topMargin));
+
+        if (count <= _bottomMargin)
+            moveImage(loc(0, 0), loc(0, count), loc(_columns - 1, _bottomMargin));
+        clearImage(loc(0, _bottomMargin - count + 1), loc(_columns - 1, _bottomMargin), ' ');
+    }
+}
+
 void Screen::scrollDown(int n)
 {
     if (n == 0) n = 1; // Default
@@ -783,6 +1265,7 @@ void Screen::scrollDown(int from, int n)
     if (from + n > _bottomMargin)
         n = _bottomMargin - from;
     moveImage(loc(0, from + n), loc(0, from), loc(_columns - 1, _bottomMargin - n));
+    moveSelection(loc(0, from + n), loc(0, from), loc(_columns - 1, _bottomMargin - n));
     clearImage(loc(0, from), loc(_columns - 1, from + n - 1), ' ');
 }
 
@@ -829,7 +1312,7 @@ int Screen::getCursorY() const
 
 void Screen::clearImage(int loca, int loce, char c)
 {
-    const int scr_TL = loc(0, _history->getLines());
+    const qint64 scr_TL = absolutePosition(0, _history->getLines());
     //FIXME: check positions
 
     //Clear entire selection if it overlaps region to be moved...
@@ -840,29 +1323,26 @@ void Screen::clearImage(int loca, int loce, char c)
     const int topLine = loca / _columns;
     const int bottomLine = loce / _columns;
 
-    Character clearCh(c, _currentForeground, _currentBackground, DEFAULT_RENDITION, false);
+    const Character clearCh(c, _currentForeground, _currentBackground, DEFAULT_RENDITION, false);
 
-    //if the character being used to clear the area is the same as the
-    //default character, the affected _lines can simply be shrunk.
-    const bool isDefaultCh = (clearCh == Screen::DefaultChar);
+    markLinesDirty(topLine, bottomLine);
 
     for (int y = topLine; y <= bottomLine; y++) {
-        _lineProperties[y] = 0;
+        _lineProperties[lineIndex(y)] = 0;
 
         const int endCol = (y == bottomLine) ? loce % _columns : _columns - 1;
         const int startCol = (y == topLine) ? loca % _columns : 0;
 
-        QVector<Character>& line = _screenLines[y];
-
-        if (isDefaultCh && endCol == _columns - 1) {
-            line.resize(startCol);
+        if (endCol == _columns - 1) {
+            // areas which extend to the end of the line are not filled,
+            // the line is shrunk and the cells past its end are taken
+            // from the line's fill character until they are written to
+            extendLine(y, startCol);
+            _screenLines[lineIndex(y)].resize(startCol);
+            _lineFill[lineIndex(y)] = clearCh;
         } else {
-            if (line.size() < endCol + 1)
-                line.resize(endCol + 1);
-
-            Character* data = line.data();
-            for (int i = startCol; i <= endCol; i++)
-                data[i] = clearCh;
+            extendLine(y, endCol + 1);
+            fillCharacters(_screenLines[lineIndex(y)].data() + startCol, endCol - startCol + 1, clearCh);
         }
     }
 }
@@ -872,22 +1352,34 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
     Q_ASSERT(sourceBegin <= sourceEnd);
 
     const int lines = (sourceEnd - sourceBegin) / _columns;
-
-    //move screen image and line properties:
-    //the source and destination areas of the image may overlap,
-    //so it matters that we do the copy in the right order -
-    //forwards if dest < sourceBegin or backwards otherwise.
-    //(search the web for 'memmove implementation' for details)
-    if (dest < sourceBegin) {
-        for (int i = 0; i <= lines; i++) {
-            _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
-            _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
-        }
+    const int destLine = dest / _columns;
+    const int sourceLine = sourceBegin / _columns;
+
+    if (destLine == 0 && sourceLine + lines == _lines - 1) {
+        // moving the bottom of the screen to the top, as when scrolling
+        // the whole screen up, only moves the start of the ring of screen
+        // lines.  The lines which are moved past the top reappear at the
+        // bottom, the callers clear them.
+        _screenLinesOffset = lineIndex(sourceLine);
+        markScreenDirty();
     } else {
-        for (int i = lines; i >= 0; i--) {
-            _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
-            _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+        //move screen image and line properties:
+        //the lines are swapped rather than copied, which rotates the
+        //region so that the lines which are overwritten end up in the
+        //source lines which are not, and the callers clear them.  Copying
+        //would leave those lines sharing their data with the moved lines
+        //and clearing them would have to detach them again.
+        //the source and destination areas may overlap, so the lines are
+        //swapped forwards if dest < sourceBegin or backwards otherwise.
+        if (dest < sourceBegin) {
+            for (int i = 0; i <= lines; i++)
+                swapLines(destLine + i, sourceLine + i);
+        } else {
+            for (int i = lines; i >= 0; i--)
+                swapLines(destLine + i, sourceLine + i);
         }
+
+        markLinesDirty(destLine, destLine + lines);
     }
 
     if (_lastPos != -1) {
@@ -896,16 +1388,29 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
         if ((_lastPos < 0) || (_lastPos >= (lines * _columns)))
             _lastPos = -1;
     }
+}
+
+void Screen::swapLines(int first, int second)
+{
+    const int firstIndex = lineIndex(first);
+    const int secondIndex = lineIndex(second);
 
+    qSwap(_screenLines[firstIndex], _screenLines[secondIndex]);
+    qSwap(_lineProperties[firstIndex], _lineProperties[secondIndex]);
+    qSwap(_lineFill[firstIndex], _lineFill[secondIndex]);
+}
+
+void Screen::moveSelection(int dest, int sourceBegin, int sourceEnd)
+{
     // Adjust selection to follow scroll.
     if (_selBegin != -1) {
         const bool beginIsTL = (_selBegin == _selTopLeft);
         const int diff = dest - sourceBegin; // Scroll by this amount
-        const int scr_TL = loc(0, _history->getLines());
-        const int srca = sourceBegin + scr_TL; // Translate index from screen to global
-        const int srce = sourceEnd + scr_TL; // Translate index from screen to global
-        const int desta = srca + diff;
-        const int deste = srce + diff;
+        const qint64 scr_TL = absolutePosition(0, _history->getLines());
+        const qint64 srca = sourceBegin + scr_TL; // Translate index from screen to global
+        const qint64 srce = sourceEnd + scr_TL; // Translate index from screen to global
+        const qint64 desta = srca + diff;
+        const qint64 deste = srce + diff;
 
         if ((_selTopLeft >= srca) && (_selTopLeft <= srce))
             _selTopLeft += diff;
@@ -917,11 +1422,11 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
         else if ((_selBottomRight >= desta) && (_selBottomRight <= deste))
             _selBottomRight = -1; // Clear selection (see below)
 
-        if (_selBottomRight < 0) {
+        if (_selBottomRight < absolutePosition(0, 0)) {
             clearSelection();
         } else {
-            if (_selTopLeft < 0)
-                _selTopLeft = 0;
+            if (_selTopLeft < absolutePosition(0, 0))
+                _selTopLeft = absolutePosition(0, 0);
         }
 
         if (beginIsTL)
@@ -944,10 +1449,7 @@ void Screen::clearToBeginOfScreen()
 void Screen::clearEntireScreen()
 {
     // Add entire screen to history
-    for (int i = 0; i < (_lines - 1); i++) {
-        addHistLine();
-        scrollUp(0, 1);
-    }
+    scrollUpIntoHistory(_lines - 1);
 
     clearImage(loc(0, 0), loc(_columns - 1, _lines - 1), ' ');
 }
@@ -996,6 +1498,17 @@ void Screen::setDefaultRendition()
     updateEffectiveRendition();
 }
 
+void Screen::setGraphicRendition(quint8 rendition, const CharacterColor& foreground,
+                                 const CharacterColor& background)
+{
+    _currentRendition = rendition;
+    _currentForeground = foreground.isValid() ? foreground
+                         : CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR);
+    _currentBackground = background.isValid() ? background
+                         : CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR);
+    updateEffectiveRendition();
+}
+
 void Screen::setForeColor(int space, int color)
 {
     _currentForeground = CharacterColor(space, color);
@@ -1021,13 +1534,15 @@ void Screen::clearSelection()
     _selBottomRight = -1;
     _selTopLeft = -1;
     _selBegin = -1;
+    _selectionOnScreen = false;
 }
 
 void Screen::getSelectionStart(int& column , int& line) const
 {
     if (_selTopLeft != -1) {
-        column = _selTopLeft % _columns;
-        line = _selTopLeft / _columns;
+        const int position = imagePosition(_selTopLeft);
+        column = position % _columns;
+        line = position / _columns;
     } else {
         column = _cuX + getHistLines();
         line = _cuY + getHistLines();
@@ -1036,8 +1551,9 @@ void Screen::getSelectionStart(int& column , int& line) const
 void Screen::getSelectionEnd(int& column , int& line) const
 {
     if (_selBottomRight != -1) {
-        column = _selBottomRight % _columns;
-        line = _selBottomRight / _columns;
+        const int position = imagePosition(_selBottomRight);
+        column = position % _columns;
+        line = position / _columns;
     } else {
         column = _cuX + getHistLines();
         line = _cuY + getHistLines();
@@ -1045,13 +1561,15 @@ void Screen::getSelectionEnd(int& column , int& line) const
 }
 void Screen::setSelectionStart(const int x, const int y, const bool blockSelectionMode)
 {
-    _selBegin = loc(x, y);
+    _selBegin = absolutePosition(x, y);
     /* FIXME, HACK to correct for x too far to the right... */
     if (x == _columns) _selBegin--;
 
     _selBottomRight = _selBegin;
     _selTopLeft = _selBegin;
     _blockSelectionMode = blockSelectionMode;
+    _selectionOnScreen = true;
+
 }
 
 void Screen::setSelectionEnd(const int x, const int y)
@@ -1059,7 +1577,7 @@ void Screen::setSelectionEnd(const int x, const int y)
     if (_selBegin == -1)
         return;
 
-    int endPos =  loc(x, y);
+    qint64 endPos = absolutePosition(x, y);
 
     if (endPos < _selBegin) {
         _selTopLeft = endPos;
@@ -1072,29 +1590,46 @@ void Screen::setSelectionEnd(const int x, const int y)
         _selTopLeft = _selBegin;
         _selBottomRight = endPos;
     }
+    _selectionOnScreen = true;
 
     // Normalize the selection in column mode
     if (_blockSelectionMode) {
-        const int topRow = _selTopLeft / _columns;
+        const qint64 topRow = _selTopLeft / _columns;
         const int topColumn = _selTopLeft % _columns;
-        const int bottomRow = _selBottomRight / _columns;
+        const qint64 bottomRow = _selBottomRight / _columns;
         const int bottomColumn = _selBottomRight % _columns;
 
-        _selTopLeft = loc(qMin(topColumn, bottomColumn), topRow);
-        _selBottomRight = loc(qMax(topColumn, bottomColumn), bottomRow);
+        _selTopLeft = topRow * _columns + qMin(topColumn, bottomColumn);
+        _selBottomRight = bottomRow * _columns + qMax(topColumn, bottomColumn);
     }
 }
 
 bool Screen::isSelected(const int x, const int y) const
 {
-    bool columnInSelection = true;
+    int startColumn;
+    int endColumn;
+    return selectedColumns(y, startColumn, endColumn) &&
+           x >= startColumn && x <= endColumn;
+}
+
+bool Screen::selectedColumns(int y, int& startColumn, int& endColumn) const
+{
+    const qint64 lineStart = absolutePosition(0, y);
+    const qint64 lineEnd = lineStart + _columns - 1;
+
+    // this also rejects lines while there is no selection, as both
+    // corners are -1 then
+    if (_selTopLeft > lineEnd || _selBottomRight < lineStart)
+        return false;
+
     if (_blockSelectionMode) {
-        columnInSelection = x >= (_selTopLeft % _columns) &&
-                            x <= (_selBottomRight % _columns);
+        startColumn = _selTopLeft % _columns;
+        endColumn = _selBottomRight % _columns;
+    } else {
+        startColumn = qMax(_selTopLeft, lineStart) - lineStart;
+        endColumn = qMin(_selBottomRight, lineEnd) - lineStart;
     }
-
-    const int pos = loc(x, y);
-    return pos >= _selTopLeft && pos <= _selBottomRight && columnInSelection;
+    return true;
 }
 
 QString Screen::selectedText(bool preserveLineBreaks, bool trimTrailingSpaces) const
@@ -1102,17 +1637,37 @@ QString Screen::selectedText(bool preserveLineBreaks, bool trimTrailingSpaces) c
     if (!isSelectionValid())
         return QString();
 
-    return text(_selTopLeft, _selBottomRight, preserveLineBreaks, trimTrailingSpaces);
+    return text(imagePosition(_selTopLeft), imagePosition(_selBottomRight),
+                preserveLineBreaks, trimTrailingSpaces);
 }
 
 QString Screen::text(int startIndex, int endIndex, bool preserveLineBreaks, bool trimTrailingSpaces) const
+{
+    return rangeText(startIndex, endIndex, _blockSelectionMode,
+                     preserveLineBreaks, trimTrailingSpaces);
+}
+
+bool Screen::getSelectionRange(int& startIndex, int& endIndex, bool& blockSelection) const
+{
+    if (!isSelectionValid())
+        return false;
+
+    startIndex = imagePosition(_selTopLeft);
+    endIndex = imagePosition(_selBottomRight);
+    blockSelection = _blockSelectionMode;
+    return true;
+}
+
+QString Screen::rangeText(int startIndex, int endIndex, bool blockSelection,
+                          bool preserveLineBreaks, bool trimTrailingSpaces) const
 {
     QString result;
     QTextStream stream(&result, QIODevice::ReadWrite);
 
     PlainTextDecoder decoder;
     decoder.begin(&stream);
-    writeToStream(&decoder, startIndex, endIndex, preserveLineBreaks, trimTrailingSpaces);
+    writeToStream(&decoder, startIndex, endIndex, blockSelection,
+                  preserveLineBreaks, trimTrailingSpaces);
     decoder.end();
 
     return result;
@@ -1120,7 +1675,7 @@ QString Screen::text(int startIndex, int endIndex, bool preserveLineBreaks, bool
 
 bool Screen::isSelectionValid() const
 {
-    return _selTopLeft >= 0 && _selBottomRight >= 0;
+    return _selTopLeft >= 0 && _selBottomRight >= absolutePosition(0, 0);
 }
 
 void Screen::writeSelectionToStream(TerminalCharacterDecoder* decoder ,
@@ -1129,11 +1684,16 @@ void Screen::writeSelectionToStream(TerminalCharacterDecoder* decoder ,
 {
     if (!isSelectionValid())
         return;
-    writeToStream(decoder, _selTopLeft, _selBottomRight, preserveLineBreaks, trimTrailingSpaces);
+    writeToStream(decoder, imagePosition(_selTopLeft), imagePosition(_selBottomRight),
+                  _blockSelectionMode, preserveLineBreaks, trimTrailingSpaces);
 }
 
+// number of history lines which writeToStream() reads at once
+static const int HISTORY_READ_BATCH = 1000;
+
 void Screen::writeToStream(TerminalCharacterDecoder* decoder,
                            int startIndex, int endIndex,
+                           bool blockSelectionMode,
                            bool preserveLineBreaks,
                            bool trimTrailingSpaces) const
 {
@@ -1145,12 +1705,23 @@ void Screen::writeToStream(TerminalCharacterDecoder* decoder,
 
     Q_ASSERT(top >= 0 && left >= 0 && bottom >= 0 && right >= 0);
 
+    // lines in the history are read a batch at a time
+    HistoryLines historyLines;
+    const int historyEnd = qMin(bottom + 1, _history->getLines());
+
+    // the lines are decoded from this buffer when they cannot be decoded
+    // where they are, it grows to fit the longest of them
+    QVector<Character> buffer(_columns + 1);
+
     for (int y = top; y <= bottom; y++) {
+        if (y < historyEnd && !historyLines.contains(y))
+            _history->readLines(y, qMin(HISTORY_READ_BATCH, historyEnd - y), historyLines);
+
         int start = 0;
-        if (y == top || _blockSelectionMode) start = left;
+        if (y == top || blockSelectionMode) start = left;
 
         int count = -1;
-        if (y == bottom || _blockSelectionMode) count = right - start + 1;
+        if (y == bottom || blockSelectionMode) count = right - start + 1;
 
         const bool appendNewLine = (y != bottom);
         int copied = copyLineToStream(y,
@@ -1159,7 +1730,9 @@ void Screen::writeToStream(TerminalCharacterDecoder* decoder,
                                       decoder,
                                       appendNewLine,
                                       preserveLineBreaks,
-                                      trimTrailingSpaces);
+                                      trimTrailingSpaces,
+                                      buffer,
+                                      &historyLines);
 
         // if the selection goes beyond the end of the last line then
         // append a new line character.
@@ -1180,22 +1753,20 @@ int Screen::copyLineToStream(int line ,
                              TerminalCharacterDecoder* decoder,
                              bool appendNewLine,
                              bool preserveLineBreaks,
-                             bool trimTrailingSpaces) const
+                             bool trimTrailingSpaces,
+                             QVector<Character>& buffer,
+                             const HistoryLines* historyLines) const
 {
-    //buffer to hold characters for decoding
-    //the buffer is static to avoid initializing every
-    //element on each call to copyLineToStream
-    //(which is unnecessary since all elements will be overwritten anyway)
-    static const int MAX_CHARS = 1024;
-    static Character characterBuffer[MAX_CHARS];
-
-    Q_ASSERT(count < MAX_CHARS);
+    // the characters to decode, which are read straight from the line where
+    // possible and copied into 'buffer' otherwise
+    const Character* characters = 0;
 
     LineProperty currentLineProperties = 0;
 
     //determine if the line is in the history buffer or the screen image
     if (line < _history->getLines()) {
-        const int lineLength = _history->getLineLen(line);
+        const bool preread = historyLines && historyLines->contains(line);
+        const int lineLength = preread ? historyLines->lineLength(line) : _history->getLineLen(line);
 
         // ensure that start position is before end of line
         start = qMin(start, qMax(0, lineLength - 1));
@@ -1212,73 +1783,151 @@ int Screen::copyLineToStream(int line ,
         // safety checks
         Q_ASSERT(start >= 0);
         Q_ASSERT(count >= 0);
-        Q_ASSERT((start + count) <= _history->getLineLen(line));
-
-        _history->getCells(line, start, count, characterBuffer);
+        Q_ASSERT((start + count) <= lineLength);
 
-        if (_history->isWrappedLine(line))
-            currentLineProperties |= LINE_WRAPPED;
+        if (preread) {
+            characters = historyLines->cells(line) + start;
+            if (historyLines->isWrapped(line))
+                currentLineProperties |= LINE_WRAPPED;
+        } else {
+            if (buffer.count() < count + 1)
+                buffer.resize(count + 1);
+            _history->getCells(line, start, count, buffer.data());
+            characters = buffer.constData();
+            if (_history->isWrappedLine(line))
+                currentLineProperties |= LINE_WRAPPED;
+        }
     } else {
-        if (count == -1)
-            count = _columns - start;
+        const int index = lineIndex(line - _history->getLines());
 
-        Q_ASSERT(count >= 0);
+        Q_ASSERT(index < _lineProperties.count());
+        currentLineProperties = _lineProperties[index];
 
-        const int screenLine = line - _history->getLines();
+        characters = screenLineCells(_screenLines[index], _lineFill[index], currentLineProperties,
+                                     _columns, start, count, trimTrailingSpaces, buffer);
+    }
 
-        Character* data = _screenLines[screenLine].data();
-        int length = _screenLines[screenLine].count();
+    return decodeCells(characters, count, currentLineProperties, decoder,
+                       appendNewLine, preserveLineBreaks, buffer);
+}
 
-        // Don't remove end spaces in lines that wrap
-        if (trimTrailingSpaces && !(_lineProperties[screenLine] & LINE_WRAPPED))
-        {
-            // ignore trailing white space at the end of the line
-            for (int i = length-1; i >= 0; i--)
-            {
-                if (data[i].character == ' ')
-                    length--;
-                else
-                    break;
-            }
-        }
+const Character* Screen::screenLineCells(const ImageLine& line, const Character& fill,
+                                         LineProperty properties, int columns,
+                                         int start, int& count, bool trimTrailingSpaces,
+                                         QVector<Character>& buffer)
+{
+    if (count == -1)
+        count = columns - start;
 
-        //retrieve line from screen image
-        for (int i = start; i < qMin(start + count, length); i++) {
-            characterBuffer[i - start] = data[i];
-        }
+    Q_ASSERT(count >= 0);
 
-        // count cannot be any greater than length
-        count = qBound(0, count, length - start);
+    const Character* data = line.constData();
+    const int lineLength = line.count();
 
-        Q_ASSERT(screenLine < _lineProperties.count());
-        currentLineProperties |= _lineProperties[screenLine];
+    // cells past the end of a line which was cleared with a
+    // non-default character belong to the line as well
+    int length = (fill != Screen::DefaultChar) ? qMax(lineLength, columns) : lineLength;
+
+    // Don't remove end spaces in lines that wrap
+    if (trimTrailingSpaces && !(properties & LINE_WRAPPED))
+    {
+        // ignore trailing white space at the end of the line
+        for (int i = length-1; i >= 0; i--)
+        {
+            const Character& c = (i < lineLength ? data[i] : fill);
+            if (c.character == ' ' && c.plane == 0)
+                length--;
+            else
+                break;
+        }
     }
 
-    if (appendNewLine && (count + 1 < MAX_CHARS)) {
-        if (currentLineProperties & LINE_WRAPPED) {
-            // do nothing extra when this line is wrapped.
-        } else {
-            // When users ask not to preserve the linebreaks, they usually mean:
-            // `treat LINEBREAK as SPACE, thus joining multiple _lines into
-            // single line in the same way as 'J' does in VIM.`
-            characterBuffer[count] = preserveLineBreaks ? Character('\n') : Character(' ');
-            count++;
+    // count cannot be any greater than length
+    count = qBound(0, count, length - start);
+
+    //retrieve line from screen image, the fill character past its end
+    //has to be copied
+    if (start + count <= lineLength)
+        return data + start;
+
+    if (buffer.count() < count + 1)
+        buffer.resize(count + 1);
+    for (int i = start; i < start + count; i++)
+        buffer[i - start] = (i < lineLength) ? data[i] : fill;
+    return buffer.constData();
+}
+
+int Screen::decodeCells(const Character* characters, int count, LineProperty properties,
+                        TerminalCharacterDecoder* decoder, bool appendNewLine,
+                        bool preserveLineBreaks, QVector<Character>& buffer)
+{
+    // nothing extra is added to the end of a line which is wrapped
+    if (appendNewLine && !(properties & LINE_WRAPPED)) {
+        // the new line goes after the characters, which have to be in
+        // the buffer for that
+        if (characters != buffer.constData()) {
+            if (buffer.count() < count + 1)
+                buffer.resize(count + 1);
+            memcpy(buffer.data(), characters, count * sizeof(Character));
+            characters = buffer.constData();
         }
+
+        // When users ask not to preserve the linebreaks, they usually mean:
+        // `treat LINEBREAK as SPACE, thus joining multiple _lines into
+        // single line in the same way as 'J' does in VIM.`
+        buffer[count] = preserveLineBreaks ? Character('\n') : Character(' ');
+        count++;
     }
 
     //decode line and write to text stream
-    decoder->decodeLine((Character*) characterBuffer ,
-                        count, currentLineProperties);
+    decoder->decodeLine(characters, count, properties);
 
     return count;
 }
 
 void Screen::writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine, int toLine) const
 {
-    writeToStream(decoder, loc(0, fromLine), loc(_columns - 1, toLine));
+    writeToStream(decoder, loc(0, fromLine), loc(_columns - 1, toLine), false);
+}
+
+ScreenSnapshot Screen::snapshot(int startLine, int endLine) const
+{
+    Q_ASSERT(startLine >= 0 && endLine < getHistLines() + _lines);
+
+    ScreenSnapshot snapshot;
+    snapshot._firstLine = startLine;
+    snapshot._lastLine = endLine;
+    snapshot._columns = _columns;
+    snapshot._historyLines = _history->getLines();
+    snapshot._discardedLines = _discardedLines;
+    snapshot._historyGeneration = historyGeneration();
+
+    const int historyEnd = qMin(endLine + 1, snapshot._historyLines);
+    if (startLine < historyEnd)
+        _history->readLines(startLine, historyEnd - startLine, snapshot._history);
+
+    // the screen lines are only copied when they are written to next
+    const int screenStart = qMax(startLine, snapshot._historyLines);
+    const int screenLines = endLine - screenStart + 1;
+    if (screenLines > 0) {
+        snapshot._screenLines.resize(screenLines);
+        snapshot._lineProperties.resize(screenLines);
+        snapshot._lineFill.resize(screenLines);
+        for (int i = 0; i < screenLines; i++) {
+            const int index = lineIndex(screenStart + i - snapshot._historyLines);
+            snapshot._screenLines[i] = _screenLines[index];
+            snapshot._lineProperties[i] = _lineProperties[index];
+            snapshot._lineFill[i] = _lineFill[index];
+        }
+    }
+
+    snapshot._extendedChars = ExtendedCharTable::instance;
+    snapshot._rgbColors = rgbColorValues();
+
+    return snapshot;
 }
 
-void Screen::addHistLine()
+void Screen::addHistLine(int y)
 {
     // add line to history buffer
     // we have to take care about scrolling, too...
@@ -1286,69 +1935,170 @@ void Screen::addHistLine()
     if (hasScroll()) {
         const int oldHistLines = _history->getLines();
 
-        _history->addCellsVector(_screenLines[0]);
-        _history->addLine(_lineProperties[0] & LINE_WRAPPED);
-
-        const int newHistLines = _history->getLines();
-
-        const bool beginIsTL = (_selBegin == _selTopLeft);
+        const bool wrapped = _lineProperties[lineIndex(y)] & LINE_WRAPPED;
+
+        // the line is cleared by the caller, so it can be filled in place
+        // and its storage handed over to the history.  The history may
+        // give back other storage, which is kept for the new line
+        ImageLine& line = _screenLines[lineIndex(y)];
+        if (_lineFill[lineIndex(y)] != DefaultChar)
+            extendLine(y, _columns);
+        indexHistoryLine(line, wrapped);
+        addHistoryExtendedChars(line);
+        addHistoryRgbColors(line);
+        _history->takeCellsVector(line);
+        _history->addLine(wrapped);
+        line.reserve(_columns);
 
         // If the history is full, increment the count
-        // of dropped _lines
-        if (newHistLines == oldHistLines)
+        // of dropped _lines.  The selection is kept in absolute lines,
+        // which are not affected by adding or discarding lines
+        if (_history->getLines() == oldHistLines) {
             _droppedLines++;
-
-        // Adjust selection for the new point of reference
-        if (newHistLines > oldHistLines) {
-            if (_selBegin != -1) {
-                _selTopLeft += _columns;
-                _selBottomRight += _columns;
-            }
+            _discardedLines++;
         }
+    }
+}
 
-        if (_selBegin != -1) {
-            // Scroll selection in history up
-            const int top_BR = loc(0, 1 + newHistLines);
+void Screen::indexHistoryLine(const QVector<Character>& line, bool wrapped)
+{
+    if (!_historyIndex)
+        return;
 
-            if (_selTopLeft < top_BR)
-                _selTopLeft -= _columns;
+    // the index holds the text as it is searched, which is the text
+    // written by writeToStream()
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    decoder.decodeLine(line.constData(), line.count(), LINE_DEFAULT);
+    decoder.end();
+    stream.flush();
 
-            if (_selBottomRight < top_BR)
-                _selBottomRight -= _columns;
+    _historyIndex->addLine(text, wrapped);
 
-            if (_selBottomRight < 0) {
-                clearSelection();
-            } else {
-                if (_selTopLeft < 0)
-                    _selTopLeft = 0;
-            }
+    // the history drops its oldest lines once it is full
+    _historyIndex->keepLines(_history->getLines());
+}
 
-            if (beginIsTL)
-                _selBegin = _selTopLeft;
-            else
-                _selBegin = _selBottomRight;
-        }
+void Screen::addHistoryExtendedChars(const QVector<Character>& line)
+{
+    const Character* cells = line.constData();
+    const int count = line.count();
+    for (int i = 0; i < count; i++) {
+        if (cells[i].rendition & RE_EXTENDED_CHAR)
+            _historyExtendedChars << cells[i].character;
     }
 }
 
+void Screen::addHistoryRgbColors(const QVector<Character>& line) const
+{
+    addRgbColors(_historyRgbColors, line.constData(), line.count());
+}
+
+void Screen::setHistoryIndexEnabled(bool enable)
+{
+    if (enable && !_historyIndex) {
+        _historyIndex = new HistorySearchIndex();
+    } else if (!enable) {
+        delete _historyIndex;
+        _historyIndex = 0;
+    }
+}
+
+bool Screen::findCandidateLines(const QString& text, int& startLine, int& endLine) const
+{
+    if (!_historyIndex)
+        return true;
+
+    return _historyIndex->findCandidateLines(text, _history->getLines(), startLine, endLine);
+}
+
 int Screen::getHistLines() const
 {
     return _history->getLines();
 }
 
+// histories with more lines than this are converted a batch of lines at a
+// time by convertHistory(), rather than at once by setScroll()
+static const int SYNCHRONOUS_HISTORY_CONVERSION_LINES = 10000;
+
 void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
 {
     clearSelection();
+    markImageDirty();
+
+    // the new history may hold lines which were not added by the screen
+    _historyExtendedChars.clear();
+    _historyExtendedCharsKnown = false;
+    _historyRgbColorsKnown = false;
+
+    // the new history may hold other lines than the current one, such as
+    // those of a persistent history from an earlier session, so only the
+    // lines added from now on are indexed
+    if (_historyIndex)
+        _historyIndex->clear();
 
     if (copyPreviousScroll) {
+        // finish any earlier conversion first
+        while (convertHistory(SYNCHRONOUS_HISTORY_CONVERSION_LINES)) {}
+
+        if (_history->getLines() > SYNCHRONOUS_HISTORY_CONVERSION_LINES) {
+            HistoryScroll* target = t.scroll(0);
+
+            // histories of the same type adapt themselves to the new type
+            // without copying their lines.  Histories which are reattached
+            // to lines from an earlier session are filled at once
+            if (target->hasScroll() && target->getLines() == 0 &&
+                    typeid(*target) != typeid(*_history)) {
+                _historyConversion = new HistoryScrollConversion(_history, target);
+                _history = _historyConversion;
+                return;
+            }
+            delete target;
+        }
+
         _history = t.scroll(_history);
     } else {
         HistoryScroll* oldScroll = _history;
         _history = t.scroll(0);
+        _historyConversion = 0;
         delete oldScroll;
     }
 }
 
+bool Screen::isConvertingHistory() const
+{
+    return _historyConversion != 0;
+}
+
+bool Screen::convertHistory(int lineCount)
+{
+    if (!_historyConversion)
+        return false;
+
+    if (!_historyConversion->convert(lineCount))
+        return true;
+
+    const int oldHistLines = _history->getLines();
+
+    HistoryScroll* history = _historyConversion->takeTarget();
+    delete _historyConversion;
+    _historyConversion = 0;
+    _history = history;
+
+    // a new history with room for fewer lines keeps only the latest ones,
+    // the others are dropped as if they had been scrolled out of it
+    const int droppedLines = oldHistLines - _history->getLines();
+    if (droppedLines > 0) {
+        _droppedLines += droppedLines;
+        _discardedLines += droppedLines;
+        markImageDirty();
+    }
+
+    return false;
+}
+
 bool Screen::hasScroll() const
 {
     return _history->hasScroll();
@@ -1359,15 +2109,85 @@ const HistoryType& Screen::getScroll() const
     return _history->getType();
 }
 
+void Screen::clearHistory()
+{
+    clearSelection();
+    markImageDirty();
+
+    // the history keeps its storage, which is cheaper than creating it again
+    _history->clear();
+    _historyExtendedChars.clear();
+    _historyExtendedCharsKnown = true;
+    _historyRgbColors.fill(false);
+    _historyRgbColorsKnown = true;
+
+    if (_historyIndex)
+        _historyIndex->clear();
+}
+
+qint64 Screen::historyMemoryUsage() const
+{
+    return _history->memoryUsage();
+}
+
+qint64 Screen::retainedHistoryMemoryUsage() const
+{
+    return _history->retainedMemoryUsage();
+}
+
+qint64 Screen::historyFileSize() const
+{
+    return _history->fileSize();
+}
+
+qint64 Screen::screenMemoryUsage() const
+{
+    qint64 usage = (_lines + 1) * sizeof(ImageLine);
+    for (int i = 0; i <= _lines; i++)
+        usage += _screenLines[i].capacity() * sizeof(Character);
+
+    usage += _lineProperties.capacity() * sizeof(LineProperty);
+    usage += _lineFill.capacity() * sizeof(Character);
+    usage += _lineGenerations.capacity() * sizeof(quint64);
+
+    return usage;
+}
+
+void Screen::compactHistory()
+{
+    _history->compact();
+}
+
+void Screen::squeezeLines()
+{
+    for (int i = 0; i <= _lines; i++)
+        _screenLines[i].squeeze();
+}
+
 void Screen::setLineProperty(LineProperty property , bool enable)
 {
     if (enable)
-        _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | property);
+        _lineProperties[lineIndex(_cuY)] = (LineProperty)(_lineProperties[lineIndex(_cuY)] | property);
     else
-        _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] & ~property);
+        _lineProperties[lineIndex(_cuY)] = (LineProperty)(_lineProperties[lineIndex(_cuY)] & ~property);
+
+    markLineDirty(_cuY);
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
-    for (int i = 0; i < count; i++)
-        dest[i] = Screen::DefaultChar;
+    fillCharacters(dest, count, Screen::DefaultChar);
+}
+
+void Screen::extendLine(int y, int length)
+{
+    ImageLine& line = _screenLines[lineIndex(y)];
+    const int oldLength = line.count();
+    if (oldLength >= length)
+        return;
+
+    line.resize(length);
+
+    const Character& fill = _lineFill[lineIndex(y)];
+    if (fill != DefaultChar)
+        fillCharacters(line.data() + oldLength, length - oldLength, fill);
 }
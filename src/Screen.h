@@ -47,6 +47,10 @@ class TerminalCharacterDecoder;
 class TerminalDisplay;
 class HistoryType;
 class HistoryScroll;
+class HistoryScrollConversion;
+class HistoryLines;
+class HistorySearchIndex;
+class ScreenSnapshot;
 
 /**
     \brief An image of characters with associated attributes.
@@ -68,8 +72,9 @@ class HistoryScroll;
 
     The screen image has a selection associated with it, specified using
     setSelectionStart() and setSelectionEnd().  The selected text can be retrieved
-    using selectedText().  When getImage() is used to retrieve the visible image,
-    characters which are part of the selection have their colors inverted.
+    using selectedText().  The selection is not part of the image returned by
+    getImage(), the views draw it themselves using selectedColumns(), so
+    changing it does not change any line of the image.
 */
 class Screen
 {
@@ -299,6 +304,26 @@ public:
      * character's rendition flags back to the default settings.
      */
     void setDefaultRendition();
+    /**
+     * Sets the rendition flags and both colors of the cursor at once.
+     * Invalid colors are replaced by the default colors.  This is cheaper
+     * than setting them one by one, eg. for the arguments of an
+     * "ESC[...m" sequence.
+     */
+    void setGraphicRendition(quint8 rendition, const CharacterColor& foreground,
+                             const CharacterColor& background);
+    /** Returns the rendition flags set with setRendition() */
+    quint8 currentRendition() const {
+        return _currentRendition;
+    }
+    /** Returns the foreground color set with setForeColor() */
+    const CharacterColor& currentForeground() const {
+        return _currentForeground;
+    }
+    /** Returns the background color set with setBackColor() */
+    const CharacterColor& currentBackground() const {
+        return _currentBackground;
+    }
 
     /** Returns the column which the cursor is positioned at. */
     int  getCursorX() const;
@@ -346,6 +371,15 @@ public:
      */
     void displayCharacter(unsigned short c);
 
+    /**
+     * Displays @p count characters from @p chars starting at the current
+     * cursor position.  This is equivalent to calling displayCharacter()
+     * for each character in turn, but runs of single-width characters are
+     * written into the line in one pass, with the wrapping and selection
+     * checks made once for each run instead of once per character.
+     */
+    void displayCharacters(const unsigned short* chars, int count);
+
     /**
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.
      * In the case that @p new_columns is smaller than the current number of columns,
@@ -355,9 +389,25 @@ public:
      * The top and bottom margins are reset to the top and bottom of the new
      * screen size.  Tab stops are also reset and the current selection is
      * cleared.
+     *
+     * If reflowLines() is enabled, lines are rewrapped to the new number of
+     * columns instead, see setReflowLines().
      */
     void resizeImage(int new_lines, int new_columns);
 
+    /**
+     * Sets whether lines are rewrapped when the number of columns is changed
+     * by resizeImage().  Lines which were wrapped because they did not fit
+     * (see LINE_WRAPPED) are joined and split again at the new width, and
+     * lines which no longer fit on the screen are moved into the history.
+     *
+     * Only the lines on the screen are rewrapped, the history is left as it is.
+     * Disabled by default.
+     */
+    void setReflowLines(bool enable);
+    /** Returns true if lines are rewrapped on resizing.  See setReflowLines() */
+    bool reflowLines() const;
+
     /**
      * Returns the current screen image.
      * The result is an array of Characters of size [getLines()][getColumns()] which
@@ -377,6 +427,11 @@ public:
      * other attributes control the size of characters in the line.
      */
     QVector<LineProperty> getLineProperties(int startLine , int endLine) const;
+    /**
+     * Copies the attributes of the lines from @p startLine to @p endLine
+     * into @p dest, which must have room for them.  See getLineProperties()
+     */
+    void getLineProperties(LineProperty* dest, int startLine, int endLine) const;
 
     /** Return the number of lines. */
     int getLines() const {
@@ -392,10 +447,62 @@ public:
      * Sets the type of storage used to keep lines in the history.
      * If @p copyPreviousScroll is true then the contents of the previous
      * history buffer are copied into the new scroll.
+     *
+     * Large histories are copied by later calls to convertHistory(), the
+     * lines being read from the previous scroll until they are all copied.
      */
     void setScroll(const HistoryType& , bool copyPreviousScroll = true);
+    /**
+     * Returns true if the lines of the previous history buffer are still
+     * being copied into the scroll set by setScroll()
+     */
+    bool isConvertingHistory() const;
+    /**
+     * Copies up to @p lineCount more lines of the previous history buffer
+     * into the scroll set by setScroll().  Returns true if there are lines
+     * left to copy.
+     */
+    bool convertHistory(int lineCount);
     /** Returns the type of storage used to keep lines in the history. */
     const HistoryType& getScroll() const;
+    /** Removes all lines from the history buffer. */
+    void clearHistory();
+    /** Returns the number of bytes of memory used by the history buffer. */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Returns the number of bytes of memory which the history buffer keeps
+     * using once a conversion started by setScroll() has finished.
+     */
+    qint64 retainedHistoryMemoryUsage() const;
+    /** Returns the number of bytes of the files the history buffer is kept in. */
+    qint64 historyFileSize() const;
+    /** Returns the number of bytes of memory used by the screen image. */
+    qint64 screenMemoryUsage() const;
+    /**
+     * Gives back the memory which the lines of the screen image reserved
+     * beyond their current length.
+     */
+    void squeezeLines();
+    /**
+     * Gives back memory which the history buffer holds but does not need
+     * for the lines it currently stores.
+     */
+    void compactHistory();
+    /**
+     * Sets whether an index of the lines added to the history is kept, which
+     * lets findCandidateLines() narrow searches down.  The index takes 16
+     * bytes for each line, and covers the lines added after it is enabled.
+     */
+    void setHistoryIndexEnabled(bool enable);
+    /**
+     * Narrows the lines from @p startLine to @p endLine, numbered as in
+     * writeToStream(), down to the first and last of them which may contain
+     * @p text, using the index of the history.  Without an index the lines
+     * are left as they are.
+     *
+     * Returns false if none of the lines can contain @p text.
+     */
+    bool findCandidateLines(const QString& text, int& startLine, int& endLine) const;
     /**
      * Returns true if this screen keeps lines that are scrolled off the screen
      * in a history buffer.
@@ -440,6 +547,18 @@ public:
       */
     bool isSelected(const int column, const int line) const;
 
+    /**
+     * Retrieves the range of columns of @p line which are part of the
+     * current selection, so that the selection can be tested once per line
+     * rather than once per character.
+     *
+     * @param line The line index, where 0 is the first line in the history
+     * @param startColumn Set to the first selected column
+     * @param endColumn Set to the last selected column
+     * @return false if no character of @p line is selected
+     */
+    bool selectedColumns(int line, int& startColumn, int& endColumn) const;
+
     /**
      * Convenience method.  Returns the currently selected text.
      * @param preserveLineBreaks Specifies whether new line characters should
@@ -460,6 +579,27 @@ public:
      */
     QString text(int startIndex, int endIndex, bool preserveLineBreaks, bool trimTrailingSpaces = false) const;
 
+    /**
+     * Retrieves the extent of the current selection, as text indices which can
+     * be passed to rangeText() later on.  The indices remain valid until the
+     * output changes, a snapshot() of their lines keeps them valid for longer.
+     *
+     * @param startIndex Set to the index of the first selected character
+     * @param endIndex Set to the index of the last selected character
+     * @param blockSelection Set to whether the selection is a block selection
+     * @return false if there is no selection, in which case the arguments are
+     * left unchanged
+     */
+    bool getSelectionRange(int& startIndex, int& endIndex, bool& blockSelection) const;
+
+    /**
+     * Returns the text between two indices, as text() does, but lets the caller
+     * choose whether the indices span a block or a stream of text instead of
+     * following the current selection mode.
+     */
+    QString rangeText(int startIndex, int endIndex, bool blockSelection,
+                      bool preserveLineBreaks, bool trimTrailingSpaces = false) const;
+
     /**
      * Copies part of the output to a stream.
      *
@@ -469,6 +609,14 @@ public:
      */
     void writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine, int toLine) const;
 
+    /**
+     * Returns a snapshot of the lines from @p startLine to @p endLine of the
+     * output, counting the lines of the history first.  The snapshot stays
+     * the same while the screen changes, and it can be read on another
+     * thread.  See ScreenSnapshot.
+     */
+    ScreenSnapshot snapshot(int startLine, int endLine) const;
+
     /**
      * Copies the selected characters, set using @see setSelBeginXY and @see setSelExtentXY
      * into a stream.
@@ -556,6 +704,49 @@ public:
      */
     void resetDroppedLines();
 
+    /**
+     * Returns a counter which is incremented whenever the image is changed.
+     *
+     * Views can remember the value when they retrieve the image with
+     * getImage() and compare it with lineGeneration() later on, to find
+     * the lines which need to be retrieved and drawn again.
+     */
+    quint64 generation() const {
+        return _generation;
+    }
+
+    /**
+     * Returns the value of generation() when @p line was last changed.
+     * @p line is counted from the first line in the history, like the
+     * lines passed to getImage().
+     *
+     * Changes which affect the whole image, such as changes to the
+     * MODE_Screen mode, are reported for every line.  Changes to the
+     * selection are not, since the selection is not part of the image.
+     * Lines in the history only change when the history is replaced or
+     * when its oldest lines are dropped, see droppedLines().
+     */
+    quint64 lineGeneration(int line) const;
+
+    /**
+     * Returns the value of generation() when the lines in the history were
+     * last changed, other than by adding lines to it or dropping its
+     * oldest lines.  While this stays the same, a line of the history keeps
+     * its contents as it moves up, see discardedLines().
+     */
+    quint64 historyGeneration() const {
+        return _imageGeneration;
+    }
+
+    /**
+     * Returns the number of lines which have been dropped from the history
+     * since the screen was created.  Unlike droppedLines(), this is never
+     * reset.
+     */
+    qint64 discardedLines() const {
+        return _discardedLines;
+    }
+
     /**
       * Fills the buffer @p dest with @p count instances of the default (ie. blank)
       * Character style.
@@ -570,18 +761,24 @@ public:
         return _currentTerminalDisplay;
     }
 
-    QSet<ushort> usedExtendedChars() const {
-        QSet<ushort> result;
-        for (int i = 0; i < _lines; ++i) {
-            const ImageLine& il = _screenLines[i];
-            for (int j = 0; j < _columns; ++j) {
-                if (il[j].rendition & RE_EXTENDED_CHAR) {
-                    result << il[j].character;
-                }
-            }
-        }
-        return result;
-    }
+    /**
+     * Returns the hashes of the ExtendedCharTable sequences used by the
+     * characters on the screen and in the history.
+     *
+     * Reading the whole history is slow, so unless @p exact is true the
+     * hashes of the history are those of all the lines added to it since
+     * it was last read, some of which may have been dropped from it since.
+     */
+    QSet<ushort> usedExtendedChars(bool exact = false) const;
+    /**
+     * Sets the bits of @p used for the indexes of the RGB colors used by the
+     * characters on the screen and in the history, and by the colors
+     * characters are written with.  See rgbColorIndex()
+     *
+     * As with usedExtendedChars(), the history is only read in full if
+     * @p exact is true or the colors of its lines are not known.
+     */
+    void usedRgbColors(QBitArray& used, bool exact = false) const;
 
     static const Character DefaultChar;
 
@@ -597,13 +794,19 @@ private:
     //count - the number of characters on the line to copy
     //decoder - a decoder which converts terminal characters (an Character array) into text
     //appendNewLine - if true a new line character (\n) is appended to the end of the line
+    //buffer - the characters are copied here when they cannot be decoded where they
+    //         are stored, it is made larger when the line does not fit
+    //historyLines - lines read from the history beforehand, used instead of reading
+    //         the line from the history if they contain it
     int  copyLineToStream(int line,
                           int start,
                           int count,
                           TerminalCharacterDecoder* decoder,
                           bool appendNewLine,
                           bool preserveLineBreaks,
-                          bool trimTrailingSpaces) const;
+                          bool trimTrailingSpaces,
+                          QVector<Character>& buffer,
+                          const HistoryLines* historyLines = 0) const;
 
     //fills a section of the screen image with the character 'c'
     //the parameters are specified as offsets from the start of the screen image.
@@ -614,28 +817,100 @@ private:
     //the parameters are specified as offsets from the start of the screen image.
     //the loc(x,y) macro can be used to generate these values from a column,line pair.
     //
-    //NOTE: moveImage() can only move whole lines
+    //NOTE: moveImage() can only move whole lines, and the source lines which
+    //are not overwritten are left undefined, callers need to clear them
     void moveImage(int dest, int sourceBegin, int sourceEnd);
+    // swaps the cells, properties and fill of two lines of the screen,
+    // which only exchanges the lines' data pointers
+    void swapLines(int first, int second);
+    // adjusts the selection after moveImage() moved the lines between
+    // 'sourceBegin' and 'sourceEnd' to 'dest'
+    void moveSelection(int dest, int sourceBegin, int sourceEnd);
     // scroll up 'i' lines in current region, clearing the bottom 'i' lines
     void scrollUp(int from, int i);
     // scroll down 'i' lines in current region, clearing the top 'i' lines
     void scrollDown(int from, int i);
+    // moves the top 'n' lines into the history and scrolls the rest of the
+    // current region up by 'n' lines.  The lines are added to the history
+    // together and the region is moved once, however many lines scroll
+    void scrollUpIntoHistory(int n = 1);
+    // adds a line which was moved into the history to its index
+    void indexHistoryLine(const QVector<Character>& line, bool wrapped);
+    // adds the extended characters of 'line' to _historyExtendedChars
+    void addHistoryExtendedChars(const QVector<Character>& line);
+    // adds the RGB colors of 'line' to _historyRgbColors
+    void addHistoryRgbColors(const QVector<Character>& line) const;
 
     //when we handle scroll commands, we need to know which screenwindow will scroll
     TerminalDisplay* _currentTerminalDisplay;
 
-    void addHistLine();
+    // adds screen line 'y' to the history, which leaves the line
+    // undefined, callers need to clear it
+    void addHistLine(int y = 0);
+
+    // returns the absolute position of the character at ('x','y'), where 'y'
+    // is a line index with 0 being the first line in the history.  See
+    // _discardedLines
+    qint64 absolutePosition(int x, int y) const {
+        return (y + _discardedLines) * _columns + x;
+    }
+    // converts an absolute position back into an offset from the start of
+    // the history, as generated by the loc(x,y) macro.  Positions in lines
+    // which have been discarded from the history are moved to its start
+    int imagePosition(qint64 position) const {
+        return int(qMax(Q_INT64_C(0), position - _discardedLines * _columns));
+    }
+
+    // rewraps the lines on the screen to 'newColumns', see setReflowLines()
+    void rewrapLines(int newColumns);
 
     void initTabStops();
 
     void updateEffectiveRendition();
     void reverseRendition(Character& p) const;
 
+    // ensures that screen line 'y' has at least 'length' cells, the new
+    // cells are set to the line's fill character, see _lineFill
+    void extendLine(int y, int length);
+
+    // returns the index of screen line 'line' in _screenLines, _lineProperties,
+    // _lineFill and _lineGenerations, see _screenLinesOffset
+    int lineIndex(int line) const {
+        const int index = line + _screenLinesOffset;
+        return index < _lines ? index : index - _lines;
+    }
+
+    // records that screen line 'line' has been changed, see lineGeneration()
+    void markLineDirty(int line) {
+        _lineGenerations[lineIndex(line)] = ++_generation;
+    }
+    // records that the screen lines from 'first' to 'last' have been changed
+    void markLinesDirty(int first, int last);
+    // records a change which affects all lines, including those in the history
+    void markImageDirty();
+    // records a change which affects all screen lines, without visiting them
+    void markScreenDirty();
+    // records the lines affected by a change of mode 'mode'
+    void markModeChanged(int mode);
+    // updates _writeModes from the current modes
+    void updateWriteModes();
+
+    // writes characters as displayCharacter() and displayCharacters() do,
+    // with the insert and wrap modes fixed when compiling, which keeps the
+    // tests of these modes out of the loops
+    template <bool InsertMode, bool WrapMode>
+    void writeCharacter(unsigned short c);
+    template <bool InsertMode, bool WrapMode>
+    void writeCharacters(const unsigned short* chars, int count);
+
     bool isSelectionValid() const;
     // copies text from 'startIndex' to 'endIndex' to a stream
     // startIndex and endIndex are positions generated using the loc(x,y) macro
+    // if 'blockSelectionMode' is true, only the columns from the left of
+    // 'startIndex' to the right of 'endIndex' are copied from each line
     void writeToStream(TerminalCharacterDecoder* decoder, int startIndex,
-                       int endIndex, bool preserveLineBreaks = true, bool trimTrailingSpaces = false) const;
+                       int endIndex, bool blockSelectionMode,
+                       bool preserveLineBreaks = true, bool trimTrailingSpaces = false) const;
     // copies 'count' lines from the screen buffer into 'dest',
     // starting from 'startLine', where 0 is the first line in the screen buffer
     void copyFromScreen(Character* dest, int startLine, int count) const;
@@ -648,17 +923,67 @@ private:
     int _columns;
 
     typedef QVector<Character> ImageLine;      // [0..columns]
+
+    // the following parts of copyLineToStream() are shared with
+    // ScreenSnapshot, which decodes its copies of the lines with them.
+    //
+    // returns the cells of the screen line 'line', whose cells past its end
+    // are 'fill', from 'start' on and sets 'count' to the number of them,
+    // as copyLineToStream() takes them
+    static const Character* screenLineCells(const ImageLine& line, const Character& fill,
+                                            LineProperty properties, int columns,
+                                            int start, int& count, bool trimTrailingSpaces,
+                                            QVector<Character>& buffer);
+    // decodes 'count' cells of a line with 'properties' and appends a new
+    // line as copyLineToStream() does, returns the number of cells decoded
+    static int decodeCells(const Character* characters, int count, LineProperty properties,
+                           TerminalCharacterDecoder* decoder, bool appendNewLine,
+                           bool preserveLineBreaks, QVector<Character>& buffer);
+    friend class ScreenSnapshot;
+
     ImageLine*          _screenLines;    // [lines]
+    // The screen lines are kept in a ring, _screenLinesOffset is the index
+    // of the first screen line.  Scrolling the whole screen up moves the
+    // offset rather than every line, see moveImage()
+    int _screenLinesOffset;
 
     int _scrolledLines;
     QRect _lastScrolledRegion;
 
     int _droppedLines;
+    // the number of lines which have been discarded from the top of the
+    // history since the screen was created.  Adding this to a line index
+    // gives an absolute line number which stays the same for a line while
+    // it scrolls through the screen and history.
+    qint64 _discardedLines;
 
     QVarLengthArray<LineProperty, 64> _lineProperties;
 
+    // The character which the cells past the end of each screen line are
+    // filled with.  Clearing a line to its end with a character other than
+    // DefaultChar shrinks the line and records the character here instead of
+    // filling every cell, see clearImage() and extendLine()
+    QVector<Character> _lineFill;        // [lines]
+
+    // change tracking, see generation() and lineGeneration()
+    quint64 _generation;
+    quint64 _imageGeneration;
+    quint64 _screenGeneration;
+    QVector<quint64> _lineGenerations;   // [lines]
+
     // history buffer ---------------
     HistoryScroll* _history;
+    // the same as _history while the history is converted, see setScroll()
+    HistoryScrollConversion* _historyConversion;
+    // the index of the history, or 0 if it is not kept
+    HistorySearchIndex* _historyIndex;
+    // the extended characters of the lines added to the history, which
+    // is read again when they are not known, see usedExtendedChars()
+    mutable QSet<ushort> _historyExtendedChars;
+    mutable bool _historyExtendedCharsKnown;
+    // the same for the indexes of the RGB colors, see usedRgbColors()
+    mutable QBitArray _historyRgbColors;
+    mutable bool _historyRgbColorsKnown;
 
     // cursor location
     int _cuX;
@@ -677,20 +1002,39 @@ private:
     int _currentModes[MODES_SCREEN];
     int _savedModes[MODES_SCREEN];
 
+    // the modes which change how characters are written, kept up to date
+    // whenever the modes change so that displayCharacter() and
+    // displayCharacters() pick the variant of writeCharacter() and
+    // writeCharacters() for them with a single switch
+    enum WriteMode {
+        WriteWrap = 1,  // MODE_Wrap
+        WriteInsert = 2 // MODE_Insert
+    };
+    int _writeModes;
+
     // ----------------------------
 
     QBitArray _tabStops;
 
     // selection -------------------
-    int _selBegin; // The first location selected.
-    int _selTopLeft;    // TopLeft Location.
-    int _selBottomRight;    // Bottom Right Location.
+    // The selection is stored in absolute positions, see absolutePosition(),
+    // which do not change as lines are added to and discarded from the
+    // history.  -1 if there is no selection.
+    qint64 _selBegin; // The first location selected.
+    qint64 _selTopLeft;    // TopLeft Location.
+    qint64 _selBottomRight;    // Bottom Right Location.
     bool _blockSelectionMode;  // Column selection mode
+    // false if there is no selection or it has been scrolled into the
+    // history, so that writing characters does not have to check it.
+    // See checkSelection()
+    bool _selectionOnScreen;
 
     // effective colors and rendition ------------
-    CharacterColor _effectiveForeground; // These are derived from
-    CharacterColor _effectiveBackground; // the cu_* variables above
-    quint8 _effectiveRendition;          // to speed up operation
+    // The cell which characters written at the cursor start from, derived
+    // from _currentRendition and the current colors by
+    // updateEffectiveRendition(), so that writing a character only copies
+    // it and sets the character itself
+    Character _effectiveCharacter;
 
     class SavedState
     {
@@ -708,6 +1052,12 @@ private:
 
     // last position where we added a character
     int _lastPos;
+
+    // the first half of a surrogate pair passed to displayCharacter(),
+    // or 0 if there is none
+    ushort _highSurrogate;
+
+    bool _reflowLines;
 };
 }
 
@@ -0,0 +1,284 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ScreenRenderer.h"
+
+// Qt
+#include <QtCore/QFileInfo>
+#include <QtGui/QFontMetrics>
+#include <QtGui/QPainter>
+#include <QtGui/QPrinter>
+
+// Konsole
+#include "ColorScheme.h"
+#include "ExtendedCharTable.h"
+#include "Screen.h"
+
+using Konsole::ScreenRenderer;
+
+// the lines of the screen are copied in blocks of this many lines, so that
+// a snapshot of the whole history does not need to copy all of it at once
+static const int SNAPSHOT_BLOCK_LINES = 1000;
+
+#define REPCHAR   "ABCDEFGHIJKLMNOPQRSTUVWXYZ" \
+    "abcdefgjijklmnopqrstuvwxyz" \
+    "0123456789./+@"
+
+// returns the width of a cell with the font metrics 'fm', the same way
+// as the terminal display computes it
+static int cellWidth(const QFontMetrics& fm)
+{
+    return qMax(1, qRound(fm.width(REPCHAR) / static_cast<double>(qstrlen(REPCHAR))));
+}
+
+ScreenRenderer::ScreenRenderer()
+    : _boldIntense(true)
+    , _printerFriendly(false)
+    , _columns(0)
+{
+    setColorTable(ColorScheme::defaultTable);
+}
+
+void ScreenRenderer::setFont(const QFont& font)
+{
+    _font = font;
+}
+
+void ScreenRenderer::setColorTable(const ColorEntry* table)
+{
+    for (int i = 0; i < TABLE_COLORS; i++)
+        _colorTable[i] = table[i];
+}
+
+void ScreenRenderer::setBoldIntense(bool boldIntense)
+{
+    _boldIntense = boldIntense;
+}
+
+void ScreenRenderer::setPrinterFriendly(bool printerFriendly)
+{
+    _printerFriendly = printerFriendly;
+}
+
+void ScreenRenderer::setLines(const Screen* screen, int startLine, int endLine)
+{
+    _columns = screen->getColumns();
+    _lines.clear();
+    _lines.reserve(endLine - startLine + 1);
+
+    QVector<Character> cells;
+    for (int line = startLine; line <= endLine; line += SNAPSHOT_BLOCK_LINES) {
+        const int blockEnd = qMin(endLine, line + SNAPSHOT_BLOCK_LINES - 1);
+        const int blockLines = blockEnd - line + 1;
+
+        cells.resize(blockLines * _columns);
+        screen->getImage(cells.data(), cells.size(), line, blockEnd);
+
+        for (int i = 0; i < blockLines; i++)
+            addLine(cells.constData() + i * _columns);
+    }
+}
+
+void ScreenRenderer::addLine(const Character* cells)
+{
+    const QRgb defaultForeground = _colorTable[DEFAULT_FORE_COLOR].color.rgb();
+    const QRgb defaultBackground = _colorTable[DEFAULT_BACK_COLOR].color.rgb();
+
+    QVector<Run> runs;
+    Run run;
+    run.width = 0;
+
+    for (int column = 0; column <= _columns; column++) {
+        const Character* cell = cells + column;
+
+        // the second half of a double width character belongs to the run
+        // of the first half
+        if (column < _columns && cell->character == 0 && run.width > 0) {
+            run.width++;
+            continue;
+        }
+
+        Run next;
+        if (column < _columns) {
+            const ColorEntry::FontWeight weight = cell->fontWeight(_colorTable);
+            if (weight == ColorEntry::UseCurrentFormat)
+                next.bold = ((cell->rendition & RE_BOLD) && _boldIntense) || _font.bold();
+            else
+                next.bold = (weight == ColorEntry::Bold);
+            next.underline = (cell->rendition & RE_UNDERLINE) || _font.underline();
+            next.italic = (cell->rendition & RE_ITALIC) || _font.italic();
+
+            if (_printerFriendly) {
+                next.foreground = qRgb(0, 0, 0);
+                next.background = qRgb(255, 255, 255);
+            } else {
+                next.foreground = cell->foregroundColor.isValid() ?
+                                  cell->foregroundColor.rgb(_colorTable) : defaultForeground;
+                next.background = cell->backgroundColor.isValid() ?
+                                  cell->backgroundColor.rgb(_colorTable) : defaultBackground;
+            }
+        }
+
+        const bool sameStyle = column < _columns && run.width > 0 &&
+                               next.foreground == run.foreground &&
+                               next.background == run.background &&
+                               next.bold == run.bold && next.underline == run.underline &&
+                               next.italic == run.italic;
+
+        if (!sameStyle) {
+            // runs of blanks without a background of their own draw nothing
+            const bool hasBackground = !_printerFriendly && run.background != defaultBackground;
+            if (run.width > 0 && (hasBackground || run.underline || !run.text.trimmed().isEmpty()))
+                runs << run;
+
+            if (column == _columns)
+                break;
+
+            run = next;
+            run.column = column;
+            run.width = 0;
+            run.text.clear();
+        }
+
+        if (cell->rendition & RE_EXTENDED_CHAR) {
+            ushort length = 0;
+            const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(cell->character, length);
+            if (chars)
+                run.text.append(QString::fromUtf16(chars, length));
+        } else if (cell->plane != 0) {
+            run.text.append(QChar(QChar::highSurrogate(cell->codePoint())));
+            run.text.append(QChar(QChar::lowSurrogate(cell->codePoint())));
+        } else if (cell->character != 0) {
+            run.text.append(QChar(cell->character));
+        }
+        run.width++;
+    }
+
+    _lines << runs;
+}
+
+int ScreenRenderer::lineCount() const
+{
+    return _lines.count();
+}
+
+int ScreenRenderer::columnCount() const
+{
+    return _columns;
+}
+
+QSize ScreenRenderer::size(QPaintDevice* device) const
+{
+    const QFontMetrics fm = device ? QFontMetrics(_font, device) : QFontMetrics(_font);
+    return QSize(_columns * cellWidth(fm), _lines.count() * fm.height());
+}
+
+void ScreenRenderer::render(QPainter& painter, int startLine, int count) const
+{
+    QFont font(_font, painter.device());
+    const QFontMetrics fm(font, painter.device());
+    const int width = cellWidth(fm);
+    const int height = fm.height();
+
+    painter.save();
+    painter.setFont(font);
+
+    if (!_printerFriendly) {
+        painter.fillRect(0, 0, _columns * width, count * height,
+                         _colorTable[DEFAULT_BACK_COLOR].color);
+    }
+
+    const QRgb defaultBackground = _colorTable[DEFAULT_BACK_COLOR].color.rgb();
+    const int endLine = qMin(_lines.count(), startLine + count);
+
+    for (int line = startLine; line < endLine; line++) {
+        const int y = (line - startLine) * height;
+
+        foreach(const Run & run, _lines[line]) {
+            const QRect rect(run.column * width, y, run.width * width, height);
+
+            if (!_printerFriendly && run.background != defaultBackground)
+                painter.fillRect(rect, QColor(run.background));
+
+            if (font.bold() != run.bold || font.underline() != run.underline ||
+                    font.italic() != run.italic) {
+                font.setBold(run.bold);
+                font.setUnderline(run.underline);
+                font.setItalic(run.italic);
+                painter.setFont(font);
+            }
+            painter.setPen(QColor(run.foreground));
+            painter.drawText(rect.x(), y + fm.ascent(), run.text);
+        }
+    }
+
+    painter.restore();
+}
+
+QImage ScreenRenderer::toImage() const
+{
+    QImage image(size(), QImage::Format_RGB32);
+    image.fill(_printerFriendly ? qRgb(255, 255, 255) : _colorTable[DEFAULT_BACK_COLOR].color.rgb());
+
+    QPainter painter(&image);
+    render(painter, 0, _lines.count());
+
+    return image;
+}
+
+bool ScreenRenderer::print(QPrinter& printer, bool scaleToPage) const
+{
+    QPainter painter;
+    if (!painter.begin(&printer))
+        return false;
+
+    const QSize contentSize = size(&printer);
+    const QRect page = printer.pageRect();
+
+    double scale = 1.0;
+    if (scaleToPage && contentSize.width() > 0)
+        scale = page.width() / static_cast<double>(contentSize.width());
+
+    const int lineHeight = _lines.isEmpty() ? 1 : contentSize.height() / _lines.count();
+    const int linesPerPage = qMax(1, static_cast<int>(page.height() / (lineHeight * scale)));
+
+    painter.scale(scale, scale);
+
+    for (int line = 0; line < _lines.count(); line += linesPerPage) {
+        if (line > 0)
+            printer.newPage();
+        render(painter, line, linesPerPage);
+    }
+
+    return painter.end() && printer.printerState() != QPrinter::Error;
+}
+
+bool ScreenRenderer::save(const QString& fileName) const
+{
+    if (QFileInfo(fileName).suffix().toLower() == "pdf") {
+        QPrinter printer(QPrinter::HighResolution);
+        printer.setOutputFormat(QPrinter::PdfFormat);
+        printer.setOutputFileName(fileName);
+
+        return print(printer, true);
+    }
+
+    return toImage().save(fileName);
+}
@@ -0,0 +1,139 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SCREENRENDERER_H
+#define SCREENRENDERER_H
+
+// Qt
+#include <QtCore/QSize>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QtGui/QFont>
+#include <QtGui/QImage>
+
+// Konsole
+#include "Character.h"
+#include "konsole_export.h"
+
+class QPainter;
+class QPaintDevice;
+class QPrinter;
+
+namespace Konsole
+{
+class Screen;
+
+/**
+ * Renders lines of a terminal screen and its history without a terminal
+ * display.  Used to print the output of a session or to save it as an
+ * image or a PDF document.
+ *
+ * Set the font and the colors and take a snapshot of the lines with
+ * setLines(), which has to happen in the GUI thread.  The snapshot holds
+ * everything needed to render it, so a copy of the renderer can then be
+ * used to render into a QImage or a QPrinter from another thread, without
+ * blocking the user interface for large ranges of lines.
+ *
+ * The snapshot does not keep the double width or double height of lines
+ * and blinking text is always shown.
+ */
+class KONSOLEPRIVATE_EXPORT ScreenRenderer
+{
+public:
+    ScreenRenderer();
+
+    /** Sets the font with which the text is rendered */
+    void setFont(const QFont& font);
+    /** Sets the TABLE_COLORS entries of the color table */
+    void setColorTable(const ColorEntry* table);
+    /** Sets whether intense colors are rendered in bold.  See TerminalDisplay::setBoldIntense() */
+    void setBoldIntense(bool boldIntense);
+    /**
+     * Sets whether the text is rendered black on white without any
+     * background, which is what most printers are best at.  This has to be
+     * set before calling setLines().
+     */
+    void setPrinterFriendly(bool printerFriendly);
+
+    /**
+     * Takes a snapshot of the lines from @p startLine to @p endLine of
+     * @p screen, counting the lines of the history first.  Uses the color
+     * table set with setColorTable().
+     */
+    void setLines(const Screen* screen, int startLine, int endLine);
+
+    /** Returns the number of lines in the snapshot */
+    int lineCount() const;
+    /** Returns the number of columns in the snapshot */
+    int columnCount() const;
+
+    /** Returns the size of the rendered lines with the font metrics of @p device */
+    QSize size(QPaintDevice* device = 0) const;
+
+    /**
+     * Renders @p count lines of the snapshot starting at @p startLine with
+     * @p painter.  The first line is drawn at the origin.
+     */
+    void render(QPainter& painter, int startLine, int count) const;
+
+    /** Renders the whole snapshot into an image */
+    QImage toImage() const;
+
+    /**
+     * Renders the whole snapshot on @p printer, as many lines on each page
+     * as fit.  If @p scaleToPage is true, the width of the lines is scaled
+     * to the width of the page.  Returns false if the printing failed.
+     */
+    bool print(QPrinter& printer, bool scaleToPage) const;
+
+    /**
+     * Renders the whole snapshot into the file @p fileName, as a PDF
+     * document if the name ends with ".pdf" and as an image in the format
+     * given by the extension otherwise.  Returns false if the file could
+     * not be written.
+     */
+    bool save(const QString& fileName) const;
+
+private:
+    // a run of cells of a line with the same attributes
+    struct Run {
+        int column;
+        int width;
+        QString text;
+        QRgb foreground;
+        QRgb background;
+        bool bold;
+        bool underline;
+        bool italic;
+    };
+
+    void addLine(const Character* cells);
+
+    QFont _font;
+    ColorEntry _colorTable[TABLE_COLORS];
+    bool _boldIntense;
+    bool _printerFriendly;
+
+    int _columns;
+    QVector<QVector<Run> > _lines;
+};
+}
+
+#endif // SCREENRENDERER_H
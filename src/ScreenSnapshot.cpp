@@ -0,0 +1,186 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ScreenSnapshot.h"
+
+// Konsole
+#include "Screen.h"
+#include "TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+ScreenSnapshot::ScreenSnapshot()
+    : _firstLine(0)
+    , _lastLine(-1)
+    , _columns(0)
+    , _historyLines(0)
+    , _discardedLines(0)
+    , _historyGeneration(0)
+{
+}
+
+int ScreenSnapshot::firstLine() const
+{
+    return _firstLine;
+}
+
+int ScreenSnapshot::lastLine() const
+{
+    return _lastLine;
+}
+
+int ScreenSnapshot::columns() const
+{
+    return _columns;
+}
+
+int ScreenSnapshot::historyLines() const
+{
+    return _historyLines;
+}
+
+qint64 ScreenSnapshot::discardedLines() const
+{
+    return _discardedLines;
+}
+
+quint64 ScreenSnapshot::historyGeneration() const
+{
+    return _historyGeneration;
+}
+
+void ScreenSnapshot::writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine, int toLine) const
+{
+    Q_ASSERT(fromLine >= _firstLine && toLine <= _lastLine);
+
+    const ExtendedCharTable* previousTable = decoder->extendedCharTable();
+    const QVector<QRgb>* previousColors = decoder->rgbColors();
+    decoder->setExtendedCharTable(&_extendedChars);
+    decoder->setRgbColors(&_rgbColors);
+
+    // the lines are decoded from this buffer when they cannot be decoded
+    // where they are, as in Screen::writeToStream()
+    QVector<Character> buffer(_columns + 1);
+
+    for (int line = fromLine; line <= toLine; line++) {
+        const bool lastLine = (line == toLine);
+        int count = lastLine ? _columns : -1;
+
+        const Character* characters = 0;
+        LineProperty properties = 0;
+
+        if (line < _historyLines) {
+            const int lineLength = _history.lineLength(line);
+            count = (count == -1) ? lineLength : qMin(count, lineLength);
+
+            characters = _history.cells(line);
+            if (_history.isWrapped(line))
+                properties |= LINE_WRAPPED;
+        } else {
+            const int index = line - qMax(_firstLine, _historyLines);
+            properties = _lineProperties[index];
+            characters = Screen::screenLineCells(_screenLines[index], _lineFill[index], properties,
+                                                 _columns, 0, count, false, buffer);
+        }
+
+        const int copied = Screen::decodeCells(characters, count, properties, decoder,
+                                               !lastLine, true, buffer);
+
+        // the last line ends with a new line as well, unless it fills all
+        // of the columns
+        if (lastLine && copied < _columns) {
+            Character newLineChar('\n');
+            decoder->decodeLine(&newLineChar, 1, 0);
+        }
+    }
+
+    decoder->setExtendedCharTable(previousTable);
+    decoder->setRgbColors(previousColors);
+}
+
+void ScreenSnapshot::writeToStream(TerminalCharacterDecoder* decoder, int startIndex, int endIndex,
+                                   bool blockSelection, bool preserveLineBreaks,
+                                   bool trimTrailingSpaces) const
+{
+    writeToStream(decoder, startIndex, endIndex, startIndex / _columns, endIndex / _columns,
+                  blockSelection, preserveLineBreaks, trimTrailingSpaces);
+}
+
+void ScreenSnapshot::writeToStream(TerminalCharacterDecoder* decoder, int startIndex, int endIndex,
+                                   int fromLine, int toLine, bool blockSelection,
+                                   bool preserveLineBreaks, bool trimTrailingSpaces) const
+{
+    const int top = startIndex / _columns;
+    const int left = startIndex % _columns;
+
+    const int bottom = endIndex / _columns;
+    const int right = endIndex % _columns;
+
+    Q_ASSERT(fromLine >= qMax(top, _firstLine) && toLine <= qMin(bottom, _lastLine));
+
+    const ExtendedCharTable* previousTable = decoder->extendedCharTable();
+    const QVector<QRgb>* previousColors = decoder->rgbColors();
+    decoder->setExtendedCharTable(&_extendedChars);
+    decoder->setRgbColors(&_rgbColors);
+
+    QVector<Character> buffer(_columns + 1);
+
+    // the lines are copied as Screen::writeToStream() and
+    // Screen::copyLineToStream() copy them
+    for (int y = fromLine; y <= toLine; y++) {
+        int start = 0;
+        if (y == top || blockSelection) start = left;
+
+        int count = -1;
+        if (y == bottom || blockSelection) count = right - start + 1;
+
+        const Character* characters = 0;
+        LineProperty properties = 0;
+        int length = count;
+
+        if (y < _historyLines) {
+            const int lineLength = _history.lineLength(y);
+            start = qMin(start, qMax(0, lineLength - 1));
+            length = (count == -1) ? lineLength - start : qMin(start + count, lineLength) - start;
+
+            characters = _history.cells(y) + start;
+            if (_history.isWrapped(y))
+                properties |= LINE_WRAPPED;
+        } else {
+            const int index = y - qMax(_firstLine, _historyLines);
+            properties = _lineProperties[index];
+            characters = Screen::screenLineCells(_screenLines[index], _lineFill[index], properties,
+                                                 _columns, start, length, trimTrailingSpaces, buffer);
+        }
+
+        const int copied = Screen::decodeCells(characters, length, properties, decoder,
+                                               y != bottom, preserveLineBreaks, buffer);
+
+        // a selection which goes beyond the end of its last line
+        // ends with a new line
+        if (y == bottom && copied < count) {
+            Character newLineChar('\n');
+            decoder->decodeLine(&newLineChar, 1, 0);
+        }
+    }
+
+    decoder->setExtendedCharTable(previousTable);
+    decoder->setRgbColors(previousColors);
+}
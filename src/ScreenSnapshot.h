@@ -0,0 +1,136 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SCREENSNAPSHOT_H
+#define SCREENSNAPSHOT_H
+
+// Qt
+#include <QtCore/QVector>
+
+// Konsole
+#include "Character.h"
+#include "ExtendedCharTable.h"
+#include "History.h"
+#include "konsole_export.h"
+
+namespace Konsole
+{
+class TerminalCharacterDecoder;
+
+/**
+ * A copy of a range of lines of a Screen and its history, which stays the
+ * same while the emulation keeps writing to the screen.  Snapshots are
+ * taken with Screen::snapshot() on the GUI thread, and can then be read on
+ * any thread, which lets readers such as the search decode large ranges of
+ * the output without blocking the user interface.
+ *
+ * Taking a snapshot needs no locks and copies little: the screen lines are
+ * implicitly shared with the screen, which copies a line only once it
+ * writes to it, and the sequences of extended characters are shared with
+ * ExtendedCharTable::instance in the same way.  The lines of the history
+ * never change once they have been added, only the oldest of them are
+ * dropped, so they are read into the snapshot in one go with
+ * HistoryScroll::readLines().  The table of RGB colors is shared with the
+ * snapshot as well, for decoders which write colors such as HTMLDecoder.
+ *
+ * The line numbers of the snapshot are those of the screen when it was
+ * taken.  historyLines() and discardedLines() tell how to map them to the
+ * lines of the screen later on, as long as historyGeneration() has not
+ * changed in the meantime.
+ */
+class KONSOLEPRIVATE_EXPORT ScreenSnapshot
+{
+public:
+    /** Constructs an empty snapshot */
+    ScreenSnapshot();
+
+    /** Returns the first line in the snapshot */
+    int firstLine() const;
+    /** Returns the last line in the snapshot */
+    int lastLine() const;
+    /** Returns the number of columns of the screen */
+    int columns() const;
+
+    /** Returns the number of lines which were in the history */
+    int historyLines() const;
+    /** Returns Screen::discardedLines() at the time of the snapshot */
+    qint64 discardedLines() const;
+    /** Returns Screen::historyGeneration() at the time of the snapshot */
+    quint64 historyGeneration() const;
+
+    /**
+     * Copies the lines from @p fromLine to @p toLine of the snapshot to a
+     * stream, with the same result as Screen::writeLinesToStream() had when
+     * the snapshot was taken.  This may be called on any thread.
+     *
+     * @param decoder A decoder which converts terminal characters into text.
+     * It looks up the extended characters in the copy of the table held by
+     * the snapshot while the lines are written, and the RGB colors in the
+     * copy of the table of RGB colors.
+     * @param fromLine The first line to copy
+     * @param toLine The last line to copy
+     */
+    void writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine, int toLine) const;
+
+    /**
+     * Copies the text between two indices to a stream, with the same result
+     * as Screen::rangeText() had for them when the snapshot was taken.  The
+     * indices are those of Screen::getSelectionRange(), and their lines must
+     * be part of the snapshot.  This may be called on any thread.
+     */
+    void writeToStream(TerminalCharacterDecoder* decoder, int startIndex, int endIndex,
+                       bool blockSelection, bool preserveLineBreaks,
+                       bool trimTrailingSpaces) const;
+    /**
+     * Copies the lines from @p fromLine to @p toLine of the text between
+     * two indices to a stream.  Only these lines have to be part of the
+     * snapshot, which lets a long range be copied with a snapshot of a few
+     * of its lines at a time.
+     */
+    void writeToStream(TerminalCharacterDecoder* decoder, int startIndex, int endIndex,
+                       int fromLine, int toLine, bool blockSelection,
+                       bool preserveLineBreaks, bool trimTrailingSpaces) const;
+
+private:
+    friend class Screen;
+
+    int _firstLine;
+    int _lastLine;
+    int _columns;
+
+    int _historyLines;
+    qint64 _discardedLines;
+    quint64 _historyGeneration;
+
+    // the lines of the snapshot which were in the history
+    HistoryLines _history;
+
+    // the lines of the snapshot which were on the screen, from the first
+    // line after the history on.  See Screen::_screenLines
+    QVector< QVector<Character> > _screenLines;
+    QVector<LineProperty> _lineProperties;
+    QVector<Character> _lineFill;
+
+    ExtendedCharTable _extendedChars;
+    // see rgbColorValues()
+    QVector<QRgb> _rgbColors;
+};
+}
+
+#endif // SCREENSNAPSHOT_H
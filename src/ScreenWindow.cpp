@@ -20,6 +20,9 @@
 // Own
 #include "ScreenWindow.h"
 
+// Standard
+#include <string.h>
+
 // Konsole
 #include "Screen.h"
 
@@ -34,17 +37,50 @@ ScreenWindow::ScreenWindow(QObject* parent)
     , _currentLine(0)
     , _trackOutput(true)
     , _scrollCount(0)
-{
+    , _allLinesDirty(true)
+    , _lastGeneration(0)
+    , _lastImageLine(-1)
+    , _lastLineCount(0)
+    , _propertiesScreen(0)
+    , _propertiesGeneration(0)
+    , _propertiesLine(-1)
+    , _propertiesLineCount(0)
+    , _prefetchFirstLine(0)
+    , _prefetchColumns(0)
+    , _prefetchGeneration(0)
+    , _prefetchDiscardedLines(0)
+{
+    _prefetchTimer.setSingleShot(true);
+    connect(&_prefetchTimer, SIGNAL(timeout()), this, SLOT(prefetchLines()));
 }
 ScreenWindow::~ScreenWindow()
 {
     delete[] _windowBuffer;
 }
+void ScreenWindow::releaseBuffers()
+{
+    delete[] _windowBuffer;
+    _windowBuffer = 0;
+    _windowBufferSize = 0;
+
+    _prefetchTimer.stop();
+    _prefetchBuffer = QVector<Character>();
+    _prefetchColumns = 0;
+
+    _lineProperties = QVector<LineProperty>();
+    _propertiesScreen = 0;
+}
+qint64 ScreenWindow::memoryUsage() const
+{
+    return (_windowBufferSize + _prefetchBuffer.capacity()) * sizeof(Character) +
+           _lineProperties.capacity() * sizeof(LineProperty);
+}
 void ScreenWindow::setScreen(Screen* screen)
 {
     Q_ASSERT(screen);
 
     _screen = screen;
+    _allLinesDirty = true;
 }
 
 Screen* ScreenWindow::screen() const
@@ -61,13 +97,34 @@ Character* ScreenWindow::getImage()
         _windowBufferSize = size;
         _windowBuffer = new Character[size];
         _bufferNeedsUpdate = true;
+        _allLinesDirty = true;
     }
 
     if (!_bufferNeedsUpdate)
         return _windowBuffer;
 
-    _screen->getImage(_windowBuffer, size,
-                      currentLine(), endWindowLine());
+    updateDirtyLines();
+
+    // only copy the runs of lines which changed since the buffer
+    // was last updated
+    const int firstLine = currentLine();
+    const int lastLine = endWindowLine();
+    const int columns = windowColumns();
+
+    int line = firstLine;
+    while (line <= lastLine) {
+        if (!_changedLines.testBit(line - firstLine)) {
+            line++;
+            continue;
+        }
+
+        int runEnd = line;
+        while (runEnd < lastLine && _changedLines.testBit(runEnd + 1 - firstLine))
+            runEnd++;
+
+        fetchLines(_windowBuffer + (line - firstLine) * columns, line, runEnd);
+        line = runEnd + 1;
+    }
 
     // this window may look beyond the end of the screen, in which
     // case there will be an unused area which needs to be filled
@@ -78,6 +135,163 @@ Character* ScreenWindow::getImage()
     return _windowBuffer;
 }
 
+void ScreenWindow::updateDirtyLines()
+{
+    if (_dirtyLines.size() != windowLines()) {
+        _dirtyLines.resize(windowLines());
+        _changedLines.resize(windowLines());
+        _allLinesDirty = true;
+    }
+
+    const int firstLine = currentLine();
+    const int lines = windowLines();
+
+    // when the window has been scrolled by less than its height, the
+    // lines which stay visible are moved within the buffer and only
+    // the lines which come into view need to be copied.  Lines beyond
+    // the end of the screen may have been filled with blanks, so this is
+    // only done while the window lies within the screen.
+    const int moved = _allLinesDirty ? 0 : firstLine - _lastImageLine;
+    if (moved != 0) {
+        if (_lastImageLine < 0 || qAbs(moved) >= lines ||
+                _lastImageLine + lines > _lastLineCount ||
+                firstLine + lines > lineCount()) {
+            _allLinesDirty = true;
+        } else {
+            const int columns = windowColumns();
+            const int keptLines = lines - qAbs(moved);
+            Character* const kept = _windowBuffer + qMax(0, moved) * columns;
+            Character* const target = _windowBuffer + qMax(0, -moved) * columns;
+            memmove((void*)target, (const void*)kept, keptLines * columns * sizeof(Character));
+
+            _lastCursorPosition.ry() -= moved;
+            // the display compares all of its lines after scrolling
+            _dirtyLines.fill(true);
+        }
+    }
+
+    // the character at the cursor position is marked in the image,
+    // so a line also changes when the cursor moves onto or off it
+    const QPoint cursor(_screen->getCursorX(),
+                        _screen->getHistLines() + _screen->getCursorY() - firstLine);
+
+    if (_allLinesDirty) {
+        _changedLines.fill(true);
+    } else {
+        _changedLines.fill(false);
+
+        // the lines which came into view
+        const int firstNewLine = moved > 0 ? lines - moved : 0;
+        for (int line = 0; line < qAbs(moved); line++)
+            _changedLines.setBit(firstNewLine + line);
+
+        const int lastLine = endWindowLine();
+        for (int line = firstLine; line <= lastLine; line++) {
+            if (_screen->lineGeneration(line) > _lastGeneration)
+                _changedLines.setBit(line - firstLine);
+        }
+
+        if (cursor != _lastCursorPosition) {
+            if (_lastCursorPosition.y() >= 0 && _lastCursorPosition.y() < _changedLines.size())
+                _changedLines.setBit(_lastCursorPosition.y());
+            if (cursor.y() >= 0 && cursor.y() < _changedLines.size())
+                _changedLines.setBit(cursor.y());
+        }
+    }
+
+    _dirtyLines |= _changedLines;
+
+    _allLinesDirty = false;
+    _lastGeneration = _screen->generation();
+    _lastImageLine = firstLine;
+    _lastLineCount = lineCount();
+    _lastCursorPosition = cursor;
+}
+
+int ScreenWindow::prefetchFirstLine() const
+{
+    return int(_prefetchFirstLine - (_screen->discardedLines() - _prefetchDiscardedLines));
+}
+
+bool ScreenWindow::isLinePrefetched(int line) const
+{
+    const int prefetchedLines = _prefetchColumns > 0 ? _prefetchBuffer.count() / _prefetchColumns : 0;
+    const int firstLine = prefetchFirstLine();
+    const int prefetchEnd = firstLine + prefetchedLines;
+
+    // the prefetched lines are history lines, they are only copied if
+    // they have not changed since they were read
+    return line >= firstLine && line < prefetchEnd &&
+           _prefetchColumns == windowColumns() &&
+           prefetchEnd <= _screen->getHistLines() &&
+           _screen->lineGeneration(line) <= _prefetchGeneration;
+}
+
+void ScreenWindow::fetchLines(Character* dest, int startLine, int endLine)
+{
+    const int columns = windowColumns();
+    const int prefetchStart = prefetchFirstLine();
+
+    int line = startLine;
+    while (line <= endLine) {
+        // the run of lines which are either all copied from the prefetched
+        // lines or all read from the screen
+        const bool prefetched = isLinePrefetched(line);
+        int last = line;
+        while (last < endLine && isLinePrefetched(last + 1) == prefetched)
+            last++;
+
+        Character* const target = dest + (line - startLine) * columns;
+        const int count = last - line + 1;
+        if (prefetched) {
+            memcpy((void*)target, (const void*)(_prefetchBuffer.constData() + (line - prefetchStart) * columns),
+                   count * columns * sizeof(Character));
+        } else {
+            _screen->getImage(target, count * columns, line, last);
+        }
+        line = last + 1;
+    }
+}
+
+void ScreenWindow::prefetchLines()
+{
+    const int historyLines = _screen->getHistLines();
+    const int firstLine = currentLine();
+
+    // the prefetched lines are only kept while the window shows the history
+    if (firstLine >= historyLines) {
+        _prefetchBuffer.clear();
+        return;
+    }
+
+    const int columns = windowColumns();
+    const int first = qMax(0, firstLine - PREFETCH_PAGES * windowLines());
+    const int last = qMin(historyLines - 1, endWindowLine() + PREFETCH_PAGES * windowLines());
+
+    // the lines which were prefetched before are copied from the old buffer
+    QVector<Character> buffer((last - first + 1) * columns);
+    fetchLines(buffer.data(), first, last);
+
+    _prefetchBuffer = buffer;
+    _prefetchFirstLine = first;
+    _prefetchColumns = columns;
+    _prefetchGeneration = _screen->generation();
+    _prefetchDiscardedLines = _screen->discardedLines();
+}
+
+bool ScreenWindow::isLineDirty(int line) const
+{
+    if (line < 0 || line >= _dirtyLines.size())
+        return true;
+
+    return _dirtyLines.testBit(line);
+}
+
+void ScreenWindow::resetDirtyLines()
+{
+    _dirtyLines.fill(false);
+}
+
 void ScreenWindow::fillUnusedArea()
 {
     int screenEndLine = _screen->getHistLines() + _screen->getLines() - 1;
@@ -107,14 +321,27 @@ int ScreenWindow::endWindowLine() const
     return qMin(currentLine() + windowLines() - 1,
                 lineCount() - 1);
 }
-QVector<LineProperty> ScreenWindow::getLineProperties()
+const QVector<LineProperty>& ScreenWindow::getLineProperties()
 {
-    QVector<LineProperty> result = _screen->getLineProperties(currentLine(), endWindowLine());
+    const int firstLine = currentLine();
+    if (_propertiesScreen == _screen && _propertiesGeneration == _screen->generation() &&
+            _propertiesLine == firstLine && _propertiesLineCount == lineCount() &&
+            _lineProperties.count() == windowLines())
+        return _lineProperties;
+
+    // the lines beyond the end of the screen have no attributes
+    _lineProperties.resize(windowLines());
+    const int lastLine = endWindowLine();
+    _screen->getLineProperties(_lineProperties.data(), firstLine, lastLine);
+    qFill(_lineProperties.begin() + (lastLine - firstLine + 1), _lineProperties.end(),
+          LineProperty(LINE_DEFAULT));
 
-    if (result.count() != windowLines())
-        result.resize(windowLines());
+    _propertiesScreen = _screen;
+    _propertiesGeneration = _screen->generation();
+    _propertiesLine = firstLine;
+    _propertiesLineCount = lineCount();
 
-    return result;
+    return _lineProperties;
 }
 
 QString ScreenWindow::selectedText(bool preserveLineBreaks, bool trimTrailingSpaces) const
@@ -122,6 +349,18 @@ QString ScreenWindow::selectedText(bool preserveLineBreaks, bool trimTrailingSpa
     return _screen->selectedText(preserveLineBreaks, trimTrailingSpaces);
 }
 
+bool ScreenWindow::getSelectionRange(int& startIndex, int& endIndex, bool& blockSelection) const
+{
+    return _screen->getSelectionRange(startIndex, endIndex, blockSelection);
+}
+
+QString ScreenWindow::rangeText(int startIndex, int endIndex, bool blockSelection,
+                                bool preserveLineBreaks, bool trimTrailingSpaces) const
+{
+    return _screen->rangeText(startIndex, endIndex, blockSelection,
+                              preserveLineBreaks, trimTrailingSpaces);
+}
+
 void ScreenWindow::getSelectionStart(int& column , int& line)
 {
     _screen->getSelectionStart(column, line);
@@ -164,6 +403,15 @@ bool ScreenWindow::isSelected(int column , int line)
     return _screen->isSelected(column , qMin(line + currentLine(), endWindowLine()));
 }
 
+bool ScreenWindow::selectedColumns(int line, int& startColumn, int& endColumn) const
+{
+    const int screenLine = line + currentLine();
+    if (screenLine > endWindowLine() || screenLine >= lineCount())
+        return false;
+
+    return _screen->selectedColumns(screenLine, startColumn, endColumn);
+}
+
 void ScreenWindow::clearSelection()
 {
     _screen->clearSelection();
@@ -242,6 +490,11 @@ void ScreenWindow::scrollTo(int line)
 
     _bufferNeedsUpdate = true;
 
+    // prefetch the lines around the new position once the window and
+    // the display have been updated
+    if (delta != 0 && !_prefetchTimer.isActive())
+        _prefetchTimer.start(0);
+
     emit scrolled(_currentLine);
 }
 
@@ -296,6 +549,11 @@ void ScreenWindow::notifyOutputChanged()
         _currentLine = qMin(_currentLine , _screen->getHistLines());
     }
 
+    // lines dropped from the history shift the remaining lines up
+    // even if the window stays at the top of the history
+    if (_screen->droppedLines() > 0)
+        _allLinesDirty = true;
+
     _bufferNeedsUpdate = true;
 
     emit outputChanged();
@@ -22,11 +22,15 @@
 
 // Qt
 #include <QtCore/QObject>
+#include <QtCore/QBitArray>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
 
 // Konsole
 #include "Character.h"
+#include "konsole_export.h"
 
 namespace Konsole
 {
@@ -49,7 +53,7 @@ class Screen;
  * be called.  This in turn will update the window's position and emit the outputChanged() signal
  * if necessary.
  */
-class ScreenWindow : public QObject
+class KONSOLEPRIVATE_EXPORT ScreenWindow : public QObject
 {
     Q_OBJECT
 
@@ -83,8 +87,25 @@ public:
     /**
      * Returns the line attributes associated with the lines of characters which
      * are currently visible through this window
+     *
+     * The attributes are only retrieved from the screen again once it has
+     * changed or the window has moved.
+     */
+    const QVector<LineProperty>& getLineProperties();
+
+    /**
+     * Returns true if line @p line of the window may have changed in the
+     * images returned by getImage() since the last call to resetDirtyLines().
+     *
+     * Views can use this to skip comparing and drawing the lines which
+     * are known to be unchanged.
      */
-    QVector<LineProperty> getLineProperties();
+    bool isLineDirty(int line) const;
+
+    /**
+     * Marks all lines in the window as unchanged, see isLineDirty()
+     */
+    void resetDirtyLines();
 
     /**
      * Returns the number of lines which the region of the window
@@ -147,6 +168,12 @@ public:
      * Returns true if the character at @p line , @p column is part of the selection.
      */
     bool isSelected(int column , int line);
+    /**
+     * Retrieves the range of columns of the window line @p line which are
+     * part of the selection.  Returns false if no column of @p line is
+     * selected.  See Screen::selectedColumns()
+     */
+    bool selectedColumns(int line, int& startColumn, int& endColumn) const;
     /**
      * Clears the current selection
      */
@@ -154,6 +181,19 @@ public:
 
     /** Sets the number of lines in the window */
     void setWindowLines(int lines);
+
+    /**
+     * Frees the copy of the window's lines returned by getImage() and the
+     * prefetched history lines, for example while the view showing the
+     * window is hidden.  The next call to getImage() copies all lines of
+     * the window again.
+     */
+    void releaseBuffers();
+    /**
+     * Returns the number of bytes of memory used by the copy of the
+     * window's lines and the prefetched history lines.
+     */
+    qint64 memoryUsage() const;
     /** Returns the number of lines in the window */
     int windowLines() const;
     /** Returns the number of columns in the window */
@@ -227,6 +267,13 @@ public:
      */
     QString selectedText(bool preserveLineBreaks, bool trimTrailingSpaces = false) const;
 
+    /** See Screen::getSelectionRange() */
+    bool getSelectionRange(int& startIndex, int& endIndex, bool& blockSelection) const;
+
+    /** See Screen::rangeText() */
+    QString rangeText(int startIndex, int endIndex, bool blockSelection,
+                      bool preserveLineBreaks, bool trimTrailingSpaces = false) const;
+
 public slots:
     /**
      * Notifies the window that the contents of the associated terminal screen have changed.
@@ -251,9 +298,27 @@ signals:
     /** Emitted when the selection is changed. */
     void selectionChanged();
 
+private slots:
+    // reads the history lines around the window into _prefetchBuffer
+    void prefetchLines();
+
 private:
     int endWindowLine() const;
     void fillUnusedArea();
+    // finds the lines which changed since the last call and adds them
+    // to the dirty lines
+    void updateDirtyLines();
+    // copies the lines from startLine to endLine into dest, from the
+    // prefetched lines where possible and from the screen otherwise
+    void fetchLines(Character* dest, int startLine, int endLine);
+    // returns true if line 'line' can be copied from _prefetchBuffer
+    bool isLinePrefetched(int line) const;
+    // returns the line which the first prefetched line is now, which moves
+    // up as lines are dropped from the history
+    int prefetchFirstLine() const;
+
+    // the number of window heights prefetched above and below the window
+    static const int PREFETCH_PAGES = 2;
 
     Screen* _screen; // see setScreen() , screen()
     Character* _windowBuffer;
@@ -265,6 +330,31 @@ private:
     bool _trackOutput; // see setTrackOutput() , trackOutput()
     int  _scrollCount; // count of lines which the window has been scrolled by since
     // the last call to resetScrollCount()
+
+    QBitArray _dirtyLines; // see isLineDirty() , resetDirtyLines()
+    QBitArray _changedLines; // lines changed since the buffer was last updated
+    bool _allLinesDirty;   // set when the whole window needs to be retrieved again
+    quint64 _lastGeneration; // Screen::generation() when the image was last retrieved
+    int _lastImageLine;      // currentLine() when the image was last retrieved
+    int _lastLineCount;      // lineCount() at that point
+    QPoint _lastCursorPosition; // cursor position in the window at that point
+
+    // the result of getLineProperties(), which is used until the screen,
+    // its generation or the lines of the window change
+    QVector<LineProperty> _lineProperties;
+    const Screen* _propertiesScreen;
+    quint64 _propertiesGeneration;
+    int _propertiesLine;
+    int _propertiesLineCount;
+
+    // the history lines around the window while it is scrolled back, so
+    // that scrolling further only copies lines which have been read already
+    QVector<Character> _prefetchBuffer;
+    int _prefetchFirstLine;
+    int _prefetchColumns;
+    quint64 _prefetchGeneration; // Screen::generation() when the lines were read
+    qint64 _prefetchDiscardedLines; // Screen::discardedLines() at that time
+    QTimer _prefetchTimer;
 };
 }
 #endif // SCREENWINDOW_H
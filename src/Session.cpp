@@ -28,13 +28,22 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
+#if defined(Q_OS_LINUX)
+#include <sys/syscall.h>
+#endif
 
 // Qt
 #include <QApplication>
 #include <QtGui/QColor>
+#include <QtCore/QDateTime>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
+#include <QtCore/QPointer>
+#include <QtCore/QSocketNotifier>
 #include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
 #include <QtDBus/QtDBus>
 
 // KDE
@@ -46,6 +55,8 @@
 #include <KProcess>
 #include <KStandardDirs>
 #include <KConfigGroup>
+#include <KApplication>
+#include <KGlobal>
 
 // Konsole
 #include <sessionadaptor.h>
@@ -57,11 +68,35 @@
 #include "Vt102Emulation.h"
 #include "ZModemDialog.h"
 #include "History.h"
+#include "PerformanceClock.h"
+#include "SessionLogger.h"
+#include "SessionRecording.h"
+#include "NonBlockingWriter.h"
+#include "TerminalCharacterDecoder.h"
 
 using namespace Konsole;
 
 int Session::lastSessionId = 0;
 
+// the interval, in milliseconds, at which the terminal follows
+// the size of its views while they are being resized
+static const int VIEW_RESIZE_INTERVAL = 30;
+// the time, in milliseconds, for which the size of the terminal has to
+// stay the same before the terminal program is told about it
+static const int WINDOW_SIZE_DELAY = 250;
+
+// the delay, in milliseconds, after input or output after which the
+// foreground process group is checked
+static const int FOREGROUND_CHECK_DELAY = 200;
+
+// the interval, in milliseconds, at which the status of a ZModem transfer
+// is shown in its dialog
+static const int ZMODEM_STATUS_INTERVAL = 200;
+
+// the size of the buffer which the data of a ZModem transfer is read into
+// from the pty
+static const int ZMODEM_READ_BUFFER_SIZE = 256 * 1024;
+
 // HACK This is copied out of QUuid::createUuid with reseeding forced.
 // Required because color schemes repeatedly seed the RNG...
 // ...with a constant.
@@ -102,7 +137,11 @@ Session::Session(QObject* parent) :
     , _monitorActivity(false)
     , _monitorSilence(false)
     , _notifiedActivity(false)
+    , _notifiedSilence(false)
     , _silenceSeconds(10)
+    , _receivedOutput(false)
+    , _lastActivityTime(0)
+    , _activityNotifiedTime(0)
     , _autoClose(true)
     , _closePerUserRequest(false)
     , _addToUtmp(true)
@@ -111,10 +150,26 @@ Session::Session(QObject* parent) :
     , _sessionProcessInfo(0)
     , _foregroundProcessInfo(0)
     , _foregroundPid(0)
+    , _sshProcessInfo(0)
+    , _sshProcessPid(0)
     , _zmodemBusy(false)
     , _zmodemProc(0)
     , _zmodemProgress(0)
+    , _pendingInputSize(0)
+    , _inputTimer(0)
     , _hasDarkBackground(false)
+    , _pendingOutputPos(0)
+    , _backgroundOutputInterval(0)
+    , _outputTimeSlice(0)
+    , _readBufferSize(64 * 1024)
+    , _outputHighWaterMark(0)
+    , _outputSuspended(false)
+    , _trackedForegroundGroup(0)
+    , _foregroundPidFd(-1)
+    , _foregroundExitNotifier(0)
+    , _outputLogger(0)
+    , _sentBytes(0)
+    , _recorder(0)
 {
     _uniqueIdentifier = createUuid();
 
@@ -148,23 +203,63 @@ Session::Session(QObject* parent) :
     //create new teletype for I/O with shell process
     openTeletype(-1);
 
-    //setup timer for monitoring session activity & silence
-    _silenceTimer = new QTimer(this);
-    _silenceTimer->setSingleShot(true);
-    connect(_silenceTimer, SIGNAL(timeout()), this, SLOT(silenceTimerDone()));
+    _viewResizeTimer = new QTimer(this);
+    _viewResizeTimer->setSingleShot(true);
+    _viewResizeTimer->setInterval(VIEW_RESIZE_INTERVAL);
+    connect(_viewResizeTimer, SIGNAL(timeout()), this, SLOT(updateTerminalSize()));
+
+    _windowSizeTimer = new QTimer(this);
+    _windowSizeTimer->setSingleShot(true);
+    _windowSizeTimer->setInterval(WINDOW_SIZE_DELAY);
+    connect(_windowSizeTimer, SIGNAL(timeout()), this, SLOT(applyWindowSize()));
+
+    _foregroundCheckTimer = new QTimer(this);
+    _foregroundCheckTimer->setSingleShot(true);
+    _foregroundCheckTimer->setInterval(FOREGROUND_CHECK_DELAY);
+    connect(_foregroundCheckTimer, SIGNAL(timeout()), this, SLOT(checkForegroundProcess()));
+
+    _zmodemStatusTimer = new QTimer(this);
+    _zmodemStatusTimer->setSingleShot(true);
+    _zmodemStatusTimer->setInterval(ZMODEM_STATUS_INTERVAL);
+    connect(_zmodemStatusTimer, SIGNAL(timeout()), this, SLOT(zmodemShowStatus()));
+
+    _inputTimer = new QTimer(this);
+    _inputTimer->setSingleShot(true);
+    connect(_inputTimer, SIGNAL(timeout()), this, SLOT(sendPendingInput()));
+    connect(_emulation, SIGNAL(sendData(const char*,int)),
+            this, SLOT(scheduleForegroundCheck()));
+    connect(_emulation, SIGNAL(sendData(const char*,int)),
+            this, SLOT(countSentData(const char*,int)));
+}
 
-    _activityTimer = new QTimer(this);
-    _activityTimer->setSingleShot(true);
-    connect(_activityTimer, SIGNAL(timeout()), this, SLOT(activityTimerDone()));
+// returns the name of the files a history of type 'type' is kept in, if
+// they are to be kept
+static QString historyFileName(const HistoryType& type)
+{
+    const HistoryTypeFile* fileType = dynamic_cast<const HistoryTypeFile*>(&type);
+    return fileType ? fileType->fileName() : QString();
 }
 
 Session::~Session()
 {
+    // the history is kept for restoring the session if Konsole is quit by
+    // the session manager, otherwise the session is gone for good
+    const QString historyFile = historyFileName(historyType());
+    if (!historyFile.isEmpty() && !(kapp && kapp->sessionSaving()))
+        HistoryScrollFile::removeFiles(historyFile);
+
     delete _foregroundProcessInfo;
     delete _sessionProcessInfo;
+    delete _sshProcessInfo;
     delete _emulation;
     delete _shellProcess;
     delete _zmodemProc;
+    delete _outputLogger;
+    delete _recorder;
+    watchForegroundProcess(0);
+
+    OutputScheduler::instance()->removeSession(this);
+    ActivityMonitor::instance()->removeSession(this);
 }
 
 void Session::openTeletype(int fd)
@@ -182,12 +277,17 @@ void Session::openTeletype(int fd)
         _shellProcess = new Pty(fd);
 
     _shellProcess->setUtf8Mode(_emulation->utf8());
+    _shellProcess->setReadBufferSize(_readBufferSize);
 
     // connect the I/O between emulator and pty process
     connect(_shellProcess, SIGNAL(receivedData(const char*,int)),
             this, SLOT(onReceiveBlock(const char*,int)));
     connect(_emulation, SIGNAL(sendData(const char*,int)),
             _shellProcess, SLOT(sendData(const char*,int)));
+    connect(_shellProcess, SIGNAL(sendDataProgress(qint64,qint64)),
+            this, SIGNAL(sendDataProgress(qint64,qint64)));
+    connect(_shellProcess, SIGNAL(outputResumeSent()),
+            this, SLOT(resumeOutput()));
 
     // UTF8 mode
     connect(_emulation, SIGNAL(useUtf8Request(bool)),
@@ -314,6 +414,8 @@ void Session::addView(TerminalDisplay* widget)
     // connect emulation - view signals and slots
     connect(widget, SIGNAL(keyPressedSignal(QKeyEvent*)),
             _emulation, SLOT(sendKeyEvent(QKeyEvent*)));
+    connect(widget, SIGNAL(keyRepeatedSignal(QKeyEvent*,int)),
+            _emulation, SLOT(sendKeyEvents(QKeyEvent*,int)));
     connect(widget, SIGNAL(mouseSignal(int,int,int,int)),
             _emulation, SLOT(sendMouseEvent(int,int,int,int)));
     connect(widget, SIGNAL(sendStringToEmu(const char*)),
@@ -326,6 +428,24 @@ void Session::addView(TerminalDisplay* widget)
 
     widget->setUsesMouse(_emulation->programUsesMouse());
 
+    // pasted text is bracketed while the foreground process asks for it
+    connect(_emulation, SIGNAL(programBracketedPasteModeChanged(bool)),
+            widget, SLOT(setBracketedPasteMode(bool)));
+
+    widget->setBracketedPasteMode(_emulation->programBracketedPasteMode());
+
+    // show the view's flood mode indicator while updates are capped
+    connect(_emulation, SIGNAL(floodModeChanged(bool)),
+            widget, SLOT(setFloodModeIndicatorVisible(bool)));
+
+    widget->setFloodModeIndicatorVisible(_emulation->updateStatistics().floodMode);
+
+    // show the progress of big pastes and allow them to be cancelled
+    connect(this, SIGNAL(sendDataProgress(qint64,qint64)),
+            widget, SLOT(showInputProgress(qint64,qint64)));
+    connect(widget, SIGNAL(cancelInputRequest()),
+            this, SLOT(cancelSendData()));
+
     widget->setScreenWindow(_emulation->createWindow());
 
     //connect view signals and slots
@@ -334,6 +454,8 @@ void Session::addView(TerminalDisplay* widget)
 
     connect(widget, SIGNAL(destroyed(QObject*)),
             this, SLOT(viewDestroyed(QObject*)));
+    connect(widget, SIGNAL(displayShown()),
+            this, SLOT(viewShown()));
 }
 
 void Session::viewDestroyed(QObject* view)
@@ -403,6 +525,9 @@ void Session::terminalWarning(const QString& message)
     static const char redPenOn[] = "\033[1m\033[31m";
     static const char redPenOff[] = "\033[0m";
 
+    // show the warning after the output which is still queued
+    processPendingOutput(0);
+
     _emulation->receiveData(redPenOn, qstrlen(redPenOn));
     _emulation->receiveData("\n\r\n\r", 4);
     _emulation->receiveData(warningText.constData(), qstrlen(warningText.constData()));
@@ -591,8 +716,37 @@ QString Session::tabTitleFormat(TabTitleContext context) const
     return QString();
 }
 
-void Session::silenceTimerDone()
+void Session::checkActivity(qint64 now)
 {
+    // TODO: should this hardcoded interval be user configurable?
+    const int activityMaskInSeconds = 15;
+
+    if (_receivedOutput) {
+        _receivedOutput = false;
+        _lastActivityTime = now;
+        _notifiedSilence = false;
+
+        // mask activity notification for a while to avoid flooding
+        if (_notifiedActivity && now - _activityNotifiedTime >= activityMaskInSeconds * 1000)
+            _notifiedActivity = false;
+
+        if (_monitorActivity && !_notifiedActivity) {
+            KNotification::event("Activity", i18n("Activity in session '%1'", _nameTitle), QPixmap(),
+                                 QApplication::activeWindow(),
+                                 KNotification::CloseWhenWidgetActivated);
+            _notifiedActivity = true;
+            _activityNotifiedTime = now;
+        }
+
+        emit stateChanged(_monitorActivity ? NOTIFYACTIVITY : NOTIFYNORMAL);
+        return;
+    }
+
+    if (!_monitorSilence || _notifiedSilence || now - _lastActivityTime < _silenceSeconds * 1000)
+        return;
+
+    _notifiedSilence = true;
+
     //FIXME: The idea here is that the notification popup will appear to tell the user than output from
     //the terminal has stopped and the popup will disappear when the user activates the session.
     //
@@ -600,23 +754,35 @@ void Session::silenceTimerDone()
     //when any of the views of the session becomes active
 
     //FIXME: Make message text for this notification and the activity notification more descriptive.
-    if (_monitorSilence) {
-        KNotification::event("Silence", i18n("Silence in session '%1'", _nameTitle), QPixmap(),
-                             QApplication::activeWindow(),
-                             KNotification::CloseWhenWidgetActivated);
-        emit stateChanged(NOTIFYSILENCE);
-    } else {
-        emit stateChanged(NOTIFYNORMAL);
-    }
+    KNotification::event("Silence", i18n("Silence in session '%1'", _nameTitle), QPixmap(),
+                         QApplication::activeWindow(),
+                         KNotification::CloseWhenWidgetActivated);
+    emit stateChanged(NOTIFYSILENCE);
 }
 
-void Session::activityTimerDone()
+void Session::updateActivityMonitor()
 {
-    _notifiedActivity = false;
+    if (_monitorActivity || _monitorSilence)
+        ActivityMonitor::instance()->addSession(this);
+    else
+        ActivityMonitor::instance()->removeSession(this);
 }
 
 void Session::updateFlowControlState(bool suspended)
 {
+    // while the output is suspended, the output which has been read already
+    // is kept aside rather than parsed.  Once it is resumed, that output is
+    // processed at once, so that the views catch up in a single update
+    const bool outputSuspended = suspended && flowControlEnabled();
+    if (outputSuspended != _outputSuspended) {
+        _outputSuspended = outputSuspended;
+        if (_outputSuspended)
+            OutputScheduler::instance()->removeSession(this);
+        else if (!_pendingOutput.isEmpty())
+            processPendingOutput(0);
+        updateReadSuspended();
+    }
+
     if (suspended) {
         if (flowControlEnabled()) {
             foreach(TerminalDisplay * display, _views) {
@@ -631,6 +797,12 @@ void Session::updateFlowControlState(bool suspended)
     }
 }
 
+void Session::resumeOutput()
+{
+    if (_outputSuspended)
+        updateFlowControlState(false);
+}
+
 void Session::onPrimaryScreenInUse(bool use)
 {
     emit primaryScreenInUse(use);
@@ -638,26 +810,12 @@ void Session::onPrimaryScreenInUse(bool use)
 
 void Session::activityStateSet(int state)
 {
-    // TODO: should this hardcoded interval be user configurable?
-    const int activityMaskInSeconds = 15;
-
     if (state == NOTIFYBELL) {
         emit bellRequest(i18n("Bell in session '%1'", _nameTitle));
     } else if (state == NOTIFYACTIVITY) {
-        if (_monitorActivity  && !_notifiedActivity) {
-            KNotification::event("Activity", i18n("Activity in session '%1'", _nameTitle), QPixmap(),
-                                 QApplication::activeWindow(),
-                                 KNotification::CloseWhenWidgetActivated);
-
-            // mask activity notification for a while to avoid flooding
-            _notifiedActivity = true;
-            _activityTimer->start(activityMaskInSeconds * 1000);
-        }
-
-        // reset the counter for monitoring continuous silence since there is activity
-        if (_monitorSilence) {
-            _silenceTimer->start(_silenceSeconds * 1000);
-        }
+        // the ActivityMonitor notifies the activity
+        _receivedOutput = true;
+        return;
     }
 
     if (state == NOTIFYACTIVITY && !_monitorActivity)
@@ -670,7 +828,11 @@ void Session::activityStateSet(int state)
 
 void Session::onViewSizeChange(int /*height*/, int /*width*/)
 {
-    updateTerminalSize();
+    // while a window edge is dragged, the views are resized many times a
+    // second.  Resizing the screens, and the pty which makes the terminal
+    // program redraw, follows at most once per VIEW_RESIZE_INTERVAL.
+    if (!_viewResizeTimer->isActive())
+        _viewResizeTimer->start();
 }
 
 void Session::updateTerminalSize()
@@ -691,7 +853,6 @@ void Session::updateTerminalSize()
                 view->columns() >= VIEW_COLUMNS_THRESHOLD) {
             minLines = (minLines == -1) ? view->lines() : qMin(minLines , view->lines());
             minColumns = (minColumns == -1) ? view->columns() : qMin(minColumns , view->columns());
-            view->processFilters();
         }
     }
 
@@ -703,7 +864,30 @@ void Session::updateTerminalSize()
 void Session::updateWindowSize(int lines, int columns)
 {
     Q_ASSERT(lines > 0 && columns > 0);
-    _shellProcess->setWindowSize(columns, lines);
+
+    if (_recorder)
+        _recorder->recordResize(lines, columns);
+
+    // the screens follow the views right away, but the terminal program
+    // redraws itself for each SIGWINCH, so it is only told about the size
+    // once the views have stopped changing.  The first size is needed
+    // before the program starts
+    _pendingWindowSize = QSize(columns, lines);
+    if (_shellProcess->state() == QProcess::Running)
+        _windowSizeTimer->start();
+    else
+        applyWindowSize();
+}
+void Session::applyWindowSize()
+{
+    _windowSizeTimer->stop();
+    _shellProcess->setWindowSize(_pendingWindowSize.width(), _pendingWindowSize.height());
+
+    // the filters were left alone while the views were being resized
+    foreach(TerminalDisplay* view, _views) {
+        if (!view->isHidden())
+            view->processFilters();
+    }
 }
 void Session::refresh()
 {
@@ -721,6 +905,9 @@ void Session::refresh()
     // if there is a more 'correct' way to do this, please
     // send an email with method or patches to konsole-devel@kde.org
 
+    if (_windowSizeTimer->isActive())
+        applyWindowSize();
+
     const QSize existingSize = _shellProcess->windowSize();
     _shellProcess->setWindowSize(existingSize.width() + 1, existingSize.height());
     usleep(500); // introduce small delay to avoid changing size too quickly
@@ -805,14 +992,83 @@ bool Session::closeInForceWay()
     }
 }
 
-void Session::sendText(const QString& text) const
+void Session::sendText(const QString& text)
 {
-    _emulation->sendText(text);
+    // the text has to wait for the input which was sent before it
+    if (!_pendingInput.isEmpty())
+        queueInput(_emulation->codec()->fromUnicode(text), 0);
+    else
+        _emulation->sendText(text);
 }
 
-void Session::runCommand(const QString& command) const
+void Session::runCommand(const QString& command)
 {
-    _emulation->sendText(command + '\n');
+    sendText(command + '\n');
+}
+
+void Session::runCommands(const QStringList& commands, int delay)
+{
+    // without a delay, the commands are sent with a single write
+    if (delay <= 0) {
+        QString text;
+        foreach(const QString& command, commands) {
+            text += command;
+            text += '\n';
+        }
+        queueInput(_emulation->codec()->fromUnicode(text), 0);
+        return;
+    }
+
+    for (int i = 0; i < commands.count(); i++)
+        queueInput(_emulation->codec()->fromUnicode(commands[i] + '\n'), i == 0 ? 0 : delay);
+}
+
+void Session::sendBytes(const QByteArray& data)
+{
+    queueInput(data, 0);
+}
+
+qint64 Session::pendingInputSize() const
+{
+    return _pendingInputSize + _shellProcess->pendingDataSize();
+}
+
+void Session::queueInput(const QByteArray& data, int delay)
+{
+    if (data.isEmpty())
+        return;
+
+    // the Pty writes large amounts of input as the terminal process reads
+    // it and keeps the order in which it was sent
+    if (_pendingInput.isEmpty() && delay <= 0) {
+        _emulation->sendString(data.constData(), data.size());
+        return;
+    }
+
+    PendingInput input;
+    input.data = data;
+    input.delay = qMax(0, delay);
+    _pendingInput << input;
+    _pendingInputSize += data.size();
+
+    if (!_inputTimer->isActive())
+        _inputTimer->start(_pendingInput.first().delay);
+}
+
+void Session::sendPendingInput()
+{
+    // the input which does not have to wait after the input which is due
+    // is sent along with it
+    QByteArray data;
+    do {
+        data += _pendingInput.takeFirst().data;
+    } while (!_pendingInput.isEmpty() && _pendingInput.first().delay == 0);
+
+    _pendingInputSize -= data.size();
+    _emulation->sendString(data.constData(), data.size());
+
+    if (!_pendingInput.isEmpty())
+        _inputTimer->start(_pendingInput.first().delay);
 }
 
 void Session::sendMouseEvent(int buttons, int column, int line, int eventType)
@@ -845,7 +1101,7 @@ void Session::done(int exitCode, QProcess::ExitStatus exitStatus)
         else
             message = i18n("Program '%1' exited with status %2.", _program, exitCode);
 
-        //FIXME: See comments in Session::silenceTimerDone()
+        //FIXME: See comments in Session::checkActivity()
         KNotification::event("Finished", message , QPixmap(),
                              QApplication::activeWindow(),
                              KNotification::CloseWhenWidgetActivated);
@@ -975,22 +1231,55 @@ bool Session::isRemote()
     return (process->name(&ok) == "ssh" && ok);
 }
 
+const SSHProcessInfo& Session::sshProcessInfo(const ProcessInfo* process)
+{
+    bool ok = false;
+    const int pid = process->pid(&ok);
+    const QVector<QString> arguments = process->arguments(&ok);
+
+    if (!_sshProcessInfo || pid != _sshProcessPid || arguments != _sshProcessArguments) {
+        delete _sshProcessInfo;
+        _sshProcessInfo = new SSHProcessInfo(*process);
+        _sshProcessPid = pid;
+        _sshProcessArguments = arguments;
+    }
+
+    return *_sshProcessInfo;
+}
+
 QString Session::getDynamicTitle()
 {
     // update current directory from process
     ProcessInfo* process = updateWorkingDirectory();
 
-    // format tab titles using process info
     bool ok = false;
-    QString title;
-    if (process->name(&ok) == "ssh" && ok) {
-        SSHProcessInfo sshInfo(*process);
-        title = sshInfo.format(tabTitleFormat(Session::RemoteTabTitle));
+    const QString name = process->name(&ok);
+    const bool remote = ok && name == "ssh";
+
+    DynamicTitleSource source;
+    source.valid = true;
+    source.pid = process->pid(&ok);
+    source.name = name;
+    source.arguments = process->arguments(&ok);
+    source.dir = _currentWorkingDir;
+    source.format = tabTitleFormat(remote ? Session::RemoteTabTitle : Session::LocalTabTitle);
+
+    if (source == _dynamicTitleSource)
+        return _dynamicTitle;
+    _dynamicTitleSource = source;
+
+    // format tab titles using process info
+    if (remote) {
+        if (_remoteTitleFormat.text() != source.format)
+            _remoteTitleFormat = TitleFormat(source.format);
+        _dynamicTitle = sshProcessInfo(process).format(_remoteTitleFormat);
     } else {
-        title = process->format(tabTitleFormat(Session::LocalTabTitle));
+        if (_localTitleFormat.text() != source.format)
+            _localTitleFormat = TitleFormat(source.format);
+        _dynamicTitle = process->format(_localTitleFormat);
     }
 
-    return title;
+    return _dynamicTitle;
 }
 
 KUrl Session::getUrl()
@@ -1006,7 +1295,7 @@ KUrl Session::getUrl()
             // for remote connections, save the user and host
             // bright ideas to get the directory at the other end are welcome :)
             if (_foregroundProcessInfo->name(&ok) == "ssh" && ok) {
-                SSHProcessInfo sshInfo(*_foregroundProcessInfo);
+                const SSHProcessInfo& sshInfo = sshProcessInfo(_foregroundProcessInfo);
 
                 path = "ssh://" + sshInfo.userName() + '@' + sshInfo.host();
 
@@ -1054,7 +1343,13 @@ QString Session::iconText() const
 
 void Session::setHistoryType(const HistoryType& hType)
 {
+    const QString oldFileName = historyFileName(historyType());
+
     _emulation->setHistory(hType);
+
+    // the lines have moved to the new history, forget the old files
+    if (!oldFileName.isEmpty() && oldFileName != historyFileName(hType))
+        HistoryScrollFile::removeFiles(oldFileName);
 }
 
 const HistoryType& Session::historyType() const
@@ -1067,6 +1362,244 @@ void Session::clearHistory()
     _emulation->clearHistory();
 }
 
+void Session::setHistoryIndexEnabled(bool enable)
+{
+    _emulation->setHistoryIndexEnabled(enable);
+}
+
+void Session::setOutputLogging(const QString& directory, bool plainText)
+{
+    const SessionLogger::Format format = plainText ? SessionLogger::PlainTextOutput
+                                                   : SessionLogger::RawOutput;
+    if (directory == _outputLogDirectory &&
+            (!_outputLogger || _outputLogger->format() == format))
+        return;
+
+    delete _outputLogger;
+    _outputLogger = 0;
+    _outputLogDirectory = directory;
+
+    if (directory.isEmpty())
+        return;
+
+    if (!QDir().mkpath(directory)) {
+        kWarning() << "Unable to create the directory for session logs" << directory;
+        return;
+    }
+
+    const QString fileName = QString("%1/konsole-%2-%3.log")
+                             .arg(directory)
+                             .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"))
+                             .arg(_sessionId);
+    _outputLogger = new SessionLogger(fileName, format);
+}
+
+QString Session::outputLogFileName() const
+{
+    return _outputLogger ? _outputLogger->fileName() : QString();
+}
+
+bool Session::setRecordingFile(const QString& fileName)
+{
+    delete _recorder;
+    _recorder = 0;
+
+    if (fileName.isEmpty())
+        return true;
+
+    _recorder = new SessionRecorder(fileName);
+    if (!_recorder->open()) {
+        kWarning() << "Unable to create the session recording" << fileName
+                   << ":" << _recorder->errorString();
+        delete _recorder;
+        _recorder = 0;
+        return false;
+    }
+
+    // the replay starts with the size the terminal had
+    const QSize size = _emulation->imageSize();
+    _recorder->recordResize(size.height(), size.width());
+
+    return true;
+}
+
+bool Session::replayRecording(const QString& fileName, bool originalSpeed)
+{
+    SessionReplay* replay = new SessionReplay(fileName, _emulation,
+            originalSpeed ? SessionReplay::OriginalSpeed : SessionReplay::MaximumSpeed,
+            this);
+
+    // the views and the terminal process follow the recorded size as
+    // they follow the size a program asks for
+    replay->setResizeEmulation(false);
+    connect(replay, SIGNAL(resizeRequest(QSize)), this, SIGNAL(resizeRequest(QSize)));
+
+    if (!replay->start()) {
+        kWarning() << "Unable to replay the session recording" << fileName
+                   << ":" << replay->errorString();
+        delete replay;
+        return false;
+    }
+
+    connect(replay, SIGNAL(finished()), replay, SLOT(deleteLater()));
+    return true;
+}
+
+int Session::historyLineCount() const
+{
+    return _emulation->lineCount() - _emulation->imageSize().height();
+}
+
+bool Session::toEmulationLines(int& startLine, int& endLine) const
+{
+    const int historyLines = historyLineCount();
+    const int screenLines = _emulation->lineCount() - historyLines;
+
+    startLine = qMax(startLine, -historyLines) + historyLines;
+    endLine = qMin(endLine, screenLines - 1) + historyLines;
+    return startLine <= endLine;
+}
+
+void Session::writeHtmlLines(QTextStream* output, int startLine, int endLine)
+{
+    HTMLDecoder decoder;
+    decoder.setUseStyleSheet(true);
+    if (!_views.isEmpty())
+        decoder.setColorTable(_views.first()->colorTable());
+
+    decoder.begin(output);
+    _emulation->writeToStream(&decoder, startLine, endLine);
+    decoder.end();
+}
+
+QString Session::lines(int startLine, int endLine, bool withAttributes)
+{
+    QString text;
+    if (!toEmulationLines(startLine, endLine))
+        return text;
+
+    QTextStream stream(&text);
+    if (withAttributes) {
+        writeHtmlLines(&stream, startLine, endLine);
+    } else {
+        PlainTextDecoder decoder;
+        decoder.setTrailingWhitespace(false);
+        decoder.begin(&stream);
+        _emulation->writeToStream(&decoder, startLine, endLine);
+        decoder.end();
+    }
+    stream.flush();
+
+    return text;
+}
+
+bool Session::writeLines(const QString& fileName, int startLine, int endLine,
+                         bool withAttributes)
+{
+    // all of the lines are decoded before any of them are written, the
+    // output which arrives in between does not change them
+    QByteArray data;
+    if (toEmulationLines(startLine, endLine)) {
+        if (withAttributes) {
+            QString text;
+            QTextStream stream(&text);
+            writeHtmlLines(&stream, startLine, endLine);
+            stream.flush();
+            data = text.toUtf8();
+        } else {
+            Utf8PlainTextDecoder decoder;
+            decoder.setTrailingWhitespace(false);
+            decoder.begin(&data);
+            _emulation->writeToStream(&decoder, startLine, endLine);
+            decoder.end();
+        }
+    }
+
+    NonBlockingWriter* writer = new NonBlockingWriter(fileName, data, this);
+    if (!writer->start()) {
+        kWarning() << "Unable to write the lines of the session to" << fileName
+                   << ":" << writer->errorString();
+        delete writer;
+        return false;
+    }
+
+    return true;
+}
+
+// the amount of unread input after which a session counts as backlogged
+static const int INPUT_BACKLOG_SIZE = 4 * 1024;
+
+void Session::sendData(const char* data, int length)
+{
+    _shellProcess->sendData(data, length);
+}
+
+bool Session::isInputBacklogged() const
+{
+    return _shellProcess->pendingDataSize() >= INPUT_BACKLOG_SIZE;
+}
+
+int Session::foregroundProcessGroup() const
+{
+    return _shellProcess->foregroundProcessGroup();
+}
+
+bool Session::isForegroundProcessTracked() const
+{
+    return isRunning();
+}
+
+void Session::scheduleForegroundCheck()
+{
+    if (!_foregroundCheckTimer->isActive())
+        _foregroundCheckTimer->start();
+}
+
+void Session::checkForegroundProcess()
+{
+    const int group = _shellProcess->foregroundProcessGroup();
+    if (group == _trackedForegroundGroup)
+        return;
+
+    _trackedForegroundGroup = group;
+    watchForegroundProcess(group);
+
+    emit foregroundProcessChanged();
+}
+
+void Session::foregroundProcessExited()
+{
+    // the pidfd stays readable once the process has exited
+    _foregroundExitNotifier->setEnabled(false);
+
+    checkForegroundProcess();
+}
+
+void Session::watchForegroundProcess(int pid)
+{
+    delete _foregroundExitNotifier;
+    _foregroundExitNotifier = 0;
+    if (_foregroundPidFd != -1) {
+        ::close(_foregroundPidFd);
+        _foregroundPidFd = -1;
+    }
+
+    // the shell exiting ends the session, which is noticed anyway
+    if (pid <= 0 || pid == processId())
+        return;
+
+#if defined(Q_OS_LINUX) && defined(SYS_pidfd_open)
+    // a pidfd becomes readable when the process exits.  this fails on
+    // kernels older than 5.3, which leaves the checks after output
+    _foregroundPidFd = syscall(SYS_pidfd_open, pid, 0);
+    if (_foregroundPidFd != -1) {
+        _foregroundExitNotifier = new QSocketNotifier(_foregroundPidFd, QSocketNotifier::Read, this);
+        connect(_foregroundExitNotifier, SIGNAL(activated(int)),
+                this, SLOT(foregroundProcessExited()));
+    }
+#endif
+}
+
 QStringList Session::arguments() const
 {
     return _arguments;
@@ -1093,9 +1626,8 @@ void Session::setMonitorActivity(bool monitor)
 
     _monitorActivity  = monitor;
     _notifiedActivity = false;
-
-    // This timer is meaningful only after activity has been notified
-    _activityTimer->stop();
+    _receivedOutput = false;
+    updateActivityMonitor();
 
     activityStateSet(NOTIFYNORMAL);
 }
@@ -1106,11 +1638,9 @@ void Session::setMonitorSilence(bool monitor)
         return;
 
     _monitorSilence = monitor;
-    if (_monitorSilence) {
-        _silenceTimer->start(_silenceSeconds * 1000);
-    } else {
-        _silenceTimer->stop();
-    }
+    _notifiedSilence = false;
+    _lastActivityTime = ActivityMonitor::instance()->currentTime();
+    updateActivityMonitor();
 
     activityStateSet(NOTIFYNORMAL);
 }
@@ -1119,7 +1649,8 @@ void Session::setMonitorSilenceSeconds(int seconds)
 {
     _silenceSeconds = seconds;
     if (_monitorSilence) {
-        _silenceTimer->start(_silenceSeconds * 1000);
+        _notifiedSilence = false;
+        _lastActivityTime = ActivityMonitor::instance()->currentTime();
     }
 }
 
@@ -1145,6 +1676,10 @@ void Session::setFlowControlEnabled(bool enabled)
     if (_shellProcess)
         _shellProcess->setFlowControlEnabled(_flowControlEnabled);
 
+    // the terminal no longer stops the output, so neither does Konsole
+    if (!enabled && _outputSuspended)
+        updateFlowControlState(false);
+
     emit flowControlEnabledChanged(enabled);
 }
 bool Session::flowControlEnabled() const
@@ -1162,6 +1697,117 @@ void Session::fireZModemDetected()
     }
 }
 
+void Session::setZModemDetectionEnabled(bool enabled)
+{
+    _emulation->setZModemDetectionEnabled(enabled);
+}
+
+void Session::setBinaryOutputDetectionEnabled(bool enabled)
+{
+    _emulation->setBinaryOutputDetectionEnabled(enabled);
+}
+
+void Session::setFastForwardEnabled(bool enabled)
+{
+    _emulation->setFastForwardEnabled(enabled);
+}
+
+void Session::setReflowLines(bool enable)
+{
+    _emulation->setReflowLines(enable);
+}
+
+void Session::setAlternateScreenReleaseDelay(int seconds)
+{
+    _emulation->setAlternateScreenReleaseDelay(seconds);
+}
+
+void Session::setUpdateScheduling(int latency, int maximumInterval, int highOutputRate)
+{
+    _emulation->setUpdateScheduling(latency, maximumInterval, highOutputRate * 1024);
+}
+
+void Session::setOutputTimeSlice(int timeSlice)
+{
+    _outputTimeSlice = qMax(0, timeSlice);
+}
+
+void Session::setBackgroundOutputInterval(int interval)
+{
+    _backgroundOutputInterval = qMax(0, interval);
+}
+
+bool Session::isOutputDeferred() const
+{
+    if (_backgroundOutputInterval == 0)
+        return false;
+
+    foreach(TerminalDisplay* view, _views) {
+        if (view->isDisplayed())
+            return false;
+    }
+    return true;
+}
+
+bool Session::hasFocusedView() const
+{
+    foreach(TerminalDisplay* view, _views) {
+        if (view->hasFocus())
+            return true;
+    }
+    return false;
+}
+
+void Session::viewShown()
+{
+    if (!_pendingOutput.isEmpty())
+        processPendingOutput(_outputTimeSlice);
+
+    emit viewDisplayed();
+}
+
+void Session::setReadBufferSize(int size)
+{
+    _readBufferSize = size;
+
+    if (_shellProcess)
+        _shellProcess->setReadBufferSize(_readBufferSize);
+}
+
+void Session::cancelSendData()
+{
+    if (_shellProcess)
+        _shellProcess->cancelSendData();
+}
+
+void Session::setOutputHighWaterMark(int size)
+{
+    _outputHighWaterMark = qMax(0, size);
+    updateReadSuspended();
+}
+
+void Session::updateReadSuspended()
+{
+    if (!_shellProcess)
+        return;
+
+    const int pendingBytes = _pendingOutput.size() - _pendingOutputPos;
+    const bool suspended = _shellProcess->isReadSuspended();
+
+    // reading goes on while the output is suspended, the terminal stops
+    // the output itself and resumes it by its own rules, see
+    // Pty::outputResumeSent()
+    if (!suspended && _outputHighWaterMark > 0 && pendingBytes >= _outputHighWaterMark)
+        _shellProcess->setReadSuspended(true);
+    else if (suspended && (_outputHighWaterMark == 0 || pendingBytes <= _outputHighWaterMark / 2))
+        _shellProcess->setReadSuspended(false);
+}
+
+void Session::setFloodModeParameters(int floodOutputRate, int frameRate)
+{
+    _emulation->setFloodModeParameters(floodOutputRate * 1024, frameRate);
+}
+
 void Session::cancelZModem()
 {
     _shellProcess->sendData("\030\030\030\030", 4); // Abort
@@ -1188,6 +1834,13 @@ void Session::startZModem(const QString& zmodem, const QString& dir, const QStri
 
     _zmodemProc->start();
 
+    // the output received so far is meant for the terminal
+    processPendingOutput(0);
+
+    // the transfer is passed on to the helper in large blocks, so that it
+    // takes fewer trips through the event loop
+    _shellProcess->setReadBufferSize(qMax(_readBufferSize, ZMODEM_READ_BUFFER_SIZE));
+
     disconnect(_shellProcess, SIGNAL(receivedData(const char*,int)),
                this, SLOT(onReceiveBlock(const char*,int)));
     connect(_shellProcess, SIGNAL(receivedData(const char*,int)),
@@ -1204,6 +1857,11 @@ void Session::startZModem(const QString& zmodem, const QString& dir, const QStri
 
 void Session::zmodemReadAndSendBlock()
 {
+    if (!_zmodemProc)
+        return;
+
+    // the pty queues the data and writes it as the terminal process
+    // reads it, see Pty::sendData()
     _zmodemProc->setReadChannel(QProcess::StandardOutput);
     QByteArray data = _zmodemProc->readAll();
 
@@ -1215,6 +1873,9 @@ void Session::zmodemReadAndSendBlock()
 
 void Session::zmodemReadStatus()
 {
+    if (!_zmodemProc)
+        return;
+
     _zmodemProc->setReadChannel(QProcess::StandardError);
     QByteArray msg = _zmodemProc->readAll();
     while (!msg.isEmpty()) {
@@ -1231,15 +1892,29 @@ void Session::zmodemReadStatus()
             msg.truncate(0);
         }
         if (!txt.isEmpty())
-            _zmodemProgress->addProgressText(QString::fromLocal8Bit(txt));
+            _zmodemStatus << QString::fromLocal8Bit(txt);
     }
+
+    // the helper reports its progress many times a second, updating the
+    // dialog each time would slow down the transfer
+    if (!_zmodemStatus.isEmpty() && !_zmodemStatusTimer->isActive())
+        _zmodemStatusTimer->start();
 }
 
-void Session::zmodemReceiveBlock(const char* data, int len)
+void Session::zmodemShowStatus()
 {
-    QByteArray bytes(data, len);
+    _zmodemStatusTimer->stop();
 
-    _zmodemProc->write(bytes);
+    foreach(const QString & text, _zmodemStatus) {
+        _zmodemProgress->addProgressText(text);
+    }
+    _zmodemStatus.clear();
+}
+
+void Session::zmodemReceiveBlock(const char* data, int len)
+{
+    if (_zmodemProc)
+        _zmodemProc->write(data, len);
 }
 
 void Session::zmodemFinished()
@@ -1258,16 +1933,263 @@ void Session::zmodemFinished()
                    this , SLOT(zmodemReceiveBlock(const char*,int)));
         connect(_shellProcess, SIGNAL(receivedData(const char*,int)),
                 this, SLOT(onReceiveBlock(const char*,int)));
+        _shellProcess->setReadBufferSize(_readBufferSize);
 
         _shellProcess->sendData("\030\030\030\030", 4); // Abort
         _shellProcess->sendData("\001\013\n", 3); // Try to get prompt back
+        zmodemShowStatus();
         _zmodemProgress->transferDone();
     }
 }
 
+// output is passed to the emulation in chunks of this size, the time
+// slice is checked after each of them
+static const int OUTPUT_CHUNK_SIZE = 4096;
+
 void Session::onReceiveBlock(const char* buf, int len)
 {
-    _emulation->receiveData(buf, len);
+    if (_outputLogger)
+        _outputLogger->logOutput(buf, len);
+    if (_recorder)
+        _recorder->recordOutput(buf, len);
+
+    scheduleForegroundCheck();
+    _receivedOutput = true;
+
+    if (!_pendingOutput.isEmpty()) {
+        // keep the order of the output
+        _pendingOutput.append(buf, len);
+    } else if (_outputSuspended) {
+        // the output which the terminal sent before it stopped waits
+        // until the output is resumed
+        _pendingOutput = QByteArray(buf, len);
+        _pendingOutputPos = 0;
+    } else if (isOutputDeferred()) {
+        _pendingOutput = QByteArray(buf, len);
+        _pendingOutputPos = 0;
+        OutputScheduler::instance()->addSession(this);
+    } else if (_outputTimeSlice == 0) {
+        _emulation->receiveData(buf, len);
+        return;
+    } else {
+        QElapsedTimer timer;
+        timer.start();
+
+        int pos = 0;
+        while (pos < len && timer.elapsed() < _outputTimeSlice) {
+            const int length = qMin(OUTPUT_CHUNK_SIZE, len - pos);
+            _emulation->receiveData(buf + pos, length);
+            pos += length;
+        }
+
+        if (pos == len)
+            return;
+
+        _pendingOutput = QByteArray(buf + pos, len - pos);
+        _pendingOutputPos = 0;
+        OutputScheduler::instance()->addSession(this);
+    }
+
+    updateReadSuspended();
+}
+
+void Session::processPendingOutput(int timeSlice)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while (processPendingOutputChunk()) {
+        if (timeSlice > 0 && timer.elapsed() >= timeSlice)
+            break;
+    }
+
+    discardProcessedOutput();
+}
+
+bool Session::processPendingOutputChunk()
+{
+    if (_outputSuspended)
+        return false;
+
+    if (_pendingOutputPos < _pendingOutput.size()) {
+        const int length = qMin(OUTPUT_CHUNK_SIZE, _pendingOutput.size() - _pendingOutputPos);
+        _emulation->receiveData(_pendingOutput.constData() + _pendingOutputPos, length);
+        _pendingOutputPos += length;
+    }
+
+    return _pendingOutputPos < _pendingOutput.size();
+}
+
+void Session::discardProcessedOutput()
+{
+    if (_pendingOutputPos < _pendingOutput.size()) {
+        _pendingOutput.remove(0, _pendingOutputPos);
+        _pendingOutputPos = 0;
+        if (!_outputSuspended)
+            OutputScheduler::instance()->addSession(this);
+    } else {
+        _pendingOutput.clear();
+        _pendingOutputPos = 0;
+        OutputScheduler::instance()->removeSession(this);
+    }
+
+    updateReadSuspended();
+}
+
+K_GLOBAL_STATIC(OutputScheduler, theOutputScheduler)
+
+OutputScheduler::OutputScheduler()
+    : _scheduled(false)
+{
+    _backgroundTimer.setSingleShot(true);
+    connect(&_backgroundTimer, SIGNAL(timeout()), this, SLOT(processBackgroundOutput()));
+}
+
+OutputScheduler* OutputScheduler::instance()
+{
+    return theOutputScheduler;
+}
+
+void OutputScheduler::addSession(Session* session)
+{
+    if (session->isOutputDeferred()) {
+        _sessions.removeAll(session);
+        if (!_backgroundSessions.contains(session))
+            _backgroundSessions << session;
+
+        const int interval = session->_backgroundOutputInterval;
+        if (!_backgroundTimer.isActive() || _backgroundTimer.interval() > interval)
+            _backgroundTimer.start(interval);
+        return;
+    }
+
+    _backgroundSessions.removeAll(session);
+    if (!_sessions.contains(session))
+        _sessions << session;
+
+    if (!_scheduled) {
+        _scheduled = true;
+        QTimer::singleShot(0, this, SLOT(processOutput()));
+    }
+}
+
+void OutputScheduler::removeSession(Session* session)
+{
+    _sessions.removeAll(session);
+    _backgroundSessions.removeAll(session);
+}
+
+void OutputScheduler::processBackgroundOutput()
+{
+    foreach(Session* session, _backgroundSessions) {
+        if (!_sessions.contains(session))
+            _sessions << session;
+    }
+    _backgroundSessions.clear();
+
+    processOutput();
+}
+
+void OutputScheduler::processOutput()
+{
+    _scheduled = false;
+
+    // the sessions may be removed while their output is processed.  The
+    // sessions whose views have the focus go first
+    QList< QPointer<Session> > sessions;
+    foreach(Session* session, _sessions) {
+        if (session->hasFocusedView())
+            sessions.prepend(session);
+        else
+            sessions << session;
+    }
+    _sessions.clear();
+
+    // the time each session has used in this pass, in microseconds, or -1
+    // once it is done
+    QVector<qint64> usedTime(sessions.count(), 0);
+    int activeSessions = sessions.count();
+
+    // each round passes one chunk from every session which is not done yet
+    while (activeSessions > 0) {
+        for (int i = 0; i < sessions.count(); i++) {
+            if (usedTime[i] < 0)
+                continue;
+
+            Session* session = sessions[i];
+            bool done = true;
+            if (session) {
+                const PerformanceClock clock;
+                done = !session->processPendingOutputChunk();
+                usedTime[i] += clock.elapsed();
+                done = done || (session->_outputTimeSlice > 0 &&
+                                usedTime[i] >= session->_outputTimeSlice * 1000);
+            }
+
+            if (done) {
+                usedTime[i] = -1;
+                activeSessions--;
+            }
+        }
+    }
+
+    // the sessions with output left are added for the next pass
+    foreach(Session* session, sessions) {
+        if (session)
+            session->discardProcessedOutput();
+    }
+}
+
+K_GLOBAL_STATIC(ActivityMonitor, theActivityMonitor)
+
+ActivityMonitor::ActivityMonitor()
+{
+    _clock.start();
+
+    _timer.setInterval(CHECK_INTERVAL);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(checkSessions()));
+}
+
+ActivityMonitor* ActivityMonitor::instance()
+{
+    return theActivityMonitor;
+}
+
+qint64 ActivityMonitor::currentTime() const
+{
+    return _clock.elapsed();
+}
+
+void ActivityMonitor::addSession(Session* session)
+{
+    if (!_sessions.contains(session))
+        _sessions << session;
+
+    if (!_timer.isActive())
+        _timer.start();
+}
+
+void ActivityMonitor::removeSession(Session* session)
+{
+    _sessions.removeAll(session);
+
+    if (_sessions.isEmpty())
+        _timer.stop();
+}
+
+void ActivityMonitor::checkSessions()
+{
+    const qint64 now = currentTime();
+
+    // the sessions may stop monitoring when they are notified
+    QList< QPointer<Session> > sessions;
+    foreach(Session* session, _sessions)
+        sessions << session;
+
+    foreach(Session* session, sessions) {
+        if (session)
+            session->checkActivity(now);
+    }
 }
 
 QSize Session::size()
@@ -1378,6 +2300,109 @@ int Session::historySize() const
     }
 }
 
+qint64 Session::historyMemoryUsage() const
+{
+    return _emulation->historyMemoryUsage();
+}
+
+qint64 Session::retainedHistoryMemoryUsage() const
+{
+    return _emulation->retainedHistoryMemoryUsage();
+}
+
+QVariantMap Session::statistics() const
+{
+    const Emulation::ProcessingStatistics& processing = _emulation->processingStatistics();
+
+    QVariantMap statistics;
+    statistics["receivedBytes"] = processing.receivedBytes;
+    statistics["sentBytes"] = _sentBytes;
+    statistics["receivedBlocks"] = processing.blockCount;
+    statistics["processedTokens"] = processing.tokenCount;
+    statistics["processingTime"] = processing.processingTime;
+    statistics["historyLines"] = _emulation->historyLineCount();
+    statistics["historyBytes"] = _emulation->historyMemoryUsage();
+    statistics["screenBytes"] = _emulation->screenMemoryUsage();
+
+    const Emulation::UpdateStatistics& updates = _emulation->updateStatistics();
+    statistics["outputRate"] = updates.outputRate;
+    statistics["updatesThrottled"] = updates.throttled;
+
+    qint64 imageUpdates = 0;
+    qint64 skippedUpdates = 0;
+    qint64 paints = 0;
+    qint64 paintTime = 0;
+    qint64 keyEchoes = 0;
+    qint64 keyEchoTime = 0;
+    qint64 maximumKeyEchoTime = 0;
+    foreach(TerminalDisplay* view, _views) {
+        const TerminalDisplay::PaintStatistics& paint = view->paintStatistics();
+        imageUpdates += paint.updateCount;
+        skippedUpdates += paint.skippedUpdates;
+        paints += paint.paintCount;
+        paintTime += paint.paintTime;
+        keyEchoes += paint.keyEchoCount;
+        keyEchoTime += paint.keyEchoTime;
+        maximumKeyEchoTime = qMax(maximumKeyEchoTime, paint.maximumKeyEchoTime);
+    }
+    statistics["imageUpdates"] = imageUpdates;
+    statistics["skippedUpdates"] = skippedUpdates;
+    statistics["paints"] = paints;
+    statistics["paintTime"] = paintTime;
+    statistics["keyEchoes"] = keyEchoes;
+    statistics["keyEchoTime"] = keyEchoTime;
+    statistics["maximumKeyEchoTime"] = maximumKeyEchoTime;
+
+    return statistics;
+}
+
+QVariantMap Session::memoryReport() const
+{
+    const qint64 screenBytes = _emulation->screenMemoryUsage();
+    const qint64 historyBytes = _emulation->historyMemoryUsage();
+    const qint64 extendedCharBytes = _emulation->extendedCharMemoryUsage();
+
+    qint64 viewBytes = 0;
+    qint64 filterBytes = 0;
+    foreach(TerminalDisplay* view, _views) {
+        viewBytes += view->memoryUsage();
+        filterBytes += view->filterMemoryUsage();
+    }
+
+    QVariantMap report;
+    report["screenBytes"] = screenBytes;
+    report["historyBytes"] = historyBytes;
+    report["historyFileBytes"] = _emulation->historyFileSize();
+    report["viewBytes"] = viewBytes;
+    report["filterBytes"] = filterBytes;
+    report["extendedCharBytes"] = extendedCharBytes;
+    report["totalBytes"] = screenBytes + historyBytes + viewBytes + filterBytes +
+                           extendedCharBytes;
+
+    return report;
+}
+
+void Session::trimMemory()
+{
+    _emulation->releaseMemory();
+
+    foreach(TerminalDisplay* view, _views) {
+        view->releaseHiddenResources();
+    }
+}
+
+void Session::countSentData(const char* /*data*/, int length)
+{
+    _sentBytes += length;
+}
+
+QString Session::persistentHistoryFileName() const
+{
+    // strip the braces around the identifier
+    const QString identifier = _uniqueIdentifier.toString().mid(1, 36);
+    return KStandardDirs::locateLocal("data", "konsole/history/" + identifier);
+}
+
 int Session::foregroundProcessId()
 {
     int pid;
@@ -1430,14 +2455,27 @@ void Session::restoreSession(KConfigGroup& group)
     value = group.readEntry("RemoteTab");
     if (!value.isEmpty()) setTabTitleFormat(RemoteTabTitle, value);
     value = group.readEntry("SessionGuid");
-    if (!value.isEmpty()) _uniqueIdentifier = QUuid(value);
+    if (!value.isEmpty()) {
+        _uniqueIdentifier = QUuid(value);
+
+        // reattach to the history kept under the restored identifier
+        if (!historyFileName(historyType()).isEmpty())
+            setHistoryType(HistoryTypeFile(persistentHistoryFileName()));
+    }
     value = group.readEntry("Encoding");
     if (!value.isEmpty()) setCodec(value.toUtf8());
 }
 
+// the interval, in milliseconds, at which backlogged sessions are checked
+// for having caught up with the forwarded input
+static const int BACKLOG_CHECK_INTERVAL = 500;
+
 SessionGroup::SessionGroup(QObject* parent)
-    : QObject(parent), _masterMode(0)
+    : QObject(parent), _masterMode(0), _backloggedSessions(0)
 {
+    _backlogTimer = new QTimer(this);
+    _backlogTimer->setInterval(BACKLOG_CHECK_INTERVAL);
+    connect(_backlogTimer, SIGNAL(timeout()), this, SLOT(updateBacklog()));
 }
 SessionGroup::~SessionGroup()
 {
@@ -1459,12 +2497,15 @@ void SessionGroup::addSession(Session* session)
 {
     connect(session, SIGNAL(finished()), this, SLOT(sessionFinished()));
     _sessions.insert(session, false);
+    updateSlaves();
 }
 void SessionGroup::removeSession(Session* session)
 {
     disconnect(session, SIGNAL(finished()), this, SLOT(sessionFinished()));
     setMasterStatus(session, false);
     _sessions.remove(session);
+    updateSlaves();
+    updateBacklog();
 }
 void SessionGroup::sessionFinished()
 {
@@ -1480,6 +2521,14 @@ QList<Session*> SessionGroup::masters() const
 {
     return _sessions.keys(true);
 }
+void SessionGroup::updateSlaves()
+{
+    _slaves = _sessions.keys(false);
+}
+int SessionGroup::backloggedSessionCount() const
+{
+    return _backloggedSessions;
+}
 void SessionGroup::setMasterStatus(Session* session , bool master)
 {
     const bool wasMaster = _sessions[session];
@@ -1489,6 +2538,7 @@ void SessionGroup::setMasterStatus(Session* session , bool master)
         return;
     }
     _sessions[session] = master;
+    updateSlaves();
 
     if (master) {
         connect(session->emulation(), SIGNAL(sendData(const char*,int)),
@@ -1509,13 +2559,34 @@ void SessionGroup::forwardData(const char* data, int size)
         return;
     }
 
+    // the data goes straight to the ptys of the other sessions, which
+    // queue it if it cannot be written right away
     _inForwardData = true;
-    foreach(Session* other, _sessions.keys()) {
-        if (!_sessions[other]) {
-            other->emulation()->sendString(data, size);
-        }
+    foreach(Session* other, _slaves) {
+        other->sendData(data, size);
     }
     _inForwardData = false;
+
+    updateBacklog();
+}
+void SessionGroup::updateBacklog()
+{
+    int backlogged = 0;
+    foreach(Session* other, _slaves) {
+        if (other->isInputBacklogged())
+            backlogged++;
+    }
+
+    // keep checking until all the sessions have caught up
+    if (backlogged == 0)
+        _backlogTimer->stop();
+    else if (!_backlogTimer->isActive())
+        _backlogTimer->start();
+
+    if (backlogged != _backloggedSessions) {
+        _backloggedSessions = backlogged;
+        emit backlogChanged(backlogged);
+    }
 }
 
 #include "Session.moc"
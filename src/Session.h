@@ -29,8 +29,11 @@
 #include <QtCore/QHash>
 //#include <QtCore/QByteRef>
 #include <QtCore/QUuid>
+#include <QtCore/QVariant>
 #include <QtCore/QSize>
 #include <QtCore/QProcess>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
 #include <QWidget>
 
 // KDE
@@ -38,8 +41,11 @@
 
 // Konsole
 #include "konsole_export.h"
+#include "ProcessInfo.h"
 
 class QColor;
+class QSocketNotifier;
+class QTextStream;
 
 class KConfigGroup;
 class KProcess;
@@ -48,10 +54,11 @@ namespace Konsole
 {
 class Emulation;
 class Pty;
-class ProcessInfo;
 class TerminalDisplay;
 class ZModemDialog;
 class HistoryType;
+class SessionLogger;
+class SessionRecorder;
 
 /**
  * Represents a terminal session consisting of a pseudo-teletype and a terminal emulation.
@@ -221,6 +228,55 @@ public:
      */
     void clearHistory();
 
+    /**
+     * Sets whether an index of the history is kept, which speeds up
+     * searching very long output at the cost of some memory for each line.
+     */
+    void setHistoryIndexEnabled(bool enable);
+
+    /**
+     * Starts logging the output of the session to a new file in @p directory,
+     * or stops logging if @p directory is empty.  The log is written as the
+     * output arrives, independently of the history.
+     *
+     * @param directory The directory in which the log file is created
+     * @param plainText Specifies whether escape sequences and control
+     * characters are removed from the logged output
+     */
+    void setOutputLogging(const QString& directory, bool plainText);
+    /**
+     * Returns the name of the file which the output is logged to, or an
+     * empty string if the output is not logged.
+     */
+    QString outputLogFileName() const;
+
+    /**
+     * Sends @p length bytes of @p data to the terminal process as they are,
+     * without passing them through the emulation.  The data is queued by
+     * the pty if the process does not read it right away.
+     */
+    void sendData(const char* data, int length);
+    /**
+     * Returns true if a lot of the data sent to the terminal process has
+     * not been read by it yet, which happens when the process or the
+     * connection it uses is slow.
+     */
+    bool isInputBacklogged() const;
+
+    /**
+     * Returns the id of the foreground process group of the terminal, or
+     * 0 if it cannot be determined.  Unlike the other methods about the
+     * foreground process, this does not read any process information.
+     */
+    int foregroundProcessGroup() const;
+
+    /**
+     * Returns true if the session notices changes of the foreground process
+     * by itself and announces them with foregroundProcessChanged().
+     * This is the case while the terminal process is running.
+     */
+    bool isForegroundProcessTracked() const;
+
     /**
      * Sets the key bindings used by this session.  The bindings
      * specify how input key sequences are translated into
@@ -333,6 +389,101 @@ public:
     bool isZModemBusy() {
         return _zmodemBusy;
     }
+    /**
+     * Sets whether the output of the terminal program is checked for
+     * the start of a ZModem transfer.
+     */
+    void setZModemDetectionEnabled(bool enabled);
+    /**
+     * Sets whether output which looks like the contents of a binary file
+     * is shown without being interpreted.  See
+     * Emulation::setBinaryOutputDetectionEnabled()
+     */
+    void setBinaryOutputDetectionEnabled(bool enabled);
+    /**
+     * Sets whether output which scrolls off the screen before it could be
+     * seen is skipped.  See Emulation::setFastForwardEnabled()
+     */
+    void setFastForwardEnabled(bool enabled);
+
+    /**
+     * Sets whether wrapped lines are rewrapped when the terminal is resized.
+     * See Emulation::setReflowLines()
+     */
+    void setReflowLines(bool enable);
+
+    /**
+     * Sets how long, in seconds, the alternate screen is kept after the
+     * terminal has switched back to the primary screen.
+     * See Emulation::setAlternateScreenReleaseDelay()
+     */
+    void setAlternateScreenReleaseDelay(int seconds);
+
+    /**
+     * Sets how attached views are updated after output has been received.
+     * See Emulation::setUpdateScheduling()
+     *
+     * @param latency Delay after the last output, in milliseconds
+     * @param maximumInterval Interval between updates at high output rates,
+     * in milliseconds
+     * @param highOutputRate Output rate above which updates are throttled,
+     * in KiB per second
+     */
+    void setUpdateScheduling(int latency, int maximumInterval, int highOutputRate);
+
+    /**
+     * Sets when attached views enter flood mode.
+     * See Emulation::setFloodModeParameters()
+     *
+     * @param floodOutputRate Output rate above which flood mode is entered,
+     * in KiB per second, or 0 to disable flood mode
+     * @param frameRate Maximum number of updates per second in flood mode
+     */
+    void setFloodModeParameters(int floodOutputRate, int frameRate);
+
+    /**
+     * Sets the longest time, in milliseconds, spent processing output
+     * from the terminal program before control is returned to the event
+     * loop.  Any output which remains is processed in the following passes
+     * through the event loop, so that a session which produces a lot of
+     * output does not make other sessions and the user interface
+     * unresponsive.
+     *
+     * If @p timeSlice is 0, output is processed entirely as soon as it
+     * arrives.
+     */
+    void setOutputTimeSlice(int timeSlice);
+
+    /**
+     * Sets the interval, in milliseconds, at which the output is processed
+     * while none of the session's views are displayed, e.g. because they
+     * are in background tabs.  The output received in the meantime is
+     * queued and then processed all at once, which takes less time in
+     * total than processing it as it arrives, and leaves more time to the
+     * sessions which are displayed.  When a view is shown again, the
+     * queued output is processed right away.
+     *
+     * If @p interval is 0, the output of sessions which are not displayed
+     * is processed like any other.
+     */
+    void setBackgroundOutputInterval(int interval);
+
+    /**
+     * Sets the size, in bytes, of the buffer which output from the
+     * terminal program is read into.  See Pty::setReadBufferSize()
+     */
+    void setReadBufferSize(int size);
+
+    /**
+     * Sets the amount of queued output, in bytes, at which reading from
+     * the terminal program is suspended until most of the queued output
+     * has been processed.  The kernel then blocks the terminal program
+     * when it writes more output, instead of Konsole falling further
+     * behind.  See setOutputTimeSlice()
+     *
+     * If @p size is 0, reading is never suspended.
+     */
+    void setOutputHighWaterMark(int size);
 
     /**
       * Possible values of the @p what parameter for setUserTitle()
@@ -359,7 +510,6 @@ public:
     void sendSignal(int signal);
 
 public slots:
-
     /**
      * Starts the terminal session.
      *
@@ -367,6 +517,12 @@ public slots:
      */
     void run();
 
+    /**
+     * Discards the input which has been sent to the terminal program, but
+     * has not been written to the pty yet.  See Pty::cancelSendData()
+     */
+    void cancelSendData();
+
     /**
      * Returns the environment of this session as a list of strings like
      * VARIABLE=VALUE
@@ -462,12 +618,40 @@ public slots:
     /**
      * Sends @p text to the current foreground terminal program.
      */
-    Q_SCRIPTABLE void sendText(const QString& text) const;
+    Q_SCRIPTABLE void sendText(const QString& text);
 
     /**
      * Sends @p command to the current foreground terminal program.
      */
-    Q_SCRIPTABLE void runCommand(const QString& command) const;
+    Q_SCRIPTABLE void runCommand(const QString& command);
+
+    /**
+     * Sends @p commands to the current foreground terminal program, each
+     * followed by a new line, with one call instead of one per command.
+     *
+     * @param delay The time in milliseconds to wait between two commands,
+     * or 0 to send them all at once.  The first command is sent right away.
+     *
+     * The input sent with sendText(), runCommand(), runCommands() and
+     * sendBytes() reaches the program in the order of the calls, input
+     * sent while earlier commands are still waiting for their delay waits
+     * for them.  Large amounts of input are written to the terminal as the
+     * program reads it, without holding up Konsole.
+     */
+    Q_SCRIPTABLE void runCommands(const QStringList& commands, int delay);
+
+    /**
+     * Sends @p data to the current foreground terminal program as it is,
+     * without encoding it with the session's codec.  See runCommands()
+     */
+    Q_SCRIPTABLE void sendBytes(const QByteArray& data);
+
+    /**
+     * Returns the number of bytes of input sent by the methods above which
+     * have not been written to the terminal program yet.  Scripts can use
+     * this to keep from sending input faster than the program reads it.
+     */
+    Q_SCRIPTABLE qint64 pendingInputSize() const;
 
     /**
      * Sends a mouse event of type @p eventType emitted by button
@@ -552,6 +736,148 @@ public slots:
      */
     Q_SCRIPTABLE int historySize() const;
 
+    /**
+     * Returns the number of bytes of memory used to store the history of
+     * this session.
+     */
+    Q_SCRIPTABLE qint64 historyMemoryUsage() const;
+
+    /**
+     * Returns the number of bytes of memory which the history keeps using
+     * once a change of the history type, which copies the lines in the
+     * background, has finished.  Until then the old history is counted by
+     * historyMemoryUsage() as well.
+     */
+    qint64 retainedHistoryMemoryUsage() const;
+
+    /**
+     * Returns cumulative statistics about the resources used by this
+     * session, for monitoring.  The counters start at 0 when the session
+     * is created, those of the views are summed over the views currently
+     * attached to the session.  Besides the counters, the map holds the
+     * current state of the scheduling of updates.  The map contains:
+     * <ul>
+     * <li>receivedBytes - bytes of output received from the terminal process</li>
+     * <li>sentBytes - bytes of input sent to the terminal process</li>
+     * <li>receivedBlocks - blocks of output passed to the emulation</li>
+     * <li>processedTokens - characters and control functions in the output</li>
+     * <li>processingTime - time spent processing the output, in microseconds</li>
+     * <li>historyLines - lines in the history</li>
+     * <li>historyBytes - memory used by the history, see historyMemoryUsage()</li>
+     * <li>screenBytes - memory used by the images of the normal and alternate screens</li>
+     * <li>outputRate - the smoothed rate of the output, in bytes per second</li>
+     * <li>updatesThrottled - true while the updates of the views are throttled
+     *     because of a high output rate</li>
+     * <li>imageUpdates - updates of the views from the screen, </li>
+     * <li>skippedUpdates - updates skipped because a view was hidden</li>
+     * <li>paints - paint events of the views</li>
+     * <li>paintTime - time spent painting the views, in microseconds</li>
+     * <li>keyEchoes - key presses whose echo was painted by the views</li>
+     * <li>keyEchoTime - time from those key presses until their echo was
+     *     painted, in microseconds</li>
+     * <li>maximumKeyEchoTime - the longest of those times, in microseconds</li>
+     * </ul>
+     */
+    Q_SCRIPTABLE QVariantMap statistics() const;
+
+    /**
+     * Returns the number of bytes of memory used by the parts of this
+     * session, to find out which sessions use how much.  Those of the
+     * views are summed over the views currently attached to the session.
+     * The map contains:
+     * <ul>
+     * <li>screenBytes - the images of the normal and alternate screens</li>
+     * <li>historyBytes - the history, see historyMemoryUsage()</li>
+     * <li>historyFileBytes - the size of the files the history is kept in,
+     *     which is not included in totalBytes</li>
+     * <li>viewBytes - the images and drawing caches of the views</li>
+     * <li>filterBytes - the text and hotspots of the views' filters</li>
+     * <li>extendedCharBytes - the combined characters used by the session</li>
+     * <li>totalBytes - the memory used by all of the above</li>
+     * </ul>
+     *
+     * The combined characters are found by reading every line of the
+     * history, which takes a while for long histories.
+     */
+    Q_SCRIPTABLE QVariantMap memoryReport() const;
+
+    /**
+     * Gives back memory which the session does not need at the moment.
+     * The history is compacted, the alternate screen is deleted unless it
+     * is in use, and the caches of views which are hidden are freed.  Views
+     * which are shown keep their caches.  This is meant for sessions which
+     * are idle, it only costs some time when their output is shown again.
+     */
+    Q_SCRIPTABLE void trimMemory();
+
+    /**
+     * Starts recording the output of the session, with the time it
+     * arrived, and the changes of the terminal size to @p fileName, or
+     * stops recording if @p fileName is empty.  The recording can be
+     * replayed with replayRecording() or by the emulation benchmark, to
+     * reproduce problems which depend on the output of a program.
+     *
+     * Returns false if the recording file cannot be created.
+     */
+    Q_SCRIPTABLE bool setRecordingFile(const QString& fileName);
+
+    /**
+     * Replays a recording made with setRecordingFile() in this session.
+     * Any output of the session's own process is shown in between.
+     *
+     * @param fileName The recording to replay
+     * @param originalSpeed Specifies whether the output is replayed with
+     * the timing it was recorded with, or as fast as possible
+     *
+     * Returns false if the recording cannot be read.
+     */
+    Q_SCRIPTABLE bool replayRecording(const QString& fileName, bool originalSpeed);
+
+    /**
+     * Returns the number of lines in the history of the current screen,
+     * which come before the lines of the screen.  See lines()
+     */
+    Q_SCRIPTABLE int historyLineCount() const;
+
+    /**
+     * Returns the text of the lines from @p startLine to @p endLine of the
+     * current screen, both included.  Line 0 is the top line of the screen,
+     * the lines of the history have negative numbers, -1 being the line
+     * just above the screen, down to -historyLineCount().  Lines outside
+     * the screen and the history are left out.
+     *
+     * @param withAttributes Specifies whether the text is returned as HTML
+     * which shows the colors and other attributes of the characters, as
+     * when saving the output, or as plain text, without the spaces at the
+     * end of the lines.
+     *
+     * The lines are read at once, so they are consistent with each other
+     * even while the output goes on.  Use writeLines() for large ranges.
+     */
+    Q_SCRIPTABLE QString lines(int startLine, int endLine, bool withAttributes);
+
+    /**
+     * Writes the lines from @p startLine to @p endLine, as returned by
+     * lines(), to @p fileName in UTF-8.  This is meant to pass the history
+     * to another program through a named pipe which it reads from: the lines
+     * are read right away, so they are consistent with each other, but are
+     * written while Konsole goes on, as fast as the reader takes them.  The
+     * reader sees the end of the file once all of them have been written.
+     *
+     * Returns false if the file cannot be opened.  A named pipe has to be
+     * opened for reading before calling this.
+     */
+    Q_SCRIPTABLE bool writeLines(const QString& fileName, int startLine, int endLine,
+                                 bool withAttributes);
+
+    /**
+     * Returns the name under which the history of this session is kept
+     * when it is to survive restarting Konsole, see HistoryTypeFile.
+     * It follows the unique identifier of the session, which is restored
+     * together with the session.
+     */
+    QString persistentHistoryFileName() const;
+
 signals:
 
     /** Emitted when the terminal process starts. */
@@ -580,6 +906,16 @@ signals:
      */
     void currentDirectoryChanged(const QString& dir);
 
+    /**
+     * Emitted when a different process group has become the foreground
+     * process group of the terminal.
+     *
+     * The session checks the foreground process group shortly after input
+     * is sent to the terminal or output is received from it.  On Linux, it
+     * is also told when the foreground process exits.
+     */
+    void foregroundProcessChanged();
+
     /** Emitted when a bell event occurs in the session. */
     void bellRequest(const QString& message);
 
@@ -651,16 +987,30 @@ signals:
      */
     void selectionChanged(const QString& text);
 
+    /**
+     * Emitted while a large amount of input is written to the pty.
+     * See Pty::sendDataProgress()
+     */
+    void sendDataProgress(qint64 sent, qint64 total);
+
+    /**
+     * Emitted when one of the session's views is shown after it was hidden,
+     * because its tab was activated or its window was restored.
+     */
+    void viewDisplayed();
+
 private slots:
     void done(int, QProcess::ExitStatus);
 
     void fireZModemDetected();
 
     void onReceiveBlock(const char* buffer, int len);
-    void silenceTimerDone();
-    void activityTimerDone();
+    // processes the output which was deferred while no view was displayed
+    void viewShown();
 
     void onViewSizeChange(int height, int width);
+    // resizes the terminal to fit into all views
+    void updateTerminalSize();
 
     void activityStateSet(int);
 
@@ -668,22 +1018,43 @@ private slots:
     void viewDestroyed(QObject* view);
 
     void zmodemReadStatus();
+    void zmodemShowStatus();
     void zmodemReadAndSendBlock();
     void zmodemReceiveBlock(const char* data, int len);
     void zmodemFinished();
 
     void updateFlowControlState(bool suspended);
+    // called when input which resumes the output of the terminal, such as
+    // a Ctrl+Q which was pasted or broadcast, has been sent to it
+    void resumeOutput();
     void updateWindowSize(int lines, int columns);
+    // tells the terminal program about the size of the terminal once it
+    // has stopped changing
+    void applyWindowSize();
 
     // signal relayer
     void onPrimaryScreenInUse(bool use);
 
+    // checks the foreground process group soon, unless that is already due
+    void scheduleForegroundCheck();
+    // emits foregroundProcessChanged() if the foreground process group changed
+    void checkForegroundProcess();
+    void foregroundProcessExited();
+
+    // counts the input sent to the terminal process
+    void countSentData(const char* data, int length);
+
+    // sends the queued input which is due, see queueInput()
+    void sendPendingInput();
+
 private:
+    // watches for process 'pid' to exit, if that is supported
+    void watchForegroundProcess(int pid);
+
     // checks that the binary 'program' is available and can be executed
     // returns the binary name if available or an empty string otherwise
     static QString checkProgram(const QString& program);
 
-    void updateTerminalSize();
     WId windowId() const;
     bool kill(int signal);
     // print a warning message in the terminal.  This is used
@@ -694,6 +1065,23 @@ private:
     void updateSessionProcessInfo();
     bool updateForegroundProcessInfo();
     ProcessInfo* updateWorkingDirectory();
+    // returns the user, host and command parsed from the arguments of the
+    // ssh process 'process', they are only parsed again when the process
+    // or its arguments change
+    const SSHProcessInfo& sshProcessInfo(const ProcessInfo* process);
+
+    // converts the lines from 'startLine' to 'endLine', numbered as in
+    // lines(), to those of Emulation::writeToStream().  Returns false if
+    // none of them exist
+    bool toEmulationLines(int& startLine, int& endLine) const;
+
+    // sends 'data' to the terminal process once 'delay' milliseconds have
+    // passed since the input queued before it was sent, or right away if
+    // none is queued and 'delay' is 0
+    void queueInput(const QByteArray& data, int delay);
+    // writes the lines from 'startLine' to 'endLine' of the emulation to
+    // 'output' as HTML, with the colors of the views
+    void writeHtmlLines(QTextStream* output, int startLine, int endLine);
 
     QUuid            _uniqueIdentifier; // SHELL_SESSION_ID
 
@@ -706,9 +1094,21 @@ private:
     bool           _monitorActivity;
     bool           _monitorSilence;
     bool           _notifiedActivity;
+    bool           _notifiedSilence;
     int            _silenceSeconds;
-    QTimer*        _silenceTimer;
-    QTimer*        _activityTimer;
+    // set for each block of output, and looked at by the ActivityMonitor
+    bool           _receivedOutput;
+    // the times of the ActivityMonitor's clock when output was last seen
+    // and when the activity was last notified, in milliseconds
+    qint64         _lastActivityTime;
+    qint64         _activityNotifiedTime;
+
+    // coalesces the resizing of the terminal while views are being resized
+    QTimer*        _viewResizeTimer;
+    // delays telling the terminal program about the new size until the
+    // views have settled, see updateWindowSize()
+    QTimer*        _windowSizeTimer;
+    QSize          _pendingWindowSize;
 
     bool           _masterMode;
     bool           _autoClose;
@@ -739,16 +1139,204 @@ private:
     ProcessInfo*   _foregroundProcessInfo;
     int            _foregroundPid;
 
+    // the ssh process whose arguments were parsed into _sshProcessInfo
+    SSHProcessInfo*  _sshProcessInfo;
+    int              _sshProcessPid;
+    QVector<QString> _sshProcessArguments;
+
+    // what the title returned by getDynamicTitle() was made from, the
+    // title is only made again when any of this changes
+    struct DynamicTitleSource {
+        DynamicTitleSource() : valid(false), pid(0) {}
+
+        bool operator==(const DynamicTitleSource& other) const {
+            return valid == other.valid && pid == other.pid && name == other.name &&
+                   arguments == other.arguments && dir == other.dir &&
+                   format == other.format;
+        }
+
+        bool valid;
+        int pid;
+        QString name;
+        QVector<QString> arguments;
+        QString dir;
+        QString format;
+    };
+    DynamicTitleSource _dynamicTitleSource;
+    QString _dynamicTitle;
+    // the tab title formats, split up for ProcessInfo::format()
+    TitleFormat _localTitleFormat;
+    TitleFormat _remoteTitleFormat;
+
     // ZModem
     bool           _zmodemBusy;
     KProcess*      _zmodemProc;
     ZModemDialog*  _zmodemProgress;
+    // the status lines of the transfer which have not been shown yet, they
+    // are shown at most every ZMODEM_STATUS_INTERVAL milliseconds
+    QStringList    _zmodemStatus;
+    QTimer*        _zmodemStatusTimer;
+
+    // input from runCommands() and the other D-Bus methods which waits for
+    // the delay before it, see queueInput()
+    struct PendingInput {
+        QByteArray data;
+        int delay;
+    };
+    QList<PendingInput> _pendingInput;
+    qint64 _pendingInputSize;
+    QTimer* _inputTimer;
 
     bool _hasDarkBackground;
 
     QSize _preferredSize;
 
+    // output received from the terminal program which has not been
+    // passed to the emulation yet, starting at _pendingOutputPos
+    QByteArray     _pendingOutput;
+    int            _pendingOutputPos;
+    int            _outputTimeSlice;
+    int            _backgroundOutputInterval;
+    int            _readBufferSize;
+    int            _outputHighWaterMark;
+    // true while the output is suspended with Ctrl+S.  The output which
+    // is read is then not passed to the emulation until data which resumes
+    // the output is sent to the terminal, see updateFlowControlState() and
+    // resumeOutput()
+    bool           _outputSuspended;
+
+    // the foreground process group which was announced last, and the
+    // means to notice when its leader exits
+    QTimer*          _foregroundCheckTimer;
+    int              _trackedForegroundGroup;
+    int              _foregroundPidFd;
+    QSocketNotifier* _foregroundExitNotifier;
+
+    // writes the output to a log file, if enabled with setOutputLogging()
+    SessionLogger* _outputLogger;
+    QString        _outputLogDirectory;
+
+    // records the output, if enabled with setRecordingFile()
+    SessionRecorder* _recorder;
+
+    qint64 _sentBytes;
+
+    // returns true if output is to be queued and processed at the
+    // background interval, because none of the views are displayed
+    bool isOutputDeferred() const;
+    // returns true if one of the views has the keyboard focus
+    bool hasFocusedView() const;
+    // passes queued output to the emulation for at most 'timeSlice' ms,
+    // or until none is left if 'timeSlice' is 0
+    void processPendingOutput(int timeSlice);
+    // passes the next chunk of the queued output to the emulation,
+    // returns false if no more output is queued
+    bool processPendingOutputChunk();
+    // drops the queued output which has been passed to the emulation, and
+    // leaves the rest to the OutputScheduler
+    void discardProcessedOutput();
+    // suspends or resumes reading from the pty depending on the amount
+    // of queued output
+    void updateReadSuspended();
+
+    // notifies the activity or silence since the last call, @p now is the
+    // time of the ActivityMonitor's clock
+    void checkActivity(qint64 now);
+    // adds the session to the ActivityMonitor while it monitors activity
+    // or silence
+    void updateActivityMonitor();
+
     static int lastSessionId;
+
+    friend class OutputScheduler;
+    friend class ActivityMonitor;
+};
+
+/**
+ * Passes the queued output of all sessions to their emulations in turns.
+ *
+ * A session which receives more output than it can process within its
+ * time slice queues the rest, see Session::setOutputTimeSlice(), and is
+ * added to the scheduler.  On each pass through the event loop the
+ * scheduler hands one chunk of output from each queued session to its
+ * emulation in turn, until every session has used up its time slice or
+ * has no output left.  A session's output is only ever taken from its
+ * own queue, so it stays in order, and a session which floods its
+ * terminal gets no larger share of a pass than the others.  The sessions
+ * whose views have the focus go first in each round.
+ *
+ * The output of sessions which are not displayed is deferred, see
+ * Session::setBackgroundOutputInterval(), and processed in background
+ * passes, which take place at a longer interval and thus process more
+ * output at a time.
+ */
+class OutputScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    OutputScheduler();
+
+    static OutputScheduler* instance();
+
+    /**
+     * Processes the queued output of @p session on the next pass, or on
+     * the next background pass if the session's output is deferred.
+     */
+    void addSession(Session* session);
+    /** Stops processing the queued output of @p session */
+    void removeSession(Session* session);
+
+private slots:
+    void processOutput();
+    void processBackgroundOutput();
+
+private:
+    QList<Session*> _sessions;
+    bool _scheduled;
+
+    // the sessions whose output is deferred, they are processed together
+    // at the shortest of their background intervals
+    QList<Session*> _backgroundSessions;
+    QTimer _backgroundTimer;
+};
+
+/**
+ * Notifies the activity and silence of all sessions which monitor them.
+ *
+ * A session only notes that output has arrived, which is all that is done
+ * for each block of output.  One timer shared by all monitored sessions
+ * looks at them about once per second, notifies the activity of the
+ * sessions which received output since the last look, and the silence of
+ * those which have not received any for their silence period.
+ */
+class ActivityMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    ActivityMonitor();
+
+    static ActivityMonitor* instance();
+
+    /** Starts watching the activity and silence of @p session */
+    void addSession(Session* session);
+    /** Stops watching @p session */
+    void removeSession(Session* session);
+
+    /** Returns the time of the monitor's clock in milliseconds */
+    qint64 currentTime() const;
+
+private slots:
+    void checkSessions();
+
+private:
+    // the interval in milliseconds between two looks at the sessions
+    static const int CHECK_INTERVAL = 1000;
+
+    QList<Session*> _sessions;
+    QTimer _timer;
+    QElapsedTimer _clock;
 };
 
 /**
@@ -812,15 +1400,38 @@ public:
      */
     int masterMode() const;
 
+    /**
+     * Returns the number of sessions in the group which have not read
+     * much of the input forwarded to them yet.
+     * See Session::isInputBacklogged()
+     */
+    int backloggedSessionCount() const;
+
+signals:
+    /**
+     * Emitted when the number of sessions which are backlogged with
+     * forwarded input changes.  See backloggedSessionCount()
+     */
+    void backlogChanged(int count);
+
 private slots:
     void sessionFinished();
     void forwardData(const char* data, int size);
+    // counts the sessions which are backlogged with forwarded input
+    void updateBacklog();
 
 private:
     QList<Session*> masters() const;
+    // updates _slaves after the members or their master status changed
+    void updateSlaves();
 
     // maps sessions to their master status
     QHash<Session*, bool> _sessions;
+    // the sessions which the input of the masters is forwarded to
+    QList<Session*> _slaves;
+
+    int _backloggedSessions;
+    QTimer* _backlogTimer;
 
     int _masterMode;
 };
@@ -25,6 +25,12 @@
 #include <QApplication>
 #include <QMenu>
 #include <QtGui/QKeyEvent>
+#include <QtCore/QFile>
+#include <QtCore/QtConcurrentMap>
+#include <QtCore/QtConcurrentRun>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtGui/QFontDatabase>
 #include <QPrinter>
 #include <QPrintDialog>
 #include <QPainter>
@@ -52,6 +58,7 @@
 #include <KStringHandler>
 #include <KConfigGroup>
 #include <KGlobal>
+#include <KLocale>
 
 #include <kdeversion.h>
 #if KDE_IS_VERSION(4, 9, 1)
@@ -69,6 +76,9 @@
 #include "HistorySizeDialog.h"
 #include "IncrementalSearchBar.h"
 #include "RenameTabDialog.h"
+#include "Screen.h"
+#include "ScreenRenderer.h"
+#include "ScreenSnapshot.h"
 #include "ScreenWindow.h"
 #include "Session.h"
 #include "ProfileList.h"
@@ -97,6 +107,16 @@ const KIcon SessionController::_broadcastIcon("emblem-important");
 QSet<SessionController*> SessionController::_allControllers;
 int SessionController::_lastControllerId;
 
+// the delay, in milliseconds, after a key press after which a snapshot is taken
+static const int INTERACTION_SNAPSHOT_DELAY = 500;
+
+// the interval, in milliseconds, at which the performance statistics are updated
+static const int STATISTICS_INTERVAL = 1000;
+
+// the delay, in milliseconds, after the output changes after which the
+// matches of a search for all of them are brought up to date
+static const int SEARCH_MATCHES_UPDATE_DELAY = 500;
+
 SessionController::SessionController(Session* session , TerminalDisplay* view, QObject* parent)
     : ViewProperties(parent)
     , KXMLGUIClient()
@@ -111,8 +131,11 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     , _findAction(0)
     , _findNextAction(0)
     , _findPreviousAction(0)
+    , _snapshotProcessGroup(-1)
     , _urlFilterUpdateRequired(false)
     , _searchBar(0)
+    , _currentSearchMatch(-1)
+    , _updatedSearchMatchLine(-1)
     , _codecAction(0)
     , _switchProfileMenu(0)
     , _webSearchMenu(0)
@@ -121,24 +144,18 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     , _keepIconUntilInteraction(false)
     , _showMenuAction(0)
     , _isSearchBarEnabled(false)
+    , _actionsCreated(false)
+    , _primaryScreenInUse(true)
 {
     Q_ASSERT(session);
     Q_ASSERT(view);
 
-    // handle user interface related to session (menus etc.)
-    if (isKonsolePart()) {
+    // handle user interface related to session (menus etc.).  the actions
+    // themselves are created by setupActions() when they are first needed
+    if (isKonsolePart())
         setXMLFile("konsole/partui.rc");
-        setupCommonActions();
-    } else {
+    else
         setXMLFile("konsole/sessionui.rc");
-        setupCommonActions();
-        setupExtraActions();
-    }
-
-    actionCollection()->addAssociatedWidget(view);
-    foreach(QAction * action, actionCollection()->actions()) {
-        action->setShortcutContext(Qt::WidgetWithChildrenShortcut);
-    }
 
     setIdentifier(++_lastControllerId);
     sessionTitleChanged();
@@ -157,6 +174,8 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     // move view to newest output when keystrokes occur
     connect(_view, SIGNAL(keyPressedSignal(QKeyEvent*)), this,
             SLOT(trackOutput(QKeyEvent*)));
+    connect(_view, SIGNAL(keyRepeatedSignal(QKeyEvent*,int)), this,
+            SLOT(trackOutput(QKeyEvent*)));
 
     // listen to activity / silence notifications from session
     connect(_session, SIGNAL(stateChanged(int)), this,
@@ -177,6 +196,12 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     // listen for output changes to set activity flag
     connect(_session->emulation(), SIGNAL(outputChanged()), this,
             SLOT(fireActivity()));
+    // the lines of the matches found by a search move with new output
+    connect(_session->emulation(), SIGNAL(outputChanged()), this,
+            SLOT(searchOutputChanged()));
+    _searchMatchesUpdateTimer.setSingleShot(true);
+    _searchMatchesUpdateTimer.setInterval(SEARCH_MATCHES_UPDATE_DELAY);
+    connect(&_searchMatchesUpdateTimer, SIGNAL(timeout()), this, SLOT(updateSearchMatches()));
 
     // listen for detection of ZModem transfer
     connect(_session, SIGNAL(zmodemDetected()), this, SLOT(zmodemDownload()));
@@ -187,22 +212,14 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     _view->setFlowControlWarningEnabled(_session->flowControlEnabled());
 
     // take a snapshot of the session state every so often when
-    // user activity occurs
-    //
-    // the timer is owned by the session so that it will be destroyed along
-    // with the session
-    _interactionTimer = new QTimer(_session);
-    _interactionTimer->setSingleShot(true);
-    _interactionTimer->setInterval(500);
-    connect(_interactionTimer, SIGNAL(timeout()), this, SLOT(snapshot()));
+    // user activity occurs, and periodically in the background
     connect(_view, SIGNAL(keyPressedSignal(QKeyEvent*)), this, SLOT(interactionHandler()));
+    connect(_view, SIGNAL(keyRepeatedSignal(QKeyEvent*,int)), this, SLOT(interactionHandler()));
+    connect(_session, SIGNAL(foregroundProcessChanged()), this, SLOT(foregroundProcessChanged()));
+    SnapshotScheduler::instance()->addController(this);
 
-    // take a snapshot of the session state periodically in the background
-    QTimer* backgroundTimer = new QTimer(_session);
-    backgroundTimer->setSingleShot(false);
-    backgroundTimer->setInterval(2000);
-    connect(backgroundTimer, SIGNAL(timeout()), this, SLOT(snapshot()));
-    backgroundTimer->start();
+    _statisticsTimer.setInterval(STATISTICS_INTERVAL);
+    connect(&_statisticsTimer, SIGNAL(timeout()), this, SLOT(updateStatistics()));
 
     _allControllers.insert(this);
 
@@ -217,6 +234,7 @@ SessionController::~SessionController()
     if (_view)
         _view->setScreenWindow(0);
 
+    SnapshotScheduler::instance()->removeController(this);
     _allControllers.remove(this);
 }
 void SessionController::trackOutput(QKeyEvent* event)
@@ -242,7 +260,12 @@ void SessionController::interactionHandler()
     // happens. Otherwise, those special icons will quickly be replaced by
     // normal icon when ::snapshot() is triggered
     _keepIconUntilInteraction = false;
-    _interactionTimer->start();
+    SnapshotScheduler::instance()->scheduleSnapshot(this, INTERACTION_SNAPSHOT_DELAY);
+}
+
+void SessionController::foregroundProcessChanged()
+{
+    SnapshotScheduler::instance()->scheduleSnapshot(this, 0);
 }
 
 void SessionController::requireUrlFilterUpdate()
@@ -256,12 +279,22 @@ void SessionController::snapshot()
 {
     Q_ASSERT(_session != 0);
 
+    _snapshotProcessGroup = _session->foregroundProcessGroup();
+
     QString title = _session->getDynamicTitle();
     title         = title.simplified();
 
     // Visualize that the session is broadcasting to others
     if (_copyToGroup && _copyToGroup->sessions().count() > 1) {
         title.append('*');
+
+        // and whether some of the others are slow to take the input
+        const int backlogged = _copyToGroup->backloggedSessionCount();
+        if (backlogged > 0) {
+            title.append(i18ncp("@info:tab Sessions which have not read all of the "
+                                "input copied to them yet",
+                                " (%1 behind)", " (%1 behind)", backlogged));
+        }
     }
 
     // use the fallback title if needed
@@ -276,6 +309,15 @@ void SessionController::snapshot()
     updateSessionIcon();
 }
 
+bool SessionController::snapshotIfProcessChanged()
+{
+    if (_session->foregroundProcessGroup() == _snapshotProcessGroup)
+        return false;
+
+    snapshot();
+    return true;
+}
+
 QString SessionController::currentDir() const
 {
     return _session->currentWorkingDirectory();
@@ -354,6 +396,10 @@ void SessionController::openUrl(const KUrl& url)
 
 void SessionController::setupPrimaryScreenSpecificActions(bool use)
 {
+    _primaryScreenInUse = use;
+    if (!_actionsCreated)
+        return;
+
     KActionCollection* collection = actionCollection();
     QAction* clearAction = collection->action("clear-history");
     QAction* resetAction = collection->action("clear-history-and-reset");
@@ -373,6 +419,9 @@ void SessionController::selectionChanged(const QString& selectedText)
 
 void SessionController::updateCopyAction(const QString& selectedText)
 {
+    if (!_actionsCreated)
+        return;
+
     QAction* copyAction = actionCollection()->action("edit_copy");
 
     // copy action is meaningful only when some text is selected.
@@ -526,6 +575,7 @@ void SessionController::setSearchBar(IncrementalSearchBar* searchBar)
         connect(_searchBar, SIGNAL(findPreviousClicked()), this, SLOT(findPreviousInHistory()));
         connect(_searchBar, SIGNAL(highlightMatchesToggled(bool)) , this , SLOT(highlightMatches(bool)));
         connect(_searchBar, SIGNAL(matchCaseToggled(bool)), this, SLOT(changeSearchMatch()));
+        connect(_searchBar, SIGNAL(findAllToggled(bool)), this, SLOT(changeSearchMatch()));
 
         // if the search bar was previously active
         // then re-enter search mode
@@ -542,6 +592,26 @@ void SessionController::setShowMenuAction(QAction* action)
     _showMenuAction = action;
 }
 
+void SessionController::setupActions()
+{
+    if (_actionsCreated)
+        return;
+    _actionsCreated = true;
+
+    setupCommonActions();
+    if (!isKonsolePart())
+        setupExtraActions();
+
+    actionCollection()->addAssociatedWidget(_view);
+    foreach(QAction * action, actionCollection()->actions()) {
+        action->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+    }
+
+    // bring the actions up to date with what happened before they existed
+    updateCopyAction(_selectedText);
+    setupPrimaryScreenSpecificActions(_primaryScreenInUse);
+}
+
 void SessionController::setupCommonActions()
 {
     KAction* action = 0;
@@ -591,6 +661,10 @@ void SessionController::setupCommonActions()
     action = KStandardAction::saveAs(this, SLOT(saveHistory()), collection);
     action->setText(i18n("Save Output &As..."));
 
+    action = collection->addAction("save-image", this, SLOT(saveImage()));
+    action->setText(i18n("Save Output as &Image..."));
+    action->setIcon(KIcon("image-x-generic"));
+
     action = KStandardAction::print(this, SLOT(print_screen()), collection);
     action->setText(i18n("&Print Screen..."));
     action->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_P));
@@ -694,6 +768,11 @@ void SessionController::setupExtraActions()
     action = collection->addAction("monitor-silence", toggleAction);
     connect(action, SIGNAL(toggled(bool)), this, SLOT(monitorSilence(bool)));
 
+    // Performance Statistics
+    toggleAction = new KToggleAction(i18n("Show Performance &Statistics"), this);
+    action = collection->addAction("show-statistics", toggleAction);
+    connect(action, SIGNAL(toggled(bool)), this, SLOT(showStatistics(bool)));
+
     // Text Size
     action = collection->addAction("enlarge-font", this, SLOT(increaseFontSize()));
     action->setText(i18n("Enlarge Font"));
@@ -969,6 +1048,7 @@ void SessionController::copyInputToAllTabs()
 {
     if (!_copyToGroup) {
         _copyToGroup = new SessionGroup(this);
+        connect(_copyToGroup, SIGNAL(backlogChanged(int)), this, SLOT(snapshot()));
     }
 
     // Find our window ...
@@ -999,6 +1079,7 @@ void SessionController::copyInputToSelectedTabs()
 {
     if (!_copyToGroup) {
         _copyToGroup = new SessionGroup(this);
+        connect(_copyToGroup, SIGNAL(backlogChanged(int)), this, SLOT(snapshot()));
         _copyToGroup->addSession(_session);
         _copyToGroup->setMasterStatus(_session, true);
         _copyToGroup->setMasterMode(SessionGroup::CopyInputToAll);
@@ -1142,6 +1223,9 @@ void SessionController::searchHistory(bool showSearchBar)
             setFindNextPrevEnabled(false);
 
             removeSearchFilter();
+            if (_searchTask)
+                _searchTask->cancel();
+            discardSearchMatches();
 
             _view->setFocus(Qt::ActiveWindowFocusReason);
         }
@@ -1149,6 +1233,9 @@ void SessionController::searchHistory(bool showSearchBar)
 }
 void SessionController::setFindNextPrevEnabled(bool enabled)
 {
+    if (!_actionsCreated)
+        return;
+
     _findNextAction->setEnabled(enabled);
     _findPreviousAction->setEnabled(enabled);
 }
@@ -1174,12 +1261,157 @@ void SessionController::searchCompleted(bool success)
         _searchBar->setFoundMatch(success);
 }
 
+void SessionController::searchMatchesFound(const QList<int>& lines , int current)
+{
+    _searchMatches = lines;
+    _currentSearchMatch = current;
+    _searchMatchesSource = _searchTaskSource;
+
+    if (_searchBar)
+        _searchBar->setMatchCount(current, lines.count());
+    _view->setSearchMatchLines(lines);
+
+    // output which arrived during the search has not been searched
+    if (searchMatchesOutdated())
+        _searchMatchesUpdateTimer.start();
+}
+
+void SessionController::searchMatchesUpdated(const QList<int>& lines , int current)
+{
+    // the match which was selected stays selected, or the one after it if
+    // it has gone
+    if (lines.isEmpty()) {
+        current = -1;
+    } else {
+        QList<int>::const_iterator iter = qLowerBound(lines.constBegin(), lines.constEnd(), _updatedSearchMatchLine);
+        current = qMin(int(iter - lines.constBegin()), lines.count() - 1);
+    }
+
+    searchMatchesFound(lines, current);
+}
+
+void SessionController::discardSearchMatches()
+{
+    _searchMatches.clear();
+    _currentSearchMatch = -1;
+    _searchMatchesSource = SearchSource();
+    _searchMatchesUpdateTimer.stop();
+
+    if (_searchBar)
+        _searchBar->setMatchCount(0, -1);
+    _view->setSearchMatchLines(QList<int>());
+}
+
+void SessionController::searchOutputChanged()
+{
+    if (_searchMatchesSource.regExp.isEmpty()) {
+        discardSearchMatches();
+        return;
+    }
+
+    // the matches are updated at most once per delay while output arrives
+    if (!_searchMatchesUpdateTimer.isActive())
+        _searchMatchesUpdateTimer.start();
+}
+
+void SessionController::updateSearchMatches()
+{
+    // a search which is running updates the matches when it is done
+    if (_searchTask || _searchMatchesSource.regExp.isEmpty() || !searchMatchesOutdated())
+        return;
+
+    const SearchSource& source = _searchMatchesSource;
+    const Screen* screen = _view->screenWindow()->screen();
+
+    _updatedSearchMatchLine = (_currentSearchMatch != -1) ? _searchMatches[_currentSearchMatch] : -1;
+
+    // the lines which were in the history keep their matches while the
+    // history is only added to, they have moved up by the lines which have
+    // been dropped from it since.  The lines which were on the screen may
+    // have changed and are searched again with the new ones
+    QList<int> matches;
+    int searchedLines = 0;
+    if (screen == source.screen && screen->historyGeneration() == source.historyGeneration) {
+        const int dropped = int(screen->discardedLines() - source.discardedLines);
+        searchedLines = qMax(0, source.historyLines - dropped);
+
+        foreach(int line, _searchMatches) {
+            if (line - dropped >= searchedLines)
+                break;
+            if (line - dropped >= 0)
+                matches << line - dropped;
+        }
+        _updatedSearchMatchLine -= dropped;
+    }
+
+    SearchHistoryTask* task = new SearchHistoryTask(this);
+    _searchTask = task;
+
+    connect(task, SIGNAL(matchesFound(QList<int>,int)),
+            this, SLOT(searchMatchesUpdated(QList<int>,int)));
+
+    task->setRegExp(source.regExp);
+    task->setFindAll(true);
+    task->setSearchedLines(matches, searchedLines);
+    task->setAutoDelete(true);
+    task->addScreenWindow(_session , _view->screenWindow());
+    setSearchTaskSource(source.regExp);
+
+    task->execute();
+}
+
+bool SessionController::searchMatchesOutdated() const
+{
+    const Screen* screen = _view->screenWindow()->screen();
+    return screen != _searchMatchesSource.screen ||
+           screen->generation() != _searchMatchesSource.generation;
+}
+
+void SessionController::setSearchTaskSource(const QRegExp& regExp)
+{
+    const Screen* screen = _view->screenWindow()->screen();
+
+    _searchTaskSource.regExp = regExp;
+    _searchTaskSource.screen = screen;
+    _searchTaskSource.generation = screen->generation();
+    _searchTaskSource.historyGeneration = screen->historyGeneration();
+    _searchTaskSource.historyLines = screen->getHistLines();
+    _searchTaskSource.discardedLines = screen->discardedLines();
+}
+
+bool SessionController::stepThroughSearchMatches(int step)
+{
+    Q_ASSERT(_searchBar);
+
+    // the matches of output which has changed are updated shortly
+    if (_currentSearchMatch == -1 || searchMatchesOutdated() ||
+            !_searchBar->optionsChecked().at(IncrementalSearchBar::FindAll))
+        return false;
+
+    const int count = _searchMatches.count();
+    const int index = (_currentSearchMatch + step + count) % count;
+
+    // the history may have been cleared or made smaller since
+    ScreenWindow* window = _view->screenWindow();
+    if (_searchMatches[index] >= window->lineCount()) {
+        discardSearchMatches();
+        return false;
+    }
+
+    _currentSearchMatch = index;
+    SearchHistoryTask::highlightResult(window, _searchMatches[index]);
+    _searchBar->setMatchCount(index, count);
+
+    return true;
+}
+
 void SessionController::beginSearch(const QString& text , int direction)
 {
     Q_ASSERT(_searchBar);
     Q_ASSERT(_searchFilter);
 
     QBitArray options = _searchBar->optionsChecked();
+    const bool findAll = options.at(IncrementalSearchBar::FindAll);
 
     Qt::CaseSensitivity caseHandling = options.at(IncrementalSearchBar::MatchCase) ? Qt::CaseSensitive : Qt::CaseInsensitive;
     QRegExp::PatternSyntax syntax = options.at(IncrementalSearchBar::RegExp) ? QRegExp::RegExp : QRegExp::FixedString;
@@ -1187,15 +1419,35 @@ void SessionController::beginSearch(const QString& text , int direction)
     QRegExp regExp(text ,  caseHandling , syntax);
     _searchFilter->setRegExp(regExp);
 
+    // a search which is still running looks for text which has changed since
+    if (_searchTask)
+        _searchTask->cancel();
+
+    // as the text is typed, each search only has to look at the lines
+    // where the one before found the text so far
+    QList<int> candidateLines;
+    const bool narrowSearch = findAll && canNarrowSearch(regExp);
+    if (narrowSearch)
+        candidateLines = _searchMatches;
+    discardSearchMatches();
+
     if (!regExp.isEmpty()) {
         SearchHistoryTask* task = new SearchHistoryTask(this);
+        _searchTask = task;
 
         connect(task, SIGNAL(completed(bool)), this, SLOT(searchCompleted(bool)));
+        connect(task, SIGNAL(matchesFound(QList<int>,int)),
+                this, SLOT(searchMatchesFound(QList<int>,int)));
 
         task->setRegExp(regExp);
         task->setSearchDirection((SearchHistoryTask::SearchDirection)direction);
+        task->setFindAll(findAll);
+        if (narrowSearch)
+            task->setCandidateLines(candidateLines);
         task->setAutoDelete(true);
         task->addScreenWindow(_session , _view->screenWindow());
+        setSearchTaskSource(regExp);
+
         task->execute();
     } else if (text.isEmpty()) {
         searchCompleted(false);
@@ -1203,6 +1455,24 @@ void SessionController::beginSearch(const QString& text , int direction)
 
     _view->processFilters();
 }
+bool SessionController::canNarrowSearch(const QRegExp& regExp) const
+{
+    const SearchSource& source = _searchMatchesSource;
+    if (source.regExp.isEmpty())
+        return false;
+
+    // every match of a fixed string starts with a match of its beginning,
+    // with the same case sensitivity
+    if (regExp.patternSyntax() != QRegExp::FixedString ||
+            source.regExp.patternSyntax() != QRegExp::FixedString ||
+            regExp.caseSensitivity() != source.regExp.caseSensitivity() ||
+            !regExp.pattern().startsWith(source.regExp.pattern(), regExp.caseSensitivity()))
+        return false;
+
+    // the lines of the matches are only the same while the output is
+    const Screen* screen = _view->screenWindow()->screen();
+    return screen == source.screen && screen->generation() == source.generation;
+}
 void SessionController::highlightMatches(bool highlight)
 {
     if (highlight) {
@@ -1219,6 +1489,11 @@ void SessionController::findNextInHistory()
     Q_ASSERT(_searchBar);
     Q_ASSERT(_searchFilter);
 
+    // once all matches are known, the next one is simply the following
+    // one in their list
+    if (stepThroughSearchMatches(1))
+        return;
+
     beginSearch(_searchBar->searchText(), SearchHistoryTask::ForwardsSearch);
 }
 void SessionController::findPreviousInHistory()
@@ -1226,6 +1501,9 @@ void SessionController::findPreviousInHistory()
     Q_ASSERT(_searchBar);
     Q_ASSERT(_searchFilter);
 
+    if (stepThroughSearchMatches(-1))
+        return;
+
     beginSearch(_searchBar->searchText(), SearchHistoryTask::BackwardsSearch);
 }
 void SessionController::changeSearchMatch()
@@ -1282,31 +1560,124 @@ void SessionController::scrollBackOptionsChanged(int mode, int lines)
     }
 }
 
+void SessionController::takeSnapshot(ScreenRenderer& renderer, bool selectedLines) const
+{
+    ScreenWindow* window = _view->screenWindow();
+    const Screen* screen = window->screen();
+
+    renderer.setFont(_view->getVTFont());
+    renderer.setColorTable(_view->colorTable());
+    renderer.setBoldIntense(_view->getBoldIntense());
+
+    int startIndex = 0;
+    int endIndex = 0;
+    bool blockSelection = false;
+    if (selectedLines && window->getSelectionRange(startIndex, endIndex, blockSelection)) {
+        renderer.setLines(screen, startIndex / screen->getColumns(),
+                          endIndex / screen->getColumns());
+    } else {
+        const int lastLine = qMin(window->currentLine() + window->windowLines(),
+                                  window->lineCount()) - 1;
+        renderer.setLines(screen, window->currentLine(), lastLine);
+    }
+}
+
+// prints the snapshot of 'renderer' on 'printer' and deletes the printer,
+// returns false if the printing failed
+static bool printSnapshot(ScreenRenderer renderer, QPrinter* printer, bool scaleToPage)
+{
+    const bool printed = renderer.print(*printer, scaleToPage);
+    delete printer;
+    return printed;
+}
+
 void SessionController::print_screen()
 {
-    QPrinter printer;
+    QPrinter* printer = new QPrinter();
 
-    QPointer<QPrintDialog> dialog = new QPrintDialog(&printer, _view);
+    QPointer<QPrintDialog> dialog = new QPrintDialog(printer, _view);
     PrintOptions* options = new PrintOptions();
 
     dialog->setOptionTabs(QList<QWidget*>() << options);
     dialog->setWindowTitle(i18n("Print Shell"));
     connect(dialog, SIGNAL(accepted()), options, SLOT(saveSettings()));
-    if (dialog->exec() != QDialog::Accepted)
+    if (dialog->exec() != QDialog::Accepted || !_view) {
+        delete dialog;
+        delete printer;
         return;
-
-    QPainter painter;
-    painter.begin(&printer);
+    }
+    delete dialog;
 
     KConfigGroup configGroup(KGlobal::config(), "PrintOptions");
 
-    if (configGroup.readEntry("ScaleOutput", true)) {
-        double scale = qMin(printer.pageRect().width() / static_cast<double>(_view->width()),
-                            printer.pageRect().height() / static_cast<double>(_view->height()));
-        painter.scale(scale, scale);
+    ScreenRenderer renderer;
+    renderer.setPrinterFriendly(configGroup.readEntry("PrinterFriendly", true));
+    takeSnapshot(renderer, false);
+
+    const bool scaleToPage = configGroup.readEntry("ScaleOutput", true);
+
+    // the rendering happens in the background where the platform can draw
+    // text outside of the GUI thread, the snapshot does not change along
+    // with the session
+    if (!QFontDatabase::supportsThreadedFontRendering()) {
+        reportPrintResult(printSnapshot(renderer, printer, scaleToPage));
+        return;
     }
 
-    _view->printContent(painter, configGroup.readEntry("PrinterFriendly", true));
+    QFutureWatcher<bool>* watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(snapshotPrinted()));
+    watcher->setFuture(QtConcurrent::run(printSnapshot, renderer, printer, scaleToPage));
+}
+
+void SessionController::snapshotPrinted()
+{
+    QFutureWatcher<bool>* watcher = static_cast<QFutureWatcher<bool>*>(sender());
+    watcher->deleteLater();
+
+    reportPrintResult(watcher->result());
+}
+
+void SessionController::reportPrintResult(bool printed)
+{
+    if (!printed)
+        KMessageBox::sorry(_view, i18n("Konsole was unable to print the output."));
+}
+
+void SessionController::saveImage()
+{
+    const QString fileName = KFileDialog::getSaveFileName(KUrl(),
+                             "*.png|" + i18n("PNG Image") + "\n*.pdf|" + i18n("PDF Document"),
+                             _view, i18n("Save Output as Image"),
+                             KFileDialog::ConfirmOverwrite);
+    if (fileName.isEmpty() || !_view)
+        return;
+
+    ScreenRenderer renderer;
+    takeSnapshot(renderer, true);
+
+    if (!QFontDatabase::supportsThreadedFontRendering()) {
+        reportSaveResult(renderer.save(fileName), fileName);
+        return;
+    }
+
+    QFutureWatcher<bool>* watcher = new QFutureWatcher<bool>(this);
+    watcher->setProperty("fileName", fileName);
+    connect(watcher, SIGNAL(finished()), this, SLOT(imageSaved()));
+    watcher->setFuture(QtConcurrent::run(renderer, &ScreenRenderer::save, fileName));
+}
+
+void SessionController::imageSaved()
+{
+    QFutureWatcher<bool>* watcher = static_cast<QFutureWatcher<bool>*>(sender());
+    watcher->deleteLater();
+
+    reportSaveResult(watcher->result(), watcher->property("fileName").toString());
+}
+
+void SessionController::reportSaveResult(bool saved, const QString& fileName)
+{
+    if (!saved)
+        KMessageBox::sorry(_view, i18n("Konsole was unable to save the output to %1.", fileName));
 }
 
 void SessionController::saveHistory()
@@ -1353,6 +1724,73 @@ void SessionController::monitorSilence(bool monitor)
 {
     _session->setMonitorSilence(monitor);
 }
+void SessionController::showStatistics(bool show)
+{
+    if (!show) {
+        _statisticsTimer.stop();
+        _view->setStatisticsText(QString());
+        return;
+    }
+
+    takeStatisticsSnapshot();
+    _view->setStatisticsText(i18n("Measuring..."));
+    _statisticsTimer.start();
+}
+void SessionController::takeStatisticsSnapshot()
+{
+    const Emulation::ProcessingStatistics& processing =
+        _session->emulation()->processingStatistics();
+    const TerminalDisplay::PaintStatistics& paint = _view->paintStatistics();
+
+    _statisticsSnapshot.receivedBytes = processing.receivedBytes;
+    _statisticsSnapshot.blockCount = processing.blockCount;
+    _statisticsSnapshot.processingTime = processing.processingTime;
+    _statisticsSnapshot.updateCount = paint.updateCount;
+    _statisticsSnapshot.skippedUpdates = paint.skippedUpdates;
+    _statisticsSnapshot.updateTime = paint.updateTime;
+    _statisticsSnapshot.paintCount = paint.paintCount;
+    _statisticsSnapshot.paintTime = paint.paintTime;
+    _statisticsSnapshot.filterTime = paint.filterTime;
+    _statisticsSnapshot.keyEchoCount = paint.keyEchoCount;
+    _statisticsSnapshot.keyEchoTime = paint.keyEchoTime;
+
+    _statisticsClock.start();
+}
+void SessionController::updateStatistics()
+{
+    const qint64 elapsed = qMax(Q_INT64_C(1), _statisticsClock.elapsed());
+    const StatisticsSnapshot last = _statisticsSnapshot;
+    takeStatisticsSnapshot();
+    const StatisticsSnapshot& now = _statisticsSnapshot;
+
+    const qint64 bytes = now.receivedBytes - last.receivedBytes;
+    const qint64 blocks = now.blockCount - last.blockCount;
+    const qint64 processingTime = now.processingTime - last.processingTime;
+    const qint64 updates = now.updateCount - last.updateCount;
+    const qint64 paints = now.paintCount - last.paintCount;
+    const qint64 keyEchoes = now.keyEchoCount - last.keyEchoCount;
+
+    // the times are in microseconds, the elapsed time in milliseconds
+    QStringList lines;
+    lines << i18n("Output: %1/s",
+                  KGlobal::locale()->formatByteSize(bytes * 1000.0 / elapsed));
+    lines << i18n("Processing: %1 µs per block, %2% of the time",
+                  blocks > 0 ? processingTime / blocks : 0,
+                  QString::number(processingTime / (10.0 * elapsed), 'f', 1));
+    lines << i18n("Frames: %1/s painted, %2/s skipped",
+                  paints * 1000 / elapsed,
+                  (now.skippedUpdates - last.skippedUpdates) * 1000 / elapsed);
+    lines << i18n("Update: %1 µs, paint: %2 µs, filters: %3 µs",
+                  updates > 0 ? (now.updateTime - last.updateTime) / updates : 0,
+                  paints > 0 ? (now.paintTime - last.paintTime) / paints : 0,
+                  paints > 0 ? (now.filterTime - last.filterTime) / paints : 0);
+    lines << i18n("Key echo: %1 µs",
+                  keyEchoes > 0 ? (now.keyEchoTime - last.keyEchoTime) / keyEchoes : 0);
+    lines << i18n("History: %1",
+                  KGlobal::locale()->formatByteSize(_session->historyMemoryUsage()));
+
+    _view->setStatisticsText(lines.join(QChar('\n')));
+}
 void SessionController::updateSessionIcon()
 {
     // Visualize that the session is broadcasting to others
@@ -1392,6 +1830,8 @@ void SessionController::sessionTitleChanged()
 
 void SessionController::showDisplayContextMenu(const QPoint& position)
 {
+    setupActions();
+
     // needed to make sure the popup menu is available, even if a hosting
     // application did not merge our GUI.
     if (!factory()) {
@@ -1604,20 +2044,6 @@ void SaveHistoryTask::execute()
             continue;
         }
 
-        KIO::TransferJob* job = KIO::put(url,
-                                         -1,   // no special permissions
-                                         // overwrite existing files
-                                         // do not resume an existing transfer
-                                         // show progress information only for remote
-                                         // URLs
-                                         KIO::Overwrite | (url.isLocalFile() ? KIO::HideProgressInfo : KIO::DefaultFlags)
-                                         // a better solution would be to show progress
-                                         // information after a certain period of time
-                                         // instead, since the overall speed of transfer
-                                         // depends on factors other than just the protocol
-                                         // used
-                                        );
-
         SaveJob jobInfo;
         jobInfo.session = session;
         jobInfo.lastLineFetched = -1;  // when each request for data comes in from the KIO subsystem
@@ -1625,11 +2051,39 @@ void SaveHistoryTask::execute()
         // has already been sent, and where the next request should continue
         // from.
         // this is set to -1 to indicate the job has just been started
+        jobInfo.bytesFetched = 0;
+        jobInfo.file = 0;
+
+        if (dialog->currentMimeFilter() == "text/html") {
+            HTMLDecoder* decoder = new HTMLDecoder();
+            decoder->setUseStyleSheet(true);
+            jobInfo.decoder = decoder;
+        } else
+            jobInfo.decoder = new Utf8PlainTextDecoder();
+
+        // local files are written directly rather than through KIO, which
+        // would pass each chunk of the output on to another process
+        if (url.isLocalFile()) {
+            jobInfo.file = new QFile(url.toLocalFile());
+            if (!jobInfo.file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                KMessageBox::sorry(0 , i18n("A problem occurred when saving the output.\n%1",
+                                            jobInfo.file->errorString()));
+                delete jobInfo.file;
+                delete jobInfo.decoder;
+                continue;
+            }
 
-        if (dialog->currentMimeFilter() == "text/html")
-            jobInfo.decoder = new HTMLDecoder();
-        else
-            jobInfo.decoder = new PlainTextDecoder();
+            if (_localJobs.isEmpty())
+                QTimer::singleShot(0, this, SLOT(writeLocalFiles()));
+            _localJobs << jobInfo;
+            continue;
+        }
+
+        KIO::TransferJob* job = KIO::put(url,
+                                         -1,   // no special permissions
+                                         // overwrite existing files
+                                         // do not resume an existing transfer
+                                         KIO::Overwrite);
 
         _jobSession.insert(job, jobInfo);
 
@@ -1640,37 +2094,97 @@ void SaveHistoryTask::execute()
     }
 
     dialog->deleteLater();
+
+    if (autoDelete() && _jobSession.isEmpty() && _localJobs.isEmpty())
+        deleteLater();
 }
-void SaveHistoryTask::jobDataRequested(KIO::Job* job , QByteArray& data)
+bool SaveHistoryTask::fetchNextChunk(SaveJob& info , QByteArray& data)
 {
-    // TODO - Report progress information for the job
-
-    // PERFORMANCE:  Do some tests and tweak this value to get faster saving
-    const int LINES_PER_REQUEST = 500;
+    // the size of the chunks is a compromise between the number of
+    // requests and the memory used for each of them
+    const int CHUNK_SIZE = 1024 * 1024;
+    const int FIRST_CHUNK_LINES = 1000;
 
-    SaveJob& info = _jobSession[job];
+    if (!info.session)
+        return false;
 
-    // transfer LINES_PER_REQUEST lines from the session's history
-    // to the save location
-    if (info.session) {
-        // note:  when retrieving lines from the emulation,
-        // the first line is at index 0.
+    // note:  when retrieving lines from the emulation,
+    // the first line is at index 0.
+    const int sessionLines = info.session->emulation()->lineCount();
 
-        int sessionLines = info.session->emulation()->lineCount();
+    if (info.lastLineFetched >= sessionLines - 1)
+        return false; // if there is no more data to transfer then stop the job
 
-        if (sessionLines - 1 == info.lastLineFetched)
-            return; // if there is no more data to transfer then stop the job
+    // the number of lines is chosen from the average size of the lines so
+    // far, so that each chunk has about the same size however long they are
+    int lines = FIRST_CHUNK_LINES;
+    if (info.bytesFetched > 0) {
+        const qint64 linesFetched = info.lastLineFetched + 1;
+        lines = qBound(qint64(1), CHUNK_SIZE * linesFetched / info.bytesFetched, qint64(sessionLines));
+    }
 
-        int copyUpToLine = qMin(info.lastLineFetched + LINES_PER_REQUEST ,
-                                sessionLines - 1);
+    const int copyUpToLine = qMin(info.lastLineFetched + lines , sessionLines - 1);
 
+    // plain text is encoded straight into the data, other formats go
+    // through a text stream
+    Utf8PlainTextDecoder* utf8Decoder = dynamic_cast<Utf8PlainTextDecoder*>(info.decoder);
+    if (utf8Decoder) {
+        utf8Decoder->begin(&data);
+        info.session->emulation()->writeToStream(utf8Decoder , info.lastLineFetched + 1 , copyUpToLine);
+        utf8Decoder->end();
+    } else {
         QTextStream stream(&data, QIODevice::ReadWrite);
+        stream.setCodec("UTF-8");
         info.decoder->begin(&stream);
         info.session->emulation()->writeToStream(info.decoder , info.lastLineFetched + 1 , copyUpToLine);
         info.decoder->end();
+        stream.flush();
+    }
+
+    info.lastLineFetched = copyUpToLine;
+    info.bytesFetched += data.size();
+
+    return true;
+}
+void SaveHistoryTask::jobDataRequested(KIO::Job* job , QByteArray& data)
+{
+    SaveJob& info = _jobSession[job];
+
+    // transfer the next chunk of the session's history to the save location
+    if (!fetchNextChunk(info, data))
+        return;
+
+    // the total size is estimated from the lines sent so far, so that the
+    // job can report its progress
+    const qint64 linesFetched = info.lastLineFetched + 1;
+    const int sessionLines = info.session->emulation()->lineCount();
+    static_cast<KIO::TransferJob*>(job)->setTotalSize(info.bytesFetched * sessionLines / linesFetched);
+}
+void SaveHistoryTask::writeLocalFiles()
+{
+    // each file gets a chunk in turn, so that saving large output does not
+    // block the user interface
+    QByteArray data;
+    for (int i = _localJobs.count() - 1; i >= 0; i--) {
+        SaveJob& info = _localJobs[i];
 
-        info.lastLineFetched = copyUpToLine;
+        data.clear();
+        if (fetchNextChunk(info, data) && info.file->write(data) == data.size())
+            continue;
+
+        if (info.file->error() != QFile::NoError) {
+            KMessageBox::sorry(0 , i18n("A problem occurred when saving the output.\n%1",
+                                        info.file->errorString()));
+        }
+        delete info.file;
+
+        SaveJob finishedInfo = info;
+        _localJobs.removeAt(i);
+        finishJob(finishedInfo);
     }
+
+    if (!_localJobs.isEmpty())
+        QTimer::singleShot(0, this, SLOT(writeLocalFiles()));
 }
 void SaveHistoryTask::jobResult(KJob* job)
 {
@@ -1678,16 +2192,17 @@ void SaveHistoryTask::jobResult(KJob* job)
         KMessageBox::sorry(0 , i18n("A problem occurred when saving the output.\n%1", job->errorString()));
     }
 
-    TerminalCharacterDecoder * decoder = _jobSession[job].decoder;
-
-    _jobSession.remove(job);
-
-    delete decoder;
+    SaveJob info = _jobSession.take(job);
+    finishJob(info);
+}
+void SaveHistoryTask::finishJob(SaveJob& info)
+{
+    delete info.decoder;
 
     // notify the world that the task is done
     emit completed(true);
 
-    if (autoDelete())
+    if (autoDelete() && _jobSession.isEmpty() && _localJobs.isEmpty())
         deleteLater();
 }
 void SearchHistoryTask::addScreenWindow(Session* session , ScreenWindow* searchWindow)
@@ -1696,132 +2211,483 @@ void SearchHistoryTask::addScreenWindow(Session* session , ScreenWindow* searchW
 }
 void SearchHistoryTask::execute()
 {
-    QMapIterator< SessionPtr , ScreenWindowPtr > iter(_windows);
+    _pendingSessions = _windows.keys();
+    executeOnNextScreenWindow();
+}
+
+void SearchHistoryTask::cancel()
+{
+    _pendingSessions.clear();
+    _session = 0;
+    _window = 0;
+
+    // the result of the blocks which are being searched is of no use any more
+    _searchWatcher->disconnect(this);
+    _findAllWatcher->disconnect(this);
+
+    if (autoDelete())
+        deleteLater();
+}
 
-    while (iter.hasNext()) {
-        iter.next();
-        executeOnScreenWindow(iter.key() , iter.value());
+void SearchHistoryTask::executeOnNextScreenWindow()
+{
+    if (_pendingSessions.isEmpty()) {
+        if (autoDelete())
+            deleteLater();
+        return;
     }
+
+    const SessionPtr session = _pendingSessions.takeFirst();
+    executeOnScreenWindow(session , _windows.value(session));
 }
 
 void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowPtr window)
 {
-    Q_ASSERT(session);
-    Q_ASSERT(window);
+    if (!session || !window || _regExp.isEmpty()) {
+        finishScreenWindow(false);
+        return;
+    }
 
-    Emulation* emulation = session->emulation();
+    _session = session;
+    _window = window;
 
     int selectionColumn = 0;
     int selectionLine = 0;
 
     window->getSelectionEnd(selectionColumn , selectionLine);
 
-    if (!_regExp.isEmpty()) {
-        int pos = -1;
-        const bool forwards = (_direction == ForwardsSearch);
-        int startLine = selectionLine + window->currentLine() + (forwards ? 1 : -1);
-        // Temporary fix for #205495
-        if (startLine < 0) startLine = 0;
-        const int lastLine = window->lineCount() - 1;
-        QString string;
-
-        //text stream to read history into string for pattern or regular expression searching
-        QTextStream searchStream(&string);
-
-        PlainTextDecoder decoder;
-        decoder.setRecordLinePositions(true);
-
-        //setup first and last lines depending on search direction
-        int line = startLine;
-
-        //read through and search history in blocks of 10K lines.
-        //this balances the need to retrieve lots of data from the history each time
-        //(for efficient searching)
-        //without using silly amounts of memory if the history is very large.
-        const int maxDelta = qMin(window->lineCount(), 10000);
-        int delta = forwards ? maxDelta : -maxDelta;
-
-        int endLine = line;
-        bool hasWrapped = false;  // set to true when we reach the top/bottom
-        // of the output and continue from the other
-        // end
-
-        //loop through history in blocks of <delta> lines.
-        do {
-            // ensure that application does not appear to hang
-            // if searching through a lengthy output
-            QApplication::processEvents();
-
-            // calculate lines to search in this iteration
-            if (hasWrapped) {
-                if (endLine == lastLine)
-                    line = 0;
-                else if (endLine == 0)
-                    line = lastLine;
-
-                endLine += delta;
-
-                if (forwards)
-                    endLine = qMin(startLine , endLine);
+    const bool forwards = (_direction == ForwardsSearch);
+    _startLine = selectionLine + window->currentLine() + (forwards ? 1 : -1);
+    // Temporary fix for #205495
+    if (_startLine < 0) _startLine = 0;
+    _lastLine = window->lineCount() - 1;
+
+    //setup first and last lines depending on search direction
+    _line = _startLine;
+    _endLine = _line;
+    _hasWrapped = false;  // set to true when we reach the top/bottom
+    // of the output and continue from the other
+    // end
+
+    if (_findAll) {
+        _matches.clear();
+        _findAllRanges.clear();
+        if (_hasCandidateLines) {
+            // runs of consecutive lines are searched together
+            foreach(int line, _candidateLines) {
+                if (line > _lastLine)
+                    break;
+                if (!_findAllRanges.isEmpty() && _findAllRanges.last().second == line - 1)
+                    _findAllRanges.last().second = line;
                 else
-                    endLine = qMax(startLine , endLine);
-            } else {
-                endLine += delta;
-
-                if (endLine > lastLine) {
-                    hasWrapped = true;
-                    endLine = lastLine;
-                } else if (endLine < 0) {
-                    hasWrapped = true;
-                    endLine = 0;
-                }
+                    _findAllRanges << qMakePair(line, line);
             }
+        } else if (_searchedLineCount != -1) {
+            _matches = _searchedMatches;
+            if (_searchedLineCount <= _lastLine)
+                _findAllRanges << qMakePair(_searchedLineCount, _lastLine);
+        } else {
+            _findAllRanges << qMakePair(0, _lastLine);
+        }
+        searchNextBlocks();
+    } else {
+        searchNextBlock();
+    }
+}
 
-            decoder.begin(&searchStream);
-            emulation->writeToStream(&decoder, qMin(endLine, line) , qMax(endLine, line));
-            decoder.end();
+void SearchHistoryTask::finishScreenWindow(bool success)
+{
+    _session = 0;
+    _window = 0;
+
+    emit completed(success);
+
+    executeOnNextScreenWindow();
+}
+
+// searches 'text' for 'regExp', forwards or backwards from position 'from',
+// a negative 'from' counts from the end of the text.  this is called on
+// another thread
+static int findInText(const QString& text , QRegExp regExp , bool forwards , int from)
+{
+    // fixed strings are found without running the expression, which
+    // is much slower than QString's own search
+    if (regExp.patternSyntax() == QRegExp::FixedString) {
+        if (forwards)
+            return text.indexOf(regExp.pattern(), from, regExp.caseSensitivity());
+        else
+            return text.lastIndexOf(regExp.pattern(), from, regExp.caseSensitivity());
+    } else if (forwards) {
+        return text.indexOf(regExp, from);
+    } else {
+        return text.lastIndexOf(regExp, from);
+    }
+}
+
+namespace
+{
+// a part of a block which is searched for its nearest match
+struct SearchChunk {
+    QRegExp regExp;
+    bool forwards;
+    QString text;
+    int offset;  // where the text starts in the block
+    int limit;   // the text after this belongs to the next chunk
+};
+}
 
-            // line number search below assumes that the buffer ends with a new-line
-            string.append('\n');
+// returns the position in the block of the nearest match in 'chunk', this
+// is called on another thread
+static int findInChunk(const SearchChunk& chunk)
+{
+    if (chunk.limit == 0)
+        return -1;
 
+    // only matches which start before the limit belong to this chunk
+    int pos;
+    if (chunk.forwards) {
+        pos = findInText(chunk.text, chunk.regExp, true, 0);
+        if (pos >= chunk.limit)
             pos = -1;
+    } else {
+        pos = findInText(chunk.text, chunk.regExp, false, chunk.limit - 1);
+    }
+
+    return (pos == -1) ? -1 : chunk.offset + pos;
+}
+
+void SearchHistoryTask::searchNextBlock()
+{
+    //read through and search history in blocks of 10K lines.
+    //this balances the need to retrieve lots of data from the history each time
+    //(for efficient searching)
+    //without using silly amounts of memory if the history is very large.
+    const int maxDelta = qMin(_lastLine + 1, 10000);
+    const bool forwards = (_direction == ForwardsSearch);
+    const int delta = forwards ? maxDelta : -maxDelta;
+
+    Emulation* emulation = _session->emulation();
+
+    int firstLine = 0;
+    int lastLine = 0;
+    while (true) {
+        // calculate lines to search in this iteration
+        if (_hasWrapped) {
+            if (_endLine == _lastLine)
+                _line = 0;
+            else if (_endLine == 0)
+                _line = _lastLine;
+
+            _endLine += delta;
+
             if (forwards)
-                pos = string.indexOf(_regExp);
+                _endLine = qMin(_startLine , _endLine);
             else
-                pos = string.lastIndexOf(_regExp);
+                _endLine = qMax(_startLine , _endLine);
+        } else {
+            _endLine += delta;
+
+            if (_endLine > _lastLine) {
+                _hasWrapped = true;
+                _endLine = _lastLine;
+            } else if (_endLine < 0) {
+                _hasWrapped = true;
+                _endLine = 0;
+            }
+        }
 
-            //if a match is found, position the cursor on that line and update the screen
-            if (pos != -1) {
-                int newLines = 0;
-                QList<int> linePositions = decoder.linePositions();
-                while (newLines < linePositions.count() && linePositions[newLines] <= pos)
-                    newLines++;
+        firstLine = qMin(_endLine, _line);
+        lastLine = qMax(_endLine, _line);
 
-                // ignore the new line at the start of the buffer
-                newLines--;
+        // the history index can only tell which lines may contain a fixed
+        // string, blocks without any of them are skipped
+        if (_regExp.patternSyntax() != QRegExp::FixedString ||
+                emulation->findCandidateLines(_regExp.pattern(), firstLine, lastLine))
+            break;
 
-                int findPos = qMin(line, endLine) + newLines;
+        _line = _endLine;
+        if (_startLine == _endLine) {
+            notFound();
+            return;
+        }
+    }
 
-                highlightResult(window, findPos);
+    // the block is decoded here, as the history may only be read on this
+    // thread, and its text is searched on another one
+    QString string;
+
+    //text stream to read history into string for pattern or regular expression searching
+    QTextStream searchStream(&string);
+
+    PlainTextDecoder decoder;
+    decoder.setRecordLinePositions(true);
+
+    decoder.begin(&searchStream);
+    emulation->writeToStream(&decoder, firstLine , lastLine);
+    decoder.end();
+    searchStream.flush();
+
+    // line number search below assumes that the buffer ends with a new-line
+    string.append('\n');
+
+    _blockStartLine = firstLine;
+    _linePositions = decoder.linePositions();
+
+    // the block is split into chunks of lines which are searched at the same
+    // time, each of them includes the first line of the next one for matches
+    // which start at its end
+    const int minChunkLines = 1000;
+    const int blockLines = _linePositions.count();
+    const int chunkCount = qBound(1, blockLines / minChunkLines, qMax(QThread::idealThreadCount(), 1));
+    const int chunkLines = (blockLines + chunkCount - 1) / chunkCount;
+
+    QList<SearchChunk> chunks;
+    for (int startLine = 0; startLine < blockLines; startLine += chunkLines) {
+        const int endLine = qMin(startLine + chunkLines, blockLines);
+        const int start = _linePositions[startLine];
+        const int limit = (endLine < blockLines) ? _linePositions[endLine] : string.length();
+        const int end = (endLine + 1 < blockLines) ? _linePositions[endLine + 1] : string.length();
+
+        SearchChunk chunk;
+        chunk.regExp = _regExp;
+        chunk.forwards = forwards;
+        chunk.text = (chunkCount == 1) ? string : string.mid(start, end - start);
+        chunk.offset = start;
+        chunk.limit = limit - start;
+        chunks << chunk;
+    }
 
-                emit completed(true);
+    _searchWatcher->setFuture(QtConcurrent::mapped(chunks, findInChunk));
+}
 
-                return;
-            }
+void SearchHistoryTask::blockSearched()
+{
+    // the session or its view may have been closed in the meantime
+    if (!_session || !_window) {
+        finishScreenWindow(false);
+        return;
+    }
+
+    // the nearest match is in the first chunk with a match in the search
+    // direction
+    const QFuture<int> future = _searchWatcher->future();
+    const bool forwards = (_direction == ForwardsSearch);
+    int pos = -1;
+    for (int i = 0; i < future.resultCount() && pos == -1; i++)
+        pos = future.resultAt(forwards ? i : future.resultCount() - 1 - i);
+
+    //if a match is found, position the cursor on that line and update the screen
+    if (pos != -1) {
+        int newLines = 0;
+        while (newLines < _linePositions.count() && _linePositions[newLines] <= pos)
+            newLines++;
+
+        // ignore the new line at the start of the buffer
+        newLines--;
+
+        const int findPos = _blockStartLine + newLines;
 
-            //clear the current block of text and move to the next one
-            string.clear();
-            line = endLine;
-        } while (startLine != endLine);
+        highlightResult(_window, findPos);
 
-        // if no match was found, clear selection to indicate this
-        window->clearSelection();
-        window->notifyOutputChanged();
+        finishScreenWindow(true);
+        return;
+    }
+
+    // move to the next block of text
+    _line = _endLine;
+    if (_startLine != _endLine) {
+        searchNextBlock();
+        return;
     }
 
-    emit completed(false);
+    notFound();
+}
+
+void SearchHistoryTask::notFound()
+{
+    // if no match was found, clear selection to indicate this
+    _window->clearSelection();
+    _window->notifyOutputChanged();
+
+    finishScreenWindow(false);
+}
+
+namespace
+{
+// a range of lines of the output which is searched for all matches.  The
+// snapshot holds the line after the range as well, for the matches which
+// start at the end of the range
+struct SearchRange {
+    ScreenSnapshot snapshot;
+    int firstLine;
+    int lastLine;
+};
+
+// a block of the output which is searched for all matches, made of one
+// or more ranges
+struct SearchBlock {
+    QRegExp regExp;
+    QList<SearchRange> ranges;
+    int lineCount;
+};
 }
-void SearchHistoryTask::highlightResult(ScreenWindowPtr window , int findPos)
+
+// returns the lines of 'block' which contain a match.  This is called on
+// another thread, which decodes the snapshots of the block as well
+static QList<int> findAllInBlock(const SearchBlock& block)
+{
+    QString text;
+    QTextStream searchStream(&text);
+    PlainTextDecoder decoder;
+    decoder.setRecordLinePositions(true);
+    decoder.begin(&searchStream);
+
+    // the line of the output each line of the text is, or -1 for a line
+    // which is only there for the matches which start at the end of the
+    // line before
+    QList<int> blockLines;
+    foreach(const SearchRange& range, block.ranges) {
+        const int decodedLines = decoder.linePositions().count();
+        range.snapshot.writeLinesToStream(&decoder, range.snapshot.firstLine(),
+                                          range.snapshot.lastLine());
+        searchStream << '\n';
+
+        const int newLines = decoder.linePositions().count() - decodedLines;
+        for (int i = 0; i < newLines; i++)
+            blockLines << (range.firstLine + i <= range.lastLine ? range.firstLine + i : -1);
+    }
+
+    decoder.end();
+    searchStream.flush();
+    const QList<int> positions = decoder.linePositions();
+
+    QList<int> lines;
+    int line = 0;
+    int pos = findInText(text, block.regExp, true, 0);
+    while (pos != -1) {
+        while (line + 1 < positions.count() && positions[line + 1] <= pos)
+            line++;
+
+        // matches which start on a line of the next range are found there
+        if (blockLines[line] != -1)
+            lines << blockLines[line];
+
+        // the line is only listed once, however many matches it has
+        if (line + 1 >= positions.count())
+            break;
+        pos = findInText(text, block.regExp, true, positions[line + 1]);
+    }
+
+    return lines;
+}
+
+void SearchHistoryTask::searchNextBlocks()
+{
+    const int maxBlockLines = 10000;
+
+    Emulation* emulation = _session->emulation();
+    const bool fixedString = (_regExp.patternSyntax() == QRegExp::FixedString);
+
+    // take snapshots of as many blocks as can be searched at the same time,
+    // the screen may only be read on this thread while the snapshots are
+    // decoded and searched on others.  A block holds up to maxBlockLines
+    // lines, from one or more of the ranges which are left
+    QList<SearchBlock> blocks;
+    while (!_findAllRanges.isEmpty() && blocks.count() < qMax(QThread::idealThreadCount(), 1)) {
+        SearchBlock block;
+        block.regExp = _regExp;
+        block.lineCount = 0;
+
+        while (!_findAllRanges.isEmpty() && block.lineCount < maxBlockLines) {
+            QPair<int, int>& range = _findAllRanges.first();
+            int firstLine = range.first;
+            int lastLine = qMin(range.first + maxBlockLines - block.lineCount - 1, range.second);
+            if (lastLine == range.second)
+                _findAllRanges.removeFirst();
+            else
+                range.first = lastLine + 1;
+
+            if (fixedString && !emulation->findCandidateLines(_regExp.pattern(), firstLine, lastLine))
+                continue;
+
+            // the line after the range is included as well, for matches
+            // which start at the end of the range
+            SearchRange searchRange;
+            searchRange.snapshot = emulation->snapshot(firstLine, qMin(lastLine + 1, _lastLine));
+            searchRange.firstLine = firstLine;
+            searchRange.lastLine = lastLine;
+            block.ranges << searchRange;
+            block.lineCount += searchRange.snapshot.lastLine() - firstLine + 1;
+        }
+
+        if (!block.ranges.isEmpty())
+            blocks << block;
+    }
+
+    if (blocks.isEmpty()) {
+        finishFindAll();
+        return;
+    }
+
+    _findAllWatcher->setFuture(QtConcurrent::mapped(blocks, findAllInBlock));
+}
+
+void SearchHistoryTask::blocksSearched()
+{
+    // the session or its view may have been closed in the meantime
+    if (!_session || !_window) {
+        finishScreenWindow(false);
+        return;
+    }
+
+    // the results are in the order of the blocks, which can overlap when
+    // the history index extends a block back to the start of a wrapped line
+    const QFuture< QList<int> > future = _findAllWatcher->future();
+    for (int i = 0; i < future.resultCount(); i++) {
+        foreach(int line, future.resultAt(i)) {
+            if (_matches.isEmpty() || line > _matches.last())
+                _matches << line;
+        }
+    }
+
+    if (!_findAllRanges.isEmpty())
+        searchNextBlocks();
+    else
+        finishFindAll();
+}
+
+void SearchHistoryTask::finishFindAll()
+{
+    // an update of earlier matches leaves the selection alone
+    if (_searchedLineCount != -1) {
+        emit matchesFound(_matches, -1);
+        finishScreenWindow(!_matches.isEmpty());
+        return;
+    }
+
+    // select the nearest match in the search direction, as when only looking
+    // for that one
+    int current = -1;
+    if (!_matches.isEmpty()) {
+        if (_direction == ForwardsSearch) {
+            QList<int>::const_iterator iter = qLowerBound(_matches.constBegin(), _matches.constEnd(), _startLine);
+            current = (iter == _matches.constEnd()) ? 0 : iter - _matches.constBegin();
+        } else {
+            QList<int>::const_iterator iter = qUpperBound(_matches.constBegin(), _matches.constEnd(), _startLine);
+            current = (iter == _matches.constBegin()) ? _matches.count() - 1 : iter - _matches.constBegin() - 1;
+        }
+        highlightResult(_window, _matches[current]);
+    } else {
+        _window->clearSelection();
+        _window->notifyOutputChanged();
+    }
+
+    emit matchesFound(_matches, current);
+
+    finishScreenWindow(current != -1);
+}
+
+void SearchHistoryTask::highlightResult(ScreenWindow* window , int findPos)
 {
     //work out how many lines into the current block of text the search result was found
     //- looks a little painful, but it only has to be done once per search.
@@ -1839,7 +2705,20 @@ void SearchHistoryTask::highlightResult(ScreenWindowPtr window , int findPos)
 SearchHistoryTask::SearchHistoryTask(QObject* parent)
     : SessionTask(parent)
     , _direction(BackwardsSearch)
-{
+    , _findAll(false)
+    , _startLine(0)
+    , _line(0)
+    , _endLine(0)
+    , _lastLine(0)
+    , _blockStartLine(0)
+    , _hasWrapped(false)
+    , _hasCandidateLines(false)
+    , _searchedLineCount(-1)
+{
+    _searchWatcher = new QFutureWatcher<int>(this);
+    connect(_searchWatcher, SIGNAL(finished()), this, SLOT(blockSearched()));
+    _findAllWatcher = new QFutureWatcher< QList<int> >(this);
+    connect(_findAllWatcher, SIGNAL(finished()), this, SLOT(blocksSearched()));
 }
 void SearchHistoryTask::setSearchDirection(SearchDirection direction)
 {
@@ -1849,6 +2728,24 @@ SearchHistoryTask::SearchDirection SearchHistoryTask::searchDirection() const
 {
     return _direction;
 }
+void SearchHistoryTask::setFindAll(bool findAll)
+{
+    _findAll = findAll;
+}
+void SearchHistoryTask::setCandidateLines(const QList<int>& lines)
+{
+    _candidateLines = lines;
+    _hasCandidateLines = true;
+}
+void SearchHistoryTask::setSearchedLines(const QList<int>& matches, int lineCount)
+{
+    _searchedMatches = matches;
+    _searchedLineCount = lineCount;
+}
+bool SearchHistoryTask::findAll() const
+{
+    return _findAll;
+}
 void SearchHistoryTask::setRegExp(const QRegExp& expression)
 {
     _regExp = expression;
@@ -1867,5 +2764,117 @@ QString SessionController::userTitle() const
     }
 }
 
+K_GLOBAL_STATIC(SnapshotScheduler, theSnapshotScheduler)
+
+// the shortest and longest intervals, in milliseconds, at which the
+// controllers are checked for changes of the foreground process
+static const int MINIMUM_SNAPSHOT_INTERVAL = 2000;
+static const int MAXIMUM_SNAPSHOT_INTERVAL = 32000;
+// the checks which are due within this many milliseconds of each other are
+// done together
+static const int SNAPSHOT_BATCH_TIME = 500;
+
+SnapshotScheduler::SnapshotScheduler()
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(takeSnapshots()));
+    _clock.start();
+}
+
+SnapshotScheduler* SnapshotScheduler::instance()
+{
+    return theSnapshotScheduler;
+}
+
+void SnapshotScheduler::addController(SessionController* controller)
+{
+    Entry entry;
+    entry.due = _clock.elapsed() + MINIMUM_SNAPSHOT_INTERVAL;
+    entry.interval = MINIMUM_SNAPSHOT_INTERVAL;
+    entry.forced = false;
+    _entries.insert(controller, entry);
+
+    scheduleNext();
+}
+
+void SnapshotScheduler::removeController(SessionController* controller)
+{
+    _entries.remove(controller);
+    scheduleNext();
+}
+
+void SnapshotScheduler::scheduleSnapshot(SessionController* controller, int delay)
+{
+    if (!_entries.contains(controller))
+        return;
+
+    Entry& entry = _entries[controller];
+    entry.due = _clock.elapsed() + delay;
+    entry.interval = MINIMUM_SNAPSHOT_INTERVAL;
+    entry.forced = true;
+
+    scheduleNext();
+}
+
+void SnapshotScheduler::takeSnapshots()
+{
+    const qint64 now = _clock.elapsed();
+
+    foreach(SessionController* controller, _entries.keys()) {
+        // a snapshot might have removed the controller
+        if (!_entries.contains(controller))
+            continue;
+
+        Entry entry = _entries.value(controller);
+        if (entry.due < 0 || entry.due > now + SNAPSHOT_BATCH_TIME)
+            continue;
+
+        bool changed = false;
+        if (controller->_session) {
+            if (entry.forced) {
+                controller->snapshot();
+                changed = true;
+            } else {
+                changed = controller->snapshotIfProcessChanged();
+            }
+        }
+
+        if (!_entries.contains(controller))
+            continue;
+
+        // back off while nothing changes, sessions which announce the
+        // changes need no checks at all
+        entry.interval = changed ? MINIMUM_SNAPSHOT_INTERVAL
+                                 : qMin(entry.interval * 2, MAXIMUM_SNAPSHOT_INTERVAL);
+        if (controller->_session && controller->_session->isForegroundProcessTracked())
+            entry.due = -1;
+        else
+            entry.due = now + entry.interval;
+        entry.forced = false;
+        _entries.insert(controller, entry);
+    }
+
+    scheduleNext();
+}
+
+void SnapshotScheduler::scheduleNext()
+{
+    if (_entries.isEmpty()) {
+        _timer.stop();
+        return;
+    }
+
+    qint64 due = -1;
+    foreach(const Entry& entry, _entries) {
+        if (entry.due >= 0 && (due < 0 || entry.due < due))
+            due = entry.due;
+    }
+
+    if (due < 0)
+        _timer.stop();
+    else
+        _timer.start(int(qMax(Q_INT64_C(0), due - _clock.elapsed())));
+}
+
 #include "SessionController.moc"
 
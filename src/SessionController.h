@@ -22,11 +22,16 @@
 #define SESSIONCONTROLLER_H
 
 // Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QRegExp>
 #include <QtCore/QSet>
 #include <QtCore/QPointer>
 #include <QtCore/QString>
 #include <QtCore/QHash>
+#include <QtCore/QTimer>
 
 // KDE
 #include <KIcon>
@@ -42,9 +47,9 @@ class Job;
 }
 
 class QAction;
+class QFile;
 class QTextCodec;
 class QKeyEvent;
-class QTimer;
 
 class KCodecAction;
 class KUrl;
@@ -56,12 +61,15 @@ namespace Konsole
 {
 class Session;
 class SessionGroup;
+class ScreenRenderer;
 class ScreenWindow;
 class TerminalDisplay;
 class IncrementalSearchBar;
 class ProfileList;
 class UrlFilter;
 class RegExpFilter;
+class SearchHistoryTask;
+class Screen;
 
 // SaveHistoryTask
 class TerminalCharacterDecoder;
@@ -144,6 +152,17 @@ public:
      */
     void setShowMenuAction(QAction* action);
 
+    /**
+     * Creates the actions of this controller, unless that has already
+     * been done.
+     *
+     * The actions are only needed once the controller is plugged into the
+     * GUI of a window or shows its context menu, which many controllers of
+     * background tabs never do.  This must be called before actionCollection()
+     * is used from outside of the controller.
+     */
+    void setupActions();
+
     // reimplemented
     virtual KUrl url() const;
     virtual QString currentDir() const;
@@ -230,11 +249,16 @@ private slots:
     void changeSearchMatch();
     void print_screen();
     void saveHistory();
+    void saveImage();
+    void snapshotPrinted();
+    void imageSaved();
     void showHistoryOptions();
     void clearHistory();
     void clearHistoryAndReset();
     void monitorActivity(bool monitor);
     void monitorSilence(bool monitor);
+    void showStatistics(bool show);
+    void updateStatistics();
     void renameSession();
     void switchProfile(Profile::Ptr profile);
     void handleWebShortcutAction();
@@ -249,13 +273,21 @@ private slots:
     void sessionTitleChanged();
     void searchTextChanged(const QString& text);
     void searchCompleted(bool success);
+    void searchMatchesFound(const QList<int>& lines , int current);
+    void searchMatchesUpdated(const QList<int>& lines , int current);
+    void discardSearchMatches();
+    void searchOutputChanged(); // called when the output changes
+    // searches the output which has changed since the last search for all
+    // matches, see SearchHistoryTask::setSearchedLines()
+    void updateSearchMatches();
     void searchClosed(); // called when the user clicks on the
     // history search bar's close button
 
     void interactionHandler();
-    void snapshot(); // called periodically as the user types
-    // to take a snapshot of the state of the
-    // foreground process in the terminal
+    void foregroundProcessChanged();
+    void snapshot(); // called by the SnapshotScheduler, and soon after
+    // the user types, to take a snapshot of the state
+    // of the foreground process in the terminal
 
     void requireUrlFilterUpdate();
     void highlightMatches(bool highlight);
@@ -283,13 +315,37 @@ private:
     // direction - value from SearchHistoryTask::SearchDirection enum to specify
     //             the search direction
     void beginSearch(const QString& text , int direction);
+    // selects the match 'step' places further on in the list of all matches
+    // found by the last search.  returns false if there is no such list
+    bool stepThroughSearchMatches(int step);
+    // returns true if the matches of 'regExp' can only be on the lines of
+    // _searchMatches, see SearchHistoryTask::setCandidateLines()
+    bool canNarrowSearch(const QRegExp& regExp) const;
+    // returns true if the output has changed since the search which found
+    // _searchMatches
+    bool searchMatchesOutdated() const;
+    // remembers the state of the output which a search of 'regExp' starts
+    // with in _searchTaskSource
+    void setSearchTaskSource(const QRegExp& regExp);
     void setupCommonActions();
     void setupExtraActions();
     void removeSearchFilter(); // remove and delete the current search filter if set
     void setFindNextPrevEnabled(bool enabled);
     void listenForScreenWindowUpdates();
+    // takes a snapshot if the foreground process group of the terminal
+    // changed since the last one.  reading the group is cheap, unlike
+    // taking the snapshot.  returns false if nothing changed
+    bool snapshotIfProcessChanged();
+    // takes a snapshot of the lines of the selection, or of the lines shown
+    // in the view if there is no selection
+    void takeSnapshot(ScreenRenderer& renderer, bool selectedLines) const;
+    // tells the user if printing or saving the output failed
+    void reportPrintResult(bool printed);
+    void reportSaveResult(bool saved, const QString& fileName);
 
 private:
+    friend class SnapshotScheduler;
+
     void updateSessionIcon();
 
     QPointer<Session>         _session;
@@ -311,11 +367,24 @@ private:
     KAction* _findNextAction;
     KAction* _findPreviousAction;
 
-    QTimer* _interactionTimer;
+    // the foreground process group of the terminal at the last snapshot
+    int _snapshotProcessGroup;
 
     bool _urlFilterUpdateRequired;
 
     QPointer<IncrementalSearchBar> _searchBar;
+    // the search through the history which is still running, if any
+    QPointer<SearchHistoryTask> _searchTask;
+    // the lines with matches found by the last search, if it found all of
+    // them, and the index of the selected one.  this is -1 if there is no
+    // list.  When the output changes, the list is brought up to date by
+    // searching only the lines which are new since, see updateSearchMatches()
+    QList<int> _searchMatches;
+    int _currentSearchMatch;
+    QTimer _searchMatchesUpdateTimer;
+    // the line of the selected match in the output which is being searched
+    // by updateSearchMatches(), or -1
+    int _updatedSearchMatchLine;
 
     KCodecAction* _codecAction;
 
@@ -331,6 +400,32 @@ private:
 
     QAction* _showMenuAction;
 
+    bool _actionsCreated;
+    // the last state passed to setupPrimaryScreenSpecificActions(), which
+    // is applied when the actions are created
+    bool _primaryScreenInUse;
+
+    // the totals of the session's statistics when they were last shown,
+    // from which the rates since then are calculated
+    struct StatisticsSnapshot {
+        qint64 receivedBytes;
+        qint64 blockCount;
+        qint64 processingTime;
+        qint64 updateCount;
+        qint64 skippedUpdates;
+        qint64 updateTime;
+        qint64 paintCount;
+        qint64 paintTime;
+        qint64 filterTime;
+        qint64 keyEchoCount;
+        qint64 keyEchoTime;
+    };
+    void takeStatisticsSnapshot();
+
+    QTimer _statisticsTimer;
+    QElapsedTimer _statisticsClock;
+    StatisticsSnapshot _statisticsSnapshot;
+
     static QSet<SessionController*> _allControllers;
     static int _lastControllerId;
     static const KIcon _activityIcon;
@@ -342,12 +437,83 @@ private:
     bool _isSearchBarEnabled;
 
     QString _searchText;
+
+    // what a search looked for and the state of the screen it searched,
+    // a search for text which extends that only has to look at the lines
+    // with its matches.  See canNarrowSearch()
+    struct SearchSource {
+        SearchSource()
+            : screen(0), generation(0), historyGeneration(0)
+            , historyLines(0), discardedLines(0) {}
+
+        QRegExp regExp;
+        const Screen* screen;
+        quint64 generation;
+        // see Screen::historyGeneration() and Screen::discardedLines()
+        quint64 historyGeneration;
+        int historyLines;
+        qint64 discardedLines;
+    };
+    SearchSource _searchTaskSource;    // of the search which is running
+    SearchSource _searchMatchesSource; // of _searchMatches, if the regExp is set
 };
 inline bool SessionController::isValid() const
 {
     return !_session.isNull() && !_view.isNull();
 }
 
+/**
+ * Takes the snapshots of all session controllers with a single timer.
+ *
+ * Sessions which announce changes of their foreground process, see
+ * Session::isForegroundProcessTracked(), only get snapshots taken when
+ * they do so or when the user types.  The others are checked at their
+ * own interval, which doubles each time the check finds the foreground
+ * process of the terminal unchanged, up to a limit, and drops back to the
+ * shortest interval when the process has changed.  Idle sessions are thus
+ * checked rarely, and the checks which fall due at roughly the same time
+ * are done together.
+ */
+class SnapshotScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    SnapshotScheduler();
+
+    static SnapshotScheduler* instance();
+
+    /** Starts checking @p controller periodically. */
+    void addController(SessionController* controller);
+    /** Stops checking @p controller */
+    void removeController(SessionController* controller);
+
+    /**
+     * Takes a snapshot of @p controller after @p delay milliseconds, whether
+     * the foreground process has changed or not, and checks it at the
+     * shortest interval again afterwards.
+     */
+    void scheduleSnapshot(SessionController* controller, int delay);
+
+private slots:
+    void takeSnapshots();
+
+private:
+    struct Entry {
+        // -1 if the controller is not to be checked until scheduleSnapshot()
+        qint64 due;
+        int interval;
+        bool forced;
+    };
+
+    // starts the timer for the entry which is due first
+    void scheduleNext();
+
+    QHash<SessionController*, Entry> _entries;
+    QTimer _timer;
+    QElapsedTimer _clock;
+};
+
 /**
  * Abstract class representing a task which can be performed on a group of sessions.
  *
@@ -419,6 +585,9 @@ public:
      * Opens a save file dialog for each session in the group and begins saving
      * each session's history to the given URL.
      *
+     * The output is encoded as UTF-8 in chunks of roughly the same size.  Local
+     * files are written directly, other URLs through KIO.
+     *
      * The data transfer is performed asynchronously and will continue after execute() returns.
      */
     virtual void execute();
@@ -426,6 +595,7 @@ public:
 private slots:
     void jobDataRequested(KIO::Job* job , QByteArray& data);
     void jobResult(KJob* job);
+    void writeLocalFiles();
 
 private:
     class SaveJob // structure to keep information needed to process
@@ -435,15 +605,23 @@ private:
         SessionPtr session; // the session associated with a history save job
         int lastLineFetched; // the last line processed in the previous data request
         // set this to -1 at the start of the save job
+        qint64 bytesFetched; // the size of the output of the lines processed so far
 
         TerminalCharacterDecoder* decoder;  // decoder used to convert terminal characters
         // into output
+
+        QFile* file; // the file written when saving to a local file, or 0
     };
 
+    // decodes the next chunk of the session's output into 'data', returns
+    // false once all of it has been decoded
+    bool fetchNextChunk(SaveJob& info , QByteArray& data);
+    void finishJob(SaveJob& info);
+
     QHash<KJob*, SaveJob> _jobSession;
+    QList<SaveJob> _localJobs;
 };
 
-//class SearchHistoryThread;
 /**
  * A task which searches through the output of sessions for matches for a given regular expression.
  * SearchHistoryTask operates on ScreenWindow instances rather than sessions added by addSession().
@@ -452,6 +630,13 @@ private:
  * When execute() is called, the search begins in the direction specified by searchDirection(),
  * starting at the position of the current selection.
  *
+ * The output is searched in blocks of lines.  Each block is decoded into text when it is
+ * reached, and the text is split into chunks of lines which are searched in parallel on
+ * other threads, so that searching long output does not block the user interface.
+ *
+ * If setFindAll() is enabled, the whole output is searched instead, several blocks at a
+ * time in parallel, and matchesFound() is emitted with every line that contains a match.
+ *
  * FIXME - This is not a proper implementation of SessionTask, in that it ignores sessions specified
  * with addSession()
  *
@@ -492,29 +677,125 @@ public:
     /** Returns the current search direction.  See setSearchDirection(). */
     SearchDirection searchDirection() const;
 
+    /**
+     * Sets whether execute() finds all matches in the output instead of
+     * stopping at the nearest one.  In that case the nearest match is still
+     * selected, and matchesFound() is emitted before completed().
+     */
+    void setFindAll(bool findAll);
+    /** Returns whether all matches are found.  See setFindAll(). */
+    bool findAll() const;
+
+    /**
+     * Restricts finding all matches to @p lines, in ascending order.  These
+     * are the lines with the matches of an earlier search which found
+     * every match of this one as well, such as a search for the start of
+     * the same text, while the output has not changed since.
+     */
+    void setCandidateLines(const QList<int>& lines);
+
+    /**
+     * Specifies that finding all matches only has to search the lines after
+     * the first @p lineCount lines of the output, the lines with matches
+     * among those are @p matches.  This brings the matches of an earlier
+     * search up to date after more output has been added to the history.
+     * In that case no match is selected, and matchesFound() is emitted with
+     * -1 for the selected match.
+     */
+    void setSearchedLines(const QList<int>& matches, int lineCount);
+
+    /**
+     * Scrolls @p window to show line @p line of its output and selects it,
+     * as the search does for a match.
+     */
+    static void highlightResult(ScreenWindow* window , int line);
+
     /**
      * Performs a search through the session's history, starting at the position
      * of the current selection, in the direction specified by setSearchDirection().
      *
      * If it finds a match, the ScreenWindow specified in the constructor is
      * scrolled to the position where the match occurred and the selection
-     * is set to the matching text.  execute() then returns immediately.
+     * is set to the matching text.  The search continues after execute()
+     * returns, completed() is emitted for each screen window once it is done.
+     * If autoDelete() is set, the task deletes itself after the last one.
      *
      * To continue the search looking for further matches, call execute() again.
      */
     virtual void execute();
 
+    /**
+     * Stops the search.  The screen windows are left as they are, and completed()
+     * is not emitted for the windows which have not been searched yet.  If
+     * autoDelete() is set, the task deletes itself.
+     */
+    void cancel();
+
+signals:
+    /**
+     * Emitted for each screen window when all matches have been found.
+     * See setFindAll().
+     *
+     * @param lines The lines of the window's output which contain a match,
+     * in ascending order
+     * @param current The index in @p lines of the match which is selected,
+     * or -1 if there are no matches
+     */
+    void matchesFound(const QList<int>& lines , int current);
+
+private slots:
+    // continues the search with the result of searching the last block
+    void blockSearched();
+    // continues finding all matches with the results of the last blocks
+    void blocksSearched();
+
 private:
     typedef QPointer<ScreenWindow> ScreenWindowPtr;
 
+    void executeOnNextScreenWindow();
     void executeOnScreenWindow(SessionPtr session , ScreenWindowPtr window);
-    void highlightResult(ScreenWindowPtr window , int position);
+    void finishScreenWindow(bool success);
+    void searchNextBlock();
+    void notFound();
+    void searchNextBlocks();
+    void finishFindAll();
 
     QMap< SessionPtr , ScreenWindowPtr > _windows;
     QRegExp _regExp;
     SearchDirection _direction;
-
-    //static QPointer<SearchHistoryThread> _thread;
+    bool _findAll;
+
+    // the sessions whose windows have not been searched yet
+    QList<SessionPtr> _pendingSessions;
+
+    // the window being searched and the lines of the block being searched,
+    // from _line to _endLine
+    SessionPtr _session;
+    ScreenWindowPtr _window;
+    int _startLine;
+    int _line;
+    int _endLine;
+    int _lastLine;
+    bool _hasWrapped;
+    // the first line of the block's text, the history index may leave out
+    // lines at either end of the block
+    int _blockStartLine;
+    // the positions in the block's text where each of its lines starts
+    QList<int> _linePositions;
+
+    QFutureWatcher<int>* _searchWatcher;
+
+    // the lines with matches found so far when finding all matches, and
+    // the ranges of lines which are still to be searched for them
+    QList<int> _matches;
+    QList< QPair<int, int> > _findAllRanges;
+    // see setCandidateLines()
+    QList<int> _candidateLines;
+    bool _hasCandidateLines;
+    // see setSearchedLines(), the line count is -1 if it is not used
+    QList<int> _searchedMatches;
+    int _searchedLineCount;
+    QFutureWatcher< QList<int> >* _findAllWatcher;
 };
 }
 
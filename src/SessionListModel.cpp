@@ -39,15 +39,65 @@ SessionListModel::SessionListModel(QObject* parent)
 
 void SessionListModel::setSessions(const QList<Session*>& sessions)
 {
+    foreach(Session * session, _sessions) {
+        disconnect(session, 0, this, 0);
+    }
+
     _sessions = sessions;
+    _titles.clear();
 
     foreach(Session * session, sessions) {
-        connect(session, SIGNAL(finished()), this, SLOT(sessionFinished()));
+        watchSession(session);
     }
 
     reset();
 }
 
+void SessionListModel::addSession(Session* session)
+{
+    if (_sessions.contains(session))
+        return;
+
+    const int row = _sessions.count();
+    beginInsertRows(QModelIndex(), row, row);
+    _sessions << session;
+    watchSession(session);
+    endInsertRows();
+}
+
+void SessionListModel::watchSession(Session* session)
+{
+    connect(session, SIGNAL(finished()), this, SLOT(sessionFinished()));
+    connect(session, SIGNAL(titleChanged()), this, SLOT(sessionTitleChanged()));
+
+    _titles.insert(session, displayedTitle(session));
+}
+
+QString SessionListModel::displayedTitle(Session* session)
+{
+    // This code is duplicated from SessionController.cpp
+    QString title = session->title(Session::DisplayedTitleRole);
+
+    // special handling for the "%w" marker which is replaced with the
+    // window title set by the shell
+    title.replace("%w", session->userTitle());
+    // special handling for the "%#" marker which is replaced with the
+    // number of the shell
+    title.replace("%#", QString::number(session->sessionId()));
+    return title;
+}
+
+QIcon SessionListModel::icon(const QString& iconName) const
+{
+    QHash<QString, QIcon>::const_iterator iter = _icons.constFind(iconName);
+    if (iter != _icons.constEnd())
+        return iter.value();
+
+    const QIcon icon = KIcon(iconName);
+    _icons.insert(iconName, icon);
+    return icon;
+}
+
 QVariant SessionListModel::data(const QModelIndex& index, int role) const
 {
     Q_ASSERT(index.isValid());
@@ -61,23 +111,14 @@ QVariant SessionListModel::data(const QModelIndex& index, int role) const
     switch (role) {
     case Qt::DisplayRole:
         if (column == 1) {
-            // This code is duplicated from SessionController.cpp
-            QString title = _sessions[row]->title(Session::DisplayedTitleRole);
-
-            // special handling for the "%w" marker which is replaced with the
-            // window title set by the shell
-            title.replace("%w", _sessions[row]->userTitle());
-            // special handling for the "%#" marker which is replaced with the
-            // number of the shell
-            title.replace("%#", QString::number(_sessions[row]->sessionId()));
-            return title;
+            return _titles.value(_sessions[row]);
         } else if (column == 0) {
             return _sessions[row]->sessionId();
         }
         break;
     case Qt::DecorationRole:
         if (column == 1)
-            return KIcon(_sessions[row]->iconName());
+            return icon(_sessions[row]->iconName());
         else
             return QVariant();
     }
@@ -129,10 +170,24 @@ void SessionListModel::sessionFinished()
         beginRemoveRows(QModelIndex(), row, row);
         sessionRemoved(session);
         _sessions.removeAt(row);
+        _titles.remove(session);
         endRemoveRows();
     }
 }
 
+void SessionListModel::sessionTitleChanged()
+{
+    Session* session = qobject_cast<Session*>(sender());
+    int row = _sessions.indexOf(session);
+
+    if (row != -1) {
+        // the icon is looked up when the view repaints the row
+        _titles.insert(session, displayedTitle(session));
+        const QModelIndex changed = index(row, 1, QModelIndex());
+        emit dataChanged(changed, changed);
+    }
+}
+
 QModelIndex SessionListModel::index(int row, int column, const QModelIndex& parent) const
 {
     if (hasIndex(row, column, parent))
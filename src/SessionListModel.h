@@ -24,8 +24,11 @@
 
 // Qt
 #include <QtCore/QAbstractListModel>
+#include <QtCore/QHash>
 #include <QtCore/QVariant>
 
+#include <QtGui/QIcon>
+
 namespace Konsole
 {
 class Session;
@@ -34,7 +37,12 @@ class Session;
  * Item-view model which contains a flat list of sessions.
  * After constructing the model, call setSessions() to set the sessions displayed
  * in the list.  When a session ends (after emitting the finished() signal) it is
- * automatically removed from the list.
+ * automatically removed from the list.  Sessions started later on can be added
+ * with addSession().
+ *
+ * The titles and icons of the sessions are cached and only updated when a
+ * session's title changes, so large lists do not need to be recomputed each
+ * time the view asks for them.
  *
  * The internal pointer for each item in the model (index.internalPointer()) is the
  * associated Session*
@@ -62,14 +70,30 @@ public:
     virtual int rowCount(const QModelIndex& parent) const;
     virtual QModelIndex parent(const QModelIndex& index) const;
 
+public slots:
+    /**
+     * Adds @p session to the end of the list, unless it is in the list
+     * already.  Connect this to SessionManager::sessionAdded() to keep the
+     * list up to date with the running sessions.
+     */
+    void addSession(Session* session);
+
 protected:
     virtual void sessionRemoved(Session*) {}
 
 private slots:
     void sessionFinished();
+    void sessionTitleChanged();
 
 private:
+    void watchSession(Session* session);
+    // computes the title displayed for session, see data()
+    static QString displayedTitle(Session* session);
+    QIcon icon(const QString& iconName) const;
+
     QList<Session*> _sessions;
+    QHash<Session*, QString> _titles;
+    mutable QHash<QString, QIcon> _icons;
 };
 }
 
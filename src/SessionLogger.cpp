@@ -0,0 +1,294 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "SessionLogger.h"
+
+// Qt
+#include <QtCore/QFile>
+#include <QtCore/QtConcurrentRun>
+
+// KDE
+#include <KDebug>
+
+using Konsole::SessionLogger;
+
+// the buffered output is written as soon as there is this much of it ...
+static const int WRITE_SIZE = 64 * 1024;
+// ... or when no more output has arrived for this many milliseconds
+static const int WRITE_DELAY = 1000;
+// output which arrives while this much is waiting to be written is dropped
+static const int MAXIMUM_BUFFER_SIZE = 16 * 1024 * 1024;
+
+static const qint64 DEFAULT_MAXIMUM_FILE_SIZE = Q_INT64_C(64) * 1024 * 1024;
+static const int DEFAULT_ROTATION_COUNT = 4;
+
+// the states of appendPlainText()
+enum EscapeState {
+    Text,
+    // after ESC
+    Escape,
+    // within the intermediate characters of an ESC sequence, eg. ESC ( B
+    EscapeIntermediate,
+    // within a CSI sequence, up to the final character
+    ControlSequence,
+    // within an OSC, DCS, PM or APC string, up to BEL or ESC '\'
+    ControlString,
+    // after ESC in a control string
+    ControlStringEscape
+};
+
+SessionLogger::SessionLogger(const QString& fileName, Format format, QObject* parent)
+    : QObject(parent)
+    , _format(format)
+    , _maximumFileSize(DEFAULT_MAXIMUM_FILE_SIZE)
+    , _rotationCount(DEFAULT_ROTATION_COUNT)
+    , _droppedBytes(0)
+    , _failed(false)
+    , _escapeState(Text)
+{
+    _log.fileName = fileName;
+    _log.file = new QFile(fileName);
+    _log.size = 0;
+    _log.maximumSize = _maximumFileSize;
+    _log.rotationCount = _rotationCount;
+
+    _writeTimer.setSingleShot(true);
+    _writeTimer.setInterval(WRITE_DELAY);
+    connect(&_writeTimer, SIGNAL(timeout()), this, SLOT(writeBuffer()));
+    connect(&_writeWatcher, SIGNAL(finished()), this, SLOT(bufferWritten()));
+}
+
+SessionLogger::~SessionLogger()
+{
+    _writeTimer.stop();
+    _writeWatcher.waitForFinished();
+
+    // the last of the output is written right away, there is at most
+    // MAXIMUM_BUFFER_SIZE bytes of it
+    if (!_failed && !_buffer.isEmpty()) {
+        _log.maximumSize = _maximumFileSize;
+        _log.rotationCount = _rotationCount;
+        writeToLog(&_log, _buffer);
+    }
+
+    delete _log.file;
+}
+
+QString SessionLogger::fileName() const
+{
+    return _log.fileName;
+}
+
+SessionLogger::Format SessionLogger::format() const
+{
+    return _format;
+}
+
+void SessionLogger::setMaximumFileSize(qint64 size)
+{
+    _maximumFileSize = size;
+}
+
+qint64 SessionLogger::maximumFileSize() const
+{
+    return _maximumFileSize;
+}
+
+void SessionLogger::setRotationCount(int count)
+{
+    _rotationCount = qMax(0, count);
+}
+
+int SessionLogger::rotationCount() const
+{
+    return _rotationCount;
+}
+
+void SessionLogger::logOutput(const char* data, int length)
+{
+    if (_failed)
+        return;
+
+    if (_buffer.size() >= MAXIMUM_BUFFER_SIZE) {
+        _droppedBytes += length;
+        return;
+    }
+
+    if (_format == PlainTextOutput)
+        appendPlainText(data, length);
+    else
+        _buffer.append(data, length);
+
+    if (_buffer.size() >= WRITE_SIZE)
+        writeBuffer();
+    else if (!_writeTimer.isActive())
+        _writeTimer.start();
+}
+
+void SessionLogger::appendPlainText(const char* data, int length)
+{
+    const int oldSize = _buffer.size();
+    _buffer.resize(oldSize + length);
+    char* out = _buffer.data() + oldSize;
+
+    int i = 0;
+    while (i < length) {
+        const uchar c = data[i];
+
+        // CAN and SUB abort a sequence
+        if (_escapeState != Text && (c == 0x18 || c == 0x1a)) {
+            _escapeState = Text;
+            i++;
+            continue;
+        }
+
+        switch (_escapeState) {
+        case Text:
+            if (c == 0x1b)
+                _escapeState = Escape;
+            else if (c >= 0x20 && c != 0x7f)
+                *out++ = c;
+            else if (c == '\n' || c == '\t')
+                *out++ = c;
+            break;
+        case Escape:
+            if (c == '[')
+                _escapeState = ControlSequence;
+            else if (c == ']' || c == 'P' || c == '^' || c == '_' || c == 'X')
+                _escapeState = ControlString;
+            else if (c >= 0x20 && c <= 0x2f)
+                _escapeState = EscapeIntermediate;
+            else if (c != 0x1b)
+                _escapeState = Text;
+            break;
+        case EscapeIntermediate:
+            if (c < 0x20 || c > 0x2f)
+                _escapeState = Text;
+            break;
+        case ControlSequence:
+            if (c == 0x1b)
+                _escapeState = Escape;
+            else if (c >= 0x40 && c <= 0x7e)
+                _escapeState = Text;
+            break;
+        case ControlString:
+            if (c == 0x07)
+                _escapeState = Text;
+            else if (c == 0x1b)
+                _escapeState = ControlStringEscape;
+            break;
+        case ControlStringEscape:
+            if (c == '\\') {
+                _escapeState = Text;
+            } else {
+                // the ESC starts a new sequence, which 'c' is a part of
+                _escapeState = Escape;
+                continue;
+            }
+            break;
+        }
+
+        i++;
+    }
+
+    _buffer.resize(out - _buffer.constData());
+}
+
+void SessionLogger::writeBuffer()
+{
+    if (_failed || _buffer.isEmpty() || _writeWatcher.isRunning())
+        return;
+
+    _writeTimer.stop();
+
+    QByteArray data = _buffer;
+    _buffer.clear();
+
+    if (_droppedBytes > 0) {
+        data += "\n[" + QByteArray::number(_droppedBytes) +
+                " bytes of output could not be logged]\n";
+        _droppedBytes = 0;
+    }
+
+    // the write in the background has the log to itself until it finishes
+    _log.maximumSize = _maximumFileSize;
+    _log.rotationCount = _rotationCount;
+    _writeWatcher.setFuture(QtConcurrent::run(writeToLog, &_log, data));
+}
+
+void SessionLogger::bufferWritten()
+{
+    if (!_writeWatcher.result()) {
+        kWarning() << "Unable to write the session log" << _log.fileName
+                   << ":" << _log.file->errorString();
+
+        _failed = true;
+        _buffer.clear();
+        return;
+    }
+
+    if (_buffer.size() >= WRITE_SIZE)
+        writeBuffer();
+    else if (!_buffer.isEmpty() && !_writeTimer.isActive())
+        _writeTimer.start();
+}
+
+bool SessionLogger::writeToLog(LogFile* log, const QByteArray& data)
+{
+    if (!log->file->isOpen()) {
+        if (!log->file->open(QIODevice::WriteOnly | QIODevice::Append))
+            return false;
+        log->size = log->file->size();
+    }
+
+    if (log->maximumSize > 0 && log->size > 0 &&
+            log->size + data.size() > log->maximumSize) {
+        if (!rotateLog(log))
+            return false;
+    }
+
+    if (log->file->write(data) != data.size())
+        return false;
+    log->size += data.size();
+
+    return log->file->flush();
+}
+
+bool SessionLogger::rotateLog(LogFile* log)
+{
+    log->file->close();
+
+    // fileName.(n-1) becomes fileName.n and so on, the oldest log is removed
+    const QString name = log->fileName + ".%1";
+    if (log->rotationCount > 0) {
+        QFile::remove(name.arg(log->rotationCount));
+        for (int i = log->rotationCount - 1; i > 0; i--)
+            QFile::rename(name.arg(i), name.arg(i + 1));
+        QFile::rename(log->fileName, name.arg(1));
+    }
+
+    if (!log->file->open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    log->size = 0;
+
+    return true;
+}
+
+#include "SessionLogger.moc"
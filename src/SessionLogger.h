@@ -0,0 +1,142 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SESSIONLOGGER_H
+#define SESSIONLOGGER_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+// Konsole
+#include "konsole_export.h"
+
+class QFile;
+
+namespace Konsole
+{
+/**
+ * Writes the output of a session to a log file as it arrives.
+ *
+ * The output passed to logOutput() is collected in a buffer which is
+ * written to the file by a background thread, so logging never waits for
+ * the disk.  The buffer is written once it has grown large enough or when
+ * no more output has arrived for a moment.  If the disk cannot keep up
+ * and the buffer grows beyond a limit, further output is dropped and a
+ * note about the dropped output is written to the log instead.
+ *
+ * Once the log file reaches maximumFileSize() it is rotated: it is renamed
+ * to fileName().1, older logs are renamed to fileName().2 and so on up to
+ * rotationCount(), and a new log file is started.
+ *
+ * If the log file cannot be opened or written to, a warning is printed and
+ * no more output is logged.
+ */
+class KONSOLEPRIVATE_EXPORT SessionLogger : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Specifies how the output is written to the log */
+    enum Format {
+        /** The output is written exactly as it was received */
+        RawOutput,
+        /**
+         * Escape sequences, carriage returns and other control characters
+         * except for new lines and tabs are removed from the output, which
+         * leaves the text printed by the session.
+         */
+        PlainTextOutput
+    };
+
+    /**
+     * Constructs a new logger which appends the output to @p fileName.
+     * The file is opened when the first output is written.
+     */
+    explicit SessionLogger(const QString& fileName, Format format = RawOutput,
+                           QObject* parent = 0);
+    /** Writes the remaining output to the log file and closes it */
+    ~SessionLogger();
+
+    /** Returns the name of the log file */
+    QString fileName() const;
+    /** Returns the format with which the output is written */
+    Format format() const;
+
+    /**
+     * Sets the size in bytes after which the log file is rotated.
+     * A size of 0 disables the rotation.
+     */
+    void setMaximumFileSize(qint64 size);
+    /** See setMaximumFileSize() */
+    qint64 maximumFileSize() const;
+
+    /** Sets how many rotated log files are kept besides the current one. */
+    void setRotationCount(int count);
+    /** See setRotationCount() */
+    int rotationCount() const;
+
+    /**
+     * Adds @p length bytes of output from @p data to the log.  This only
+     * copies the data, it is written to the log file later on.
+     */
+    void logOutput(const char* data, int length);
+
+private slots:
+    // starts writing the buffered output, unless a write is already running
+    void writeBuffer();
+    void bufferWritten();
+
+private:
+    // the log file and the settings of the rotation.  While a write is
+    // running in the background, it is only used by that write
+    struct LogFile {
+        QString fileName;
+        QFile* file;
+        qint64 size;
+        qint64 maximumSize;
+        int rotationCount;
+    };
+
+    static bool writeToLog(LogFile* log, const QByteArray& data);
+    static bool rotateLog(LogFile* log);
+
+    // removes escape sequences and control characters from the output
+    void appendPlainText(const char* data, int length);
+
+    Format _format;
+    LogFile _log;
+    qint64 _maximumFileSize;
+    int _rotationCount;
+
+    QByteArray _buffer;
+    qint64 _droppedBytes;
+    bool _failed;
+
+    // the state of appendPlainText() between calls
+    int _escapeState;
+
+    QTimer _writeTimer;
+    QFutureWatcher<bool> _writeWatcher;
+};
+}
+
+#endif // SESSIONLOGGER_H
@@ -22,10 +22,17 @@
 // Own
 #include "SessionManager.h"
 
+// Standard
+#include <typeinfo>
+
 // Qt
 #include <QtCore/QStringList>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 #include <QtCore/QSignalMapper>
 #include <QtCore/QTextCodec>
+#include <QtCore/QTimer>
 
 // KDE
 #include <KConfig>
@@ -34,13 +41,38 @@
 #include <KDebug>
 
 // Konsole
+#include "Emulation.h"
 #include "Session.h"
 #include "ProfileManager.h"
 #include "History.h"
 #include "Enumeration.h"
+#include "TerminalDisplay.h"
 
 using namespace Konsole;
 
+// how often the memory used by the histories is checked against the budget
+static const int HISTORY_BUDGET_CHECK_INTERVAL = 10 * 1000;
+
+// the delay, in milliseconds, after a session has been created before a
+// spare session is started in its place, so that it does not slow down
+// the start of the new session
+static const int SPARE_SESSION_DELAY = 2000;
+static const int MAXIMUM_SPARE_SESSIONS = 4;
+
+// returns the canonical path of the directory which a new session for
+// 'profile' starts in if its tab is opened from a session in 'directory',
+// see MainWindow::createSession()
+static QString startDirectory(const Profile::Ptr profile, const QString& directory)
+{
+    QString path = profile->defaultWorkingDirectory();
+    if (!directory.isEmpty() && profile->startInCurrentSessionDir())
+        path = directory;
+    if (path.isEmpty())
+        path = QDir::currentPath();
+
+    return QFileInfo(path).canonicalFilePath();
+}
+
 SessionManager::SessionManager()
 {
     //map finished() signals from sessions
@@ -51,10 +83,26 @@ SessionManager::SessionManager()
     ProfileManager* profileMananger = ProfileManager::instance();
     connect(profileMananger , SIGNAL(profileChanged(Profile::Ptr)) ,
             this , SLOT(profileChanged(Profile::Ptr)));
+
+    // the budget is given in megabytes
+    const KConfigGroup historyGroup(KGlobal::config(), "History");
+    _historyMemoryBudget = historyGroup.readEntry("MemoryBudget", 512) * Q_INT64_C(1024 * 1024);
+
+    _historyBudgetTimer = new QTimer(this);
+    _historyBudgetTimer->setInterval(HISTORY_BUDGET_CHECK_INTERVAL);
+    connect(_historyBudgetTimer, SIGNAL(timeout()), this, SLOT(checkHistoryMemoryBudget()));
+    _historyBudgetTimer->start();
+
+    _spareSessionTimer = new QTimer(this);
+    _spareSessionTimer->setSingleShot(true);
+    _spareSessionTimer->setInterval(SPARE_SESSION_DELAY);
+    connect(_spareSessionTimer, SIGNAL(timeout()), this, SLOT(startSpareSession()));
 }
 
 SessionManager::~SessionManager()
 {
+    discardSpareSessions();
+
     if (_sessions.count() > 0) {
         kWarning() << "Konsole SessionManager destroyed with sessions still alive";
         // ensure that the Session doesn't later try to call back and do things to the
@@ -78,6 +126,11 @@ void SessionManager::closeAllSessions()
         session->close();
     }
     _sessions.clear();
+    _sessionsById.clear();
+    _profileSessions.clear();
+
+    discardSpareSessions();
+    _spareSessionTimer->stop();
 }
 
 const QList<Session*> SessionManager::sessions() const
@@ -99,8 +152,19 @@ Session* SessionManager::createSession(Profile::Ptr profile)
     Q_ASSERT(session);
     applyProfile(session, profile, false);
 
+    addSession(session, profile);
+
+    // replace the spare session which could have been used instead
+    scheduleSpareSessions();
+
+    return session;
+}
+void SessionManager::addSession(Session* session, Profile::Ptr profile)
+{
     connect(session , SIGNAL(profileChangeCommandReceived(QString)) , this ,
             SLOT(sessionProfileCommandReceived(QString)));
+    connect(session , SIGNAL(viewDisplayed()) , this ,
+            SLOT(sessionViewDisplayed()));
 
     //ask for notification when session dies
     _sessionMapper->setMapping(session, session);
@@ -109,13 +173,137 @@ Session* SessionManager::createSession(Profile::Ptr profile)
 
     //add session to active list
     _sessions << session;
-    _sessionProfiles.insert(session, profile);
+    _sessionsById.insert(session->sessionId(), session);
+    assignProfile(session, profile);
 
-    return session;
+    emit sessionAdded(session);
+}
+void SessionManager::assignProfile(Session* session, Profile::Ptr profile)
+{
+    const Profile::Ptr oldProfile = _sessionProfiles.value(session);
+    _sessionProfiles[session] = profile;
+
+    if (_sessionsById.value(session->sessionId()) != session)
+        return;
+
+    if (oldProfile && oldProfile != profile) {
+        QList<Session*>& oldSessions = _profileSessions[oldProfile.data()];
+        oldSessions.removeAll(session);
+        if (oldSessions.isEmpty())
+            _profileSessions.remove(oldProfile.data());
+    }
+
+    QList<Session*>& sessions = _profileSessions[profile.data()];
+    if (!sessions.contains(session))
+        sessions << session;
+}
+Session* SessionManager::takeSpareSession(Profile::Ptr profile, const QString& directory)
+{
+    if (!profile)
+        profile = ProfileManager::instance()->defaultProfile();
+
+    if (profile != _spareProfile || _spareSessions.isEmpty())
+        return 0;
+
+    const QString path = startDirectory(profile, directory);
+
+    foreach(Session* session, _spareSessions) {
+        if (_spareDirectories[session] == path) {
+            _spareSessions.removeAll(session);
+            _spareDirectories.remove(session);
+            disconnect(session, SIGNAL(finished()), this, SLOT(spareSessionFinished()));
+
+            addSession(session, profile);
+            scheduleSpareSessions();
+            return session;
+        }
+    }
+
+    return 0;
+}
+void SessionManager::scheduleSpareSessions()
+{
+    if (!_spareSessionTimer->isActive())
+        _spareSessionTimer->start();
+}
+void SessionManager::startSpareSession()
+{
+    const Profile::Ptr profile = ProfileManager::instance()->defaultProfile();
+    if (profile != _spareProfile) {
+        discardSpareSessions();
+        _spareProfile = profile;
+    }
+
+    const int count = qBound(0, profile->spareSessions(), MAXIMUM_SPARE_SESSIONS);
+    while (_spareSessions.count() > count)
+        closeSpareSession(_spareSessions.last());
+
+    if (_spareSessions.count() == count)
+        return;
+
+    const QString directory = startDirectory(profile, QString());
+    if (directory.isEmpty())
+        return;
+
+    Session* session = new Session();
+    applyProfile(session, profile, false);
+    session->setInitialWorkingDirectory(directory);
+
+    connect(session, SIGNAL(finished()), this, SLOT(spareSessionFinished()));
+
+    _spareSessions << session;
+    _spareDirectories.insert(session, directory);
+
+    // without a view the size of the terminal has to be set here, the
+    // shell is started as soon as it is known
+    const QSize size = session->preferredSize();
+    session->emulation()->setImageSize(size.height(), size.width());
+
+    // the spare sessions are started one at a time
+    if (_spareSessions.count() < count)
+        _spareSessionTimer->start();
+}
+void SessionManager::spareSessionFinished()
+{
+    // the session is not started again right away, in case its shell
+    // exits early every time
+    Session* session = qobject_cast<Session*>(sender());
+    if (session && _spareSessions.contains(session)) {
+        removeSpareSession(session);
+        session->deleteLater();
+    }
+}
+void SessionManager::removeSpareSession(Session* session)
+{
+    disconnect(session, 0, this, 0);
+
+    _spareSessions.removeAll(session);
+    _spareDirectories.remove(session);
+    _sessionProfiles.remove(session);
+}
+void SessionManager::closeSpareSession(Session* session)
+{
+    removeSpareSession(session);
+
+    connect(session, SIGNAL(finished()), session, SLOT(deleteLater()));
+    session->close();
+}
+void SessionManager::discardSpareSessions()
+{
+    foreach(Session* session, _spareSessions) {
+        closeSpareSession(session);
+    }
 }
 void SessionManager::profileChanged(Profile::Ptr profile)
 {
     applyProfile(profile, true);
+
+    // the spare sessions are started from scratch with the new settings
+    if (profile == _spareProfile ||
+            profile == ProfileManager::instance()->defaultProfile()) {
+        discardSpareSessions();
+        _spareSessionTimer->start();
+    }
 }
 
 void SessionManager::sessionTerminated(QObject* sessionObject)
@@ -124,18 +312,172 @@ void SessionManager::sessionTerminated(QObject* sessionObject)
 
     Q_ASSERT(session);
 
+    const Profile::Ptr profile = _sessionProfiles.value(session);
+    if (profile) {
+        QList<Session*>& sessions = _profileSessions[profile.data()];
+        sessions.removeAll(session);
+        if (sessions.isEmpty())
+            _profileSessions.remove(profile.data());
+    }
+
     _sessions.removeAll(session);
+    _sessionsById.remove(session->sessionId());
     _sessionProfiles.remove(session);
     _sessionRuntimeProfiles.remove(session);
+    _lastViewed.remove(session);
+    _pendingHistorySessions.remove(session);
 
     session->deleteLater();
 }
 
-void SessionManager::applyProfile(Profile::Ptr profile , bool modifiedPropertiesOnly)
+void SessionManager::setHistoryMemoryBudget(qint64 bytes)
+{
+    _historyMemoryBudget = bytes;
+    checkHistoryMemoryBudget();
+}
+
+qint64 SessionManager::historyMemoryBudget() const
+{
+    return _historyMemoryBudget;
+}
+
+// returns true if one of the views of 'session' is visible
+static bool isViewed(const Session* session)
+{
+    foreach(TerminalDisplay* view, session->views()) {
+        if (view->isVisible())
+            return true;
+    }
+    return false;
+}
+
+// returns true if the history of 'session' is kept in memory
+static bool hasHistoryInMemory(const Session* session)
+{
+    const HistoryType& type = session->historyType();
+    return dynamic_cast<const CompactHistoryType*>(&type) ||
+           dynamic_cast<const SharedHistoryType*>(&type);
+}
+
+void SessionManager::trimIdleSessions()
+{
+    foreach(Session* session, _sessions) {
+        if (!isViewed(session))
+            session->trimMemory();
+    }
+}
+
+static bool lessRecentlyViewed(const QPair<qint64, Session*>& a, const QPair<qint64, Session*>& b)
 {
+    return a.first < b.first;
+}
+
+void SessionManager::checkHistoryMemoryBudget()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    qint64 usage = 0;
+    QList< QPair<qint64, Session*> > candidates;
     foreach(Session* session, _sessions) {
-        if (_sessionProfiles[session] == profile)
-            applyProfile(session, profile, modifiedPropertiesOnly);
+        // the old history of a session which is being moved into another
+        // one is released once its lines are copied
+        usage += session->retainedHistoryMemoryUsage();
+
+        if (isViewed(session)) {
+            _lastViewed.insert(session, now);
+        } else if (hasHistoryInMemory(session)) {
+            // sessions which were never seen count as viewed when they are
+            // first checked
+            if (!_lastViewed.contains(session))
+                _lastViewed.insert(session, now);
+            candidates << qMakePair(_lastViewed.value(session), session);
+        }
+    }
+
+    if (usage <= _historyMemoryBudget)
+        return;
+
+    // compacting the histories may already be enough
+    for (int i = 0; i < candidates.count(); i++) {
+        Session* session = candidates[i].second;
+
+        const qint64 oldUsage = session->retainedHistoryMemoryUsage();
+        session->trimMemory();
+        usage -= oldUsage - session->retainedHistoryMemoryUsage();
+    }
+
+    if (usage <= _historyMemoryBudget)
+        return;
+
+    qStableSort(candidates.begin(), candidates.end(), lessRecentlyViewed);
+
+    for (int i = 0; i < candidates.count() && usage > _historyMemoryBudget; i++) {
+        Session* session = candidates[i].second;
+
+        // the compressed history keeps as many lines as before
+        const qint64 oldUsage = session->retainedHistoryMemoryUsage();
+        session->setHistoryType(CompressedHistoryType(session->historyType().maximumLineCount()));
+        usage -= oldUsage - session->retainedHistoryMemoryUsage();
+    }
+}
+
+// sets the history type of 'session' unless its history is kept that way
+// already.  Changing the history type copies all of its lines
+static void setHistoryType(Session* session, const HistoryType& type)
+{
+    const HistoryType& current = session->historyType();
+    if (typeid(current) == typeid(type) &&
+            current.maximumLineCount() == type.maximumLineCount()) {
+        const HistoryTypeFile* file = dynamic_cast<const HistoryTypeFile*>(&type);
+        if (!file || file->fileName() == static_cast<const HistoryTypeFile&>(current).fileName())
+            return;
+    }
+
+    session->setHistoryType(type);
+}
+
+// sets the history type of 'session' as 'profile' asks for
+static void applyHistoryType(Session* session, const Profile::Ptr profile)
+{
+    const int mode = profile->property<int>(Profile::HistoryMode);
+    switch (mode) {
+    case Enum::NoHistory:
+        setHistoryType(session, HistoryTypeNone());
+        break;
+
+    case Enum::FixedSizeHistory: {
+        int lines = profile->historySize();
+        if (profile->shareHistory())
+            setHistoryType(session, SharedHistoryType(lines));
+        else
+            setHistoryType(session, CompactHistoryType(lines));
+    }
+    break;
+
+    case Enum::UnlimitedHistory:
+        if (profile->compressHistory())
+            setHistoryType(session, CompressedHistoryType());
+        else if (profile->persistentHistory())
+            setHistoryType(session, HistoryTypeFile(session->persistentHistoryFileName()));
+        else
+            setHistoryType(session, HistoryTypeFile());
+        break;
+    }
+}
+
+void SessionManager::sessionViewDisplayed()
+{
+    Session* session = qobject_cast<Session*>(sender());
+    if (session && _pendingHistorySessions.remove(session))
+        applyHistoryType(session, _sessionProfiles.value(session));
+}
+
+void SessionManager::applyProfile(Profile::Ptr profile , bool modifiedPropertiesOnly)
+{
+    // a copy, since applying the profile may change the sessions of a profile
+    const QList<Session*> sessions = _profileSessions.value(profile.data());
+    foreach(Session* session, sessions) {
+        applyProfile(session, profile, modifiedPropertiesOnly);
     }
 }
 Profile::Ptr SessionManager::sessionProfile(Session* session) const
@@ -149,7 +491,7 @@ void SessionManager::setSessionProfile(Session* session, Profile::Ptr profile)
 
     Q_ASSERT(profile);
 
-    _sessionProfiles[session] = profile;
+    assignProfile(session, profile);
 
     applyProfile(session, profile, false);
 
@@ -159,7 +501,7 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
 {
     Q_ASSERT(profile);
 
-    _sessionProfiles[session] = profile;
+    assignProfile(session, profile);
 
     ShouldApplyProperty apply(profile, modifiedPropertiesOnly);
 
@@ -209,28 +551,56 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
                                    profile->remoteTabTitleFormat());
 
     // History
-    if (apply.shouldApply(Profile::HistoryMode) || apply.shouldApply(Profile::HistorySize)) {
-        const int mode = profile->property<int>(Profile::HistoryMode);
-        switch (mode) {
-        case Enum::NoHistory:
-            session->setHistoryType(HistoryTypeNone());
-            break;
-
-        case Enum::FixedSizeHistory: {
-            int lines = profile->historySize();
-            session->setHistoryType(CompactHistoryType(lines));
-        }
-        break;
-
-        case Enum::UnlimitedHistory:
-            session->setHistoryType(HistoryTypeFile());
-            break;
+    if (apply.shouldApply(Profile::HistoryMode) || apply.shouldApply(Profile::HistorySize) ||
+            apply.shouldApply(Profile::CompressHistory) || apply.shouldApply(Profile::ShareHistory) ||
+            apply.shouldApply(Profile::PersistentHistory)) {
+        // the lines of sessions which nobody looks at are copied into the
+        // new history once one of their views is shown
+        if (modifiedPropertiesOnly && !session->views().isEmpty() && !isViewed(session)) {
+            _pendingHistorySessions.insert(session);
+        } else {
+            _pendingHistorySessions.remove(session);
+            applyHistoryType(session, profile);
         }
     }
+    if (apply.shouldApply(Profile::IndexHistory))
+        session->setHistoryIndexEnabled(profile->indexHistory());
 
     // Terminal features
     if (apply.shouldApply(Profile::FlowControlEnabled))
         session->setFlowControlEnabled(profile->flowControlEnabled());
+    if (apply.shouldApply(Profile::ZModemDetectionEnabled))
+        session->setZModemDetectionEnabled(profile->zmodemDetectionEnabled());
+    if (apply.shouldApply(Profile::BinaryOutputDetectionEnabled))
+        session->setBinaryOutputDetectionEnabled(profile->binaryOutputDetectionEnabled());
+    if (apply.shouldApply(Profile::FastForwardEnabled))
+        session->setFastForwardEnabled(profile->fastForwardEnabled());
+    if (apply.shouldApply(Profile::ReflowLines))
+        session->setReflowLines(profile->reflowLines());
+    if (apply.shouldApply(Profile::AlternateScreenReleaseDelay))
+        session->setAlternateScreenReleaseDelay(profile->alternateScreenReleaseDelay());
+
+    // Display updates
+    if (apply.shouldApply(Profile::UpdateLatency) ||
+            apply.shouldApply(Profile::MaximumUpdateInterval) ||
+            apply.shouldApply(Profile::HighOutputRate)) {
+        session->setUpdateScheduling(profile->property<int>(Profile::UpdateLatency),
+                                     profile->property<int>(Profile::MaximumUpdateInterval),
+                                     profile->property<int>(Profile::HighOutputRate));
+    }
+    if (apply.shouldApply(Profile::FloodOutputRate) ||
+            apply.shouldApply(Profile::FloodFrameRate)) {
+        session->setFloodModeParameters(profile->property<int>(Profile::FloodOutputRate),
+                                        profile->property<int>(Profile::FloodFrameRate));
+    }
+    if (apply.shouldApply(Profile::OutputTimeSlice))
+        session->setOutputTimeSlice(profile->property<int>(Profile::OutputTimeSlice));
+    if (apply.shouldApply(Profile::BackgroundOutputInterval))
+        session->setBackgroundOutputInterval(profile->property<int>(Profile::BackgroundOutputInterval));
+    if (apply.shouldApply(Profile::ReadBufferSize))
+        session->setReadBufferSize(profile->property<int>(Profile::ReadBufferSize) * 1024);
+    if (apply.shouldApply(Profile::OutputHighWaterMark))
+        session->setOutputHighWaterMark(profile->property<int>(Profile::OutputHighWaterMark) * 1024);
 
     // Encoding
     if (apply.shouldApply(Profile::DefaultEncoding)) {
@@ -241,6 +611,13 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
     // Monitor Silence
     if (apply.shouldApply(Profile::SilenceSeconds))
         session->setMonitorSilenceSeconds(profile->silenceSeconds());
+
+    // Output log
+    if (apply.shouldApply(Profile::OutputLogDirectory) ||
+            apply.shouldApply(Profile::OutputLogPlainText)) {
+        session->setOutputLogging(profile->outputLogDirectory(),
+                                  profile->outputLogPlainText());
+    }
 }
 
 void SessionManager::sessionProfileCommandReceived(const QString& text)
@@ -251,6 +628,10 @@ void SessionManager::sessionProfileCommandReceived(const QString& text)
     ProfileCommandParser parser;
     QHash<Profile::Property, QVariant> changes = parser.parse(text);
 
+    // the program in the terminal must not be able to make Konsole write
+    // files wherever it likes
+    changes.remove(Profile::OutputLogDirectory);
+
     Profile::Ptr newProfile;
     if (!_sessionRuntimeProfiles.contains(session)) {
         newProfile = new Profile(_sessionProfiles[session]);
@@ -265,7 +646,7 @@ void SessionManager::sessionProfileCommandReceived(const QString& text)
         newProfile->setProperty(iter.key(), iter.value());
     }
 
-    _sessionProfiles[session] = newProfile;
+    assignProfile(session, newProfile);
     applyProfile(newProfile, true);
     emit sessionUpdated(session);
 }
@@ -321,13 +702,10 @@ void SessionManager::restoreSessions(KConfig* config)
 Session* SessionManager::idToSession(int id)
 {
     Q_ASSERT(id);
-    foreach(Session * session, _sessions) {
-        if (session->sessionId() == id)
-            return session;
-    }
+    Session* session = _sessionsById.value(id);
     // this should not happen
-    Q_ASSERT(0);
-    return 0;
+    Q_ASSERT(session);
+    return session;
 }
 
 
@@ -25,11 +25,13 @@
 // Qt
 #include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QSet>
 
 // Konsole
 #include "Profile.h"
 
 class QSignalMapper;
+class QTimer;
 
 class KConfig;
 
@@ -78,6 +80,21 @@ public:
      */
     Session* createSession(Profile::Ptr profile = Profile::Ptr());
 
+    /**
+     * Returns a session for @p profile whose shell has been started ahead of
+     * time, or 0 if there is no such session.  This can be used instead of
+     * createSession() when a new tab is opened from a session whose current
+     * directory is @p directory, the returned session runs in the
+     * directory which a new session would start in.
+     *
+     * Spare sessions are only started for the default profile, see
+     * Profile::SpareSessions.  The returned session is added to the manager
+     * like one returned by createSession(), but its shell is already
+     * running, so its environment and initial working directory cannot be
+     * changed anymore.
+     */
+    Session* takeSpareSession(Profile::Ptr profile, const QString& directory);
+
     /** Sets the profile associated with a session. */
     void setSessionProfile(Session* session, Profile::Ptr profile);
 
@@ -95,6 +112,23 @@ public:
     int  getRestoreId(Session* session);
     Session* idToSession(int id);
 
+    /**
+     * Sets the number of bytes of memory which the histories of all sessions
+     * may use together.  Once they use more, the histories of the sessions
+     * which have not been viewed for the longest time are moved from memory
+     * into compressed files.
+     */
+    void setHistoryMemoryBudget(qint64 bytes);
+    /** Returns the memory budget of the histories.  See setHistoryMemoryBudget() */
+    qint64 historyMemoryBudget() const;
+
+    /**
+     * Gives back the memory which the sessions that are not viewed at the
+     * moment do not need, see Session::trimMemory().  This is also done
+     * before histories are moved out of memory to keep within the budget.
+     */
+    void trimIdleSessions();
+
 signals:
     /**
      * Emitted when a session's settings are updated to match
@@ -102,6 +136,12 @@ signals:
      */
     void sessionUpdated(Session* session);
 
+    /**
+     * Emitted when a new session has been added to the list of running
+     * sessions.  See sessions()
+     */
+    void sessionAdded(Session* session);
+
 protected slots:
     /**
      * Called to inform the manager that a session has finished executing.
@@ -115,6 +155,18 @@ private slots:
 
     void profileChanged(Profile::Ptr profile);
 
+    // applies the history settings which were deferred while the session
+    // was not viewed, see applyProfile()
+    void sessionViewDisplayed();
+
+    // moves histories out of memory while they use more than the budget
+    void checkHistoryMemoryBudget();
+
+    // starts another spare session if there are fewer than the default
+    // profile asks for
+    void startSpareSession();
+    void spareSessionFinished();
+
 private:
     // applies updates to a profile
     // to all sessions currently using that profile
@@ -128,13 +180,46 @@ private:
     // returns true )
     void applyProfile(Session* session , const Profile::Ptr profile , bool modifiedPropertiesOnly);
 
+    // adds a session which has been created for @p profile to the list of
+    // sessions
+    void addSession(Session* session, Profile::Ptr profile);
+    // records @p profile as the profile of @p session, and for the sessions
+    // in the list of sessions, in the sessions of each profile
+    void assignProfile(Session* session, Profile::Ptr profile);
+
+    // makes sure that the spare sessions are checked soon
+    void scheduleSpareSessions();
+    // closes the spare sessions
+    void discardSpareSessions();
+    void closeSpareSession(Session* session);
+    void removeSpareSession(Session* session);
+
     QList<Session*> _sessions; // list of running sessions
+    QHash<int, Session*> _sessionsById; // the sessions of _sessions by ID
 
     QHash<Session*, Profile::Ptr> _sessionProfiles;
+    // the sessions of _sessions which use each profile, so that changes to
+    // a profile only visit the sessions using it
+    QHash<const Profile*, QList<Session*> > _profileSessions;
     QHash<Session*, Profile::Ptr> _sessionRuntimeProfiles;
     QHash<Session*, int> _restoreMapping;
 
     QSignalMapper* _sessionMapper;
+
+    qint64 _historyMemoryBudget;
+    QTimer* _historyBudgetTimer;
+    QHash<Session*, qint64> _lastViewed; // when a view of each session was last seen visible
+
+    // the sessions whose history is kept as before until one of their
+    // views is shown, although their profile asks for another kind
+    QSet<Session*> _pendingHistorySessions;
+
+    // sessions which have been started ahead of time for _spareProfile,
+    // and the directories they run in
+    QList<Session*> _spareSessions;
+    QHash<Session*, QString> _spareDirectories;
+    Profile::Ptr _spareProfile;
+    QTimer* _spareSessionTimer;
 };
 
 /** Utility class to simplify code in SessionManager::applyProfile(). */
@@ -0,0 +1,326 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "SessionRecording.h"
+
+// KDE
+#include <KDebug>
+
+// Konsole
+#include "Emulation.h"
+
+using Konsole::SessionRecorder;
+using Konsole::SessionRecordingReader;
+using Konsole::SessionReplay;
+using Konsole::RecordedEvent;
+
+// the start of each recording, followed by the version of the format
+static const char RECORDING_MAGIC[] = "KONSOLE-RECORDING";
+static const char RECORDING_VERSION = 1;
+
+// the bytes which introduce each type of event
+static const char OUTPUT_EVENT = 'o';
+static const char RESIZE_EVENT = 'r';
+
+// the buffered events are written as soon as there are this many bytes of them ...
+static const int WRITE_SIZE = 64 * 1024;
+// ... or when no more events have arrived for this many milliseconds
+static const int WRITE_DELAY = 1000;
+
+// the largest block of output which is accepted when reading a recording
+static const quint64 MAXIMUM_OUTPUT_SIZE = 16 * 1024 * 1024;
+
+// when replaying at maximum speed, the events are passed on for this many
+// milliseconds at a time before returning to the event loop
+static const int REPLAY_TIME_SLICE = 50;
+
+SessionRecorder::SessionRecorder(const QString& fileName, QObject* parent)
+    : QObject(parent)
+    , _file(fileName)
+    , _failed(false)
+    , _lastEventTime(0)
+{
+    _writeTimer.setSingleShot(true);
+    _writeTimer.setInterval(WRITE_DELAY);
+    connect(&_writeTimer, SIGNAL(timeout()), this, SLOT(writeBuffer()));
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    writeBuffer();
+}
+
+bool SessionRecorder::open()
+{
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        _failed = true;
+        return false;
+    }
+
+    _buffer.append(RECORDING_MAGIC, sizeof(RECORDING_MAGIC) - 1);
+    _buffer.append(RECORDING_VERSION);
+
+    _clock.restart();
+    _lastEventTime = 0;
+
+    return true;
+}
+
+QString SessionRecorder::fileName() const
+{
+    return _file.fileName();
+}
+
+QString SessionRecorder::errorString() const
+{
+    return _file.errorString();
+}
+
+void SessionRecorder::recordOutput(const char* data, int length)
+{
+    if (_failed)
+        return;
+
+    beginEvent(RecordedEvent::Output);
+    appendNumber(length);
+    _buffer.append(data, length);
+    eventAdded();
+}
+
+void SessionRecorder::recordResize(int lines, int columns)
+{
+    if (_failed)
+        return;
+
+    beginEvent(RecordedEvent::Resize);
+    appendNumber(lines);
+    appendNumber(columns);
+    eventAdded();
+}
+
+void SessionRecorder::beginEvent(RecordedEvent::Type type)
+{
+    const qint64 time = _clock.elapsed();
+
+    _buffer.append(type == RecordedEvent::Output ? OUTPUT_EVENT : RESIZE_EVENT);
+    appendNumber(time - _lastEventTime);
+    _lastEventTime = time;
+}
+
+// appends 'number' seven bits at a time, starting with the lowest bits.
+// The highest bit of each byte is set if more bytes follow
+void SessionRecorder::appendNumber(quint64 number)
+{
+    while (number >= 0x80) {
+        _buffer.append(char((number & 0x7f) | 0x80));
+        number >>= 7;
+    }
+    _buffer.append(char(number));
+}
+
+void SessionRecorder::eventAdded()
+{
+    if (_buffer.size() >= WRITE_SIZE)
+        writeBuffer();
+    else if (!_writeTimer.isActive())
+        _writeTimer.start();
+}
+
+void SessionRecorder::writeBuffer()
+{
+    _writeTimer.stop();
+
+    if (_failed || _buffer.isEmpty())
+        return;
+
+    if (_file.write(_buffer) != _buffer.size() || !_file.flush()) {
+        kWarning() << "Unable to write the session recording" << _file.fileName()
+                   << ":" << _file.errorString();
+        _failed = true;
+    }
+    _buffer.clear();
+}
+
+SessionRecordingReader::SessionRecordingReader(const QString& fileName)
+    : _file(fileName)
+    , _time(0)
+{
+}
+
+bool SessionRecordingReader::open()
+{
+    if (!_file.open(QIODevice::ReadOnly)) {
+        _error = _file.errorString();
+        return false;
+    }
+
+    const QByteArray header = _file.read(sizeof(RECORDING_MAGIC));
+    if (header != QByteArray(RECORDING_MAGIC) + RECORDING_VERSION) {
+        _error = QString("%1 is not a session recording").arg(_file.fileName());
+        return false;
+    }
+
+    _time = 0;
+    return true;
+}
+
+bool SessionRecordingReader::readEvent(RecordedEvent* event)
+{
+    char type;
+    if (!_file.getChar(&type))
+        return false;
+
+    quint64 delay;
+    if (!readNumber(&delay))
+        return false;
+    _time += delay;
+    event->time = _time;
+
+    if (type == OUTPUT_EVENT) {
+        quint64 length;
+        if (!readNumber(&length))
+            return false;
+        if (length > MAXIMUM_OUTPUT_SIZE) {
+            _error = QString("The recording %1 is damaged").arg(_file.fileName());
+            return false;
+        }
+
+        event->type = RecordedEvent::Output;
+        event->data = _file.read(length);
+        if (event->data.size() != int(length)) {
+            _error = QString("The recording %1 is truncated").arg(_file.fileName());
+            return false;
+        }
+    } else if (type == RESIZE_EVENT) {
+        quint64 lines;
+        quint64 columns;
+        if (!readNumber(&lines) || !readNumber(&columns))
+            return false;
+
+        event->type = RecordedEvent::Resize;
+        event->data.clear();
+        event->lines = int(lines);
+        event->columns = int(columns);
+    } else {
+        _error = QString("The recording %1 is damaged").arg(_file.fileName());
+        return false;
+    }
+
+    return true;
+}
+
+bool SessionRecordingReader::readNumber(quint64* number)
+{
+    *number = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        char c;
+        if (!_file.getChar(&c)) {
+            _error = QString("The recording %1 is truncated").arg(_file.fileName());
+            return false;
+        }
+
+        *number |= quint64(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+
+    _error = QString("The recording %1 is damaged").arg(_file.fileName());
+    return false;
+}
+
+QString SessionRecordingReader::errorString() const
+{
+    return _error;
+}
+
+SessionReplay::SessionReplay(const QString& fileName, Emulation* emulation, Speed speed,
+                             QObject* parent)
+    : QObject(parent)
+    , _reader(fileName)
+    , _emulation(emulation)
+    , _speed(speed)
+    , _resizeEmulation(true)
+    , _hasNextEvent(false)
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(replayEvents()));
+}
+
+bool SessionReplay::start()
+{
+    if (!_reader.open())
+        return false;
+
+    _hasNextEvent = _reader.readEvent(&_nextEvent);
+    _clock.restart();
+    _timer.start(0);
+
+    return true;
+}
+
+QString SessionReplay::errorString() const
+{
+    return _reader.errorString();
+}
+
+void SessionReplay::setResizeEmulation(bool resize)
+{
+    _resizeEmulation = resize;
+}
+
+void SessionReplay::replayEvent(const RecordedEvent& event, Emulation* emulation)
+{
+    if (event.type == RecordedEvent::Output)
+        emulation->receiveData(event.data.constData(), event.data.size());
+    else
+        emulation->setImageSize(event.lines, event.columns);
+}
+
+void SessionReplay::replayEvents()
+{
+    const PerformanceClock slice;
+
+    while (_hasNextEvent) {
+        if (_speed == OriginalSpeed) {
+            const qint64 delay = _nextEvent.time - _clock.elapsed();
+            if (delay > 0) {
+                // round up, the event is due once the delay has passed
+                _timer.start(int((delay + 999) / 1000));
+                return;
+            }
+        } else if (slice.elapsed() >= REPLAY_TIME_SLICE * 1000) {
+            _timer.start(0);
+            return;
+        }
+
+        if (_nextEvent.type == RecordedEvent::Resize && !_resizeEmulation)
+            emit resizeRequest(QSize(_nextEvent.columns, _nextEvent.lines));
+        else
+            replayEvent(_nextEvent, _emulation);
+        _hasNextEvent = _reader.readEvent(&_nextEvent);
+    }
+
+    if (!_reader.errorString().isEmpty())
+        kWarning() << _reader.errorString();
+
+    emit finished();
+}
+
+#include "SessionRecording.moc"
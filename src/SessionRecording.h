@@ -0,0 +1,224 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SESSIONRECORDING_H
+#define SESSIONRECORDING_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+#include <QtCore/QSize>
+#include <QtCore/QTimer>
+
+// Konsole
+#include "konsole_export.h"
+#include "PerformanceClock.h"
+
+namespace Konsole
+{
+class Emulation;
+
+/**
+ * Describes an event in a recording of a session, see SessionRecorder.
+ */
+struct RecordedEvent {
+    enum Type {
+        /** Output received from the terminal process */
+        Output,
+        /** The terminal was resized */
+        Resize
+    };
+
+    Type type;
+    /** The time of the event in microseconds since the recording started */
+    qint64 time;
+    /** The output, for Output events */
+    QByteArray data;
+    /** The new size of the terminal, for Resize events */
+    int lines;
+    int columns;
+};
+
+/**
+ * Records the output of a session as it was received from the terminal
+ * process, along with the time it arrived and the changes of the
+ * terminal size, so that the output can be replayed exactly later on,
+ * eg. to reproduce a performance problem.  See SessionReplay.
+ *
+ * The recording is written in a compact binary format: a header
+ * followed by the events, each consisting of its type, the time since
+ * the previous event and its data, with the numbers written as
+ * variable length integers.
+ *
+ * The events are collected in a buffer which is written to the file once
+ * it has grown large enough or when no more events have arrived for a
+ * moment.
+ */
+class KONSOLEPRIVATE_EXPORT SessionRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Constructs a recorder which writes the recording to @p fileName */
+    explicit SessionRecorder(const QString& fileName, QObject* parent = 0);
+    /** Writes the remaining events and closes the recording */
+    ~SessionRecorder();
+
+    /**
+     * Creates the file and writes the header of the recording.  Returns
+     * false if the file cannot be created, see errorString().
+     */
+    bool open();
+
+    /** Returns the name of the recording file */
+    QString fileName() const;
+    /** Returns a description of the last error */
+    QString errorString() const;
+
+    /** Adds @p length bytes of output from @p data to the recording. */
+    void recordOutput(const char* data, int length);
+    /** Records that the terminal was resized to @p lines by @p columns. */
+    void recordResize(int lines, int columns);
+
+private slots:
+    void writeBuffer();
+
+private:
+    void beginEvent(RecordedEvent::Type type);
+    void appendNumber(quint64 number);
+    void eventAdded();
+
+    QFile _file;
+    QByteArray _buffer;
+    bool _failed;
+
+    PerformanceClock _clock;
+    qint64 _lastEventTime;
+
+    QTimer _writeTimer;
+};
+
+/**
+ * Reads the events of a recording written by SessionRecorder.
+ */
+class KONSOLEPRIVATE_EXPORT SessionRecordingReader
+{
+public:
+    /** Constructs a reader for the recording in @p fileName */
+    explicit SessionRecordingReader(const QString& fileName);
+
+    /**
+     * Opens the recording and checks its header.  Returns false if it
+     * cannot be read, see errorString().
+     */
+    bool open();
+
+    /**
+     * Reads the next event into @p event.  Returns false once all events
+     * were read or if the recording is damaged, in which case
+     * errorString() is set.
+     */
+    bool readEvent(RecordedEvent* event);
+
+    /** Returns a description of the last error, or an empty string */
+    QString errorString() const;
+
+private:
+    bool readNumber(quint64* number);
+
+    QFile _file;
+    qint64 _time;
+    QString _error;
+};
+
+/**
+ * Feeds a recording written by SessionRecorder into an emulation, either
+ * with the timing of the original session or as fast as possible.  The
+ * events are replayed from the event loop so that the views attached to
+ * the emulation keep being updated.
+ */
+class KONSOLEPRIVATE_EXPORT SessionReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Speed {
+        /** The events are replayed with the delays they were recorded with */
+        OriginalSpeed,
+        /** The events are replayed without delays */
+        MaximumSpeed
+    };
+
+    /**
+     * Constructs a replay of the recording in @p fileName into
+     * @p emulation.  The emulation must outlive the replay.
+     */
+    SessionReplay(const QString& fileName, Emulation* emulation, Speed speed,
+                  QObject* parent = 0);
+
+    /**
+     * Starts the replay.  Returns false if the recording cannot be read,
+     * see errorString().
+     */
+    bool start();
+
+    /** Returns a description of the last error, or an empty string */
+    QString errorString() const;
+
+    /**
+     * Specifies whether the replay resizes the emulation when the recorded
+     * terminal was resized, which is the default, or emits resizeRequest()
+     * instead.  The emulation of a session must be resized together with
+     * its views and its terminal process, see Session::setSize().
+     */
+    void setResizeEmulation(bool resize);
+
+    /** Passes @p event on to @p emulation */
+    static void replayEvent(const RecordedEvent& event, Emulation* emulation);
+
+signals:
+    /** Emitted once all events were replayed, or the replay failed */
+    void finished();
+
+    /**
+     * Emitted when the recorded terminal was resized to @p size, in columns
+     * and lines, unless the replay resizes the emulation itself.  See
+     * setResizeEmulation()
+     */
+    void resizeRequest(const QSize& size);
+
+private slots:
+    void replayEvents();
+
+private:
+    SessionRecordingReader _reader;
+    Emulation* _emulation;
+    Speed _speed;
+    bool _resizeEmulation;
+
+    RecordedEvent _nextEvent;
+    bool _hasNextEvent;
+    PerformanceClock _clock;
+
+    QTimer _timer;
+};
+}
+
+#endif // SESSIONRECORDING_H
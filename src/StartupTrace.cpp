@@ -0,0 +1,120 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "StartupTrace.h"
+
+// System
+#include <stdio.h>
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+
+// KDE
+#include <KGlobal>
+
+using Konsole::StartupTrace;
+
+namespace
+{
+struct Phase {
+    const char* name;
+    qint64 time;
+};
+
+struct Trace {
+    Trace()
+        : budget(0)
+        , finished(false) {
+        clock.start();
+
+        enabled = qgetenv("KONSOLE_STARTUP_TRACE") == "1";
+        budget = qgetenv("KONSOLE_STARTUP_BUDGET").toInt();
+    }
+
+    QElapsedTimer clock;
+    QVector<Phase> phases;
+    int budget;
+    bool enabled;
+    bool finished;
+};
+}
+
+K_GLOBAL_STATIC(Trace, theTrace)
+
+// the first paint of every display ends up here, so this avoids even
+// looking at the trace once it has finished
+static bool traceFinished = false;
+
+void StartupTrace::setEnabled(bool enabled)
+{
+    theTrace->enabled = enabled;
+}
+
+bool StartupTrace::isEnabled()
+{
+    return theTrace->enabled;
+}
+
+void StartupTrace::mark(const char* phase)
+{
+    if (traceFinished)
+        return;
+
+    Trace* trace = theTrace;
+    foreach(const Phase& existing, trace->phases) {
+        if (qstrcmp(existing.name, phase) == 0)
+            return;
+    }
+
+    const Phase newPhase = { phase, trace->clock.elapsed() };
+    trace->phases << newPhase;
+}
+
+void StartupTrace::finish()
+{
+    if (traceFinished)
+        return;
+
+    traceFinished = true;
+
+    const Trace* trace = theTrace;
+    if (!trace->enabled)
+        return;
+
+    const qint64 total = trace->clock.elapsed();
+
+    fprintf(stderr, "Konsole startup trace (milliseconds since main()):\n");
+    qint64 previous = 0;
+    foreach(const Phase& phase, trace->phases) {
+        fprintf(stderr, "%8lld %+8lld  %s\n", phase.time, phase.time - previous, phase.name);
+        previous = phase.time;
+    }
+
+    if (trace->budget > 0 && total > trace->budget) {
+        fprintf(stderr, "Startup took %lld ms, %lld ms over the budget of %d ms\n",
+                total, total - trace->budget, trace->budget);
+    } else if (trace->budget > 0) {
+        fprintf(stderr, "Startup took %lld ms, within the budget of %d ms\n",
+                total, trace->budget);
+    } else {
+        fprintf(stderr, "Startup took %lld ms\n", total);
+    }
+}
@@ -0,0 +1,61 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * Records when the phases of Konsole's startup are reached and prints a
+ * summary of them once the first terminal display has been painted.
+ *
+ * The phases are always recorded, which only takes a few timestamps.  The
+ * summary is printed to stderr if the trace has been enabled with
+ * setEnabled(), or by setting the KONSOLE_STARTUP_TRACE environment
+ * variable to 1.  If KONSOLE_STARTUP_BUDGET is set to a number of
+ * milliseconds, the summary also reports whether the startup took longer.
+ */
+class KONSOLEPRIVATE_EXPORT StartupTrace
+{
+public:
+    /** Sets whether the summary is printed, see finish() */
+    static void setEnabled(bool enabled);
+    /** Returns whether the summary is printed */
+    static bool isEnabled();
+
+    /**
+     * Records that the phase @p phase of the startup has been reached.
+     * Each phase is only recorded the first time.  @p phase must be a
+     * string literal.
+     */
+    static void mark(const char* phase);
+
+    /**
+     * Ends the trace and prints the summary if the trace is enabled.
+     * Marks after this are ignored.
+     */
+    static void finish();
+};
+}
+
+#endif // STARTUPTRACE_H
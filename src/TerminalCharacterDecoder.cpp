@@ -32,6 +32,40 @@
 #include "ColorScheme.h"
 
 using namespace Konsole;
+
+TerminalCharacterDecoder::TerminalCharacterDecoder()
+    : _extendedCharTable(&ExtendedCharTable::instance)
+    , _rgbColors(0)
+{
+}
+
+void TerminalCharacterDecoder::setExtendedCharTable(const ExtendedCharTable* table)
+{
+    _extendedCharTable = table;
+}
+
+const ExtendedCharTable* TerminalCharacterDecoder::extendedCharTable() const
+{
+    return _extendedCharTable;
+}
+
+void TerminalCharacterDecoder::setRgbColors(const QVector<QRgb>* colors)
+{
+    _rgbColors = colors;
+}
+
+const QVector<QRgb>* TerminalCharacterDecoder::rgbColors() const
+{
+    return _rgbColors;
+}
+
+QColor TerminalCharacterDecoder::color(const CharacterColor& characterColor, const ColorEntry* palette) const
+{
+    if (_rgbColors && characterColor.isRgb())
+        return QColor(_rgbColors->at(characterColor.rgbIndex()));
+
+    return characterColor.color(palette);
+}
 PlainTextDecoder::PlainTextDecoder()
     : _output(0)
     , _includeTrailingWhitespace(true)
@@ -65,29 +99,17 @@ QList<int> PlainTextDecoder::linePositions() const
 {
     return _linePositions;
 }
-void PlainTextDecoder::decodeLine(const Character* const characters, int count, LineProperty /*properties*/
-                                 )
-{
-    Q_ASSERT(_output);
-
-    if (_recordLinePositions && _output->string()) {
-        int pos = _output->string()->count();
-        _linePositions << pos;
-    }
-
-    //TODO should we ignore or respect the LINE_WRAPPED line property?
-
-    //note:  we build up a QString and send it to the text stream rather writing into the text
-    //stream a character at a time because it is more efficient.
-    //(since QTextStream always deals with QStrings internally anyway)
-    QString plainText;
-    plainText.reserve(count);
 
+// returns the number of characters at the start of a line which are part of
+// its plain text, which leaves out the trailing whitespace if
+// 'includeTrailingWhitespace' is false
+static int plainTextLength(const Character* const characters, int count, bool includeTrailingWhitespace)
+{
     int outputCount = count;
 
     // if inclusion of trailing whitespace is disabled then find the end of the
     // line
-    if (!_includeTrailingWhitespace) {
+    if (!includeTrailingWhitespace) {
         for (int i = count - 1 ; i >= 0 ; i--) {
             if (!characters[i].isSpace())
                 break;
@@ -96,6 +118,34 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
         }
     }
 
+    return outputCount;
+}
+
+namespace
+{
+// appends text to a QString
+class QStringAppender
+{
+public:
+    explicit QStringAppender(QString& text) : _text(text) {}
+    void operator()(const ushort* chars, int length) const {
+        if (length == 1)
+            _text.append(QChar(chars[0]));
+        else
+            _text.append(QString::fromRawData(reinterpret_cast<const QChar*>(chars), length));
+    }
+private:
+    QString& _text;
+};
+}
+
+// passes the plain text of the first 'outputCount' of the 'count' characters
+// of a line to 'append', a function object which takes UTF-16 text and its
+// length.  Extended characters are looked up in 'table'
+template <typename Appender>
+static void decodePlainText(const Character* const characters, int count, int outputCount,
+                            const ExtendedCharTable& table, const Appender& append)
+{
     // find out the last technically real character in the line
     int realCharacterGuard = -1;
     for (int i = count - 1 ; i >= 0 ; i--) {
@@ -111,11 +161,10 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
     for (int i = 0; i < outputCount;) {
         if (characters[i].rendition & RE_EXTENDED_CHAR) {
             ushort extendedCharLength = 0;
-            const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
+            const ushort* chars = table.lookupExtendedChar(characters[i].character, extendedCharLength);
             if (chars) {
-                const QString s = QString::fromUtf16(chars, extendedCharLength);
-                plainText.append(s);
-                i += qMax(1, string_width(s));
+                append(chars, extendedCharLength);
+                i += qMax(1, string_width(QString::fromUtf16(chars, extendedCharLength)));
             }
         } else {
             // All characters which appear before the last real character are
@@ -125,20 +174,164 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
             // This feels tricky, but otherwise leading "whitespaces" may be
             // lost in some situation. One typical example is copying the result
             // of `dialog --infobox "qwe" 10 10` .
-            if (characters[i].isRealCharacter || i <= realCharacterGuard) {
-                plainText.append(QChar(characters[i].character));
-                i += qMax(1, konsole_wcwidth(characters[i].character));
+            if (characters[i].plane != 0) {
+                const uint codePoint = characters[i].codePoint();
+                const ushort surrogates[2] = { QChar::highSurrogate(codePoint), QChar::lowSurrogate(codePoint) };
+                append(surrogates, 2);
+                i += qMax(1, konsole_wcwidth_ucs4(codePoint));
+            } else if (characters[i].isRealCharacter || i <= realCharacterGuard) {
+                const ushort character = characters[i].character;
+                append(&character, 1);
+                i += qMax(1, konsole_wcwidth(character));
             } else {
                 ++i;  // should we 'break' directly here?
             }
         }
     }
+}
+
+void PlainTextDecoder::decodeLine(const Character* const characters, int count, LineProperty /*properties*/
+                                 )
+{
+    Q_ASSERT(_output);
+
+    if (_recordLinePositions && _output->string()) {
+        int pos = _output->string()->count();
+        _linePositions << pos;
+    }
+
+    //TODO should we ignore or respect the LINE_WRAPPED line property?
+
+    //note:  we build up a QString and send it to the text stream rather writing into the text
+    //stream a character at a time because it is more efficient.
+    //(since QTextStream always deals with QStrings internally anyway)
+    QString plainText;
+    plainText.reserve(count);
+
+    const int outputCount = plainTextLength(characters, count, _includeTrailingWhitespace);
+
+    decodePlainText(characters, count, outputCount, *_extendedCharTable, QStringAppender(plainText));
+
     *_output << plainText;
 }
 
+Utf8PlainTextDecoder::Utf8PlainTextDecoder()
+    : _output(0)
+    , _outputSize(0)
+    , _stream(0)
+    , _includeTrailingWhitespace(true)
+    , _recordLinePositions(false)
+{
+}
+void Utf8PlainTextDecoder::setTrailingWhitespace(bool enable)
+{
+    _includeTrailingWhitespace = enable;
+}
+bool Utf8PlainTextDecoder::trailingWhitespace() const
+{
+    return _includeTrailingWhitespace;
+}
+void Utf8PlainTextDecoder::setRecordLinePositions(bool record)
+{
+    _recordLinePositions = record;
+}
+const QVector<int>& Utf8PlainTextDecoder::linePositions() const
+{
+    return _linePositions;
+}
+void Utf8PlainTextDecoder::begin(QByteArray* output)
+{
+    _output = output;
+    _outputSize = output->size();
+    _stream = 0;
+
+    // resize() rather than clear() keeps the memory of the previous lines
+    _linePositions.resize(0);
+}
+void Utf8PlainTextDecoder::begin(QTextStream* output)
+{
+    _streamBuffer.resize(0);
+    begin(&_streamBuffer);
+    _stream = output;
+}
+void Utf8PlainTextDecoder::end()
+{
+    Q_ASSERT(_output);
+
+    _output->resize(_outputSize);
+
+    if (_stream)
+        *_stream << QString::fromUtf8(_streamBuffer.constData(), _streamBuffer.size());
+
+    _output = 0;
+    _stream = 0;
+}
+void Utf8PlainTextDecoder::appendText(const ushort* chars, int length)
+{
+    // each UTF-16 code unit takes up to three bytes, the output grows in
+    // large steps so that this does not resize it each time
+    if (_outputSize + 3 * length > _output->size())
+        _output->resize(qMax(2 * _output->size(), _outputSize + 3 * length + 1024));
+
+    uchar* out = reinterpret_cast<uchar*>(_output->data()) + _outputSize;
+    for (int i = 0; i < length; i++) {
+        uint c = chars[i];
+        if (c < 0x80) {
+            *out++ = c;
+        } else if (c < 0x800) {
+            *out++ = 0xc0 | (c >> 6);
+            *out++ = 0x80 | (c & 0x3f);
+        } else if ((c & 0xf800) != 0xd800) {
+            *out++ = 0xe0 | (c >> 12);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        } else if ((c & 0xfc00) == 0xd800 && i + 1 < length && (chars[i + 1] & 0xfc00) == 0xdc00) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (chars[++i] - 0xdc00);
+            *out++ = 0xf0 | (c >> 18);
+            *out++ = 0x80 | ((c >> 12) & 0x3f);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        } else {
+            // a lone surrogate becomes U+FFFD REPLACEMENT CHARACTER
+            *out++ = 0xef;
+            *out++ = 0xbf;
+            *out++ = 0xbd;
+        }
+    }
+    _outputSize = out - reinterpret_cast<uchar*>(_output->data());
+}
+
+namespace
+{
+// appends text to a Utf8PlainTextDecoder's output
+class Utf8Appender
+{
+public:
+    explicit Utf8Appender(Utf8PlainTextDecoder* decoder) : _decoder(decoder) {}
+    void operator()(const ushort* chars, int length) const {
+        _decoder->appendText(chars, length);
+    }
+private:
+    Utf8PlainTextDecoder* _decoder;
+};
+}
+
+void Utf8PlainTextDecoder::decodeLine(const Character* const characters, int count, LineProperty /*properties*/)
+{
+    Q_ASSERT(_output);
+
+    if (_recordLinePositions)
+        _linePositions << _outputSize;
+
+    decodePlainText(characters, count, plainTextLength(characters, count, _includeTrailingWhitespace),
+                    *_extendedCharTable, Utf8Appender(this));
+}
+
 HTMLDecoder::HTMLDecoder() :
     _output(0)
     , _colorTable(ColorScheme::defaultTable)
+    , _useStyleSheet(false)
+    , _styleSheetWritten(false)
     , _innerSpanOpen(false)
     , _lastRendition(DEFAULT_RENDITION)
 {
@@ -150,12 +343,40 @@ void HTMLDecoder::begin(QTextStream* output)
 
     QString text;
 
+    if (_useStyleSheet && !_styleSheetWritten) {
+        writeStyleSheet(text);
+        _styleSheetWritten = true;
+    }
+
     //open monospace span
     openSpan(text, "font-family:monospace");
 
     *output << text;
 }
 
+void HTMLDecoder::setUseStyleSheet(bool use)
+{
+    _useStyleSheet = use;
+}
+
+void HTMLDecoder::writeStyleSheet(QString& text)
+{
+    // foreground colors are classes 'f' and background colors classes 'b'
+    // followed by their index in the palette
+    text.append("<style type=\"text/css\">");
+    text.append(".B{font-weight:bold}.U{text-decoration:underline}");
+    if (_colorTable) {
+        for (int i = 0; i < PALETTE_COLORS; i++) {
+            const QColor color = (i < TABLE_COLORS) ?
+                                 _colorTable[i].color :
+                                 CharacterColor(COLOR_SPACE_256, i - TABLE_COLORS).color(_colorTable);
+            const QString name = color.name();
+            text.append(QString(".f%1{color:%2}.b%1{background-color:%2}").arg(i).arg(name));
+        }
+    }
+    text.append("</style>");
+}
+
 void HTMLDecoder::end()
 {
     Q_ASSERT(_output);
@@ -176,12 +397,22 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
     Q_ASSERT(_output);
 
     QString text;
+    text.reserve(count * 2);
 
     int spaceCount = 0;
 
-    for (int i = 0; i < count; i++) {
-        //check if appearance of character is different from previous char
-        if (characters[i].rendition != _lastRendition  ||
+    int i = 0;
+    while (i < count) {
+        // lines usually consist of only a few runs of characters with the
+        // same appearance, find the end of the current one so that the
+        // format is only checked once per run
+        int runEnd = i + 1;
+        while (runEnd < count && characters[runEnd].equalsFormat(characters[i]))
+            runEnd++;
+
+        //check if appearance of the run is different from the previous one
+        if (!_innerSpanOpen ||
+                characters[i].rendition != _lastRendition  ||
                 characters[i].foregroundColor != _lastForeColor  ||
                 characters[i].backgroundColor != _lastBackColor) {
             if (_innerSpanOpen)
@@ -191,9 +422,6 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
             _lastForeColor = characters[i].foregroundColor;
             _lastBackColor = characters[i].backgroundColor;
 
-            //build up style string
-            QString style;
-
             bool useBold;
             ColorEntry::FontWeight weight = characters[i].fontWeight(_colorTable);
             if (weight == ColorEntry::UseCurrentFormat)
@@ -201,56 +429,102 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
             else
                 useBold = weight == ColorEntry::Bold;
 
-            if (useBold)
-                style.append("font-weight:bold;");
+            if (_useStyleSheet) {
+                // the classes of the style sheet cover the colors of the
+                // palette, other colors still need a style
+                QString classes;
+                QString style;
+
+                if (useBold)
+                    classes.append("B ");
+                if (_lastRendition & RE_UNDERLINE)
+                    classes.append("U ");
+
+                if (_colorTable) {
+                    const int foreIndex = _lastForeColor.paletteIndex();
+                    if (foreIndex >= 0)
+                        classes.append(QString("f%1 ").arg(foreIndex));
+                    else
+                        style.append(QString("color:%1;").arg(color(_lastForeColor, _colorTable).name()));
+
+                    const int backIndex = _lastBackColor.paletteIndex();
+                    if (backIndex >= 0)
+                        classes.append(QString("b%1").arg(backIndex));
+                    else
+                        style.append(QString("background-color:%1;").arg(color(_lastBackColor, _colorTable).name()));
+                }
 
-            if (_lastRendition & RE_UNDERLINE)
-                style.append("font-decoration:underline;");
+                openClassSpan(text, classes.trimmed(), style);
+            } else {
+                //build up style string
+                QString style;
 
-            //colors - a color table must have been defined first
-            if (_colorTable) {
-                style.append(QString("color:%1;").arg(_lastForeColor.color(_colorTable).name()));
+                if (useBold)
+                    style.append("font-weight:bold;");
 
-                style.append(QString("background-color:%1;").arg(_lastBackColor.color(_colorTable).name()));
-            }
+                if (_lastRendition & RE_UNDERLINE)
+                    style.append("font-decoration:underline;");
 
-            //open the span with the current style
-            openSpan(text, style);
+                //colors - a color table must have been defined first
+                if (_colorTable) {
+                    style.append(QString("color:%1;").arg(color(_lastForeColor, _colorTable).name()));
+
+                    style.append(QString("background-color:%1;").arg(color(_lastBackColor, _colorTable).name()));
+                }
+
+                //open the span with the current style
+                openSpan(text, style);
+            }
             _innerSpanOpen = true;
         }
 
-        //handle whitespace
-        if (characters[i].isSpace())
-            spaceCount++;
-        else
-            spaceCount = 0;
-
-        //output current character
-        if (spaceCount < 2) {
-            if (characters[i].rendition & RE_EXTENDED_CHAR) {
-                ushort extendedCharLength = 0;
-                const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
-                if (chars) {
-                    text.append(QString::fromUtf16(chars, extendedCharLength));
+        for (; i < runEnd; i++) {
+            //handle whitespace
+            if (characters[i].isSpace())
+                spaceCount++;
+            else
+                spaceCount = 0;
+
+            //output current character
+            if (spaceCount < 2) {
+                if (characters[i].rendition & RE_EXTENDED_CHAR) {
+                    ushort extendedCharLength = 0;
+                    const ushort* chars = _extendedCharTable->lookupExtendedChar(characters[i].character, extendedCharLength);
+                    if (chars) {
+                        text.append(QString::fromUtf16(chars, extendedCharLength));
+                    }
+                } else if (characters[i].plane != 0) {
+                    const uint codePoint = characters[i].codePoint();
+                    text.append(QChar(QChar::highSurrogate(codePoint)));
+                    text.append(QChar(QChar::lowSurrogate(codePoint)));
+                } else {
+                    //escape HTML special characters and just display others as they are
+                    const ushort ch = characters[i].character;
+                    switch (ch) {
+                    case '<':
+                        text.append("&lt;");
+                        break;
+                    case '>':
+                        text.append("&gt;");
+                        break;
+                    case '&':
+                        text.append("&amp;");
+                        break;
+                    default:
+                        text.append(QChar(ch));
+                    }
                 }
             } else {
-                //escape HTML tag characters and just display others as they are
-                const QChar ch = characters[i].character;
-                if (ch == '<')
-                    text.append("&lt;");
-                else if (ch == '>')
-                    text.append("&gt;");
-                else
-                    text.append(ch);
+                text.append("&nbsp;"); //HTML truncates multiple spaces, so use a space marker instead
             }
-        } else {
-            text.append("&nbsp;"); //HTML truncates multiple spaces, so use a space marker instead
         }
     }
 
-    //close any remaining open inner spans
-    if (_innerSpanOpen)
+    //close any remaining open inner spans, the next line opens its own
+    if (_innerSpanOpen) {
         closeSpan(text);
+        _innerSpanOpen = false;
+    }
 
     //start new line
     text.append("<br>");
@@ -262,6 +536,17 @@ void HTMLDecoder::openSpan(QString& text , const QString& style)
     text.append(QString("<span style=\"%1\">").arg(style));
 }
 
+void HTMLDecoder::openClassSpan(QString& text , const QString& classes , const QString& style)
+{
+    text.append("<span class=\"");
+    text.append(classes);
+    if (!style.isEmpty()) {
+        text.append("\" style=\"");
+        text.append(style);
+    }
+    text.append("\">");
+}
+
 void HTMLDecoder::closeSpan(QString& text)
 {
     text.append("</span>");
@@ -23,7 +23,9 @@
 #define TERMINAL_CHARACTER_DECODER_H
 
 // Qt
+#include <QtCore/QByteArray>
 #include <QtCore/QList>
+#include <QtCore/QVector>
 
 // Konsole
 #include "Character.h"
@@ -33,6 +35,8 @@ class QTextStream;
 
 namespace Konsole
 {
+class ExtendedCharTable;
+
 /**
  * Base class for terminal character decoders
  *
@@ -45,8 +49,29 @@ namespace Konsole
 class KONSOLEPRIVATE_EXPORT TerminalCharacterDecoder
 {
 public:
+    TerminalCharacterDecoder();
     virtual ~TerminalCharacterDecoder() {}
 
+    /**
+     * Sets the table in which the sequences of extended characters are looked
+     * up.  Defaults to ExtendedCharTable::instance, which may only be used on
+     * the GUI thread.  Decoders on other threads use a copy of it, see
+     * ScreenSnapshot.
+     */
+    void setExtendedCharTable(const ExtendedCharTable* table);
+    /** Returns the table set with setExtendedCharTable() */
+    const ExtendedCharTable* extendedCharTable() const;
+
+    /**
+     * Sets the table in which RGB colors are looked up, indexed as
+     * rgbColorValue().  Defaults to 0, which uses the table of RGB colors
+     * itself and may only be done on the GUI thread.  Decoders on other
+     * threads use a copy of it, see ScreenSnapshot.
+     */
+    void setRgbColors(const QVector<QRgb>* colors);
+    /** Returns the table set with setRgbColors() */
+    const QVector<QRgb>* rgbColors() const;
+
     /** Begin decoding characters.  The resulting text is appended to @p output. */
     virtual void begin(QTextStream* output) = 0;
     /** End decoding. */
@@ -63,6 +88,16 @@ public:
     virtual void decodeLine(const Character* const characters,
                             int count,
                             LineProperty properties) = 0;
+
+protected:
+    /**
+     * Returns the color of @p characterColor within @p palette, looking RGB colors
+     * up in the table set with setRgbColors()
+     */
+    QColor color(const CharacterColor& characterColor, const ColorEntry* palette) const;
+
+    const ExtendedCharTable* _extendedCharTable;
+    const QVector<QRgb>* _rgbColors;
 };
 
 /**
@@ -109,6 +144,66 @@ private:
     QList<int> _linePositions;
 };
 
+/**
+ * A terminal character decoder which produces the same plain text as PlainTextDecoder,
+ * encoded as UTF-8.  The text is appended straight to a byte array, without going
+ * through a QString and QTextStream, which makes it faster for output which is written
+ * to a file or sent elsewhere anyway.
+ */
+class KONSOLEPRIVATE_EXPORT Utf8PlainTextDecoder : public TerminalCharacterDecoder
+{
+public:
+    Utf8PlainTextDecoder();
+
+    /**
+     * Set whether trailing whitespace at the end of lines should be included
+     * in the output.
+     * Defaults to true.
+     */
+    void setTrailingWhitespace(bool enable);
+    /**
+     * Returns whether trailing whitespace at the end of lines is included
+     * in the output.
+     */
+    bool trailingWhitespace() const;
+    /**
+     * Returns the byte offsets in the output at which each line decoded since
+     * begin() starts.  Returns an empty vector if setRecordLinePositions() is false.
+     */
+    const QVector<int>& linePositions() const;
+    /** Enables recording of the offsets at which lines start.  See linePositions() */
+    void setRecordLinePositions(bool record);
+
+    /**
+     * Begin decoding characters.  The resulting text is appended to @p output,
+     * whose size is only updated when end() is called.
+     */
+    void begin(QByteArray* output);
+    /**
+     * Begin decoding characters.  The resulting text is written to @p output
+     * when end() is called.
+     */
+    virtual void begin(QTextStream* output);
+    virtual void end();
+
+    virtual void decodeLine(const Character* const characters,
+                            int count,
+                            LineProperty properties);
+
+    // appends the UTF-16 text 'chars' of 'length' code units to the output
+    void appendText(const ushort* chars, int length);
+
+private:
+    QByteArray* _output;
+    int _outputSize; // the size of the output written so far
+    QTextStream* _stream;
+    QByteArray _streamBuffer; // the output when writing to a text stream
+    bool _includeTrailingWhitespace;
+
+    bool _recordLinePositions;
+    QVector<int> _linePositions;
+};
+
 /**
  * A terminal character decoder which produces pretty HTML markup
  */
@@ -126,6 +221,14 @@ public:
      */
     void setColorTable(const ColorEntry* table);
 
+    /**
+     * Sets whether the appearance of the text is given by the classes of a
+     * style sheet rather than by the style of each span.  The style sheet covers
+     * every color of the palette and is written once, by the first call to begin().
+     * This makes the output several times smaller.  Defaults to false.
+     */
+    void setUseStyleSheet(bool use);
+
     virtual void decodeLine(const Character* const characters,
                             int count,
                             LineProperty properties);
@@ -135,10 +238,14 @@ public:
 
 private:
     void openSpan(QString& text , const QString& style);
+    void openClassSpan(QString& text , const QString& classes , const QString& style);
     void closeSpan(QString& text);
+    void writeStyleSheet(QString& text);
 
     QTextStream* _output;
     const ColorEntry* _colorTable;
+    bool _useStyleSheet;
+    bool _styleSheetWritten;
     bool _innerSpanOpen;
     quint8 _lastRendition;
     CharacterColor _lastForeColor;
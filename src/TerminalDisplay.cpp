@@ -32,6 +32,10 @@
 #include <QtGui/QKeyEvent>
 #include <QtCore/QEvent>
 #include <QtCore/QFileInfo>
+#include <QtCore/QMimeData>
+#include <QtCore/QPointer>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QtConcurrentRun>
 #include <QGridLayout>
 #include <QAction>
 #include <QLabel>
@@ -39,7 +43,10 @@
 #include <QtGui/QPixmap>
 #include <QScrollBar>
 #include <QStyle>
+#include <QStyleOptionSlider>
+#include <QtCore/QTextStream>
 #include <QtCore/QTimer>
+#include <QtCore/QVarLengthArray>
 #include <QToolTip>
 #include <QtGui/QAccessible>
 
@@ -60,17 +67,23 @@
 #include <KMessageBox>
 
 // Konsole
+#include "ColorPalette.h"
 #include "Filter.h"
+#include "FontResource.h"
+#include "LineCache.h"
 #include "konsole_wcwidth.h"
 #include "TerminalCharacterDecoder.h"
 #include "Screen.h"
 #include "ScreenWindow.h"
+#include "ScreenSnapshot.h"
 #include "LineFont.h"
 #include "SessionController.h"
 #include "ExtendedCharTable.h"
 #include "TerminalDisplayAccessible.h"
 #include "SessionManager.h"
 #include "Session.h"
+#include "StartupTrace.h"
+#include "PerformanceClock.h"
 
 using namespace Konsole;
 
@@ -78,10 +91,6 @@ using namespace Konsole;
 #define loc(X,Y) ((Y)*_columns+(X))
 #endif
 
-#define REPCHAR   "ABCDEFGHIJKLMNOPQRSTUVWXYZ" \
-    "abcdefgjijklmnopqrstuvwxyz" \
-    "0123456789./+@"
-
 // we use this to force QPainter to display text in LTR mode
 // more information can be found in: http://unicode.org/reports/tr9/
 const QChar LTR_OVERRIDE_CHAR(0x202D);
@@ -112,6 +121,7 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
     }
 
     _screenWindow = window;
+    _imageInSync = false;
 
     if (_screenWindow) {
         connect(_screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateLineProperties()));
@@ -122,20 +132,14 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
 
 const ColorEntry* TerminalDisplay::colorTable() const
 {
-    return _colorTable;
+    return _colorPalette->colorTable();
 }
 void TerminalDisplay::setBackgroundColor(const QColor& color)
 {
-    _colorTable[DEFAULT_BACK_COLOR].color = color;
-
-    QPalette p = palette();
-    p.setColor(backgroundRole(), color);
-    setPalette(p);
-
-    // Avoid propagating the palette change to the scroll bar
-    _scrollBar->setPalette(QApplication::palette());
-
-    update();
+    ColorEntry table[TABLE_COLORS];
+    qCopy(colorTable(), colorTable() + TABLE_COLORS, table);
+    table[DEFAULT_BACK_COLOR].color = color;
+    setColorTable(table);
 }
 QColor TerminalDisplay::getBackgroundColor() const
 {
@@ -144,16 +148,37 @@ QColor TerminalDisplay::getBackgroundColor() const
 }
 void TerminalDisplay::setForegroundColor(const QColor& color)
 {
-    _colorTable[DEFAULT_FORE_COLOR].color = color;
-
-    update();
+    ColorEntry table[TABLE_COLORS];
+    qCopy(colorTable(), colorTable() + TABLE_COLORS, table);
+    table[DEFAULT_FORE_COLOR].color = color;
+    setColors(table);
 }
 void TerminalDisplay::setColorTable(const ColorEntry table[])
 {
-    for (int i = 0; i < TABLE_COLORS; i++)
-        _colorTable[i] = table[i];
+    setColors(table);
+
+    QPalette p = palette();
+    p.setColor(backgroundRole(), table[DEFAULT_BACK_COLOR].color);
+    setPalette(p);
+
+    // Avoid propagating the palette change to the scroll bar
+    _scrollBar->setPalette(QApplication::palette());
+}
+void TerminalDisplay::setColors(const ColorEntry* table)
+{
+    // the displays with the same colors share the resolved palette, so it
+    // is only computed once
+    ColorPalette* oldPalette = _colorPalette;
+    _colorPalette = ColorPalette::acquire(table);
+    ColorPalette::release(oldPalette);
+
+    if (_colorPalette == oldPalette)
+        return;
 
-    setBackgroundColor(_colorTable[DEFAULT_BACK_COLOR].color);
+    releaseLineCache();
+    _fragmentStyles.clear();
+    update();
+    _textLayerDirty = rect();
 }
 
 /* ------------------------------------------------------------------------- */
@@ -172,33 +197,25 @@ static inline bool isLineCharString(const QString& string)
 
 void TerminalDisplay::fontChange(const QFont&)
 {
-    QFontMetrics fm(font());
-    _fontHeight = fm.height() + _lineSpacing;
-
-    // waba TerminalDisplay 1.123:
-    // "Base character width on widest ASCII character. This prevents too wide
-    //  characters in the presence of double wide (e.g. Japanese) characters."
-    // Get the width from representative normal width characters
-    _fontWidth = qRound((static_cast<double>(fm.width(REPCHAR)) / static_cast<double>(qstrlen(REPCHAR))));
-
-    _fixedFont = true;
+    // the metrics and glyphs are shared with the other displays using the
+    // same font
+    FontResource* oldResource = _fontResource;
+    _fontResource = FontResource::acquire(font(), _lineSpacing);
+    FontResource::release(oldResource);
 
-    const int fw = fm.width(REPCHAR[0]);
-    for (unsigned int i = 1; i < qstrlen(REPCHAR); i++) {
-        if (fw != fm.width(REPCHAR[i])) {
-            _fixedFont = false;
-            break;
-        }
-    }
+    _fontHeight = _fontResource->fontHeight();
+    _fontWidth = _fontResource->fontWidth();
+    _fontAscent = _fontResource->fontAscent();
+    _fixedFont = _fontResource->isFixedFont();
 
-    if (_fontWidth < 1)
-        _fontWidth = 1;
-
-    _fontAscent = fm.ascent();
+    // the cached lines were rendered with the previous font
+    releaseLineCache();
+    _fragmentStyles.clear();
 
     emit changedFontMetricSignal(_fontHeight, _fontWidth);
     propagateSize();
     update();
+    _textLayerDirty = rect();
 }
 
 void TerminalDisplay::setVTFont(const QFont& f)
@@ -214,7 +231,7 @@ void TerminalDisplay::setVTFont(const QFont& f)
     if (metrics.height() < height() && metrics.maxWidth() < width()) {
         // hint that text should be drawn without anti-aliasing.
         // depending on the user's font configuration, this may not be respected
-        if (!_antialiasText)
+        if (!_antialiasText || _lowBandwidthRendering)
             font.setStyleStrategy(QFont::NoAntialias);
 
         // experimental optimization.  Konsole assumes that the terminal is using a
@@ -225,6 +242,10 @@ void TerminalDisplay::setVTFont(const QFont& f)
         // Konsole cannot handle non-integer font metrics
         font.setStyleStrategy(QFont::StyleStrategy(font.styleStrategy() | QFont::ForceIntegerMetrics));
 
+        // applying a profile sets the font again even if it has not changed
+        if (font == QWidget::font())
+            return;
+
         QWidget::setFont(font);
         fontChange(font);
     }
@@ -258,8 +279,11 @@ uint TerminalDisplay::lineSpacing() const
 
 void TerminalDisplay::setLineSpacing(uint i)
 {
+    if (i == _lineSpacing)
+        return;
+
     _lineSpacing = i;
-    setVTFont(font()); // Trigger an update.
+    fontChange(font()); // Trigger an update.
 }
 
 
@@ -306,10 +330,24 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _contentHeight(1)
     , _contentWidth(1)
     , _image(0)
+    , _imageInSync(false)
+    , _extendedCharsGeneration(ExtendedCharTable::instance.generation())
+    , _rgbColorsGeneration(rgbColorGeneration())
+    , _colorPalette(0)
     , _randomSeed(0)
     , _resizing(false)
+    , _hidden(true)
+    , _keyEchoUpdated(false)
+    , _accessibleTextChanged(false)
+    , _hotSpotCell(-1, -1)
+    , _mouseMoveButtons(Qt::NoButton)
+    , _mouseMoveModifiers(Qt::NoModifier)
+    , _wheelKeyDelta(0)
+    , _lastMouseReport(-1, -1)
+    , _lastMouseReportButton(-1)
     , _showTerminalSizeHint(true)
     , _bidiEnabled(false)
+    , _bracketedPasteMode(false)
     , _actSel(0)
     , _wordSelectionMode(false)
     , _lineSelectionMode(false)
@@ -319,6 +357,7 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _middleClickPasteMode(Enum::PasteFromX11Selection)
     , _scrollbarLocation(Enum::ScrollBarRight)
     , _scrollFullPage(false)
+    , _searchMatchMarkers(0)
     , _wordCharacters(":@-./_~")
     , _bellMode(Enum::NotifyBell)
     , _allowBlinkingText(true)
@@ -336,12 +375,22 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _resizeTimer(0)
     , _flowControlWarningEnabled(false)
     , _outputSuspendedLabel(0)
+    , _floodModeLabel(0)
+    , _inputProgressLabel(0)
+    , _statisticsLabel(0)
     , _lineSpacing(0)
     , _blendColor(qRgba(0, 0, 0, 0xff))
+    , _opacity(1.0)
+    , _lowBandwidthRendering(false)
+    , _lowBandwidthUpdateTimer(0)
     , _filterChain(new TerminalImageFilterChain())
+    , _filterSearchWatcher(0)
+    , _filterGeneration(0)
+    , _filterSearchGeneration(0)
     , _cursorShape(Enum::BlockCursor)
     , _antialiasText(true)
-    , _printerFriendly(false)
+    , _lineCache(0)
+    , _renderingCachedLine(false)
     , _sessionController(0)
     , _trimTrailingSpaces(false)
 {
@@ -352,6 +401,9 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     _topMargin = DEFAULT_TOP_MARGIN;
     _leftMargin = DEFAULT_LEFT_MARGIN;
 
+    _fontResource = FontResource::acquire(font(), _lineSpacing);
+    _wordCharacterTable = wordCharacterTable(_wordCharacters);
+
     // create scroll bar for scrolling output up and down
     _scrollBar = new QScrollBar(this);
     // set the scroll bar's slider to occupy the whole area of the scroll bar initially
@@ -370,6 +422,41 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     _blinkCursorTimer->setInterval(QApplication::cursorFlashTime() / 2);
     connect(_blinkCursorTimer, SIGNAL(timeout()), this, SLOT(blinkCursorEvent()));
 
+    _accessibilityTimer = new QTimer(this);
+    _accessibilityTimer->setSingleShot(true);
+    connect(_accessibilityTimer, SIGNAL(timeout()), this, SLOT(notifyAccessibility()));
+
+    _mouseMoveTimer = new QTimer(this);
+    _mouseMoveTimer->setSingleShot(true);
+    connect(_mouseMoveTimer, SIGNAL(timeout()), this, SLOT(processMouseMove()));
+
+    _wheelKeyTimer = new QTimer(this);
+    _wheelKeyTimer->setSingleShot(true);
+    _wheelKeyTimer->setInterval(WHEEL_KEY_INTERVAL);
+    connect(_wheelKeyTimer, SIGNAL(timeout()), this, SLOT(sendWheelKeys()));
+
+    _releaseTimer = new QTimer(this);
+    _releaseTimer->setSingleShot(true);
+    _releaseTimer->setInterval(HIDDEN_RELEASE_DELAY);
+    connect(_releaseTimer, SIGNAL(timeout()), this, SLOT(releaseHiddenResources()));
+
+    _lowBandwidthUpdateTimer = new QTimer(this);
+    _lowBandwidthUpdateTimer->setSingleShot(true);
+    connect(_lowBandwidthUpdateTimer, SIGNAL(timeout()), this, SLOT(updateImage()));
+
+    _filterSearchWatcher = new QFutureWatcher<QList<RegExpFilter::Search> >(this);
+    connect(_filterSearchWatcher, SIGNAL(finished()), this, SLOT(filterSearchesFinished()));
+
+    _paintStatistics.updateCount = 0;
+    _paintStatistics.skippedUpdates = 0;
+    _paintStatistics.updateTime = 0;
+    _paintStatistics.paintCount = 0;
+    _paintStatistics.paintTime = 0;
+    _paintStatistics.filterTime = 0;
+    _paintStatistics.keyEchoCount = 0;
+    _paintStatistics.keyEchoTime = 0;
+    _paintStatistics.maximumKeyEchoTime = 0;
+
     // hide mouse cursor on keystroke or idle
     KCursor::setAutoHideCursor(this, true);
     setMouseTracking(true);
@@ -411,6 +498,10 @@ TerminalDisplay::~TerminalDisplay()
 
     delete[] _image;
 
+    LineCache::release(_lineCache);
+    FontResource::release(_fontResource);
+    ColorPalette::release(_colorPalette);
+
     delete _gridLayout;
     delete _outputSuspendedLabel;
     delete _filterChain;
@@ -438,35 +529,13 @@ TerminalDisplay::~TerminalDisplay()
 where _ = none
       | = vertical line.
       - = horizontal line.
+
+ fontembedder also splits each glyph into the lines it is drawn with, see
+ LineCharSegments, so that drawLineChar() only has to scale them to the cell.
  */
 
-enum LineEncode {
-    TopL  = (1 << 1),
-    TopC  = (1 << 2),
-    TopR  = (1 << 3),
-
-    LeftT = (1 << 5),
-    Int11 = (1 << 6),
-    Int12 = (1 << 7),
-    Int13 = (1 << 8),
-    RightT = (1 << 9),
-
-    LeftC = (1 << 10),
-    Int21 = (1 << 11),
-    Int22 = (1 << 12),
-    Int23 = (1 << 13),
-    RightC = (1 << 14),
-
-    LeftB = (1 << 15),
-    Int31 = (1 << 16),
-    Int32 = (1 << 17),
-    Int33 = (1 << 18),
-    RightB = (1 << 19),
-
-    BotL  = (1 << 21),
-    BotC  = (1 << 22),
-    BotR  = (1 << 23)
-};
+// room for the lines of any glyph in LineCharSegments, none has more than 8
+static const int MAX_LINE_CHAR_SEGMENTS = 16;
 
 static void drawLineChar(QPainter& paint, int x, int y, int w, int h, uchar code)
 {
@@ -476,61 +545,35 @@ static void drawLineChar(QPainter& paint, int x, int y, int w, int h, uchar code
     const int ex = x + w - 1;
     const int ey = y + h - 1;
 
-    const quint32 toDraw = LineChars[code];
-
-    //Top _lines:
-    if (toDraw & TopL)
-        paint.drawLine(cx - 1, y, cx - 1, cy - 2);
-    if (toDraw & TopC)
-        paint.drawLine(cx, y, cx, cy - 2);
-    if (toDraw & TopR)
-        paint.drawLine(cx + 1, y, cx + 1, cy - 2);
-
-    //Bot _lines:
-    if (toDraw & BotL)
-        paint.drawLine(cx - 1, cy + 2, cx - 1, ey);
-    if (toDraw & BotC)
-        paint.drawLine(cx, cy + 2, cx, ey);
-    if (toDraw & BotR)
-        paint.drawLine(cx + 1, cy + 2, cx + 1, ey);
-
-    //Left _lines:
-    if (toDraw & LeftT)
-        paint.drawLine(x, cy - 1, cx - 2, cy - 1);
-    if (toDraw & LeftC)
-        paint.drawLine(x, cy, cx - 2, cy);
-    if (toDraw & LeftB)
-        paint.drawLine(x, cy + 1, cx - 2, cy + 1);
-
-    //Right _lines:
-    if (toDraw & RightT)
-        paint.drawLine(cx + 2, cy - 1, ex, cy - 1);
-    if (toDraw & RightC)
-        paint.drawLine(cx + 2, cy, ex, cy);
-    if (toDraw & RightB)
-        paint.drawLine(cx + 2, cy + 1, ex, cy + 1);
-
-    //Intersection points.
-    if (toDraw & Int11)
-        paint.drawPoint(cx - 1, cy - 1);
-    if (toDraw & Int12)
-        paint.drawPoint(cx, cy - 1);
-    if (toDraw & Int13)
-        paint.drawPoint(cx + 1, cy - 1);
-
-    if (toDraw & Int21)
-        paint.drawPoint(cx - 1, cy);
-    if (toDraw & Int22)
-        paint.drawPoint(cx, cy);
-    if (toDraw & Int23)
-        paint.drawPoint(cx + 1, cy);
-
-    if (toDraw & Int31)
-        paint.drawPoint(cx - 1, cy + 1);
-    if (toDraw & Int32)
-        paint.drawPoint(cx, cy + 1);
-    if (toDraw & Int33)
-        paint.drawPoint(cx + 1, cy + 1);
+    //The pixel positions of the grid columns and rows.  The lines along the
+    //edges of the grid end two pixels away from the middle of the cell.
+    const int startX[5] = { x, cx - 1, cx, cx + 1, cx + 2 };
+    const int endX[5] = { cx - 2, cx - 1, cx, cx + 1, ex };
+    const int startY[5] = { y, cy - 1, cy, cy + 1, cy + 2 };
+    const int endY[5] = { cy - 2, cy - 1, cy, cy + 1, ey };
+
+    QLine lines[MAX_LINE_CHAR_SEGMENTS];
+    QPoint points[MAX_LINE_CHAR_SEGMENTS];
+    int lineCount = 0;
+    int pointCount = 0;
+
+    const int first = LineCharSegmentIndex[code];
+    const int last = LineCharSegmentIndex[code + 1];
+    Q_ASSERT(last - first <= MAX_LINE_CHAR_SEGMENTS);
+
+    for (int i = first; i < last; i++) {
+        const uchar* segment = LineCharSegments[i];
+        if (segment[0] == segment[2] && segment[1] == segment[3])
+            points[pointCount++] = QPoint(startX[segment[0]], startY[segment[1]]);
+        else
+            lines[lineCount++] = QLine(startX[segment[0]], startY[segment[1]],
+                                       endX[segment[2]], endY[segment[3]]);
+    }
+
+    if (lineCount > 0)
+        paint.drawLines(lines, lineCount);
+    if (pointCount > 0)
+        paint.drawPoints(points, pointCount);
 }
 
 void TerminalDisplay::drawLineCharString(QPainter& painter, int x, int y, const QString& str,
@@ -544,10 +587,38 @@ void TerminalDisplay::drawLineCharString(QPainter& painter, int x, int y, const
         painter.setPen(boldPen);
     }
 
+    // box-drawing cells are rendered once into the glyph cache and blitted
+    // from there, unless the painter is scaled
+    const bool useCache = painter.worldTransform().type() <= QTransform::TxTranslate;
+    const QPen& pen = painter.pen();
+    const quint32 variant = LINE_CHAR_GLYPH | (pen.width() > 1 ? BOLD_GLYPH : 0);
+    const quint64 colorKey = quint64(pen.color().rgba()) << 32;
+
     for (int i = 0 ; i < str.length(); i++) {
         const uchar code = str[i].cell();
-        if (LineChars[code])
+        if (!LineChars[code])
+            continue;
+
+        if (!useCache) {
             drawLineChar(painter, x + (_fontWidth * i), y, _fontWidth, _fontHeight, code);
+            continue;
+        }
+
+        const FontResource::GlyphKey key(colorKey, (variant << GLYPH_VARIANT_SHIFT) | code);
+        QPixmap* glyph = _fontResource->glyphCache().object(key);
+        if (!glyph) {
+            glyph = new QPixmap(_fontWidth, _fontHeight);
+            glyph->fill(Qt::transparent);
+
+            QPainter glyphPainter(glyph);
+            glyphPainter.setPen(pen);
+            drawLineChar(glyphPainter, 0, 0, _fontWidth, _fontHeight, code);
+            glyphPainter.end();
+
+            _fontResource->glyphCache().insert(key, glyph);
+        }
+
+        painter.drawPixmap(x + (_fontWidth * i), y, *glyph);
     }
 
     painter.setPen(originalPen);
@@ -572,8 +643,12 @@ QColor TerminalDisplay::keyboardCursorColor() const
 
 void TerminalDisplay::setOpacity(qreal opacity)
 {
+    _opacity = opacity;
+
+    // a translucent background has to be blended with what is behind the
+    // window for every update
     QColor color(_blendColor);
-    color.setAlphaF(opacity);
+    color.setAlphaF(_lowBandwidthRendering ? 1.0 : opacity);
 
     // enable automatic background filling to prevent the display
     // flickering if there is no transparency
@@ -591,7 +666,31 @@ void TerminalDisplay::setOpacity(qreal opacity)
 
 void TerminalDisplay::setWallpaper(ColorSchemeWallpaper::Ptr p)
 {
-    _wallpaper = p;
+    _requestedWallpaper = p;
+
+    // the parts of the wallpaper behind the text have to be drawn again
+    // whenever the text changes, and the display cannot be scrolled
+    if (_lowBandwidthRendering && p && !p->isNull())
+        _wallpaper = new ColorSchemeWallpaper(QString());
+    else
+        _wallpaper = p;
+
+    // the text layer is only used to draw the text over the wallpaper
+    _textLayer = QPixmap();
+    _textLayerDirty = QRegion();
+}
+
+void TerminalDisplay::setLowBandwidthRendering(bool enable)
+{
+    if (_lowBandwidthRendering == enable)
+        return;
+
+    _lowBandwidthRendering = enable;
+    releaseLineCache();
+
+    setWallpaper(_requestedWallpaper);
+    setOpacity(_opacity);
+    update();
 }
 
 void TerminalDisplay::drawBackground(QPainter& painter, const QRect& rect, const QColor& backgroundColor, bool useOpacitySetting)
@@ -683,19 +782,17 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
                                      const QRect& rect,
                                      const QString& text,
                                      const Character* style,
-                                     bool invertCharacterColor)
+                                     bool invertCharacterColor,
+                                     const QColor& background)
 {
     // don't draw text which is currently blinking
     if (_textBlinking && (style->rendition & RE_BLINK))
         return;
 
+    const FragmentStyle& resolved = resolveStyle(style);
+
     // setup bold and underline
-    bool useBold;
-    ColorEntry::FontWeight weight = style->fontWeight(_colorTable);
-    if (weight == ColorEntry::UseCurrentFormat)
-        useBold = ((style->rendition & RE_BOLD) && _boldIntense) || font().bold();
-    else
-        useBold = (weight == ColorEntry::Bold) ? true : false;
+    const bool useBold = resolved.bold;
     const bool useUnderline = style->rendition & RE_UNDERLINE || font().underline();
     const bool useItalic = style->rendition & RE_ITALIC || font().italic();
 
@@ -710,8 +807,7 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     }
 
     // setup pen
-    const CharacterColor& textColor = (invertCharacterColor ? style->backgroundColor : style->foregroundColor);
-    const QColor color = textColor.color(_colorTable);
+    const QColor color = invertCharacterColor ? resolved.background : resolved.foreground;
     QPen pen = painter.pen();
     if (pen.color() != color) {
         pen.setColor(color);
@@ -721,7 +817,7 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     // draw text
     if (isLineCharString(text)) {
         drawLineCharString(painter, rect.x(), rect.y(), text, style);
-    } else {
+    } else if (!drawCachedGlyphs(painter, rect, text, color, background)) {
         // Force using LTR as the document layout for the terminal area, because
         // there is no use cases for RTL emulator and RTL terminal application.
         //
@@ -748,16 +844,158 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     }
 }
 
+bool TerminalDisplay::drawCachedGlyphs(QPainter& painter,
+                                       const QRect& rect,
+                                       const QString& text,
+                                       const QColor& color,
+                                       const QColor& background)
+{
+    // the cache holds one glyph per character, so it can only be used when
+    // the characters of the fragment are laid out on the grid of cells.
+    // The glyphs are opaque, so their background has to be known
+    if (!_fixedFont || _bidiEnabled || !background.isValid())
+        return false;
+    if (rect.height() != _fontHeight)
+        return false;
+    if (painter.worldTransform().type() > QTransform::TxTranslate)
+        return false;
+
+    // italic glyphs overhang their cell, which a cell-sized glyph would clip
+    const QFont& font = painter.font();
+    if (font.italic())
+        return false;
+
+    // combining characters need to be shaped together with the characters
+    // they belong to.  Characters outside of the basic multilingual plane,
+    // such as emoji, are cached by their code point
+    QVarLengthArray<uint, 128> codePoints;
+    for (int i = 0; i < text.length(); i++) {
+        const QChar ch = text.at(i);
+        if (ch.isMark() || ch.isLowSurrogate())
+            return false;
+
+        if (!ch.isHighSurrogate()) {
+            codePoints.append(ch.unicode());
+        } else if (i + 1 < text.length() && text.at(i + 1).isLowSurrogate()) {
+            codePoints.append(QChar::surrogateToUcs4(ch, text.at(i + 1)));
+            i++;
+        } else {
+            return false;
+        }
+    }
+
+    // the characters of a fragment are either all single width or all
+    // double width, see drawContents()
+    int cellsPerCharacter = 0;
+    if (rect.width() == codePoints.count() * _fontWidth)
+        cellsPerCharacter = 1;
+    else if (rect.width() == codePoints.count() * 2 * _fontWidth)
+        cellsPerCharacter = 2;
+    else
+        return false;
+    const int glyphWidth = cellsPerCharacter * _fontWidth;
+
+    const quint32 variant = (font.bold() ? BOLD_GLYPH : 0) | (font.underline() ? UNDERLINE_GLYPH : 0) |
+                            (cellsPerCharacter == 2 ? WIDE_GLYPH : 0);
+
+    // glyphs which overhang their cells go through the text shaper, which
+    // does not clip them, along with the rest of the fragment
+    for (int i = 0; i < codePoints.count(); i++) {
+        const uint codePoint = codePoints[i];
+        if (codePoint == ' ' && !font.underline())
+            continue;
+        if (cachedGlyph(codePoint, variant, font, color, background, glyphWidth)->isNull())
+            return false;
+    }
+
+    for (int i = 0; i < codePoints.count(); i++) {
+        const uint codePoint = codePoints[i];
+        if (codePoint == ' ' && !font.underline())
+            continue;
+
+        const QPixmap* glyph = cachedGlyph(codePoint, variant, font, color, background, glyphWidth);
+        painter.drawPixmap(rect.x() + i * glyphWidth, rect.y(), *glyph);
+    }
+
+    return true;
+}
+
+const QPixmap* TerminalDisplay::cachedGlyph(uint codePoint, quint32 variant, const QFont& font,
+                                            const QColor& color, const QColor& background, int glyphWidth)
+{
+    // characters which the font does not have are drawn with a fallback
+    // font, which the text shaper looks for each time they are drawn.
+    // Caching the glyph means that this only happens once
+    const FontResource::GlyphKey key((quint64(color.rgba()) << 32) | background.rgba(),
+                                     (variant << GLYPH_VARIANT_SHIFT) | codePoint);
+    QPixmap* glyph = _fontResource->glyphCache().object(key);
+    if (glyph)
+        return glyph;
+
+    QString character;
+    if (codePoint > 0xffff) {
+        character.append(QChar(QChar::highSurrogate(codePoint)));
+        character.append(QChar(QChar::lowSurrogate(codePoint)));
+    } else {
+        character = QChar(codePoint);
+    }
+
+    // use the same alignment as the text shaper path in drawCharacters()
+    const QFontMetrics metrics(font);
+#if QT_VERSION >= 0x040800
+    const int flags = Qt::AlignBottom;
+    const int baseline = _fontHeight - metrics.descent();
+#else
+    const int flags = 0;
+    const int baseline = metrics.ascent();
+#endif
+
+    const QRect bounds = metrics.boundingRect(character).translated(0, baseline);
+    if (bounds.left() < 0 || bounds.right() >= glyphWidth ||
+            bounds.top() < 0 || bounds.bottom() >= _fontHeight) {
+        glyph = new QPixmap;
+    } else {
+        // the glyph is rendered on its background rather than on a
+        // transparent pixmap, which keeps subpixel antialiasing
+        glyph = new QPixmap(glyphWidth, _fontHeight);
+        glyph->fill(background);
+
+        QPainter glyphPainter(glyph);
+        glyphPainter.setFont(font);
+        glyphPainter.setPen(color);
+        glyphPainter.setLayoutDirection(Qt::LeftToRight);
+        glyphPainter.drawText(glyph->rect(), flags, character);
+        glyphPainter.end();
+    }
+
+    _fontResource->glyphCache().insert(key, glyph);
+    return glyph;
+}
+
+QColor TerminalDisplay::textBackground(const QColor& color) const
+{
+    // fragments of other colors than the display's background have their
+    // background drawn fully opaque, see drawTextFragment().  The display's
+    // background may be a wallpaper or translucent, and is left out of the
+    // lines rendered into the line cache
+    if (color != palette().background().color())
+        return color;
+    if (_renderingCachedLine || !_wallpaper->isNull() || qAlpha(_blendColor) < 0xff)
+        return QColor();
+    return color;
+}
+
 void TerminalDisplay::drawTextFragment(QPainter& painter ,
                                        const QRect& rect,
                                        const QString& text,
                                        const Character* style)
 {
-    painter.save();
-
-    // setup painter
-    const QColor foregroundColor = style->foregroundColor.color(_colorTable);
-    const QColor backgroundColor = style->backgroundColor.color(_colorTable);
+    // the painter state is not saved and restored for each fragment, so that
+    // drawCharacters() only has to switch the font and pen when they differ
+    // from the previous fragment.  drawContents() restores the state
+    const FragmentStyle& resolved = resolveStyle(style);
+    const QColor foregroundColor = resolved.foreground;
+    const QColor backgroundColor = resolved.background;
 
     // draw background if different from the display's background color
     if (backgroundColor != palette().background().color())
@@ -767,32 +1005,41 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
     // draw cursor shape if the current character is the cursor
     // this may alter the foreground and background colors
     bool invertCharacterColor = false;
-    if (style->rendition & RE_CURSOR)
+    QColor textBackgroundColor = textBackground(backgroundColor);
+    if (style->rendition & RE_CURSOR) {
         drawCursor(painter, rect, foregroundColor, backgroundColor, invertCharacterColor);
+        textBackgroundColor = QColor();
+    }
 
     // draw text
-    drawCharacters(painter, rect, text, style, invertCharacterColor);
-
-    painter.restore();
+    drawCharacters(painter, rect, text, style, invertCharacterColor, textBackgroundColor);
 }
 
-void TerminalDisplay::drawPrinterFriendlyTextFragment(QPainter& painter,
-        const QRect& rect,
-        const QString& text,
-        const Character* style)
+const TerminalDisplay::FragmentStyle& TerminalDisplay::resolveStyle(const Character* style)
 {
-    painter.save();
+    const bool boldRendition = style->rendition & RE_BOLD;
+    const quint64 key = (quint64(boldRendition) << 32) |
+                        (quint64(style->foregroundColor.packedValue()) << 16) |
+                        style->backgroundColor.packedValue();
 
-    // Set the colors used to draw to black foreground and white
-    // background for printer friendly output when printing
-    Character print_style = *style;
-    print_style.foregroundColor = CharacterColor(COLOR_SPACE_RGB, 0x00000000);
-    print_style.backgroundColor = CharacterColor(COLOR_SPACE_RGB, 0xFFFFFFFF);
+    QHash<quint64, FragmentStyle>::const_iterator iter = _fragmentStyles.constFind(key);
+    if (iter != _fragmentStyles.constEnd())
+        return iter.value();
 
-    // draw text
-    drawCharacters(painter, rect, text, &print_style, false);
+    if (_fragmentStyles.count() >= FRAGMENT_STYLE_CACHE_SIZE)
+        _fragmentStyles.clear();
 
-    painter.restore();
+    FragmentStyle resolved;
+    resolved.foreground = resolveColor(style->foregroundColor);
+    resolved.background = resolveColor(style->backgroundColor);
+
+    const ColorEntry::FontWeight weight = style->fontWeight(colorTable());
+    if (weight == ColorEntry::UseCurrentFormat)
+        resolved.bold = (boldRendition && _boldIntense) || font().bold();
+    else
+        resolved.bold = (weight == ColorEntry::Bold);
+
+    return *_fragmentStyles.insert(key, resolved);
 }
 
 void TerminalDisplay::setRandomSeed(uint randomSeed)
@@ -819,6 +1066,13 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
     // is to just disable the optimization whilst it is visible
     if (_outputSuspendedLabel && _outputSuspendedLabel->isVisible())
         return;
+    // the same applies to the flood mode indicator and the input progress
+    if (_floodModeLabel && _floodModeLabel->isVisible())
+        return;
+    if (_inputProgressLabel && _inputProgressLabel->isVisible())
+        return;
+    if (_statisticsLabel && _statisticsLabel->isVisible())
+        return;
 
     // constrain the region to the display
     // the bottom of the region is capped to the number of lines in the display's
@@ -878,6 +1132,11 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
         //scroll internal image down
         memmove(firstCharPos , lastCharPos , bytesToMove);
+        for (int line = region.top(); line < region.top() + linesToMove; line++) {
+            _blinkingLines.setBit(line, _blinkingLines.testBit(line + lines));
+            if (line + lines < _selectedColumns.count())
+                _selectedColumns[line] = _selectedColumns[line + lines];
+        }
 
         //set region of display to scroll
         scrollRect.setTop(top);
@@ -888,6 +1147,11 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
         //scroll internal image up
         memmove(lastCharPos , firstCharPos , bytesToMove);
+        for (int line = region.top() + linesToMove - 1; line >= region.top(); line--) {
+            _blinkingLines.setBit(line - lines, _blinkingLines.testBit(line));
+            if (line - lines < _selectedColumns.count())
+                _selectedColumns[line - lines] = _selectedColumns[line];
+        }
 
         //set region of the display to scroll
         scrollRect.setTop(top + abs(lines) * _fontHeight);
@@ -896,50 +1160,154 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
     Q_ASSERT(scrollRect.isValid() && !scrollRect.isEmpty());
 
-    //scroll the display vertically to match internal _image
-    scroll(0 , _fontHeight * (-lines) , scrollRect);
+    if (_wallpaper->isNull()) {
+        //scroll the display vertically to match internal _image
+        scroll(0 , _fontHeight * (-lines) , scrollRect);
+    } else if (_textLayer.size() == size()) {
+        // scrolling the widget would move the wallpaper along with the text,
+        // so only the text layer is scrolled and then composited over the
+        // wallpaper again.  out of date parts of the layer move along with
+        // it, and only the newly exposed lines have to be drawn
+        const int dy = _fontHeight * (-lines);
+        _textLayer.scroll(0 , dy , scrollRect);
+
+        const QRegion moved = (_textLayerDirty & scrollRect).translated(0 , dy) & scrollRect;
+        const QRegion exposed = QRegion(scrollRect) - scrollRect.translated(0 , dy);
+        _textLayerDirty = (_textLayerDirty - scrollRect) | moved | exposed;
+
+        update(scrollRect);
+    }
 }
 
-QRegion TerminalDisplay::hotSpotRegion() const
+QRegion TerminalDisplay::linesToRegion(const QBitArray& lines, int lineCount, int columnCount) const
 {
+    const QPoint tL = contentsRect().topLeft();
+
+    // turn each run of adjacent lines into one rectangle.  the rectangles
+    // are sorted and do not overlap, so the region can be built from them
+    // directly instead of uniting the areas of the lines one at a time
+    QVector<QRect> rects;
+    for (int line = 0; line < lineCount; line++) {
+        if (!lines.testBit(line))
+            continue;
+
+        const int firstLine = line;
+        while (line + 1 < lineCount && lines.testBit(line + 1))
+            line++;
+
+        rects << QRect(_leftMargin + tL.x() ,
+                       _topMargin + tL.y() + _fontHeight * firstLine ,
+                       _fontWidth * columnCount ,
+                       _fontHeight * (line - firstLine + 1));
+    }
+
     QRegion region;
-    foreach(Filter::HotSpot * hotSpot , _filterChain->hotSpots()) {
-        QRect r;
-        if (hotSpot->startLine() == hotSpot->endLine()) {
-            r.setLeft(hotSpot->startColumn());
-            r.setTop(hotSpot->startLine());
-            r.setRight(hotSpot->endColumn());
-            r.setBottom(hotSpot->endLine());
-            region |= imageToWidget(r);
-        } else {
-            r.setLeft(hotSpot->startColumn());
-            r.setTop(hotSpot->startLine());
-            r.setRight(_columns);
-            r.setBottom(hotSpot->startLine());
-            region |= imageToWidget(r);
-            for (int line = hotSpot->startLine() + 1 ; line < hotSpot->endLine() ; line++) {
-                r.setLeft(0);
-                r.setTop(line);
-                r.setRight(_columns);
-                r.setBottom(line);
-                region |= imageToWidget(r);
-            }
-            r.setLeft(0);
-            r.setTop(hotSpot->endLine());
-            r.setRight(hotSpot->endColumn());
-            r.setBottom(hotSpot->endLine());
-            region |= imageToWidget(r);
+    region.setRects(rects.constData(), rects.count());
+    return region;
+}
+
+QRegion TerminalDisplay::selectionRegion() const
+{
+    const QPoint tL = contentsRect().topLeft();
+
+    // one rectangle per line, which keeps them sorted and apart
+    QVector<QRect> rects;
+    for (int line = 0; line < _selectedColumns.count(); line++) {
+        const QPoint& columns = _selectedColumns[line];
+        if (columns.x() > columns.y())
+            continue;
+
+        rects << QRect(_leftMargin + tL.x() + _fontWidth * columns.x() ,
+                       _topMargin + tL.y() + _fontHeight * line ,
+                       _fontWidth * (columns.y() - columns.x() + 1) ,
+                       _fontHeight);
+    }
+
+    QRegion region;
+    region.setRects(rects.constData(), rects.count());
+    return region;
+}
+
+void TerminalDisplay::updateSelection()
+{
+    QVector<QPoint> selectedColumns(_usedLines, QPoint(0, -1));
+    for (int line = 0; line < _usedLines; line++) {
+        int startColumn;
+        int endColumn;
+        if (_screenWindow->selectedColumns(line, startColumn, endColumn))
+            selectedColumns[line] = QPoint(startColumn, qMin(endColumn, _usedColumns - 1));
+    }
+
+    if (selectedColumns == _selectedColumns)
+        return;
+
+    // scrollImage() moves the columns along with the lines, so only the
+    // cells whose selection differs from what is on the display change
+    const QRegion oldRegion = selectionRegion();
+    _selectedColumns = selectedColumns;
+    update(oldRegion ^ selectionRegion());
+}
+
+// returns true if the hotspots on a line look the same in both lists of spans
+static bool sameSpans(const QVector<HotSpotIndex::Span>& first,
+                      const QVector<HotSpotIndex::Span>& second)
+{
+    if (first.count() != second.count())
+        return false;
+
+    for (int i = 0; i < first.count(); i++) {
+        if (first[i].startColumn != second[i].startColumn ||
+                first[i].endColumn != second[i].endColumn ||
+                first[i].type != second[i].type)
+            return false;
+    }
+
+    return true;
+}
+
+QRegion TerminalDisplay::hotSpotRegion(const HotSpotIndex& index,
+                                       const HotSpotIndex& previousIndex) const
+{
+    QVector<QRect> rects;
+
+    const int lines = qMax(index.lineCount(), previousIndex.lineCount());
+    for (int line = 0; line < lines; line++) {
+        const QVector<HotSpotIndex::Span> spans = index.spans(line);
+        const QVector<HotSpotIndex::Span> previousSpans = previousIndex.spans(line);
+        if (sameSpans(spans, previousSpans))
+            continue;
+
+        // one rect per line keeps the rects apart, as setRects() requires
+        int startColumn = _columns;
+        int endColumn = 0;
+        foreach(const HotSpotIndex::Span& span, spans + previousSpans) {
+            startColumn = qMin(startColumn, span.startColumn);
+            endColumn = qMax(endColumn, qMin(span.endColumn, _columns));
         }
+        if (startColumn <= endColumn)
+            rects << imageToWidget(QRect(QPoint(startColumn, line), QPoint(endColumn, line)));
     }
+
+    QRegion region;
+    region.setRects(rects.constData(), rects.count());
     return region;
 }
 
+// runs the searches of the filters, this is called on another thread
+static QList<RegExpFilter::Search> runFilterSearches(QList<RegExpFilter::Search> searches)
+{
+    for (int i = 0; i < searches.count(); i++)
+        searches[i].run();
+
+    return searches;
+}
+
 void TerminalDisplay::processFilters()
 {
     if (!_screenWindow)
         return;
 
-    QRegion preUpdateHotSpots = hotSpotRegion();
+    const PerformanceClock clock;
 
     // use _screenWindow->getImage() here rather than _image because
     // other classes may call processFilters() when this display's
@@ -950,11 +1318,49 @@ void TerminalDisplay::processFilters()
                            _screenWindow->windowLines(),
                            _screenWindow->windowColumns(),
                            _screenWindow->getLineProperties());
-    _filterChain->process();
+    _filterGeneration++;
+
+    // the lines which the filters have not searched before, which are
+    // usually the new output, are searched on another thread.  while
+    // the searches of an earlier image are still running, new searches are
+    // only started once they have finished
+    const QList<RegExpFilter::Search> searches = _filterChain->searches();
+    if (searches.isEmpty()) {
+        updateHotSpots();
+    } else if (!_filterSearchWatcher->isRunning()) {
+        _filterSearchGeneration = _filterGeneration;
+        _filterSearchWatcher->setFuture(QtConcurrent::run(runFilterSearches, searches));
+    }
 
-    QRegion postUpdateHotSpots = hotSpotRegion();
+    _paintStatistics.filterTime += clock.elapsed();
+}
 
-    update(preUpdateHotSpots | postUpdateHotSpots);
+void TerminalDisplay::filterSearchesFinished()
+{
+    // the matches of a line do not depend on where it is in the image, so
+    // the results are kept even if the image has changed in the meantime
+    const PerformanceClock clock;
+    _filterChain->addSearchResults(_filterSearchWatcher->result());
+
+    if (_filterSearchGeneration == _filterGeneration) {
+        updateHotSpots();
+        _paintStatistics.filterTime += clock.elapsed();
+    } else {
+        // the hotspots would be those of an image which is no longer
+        // shown, search what is left of the current one instead
+        processFilters();
+    }
+}
+
+void TerminalDisplay::updateHotSpots()
+{
+    const HotSpotIndex previousIndex = _filterChain->hotSpotIndex();
+
+    _filterChain->process();
+    _hotSpotCell = QPoint(-1, -1);
+
+    // only the lines whose hotspots have changed need to be repainted
+    update(hotSpotRegion(_filterChain->hotSpotIndex(), previousIndex));
 }
 
 void TerminalDisplay::updateImage()
@@ -962,15 +1368,51 @@ void TerminalDisplay::updateImage()
     if (!_screenWindow)
         return;
 
+    // don't retrieve and compare images while the display is hidden or its
+    // window is minimized, showEvent() brings the display up to date in one go
+    if (_hidden) {
+        _screenWindow->resetScrollCount();
+        _imageInSync = false;
+        _paintStatistics.skippedUpdates++;
+        return;
+    }
+
+    // in low bandwidth mode, updates which follow each other closely are
+    // made together.  The echo of a key press is not held back
+    if (_lowBandwidthRendering && !_keyPressClock.isValid()) {
+        const qint64 elapsed = _lowBandwidthUpdateClock.isValid() ?
+                               _lowBandwidthUpdateClock.elapsed() : LOW_BANDWIDTH_UPDATE_INTERVAL;
+        if (elapsed < LOW_BANDWIDTH_UPDATE_INTERVAL) {
+            if (!_lowBandwidthUpdateTimer->isActive())
+                _lowBandwidthUpdateTimer->start(LOW_BANDWIDTH_UPDATE_INTERVAL - elapsed);
+            return;
+        }
+    }
+    _lowBandwidthUpdateTimer->stop();
+    _lowBandwidthUpdateClock.start();
+
+    const PerformanceClock clock;
+
     // optimization - scroll the existing image where possible and
     // avoid expensive text drawing for parts of the image that
     // can simply be moved up or down
-    if (_wallpaper->isNull()) {
-        scrollImage(_screenWindow->scrollCount() ,
-                    _screenWindow->scrollRegion());
-        _screenWindow->resetScrollCount();
+    if (_screenWindow->scrollCount() != 0)
+        _imageInSync = false;
+
+    if (_keyPressClock.isValid())
+        _keyEchoUpdated = true;
+
+    // the cached text and character classes of the lines are not
+    // scrolled along with the image
+    if (_screenWindow->scrollCount() != 0) {
+        _accessibleLinesStale.fill(true);
+        _charClassLines.fill(false);
     }
 
+    scrollImage(_screenWindow->scrollCount() ,
+                _screenWindow->scrollRegion());
+    _screenWindow->resetScrollCount();
+
     if (!_image) {
         // Create _image.
         // The emitted changedContentSizeSignal also leads to getImage being recreated, so do this first.
@@ -991,8 +1433,6 @@ void TerminalDisplay::updateImage()
     const QPoint tL  = contentsRect().topLeft();
     const int    tLx = tL.x();
     const int    tLy = tL.y();
-    _hasTextBlinker = false;
-
     CharacterColor cf;       // undefined
 
     const int linesToUpdate = qMin(this->_lines, qMax(0, lines));
@@ -1001,73 +1441,98 @@ void TerminalDisplay::updateImage()
     char* dirtyMask = new char[columnsToUpdate + 2];
     QRegion dirtyRegion;
 
+    // the lines which need repainting, see below
+    QBitArray dirtyLines(linesToUpdate);
+
     // debugging variable, this records the number of lines that are found to
     // be 'dirty' ( ie. have changed from the old _image to the new _image ) and
     // which therefore need to be repainted
     int dirtyLineCount = 0;
 
+    const bool tablesChanged = _extendedCharsGeneration != ExtendedCharTable::instance.generation() ||
+                               _rgbColorsGeneration != rgbColorGeneration();
+    _extendedCharsGeneration = ExtendedCharTable::instance.generation();
+    _rgbColorsGeneration = rgbColorGeneration();
+
     for (y = 0; y < linesToUpdate; ++y) {
         const Character* currentLine = &_image[y * this->_columns];
         const Character* const newLine = &newimg[y * columns];
 
         bool updateLine = false;
 
-        // The dirty mask indicates which characters need repainting. We also
-        // mark surrounding neighbors dirty, in case the character exceeds
-        // its cell boundaries
-        memset(dirtyMask, 0, columnsToUpdate + 2);
-
-        for (x = 0 ; x < columnsToUpdate ; ++x) {
-            if (newLine[x] != currentLine[x]) {
-                dirtyMask[x] = true;
+        // Most lines do not change from one update to the next.  Skip the
+        // lines which the screen window knows to be unchanged, then compare
+        // whole lines (memcmp() uses the vector instructions of the CPU) and
+        // only look for the characters which need repainting in the lines
+        // which differ.
+        const bool lineChanged = tablesChanged ||
+                                 ((!_imageInSync || _screenWindow->isLineDirty(y)) &&
+                                  memcmp(currentLine, newLine, columnsToUpdate * sizeof(Character)) != 0);
+
+        if (lineChanged) {
+            // The dirty mask indicates which characters need repainting. We also
+            // mark surrounding neighbors dirty, in case the character exceeds
+            // its cell boundaries
+            memset(dirtyMask, 0, columnsToUpdate + 2);
+
+            for (x = 0 ; x < columnsToUpdate ; ++x) {
+                if (tablesChanged || newLine[x] != currentLine[x]) {
+                    dirtyMask[x] = true;
+                }
             }
-        }
 
-        if (!_resizing) // not while _resizing, we're expecting a paintEvent
-            for (x = 0; x < columnsToUpdate; ++x) {
-                _hasTextBlinker |= (newLine[x].rendition & RE_BLINK);
-
-                // Start drawing if this character or the next one differs.
-                // We also take the next one into account to handle the situation
-                // where characters exceed their cell width.
-                if (dirtyMask[x]) {
-                    if (!newLine[x + 0].character)
-                        continue;
-                    const bool lineDraw = newLine[x + 0].isLineChar();
-                    const bool doubleWidth = (x + 1 == columnsToUpdate) ? false : (newLine[x + 1].character == 0);
-                    const quint8 cr = newLine[x].rendition;
-                    const CharacterColor clipboard = newLine[x].backgroundColor;
-                    if (newLine[x].foregroundColor != cf) cf = newLine[x].foregroundColor;
-                    const int lln = columnsToUpdate - x;
-                    for (len = 1; len < lln; ++len) {
-                        const Character& ch = newLine[x + len];
-
-                        if (!ch.character)
-                            continue; // Skip trailing part of multi-col chars.
-
-                        const bool nextIsDoubleWidth = (x + len + 1 == columnsToUpdate) ? false : (newLine[x + len + 1].character == 0);
-
-                        if (ch.foregroundColor != cf ||
-                                ch.backgroundColor != clipboard ||
-                                (ch.rendition & ~RE_EXTENDED_CHAR) != (cr & ~RE_EXTENDED_CHAR) ||
-                                !dirtyMask[x + len] ||
-                                ch.isLineChar() != lineDraw ||
-                                nextIsDoubleWidth != doubleWidth)
-                            break;
-                    }
+            if (!_resizing) // not while _resizing, we're expecting a paintEvent
+                for (x = 0; x < columnsToUpdate; ++x) {
+                    // Start drawing if this character or the next one differs.
+                    // We also take the next one into account to handle the situation
+                    // where characters exceed their cell width.
+                    if (dirtyMask[x]) {
+                        if (!newLine[x + 0].character)
+                            continue;
+                        const bool lineDraw = newLine[x + 0].isLineChar();
+                        const bool doubleWidth = (x + 1 == columnsToUpdate) ? false : (newLine[x + 1].character == 0);
+                        const quint8 cr = newLine[x].rendition;
+                        const CharacterColor clipboard = newLine[x].backgroundColor;
+                        if (newLine[x].foregroundColor != cf) cf = newLine[x].foregroundColor;
+                        const int lln = columnsToUpdate - x;
+                        for (len = 1; len < lln; ++len) {
+                            const Character& ch = newLine[x + len];
+
+                            if (!ch.character)
+                                continue; // Skip trailing part of multi-col chars.
+
+                            const bool nextIsDoubleWidth = (x + len + 1 == columnsToUpdate) ? false : (newLine[x + len + 1].character == 0);
+
+                            if (ch.foregroundColor != cf ||
+                                    ch.backgroundColor != clipboard ||
+                                    (ch.rendition & ~RE_EXTENDED_CHAR) != (cr & ~RE_EXTENDED_CHAR) ||
+                                    !dirtyMask[x + len] ||
+                                    ch.isLineChar() != lineDraw ||
+                                    nextIsDoubleWidth != doubleWidth)
+                                break;
+                        }
 
-                    const bool saveFixedFont = _fixedFont;
-                    if (lineDraw)
-                        _fixedFont = false;
-                    if (doubleWidth)
-                        _fixedFont = false;
+                        const bool saveFixedFont = _fixedFont;
+                        if (lineDraw)
+                            _fixedFont = false;
+                        if (doubleWidth)
+                            _fixedFont = false;
 
-                    updateLine = true;
+                        updateLine = true;
 
-                    _fixedFont = saveFixedFont;
-                    x += len - 1;
+                        _fixedFont = saveFixedFont;
+                        x += len - 1;
+                    }
                 }
-            }
+
+            // keep track of the lines containing blinking text, so that
+            // blinkTextEvent() only needs to repaint those lines.  an unchanged
+            // line keeps its flag
+            bool blinking = false;
+            for (x = 0; x < columnsToUpdate && !blinking; ++x)
+                blinking = newLine[x].rendition & RE_BLINK;
+            _blinkingLines.setBit(y, blinking);
+        }
 
         //both the top and bottom halves of double height _lines must always be redrawn
         //although both top and bottom halves contain the same characters, only
@@ -1080,22 +1545,32 @@ void TerminalDisplay::updateImage()
         // then this line must be repainted.
         if (updateLine) {
             dirtyLineCount++;
-
-            // add the area occupied by this line to the region which needs to be
-            // repainted
-            QRect dirtyRect = QRect(_leftMargin + tLx ,
-                                    _topMargin + tLy + _fontHeight * y ,
-                                    _fontWidth * columnsToUpdate ,
-                                    _fontHeight);
-
-            dirtyRegion |= dirtyRect;
+            dirtyLines.setBit(y);
         }
 
         // replace the line of characters in the old _image with the
         // current line of the new _image
-        memcpy((void*)currentLine, (const void*)newLine, columnsToUpdate * sizeof(Character));
+        if (lineChanged) {
+            memcpy((void*)currentLine, (const void*)newLine, columnsToUpdate * sizeof(Character));
+
+            if (y < _accessibleLinesStale.size())
+                _accessibleLinesStale.setBit(y);
+            if (y < _charClassLines.size())
+                _charClassLines.clearBit(y);
+            _accessibleTextChanged = true;
+        }
     }
 
+    // turn each run of adjacent dirty lines into one rectangle.  the rectangles
+    // are sorted and do not overlap, so the region can be built from them
+    // directly instead of uniting the areas of the lines one at a time
+    dirtyRegion = linesToRegion(dirtyLines, linesToUpdate, columnsToUpdate);
+
+    // lines below the new _image no longer contain blinking text
+    for (y = linesToUpdate; y < _blinkingLines.size(); ++y)
+        _blinkingLines.clearBit(y);
+    _hasTextBlinker = _blinkingLines.count(true) > 0;
+
     // if the new _image is smaller than the previous _image, then ensure that the area
     // outside the new _image is cleared
     if (linesToUpdate < _usedLines) {
@@ -1114,10 +1589,16 @@ void TerminalDisplay::updateImage()
     }
     _usedColumns = columnsToUpdate;
 
+    _screenWindow->resetDirtyLines();
+    _imageInSync = true;
+
+    updateSelection();
+
     dirtyRegion |= _inputMethodData.previousPreeditRect;
 
     // update the parts of the display which have changed
     update(dirtyRegion);
+    _textLayerDirty |= dirtyRegion;
 
     if (_allowBlinkingText && _hasTextBlinker && !_blinkTextTimer->isActive()) {
         _blinkTextTimer->start();
@@ -1128,12 +1609,92 @@ void TerminalDisplay::updateImage()
     }
     delete[] dirtyMask;
 
+    scheduleAccessibilityUpdate();
+
+    _paintStatistics.updateCount++;
+    _paintStatistics.updateTime += clock.elapsed();
+}
+
+QString TerminalDisplay::accessibleText()
+{
+    if (_accessibleLines.size() != _usedLines || _accessibleLinesStale.size() < _usedLines) {
+        _accessibleLines.resize(_usedLines);
+        _accessibleLinesStale.fill(true, qMax(_lines, _usedLines));
+        _accessibleText.clear();
+    }
+
+    PlainTextDecoder decoder;
+    decoder.setTrailingWhitespace(false);
+
+    bool textChanged = false;
+    for (int y = 0; y < _usedLines; y++) {
+        if (!_accessibleLinesStale.testBit(y))
+            continue;
+
+        QString& text = _accessibleLines[y];
+        text.clear();
+        {
+            QTextStream stream(&text);
+            decoder.begin(&stream);
+            decoder.decodeLine(&_image[y * _columns], _usedColumns, LINE_DEFAULT);
+            decoder.end();
+        }
+
+        // wrapped lines continue on the next line
+        const bool wrapped = y < _lineProperties.count() && (_lineProperties[y] & LINE_WRAPPED);
+        if (!wrapped && y < _usedLines - 1)
+            text += '\n';
+
+        _accessibleLinesStale.clearBit(y);
+        textChanged = true;
+    }
+
+    if (textChanged) {
+        _accessibleText.clear();
+        for (int y = 0; y < _usedLines; y++)
+            _accessibleText += _accessibleLines[y];
+    }
+
+    return _accessibleText;
+}
+
+void TerminalDisplay::scheduleAccessibilityUpdate()
+{
+#ifndef QT_NO_ACCESSIBILITY
+    if (!QAccessible::isActive() || _accessibilityTimer->isActive())
+        return;
+
+    const qint64 elapsed = _accessibilityClock.isValid() ? _accessibilityClock.elapsed()
+                           : ACCESSIBILITY_UPDATE_INTERVAL;
+    if (elapsed >= ACCESSIBILITY_UPDATE_INTERVAL)
+        notifyAccessibility();
+    else
+        _accessibilityTimer->start(ACCESSIBILITY_UPDATE_INTERVAL - elapsed);
+#endif
+}
+
+void TerminalDisplay::notifyAccessibility()
+{
+    _accessibilityClock.start();
+
+    // only the changes are reported, an update which leaves the text and
+    // the cursor as they are is not worth a notification
+    const QPoint cursor = _screenWindow ? _screenWindow->cursorPosition() : QPoint();
+    const bool cursorMoved = cursor != _accessibleCursor;
+    _accessibleCursor = cursor;
+
 #if QT_VERSION >= 0x040800 // added in Qt 4.8.0
 #ifndef QT_NO_ACCESSIBILITY
-    QAccessible::updateAccessibility(this, 0, QAccessible::TextUpdated);
-    QAccessible::updateAccessibility(this, 0, QAccessible::TextCaretMoved);
+    if (_accessibleTextChanged)
+        QAccessible::updateAccessibility(this, 0, QAccessible::TextUpdated);
+    if (cursorMoved)
+        QAccessible::updateAccessibility(this, 0, QAccessible::TextCaretMoved);
 #endif
+#else
+    Q_UNUSED(cursorMoved);
 #endif
+
+    _accessibleTextChanged = false;
 }
 
 void TerminalDisplay::showResizeNotification()
@@ -1163,36 +1724,174 @@ void TerminalDisplay::showResizeNotification()
 
 void TerminalDisplay::paintEvent(QPaintEvent* pe)
 {
+    StartupTrace::mark("first TerminalDisplay paint");
+    StartupTrace::finish();
+
+    const PerformanceClock clock;
+
+    const QRegion region = pe->region() & contentsRect();
+
+    if (!_wallpaper->isNull())
+        updateTextLayer();
+
     QPainter paint(this);
 
-    foreach(const QRect & rect, (pe->region() & contentsRect()).rects()) {
+    // the selected cells are drawn separately, on top of the background
+    const QRegion selection = region & selectionRegion();
+
+    foreach(const QRect & rect, (region - selection).rects()) {
         drawBackground(paint, rect, palette().background().color(),
                        true /* use opacity setting */);
-        drawContents(paint, rect);
+        if (_wallpaper->isNull())
+            drawContents(paint, rect);
+        else
+            paint.drawPixmap(rect.topLeft(), _textLayer, rect);
     }
+    if (!selection.isEmpty())
+        drawSelection(paint, selection);
     drawInputMethodPreeditString(paint, preeditRect());
+
+    const PerformanceClock filterClock;
     paintFilters(paint);
+    _paintStatistics.filterTime += filterClock.elapsed();
+
+    if (_keyEchoUpdated)
+        recordKeyLatency();
+
+    _paintStatistics.paintCount++;
+    _paintStatistics.paintTime += clock.elapsed();
 }
 
-void TerminalDisplay::printContent(QPainter& painter, bool friendly)
+void TerminalDisplay::recordKeyLatency()
 {
-    // Reinitialize the font with the printers paint device so the font
-    // measurement calculations will be done correctly
-    QFont savedFont = getVTFont();
-    QFont font(savedFont, painter.device());
-    painter.setFont(font);
-    setVTFont(font);
+    const qint64 latency = _keyPressClock.nsecsElapsed() / 1000;
+    _keyPressClock.invalidate();
+    _keyEchoUpdated = false;
+
+    _paintStatistics.keyEchoCount++;
+    _paintStatistics.keyEchoTime += latency;
+    _paintStatistics.maximumKeyEchoTime = qMax(_paintStatistics.maximumKeyEchoTime, latency);
+}
 
-    QRect rect(0, 0, size().width(), size().height());
+void TerminalDisplay::releaseLineCache()
+{
+    LineCache::release(_lineCache);
+    _lineCache = 0;
+}
+
+bool TerminalDisplay::drawCachedLine(QPainter& painter, const QRect& rect, int line)
+{
+    if (_renderingCachedLine)
+        return false;
+    if (painter.worldTransform().type() > QTransform::TxTranslate)
+        return false;
+    if (line < _lineProperties.size() &&
+            (_lineProperties[line] & (LINE_DOUBLEWIDTH | LINE_DOUBLEHEIGHT)))
+        return false;
+
+    // the cursor and blinking text change without the cells changing
+    const Character* const cells = &_image[loc(0, line)];
+    for (int x = 0; x < _usedColumns; x++) {
+        if (cells[x].rendition & (RE_CURSOR | RE_BLINK))
+            return false;
+    }
+
+    const QPoint topLeft = contentsRect().topLeft();
+    const QRect lineArea(_leftMargin + topLeft.x(),
+                         _topMargin + topLeft.y() + _fontHeight * line,
+                         _fontWidth * _usedColumns,
+                         _fontHeight);
+    const QRect target = lineArea & rect;
+    if (target.isEmpty())
+        return false;
 
-    _printerFriendly = friendly;
-    if (!friendly) {
-        drawBackground(painter, rect, getBackgroundColor(),
+    if (!_lineCache) {
+        int flags = 0;
+        if (_boldIntense)
+            flags |= LineCache::BoldIntense;
+        if (_bidiEnabled)
+            flags |= LineCache::Bidi;
+        if (_antialiasText && !_lowBandwidthRendering)
+            flags |= LineCache::Antialias;
+        _lineCache = LineCache::acquire(_fontResource, _colorPalette, flags);
+    }
+
+    const int length = _usedColumns * sizeof(Character);
+    QPixmap* pixmap = _lineCache->object(QByteArray::fromRawData(reinterpret_cast<const char*>(cells), length));
+    if (!pixmap) {
+        // only lines which are being drawn in full are added to the cache,
+        // the lines which are partially updated are usually changing
+        if (target.left() != lineArea.left() || target.right() != lineArea.right())
+            return false;
+
+        pixmap = new QPixmap(lineArea.size());
+        pixmap->fill(Qt::transparent);
+
+        QPainter linePainter(pixmap);
+        linePainter.translate(-lineArea.topLeft());
+        _renderingCachedLine = true;
+        drawContents(linePainter, lineArea);
+        _renderingCachedLine = false;
+        linePainter.end();
+
+        // the cache deletes lines which are larger than the whole cache
+        if (!_lineCache->insert(QByteArray(reinterpret_cast<const char*>(cells), length), pixmap))
+            return false;
+    }
+
+    painter.drawPixmap(target, *pixmap, target.translated(-lineArea.topLeft()));
+    return true;
+}
+
+void TerminalDisplay::drawSelection(QPainter& painter, const QRegion& region)
+{
+    // the selected cells are drawn from a copy of _image in which their
+    // colors are reversed, so changing the selection never changes _image
+    QVector<Character> selectedImage(_imageSize + 1);
+    qCopy(_image, _image + _imageSize + 1, selectedImage.begin());
+    for (int line = 0; line < _selectedColumns.count(); line++) {
+        const QPoint& columns = _selectedColumns[line];
+        for (int column = columns.x(); column <= columns.y(); column++) {
+            Character& character = selectedImage[loc(column, line)];
+            qSwap(character.foregroundColor, character.backgroundColor);
+        }
+    }
+
+    Character* const image = _image;
+    _image = selectedImage.data();
+
+    painter.save();
+    painter.setClipRegion(region, Qt::IntersectClip);
+    foreach(const QRect & rect, region.rects()) {
+        drawBackground(painter, rect, palette().background().color(),
                        true /* use opacity setting */);
+        drawContents(painter, rect);
+    }
+    painter.restore();
+
+    _image = image;
+}
+
+void TerminalDisplay::updateTextLayer()
+{
+    if (_textLayer.size() != size()) {
+        // fill the new layer so that it gets an alpha channel
+        _textLayer = QPixmap(size());
+        _textLayer.fill(Qt::transparent);
+        _textLayerDirty = rect();
+    }
+
+    const QRegion dirtyRegion = _textLayerDirty & contentsRect();
+    _textLayerDirty = QRegion();
+
+    QPainter painter(&_textLayer);
+    foreach(const QRect & rect, dirtyRegion.rects()) {
+        painter.setClipRect(rect);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(rect, Qt::transparent);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        drawContents(painter, rect);
     }
-    drawContents(painter, rect);
-    _printerFriendly = false;
-    setVTFont(savedFont);
 }
 
 QPoint TerminalDisplay::cursorPosition() const
@@ -1326,7 +2025,13 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
     const int numberOfColumns = _usedColumns;
     QString unistr;
     unistr.reserve(numberOfColumns);
+
+    paint.save();
+
     for (int y = luy; y <= rly; y++) {
+        if (drawCachedLine(paint, rect, y))
+            continue;
+
         int x = lux;
         if (!_image[loc(lux, y)].character && x)
             x--; // Search for start of multi-column character
@@ -1356,10 +2061,17 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
                 }
             } else {
                 // single character
-                const quint16 c = _image[loc(x, y)].character;
-                if (c) {
+                const Character& ch = _image[loc(x, y)];
+                if (ch.plane != 0) {
+                    // outside of the basic multilingual plane
+                    bufferSize++;
+                    unistr.resize(bufferSize);
+                    disstrU = unistr.data();
+                    disstrU[p++] = QChar::highSurrogate(ch.codePoint());
+                    disstrU[p++] = QChar::lowSurrogate(ch.codePoint());
+                } else if (ch.character) {
                     Q_ASSERT(p < bufferSize);
-                    disstrU[p++] = c; //fontMap(c);
+                    disstrU[p++] = ch.character; //fontMap(c);
                 }
             }
 
@@ -1392,7 +2104,14 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
                     }
                 } else {
                     // single character
-                    if (c) {
+                    const Character& ch = _image[loc(x + len, y)];
+                    if (ch.plane != 0) {
+                        bufferSize++;
+                        unistr.resize(bufferSize);
+                        disstrU = unistr.data();
+                        disstrU[p++] = QChar::highSurrogate(ch.codePoint());
+                        disstrU[p++] = QChar::lowSurrogate(ch.codePoint());
+                    } else if (c) {
                         Q_ASSERT(p < bufferSize);
                         disstrU[p++] = c; //fontMap(c);
                     }
@@ -1408,8 +2127,6 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             const bool save__fixedFont = _fixedFont;
             if (lineDraw)
                 _fixedFont = false;
-            if (doubleWidth)
-                _fixedFont = false;
             unistr.resize(p);
 
             // Create a text scaling matrix for double width and double height lines.
@@ -1424,7 +2141,9 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             }
 
             //Apply text scaling matrix.
-            paint.setWorldMatrix(textScale, true);
+            const bool scaled = !textScale.isIdentity();
+            if (scaled)
+                paint.setWorldMatrix(textScale, true);
 
             //calculate the area in which the text will be drawn
             QRect textArea = QRect(_leftMargin + tLx + _fontWidth * x , _topMargin + tLy + _fontHeight * y , _fontWidth * len , _fontHeight);
@@ -1435,25 +2154,20 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             //transformation has been applied to the painter.  this ensures that
             //painting does actually start from textArea.topLeft()
             //(instead of textArea.topLeft() * painter-scale)
-            textArea.moveTopLeft(textScale.inverted().map(textArea.topLeft()));
+            if (scaled)
+                textArea.moveTopLeft(textScale.inverted().map(textArea.topLeft()));
 
             //paint text fragment
-            if (_printerFriendly) {
-                drawPrinterFriendlyTextFragment(paint,
-                                                textArea,
-                                                unistr,
-                                                &_image[loc(x, y)]);
-            } else {
-                drawTextFragment(paint,
-                                 textArea,
-                                 unistr,
-                                 &_image[loc(x, y)]);
-            }
+            drawTextFragment(paint,
+                             textArea,
+                             unistr,
+                             &_image[loc(x, y)]);
 
             _fixedFont = save__fixedFont;
 
             //reset back to single-width, single-height _lines
-            paint.setWorldMatrix(textScale.inverted(), true);
+            if (scaled)
+                paint.setWorldMatrix(textScale.inverted(), true);
 
             if (y < _lineProperties.size() - 1) {
                 //double-height _lines are represented by two adjacent _lines
@@ -1468,6 +2182,8 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             x += len - 1;
         }
     }
+
+    paint.restore();
 }
 
 QRect TerminalDisplay::imageToWidget(const QRect& imageArea) const
@@ -1556,9 +2272,10 @@ void TerminalDisplay::blinkTextEvent()
 
     _textBlinking = !_textBlinking;
 
-    // TODO: Optimize to only repaint the areas of the widget where there is
-    // blinking text rather than repainting the whole widget.
-    update();
+    // only the lines containing blinking text need to be repainted
+    const QRegion blinkingRegion = linesToRegion(_blinkingLines, _usedLines, _usedColumns);
+    update(blinkingRegion);
+    _textLayerDirty |= blinkingRegion;
 }
 
 void TerminalDisplay::blinkCursorEvent()
@@ -1573,6 +2290,7 @@ void TerminalDisplay::updateCursor()
 {
     QRect cursorRect = imageToWidget(QRect(cursorPosition(), QSize(1, 1)));
     update(cursorRect);
+    _textLayerDirty |= cursorRect;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -1584,6 +2302,11 @@ void TerminalDisplay::updateCursor()
 void TerminalDisplay::resizeEvent(QResizeEvent*)
 {
     updateImageSize();
+
+    if (_floodModeLabel && _floodModeLabel->isVisible())
+        setFloodModeIndicatorVisible(true);
+    if (_statisticsLabel && _statisticsLabel->isVisible())
+        setStatisticsText(_statisticsLabel->text());
 }
 
 void TerminalDisplay::propagateSize()
@@ -1619,6 +2342,12 @@ void TerminalDisplay::updateImageSize()
         delete[] oldImage;
     }
 
+    // the flags of the lines which were copied stay valid
+    _blinkingLines.resize(_lines);
+
+    // the text of the lines is decoded again for the new size
+    _accessibleLinesStale.fill(true, _lines);
+
     if (_screenWindow)
         _screenWindow->setWindowLines(_lines);
 
@@ -1656,11 +2385,111 @@ void TerminalDisplay::clearImage()
 {
     for (int i = 0; i <= _imageSize; ++i)
         _image[i] = Screen::DefaultChar;
+    _charClassLines.fill(false);
+    _selectedColumns.clear();
+
+    _imageInSync = false;
+}
+
+namespace Konsole
+{
+/**
+ * Draws the markers of TerminalDisplay::setSearchMatchLines() over the
+ * groove of a scroll bar.  It covers the whole scroll bar, but lets the
+ * mouse events through to it.
+ *
+ * The lines are counted into the rows of pixels of the groove, which is
+ * only done again when the lines, the range of the scroll bar or its size
+ * change.  Painting the markers then only depends on the height of the
+ * scroll bar, however many lines there are.
+ */
+class SearchMatchMarkers : public QWidget
+{
+public:
+    explicit SearchMatchMarkers(QScrollBar* scrollBar)
+        : QWidget(scrollBar)
+        , _scrollBar(scrollBar)
+        , _rowsLineCount(-1) {
+        setAttribute(Qt::WA_TransparentForMouseEvents);
+    }
+
+    void setLines(const QList<int>& lines) {
+        if (lines.isEmpty() && _lines.isEmpty())
+            return;
+
+        _lines = lines;
+        _rowsLineCount = -1;
+        update();
+    }
+
+protected:
+    virtual void paintEvent(QPaintEvent*) {
+        if (_lines.isEmpty())
+            return;
+
+        // the lines are spread over the groove, between the arrow buttons
+        QStyleOptionSlider option;
+        option.initFrom(_scrollBar);
+        option.orientation = Qt::Vertical;
+        option.minimum = _scrollBar->minimum();
+        option.maximum = _scrollBar->maximum();
+        option.sliderPosition = _scrollBar->sliderPosition();
+        option.sliderValue = _scrollBar->value();
+        option.singleStep = _scrollBar->singleStep();
+        option.pageStep = _scrollBar->pageStep();
+        option.subControls = QStyle::SC_All;
+        const QRect groove = _scrollBar->style()->subControlRect(QStyle::CC_ScrollBar, &option,
+                             QStyle::SC_ScrollBarGroove, _scrollBar);
+        if (groove.height() <= 0)
+            return;
+
+        const int lineCount = _scrollBar->maximum() + _scrollBar->pageStep();
+        if (lineCount != _rowsLineCount || groove.height() != _rows.count())
+            countRows(lineCount, groove.height());
+
+        QColor color = palette().color(QPalette::Highlight);
+        QPainter painter(this);
+        for (int row = 0; row < _rows.count(); row++) {
+            if (_rows[row] == 0)
+                continue;
+
+            // a marker for a single line is faint, one for many of them solid
+            color.setAlpha(qMin(255, MINIMUM_ALPHA + (_rows[row] - 1) * ALPHA_STEP));
+            painter.fillRect(groove.left() + 1, groove.top() + row, groove.width() - 2,
+                             MARKER_HEIGHT, color);
+        }
+    }
+
+private:
+    static const int MARKER_HEIGHT = 2;
+    static const int MINIMUM_ALPHA = 128;
+    static const int ALPHA_STEP = 32;
+
+    void countRows(int lineCount, int height) {
+        _rows.fill(0, height);
+        _rowsLineCount = lineCount;
+
+        foreach(int line, _lines) {
+            if (line >= lineCount)
+                break;
+            _rows[qint64(line) * height / lineCount]++;
+        }
+    }
+
+    QScrollBar* _scrollBar;
+    QList<int> _lines;
+    // the number of lines in each row of the groove, and the line count
+    // of the scroll bar they were counted for
+    QVector<int> _rows;
+    int _rowsLineCount;
+};
 }
 
 void TerminalDisplay::calcGeometry()
 {
     _scrollBar->resize(_scrollBar->sizeHint().width(), contentsRect().height());
+    if (_searchMatchMarkers)
+        _searchMatchMarkers->setGeometry(_scrollBar->rect());
     switch (_scrollbarLocation) {
     case Enum::ScrollBarHidden :
         _leftMargin = DEFAULT_LEFT_MARGIN;
@@ -1739,10 +2568,77 @@ QSize TerminalDisplay::sizeHint() const
 void TerminalDisplay::showEvent(QShowEvent*)
 {
     emit changedContentSizeSignal(_contentHeight, _contentWidth);
+
+    _releaseTimer->stop();
+
+    // catch up with the output received while the display was hidden
+    if (_hidden) {
+        _hidden = false;
+        emit displayShown();
+        updateLineProperties();
+        updateImage();
+    }
 }
 void TerminalDisplay::hideEvent(QHideEvent*)
 {
     emit changedContentSizeSignal(_contentHeight, _contentWidth);
+
+    // hide events are also received when the window is minimized
+    _hidden = true;
+    _releaseTimer->start();
+}
+
+void TerminalDisplay::releaseHiddenResources()
+{
+    if (!_hidden)
+        return;
+
+    // everything freed here is rebuilt as it is needed once the display is
+    // shown again, which updates the whole display anyway.  The cached
+    // lines are kept while other displays use them
+    releaseLineCache();
+    _fragmentStyles.clear();
+    _textLayer = QPixmap();
+    _textLayerDirty = QRegion();
+
+    _charClasses = QVector<QChar>();
+    _charClassLines.fill(false);
+
+    _accessibleLines = QVector<QString>();
+    _accessibleText.clear();
+
+    if (_screenWindow)
+        _screenWindow->releaseBuffers();
+}
+
+qint64 TerminalDisplay::memoryUsage() const
+{
+    qint64 usage = _imageSize * sizeof(Character) +
+                   _lineProperties.capacity() * sizeof(LineProperty);
+
+    // the cost of a cached line is its number of pixels.  The lines are
+    // counted for each of the displays sharing them
+    const int pixelSize = QPixmap::defaultDepth() / 8;
+    if (_lineCache)
+        usage += qint64(_lineCache->totalCost()) * pixelSize;
+    usage += qint64(_textLayer.width()) * _textLayer.height() * pixelSize;
+
+    usage += _charClasses.capacity() * sizeof(QChar);
+    foreach(const QString& line, _accessibleLines) {
+        usage += line.capacity() * sizeof(QChar);
+    }
+    usage += _accessibleText.capacity() * sizeof(QChar);
+    usage += _fragmentStyles.count() * sizeof(FragmentStyle);
+
+    if (_screenWindow)
+        usage += _screenWindow->memoryUsage();
+
+    return usage;
+}
+
+qint64 TerminalDisplay::filterMemoryUsage() const
+{
+    return _filterChain->memoryUsage();
 }
 
 /* ------------------------------------------------------------------------- */
@@ -1766,6 +2662,7 @@ void TerminalDisplay::setScrollBarPosition(Enum::ScrollBarPositionEnum position)
 
     propagateSize();
     update();
+    _textLayerDirty = rect();
 }
 
 void TerminalDisplay::scrollBarPositionChanged(int)
@@ -1804,6 +2701,24 @@ void TerminalDisplay::setScroll(int cursor, int slines)
     _scrollBar->setPageStep(_lines);
     _scrollBar->setValue(cursor);
     connect(_scrollBar, SIGNAL(valueChanged(int)), this, SLOT(scrollBarPositionChanged(int)));
+
+    // the markers move along with the range
+    if (_searchMatchMarkers)
+        _searchMatchMarkers->update();
+}
+
+void TerminalDisplay::setSearchMatchLines(const QList<int>& lines)
+{
+    if (lines.isEmpty() && !_searchMatchMarkers)
+        return;
+
+    if (!_searchMatchMarkers) {
+        _searchMatchMarkers = new SearchMatchMarkers(_scrollBar);
+        _searchMatchMarkers->setGeometry(_scrollBar->rect());
+        _searchMatchMarkers->show();
+    }
+
+    _searchMatchMarkers->setLines(lines);
 }
 
 void TerminalDisplay::setScrollFullPage(bool fullPage)
@@ -1823,6 +2738,9 @@ bool TerminalDisplay::scrollFullPage() const
 /* ------------------------------------------------------------------------- */
 void TerminalDisplay::mousePressEvent(QMouseEvent* ev)
 {
+    flushMouseMove();
+    _lastMouseReport = QPoint(-1, -1);
+
     if (_possibleTripleClick && (ev->button() == Qt::LeftButton)) {
         mouseTripleClickEvent(ev);
         return;
@@ -1910,6 +2828,41 @@ QList<QAction*> TerminalDisplay::filterActions(const QPoint& position)
 }
 
 void TerminalDisplay::mouseMoveEvent(QMouseEvent* ev)
+{
+    // mice with a high polling rate send far more moves than there are
+    // frames, only the latest position, buttons and modifiers matter
+    _mouseMovePosition = ev->pos();
+    _mouseMoveButtons = ev->buttons();
+    _mouseMoveModifiers = ev->modifiers();
+
+    if (_mouseMoveTimer->isActive())
+        return;
+
+    const qint64 elapsed = _mouseMoveClock.isValid() ? _mouseMoveClock.elapsed() : MOUSE_MOVE_INTERVAL;
+    if (elapsed >= MOUSE_MOVE_INTERVAL)
+        processMouseMove();
+    else
+        _mouseMoveTimer->start(MOUSE_MOVE_INTERVAL - elapsed);
+}
+
+void TerminalDisplay::flushMouseMove()
+{
+    if (_mouseMoveTimer->isActive()) {
+        _mouseMoveTimer->stop();
+        processMouseMove();
+    }
+}
+
+void TerminalDisplay::processMouseMove()
+{
+    _mouseMoveClock.start();
+
+    QMouseEvent event(QEvent::MouseMove, _mouseMovePosition, Qt::NoButton,
+                      _mouseMoveButtons, _mouseMoveModifiers);
+    handleMouseMove(&event);
+}
+
+void TerminalDisplay::handleMouseMove(QMouseEvent* ev)
 {
     int charLine = 0;
     int charColumn = 0;
@@ -1918,8 +2871,13 @@ void TerminalDisplay::mouseMoveEvent(QMouseEvent* ev)
     const int scrollBarWidth = (_scrollbarLocation == Enum::ScrollBarLeft) ? _scrollBar->width() : 0;
 
     // handle filters
-    // change link hot-spot appearance on mouse-over
-    Filter::HotSpot* spot = _filterChain->hotSpotAt(charLine, charColumn);
+    // change link hot-spot appearance on mouse-over.  The hotspots only
+    // need to be looked up again once the mouse is over another cell
+    const QPoint cell(charColumn, charLine);
+    const bool sameCell = cell == _hotSpotCell;
+    _hotSpotCell = cell;
+
+    Filter::HotSpot* spot = sameCell ? 0 : _filterChain->hotSpotAt(charLine, charColumn);
     if (spot && spot->type() == Filter::HotSpot::Link) {
         if (_underlineLinks) {
             QRegion previousHotspotArea = _mouseOverHotspotArea;
@@ -1956,7 +2914,7 @@ void TerminalDisplay::mouseMoveEvent(QMouseEvent* ev)
 
             update(_mouseOverHotspotArea | previousHotspotArea);
         }
-    } else if (!_mouseOverHotspotArea.isEmpty()) {
+    } else if (!sameCell && !_mouseOverHotspotArea.isEmpty()) {
         if (_underlineLinks && _openLinksByDirectClick)
             setCursor(_mouseMarks ? Qt::IBeamCursor : Qt::ArrowCursor);
 
@@ -1980,10 +2938,13 @@ void TerminalDisplay::mouseMoveEvent(QMouseEvent* ev)
         if (ev->buttons() & Qt::RightButton)
             button = 2;
 
-        emit mouseSignal(button,
-                         charColumn + 1,
-                         charLine + 1 + _scrollBar->value() - _scrollBar->maximum(),
-                         1);
+        const QPoint report(charColumn + 1, charLine + 1 + _scrollBar->value() - _scrollBar->maximum());
+        if (report == _lastMouseReport && button == _lastMouseReportButton)
+            return;
+        _lastMouseReport = report;
+        _lastMouseReportButton = button;
+
+        emit mouseSignal(button, report.x(), report.y(), 1);
 
         return;
     }
@@ -2081,9 +3042,9 @@ void TerminalDisplay::extendSelection(const QPoint& position)
         QPoint left = left_not_right ? here : _iPntSelCorr;
         i = loc(left.x(), left.y());
         if (i >= 0 && i <= _imageSize) {
-            selClass = charClass(_image[i]);
+            selClass = cachedCharClass(i);
             while (((left.x() > 0) || (left.y() > 0 && (_lineProperties[left.y() - 1] & LINE_WRAPPED)))
-                    && charClass(_image[i - 1]) == selClass) {
+                    && cachedCharClass(i - 1) == selClass) {
                 i--;
                 if (left.x() > 0) {
                     left.rx()--;
@@ -2098,9 +3059,9 @@ void TerminalDisplay::extendSelection(const QPoint& position)
         QPoint right = left_not_right ? _iPntSelCorr : here;
         i = loc(right.x(), right.y());
         if (i >= 0 && i <= _imageSize) {
-            selClass = charClass(_image[i]);
+            selClass = cachedCharClass(i);
             while (((right.x() < _usedColumns - 1) || (right.y() < _usedLines - 1 && (_lineProperties[right.y()] & LINE_WRAPPED)))
-                    && charClass(_image[i + 1]) == selClass) {
+                    && cachedCharClass(i + 1) == selClass) {
                 i++;
                 if (right.x() < _usedColumns - 1) {
                     right.rx()++;
@@ -2222,6 +3183,9 @@ void TerminalDisplay::extendSelection(const QPoint& position)
 
 void TerminalDisplay::mouseReleaseEvent(QMouseEvent* ev)
 {
+    flushMouseMove();
+    _lastMouseReport = QPoint(-1, -1);
+
     if (!_screenWindow)
         return;
 
@@ -2286,7 +3250,7 @@ void TerminalDisplay::getCharacterPosition(const QPoint& widgetPoint, int& line,
 
 void TerminalDisplay::updateLineProperties()
 {
-    if (!_screenWindow)
+    if (!_screenWindow || _hidden)
         return;
 
     _lineProperties = _screenWindow->getLineProperties();
@@ -2437,21 +3401,13 @@ void TerminalDisplay::wheelEvent(QWheelEvent* ev)
         if (canScroll) {
             _scrollBar->event(ev);
         } else {
-            // assume that each Up / Down key event will cause the terminal application
-            // to scroll by one line.
-            //
-            // to get a reasonable scrolling speed, scroll by one line for every 5 degrees
-            // of mouse wheel rotation.  Mouse wheels typically move in steps of 15 degrees,
-            // giving a scroll of 3 lines
-            const int keyCode = delta > 0 ? Qt::Key_Up : Qt::Key_Down;
-            QKeyEvent keyEvent(QEvent::KeyPress, keyCode, Qt::NoModifier);
-
-            // QWheelEvent::delta() gives rotation in eighths of a degree
-            const int degrees = delta / 8;
-            const int lines = abs(degrees) / 5;
-
-            for (int i = 0; i < lines; i++)
-                emit keyPressedSignal(&keyEvent);
+            // the rotation is collected and sent as key presses once per
+            // frame, the first event of a scroll is sent right away
+            _wheelKeyDelta += delta;
+            if (!_wheelKeyTimer->isActive()) {
+                sendWheelKeys();
+                _wheelKeyTimer->start();
+            }
         }
     } else {
         // terminal program wants notification of mouse activity
@@ -2467,6 +3423,27 @@ void TerminalDisplay::wheelEvent(QWheelEvent* ev)
     }
 }
 
+void TerminalDisplay::sendWheelKeys()
+{
+    // assume that each Up / Down key event will cause the terminal application
+    // to scroll by one line.
+    //
+    // to get a reasonable scrolling speed, scroll by one line for every 5 degrees
+    // of mouse wheel rotation.  Mouse wheels typically move in steps of 15 degrees,
+    // giving a scroll of 3 lines.  QWheelEvent::delta() gives rotation in eighths
+    // of a degree, the rest of the rotation is kept for the next events
+    const int deltaPerLine = 5 * 8;
+    const int lines = abs(_wheelKeyDelta) / deltaPerLine;
+    if (lines == 0)
+        return;
+
+    const bool up = _wheelKeyDelta > 0;
+    _wheelKeyDelta -= (up ? lines : -lines) * deltaPerLine;
+
+    QKeyEvent keyEvent(QEvent::KeyPress, up ? Qt::Key_Up : Qt::Key_Down, Qt::NoModifier);
+    emit keyRepeatedSignal(&keyEvent, lines);
+}
+
 void TerminalDisplay::tripleClickTimeout()
 {
     _possibleTripleClick = false;
@@ -2537,6 +3514,50 @@ bool TerminalDisplay::focusNextPrevChild(bool next)
         return QWidget::focusNextPrevChild(next);
 }
 
+// the number of characters in the basic multilingual plane
+static const int BMP_SIZE = 0x10000;
+
+// returns a table with the bits set for the space characters of the basic
+// multilingual plane
+static const QBitArray& spaceTable()
+{
+    static QBitArray table;
+    if (table.isEmpty()) {
+        table.resize(BMP_SIZE);
+        for (int i = 0; i < BMP_SIZE; i++)
+            table.setBit(i, QChar(ushort(i)).isSpace());
+    }
+    return table;
+}
+
+// returns a table with the bits set for the characters of the basic
+// multilingual plane which are part of words, that is letters, numbers and
+// 'wordCharacters' regardless of their case.  The displays of a profile
+// share its word characters, so the last table is kept and shared with
+// the displays which ask for it again
+QBitArray TerminalDisplay::wordCharacterTable(const QString& wordCharacters)
+{
+    static QString lastWordCharacters;
+    static QBitArray lastTable;
+
+    if (lastTable.isEmpty() || wordCharacters != lastWordCharacters) {
+        QBitArray table(BMP_SIZE);
+        for (int i = 0; i < BMP_SIZE; i++)
+            table.setBit(i, QChar(ushort(i)).isLetterOrNumber());
+        foreach(const QChar& ch, wordCharacters) {
+            table.setBit(ch.unicode());
+            table.setBit(ch.toLower().unicode());
+            table.setBit(ch.toUpper().unicode());
+            table.setBit(ch.toCaseFolded().unicode());
+        }
+
+        lastWordCharacters = wordCharacters;
+        lastTable = table;
+    }
+
+    return lastTable;
+}
+
 QChar TerminalDisplay::charClass(const Character& ch) const
 {
     if (ch.rendition & RE_EXTENDED_CHAR) {
@@ -2552,20 +3573,51 @@ QChar TerminalDisplay::charClass(const Character& ch) const
             return allLetterOrNumber ? 'a' : s.at(0);
         }
         return 0;
-    } else {
-        const QChar qch(ch.character);
-        if (qch.isSpace()) return ' ';
+    } else if (ch.plane != 0) {
+        // outside of the basic multilingual plane, letters and numbers
+        // are word characters and everything else is a class of its own
+        const QChar::Category category = QChar::category(ch.codePoint());
+        if ((category >= QChar::Number_DecimalDigit && category <= QChar::Number_Other) ||
+                (category >= QChar::Letter_Uppercase && category <= QChar::Letter_Other))
+            return 'a';
 
-        if (qch.isLetterOrNumber() || _wordCharacters.contains(qch, Qt::CaseInsensitive))
+        return QChar(QChar::highSurrogate(ch.codePoint()));
+    } else {
+        if (spaceTable().testBit(ch.character))
+            return ' ';
+        if (_wordCharacterTable.testBit(ch.character))
             return 'a';
 
-        return qch;
+        return QChar(ch.character);
     }
 }
 
 void TerminalDisplay::setWordCharacters(const QString& wc)
 {
     _wordCharacters = wc;
+    _wordCharacterTable = wordCharacterTable(wc);
+    _charClassLines.fill(false);
+}
+
+QChar TerminalDisplay::cachedCharClass(int position)
+{
+    if (_charClasses.size() != _imageSize + 1 || _charClassLines.size() != _lines) {
+        _charClasses.resize(_imageSize + 1);
+        _charClassLines.fill(false, _lines);
+    }
+
+    const int line = position / _columns;
+    if (line >= _lines)
+        return charClass(_image[position]);
+
+    if (!_charClassLines.testBit(line)) {
+        const int start = line * _columns;
+        for (int i = start; i < start + _columns; i++)
+            _charClasses[i] = charClass(_image[i]);
+        _charClassLines.setBit(line);
+    }
+
+    return _charClasses[position];
 }
 
 // FIXME: the actual value of _mouseMarks is the opposite of its semantic.
@@ -2581,6 +3633,15 @@ bool TerminalDisplay::usesMouse() const
     return _mouseMarks;
 }
 
+void TerminalDisplay::setBracketedPasteMode(bool on)
+{
+    _bracketedPasteMode = on;
+}
+bool TerminalDisplay::bracketedPasteMode() const
+{
+    return _bracketedPasteMode;
+}
+
 /* ------------------------------------------------------------------------- */
 /*                                                                           */
 /*                               Clipboard                                   */
@@ -2592,9 +3653,6 @@ void TerminalDisplay::doPaste(QString text, bool appendReturn)
     if (!_screenWindow)
         return;
 
-    if (appendReturn)
-        text.append("\r");
-
     if (text.length() > 8000) {
         if (KMessageBox::warningContinueCancel(window(),
                         i18np("Are you sure you want to paste %1 character?",
@@ -2609,12 +3667,31 @@ void TerminalDisplay::doPaste(QString text, bool appendReturn)
 
     if (!text.isEmpty()) {
         text.replace('\n', '\r');
+        bracketText(text);
+    }
+
+    // the return runs the pasted text, so it goes after the bracket
+    if (appendReturn)
+        text.append("\r");
+
+    if (!text.isEmpty()) {
         // perform paste by simulating keypress events
         QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, text);
         emit keyPressedSignal(&e);
     }
 }
 
+void TerminalDisplay::bracketText(QString& text) const
+{
+    if (!_bracketedPasteMode)
+        return;
+
+    // the text must not end the bracket early
+    text.remove(QLatin1String("\033[201~"));
+    text.prepend(QLatin1String("\033[200~"));
+    text.append(QLatin1String("\033[201~"));
+}
+
 void TerminalDisplay::setAutoCopySelectedText(bool enabled)
 {
     _autoCopySelectedText = enabled;
@@ -2625,31 +3702,193 @@ void TerminalDisplay::setMiddleClickPasteMode(Enum::MiddleClickPasteModeEnum mod
     _middleClickPasteMode = mode;
 }
 
-void TerminalDisplay::copyToX11Selection()
+namespace Konsole
 {
-    if (!_screenWindow)
-        return;
+/**
+ * The text of a large selection, which is only read from the screen once
+ * it is pasted.  Copying it to the clipboard keeps nothing but the range,
+ * so that selecting all of a long history neither blocks the display nor
+ * makes a copy of the history.
+ *
+ * The text is only available as long as the history keeps the selected
+ * lines.  Once they have been dropped from the history, or it has been
+ * replaced or reflowed, there is no text left to paste.
+ */
+class SelectionText
+{
+public:
+    SelectionText(ScreenWindow* window, int startIndex, int endIndex, bool blockSelection,
+                  bool preserveLineBreaks, bool trimTrailingSpaces)
+        : _window(window)
+        , _screen(window->screen())
+        , _historyGeneration(_screen->historyGeneration())
+        , _discardedLines(_screen->discardedLines())
+        , _columns(_screen->getColumns())
+        , _startIndex(startIndex)
+        , _endIndex(endIndex)
+        , _blockSelection(blockSelection)
+        , _preserveLineBreaks(preserveLineBreaks)
+        , _trimTrailingSpaces(trimTrailingSpaces)
+        , _decoded(false) {
+    }
+
+    // returns the selected text, reading it from the screen the first time
+    QString text();
+
+private:
+    // the screens of a window live as long as the window
+    QPointer<ScreenWindow> _window;
+    Screen* _screen;
+    quint64 _historyGeneration;
+    qint64 _discardedLines;
+    int _columns;
+
+    int _startIndex;
+    int _endIndex;
+    bool _blockSelection;
+    bool _preserveLineBreaks;
+    bool _trimTrailingSpaces;
+
+    QString _text;
+    bool _decoded;
+};
+
+// the number of lines which are read from the screen at a time while the
+// text of a selection is decoded
+static const int SELECTION_READ_LINES = 4096;
 
-    QString text = _screenWindow->selectedText(_preserveLineBreaks, _trimTrailingSpaces);
-    if (text.isEmpty())
+QString SelectionText::text()
+{
+    if (_decoded)
+        return _text;
+    _decoded = true;
+
+    if (!_window || _screen->historyGeneration() != _historyGeneration ||
+            _screen->getColumns() != _columns)
+        return _text;
+
+    // the lines have moved up by the lines dropped from the history since
+    const int shift = int(_screen->discardedLines() - _discardedLines) * _columns;
+    const int startIndex = _startIndex - shift;
+    const int endIndex = _endIndex - shift;
+    if (startIndex < 0)
+        return _text;
+
+    const int top = startIndex / _columns;
+    const int bottom = endIndex / _columns;
+    if (bottom >= _screen->getHistLines() + _screen->getLines())
+        return _text;
+
+    QTextStream stream(&_text, QIODevice::ReadWrite);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    for (int line = top; line <= bottom; line += SELECTION_READ_LINES) {
+        const int lastLine = qMin(line + SELECTION_READ_LINES - 1, bottom);
+        _screen->snapshot(line, lastLine).writeToStream(&decoder, startIndex, endIndex,
+                                                        line, lastLine, _blockSelection,
+                                                        _preserveLineBreaks,
+                                                        _trimTrailingSpaces);
+    }
+    decoder.end();
+
+    return _text;
+}
+
+/**
+ * Clipboard data for a large selection.  The selection and the clipboard
+ * share the SelectionText, which is decoded once for both of them.
+ */
+class SelectionMimeData : public QMimeData
+{
+public:
+    explicit SelectionMimeData(const QSharedPointer<SelectionText>& text)
+        : _text(text) {
+    }
+
+    virtual QStringList formats() const {
+        return QStringList() << "text/plain";
+    }
+
+    virtual bool hasFormat(const QString& mimeType) const {
+        return mimeType == "text/plain";
+    }
+
+protected:
+    virtual QVariant retrieveData(const QString& mimeType, QVariant::Type type) const {
+        Q_UNUSED(type);
+
+        if (mimeType != "text/plain")
+            return QVariant();
+
+        const QString text = _text->text();
+        if (text.isEmpty())
+            return QVariant();
+
+        return text;
+    }
+
+private:
+    QSharedPointer<SelectionText> _text;
+};
+}
+
+// selections with fewer lines than this are copied to the clipboard at once,
+// the text of larger ones is read from the screen once it is pasted
+static const int LAZY_COPY_LINES = 10000;
+
+void TerminalDisplay::copySelection(bool toSelection, bool toClipboard)
+{
+    int startIndex = 0;
+    int endIndex = 0;
+    bool blockSelection = false;
+    if (!_screenWindow->getSelectionRange(startIndex, endIndex, blockSelection))
         return;
 
-    QApplication::clipboard()->setText(text, QClipboard::Selection);
+    // the clipboard takes ownership of the data, so each mode gets its own
+    // copy of it
+    const int columns = _screenWindow->windowColumns();
+    if (endIndex / columns - startIndex / columns + 1 < LAZY_COPY_LINES) {
+        const QString text = _screenWindow->rangeText(startIndex, endIndex, blockSelection,
+                                                      _preserveLineBreaks, _trimTrailingSpaces);
+        if (text.isEmpty())
+            return;
+
+        if (toSelection) {
+            QMimeData* mimeData = new QMimeData;
+            mimeData->setText(text);
+            QApplication::clipboard()->setMimeData(mimeData, QClipboard::Selection);
+        }
+        if (toClipboard) {
+            QMimeData* mimeData = new QMimeData;
+            mimeData->setText(text);
+            QApplication::clipboard()->setMimeData(mimeData, QClipboard::Clipboard);
+        }
+        return;
+    }
 
-    if (_autoCopySelectedText)
-        QApplication::clipboard()->setText(text, QClipboard::Clipboard);
+    const QSharedPointer<SelectionText> text(new SelectionText(_screenWindow, startIndex, endIndex,
+                                                               blockSelection, _preserveLineBreaks,
+                                                               _trimTrailingSpaces));
+    if (toSelection)
+        QApplication::clipboard()->setMimeData(new SelectionMimeData(text), QClipboard::Selection);
+    if (toClipboard)
+        QApplication::clipboard()->setMimeData(new SelectionMimeData(text), QClipboard::Clipboard);
 }
 
-void TerminalDisplay::copyToClipboard()
+void TerminalDisplay::copyToX11Selection()
 {
     if (!_screenWindow)
         return;
 
-    QString text = _screenWindow->selectedText(_preserveLineBreaks, _trimTrailingSpaces);
-    if (text.isEmpty())
+    copySelection(true, _autoCopySelectedText);
+}
+
+void TerminalDisplay::copyToClipboard()
+{
+    if (!_screenWindow)
         return;
 
-    QApplication::clipboard()->setText(text, QClipboard::Clipboard);
+    copySelection(false, true);
 }
 
 void TerminalDisplay::pasteFromClipboard(bool appendEnter)
@@ -2739,13 +3978,13 @@ void TerminalDisplay::drawInputMethodPreeditString(QPainter& painter , const QRe
     const QPoint cursorPos = cursorPosition();
 
     bool invertColors = false;
-    const QColor background = _colorTable[DEFAULT_BACK_COLOR].color;
-    const QColor foreground = _colorTable[DEFAULT_FORE_COLOR].color;
+    const QColor background = colorTable()[DEFAULT_BACK_COLOR].color;
+    const QColor foreground = colorTable()[DEFAULT_FORE_COLOR].color;
     const Character* style = &_image[loc(cursorPos.x(), cursorPos.y())];
 
     drawBackground(painter, rect, background, true);
     drawCursor(painter, rect, foreground, background, invertColors);
-    drawCharacters(painter, rect, _inputMethodData.preeditString, style, invertColors);
+    drawCharacters(painter, rect, _inputMethodData.preeditString, style, invertColors, QColor());
 
     _inputMethodData.previousPreeditRect = rect;
 }
@@ -2804,6 +4043,90 @@ void TerminalDisplay::outputSuspended(bool suspended)
     _outputSuspendedLabel->setVisible(suspended);
 }
 
+void TerminalDisplay::setFloodModeIndicatorVisible(bool visible)
+{
+    if (!visible && !_floodModeLabel)
+        return;
+
+    if (!_floodModeLabel) {
+        _floodModeLabel = new QLabel(i18n("Fast output"), this);
+        _floodModeLabel->setToolTip(i18n("The program produces output faster than it "
+                                         "can be shown, so the display is updated less often"));
+        _floodModeLabel->setFont(KGlobalSettings::smallestReadableFont());
+        _floodModeLabel->setContentsMargins(3, 1, 3, 1);
+        _floodModeLabel->setStyleSheet("background-color:palette(window);border-style:solid;border-width:1px;border-color:palette(dark)");
+        _floodModeLabel->adjustSize();
+    }
+
+    const int right = (_scrollbarLocation == Enum::ScrollBarRight && _scrollBar->isVisible()) ?
+                      _scrollBar->x() : width();
+    _floodModeLabel->move(right - _floodModeLabel->width() - _leftMargin, _topMargin);
+    _floodModeLabel->setVisible(visible);
+
+    // the indicator disables the scrolling optimization, so redraw
+    // whatever was scrolled past it
+    if (!visible)
+        update();
+}
+
+void TerminalDisplay::showInputProgress(qint64 sent, qint64 total)
+{
+    if (sent >= total) {
+        if (_inputProgressLabel && _inputProgressLabel->isVisible()) {
+            _inputProgressLabel->hide();
+            update();
+        }
+        return;
+    }
+
+    if (!_inputProgressLabel) {
+        _inputProgressLabel = new QLabel(this);
+        _inputProgressLabel->setFont(KGlobalSettings::smallestReadableFont());
+        _inputProgressLabel->setContentsMargins(3, 1, 3, 1);
+        _inputProgressLabel->setStyleSheet("background-color:palette(window);border-style:solid;border-width:1px;border-color:palette(dark)");
+        _inputProgressLabel->setTextInteractionFlags(Qt::LinksAccessibleByMouse |
+                Qt::LinksAccessibleByKeyboard);
+        connect(_inputProgressLabel, SIGNAL(linkActivated(QString)),
+                this, SIGNAL(cancelInputRequest()));
+    }
+
+    const int percent = int(sent * 100 / total);
+    _inputProgressLabel->setText(i18n("<qt>Sending input: %1% <a href=\"#cancel\">Cancel</a></qt>",
+                                      percent));
+    _inputProgressLabel->adjustSize();
+    _inputProgressLabel->move(_leftMargin, _topMargin);
+    _inputProgressLabel->show();
+}
+
+void TerminalDisplay::setStatisticsText(const QString& text)
+{
+    if (text.isEmpty()) {
+        if (_statisticsLabel && _statisticsLabel->isVisible()) {
+            _statisticsLabel->hide();
+            update();
+        }
+        return;
+    }
+
+    if (!_statisticsLabel) {
+        _statisticsLabel = new QLabel(this);
+        _statisticsLabel->setFont(KGlobalSettings::smallestReadableFont());
+        _statisticsLabel->setContentsMargins(3, 1, 3, 1);
+        _statisticsLabel->setStyleSheet("background-color:palette(window);border-style:solid;border-width:1px;border-color:palette(dark)");
+        _statisticsLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+        _statisticsLabel->setTextFormat(Qt::PlainText);
+    }
+
+    _statisticsLabel->setText(text);
+    _statisticsLabel->adjustSize();
+
+    const int right = (_scrollbarLocation == Enum::ScrollBarRight && _scrollBar->isVisible()) ?
+                      _scrollBar->x() : width();
+    _statisticsLabel->move(right - _statisticsLabel->width() - _leftMargin,
+                           height() - _statisticsLabel->height() - _topMargin);
+    _statisticsLabel->show();
+}
+
 void TerminalDisplay::scrollScreenWindow(enum ScreenWindow::RelativeScrollMode mode, int amount)
 {
     _screenWindow->scrollBy(mode, amount, _scrollFullPage);
@@ -2828,6 +4151,9 @@ void TerminalDisplay::keyPressEvent(QKeyEvent* event)
         Q_ASSERT(_cursorBlinking == false);
     }
 
+    _keyPressClock.start();
+    _keyEchoUpdated = false;
+
     emit keyPressedSignal(event);
 
 #if QT_VERSION >= 0x040800 // added in Qt 4.8.0
@@ -2972,11 +4298,11 @@ void TerminalDisplay::visualBell()
 void TerminalDisplay::swapFGBGColors()
 {
     // swap the default foreground & background color
-    ColorEntry color = _colorTable[DEFAULT_BACK_COLOR];
-    _colorTable[DEFAULT_BACK_COLOR] = _colorTable[DEFAULT_FORE_COLOR];
-    _colorTable[DEFAULT_FORE_COLOR] = color;
+    ColorEntry table[TABLE_COLORS];
+    qCopy(colorTable(), colorTable() + TABLE_COLORS, table);
+    qSwap(table[DEFAULT_BACK_COLOR], table[DEFAULT_FORE_COLOR]);
 
-    update();
+    setColors(table);
 }
 
 /* --------------------------------------------------------------------- */
@@ -2997,14 +4323,22 @@ void TerminalDisplay::dragEnterEvent(QDragEnterEvent* event)
     }
 }
 
+// finding the local path of a URL may have to wait for a KIO slave, so
+// this is only done for the URLs of drops with at most this many URLs.
+// Local files need no lookup
+static const int MAX_RESOLVED_DROP_URLS = 16;
+
 void TerminalDisplay::dropEvent(QDropEvent* event)
 {
     KUrl::List urls = KUrl::List::fromMimeData(event->mimeData());
 
     QString dropText;
     if (!urls.isEmpty()) {
+        const bool resolveUrls = urls.count() <= MAX_RESOLVED_DROP_URLS;
         for (int i = 0 ; i < urls.count() ; i++) {
-            KUrl url = KIO::NetAccess::mostLocalUrl(urls[i] , 0);
+            KUrl url = urls[i];
+            if (resolveUrls && !url.isLocalFile())
+                url = KIO::NetAccess::mostLocalUrl(url , 0);
             QString urlText;
 
             if (url.isLocalFile())
@@ -3030,7 +4364,9 @@ void TerminalDisplay::dropEvent(QDropEvent* event)
             // plus an additional Paste option.
 
             QAction* pasteAction = new QAction(i18n("&Paste Location"), this);
-            pasteAction->setData(dropText);
+            QString pasteText = dropText;
+            bracketText(pasteText);
+            pasteAction->setData(pasteText);
             connect(pasteAction, SIGNAL(triggered()), this, SLOT(dropMenuPasteActionTriggered()));
 
             QList<QAction*> additionalActions;
@@ -3066,6 +4402,8 @@ void TerminalDisplay::dropEvent(QDropEvent* event)
 
     if (event->mimeData()->hasFormat("text/plain") ||
             event->mimeData()->hasFormat("text/uri-list")) {
+        // large drops are queued by the pty and written as it accepts them
+        bracketText(dropText);
         emit sendStringToEmu(dropText.toLocal8Bit());
     }
 }
@@ -22,12 +22,17 @@
 #define TERMINALDISPLAY_H
 
 // Qt
+#include <QtCore/QBitArray>
 #include <QtGui/QColor>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QPointer>
+#include <QtGui/QPixmap>
 #include <QWidget>
 
 // Konsole
 #include "Character.h"
+#include "Filter.h"
 #include "konsole_export.h"
 #include "ScreenWindow.h"
 #include "ColorScheme.h"
@@ -48,8 +53,10 @@ class QTimerEvent;
 
 namespace Konsole
 {
-class FilterChain;
-class TerminalImageFilterChain;
+class ColorPalette;
+class FontResource;
+class LineCache;
+class SearchMatchMarkers;
 class SessionController;
 
 /**
@@ -91,6 +98,23 @@ public:
     /** Sets the background picture */
     void setWallpaper(ColorSchemeWallpaper::Ptr p);
 
+    /**
+     * Sets whether the display is drawn in a way which suits displays shown
+     * over a network, such as forwarded X11 or remote desktop sessions,
+     * where every pixel which changes has to be transferred.  The wallpaper
+     * and the opacity are not used, text is drawn without anti-aliasing and
+     * the display is updated at most every LOW_BANDWIDTH_UPDATE_INTERVAL
+     * milliseconds, except to echo the keys which are typed.
+     *
+     * As with setAntialias(), the anti-aliasing changes with the next call
+     * to setVTFont().
+     */
+    void setLowBandwidthRendering(bool enable);
+    /** See setLowBandwidthRendering() */
+    bool lowBandwidthRendering() const {
+        return _lowBandwidthRendering;
+    }
+
     /**
      * Specifies whether the terminal display has a vertical scroll bar, and if so whether it
      * is shown on the left or right side of the display.
@@ -105,6 +129,16 @@ public:
      */
     void setScroll(int cursor, int lines);
 
+    /**
+     * Marks @p lines of the output on the scroll bar, such as the lines
+     * with the matches of a search, so that the user can see where they
+     * are in the whole history.  The lines are in ascending order and
+     * counted from the start of the history.  Lines which are close to
+     * each other share a marker, which is stronger the more lines it
+     * stands for.  An empty list removes the markers.
+     */
+    void setSearchMatchLines(const QList<int>& lines);
+
     void setScrollFullPage(bool fullPage);
     bool scrollFullPage() const;
 
@@ -125,6 +159,11 @@ public:
      * Updates the filters in the display's filter chain.  This will cause
      * the hotspots to be updated to match the current image.
      *
+     * The lines of the image which the filters have not searched before are
+     * searched on another thread, so the hotspots may only be updated after
+     * this returns.  If the image has changed again by then, the results
+     * are used for the next update instead.
+     *
      * WARNING:  This function can be expensive depending on the
      * image size and number of filters in the filterChain()
      *
@@ -382,6 +421,7 @@ public:
      */
     void setAntialias(bool value) {
         _antialiasText = value;
+        releaseLineCache();
     }
     /**
      * Returns true if anti-aliasing of text in the terminal is enabled.
@@ -396,6 +436,8 @@ public:
      */
     void setBoldIntense(bool value) {
         _boldIntense = value;
+        releaseLineCache();
+        _fragmentStyles.clear();
     }
     /**
      * Returns true if characters with intense colors are rendered in bold.
@@ -427,6 +469,7 @@ public:
      */
     void setBidiEnabled(bool set) {
         _bidiEnabled = set;
+        releaseLineCache();
     }
     /**
      * Returns the status of the BiDi rendering in this widget.
@@ -447,7 +490,41 @@ public:
     /** Returns the terminal screen section which is displayed in this widget.  See setScreenWindow() */
     ScreenWindow* screenWindow() const;
 
-    void printContent(QPainter& painter, bool friendly);
+    /** Totals about updating and painting the display. */
+    struct PaintStatistics {
+        /** Number of times the image was updated from the screen window */
+        qint64 updateCount;
+        /** Number of updates which were skipped while the display was hidden */
+        qint64 skippedUpdates;
+        /** Time spent in updateImage(), in microseconds */
+        qint64 updateTime;
+        /** Number of paint events */
+        qint64 paintCount;
+        /** Time spent painting, in microseconds */
+        qint64 paintTime;
+        /** Time spent finding and painting the filters' hotspots, in microseconds */
+        qint64 filterTime;
+        /** Number of key presses whose echo was painted */
+        qint64 keyEchoCount;
+        /** Time from the key presses until their echo was painted, in microseconds */
+        qint64 keyEchoTime;
+        /** The longest time from a key press until its echo was painted, in microseconds */
+        qint64 maximumKeyEchoTime;
+    };
+
+    /** Returns the totals about updating and painting the display. */
+    const PaintStatistics& paintStatistics() const {
+        return _paintStatistics;
+    }
+
+    /**
+     * Returns the number of bytes of memory used by the image of the
+     * display, the caches of its drawing and the buffers of its screen
+     * window.
+     */
+    qint64 memoryUsage() const;
+    /** Returns the number of bytes of memory used by the filter chain. */
+    qint64 filterMemoryUsage() const;
 
 public slots:
     /**
@@ -462,6 +539,13 @@ public slots:
      * terminal screen ( see setScreenWindow() ) and redraw the display.
      */
     void updateImage();
+
+    /**
+     * Frees the caches which are only needed while the display is shown,
+     * if it is hidden.  This is done once the display has been hidden for
+     * a while.
+     */
+    void releaseHiddenResources();
     /**
      * Causes the terminal display to fetch the latest line status flags from the
      * associated terminal screen ( see setScreenWindow() ).
@@ -531,6 +615,46 @@ public slots:
     /** See setUsesMouse() */
     bool usesMouse() const;
 
+    /**
+     * Sets whether the program whose output is being displayed in the view
+     * wants pasted and dropped text to be surrounded by ESC[200~ and
+     * ESC[201~.  See Emulation::programBracketedPasteMode()
+     */
+    void setBracketedPasteMode(bool bracketedPasteMode);
+
+    /** See setBracketedPasteMode() */
+    bool bracketedPasteMode() const;
+
+    /**
+     * Returns false while the display is hidden, because it is in a
+     * background tab or its window is minimized.
+     */
+    bool isDisplayed() const {
+        return !_hidden;
+    }
+
+    /**
+     * Shows or hides a small indicator in the corner of the view which
+     * tells the user that updates are capped because the program running
+     * in the terminal produces output faster than it can be displayed.
+     */
+    void setFloodModeIndicatorVisible(bool visible);
+
+    /**
+     * Shows the progress of sending a large amount of input, such as a
+     * big paste, to the terminal.  The progress is shown together with a
+     * link which emits cancelInputRequest() when activated, and hidden
+     * once @p sent reaches @p total.
+     */
+    void showInputProgress(qint64 sent, qint64 total);
+
+    /**
+     * Shows @p text, such as performance statistics, in a small overlay in
+     * the bottom right corner of the view.  The overlay is hidden if
+     * @p text is empty.
+     */
+    void setStatisticsText(const QString& text);
+
     /**
      * Shows a notification that a bell event has occurred in the terminal.
      * TODO: More documentation here
@@ -562,6 +686,13 @@ signals:
      */
     void keyPressedSignal(QKeyEvent* event);
 
+    /**
+     * Emitted instead of keyPressedSignal() for a key which is pressed
+     * @p count times in a row, such as the cursor keys which the mouse
+     * wheel is translated into.
+     */
+    void keyRepeatedSignal(QKeyEvent* event, int count);
+
     /**
      * A mouse event occurred.
      * @param button The mouse button (0 for left button, 1 for middle button, 2 for right button, 3 for release)
@@ -594,6 +725,18 @@ signals:
 
     void sendStringToEmu(const char*);
 
+    /**
+     * Emitted when the user asks to stop sending the input whose progress
+     * is shown.  See showInputProgress()
+     */
+    void cancelInputRequest();
+
+    /**
+     * Emitted when the display is shown after it was hidden, before it
+     * catches up with the output received in the meantime.
+     */
+    void displayShown();
+
 protected:
     virtual bool event(QEvent* event);
 
@@ -637,6 +780,12 @@ protected:
     //     - Part of a word (returns 'a')
     //     - Other characters (returns the input character)
     QChar charClass(const Character& ch) const;
+    // returns the table of the word characters used by charClass()
+    static QBitArray wordCharacterTable(const QString& wordCharacters);
+    // returns the class of the character at 'position' in _image, the
+    // classes of a line are kept until the line changes, so that extending
+    // a selection by words does not classify the same characters again
+    QChar cachedCharClass(int position);
 
     void clearImage();
 
@@ -665,21 +814,44 @@ private slots:
 
     void dropMenuCdActionTriggered();
 
+    // tells assistive technology about the changes of the text and the
+    // cursor since the last notification
+    void notifyAccessibility();
+
+    // handles the latest mouse move, see mouseMoveEvent()
+    void processMouseMove();
+
+    // sends the cursor key presses which the wheel rotation collected in
+    // _wheelKeyDelta amounts to, see wheelEvent()
+    void sendWheelKeys();
+
+    // publishes the results of the filter searches started by processFilters()
+    void filterSearchesFinished();
+
 private:
     // -- Drawing helpers --
 
+    // lets go of the cached lines once the way lines are rendered changes,
+    // the cache for the new settings is acquired by drawCachedLine()
+    void releaseLineCache();
+
     // divides the part of the display specified by 'rect' into
     // fragments according to their colors and styles and calls
-    // drawTextFragment() or drawPrinterFriendlyTextFragment()
-    // to draw the fragments
+    // drawTextFragment() to draw the fragments
     void drawContents(QPainter& painter, const QRect& rect);
+    // draws the part of 'line' inside 'rect' from the line cache, rendering
+    // the line into the cache first if the rect covers the whole line.
+    // returns false if the line has to be drawn by drawContents() instead
+    bool drawCachedLine(QPainter& painter, const QRect& rect, int line);
+    // draws the out of date parts of the text layer, which is composited
+    // over the wallpaper by paintEvent()
+    void updateTextLayer();
+    // draws the selected cells inside 'region' with their colors reversed
+    void drawSelection(QPainter& painter, const QRegion& region);
     // draws a section of text, all the text in this section
     // has a common color and style
     void drawTextFragment(QPainter& painter, const QRect& rect,
                           const QString& text, const Character* style);
-
-    void drawPrinterFriendlyTextFragment(QPainter& painter, const QRect& rect,
-                                         const QString& text, const Character* style);
     // draws the background for a text fragment
     // if useOpacitySetting is true then the color's alpha value will be set to
     // the display's transparency (set with setOpacity()), otherwise the background
@@ -689,9 +861,26 @@ private:
     // draws the cursor character
     void drawCursor(QPainter& painter, const QRect& rect , const QColor& foregroundColor,
                     const QColor& backgroundColor , bool& invertColors);
-    // draws the characters or line graphics in a text fragment
+    // draws the characters or line graphics in a text fragment.  'background'
+    // is the color which the fragment is drawn on, or an invalid color if the
+    // text is drawn on anything else, such as the cursor or a wallpaper
     void drawCharacters(QPainter& painter, const QRect& rect,  const QString& text,
-                        const Character* style, bool invertCharacterColor);
+                        const Character* style, bool invertCharacterColor,
+                        const QColor& background);
+    // draws the characters of a text fragment one at a time using the glyph
+    // cache, each of them in one cell or, for double width characters, in
+    // two.  returns false without drawing anything if the text cannot
+    // be drawn that way, in which case it has to go through the text shaper
+    bool drawCachedGlyphs(QPainter& painter, const QRect& rect, const QString& text,
+                          const QColor& color, const QColor& background);
+    // returns the glyph of 'codePoint' in the variant 'variant' from the
+    // glyph cache, rendering it on 'background' if it is not cached yet.
+    // The glyph is a null pixmap if it does not fit into its cells
+    const QPixmap* cachedGlyph(uint codePoint, quint32 variant, const QFont& font,
+                               const QColor& color, const QColor& background, int glyphWidth);
+    // returns the color which text of the background color 'color' is drawn
+    // on, or an invalid color if it is not a single color, see drawCharacters()
+    QColor textBackground(const QColor& color) const;
     // draws a string of line graphics
     void drawLineCharString(QPainter& painter, int x, int y,
                             const QString& str, const Character* attributes);
@@ -730,9 +919,24 @@ private:
 
     void paintFilters(QPainter& painter);
 
-    // returns a region covering all of the areas of the widget which contain
-    // a hotspot
-    QRegion hotSpotRegion() const;
+    // adds the time from the last key press until its echo was painted to
+    // the paint statistics
+    void recordKeyLatency();
+
+    // returns the area of the lines whose hotspots differ between the indexes
+    QRegion hotSpotRegion(const HotSpotIndex& index, const HotSpotIndex& previousIndex) const;
+    // processes the filter chain and repaints the hotspots which changed
+    void updateHotSpots();
+
+    // returns a region covering the first 'columnCount' columns of the lines
+    // whose bits are set in 'lines', checking the first 'lineCount' lines
+    QRegion linesToRegion(const QBitArray& lines, int lineCount, int columnCount) const;
+
+    // returns the area of the cells in _selectedColumns
+    QRegion selectionRegion() const;
+    // fetches the selected columns from the screen window and repaints
+    // the cells which were selected or deselected
+    void updateSelection();
 
     // returns the position of the cursor in columns and lines
     QPoint cursorPosition() const;
@@ -740,9 +944,35 @@ private:
     // redraws the cursor
     void updateCursor();
 
+    // switches to the palette of 'table' and redraws the display
+    void setColors(const ColorEntry* table);
+    // returns the color for 'color' in the current color table
+    QColor resolveColor(const CharacterColor& color) const {
+        const int index = color.paletteIndex();
+        return index >= 0 ? _colorPalette->color(index) : color.color(colorTable());
+    }
+
+    // the colors and the weight with which a text fragment is drawn
+    struct FragmentStyle {
+        QColor foreground;
+        QColor background;
+        bool bold;
+    };
+    // returns the colors and weight of the fragment with the attributes of
+    // 'style', which are resolved once for each distinct set of attributes
+    const FragmentStyle& resolveStyle(const Character* style);
+
     bool handleShortcutOverrideEvent(QKeyEvent* event);
 
     void doPaste(QString text, bool appendReturn);
+    // surrounds 'text' with the bracketed paste markers if the program
+    // asked for them, see setBracketedPasteMode()
+    void bracketText(QString& text) const;
+
+    // copies the current selection to the X11 selection and/or to the
+    // clipboard.  The text of large selections is only read from the
+    // screen once it is pasted
+    void copySelection(bool toSelection, bool toClipboard);
 
     void processMidButtonClick(QMouseEvent* event);
 
@@ -780,15 +1010,32 @@ private:
     // only the area [usedLines][usedColumns] in the image contains valid data
 
     int _imageSize;
+    // false if _image may differ from the last image retrieved from the
+    // screen window, in which case all lines need to be compared
+    bool _imageInSync;
+    // the generations of the ExtendedCharTable and the table of RGB colors
+    // when _image was last updated.  Once they change, cells of _image may
+    // stand for other characters and colors than the same cells of the
+    // screen window, so all of the cells are repainted
+    quint64 _extendedCharsGeneration;
+    quint64 _rgbColorsGeneration;
     QVector<LineProperty> _lineProperties;
 
-    ColorEntry _colorTable[TABLE_COLORS];
+    ColorPalette* _colorPalette; // the color table and the resolved colors
     uint _randomSeed;
 
     bool _resizing;
+    bool _hidden; // the display is hidden or its window is minimized
+    QTimer* _releaseTimer; // see releaseHiddenResources()
+
+    // started by a key press and invalidated once the output which followed
+    // it has been painted, see recordKeyLatency()
+    QElapsedTimer _keyPressClock;
+    bool _keyEchoUpdated; // the image was updated since the key press
     bool _showTerminalSizeHint;
     bool _bidiEnabled;
     bool _mouseMarks;
+    bool _bracketedPasteMode;
 
     QPoint  _iPntSel; // initial selection point
     QPoint  _pntSel; // current selection point
@@ -805,7 +1052,13 @@ private:
     QScrollBar* _scrollBar;
     Enum::ScrollBarPositionEnum _scrollbarLocation;
     bool _scrollFullPage;
+    // shows the lines passed to setSearchMatchLines(), created when
+    // there are some
+    SearchMatchMarkers* _searchMatchMarkers;
     QString     _wordCharacters;
+    // the characters of the basic multilingual plane which are part of
+    // words, see wordCharacterTable()
+    QBitArray   _wordCharacterTable;
     int         _bellMode;
 
     bool _allowBlinkingText;  // allow text to blink
@@ -813,9 +1066,30 @@ private:
     bool _textBlinking;   // text is blinking, hide it when drawing
     bool _cursorBlinking;     // cursor is blinking, hide it when drawing
     bool _hasTextBlinker; // has characters to blink
+    QBitArray _blinkingLines; // the lines of _image which have characters to blink
+
+    // the selected columns of each line of _image, from x() to y().  The
+    // selection is not part of _image, it is drawn over the text by
+    // drawSelection()
+    QVector<QPoint> _selectedColumns;
     QTimer* _blinkTextTimer;
     QTimer* _blinkCursorTimer;
 
+    // the text of the lines of _image for assistive technology.  It is
+    // decoded when asked for, and then only for the lines which changed
+    QString accessibleText();
+    // sends the notifications of changes right away after a quiet moment,
+    // but at most once per ACCESSIBILITY_UPDATE_INTERVAL during a burst
+    void scheduleAccessibilityUpdate();
+
+    QVector<QString> _accessibleLines;
+    QBitArray _accessibleLinesStale; // the lines of _accessibleLines to decode again
+    QString _accessibleText;         // _accessibleLines joined together
+    bool _accessibleTextChanged;     // the text changed since the last notification
+    QPoint _accessibleCursor;        // the cursor position of the last notification
+    QTimer* _accessibilityTimer;
+    QElapsedTimer _accessibilityClock; // started by each notification
+
     bool _underlineLinks;     // Underline URL and hosts on mouse hover
     bool _openLinksByDirectClick;     // Open URL and hosts by single mouse click
     bool _isFixedSize; // columns/lines are locked.
@@ -835,6 +1109,12 @@ private:
     //terminal output - informing them what has happened and how to resume output
     QLabel* _outputSuspendedLabel;
 
+    QLabel* _floodModeLabel;
+    QLabel* _inputProgressLabel;
+    QLabel* _statisticsLabel;
+
+    PaintStatistics _paintStatistics;
+
     uint _lineSpacing;
 
     QSize _size;
@@ -843,10 +1123,62 @@ private:
 
     ColorSchemeWallpaper::Ptr _wallpaper;
 
+    // the wallpaper and the opacity which were set, they are not used while
+    // the display is in low bandwidth mode, see setLowBandwidthRendering()
+    ColorSchemeWallpaper::Ptr _requestedWallpaper;
+    qreal _opacity;
+    bool _lowBandwidthRendering;
+    QElapsedTimer _lowBandwidthUpdateClock; // started by each update in that mode
+    QTimer* _lowBandwidthUpdateTimer;       // makes the update which was held back
+
+    // the text drawn over the wallpaper, so that it can be scrolled
+    // separately from the wallpaper
+    QPixmap _textLayer;
+    // the part of the text layer which needs to be drawn again
+    QRegion _textLayerDirty;
+
     // list of filters currently applied to the display.  used for links and
     // search highlight
     TerminalImageFilterChain* _filterChain;
     QRegion _mouseOverHotspotArea;
+    // the cell whose hotspot was last looked up by handleMouseMove(), the
+    // lookup is repeated once the mouse leaves it or the hotspots change
+    QPoint _hotSpotCell;
+
+    // see cachedCharClass()
+    QVector<QChar> _charClasses;
+    QBitArray _charClassLines; // the lines of _charClasses which are up to date
+
+    // mouse moves are handled at most once per MOUSE_MOVE_INTERVAL, and
+    // only the latest of them matters
+    void handleMouseMove(QMouseEvent* event);
+    // handles the mouse move which is still waiting for the timer, so that
+    // it is not handled after a following button press or release
+    void flushMouseMove();
+
+    QPoint _mouseMovePosition;
+    Qt::MouseButtons _mouseMoveButtons;
+    Qt::KeyboardModifiers _mouseMoveModifiers;
+    QTimer* _mouseMoveTimer;
+    QElapsedTimer _mouseMoveClock; // started when a mouse move is handled
+
+    // the wheel rotation, in eighths of a degree, which has not been sent
+    // as cursor key presses yet.  Wheel events are collected for up to
+    // WHEEL_KEY_INTERVAL, so that the many small events of a touchpad
+    // become a single write to the terminal
+    int _wheelKeyDelta;
+    QTimer* _wheelKeyTimer;
+
+    // the cell and button of the last motion report sent to the terminal
+    // program, reports for the same cell are not repeated
+    QPoint _lastMouseReport;
+    int _lastMouseReportButton;
+    // the filter searches running on another thread, and the generation of
+    // the filter chain's image they were started for.  the generation is
+    // increased each time the image is set
+    QFutureWatcher<QList<RegExpFilter::Search> >* _filterSearchWatcher;
+    int _filterGeneration;
+    int _filterSearchGeneration;
 
     Enum::CursorShapeEnum _cursorShape;
 
@@ -862,14 +1194,60 @@ private:
 
     bool _antialiasText;   // do we anti-alias or not
 
-    bool _printerFriendly; // are we currently painting to a printer in black/white mode
+    // the metrics and rendered glyphs of the font, the glyphs are keyed by
+    // character, glyph variant and color
+    FontResource* _fontResource;
+
+    // rendered lines, shared with the displays which draw lines the same
+    // way.  Acquired when a line is first drawn, see releaseLineCache()
+    LineCache* _lineCache;
+    // resolved fragment styles, keyed by the colors and the bold rendition,
+    // see resolveStyle()
+    QHash<quint64, FragmentStyle> _fragmentStyles;
+    bool _renderingCachedLine; // a line is being rendered into the line cache
+
+    // flags identifying the variant of a glyph in the glyph cache.  The key
+    // of a glyph holds its color in the upper 32 bits of the first member
+    // and its background color, or 0 for a transparent background, in the
+    // lower ones.  The second member holds its variant shifted by
+    // GLYPH_VARIANT_SHIFT and its code point
+    enum GlyphVariant {
+        BOLD_GLYPH = 1,
+        UNDERLINE_GLYPH = 2,
+        LINE_CHAR_GLYPH = 4,  // box-drawing character drawn by drawLineChar()
+        WIDE_GLYPH = 8        // character which occupies two cells
+    };
+    static const int GLYPH_VARIANT_SHIFT = 24;
 
     //the delay in milliseconds between redrawing blinking text
     static const int TEXT_BLINK_DELAY = 500;
 
+    //the minimum time in milliseconds between notifications of assistive technology
+    static const int ACCESSIBILITY_UPDATE_INTERVAL = 100;
+
+    //the minimum time in milliseconds between the handling of two mouse moves,
+    //about one frame
+    static const int MOUSE_MOVE_INTERVAL = 16;
+
+    //the time in milliseconds for which wheel rotation is collected before
+    //it is sent as cursor key presses, about one frame
+    static const int WHEEL_KEY_INTERVAL = 16;
+
     //the duration of the size hint in milliseconds
     static const int SIZE_HINT_DURATION = 1000;
 
+    // the number of resolved fragment styles after which they are resolved
+    // anew, more than most applications use
+    static const int FRAGMENT_STYLE_CACHE_SIZE = 1024;
+
+    // the time in milliseconds after which a hidden display frees its
+    // caches.  With many tabs, most displays are hidden most of the time
+    static const int HIDDEN_RELEASE_DELAY = 60 * 1000;
+
+    // the minimum time in milliseconds between two updates of the display
+    // in low bandwidth mode
+    static const int LOW_BANDWIDTH_UPDATE_INTERVAL = 50;
+
     static const int DEFAULT_LEFT_MARGIN = 1;
     static const int DEFAULT_TOP_MARGIN = 1;
 
@@ -94,10 +94,12 @@ QString TerminalDisplayAccessible::visibleText() const
 {
     // This function should be const to allow calling it from const interface functions.
     TerminalDisplay* display = const_cast<TerminalDisplayAccessible*>(this)->display();
-    if (!display->screenWindow())
+    if (!display->screenWindow() || !display->_image)
         return QString();
 
-    return display->screenWindow()->screen()->text(0, display->_usedColumns * display->_usedLines, true);
+    // the interface is created anew for each query, the display keeps the
+    // decoded text between them
+    return display->accessibleText();
 }
 
 void TerminalDisplayAccessible::addSelection(int startOffset, int endOffset)
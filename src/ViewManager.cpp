@@ -23,6 +23,7 @@
 // Qt
 #include <QtCore/QSignalMapper>
 #include <QtCore/QStringList>
+#include <QtCore/QTimer>
 #include <QMenu>
 #include <QtDBus/QtDBus>
 
@@ -52,6 +53,10 @@ using namespace Konsole;
 
 int ViewManager::lastManagerId = 0;
 
+// the delay, in milliseconds, between starting two of the sessions of
+// restoreSessions() which are not shown at first
+static const int RESTORE_SESSION_DELAY = 50;
+
 ViewManager::ViewManager(QObject* parent , KActionCollection* collection)
     : QObject(parent)
     , _viewSplitter(0)
@@ -518,6 +523,8 @@ void ViewManager::controllerChanged(SessionController* controller)
 
     _viewSplitter->setFocusProxy(controller->view());
 
+    startPendingSession(controller->session());
+
     _pluggedController = controller;
     emit activeViewChanged(controller);
 }
@@ -724,6 +731,7 @@ void ViewManager::viewDestroyed(QWidget* view)
     // 2. if the session has no views left, close it
     Session* session = _sessionMap[ display ];
     _sessionMap.remove(display);
+    _pendingProfileViews.remove(display);
     if (session) {
         display->deleteLater();
 
@@ -773,6 +781,7 @@ void ViewManager::applyProfileToView(TerminalDisplay* view , const Profile::Ptr
     const ColorScheme* colorScheme = colorSchemeForProfile(profile);
     colorScheme->getColorTable(table , view->randomSeed());
     view->setColorTable(table);
+    view->setLowBandwidthRendering(profile->lowBandwidthRendering());
     view->setOpacity(colorScheme->opacity());
     view->setWallpaper(colorScheme->wallpaper());
 
@@ -854,10 +863,33 @@ void ViewManager::updateViewsForSession(Session* session)
     const Profile::Ptr profile = SessionManager::instance()->sessionProfile(session);
 
     foreach(TerminalDisplay* view, _sessionMap.keys(session)) {
+        updateView(view, profile);
+    }
+}
+
+void ViewManager::updateView(TerminalDisplay* view, const Profile::Ptr profile)
+{
+    if (view->isDisplayed()) {
+        _pendingProfileViews.remove(view);
         applyProfileToView(view, profile);
+    } else {
+        _pendingProfileViews.insert(view);
+        connect(view, SIGNAL(displayShown()), this, SLOT(applyPendingProfile()),
+                Qt::UniqueConnection);
     }
 }
 
+void ViewManager::applyPendingProfile()
+{
+    TerminalDisplay* view = qobject_cast<TerminalDisplay*>(sender());
+    if (!view || !_pendingProfileViews.remove(view))
+        return;
+
+    Session* session = _sessionMap.value(view);
+    if (session)
+        applyProfileToView(view, SessionManager::instance()->sessionProfile(session));
+}
+
 void ViewManager::profileChanged(Profile::Ptr profile)
 {
     // update all views associated with this profile
@@ -869,7 +901,7 @@ void ViewManager::profileChanged(Profile::Ptr profile)
         if (iter.key() != 0 &&
                 iter.value() != 0 &&
                 SessionManager::instance()->sessionProfile(iter.value()) == profile) {
-            applyProfileToView(iter.key(), profile);
+            updateView(iter.key(), profile);
         }
     }
 }
@@ -932,21 +964,36 @@ void ViewManager::restoreSessions(const KConfigGroup& group)
     int activeTab  = group.readEntry("Active", 0);
     TerminalDisplay* display = 0;
 
+    // only the active session is started right away, the others are started
+    // one after another once the window has been shown.  starting a shell
+    // is what takes the time, and the views of the tabs in the background
+    // do not allocate their images until they are shown
+    Session* activeSession = 0;
     int tab = 1;
     foreach(int id, ids) {
         Session* session = SessionManager::instance()->idToSession(id);
         createView(session);
-        if (!session->isRunning())
-            session->run();
-        if (tab++ == activeTab)
+        if (tab++ == activeTab) {
             display = qobject_cast<TerminalDisplay*>(activeView());
+            activeSession = session;
+        }
+        if (!session->isRunning())
+            _pendingSessions << session;
     }
 
+    if (!activeSession && !_pendingSessions.isEmpty())
+        activeSession = _pendingSessions.first();
+    if (activeSession)
+        startPendingSession(activeSession);
+
     if (display) {
         _viewSplitter->activeContainer()->setActiveView(display);
         display->setFocus(Qt::OtherFocusReason);
     }
 
+    if (!_pendingSessions.isEmpty())
+        QTimer::singleShot(RESTORE_SESSION_DELAY, this, SLOT(startRestoredSession()));
+
     if (ids.isEmpty()) { // Session file is unusable, start default Profile
         Profile::Ptr profile = ProfileManager::instance()->defaultProfile();
         Session* session = SessionManager::instance()->createSession(profile);
@@ -956,6 +1003,26 @@ void ViewManager::restoreSessions(const KConfigGroup& group)
     }
 }
 
+void ViewManager::startRestoredSession()
+{
+    while (!_pendingSessions.isEmpty()) {
+        QPointer<Session> session = _pendingSessions.takeFirst();
+        if (session && !session->isRunning()) {
+            session->run();
+            break;
+        }
+    }
+
+    if (!_pendingSessions.isEmpty())
+        QTimer::singleShot(RESTORE_SESSION_DELAY, this, SLOT(startRestoredSession()));
+}
+
+void ViewManager::startPendingSession(Session* session)
+{
+    if (session && _pendingSessions.removeAll(session) > 0 && !session->isRunning())
+        session->run();
+}
+
 uint qHash(QPointer<TerminalDisplay> display)
 {
     return qHash((TerminalDisplay*)display);
@@ -978,25 +1045,22 @@ int ViewManager::currentSession()
 int ViewManager::newSession()
 {
     Profile::Ptr profile = ProfileManager::instance()->defaultProfile();
-    Session* session = SessionManager::instance()->createSession(profile);
+    Session* session = SessionManager::instance()->takeSpareSession(profile, QString());
+    if (!session)
+        session = SessionManager::instance()->createSession(profile);
 
     this->createView(session);
-    session->run();
+    if (!session->isRunning())
+        session->run();
 
     return session->sessionId();
 }
 
 int ViewManager::newSession(QString profile, QString directory)
 {
-    const QList<Profile::Ptr> profilelist = ProfileManager::instance()->allProfiles();
-    Profile::Ptr profileptr = ProfileManager::instance()->defaultProfile();
-
-    for (int i = 0; i < profilelist.size(); ++i) {
-        if (profilelist.at(i)->name() == profile) {
-            profileptr = profilelist.at(i);
-            break;
-        }
-    }
+    Profile::Ptr profileptr = ProfileManager::instance()->findByName(profile);
+    if (!profileptr)
+        profileptr = ProfileManager::instance()->defaultProfile();
 
     Session* session = SessionManager::instance()->createSession(profileptr);
     session->setInitialWorkingDirectory(directory);
@@ -1044,6 +1108,11 @@ void ViewManager::setTabWidthToText(bool useTextWidth)
     container->setNavigationTextMode(useTextWidth);
 }
 
+void ViewManager::trimIdleSessions()
+{
+    SessionManager::instance()->trimIdleSessions();
+}
+
 void ViewManager::closeTabFromContainer(ViewContainer* container, QWidget* tab)
 {
     SessionController* controller = qobject_cast<SessionController*>(container->viewProperties(tab));
@@ -24,6 +24,7 @@
 #include <QtCore/QHash>
 #include <QtCore/QObject>
 #include <QtCore/QPointer>
+#include <QtCore/QSet>
 
 // Konsole
 #include "Profile.h"
@@ -271,6 +272,12 @@ public slots:
     /** DBus slot that sets ALL tabs' width to match their text */
     Q_SCRIPTABLE void setTabWidthToText(bool);
 
+    /** DBus slot that gives back the memory of the sessions which are
+      * not shown in any view at the moment, see
+      * SessionManager::trimIdleSessions()
+      */
+    Q_SCRIPTABLE void trimIdleSessions();
+
 private slots:
     // called when the "Split View Left/Right" menu item is selected
     void splitLeftRight();
@@ -320,6 +327,10 @@ private slots:
 
     void updateViewsForSession(Session* session);
 
+    // applies the profile of its session to a view which was hidden when
+    // the profile changed, see updateView()
+    void applyPendingProfile();
+
     // moves active view to the left
     void moveActiveViewLeft();
     // moves active view to the right
@@ -339,6 +350,9 @@ private slots:
 
     void closeTabFromContainer(ViewContainer* container, QWidget* view);
 
+    // starts the next of the restored sessions which are still waiting
+    void startRestoredSession();
+
 private:
     void createView(Session* session, ViewContainer* container, int index);
     static const ColorScheme* colorSchemeForProfile(const Profile::Ptr profile);
@@ -366,12 +380,27 @@ private:
     // about the session ( such as title and associated icon ) to the display.
     SessionController* createController(Session* session , TerminalDisplay* display);
 
+    // starts 'session' right away if it is one of the restored sessions
+    // which are still waiting for their turn
+    void startPendingSession(Session* session);
+
+    // applies 'profile' to 'view' if it is displayed, or once it is shown
+    // otherwise.  Changing the font or the colors of a view repaints and
+    // possibly resizes it, which is not worth doing for views nobody sees
+    void updateView(TerminalDisplay* view, const Profile::Ptr profile);
+
 private:
     QPointer<ViewSplitter>          _viewSplitter;
     QPointer<SessionController>     _pluggedController;
 
     QHash<TerminalDisplay*, Session*> _sessionMap;
 
+    // the views whose profile changed while they were hidden
+    QSet<TerminalDisplay*> _pendingProfileViews;
+
+    // the sessions of restoreSessions() which are yet to be started
+    QList<QPointer<Session> > _pendingSessions;
+
     KActionCollection*                  _actionCollection;
     QSignalMapper*                      _containerSignalMapper;
 
@@ -25,6 +25,7 @@
 
 // Standard
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 // Qt
@@ -67,12 +68,14 @@ unsigned short Konsole::vt100_graphics[32] = {
 
 Vt102Emulation::Vt102Emulation()
     : Emulation(),
-      _titleUpdateTimer(new QTimer(this))
+      _parser(this),
+      _titleUpdateTimer(new QTimer(this)),
+      _keySequenceTranslator(0),
+      _keySequenceCodec(0)
 {
     _titleUpdateTimer->setSingleShot(true);
     QObject::connect(_titleUpdateTimer , SIGNAL(timeout()) , this , SLOT(updateTitle()));
 
-    initTokenizer();
     reset();
 }
 
@@ -91,12 +94,14 @@ void Vt102Emulation::reset()
     // Ideally we would want to use the profile setting
     const QTextCodec* currentCodec = codec();
 
-    resetTokenizer();
+    _parser.reset();
+    _binaryOutput = false;
     resetModes();
     resetCharset(0);
     _screen[0]->reset();
     resetCharset(1);
-    _screen[1]->reset();
+    if (_screen[1])
+        _screen[1]->reset();
 
     if (currentCodec)
         setCodec(currentCodec);
@@ -121,7 +126,7 @@ void Vt102Emulation::reset()
 
    The pipeline proceeds as follows:
 
-   - Tokenizing the ESC codes (onReceiveChar)
+   - Tokenizing the ESC codes (Vt102Parser)
    - VT100 code page translation of plain characters (applyCharset)
    - Interpretation of ESC codes (processToken)
 
@@ -129,301 +134,282 @@ void Vt102Emulation::reset()
    technical reference of this program.
 */
 
-// Tokens ------------------------------------------------------------------ --
-
-/*
-   Since the tokens are the central notion if this section, we've put them
-   in front. They provide the syntactical elements used to represent the
-   terminals operations as byte sequences.
-
-   They are encodes here into a single machine word, so that we can later
-   switch over them easily. Depending on the token itself, additional
-   argument variables are filled with parameter values.
-
-   The tokens are defined below:
-
-   - CHR        - Printable characters     (32..255 but DEL (=127))
-   - CTL        - Control characters       (0..31 but ESC (= 27), DEL)
-   - ESC        - Escape codes of the form <ESC><CHR but `[]()+*#'>
-   - ESC_DE     - Escape codes of the form <ESC><any of `()+*#%'> C
-   - CSI_PN     - Escape codes of the form <ESC>'['     {Pn} ';' {Pn} C
-   - CSI_PS     - Escape codes of the form <ESC>'['     {Pn} ';' ...  C
-   - CSI_PR     - Escape codes of the form <ESC>'[' '?' {Pn} ';' ...  C
-   - CSI_PE     - Escape codes of the form <ESC>'[' '!' {Pn} ';' ...  C
-   - VT52       - VT52 escape codes
-                  - <ESC><Chr>
-                  - <ESC>'Y'{Pc}{Pc}
-   - XTE_HA     - Xterm window/terminal attribute commands
-                  of the form <ESC>`]' {Pn} `;' {Text} <BEL>
-                  (Note that these are handled differently to the other formats)
-
-   The last two forms allow list of arguments. Since the elements of
-   the lists are treated individually the same way, they are passed
-   as individual tokens to the interpretation. Further, because the
-   meaning of the parameters are names (although represented as numbers),
-   they are includes within the token ('N').
-
-*/
-
-#define TY_CONSTRUCT(T,A,N) ( ((((int)N) & 0xffff) << 16) | ((((int)A) & 0xff) << 8) | (((int)T) & 0xff) )
-
-#define TY_CHR(   )     TY_CONSTRUCT(0,0,0)
-#define TY_CTL(A  )     TY_CONSTRUCT(1,A,0)
-#define TY_ESC(A  )     TY_CONSTRUCT(2,A,0)
-#define TY_ESC_CS(A,B)  TY_CONSTRUCT(3,A,B)
-#define TY_ESC_DE(A  )  TY_CONSTRUCT(4,A,0)
-#define TY_CSI_PS(A,N)  TY_CONSTRUCT(5,A,N)
-#define TY_CSI_PN(A  )  TY_CONSTRUCT(6,A,0)
-#define TY_CSI_PR(A,N)  TY_CONSTRUCT(7,A,N)
-
-#define TY_VT52(A)    TY_CONSTRUCT(8,A,0)
-#define TY_CSI_PG(A)  TY_CONSTRUCT(9,A,0)
-#define TY_CSI_PE(A)  TY_CONSTRUCT(10,A,0)
-
-const int MAX_ARGUMENT = 4096;
-
-// Tokenizer --------------------------------------------------------------- --
-
-/* The tokenizer's state
-
-   The state is represented by the buffer (tokenBuffer, tokenBufferPos),
-   and accompanied by decoded arguments kept in (argv,argc).
-   Note that they are kept internal in the tokenizer.
-*/
+#define CHARSET _charset[_currentScreen==_screen[1]]
+const int ESC = 27;
+const int DEL = 127;
 
-void Vt102Emulation::resetTokenizer()
+// process an incoming unicode character
+void Vt102Emulation::receiveChar(int cc)
 {
-    tokenBufferPos = 0;
-    argc = 0;
-    argv[0] = 0;
-    argv[1] = 0;
+  _parser.receiveChar(cc);
 }
-
-void Vt102Emulation::addDigit(int digit)
+// process a run of incoming unicode characters
+//
+// runs of printable characters which arrive while no escape sequence is
+// being decoded are written to the screen in one go, everything else goes
+// through receiveChar()
+void Vt102Emulation::receiveChars(const ushort* chars, int count)
 {
-    if (argv[argc] < MAX_ARGUMENT)
-        argv[argc] = 10 * argv[argc] + digit;
+  int i = 0;
+  while (i < count)
+  {
+    // the VT52 grammar and the VT100 charset translation are left to receiveChar()
+    if (_parser.isInGroundState() && !CHARSET.graphic && !CHARSET.pound)
+    {
+      int end = i;
+      while (end < count && chars[end] >= 32 && chars[end] != DEL && chars[end] != ESC+128)
+        end++;
+
+      if (end > i)
+      {
+        _currentScreen->displayCharacters(chars + i, end - i);
+        addProcessedTokens(end - i);
+        i = end;
+        continue;
+      }
+    }
+
+    receiveChar(chars[i++]);
+  }
 }
 
-void Vt102Emulation::addArgument()
+void Vt102Emulation::resetParser()
 {
-    argc = qMin(argc + 1, MAXARGS - 1);
-    argv[argc] = 0;
+    _parser.reset();
 }
 
-void Vt102Emulation::addToCurrentToken(int cc)
+bool Vt102Emulation::skipScrolledOutput(const char* text, int length, int lineFeeds)
 {
-    tokenBuffer[tokenBufferPos] = cc;
-    tokenBufferPos = qMin(tokenBufferPos + 1, MAX_TOKEN_LENGTH - 1);
+  // the skipped output must leave the cursor on the bottom line of a
+  // region which spans the whole screen, so that the line feeds which
+  // follow it scroll everything it would have written out of sight
+  Screen* screen = _currentScreen;
+  if (!_parser.isInGroundState() || !getMode(MODE_Ansi) ||
+      screen->topMargin() != 0 || screen->bottomMargin() != screen->getLines() - 1 ||
+      screen->getCursorY() + lineFeeds < screen->bottomMargin())
+    return false;
+
+  // only the SGR sequences are processed, they are all complete
+  const char* const end = text + length;
+  const char* p = text;
+  while ((p = static_cast<const char*>(memchr(p, ESC, end - p))) != 0)
+  {
+    do
+      receiveChar(uchar(*p++));
+    while (p < end && !_parser.isInGroundState());
+  }
+
+  screen->clearSelection();
+  screen->setCursorY(screen->getLines());
+  return true;
 }
 
-// Character Class flags used while decoding
-const int CTL =  1;  // Control character
-const int CHR =  2;  // Printable character
-const int CPN =  4;  // TODO: Document me
-const int DIG =  8;  // Digit
-const int SCS = 16;  // Select Character Set
-const int GRP = 32;  // TODO: Document me
-const int CPS = 64;  // Character which indicates end of window resize
+/*
+   The arguments of "ESC[...m" sequences are looked up in a table which
+   describes what each of them changes.  They are all applied to a copy of
+   the current rendition and colors, which is then passed to the screen
+   once for the whole sequence.
+*/
 
-void Vt102Emulation::initTokenizer()
+namespace
 {
-    int i;
-    quint8* s;
-    for (i = 0; i < 256; ++i)
-        charClass[i] = 0;
-    for (i = 0; i < 32; ++i)
-        charClass[i] |= CTL;
-    for (i = 32; i < 256; ++i)
-        charClass[i] |= CHR;
-    for (s = (quint8*)"@ABCDGHILMPSTXZcdfry"; *s; ++s)
-        charClass[*s] |= CPN;
-    // resize = \e[8;<row>;<col>t
-    for (s = (quint8*)"t"; *s; ++s)
-        charClass[*s] |= CPS;
-    for (s = (quint8*)"0123456789"; *s; ++s)
-        charClass[*s] |= DIG;
-    for (s = (quint8*)"()+*%"; *s; ++s)
-        charClass[*s] |= SCS;
-    for (s = (quint8*)"()+*#[]%"; *s; ++s)
-        charClass[*s] |= GRP;
-
-    resetTokenizer();
-}
+enum GraphicRenditionAction
+{
+  RenditionIgnored,
+  RenditionDefault,            // reset the rendition and both colors
+  RenditionSet,                // set the rendition flag 'value'
+  RenditionReset,              // reset the rendition flag 'value'
+  RenditionForeground,         // set the system color 'value'
+  RenditionBackground,
+  RenditionDefaultForeground,
+  RenditionDefaultBackground,
+  RenditionExtendedForeground, // followed by 2;<red>;<green>;<blue> or 5;<index>
+  RenditionExtendedBackground
+};
 
-/* Ok, here comes the nasty part of the decoder.
+struct GraphicRendition
+{
+  quint8 action;
+  quint8 value;
+};
 
-   Instead of keeping an explicit state, we deduce it from the
-   token scanned so far. It is then immediately combined with
-   the current character to form a scanning decision.
+const int GRAPHIC_RENDITION_COUNT = 108;
 
-   This is done by the following defines.
+class GraphicRenditionTable
+{
+public:
+  GraphicRenditionTable()
+  {
+    for (int i = 0; i < GRAPHIC_RENDITION_COUNT; i++)
+      set(i, RenditionIgnored);
+
+    set(0, RenditionDefault);
+    set(1, RenditionSet, RE_BOLD);
+    set(3, RenditionSet, RE_ITALIC);
+    set(4, RenditionSet, RE_UNDERLINE);
+    set(5, RenditionSet, RE_BLINK);
+    set(7, RenditionSet, RE_REVERSE);
+    // 10, 11 and 12 select the font mapping on Linux and are ignored
+    set(22, RenditionReset, RE_BOLD);
+    set(23, RenditionReset, RE_ITALIC);
+    set(24, RenditionReset, RE_UNDERLINE);
+    set(25, RenditionReset, RE_BLINK);
+    set(27, RenditionReset, RE_REVERSE);
+
+    for (int i = 0; i < 8; i++)
+    {
+      set(30 + i, RenditionForeground, i);
+      set(40 + i, RenditionBackground, i);
+      set(90 + i, RenditionForeground, 8 + i);
+      set(100 + i, RenditionBackground, 8 + i);
+    }
 
-   - P is the length of the token scanned so far.
-   - L (often P-1) is the position on which contents we base a decision.
-   - C is a character or a group of characters (taken from 'charClass').
+    set(38, RenditionExtendedForeground);
+    set(39, RenditionDefaultForeground);
+    set(48, RenditionExtendedBackground);
+    set(49, RenditionDefaultBackground);
+  }
 
-   - 'cc' is the current character
-   - 's' is a pointer to the start of the token buffer
-   - 'p' is the current position within the token buffer
+  const GraphicRendition& operator[](int argument) const
+  {
+    return _entries[argument];
+  }
 
-   Note that they need to applied in proper order.
-*/
+private:
+  void set(int argument, GraphicRenditionAction action, int value = 0)
+  {
+    _entries[argument].action = action;
+    _entries[argument].value = value;
+  }
 
-#define lec(P,L,C) (p == (P) && s[(L)] == (C))
-#define lun(     ) (p ==  1  && cc >= 32 )
-#define les(P,L,C) (p == (P) && s[L] < 256 && (charClass[s[(L)]] & (C)) == (C))
-#define eec(C)     (p >=  3  && cc == (C))
-#define ees(C)     (p >=  3  && cc < 256 && (charClass[cc] & (C)) == (C))
-#define eps(C)     (p >=  3  && s[2] != '?' && s[2] != '!' && s[2] != '>' && cc < 256 && (charClass[cc] & (C)) == (C))
-#define epp( )     (p >=  3  && s[2] == '?')
-#define epe( )     (p >=  3  && s[2] == '!')
-#define egt( )     (p >=  3  && s[2] == '>')
-#define Xpe        (tokenBufferPos >= 2 && tokenBuffer[1] == ']')
-#define Xte        (Xpe      && cc ==  7 )
-#define ces(C)     (cc < 256 && (charClass[cc] & (C)) == (C) && !Xte)
-
-#define CNTL(c) ((c)-'@')
-const int ESC = 27;
-const int DEL = 127;
+  GraphicRendition _entries[GRAPHIC_RENDITION_COUNT];
+};
 
-// process an incoming unicode character
-void Vt102Emulation::receiveChar(int cc)
-{
-  if (cc == DEL)
-    return; //VT100: ignore.
+const GraphicRenditionTable graphicRenditions;
+}
 
-  if (ces(CTL))
-  {
-    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
-    // This means, they do neither a resetTokenizer() nor a pushToToken(). Some of them, do
-    // of course. Guess this originates from a weakly layered handling of the X-on
-    // X-off protocol, which comes really below this level.
-    if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC)
-        resetTokenizer(); //VT100: CAN or SUB
-    if (cc != ESC)
-    {
-        processToken(TY_CTL(cc+'@' ),0,0);
-        return;
-    }
-  }
-  // advance the state
-  addToCurrentToken(cc);
+void Vt102Emulation::processGraphicRendition(const int* arguments, int count)
+{
+  addProcessedTokens(1);
 
-  int* s = tokenBuffer;
-  const int  p = tokenBufferPos;
+  quint8 rendition = _currentScreen->currentRendition();
+  CharacterColor foreground = _currentScreen->currentForeground();
+  CharacterColor background = _currentScreen->currentBackground();
 
-  if (getMode(MODE_Ansi))
+  for (int i = 0; i < count; i++)
   {
-    if (lec(1,0,ESC)) { return; }
-    if (lec(1,0,ESC+128)) { s[0] = ESC; receiveChar('['); return; }
-    if (les(2,1,GRP)) { return; }
-    if (Xte         ) { processWindowAttributeChange(); resetTokenizer(); return; }
-    if (Xpe         ) { return; }
-    if (lec(3,2,'?')) { return; }
-    if (lec(3,2,'>')) { return; }
-    if (lec(3,2,'!')) { return; }
-    if (lun(       )) { processToken( TY_CHR(), applyCharset(cc), 0);   resetTokenizer(); return; }
-    if (lec(2,0,ESC)) { processToken( TY_ESC(s[1]), 0, 0);              resetTokenizer(); return; }
-    if (les(3,1,SCS)) { processToken( TY_ESC_CS(s[1],s[2]), 0, 0);      resetTokenizer(); return; }
-    if (lec(3,1,'#')) { processToken( TY_ESC_DE(s[2]), 0, 0);           resetTokenizer(); return; }
-    if (eps(    CPN)) { processToken( TY_CSI_PN(cc), argv[0],argv[1]);  resetTokenizer(); return; }
-
-    // resize = \e[8;<row>;<col>t
-    if (eps(CPS))
-    {
-        processToken( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
-        resetTokenizer();
-        return;
-    }
+    const int argument = arguments[i];
+    if (argument < 0 || argument >= GRAPHIC_RENDITION_COUNT)
+      continue;
 
-    if (epe(   )) { processToken( TY_CSI_PE(cc), 0, 0); resetTokenizer(); return; }
-    if (ees(DIG)) { addDigit(cc-'0'); return; }
-    if (eec(';')) { addArgument();    return; }
-    for (int i = 0; i <= argc; i++)
+    const GraphicRendition& entry = graphicRenditions[argument];
+    switch (entry.action)
     {
-        if (epp())
-            processToken(TY_CSI_PR(cc,argv[i]), 0, 0);
-        else if (egt())
-            processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
-        else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
+      case RenditionIgnored:
+        break;
+      case RenditionDefault:
+        rendition = DEFAULT_RENDITION;
+        foreground = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR);
+        background = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR);
+        break;
+      case RenditionSet:
+        rendition |= entry.value;
+        break;
+      case RenditionReset:
+        rendition &= ~entry.value;
+        break;
+      case RenditionForeground:
+        foreground = CharacterColor(COLOR_SPACE_SYSTEM, entry.value);
+        break;
+      case RenditionBackground:
+        background = CharacterColor(COLOR_SPACE_SYSTEM, entry.value);
+        break;
+      case RenditionDefaultForeground:
+        foreground = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR);
+        break;
+      case RenditionDefaultBackground:
+        background = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR);
+        break;
+      case RenditionExtendedForeground:
+      case RenditionExtendedBackground:
+      {
+        // an incomplete color selects the default color
+        CharacterColor color;
+        if (count - i >= 5 && arguments[i + 1] == 2)
         {
-            // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
-            i += 2;
-            processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
-            i += 2;
+          // ESC[ ... 38;2;<red>;<green>;<blue> ... m
+          color = CharacterColor(COLOR_SPACE_RGB, (arguments[i + 2] << 16) |
+                                                  (arguments[i + 3] << 8) |
+                                                  arguments[i + 4]);
+          i += 4;
         }
-        else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
+        else if (count - i >= 3 && arguments[i + 1] == 5)
         {
-            // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
-            i += 2;
-            processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
+          // ESC[ ... 38;5;<index> ... m
+          color = CharacterColor(COLOR_SPACE_256, arguments[i + 2]);
+          i += 2;
         }
+
+        if (entry.action == RenditionExtendedForeground)
+          foreground = color;
         else
-            processToken(TY_CSI_PS(cc,argv[i]), 0, 0);
-    }
-    resetTokenizer();
-  }
-  else
-  {
-    // VT52 Mode
-    if (lec(1,0,ESC))
-        return;
-    if (les(1,0,CHR))
-    {
-        processToken( TY_CHR(), s[0], 0);
-        resetTokenizer();
-        return;
-    }
-    if (lec(2,1,'Y'))
-        return;
-    if (lec(3,1,'Y'))
-        return;
-    if (p < 4)
-    {
-        processToken(TY_VT52(s[1] ), 0, 0);
-        resetTokenizer();
-        return;
+          background = color;
+        break;
+      }
     }
-    processToken(TY_VT52(s[1]), s[2], s[3]);
-    resetTokenizer();
-    return;
   }
+
+  _currentScreen->setGraphicRendition(rendition, foreground, background);
 }
-void Vt102Emulation::processWindowAttributeChange()
+
+void Vt102Emulation::processWindowAttributeChange(int attribute, const QString& value)
 {
-  // Describes the window or terminal session attribute to change
-  // See Session::UserTitleChange for possible values
-  int attributeToChange = 0;
-  int i;
-  for (i = 2; i < tokenBufferPos     &&
-              tokenBuffer[i] >= '0'  &&
-              tokenBuffer[i] <= '9'; i++)
+  // See Session::UserTitleChange for possible values of 'attribute'
+  QHash<int, QString>::const_iterator pending = _pendingTitleUpdates.constFind(attribute);
+  if (pending != _pendingTitleUpdates.constEnd())
   {
-    attributeToChange = 10 * attributeToChange + (tokenBuffer[i]-'0');
+    if (*pending == value)
+      return;
   }
-
-  if (tokenBuffer[i] != ';')
+  else if (!titleChangeNeeded(attribute, value))
   {
-    reportDecodingError();
+    // many shells set the same title again with every prompt
     return;
   }
 
-  QString newValue;
-  newValue.reserve(tokenBufferPos-i-2);
-  for (int j = 0; j < tokenBufferPos-i-2; j++)
-    newValue[j] = tokenBuffer[i+1+j];
-
-  _pendingTitleUpdates[attributeToChange] = newValue;
+  _pendingTitleUpdates[attribute] = value;
   _titleUpdateTimer->start(20);
 }
 
+bool Vt102Emulation::titleChangeNeeded(int attribute, const QString& value) const
+{
+  switch (attribute)
+  {
+    case 0:
+      return value != _windowTitle || value != _iconName;
+    case 1:
+      return value != _iconName;
+    case 2:
+      return value != _windowTitle;
+    default:
+      return true;
+  }
+}
+
 void Vt102Emulation::updateTitle()
 {
     QListIterator<int> iter( _pendingTitleUpdates.keys() );
     while (iter.hasNext()) {
         int arg = iter.next();
-        emit titleChanged( arg , _pendingTitleUpdates[arg] );
+        const QString& title = _pendingTitleUpdates[arg];
+
+        // remember the titles passed on, see titleChangeNeeded()
+        if (arg == 0 || arg == 2)
+            _windowTitle = title;
+        if (arg == 0 || arg == 1)
+            _iconName = title;
+
+        emit titleChanged( arg , title );
     }
     _pendingTitleUpdates.clear();
 }
@@ -448,9 +434,11 @@ void Vt102Emulation::updateTitle()
 
 void Vt102Emulation::processToken(int token, int p, int q)
 {
+  addProcessedTokens(1);
+
   switch (token)
   {
-    case TY_CHR(         ) : _currentScreen->displayCharacter     (p         ); break; //UTF16
+    case TY_CHR(         ) : _currentScreen->displayCharacter     (applyCharset(p)); break; //UTF16
 
     //             127 DEL    : ignored on input
 
@@ -568,64 +556,7 @@ void Vt102Emulation::processToken(int token, int p, int q)
     case TY_CSI_PS('s',   0) :      saveCursor           (          ); break;
     case TY_CSI_PS('u',   0) :      restoreCursor        (          ); break;
 
-    case TY_CSI_PS('m',   0) : _currentScreen->setDefaultRendition  (          ); break;
-    case TY_CSI_PS('m',   1) : _currentScreen->  setRendition     (RE_BOLD     ); break; //VT100
-    case TY_CSI_PS('m',   3) : _currentScreen->  setRendition     (RE_ITALIC   ); break; //VT100
-    case TY_CSI_PS('m',   4) : _currentScreen->  setRendition     (RE_UNDERLINE); break; //VT100
-    case TY_CSI_PS('m',   5) : _currentScreen->  setRendition     (RE_BLINK    ); break; //VT100
-    case TY_CSI_PS('m',   7) : _currentScreen->  setRendition     (RE_REVERSE  ); break;
-    case TY_CSI_PS('m',  10) : /* IGNORED: mapping related          */ break; //LINUX
-    case TY_CSI_PS('m',  11) : /* IGNORED: mapping related          */ break; //LINUX
-    case TY_CSI_PS('m',  12) : /* IGNORED: mapping related          */ break; //LINUX
-    case TY_CSI_PS('m',  22) : _currentScreen->resetRendition     (RE_BOLD     ); break;
-    case TY_CSI_PS('m',  23) : _currentScreen->resetRendition     (RE_ITALIC   ); break; //VT100
-    case TY_CSI_PS('m',  24) : _currentScreen->resetRendition     (RE_UNDERLINE); break;
-    case TY_CSI_PS('m',  25) : _currentScreen->resetRendition     (RE_BLINK    ); break;
-    case TY_CSI_PS('m',  27) : _currentScreen->resetRendition     (RE_REVERSE  ); break;
-
-    case TY_CSI_PS('m',   30) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  0); break;
-    case TY_CSI_PS('m',   31) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  1); break;
-    case TY_CSI_PS('m',   32) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  2); break;
-    case TY_CSI_PS('m',   33) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  3); break;
-    case TY_CSI_PS('m',   34) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  4); break;
-    case TY_CSI_PS('m',   35) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  5); break;
-    case TY_CSI_PS('m',   36) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  6); break;
-    case TY_CSI_PS('m',   37) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  7); break;
-
-    case TY_CSI_PS('m',   38) : _currentScreen->setForeColor         (p,       q); break;
-
-    case TY_CSI_PS('m',   39) : _currentScreen->setForeColor         (COLOR_SPACE_DEFAULT,  0); break;
-
-    case TY_CSI_PS('m',   40) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  0); break;
-    case TY_CSI_PS('m',   41) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  1); break;
-    case TY_CSI_PS('m',   42) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  2); break;
-    case TY_CSI_PS('m',   43) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  3); break;
-    case TY_CSI_PS('m',   44) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  4); break;
-    case TY_CSI_PS('m',   45) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  5); break;
-    case TY_CSI_PS('m',   46) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  6); break;
-    case TY_CSI_PS('m',   47) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  7); break;
-
-    case TY_CSI_PS('m',   48) : _currentScreen->setBackColor         (p,       q); break;
-
-    case TY_CSI_PS('m',   49) : _currentScreen->setBackColor         (COLOR_SPACE_DEFAULT,  1); break;
-
-    case TY_CSI_PS('m',   90) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  8); break;
-    case TY_CSI_PS('m',   91) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM,  9); break;
-    case TY_CSI_PS('m',   92) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM, 10); break;
-    case TY_CSI_PS('m',   93) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM, 11); break;
-    case TY_CSI_PS('m',   94) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM, 12); break;
-    case TY_CSI_PS('m',   95) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM, 13); break;
-    case TY_CSI_PS('m',   96) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM, 14); break;
-    case TY_CSI_PS('m',   97) : _currentScreen->setForeColor         (COLOR_SPACE_SYSTEM, 15); break;
-
-    case TY_CSI_PS('m',  100) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  8); break;
-    case TY_CSI_PS('m',  101) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM,  9); break;
-    case TY_CSI_PS('m',  102) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM, 10); break;
-    case TY_CSI_PS('m',  103) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM, 11); break;
-    case TY_CSI_PS('m',  104) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM, 12); break;
-    case TY_CSI_PS('m',  105) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM, 13); break;
-    case TY_CSI_PS('m',  106) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM, 14); break;
-    case TY_CSI_PS('m',  107) : _currentScreen->setBackColor         (COLOR_SPACE_SYSTEM, 15); break;
+    // TY_CSI_PS('m', ...) is passed to processGraphicRendition()
 
     case TY_CSI_PS('n',   5) :      reportStatus         (          ); break;
     case TY_CSI_PS('n',   6) :      reportCursorPosition (          ); break;
@@ -774,7 +705,7 @@ void Vt102Emulation::processToken(int token, int p, int q)
     case TY_CSI_PR('h', 1034) : /* IGNORED: 8bitinput activation     */ break; //XTERM
 
     case TY_CSI_PR('h', 1047) :          setMode      (MODE_AppScreen); break; //XTERM
-    case TY_CSI_PR('l', 1047) : _screen[1]->clearEntireScreen(); resetMode(MODE_AppScreen); break; //XTERM
+    case TY_CSI_PR('l', 1047) : if (_screen[1]) _screen[1]->clearEntireScreen(); resetMode(MODE_AppScreen); break; //XTERM
     case TY_CSI_PR('s', 1047) :         saveMode      (MODE_AppScreen); break; //XTERM
     case TY_CSI_PR('r', 1047) :      restoreMode      (MODE_AppScreen); break; //XTERM
 
@@ -786,9 +717,19 @@ void Vt102Emulation::processToken(int token, int p, int q)
 
     //FIXME: every once new sequences like this pop up in xterm.
     //       Here's a guess of what they could mean.
-    case TY_CSI_PR('h', 1049) : saveCursor(); _screen[1]->clearEntireScreen(); setMode(MODE_AppScreen); break; //XTERM
+    case TY_CSI_PR('h', 1049) : saveCursor(); alternateScreen()->clearEntireScreen(); setMode(MODE_AppScreen); break; //XTERM
     case TY_CSI_PR('l', 1049) : resetMode(MODE_AppScreen); restoreCursor(); break; //XTERM
 
+    // pasted text is marked as such, see Emulation::programBracketedPasteMode()
+    case TY_CSI_PR('h', 2004) :          setMode      (MODE_BracketedPaste); break; //XTERM
+    case TY_CSI_PR('l', 2004) :        resetMode      (MODE_BracketedPaste); break; //XTERM
+    case TY_CSI_PR('s', 2004) :         saveMode      (MODE_BracketedPaste); break; //XTERM
+    case TY_CSI_PR('r', 2004) :      restoreMode      (MODE_BracketedPaste); break; //XTERM
+
+    // synchronized output, see Emulation::setSynchronizedUpdate()
+    case TY_CSI_PR('h', 2026) :          setMode      (MODE_SynchronizedUpdate); break;
+    case TY_CSI_PR('l', 2026) :        resetMode      (MODE_SynchronizedUpdate); break;
+
     //FIXME: weird DEC reset sequence
     case TY_CSI_PE('p'      ) : /* IGNORED: reset         (        ) */ break;
 
@@ -966,6 +907,15 @@ void Vt102Emulation::sendText(const QString& text)
 }
 void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
 {
+    sendKeyEvents(event, 1);
+}
+void Vt102Emulation::sendKeyEvents(QKeyEvent* event, int count)
+{
+    if (count <= 0)
+        return;
+
+    keyPressSent();
+
     const Qt::KeyboardModifiers modifiers = event->modifiers();
     KeyboardTranslator::States states = KeyboardTranslator::NoState;
 
@@ -992,6 +942,23 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
 
     // look up key binding
     if (_keyTranslator) {
+        // the characters of a key binding only depend on the key, the
+        // modifiers, the state and whether the key has text, for a given
+        // translator and codec
+        if (_keyTranslator != _keySequenceTranslator || _codec != _keySequenceCodec) {
+            _keySequences.clear();
+            _keySequenceTranslator = _keyTranslator;
+            _keySequenceCodec = _codec;
+        }
+        const quint64 sequenceKey = (quint64(states) << 33) |
+                                    (quint64(event->text().isEmpty()) << 32) |
+                                    (uint(event->key()) | uint(modifiers));
+        QHash<quint64, QByteArray>::const_iterator sequence = _keySequences.constFind(sequenceKey);
+        if (sequence != _keySequences.constEnd()) {
+            sendKeySequence(*sequence, count);
+            return;
+        }
+
         KeyboardTranslator::Entry entry = _keyTranslator->findEntry(
                                               event->key() ,
                                               modifiers,
@@ -1027,13 +994,13 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
             if (entry.command() & KeyboardTranslator::EraseCommand) {
                 textToSend += eraseChar();
             } else if (entry.command() & KeyboardTranslator::ScrollPageUpCommand)
-                currentView->scrollScreenWindow(ScreenWindow::ScrollPages, -1);
+                currentView->scrollScreenWindow(ScreenWindow::ScrollPages, -count);
             else if (entry.command() & KeyboardTranslator::ScrollPageDownCommand)
-                currentView->scrollScreenWindow(ScreenWindow::ScrollPages, 1);
+                currentView->scrollScreenWindow(ScreenWindow::ScrollPages, count);
             else if (entry.command() & KeyboardTranslator::ScrollLineUpCommand)
-                currentView->scrollScreenWindow(ScreenWindow::ScrollLines, -1);
+                currentView->scrollScreenWindow(ScreenWindow::ScrollLines, -count);
             else if (entry.command() & KeyboardTranslator::ScrollLineDownCommand)
-                currentView->scrollScreenWindow(ScreenWindow::ScrollLines, 1);
+                currentView->scrollScreenWindow(ScreenWindow::ScrollLines, count);
             else if (entry.command() & KeyboardTranslator::ScrollUpToTopCommand)
                 currentView->scrollScreenWindow(ScreenWindow::ScrollLines,
                                                 - currentView->screenWindow()->currentLine());
@@ -1043,11 +1010,17 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
         else if (!entry.text().isEmpty())
         {
             textToSend += _codec->fromUnicode(entry.text(true,modifiers));
+            if (_keySequences.count() < MAXIMUM_KEY_SEQUENCES)
+                _keySequences.insert(sequenceKey, textToSend);
         }
+        else if (_utf8FastPath && event->text().length() == 1 &&
+                 event->text().at(0).unicode() >= 0x20 && event->text().at(0).unicode() < 0x7f)
+            // printable ASCII is the same in UTF-8, which spares the codec
+            textToSend += char(event->text().at(0).unicode());
         else
             textToSend += _codec->fromUnicode(event->text());
 
-        sendData(textToSend.constData(), textToSend.length());
+        sendKeySequence(textToSend, count);
     }
     else
     {
@@ -1062,6 +1035,17 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
     }
 }
 
+void Vt102Emulation::sendKeySequence(const QByteArray& sequence, int count)
+{
+    // the characters for all the presses are sent in a single write
+    if (count == 1) {
+        sendData(sequence.constData(), sequence.length());
+    } else {
+        const QByteArray sequences = sequence.repeated(count);
+        sendData(sequences.constData(), sequences.length());
+    }
+}
+
 /* ------------------------------------------------------------------------- */
 /*                                                                           */
 /*                                VT100 Charsets                             */
@@ -1086,8 +1070,6 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
    particular glyphs allocated in (0x00-0x1f) in their code page.
 */
 
-#define CHARSET _charset[_currentScreen==_screen[1]]
-
 // Apply current character map.
 
 unsigned short Vt102Emulation::applyCharset(unsigned short c)
@@ -1137,13 +1119,15 @@ void Vt102Emulation::useCharset(int n)
 void Vt102Emulation::setDefaultMargins()
 {
     _screen[0]->setDefaultMargins();
-    _screen[1]->setDefaultMargins();
+    if (_screen[1])
+        _screen[1]->setDefaultMargins();
 }
 
 void Vt102Emulation::setMargins(int t, int b)
 {
     _screen[0]->setMargins(t, b);
-    _screen[1]->setMargins(t, b);
+    if (_screen[1])
+        _screen[1]->setMargins(t, b);
 }
 
 void Vt102Emulation::saveCursor()
@@ -1196,11 +1180,13 @@ void Vt102Emulation::resetModes()
     resetMode(MODE_Mouse1005);  saveMode(MODE_Mouse1005);
     resetMode(MODE_Mouse1006);  saveMode(MODE_Mouse1006);
     resetMode(MODE_Mouse1015);  saveMode(MODE_Mouse1015);
+    resetMode(MODE_BracketedPaste);  saveMode(MODE_BracketedPaste);
 
     resetMode(MODE_AppScreen);  saveMode(MODE_AppScreen);
     resetMode(MODE_AppCuKeys);  saveMode(MODE_AppCuKeys);
     resetMode(MODE_AppKeyPad);  saveMode(MODE_AppKeyPad);
     resetMode(MODE_NewLine);
+    resetMode(MODE_SynchronizedUpdate);
     setMode(MODE_Ansi);
 }
 
@@ -1221,16 +1207,29 @@ void Vt102Emulation::setMode(int m)
         emit programUsesMouseChanged(false);
         break;
 
+    case MODE_BracketedPaste:
+        emit programBracketedPasteModeChanged(true);
+        break;
+
     case MODE_AppScreen :
-        _screen[1]->clearSelection();
+        alternateScreen()->clearSelection();
         setScreen(1);
         break;
+
+    case MODE_Ansi :
+        _parser.setAnsiMode(true);
+        break;
+
+    case MODE_SynchronizedUpdate :
+        setSynchronizedUpdate(true);
+        break;
     }
     // FIXME: Currently this has a redundant condition as MODES_SCREEN is 6
     // and MODE_NewLine is 5
     if (m < MODES_SCREEN || m == MODE_NewLine) {
         _screen[0]->setMode(m);
-        _screen[1]->setMode(m);
+        if (_screen[1])
+            _screen[1]->setMode(m);
     }
 }
 
@@ -1249,16 +1248,29 @@ void Vt102Emulation::resetMode(int m)
         emit programUsesMouseChanged(true);
         break;
 
+    case MODE_BracketedPaste:
+        emit programBracketedPasteModeChanged(false);
+        break;
+
     case MODE_AppScreen :
         _screen[0]->clearSelection();
         setScreen(0);
         break;
+
+    case MODE_Ansi :
+        _parser.setAnsiMode(false);
+        break;
+
+    case MODE_SynchronizedUpdate :
+        setSynchronizedUpdate(false);
+        break;
     }
     // FIXME: Currently this has a redundant condition as MODES_SCREEN is 6
     // and MODE_NewLine is 5
     if (m < MODES_SCREEN || m == MODE_NewLine) {
         _screen[0]->resetMode(m);
-        _screen[1]->resetMode(m);
+        if (_screen[1])
+            _screen[1]->resetMode(m);
     }
 }
 
@@ -1309,7 +1321,7 @@ static void hexdump(int* s, int len)
 #endif
 
 // return contents of the scan buffer
-static QString hexdump2(int* s, int len)
+static QString hexdump2(const int* s, int len)
 {
     int i;
     char dump[128];
@@ -1329,6 +1341,9 @@ static QString hexdump2(int* s, int len)
 
 void Vt102Emulation::reportDecodingError()
 {
+    const int* tokenBuffer = _parser.tokenBuffer();
+    const int tokenBufferPos = _parser.tokenLength();
+
     if (tokenBufferPos == 0 || (tokenBufferPos == 1 && (tokenBuffer[0] & 0xff) >= 32))
         return;
 
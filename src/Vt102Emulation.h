@@ -29,6 +29,7 @@
 // Konsole
 #include "Emulation.h"
 #include "Screen.h"
+#include "Vt102Parser.h"
 
 class QTimer;
 class QKeyEvent;
@@ -46,7 +47,9 @@ class QKeyEvent;
 #define MODE_Ansi            (MODES_SCREEN+10)   // Use US Ascii for character sets G0-G3 (DECANM)
 #define MODE_132Columns      (MODES_SCREEN+11)  // 80 <-> 132 column mode switch (DECCOLM)
 #define MODE_Allow132Columns (MODES_SCREEN+12)  // Allow DECCOLM mode
-#define MODE_total           (MODES_SCREEN+13)
+#define MODE_SynchronizedUpdate (MODES_SCREEN+13)  // Hold back updates while a frame is drawn
+#define MODE_BracketedPaste  (MODES_SCREEN+14)  // Xterm-style bracketed paste mode
+#define MODE_total           (MODES_SCREEN+15)
 
 namespace Konsole
 {
@@ -72,7 +75,7 @@ struct CharCodes {
  * sequences.
  *
  */
-class Vt102Emulation : public Emulation
+class KONSOLEPRIVATE_EXPORT Vt102Emulation : public Emulation, private Vt102Parser::Handler
 {
     Q_OBJECT
 
@@ -91,6 +94,7 @@ public slots:
     virtual void sendString(const char*, int length = -1);
     virtual void sendText(const QString& text);
     virtual void sendKeyEvent(QKeyEvent*);
+    virtual void sendKeyEvents(QKeyEvent* event, int count);
     virtual void sendMouseEvent(int buttons, int column, int line, int eventType);
 
 protected:
@@ -98,6 +102,9 @@ protected:
     virtual void setMode(int mode);
     virtual void resetMode(int mode);
     virtual void receiveChar(int cc);
+    virtual void receiveChars(const ushort* chars, int count);
+    virtual bool skipScrolledOutput(const char* text, int length, int lineFeeds);
+    virtual void resetParser();
 
 private slots:
     //causes changeTitle() to be emitted for each (int,QString) pair in pendingTitleUpdates
@@ -127,27 +134,17 @@ private:
     // (except MODE_Allow132Columns)
     void resetModes();
 
-    void resetTokenizer();
-#define MAX_TOKEN_LENGTH 256 // Max length of tokens (e.g. window title)
-    void addToCurrentToken(int cc);
-    int tokenBuffer[MAX_TOKEN_LENGTH]; //FIXME: overflow?
-    int tokenBufferPos;
-#define MAXARGS 15
-    void addDigit(int dig);
-    void addArgument();
-    int argv[MAXARGS];
-    int argc;
-    void initTokenizer();
+    // splits the incoming character stream into tokens
+    Vt102Parser _parser;
 
-    // Set of flags for each of the ASCII characters which indicates
-    // what category they fall into (printable character, control, digit etc.)
-    // for the purposes of decoding terminal output
-    int charClass[256];
+    // reimplemented from Vt102Parser::Handler
+    virtual void reportDecodingError();
+    virtual void processToken(int code, int p, int q);
+    virtual void processGraphicRendition(const int* arguments, int count);
+    virtual void processWindowAttributeChange(int attribute, const QString& value);
 
-    void reportDecodingError();
-
-    void processToken(int code, int p, int q);
-    void processWindowAttributeChange();
+    // sends the characters of a key press 'count' times
+    void sendKeySequence(const QByteArray& sequence, int count);
 
     void reportTerminalType();
     void reportSecondaryAttributes();
@@ -183,6 +180,21 @@ private:
     //output from the terminal
     QHash<int, QString> _pendingTitleUpdates;
     QTimer* _titleUpdateTimer;
+    // the titles last passed on with titleChanged(), updates which would
+    // not change them are dropped
+    QString _windowTitle;
+    QString _iconName;
+    bool titleChangeNeeded(int attribute, const QString& value) const;
+
+    // the characters sent for the key bindings with text which have been
+    // used so far, by key, modifiers, states and whether the key press has
+    // text.  They are forgotten when the translator or the codec changes
+    QHash<quint64, QByteArray> _keySequences;
+    const KeyboardTranslator* _keySequenceTranslator;
+    const QTextCodec* _keySequenceCodec;
+    // the bindings used while typing are few, this guards against
+    // unusual input filling the cache
+    static const int MAXIMUM_KEY_SEQUENCES = 1024;
 };
 }
 
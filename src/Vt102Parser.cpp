@@ -0,0 +1,331 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2007-2008 by Robert Knight <robert.knight@gmail.com>
+    Copyright 1997,1998 by Lars Doelle <lars.doelle@on-line.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Vt102Parser.h"
+
+using Konsole::Vt102Parser;
+
+/* The parser's state
+
+   Besides the explicit state, the parser keeps the characters of the
+   sequence decoded so far in (_tokenBuffer, _tokenBufferPos), which are
+   needed by some of the dispatch actions and for reporting decoding errors,
+   accompanied by decoded arguments kept in (_argv, _argc).
+
+   Each incoming character is first mapped to a character class.  The pair
+   of the current state and the character class then selects an entry in
+   the transition table, which holds the action to perform and the state to
+   continue with.
+
+   Note that control characters are allowed *within* escape sequences in
+   VT100, so most of them are executed without affecting the state.  CAN and
+   SUB abort the current sequence, and ESC starts a new one.
+*/
+
+const int MAX_ARGUMENT = 4096;
+
+#define CNTL(c) ((c)-'@')
+const int ESC = 27;
+const int DEL = 127;
+
+Vt102Parser::Vt102Parser(Handler* handler)
+    : _handler(handler),
+      _ansiMode(true),
+      _state(Ground)
+{
+    initTables();
+    reset();
+}
+
+void Vt102Parser::reset()
+{
+    _tokenBufferPos = 0;
+    // keeps the capacity, so that the buffer is allocated only once
+    _attributeText.resize(0);
+    _argc = 0;
+    _argv[0] = 0;
+    _argv[1] = 0;
+    _argv[2] = 0;
+    _state = _ansiMode ? Ground : Vt52Ground;
+}
+
+void Vt102Parser::setAnsiMode(bool ansi)
+{
+    _ansiMode = ansi;
+
+    // a sequence which is currently being decoded is completed using
+    // the old grammar, the new one is used from the next sequence on
+    if (_state == Ground || _state == Vt52Ground)
+        _state = ansi ? Ground : Vt52Ground;
+}
+
+void Vt102Parser::addDigit(int digit)
+{
+    if (_argv[_argc] < MAX_ARGUMENT)
+        _argv[_argc] = 10 * _argv[_argc] + digit;
+}
+
+void Vt102Parser::addArgument()
+{
+    _argc = qMin(_argc + 1, MAXARGS - 1);
+    _argv[_argc] = 0;
+}
+
+void Vt102Parser::addToCurrentToken(int cc)
+{
+    _tokenBuffer[_tokenBufferPos] = cc;
+    _tokenBufferPos = qMin(_tokenBufferPos + 1, MAX_TOKEN_LENGTH - 1);
+}
+
+void Vt102Parser::setTransition(State state, CharClass charClass, Action action, State nextState)
+{
+    _transitions[state][charClass].action = action;
+    _transitions[state][charClass].nextState = nextState;
+}
+
+void Vt102Parser::setTransitions(State state, Action action, State nextState)
+{
+    for (int i = 0; i < ClassCount; i++)
+        setTransition(state, static_cast<CharClass>(i), action, nextState);
+}
+
+void Vt102Parser::initTables()
+{
+    int i;
+    const quint8* s;
+
+    for (i = 0; i < 256; ++i)
+        _charClass[i] = ClassOther;
+    for (i = 0; i < 32; ++i)
+        _charClass[i] = ClassControl;
+    _charClass[CNTL('G')] = ClassBell;
+    _charClass[CNTL('X')] = ClassCancel;
+    _charClass[CNTL('Z')] = ClassCancel;
+    _charClass[ESC] = ClassEscape;
+    _charClass[DEL] = ClassDelete;
+    for (s = (const quint8*)"0123456789"; *s; ++s)
+        _charClass[*s] = ClassDigit;
+    for (s = (const quint8*)"()+*%"; *s; ++s)
+        _charClass[*s] = ClassCharset;
+    for (s = (const quint8*)"@ABCDGHILMPSTXZcdfry"; *s; ++s)
+        _charClass[*s] = ClassFinalPn;
+    _charClass[';'] = ClassSemicolon;
+    _charClass['?'] = ClassQuestion;
+    _charClass['>'] = ClassGreater;
+    _charClass['!'] = ClassBang;
+    _charClass['['] = ClassOpenBracket;
+    _charClass[']'] = ClassCloseBracket;
+    _charClass['#'] = ClassHash;
+    // resize = \e[8;<row>;<col>t
+    _charClass['t'] = ClassFinalT;
+    _charClass['Y'] = ClassY;
+    _charClass[ESC + 128] = ClassCsi;
+
+    // ANSI grammar
+    setTransitions(Ground, Print, Ground);
+    setTransition(Ground, ClassCsi, EnterCsi, CsiEntry);
+
+    setTransitions(Escape, EscDispatch, Ground);
+    setTransition(Escape, ClassCharset, Collect, EscapeCharset);
+    setTransition(Escape, ClassHash, Collect, EscapeHash);
+    setTransition(Escape, ClassOpenBracket, Collect, CsiEntry);
+    setTransition(Escape, ClassCloseBracket, Collect, OscString);
+
+    setTransitions(EscapeCharset, CharsetDispatch, Ground);
+    setTransitions(EscapeHash, HashDispatch, Ground);
+
+    setTransitions(CsiEntry, CsiPsDispatch, Ground);
+    setTransition(CsiEntry, ClassQuestion, Collect, CsiPrivate);
+    setTransition(CsiEntry, ClassGreater, Collect, CsiGreater);
+    setTransition(CsiEntry, ClassBang, Collect, CsiBang);
+
+    setTransitions(CsiParam, CsiPsDispatch, Ground);
+
+    for (i = CsiEntry; i <= CsiParam; i++) {
+        const State state = static_cast<State>(i);
+        setTransition(state, ClassDigit, Param, CsiParam);
+        setTransition(state, ClassSemicolon, Separator, CsiParam);
+        setTransition(state, ClassFinalPn, CsiPnDispatch, Ground);
+        setTransition(state, ClassFinalT, CsiResizeDispatch, Ground);
+    }
+
+    setTransitions(CsiPrivate, CsiPrDispatch, Ground);
+    setTransitions(CsiGreater, CsiPgDispatch, Ground);
+
+    for (i = CsiPrivate; i <= CsiGreater; i++) {
+        const State state = static_cast<State>(i);
+        setTransition(state, ClassDigit, Param, state);
+        setTransition(state, ClassSemicolon, Separator, state);
+    }
+
+    setTransitions(CsiBang, CsiPeDispatch, Ground);
+
+    setTransitions(OscString, Collect, OscInvalid);
+    setTransition(OscString, ClassDigit, Param, OscString);
+    setTransition(OscString, ClassSemicolon, Collect, OscText);
+    setTransitions(OscText, CollectText, OscText);
+    setTransitions(OscInvalid, Collect, OscInvalid);
+
+    // VT52 grammar
+    setTransitions(Vt52Ground, Print, Vt52Ground);
+
+    setTransitions(Vt52Escape, Vt52Dispatch, Vt52Ground);
+    setTransition(Vt52Escape, ClassY, Collect, Vt52CursorRow);
+
+    setTransitions(Vt52CursorRow, Collect, Vt52CursorColumn);
+    setTransitions(Vt52CursorColumn, Vt52CursorDispatch, Vt52Ground);
+
+    // control characters are handled the same way in every state
+    for (i = 0; i < StateCount; i++) {
+        const State state = static_cast<State>(i);
+        const bool vt52 = (state >= Vt52Ground);
+
+        setTransition(state, ClassControl, Execute, state);
+        setTransition(state, ClassBell, Execute, state);
+        setTransition(state, ClassCancel, Cancel, vt52 ? Vt52Ground : Ground);
+        setTransition(state, ClassEscape, EnterEscape, vt52 ? Vt52Escape : Escape);
+        setTransition(state, ClassDelete, Ignore, state); //VT100: ignore.
+    }
+
+    // except that BEL terminates the xterm window attribute sequences
+    for (i = OscString; i <= OscInvalid; i++)
+        setTransition(static_cast<State>(i), ClassBell, OscDispatch, Ground);
+}
+
+// process an incoming unicode character
+void Vt102Parser::receiveChar(int cc)
+{
+    const int charClass = (cc < 256) ? _charClass[cc] : ClassOther;
+    const Transition& transition = _transitions[_state][charClass];
+
+    switch (transition.action) {
+    case Ignore:
+        return;
+    case Execute:
+        _handler->processToken(TY_CTL(cc + '@'), 0, 0);
+        return;
+    case Cancel:
+        reset(); //VT100: CAN or SUB
+        _handler->processToken(TY_CTL(cc + '@'), 0, 0);
+        return;
+    case Print:
+        _handler->processToken(TY_CHR(), cc, 0);
+        return;
+    case CollectText:
+        if (_attributeText.size() < MAX_ATTRIBUTE_LENGTH)
+            _attributeText.append(QChar(cc));
+        return;
+    case EnterEscape:
+        reset();
+        addToCurrentToken(cc);
+        _state = static_cast<State>(transition.nextState);
+        return;
+    }
+
+    // advance the state
+    addToCurrentToken(cc);
+
+    switch (transition.action) {
+    case EnterCsi:
+        // treat <ESC>+128 as <ESC>'['
+        _tokenBuffer[0] = ESC;
+        addToCurrentToken('[');
+        _state = static_cast<State>(transition.nextState);
+        return;
+    case Collect:
+        _state = static_cast<State>(transition.nextState);
+        return;
+    case Param:
+        addDigit(cc - '0');
+        _state = static_cast<State>(transition.nextState);
+        return;
+    case Separator:
+        addArgument();
+        _state = static_cast<State>(transition.nextState);
+        return;
+    case EscDispatch:
+        _handler->processToken(TY_ESC(cc), 0, 0);
+        break;
+    case CharsetDispatch:
+        _handler->processToken(TY_ESC_CS(_tokenBuffer[1], cc), 0, 0);
+        break;
+    case HashDispatch:
+        _handler->processToken(TY_ESC_DE(cc), 0, 0);
+        break;
+    case CsiPnDispatch:
+        _handler->processToken(TY_CSI_PN(cc), _argv[0], _argv[1]);
+        break;
+    case CsiResizeDispatch:
+        // resize = \e[8;<row>;<col>t
+        _handler->processToken(TY_CSI_PS(cc, _argv[0]), _argv[1], _argv[2]);
+        break;
+    case CsiPsDispatch:
+    case CsiPrDispatch:
+    case CsiPgDispatch:
+        dispatchCsi(cc, transition.action);
+        break;
+    case CsiPeDispatch:
+        _handler->processToken(TY_CSI_PE(cc), 0, 0);
+        break;
+    case OscDispatch:
+        dispatchWindowAttributeChange();
+        break;
+    case Vt52Dispatch:
+        _handler->processToken(TY_VT52(cc), 0, 0);
+        break;
+    case Vt52CursorDispatch:
+        _handler->processToken(TY_VT52(_tokenBuffer[1]), _tokenBuffer[2], _tokenBuffer[3]);
+        break;
+    }
+
+    reset();
+}
+
+void Vt102Parser::dispatchCsi(int cc, int action)
+{
+    if (action == CsiPsDispatch && cc == 'm') {
+        _handler->processGraphicRendition(_argv, _argc + 1);
+        return;
+    }
+
+    for (int i = 0; i <= _argc; i++) {
+        if (action == CsiPrDispatch)
+            _handler->processToken(TY_CSI_PR(cc, _argv[i]), 0, 0);
+        else if (action == CsiPgDispatch)
+            _handler->processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
+        else
+            _handler->processToken(TY_CSI_PS(cc, _argv[i]), 0, 0);
+    }
+}
+
+void Vt102Parser::dispatchWindowAttributeChange()
+{
+    // the attribute number must be followed by ';' and the text
+    if (_state != OscText) {
+        _handler->reportDecodingError();
+        return;
+    }
+
+    // See Session::UserTitleChange for possible values of the attribute
+    _handler->processWindowAttributeChange(_argv[0], _attributeText);
+}
@@ -0,0 +1,293 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2007-2008 by Robert Knight <robertknight@gmail.com>
+    Copyright 1997,1998 by Lars Doelle <lars.doelle@on-line.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef VT102PARSER_H
+#define VT102PARSER_H
+
+// Qt
+#include <QtCore/QString>
+
+// Konsole
+#include "konsole_export.h"
+
+/*
+   The tokens produced by the parser are encoded into a single machine word,
+   so that they can be switched over easily. Depending on the token itself,
+   additional argument values are passed along with it.
+
+   - CHR        - Printable characters     (32..255 but DEL (=127))
+   - CTL        - Control characters       (0..31 but ESC (= 27), DEL)
+   - ESC        - Escape codes of the form <ESC><CHR but `[]()+*#'>
+   - ESC_CS     - Escape codes of the form <ESC><any of `()+*%'> C
+   - ESC_DE     - Escape codes of the form <ESC>'#' C
+   - CSI_PN     - Escape codes of the form <ESC>'['     {Pn} ';' {Pn} C
+   - CSI_PS     - Escape codes of the form <ESC>'['     {Pn} ';' ...  C
+   - CSI_PR     - Escape codes of the form <ESC>'[' '?' {Pn} ';' ...  C
+   - CSI_PE     - Escape codes of the form <ESC>'[' '!' {Pn} ';' ...  C
+   - CSI_PG     - Escape codes of the form <ESC>'[' '>' {Pn} ';' ...  C
+   - VT52       - VT52 escape codes
+                  - <ESC><Chr>
+                  - <ESC>'Y'{Pc}{Pc}
+
+   Xterm window/terminal attribute commands of the form
+   <ESC>`]' {Pn} `;' {Text} <BEL> are not passed as tokens; see
+   Vt102Parser::Handler::processWindowAttributeChange().  Their text is
+   collected separately from the other sequences, in a buffer which is
+   reused from one command to the next, up to MAX_ATTRIBUTE_LENGTH
+   characters.
+
+   The CSI_PS and CSI_PR forms allow a list of arguments. Since the elements
+   of the lists are treated individually the same way, they are passed as
+   individual tokens to the interpretation. Further, because the meaning of
+   the parameters are names (although represented as numbers), they are
+   included within the token ('N').
+
+   The exception are the "select graphic rendition" sequences
+   <ESC>'[' {Pn} ';' ... 'm', whose arguments are all passed at once to
+   Vt102Parser::Handler::processGraphicRendition().  They are by far the
+   most frequent sequences with several arguments, and some of the
+   arguments (the extended colors) span several elements of the list.
+*/
+
+#define TY_CONSTRUCT(T,A,N) ( ((((int)N) & 0xffff) << 16) | ((((int)A) & 0xff) << 8) | (((int)T) & 0xff) )
+
+#define TY_CHR(   )     TY_CONSTRUCT(0,0,0)
+#define TY_CTL(A  )     TY_CONSTRUCT(1,A,0)
+#define TY_ESC(A  )     TY_CONSTRUCT(2,A,0)
+#define TY_ESC_CS(A,B)  TY_CONSTRUCT(3,A,B)
+#define TY_ESC_DE(A  )  TY_CONSTRUCT(4,A,0)
+#define TY_CSI_PS(A,N)  TY_CONSTRUCT(5,A,N)
+#define TY_CSI_PN(A  )  TY_CONSTRUCT(6,A,0)
+#define TY_CSI_PR(A,N)  TY_CONSTRUCT(7,A,N)
+
+#define TY_VT52(A)    TY_CONSTRUCT(8,A,0)
+#define TY_CSI_PG(A)  TY_CONSTRUCT(9,A,0)
+#define TY_CSI_PE(A)  TY_CONSTRUCT(10,A,0)
+
+namespace Konsole
+{
+/**
+ * Splits the stream of characters received by a VT102 compatible
+ * terminal into printable characters, control characters and escape
+ * sequences.
+ *
+ * The parser is a DEC/ANSI style state machine.  Each character is mapped
+ * to a character class and the action and next state are then found with a
+ * single lookup in a transition table, so the cost per character does not
+ * depend on the sequence being decoded.
+ *
+ * The recognized tokens are passed to the Handler given to the constructor.
+ * The VT52 grammar is used instead of the ANSI one while setAnsiMode(false)
+ * is in effect.
+ */
+class KONSOLEPRIVATE_EXPORT Vt102Parser
+{
+public:
+    /** Receives the tokens recognized by a Vt102Parser. */
+    class Handler
+    {
+    public:
+        virtual ~Handler() {}
+
+        /**
+         * Called for each token recognized by the parser.
+         *
+         * @param token The token, constructed with one of the TY_* macros
+         * @param p The first argument of the token
+         * @param q The second argument of the token
+         */
+        virtual void processToken(int token, int p, int q) = 0;
+
+        /**
+         * Called when an "<ESC>[{Pn};...m" sequence which selects the
+         * rendition and colors of the following characters has been
+         * received.
+         *
+         * @param arguments The arguments of the sequence, in the order
+         * in which they were received.  Missing arguments are 0.
+         * @param count The number of arguments, at least 1
+         */
+        virtual void processGraphicRendition(const int* arguments, int count) = 0;
+
+        /**
+         * Called when an xterm "<ESC>]{Pn};{Text}<BEL>" sequence has
+         * been received.
+         *
+         * @param attribute The numeric argument {Pn} of the sequence
+         * @param value The text of the sequence
+         */
+        virtual void processWindowAttributeChange(int attribute, const QString& value) = 0;
+
+        /**
+         * Called when the current sequence could not be decoded.
+         * The sequence is available from tokenBuffer() at this point.
+         */
+        virtual void reportDecodingError() = 0;
+    };
+
+    /** Constructs a new parser which passes tokens to @p handler. */
+    explicit Vt102Parser(Handler* handler);
+
+    /** Discards any partially received sequence. */
+    void reset();
+
+    /**
+     * Sets whether the ANSI (true) or the VT52 (false) grammar is used
+     * for the sequences which follow.
+     */
+    void setAnsiMode(bool ansi);
+
+    /**
+     * Returns true if the parser is using the ANSI grammar and is
+     * not in the middle of a sequence, in which case any printable
+     * character received next is passed on as a TY_CHR() token.
+     */
+    bool isInGroundState() const {
+        return _state == Ground;
+    }
+
+    /** Processes the incoming unicode character @p cc. */
+    void receiveChar(int cc);
+
+    /** Returns the characters of the sequence decoded so far. */
+    const int* tokenBuffer() const {
+        return _tokenBuffer;
+    }
+    /** Returns the number of characters in tokenBuffer() */
+    int tokenLength() const {
+        return _tokenBufferPos;
+    }
+
+    /** Max length of tokens, other than the text of window attribute commands */
+    static const int MAX_TOKEN_LENGTH = 256;
+    /**
+     * Max length of the text of window attribute commands, eg. the window
+     * title.  Longer texts are truncated.
+     */
+    static const int MAX_ATTRIBUTE_LENGTH = 64 * 1024;
+    /** Max number of arguments of a CSI sequence */
+    static const int MAXARGS = 15;
+
+private:
+    enum State {
+        Ground,
+        Escape,
+        EscapeCharset,      // <ESC> followed by one of '()+*%'
+        EscapeHash,         // <ESC> '#'
+        CsiEntry,           // <ESC> '['
+        CsiParam,
+        CsiPrivate,         // <ESC> '[' '?'
+        CsiGreater,         // <ESC> '[' '>'
+        CsiBang,            // <ESC> '[' '!'
+        OscString,          // <ESC> ']', followed by the attribute number
+        OscText,            // <ESC> ']' {Pn} ';'
+        OscInvalid,         // <ESC> ']' followed by anything else
+        Vt52Ground,
+        Vt52Escape,
+        Vt52CursorRow,      // <ESC> 'Y'
+        Vt52CursorColumn,   // <ESC> 'Y' {Pc}
+        StateCount
+    };
+
+    enum CharClass {
+        ClassControl,       // C0 controls other than the ones below
+        ClassBell,
+        ClassCancel,        // CAN and SUB
+        ClassEscape,
+        ClassDelete,
+        ClassDigit,
+        ClassSemicolon,
+        ClassQuestion,
+        ClassGreater,
+        ClassBang,
+        ClassOpenBracket,
+        ClassCloseBracket,
+        ClassHash,
+        ClassCharset,       // one of '()+*%'
+        ClassFinalPn,       // final characters of CSI_PN sequences
+        ClassFinalT,        // final character of the window resize sequence
+        ClassY,
+        ClassCsi,           // 8-bit CSI (<ESC>+128)
+        ClassOther,
+        ClassCount
+    };
+
+    enum Action {
+        Ignore,
+        Execute,            // pass a control character on, the state is kept
+        Cancel,             // abort the current sequence and execute
+        EnterEscape,
+        EnterCsi,           // 8-bit CSI, equivalent to <ESC> '['
+        CollectText,        // add to the text of a window attribute command
+        Collect,
+        Param,
+        Separator,
+        Print,
+        EscDispatch,
+        CharsetDispatch,
+        HashDispatch,
+        CsiPnDispatch,
+        CsiResizeDispatch,
+        CsiPsDispatch,
+        CsiPrDispatch,
+        CsiPgDispatch,
+        CsiPeDispatch,
+        OscDispatch,
+        Vt52Dispatch,
+        Vt52CursorDispatch
+    };
+
+    struct Transition {
+        quint8 action;
+        quint8 nextState;
+    };
+
+    void initTables();
+    // sets the transition for all character classes in 'state'
+    void setTransitions(State state, Action action, State nextState);
+    void setTransition(State state, CharClass charClass, Action action, State nextState);
+
+    void addToCurrentToken(int cc);
+    void addDigit(int digit);
+    void addArgument();
+
+    void dispatchCsi(int cc, int action);
+    void dispatchWindowAttributeChange();
+
+    Handler* _handler;
+    bool _ansiMode;
+    State _state;
+
+    int _tokenBuffer[MAX_TOKEN_LENGTH];
+    int _tokenBufferPos;
+    int _argv[MAXARGS];
+    int _argc;
+
+    // the text of the window attribute command being decoded
+    QString _attributeText;
+
+    quint8 _charClass[256];
+    Transition _transitions[StateCount][ClassCount];
+};
+}
+
+#endif // VT102PARSER_H
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 
 // Qt
 #include <QtCore/QFile>
@@ -60,12 +61,103 @@ static quint32 readGlyph(QTextStream& input)
            (readGlyphLine(input) << 20);
 }
 
+static bool isSet(quint32 glyph, int row, int col)
+{
+    return glyph & (1 << (row * 5 + col));
+}
+
+struct Segment {
+    int startCol;
+    int startRow;
+    int endCol;
+    int endRow;
+};
+
+static void addSegment(Segment* segments, int& count,
+                       int startCol, int startRow, int endCol, int endRow)
+{
+    const Segment segment = { startCol, startRow, endCol, endRow };
+    segments[count++] = segment;
+}
+
+/**
+ * Splits a glyph into the lines it is drawn with.  The vertical lines are
+ * the longest runs of set points in the three middle columns and the
+ * horizontal lines are the longest runs in the three middle rows, unless the
+ * vertical lines cover them already.  Runs of a single point in the middle of
+ * the grid are only kept as points, ie. segments which start where they end,
+ * if no line covers them.  The corners of the grid are never drawn.
+ */
+static int glyphSegments(quint32 glyph, Segment* segments)
+{
+    int count = 0;
+    bool covered[5][5] = {{false}};
+
+    for (int col = 1; col <= 3; ++col) {
+        for (int row = 0; row < 5; ++row) {
+            if (!isSet(glyph, row, col))
+                continue;
+
+            const int start = row;
+            while (row + 1 < 5 && isSet(glyph, row + 1, col))
+                ++row;
+
+            if (row > start || start == 0 || start == 4) {
+                addSegment(segments, count, col, start, col, row);
+                for (int i = start; i <= row; ++i)
+                    covered[i][col] = true;
+            }
+        }
+    }
+
+    for (int row = 1; row <= 3; ++row) {
+        for (int col = 0; col < 5; ++col) {
+            if (!isSet(glyph, row, col))
+                continue;
+
+            const int start = col;
+            while (col + 1 < 5 && isSet(glyph, row, col + 1))
+                ++col;
+
+            bool isCovered = true;
+            for (int i = start; i <= col; ++i)
+                isCovered = isCovered && covered[row][i];
+
+            if (!isCovered && (col > start || start == 0 || start == 4)) {
+                addSegment(segments, count, start, row, col, row);
+                for (int i = start; i <= col; ++i)
+                    covered[row][i] = true;
+            }
+        }
+    }
+
+    for (int row = 1; row <= 3; ++row) {
+        for (int col = 1; col <= 3; ++col) {
+            if (isSet(glyph, row, col) && !covered[row][col])
+                addSegment(segments, count, col, row, col, row);
+        }
+    }
+
+    return count;
+}
+
 int main(int argc, char **argv)
 {
-    if (argc < 1) {
-        qWarning("usage: fontembedder font.src > font.h");
+    if (argc < 2) {
+        qWarning("usage: fontembedder font.src [font.h]");
         exit(1);
     }
+
+    // without an output file, the header is written to stdout
+    ofstream outFile;
+    streambuf* stdoutBuffer = cout.rdbuf();
+    if (argc > 2) {
+        outFile.open(argv[2]);
+        if (!outFile)
+            qFatal("Can not open %s", argv[2]);
+        cout.rdbuf(outFile.rdbuf());
+    }
+
     QFile inFile(argv[1]);
     if (!inFile.open(QIODevice::ReadOnly)) {
         qFatal("Can not open %s", argv[1]);
@@ -102,15 +194,62 @@ int main(int argc, char **argv)
 
     //Nicely formatted: 8 per line, 16 lines
     for (int line = 0; line < 128; line += 8) {
-        cout << "\t";
+        cout << "    ";
         for (int col = line; col < line + 8; ++col) {
             cout << "0x" << hex << setw(8) << setfill('0') << glyphStates[col];
             if (col != 127)
-                cout << ", ";
+                cout << ",";
+            if (col != line + 7)
+                cout << " ";
+        }
+        cout << "\n";
+    }
+    cout << "};\n\n";
+
+    //The lines of each glyph, as { startCol, startRow, endCol, endRow } in
+    //the 5x5 grid.  The lines of glyph i are LineCharSegments[LineCharSegmentIndex[i]]
+    //up to LineCharSegments[LineCharSegmentIndex[i + 1]].
+    int segmentIndex[129];
+    int segmentCount = 0;
+
+    cout << dec;
+    cout << "static const uchar LineCharSegments[][4] = {\n";
+    for (int glyph = 0; glyph < 128; ++glyph) {
+        Segment segments[25];
+        const int count = glyphSegments(glyphStates[glyph], segments);
+
+        segmentIndex[glyph] = segmentCount;
+        segmentCount += count;
+
+        if (count == 0)
+            continue;
+
+        cout << "    ";
+        for (int i = 0; i < count; ++i) {
+            cout << "{ " << segments[i].startCol << ", " << segments[i].startRow << ", "
+                 << segments[i].endCol << ", " << segments[i].endRow << " },";
+            if (i != count - 1)
+                cout << " ";
+        }
+        cout << " // U+" << hex << uppercase << (0x2500 + glyph) << nouppercase << dec << "\n";
+    }
+    cout << "};\n\n";
+    segmentIndex[128] = segmentCount;
+
+    cout << "static const quint16 LineCharSegmentIndex[] = {\n";
+    for (int line = 0; line < 129; line += 8) {
+        cout << "    ";
+        for (int col = line; col < line + 8 && col < 129; ++col) {
+            cout << setw(3) << setfill(' ') << segmentIndex[col];
+            if (col != 128)
+                cout << ",";
+            if (col != line + 7 && col != 128)
+                cout << " ";
         }
         cout << "\n";
     }
     cout << "};\n";
+    cout.rdbuf(stdoutBuffer);
     return 0;
 }
 
@@ -69,6 +69,13 @@
 // Own
 #include "konsole_wcwidth.h"
 
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+// KDE
+#include <KGlobal>
+
 struct interval {
     unsigned long first;
     unsigned long last;
@@ -125,11 +132,8 @@ static int bisearch(unsigned long ucs, const struct interval* table, int max)
  * in ISO 10646.
  */
 
-int konsole_wcwidth(quint16 oucs)
+static int characterWidth(uint oucs)
 {
-    /* NOTE: It is not possible to compare quint16 with the new last four lines of characters,
-     * therefore this cast is now necessary.
-     */
     unsigned long ucs = static_cast<unsigned long>(oucs);
     /* sorted list of non-overlapping intervals of non-spacing characters */
     /* generated by "uniset +cat=Me +cat=Mn +cat=Cf -00AD +1160-11FF +200B c" */
@@ -210,18 +214,13 @@ int konsole_wcwidth(quint16 oucs)
              (ucs >= 0xff00 && ucs <= 0xff5f) || /* Fullwidth Forms */
              (ucs >= 0xffe0 && ucs <= 0xffe6) ||
              (ucs >= 0x300a && ucs <= 0x300b) || /* Special character 《 and 》(Unicode Standard Annex #11) */
+             (ucs >= 0x1f300 && ucs <= 0x1f64f) || /* Pictographs and Emoticons */
+             (ucs >= 0x1f680 && ucs <= 0x1f6ff) || /* Transport and Map Symbols */
+             (ucs >= 0x1f900 && ucs <= 0x1f9ff) || /* Supplemental Symbols and Pictographs */
              (ucs >= 0x20000 && ucs <= 0x2fffd) ||
              (ucs >= 0x30000 && ucs <= 0x3fffd)));
 }
 
-int string_width(const QString& text)
-{
-    int w = 0;
-    for (int i = 0; i < text.length(); ++i)
-        w += konsole_wcwidth(text[i].unicode());
-    return w;
-}
-
 /*
  * The following functions are the same as mk_wcwidth() and
  * mk_wcwidth_cjk(), except that spacing characters in the East Asian
@@ -231,7 +230,7 @@ int string_width(const QString& text)
  * the traditional terminal character-width behaviour. It is not
  * otherwise recommended for general use.
  */
-int konsole_wcwidth_cjk(quint16 oucs)
+static int characterWidthCjk(uint oucs)
 {
     /* sorted list of non-overlapping intervals of East Asian Ambiguous
      * characters, generated by
@@ -311,13 +310,118 @@ int konsole_wcwidth_cjk(quint16 oucs)
                  sizeof(ambiguous) / sizeof(struct interval) - 1))
         return 2;
 
-    return konsole_wcwidth(oucs);
+    return characterWidth(oucs);
+}
+
+/*
+ * The widths of all the characters are looked up in two-level tables
+ * which are filled from the functions above the first time they are
+ * needed.  The 65536 characters are split into blocks of 256, and blocks
+ * in which the characters have the same widths share their entries, which
+ * leaves a few dozen distinct blocks.
+ */
+namespace
+{
+class WidthTable
+{
+public:
+    explicit WidthTable(int (*width)(uint));
+
+    int width(quint16 ucs) const {
+        return _widths[_blockOffsets[ucs >> BLOCK_BITS] + (ucs & BLOCK_MASK)];
+    }
+
+private:
+    static const int BLOCK_BITS = 8;
+    static const int BLOCK_SIZE = 1 << BLOCK_BITS;
+    static const int BLOCK_MASK = BLOCK_SIZE - 1;
+    static const int BLOCK_COUNT = 0x10000 / BLOCK_SIZE;
+
+    int _blockOffsets[BLOCK_COUNT];
+    QVector<qint8> _widths;
+};
+
+WidthTable::WidthTable(int (*width)(uint))
+{
+    QHash<QByteArray, int> uniqueBlocks;
+    QByteArray block(BLOCK_SIZE, 0);
+
+    for (int i = 0; i < BLOCK_COUNT; i++) {
+        for (int j = 0; j < BLOCK_SIZE; j++)
+            block[j] = width(i * BLOCK_SIZE + j);
+
+        QHash<QByteArray, int>::const_iterator iter = uniqueBlocks.constFind(block);
+        if (iter != uniqueBlocks.constEnd()) {
+            _blockOffsets[i] = iter.value();
+        } else {
+            _blockOffsets[i] = _widths.size();
+            uniqueBlocks.insert(block, _widths.size());
+            for (int j = 0; j < BLOCK_SIZE; j++)
+                _widths << qint8(block.at(j));
+        }
+    }
+}
+
+struct WidthTables {
+    WidthTables()
+        : normal(characterWidth)
+        , cjk(characterWidthCjk) {
+    }
+
+    WidthTable normal;
+    WidthTable cjk;
+};
+}
+
+K_GLOBAL_STATIC(WidthTables, widthTables)
+
+int konsole_wcwidth(quint16 oucs)
+{
+    // printable ASCII, which is most of the output
+    if (oucs >= 0x20 && oucs < 0x7f)
+        return 1;
+
+    return widthTables->normal.width(oucs);
+}
+
+int konsole_wcwidth_cjk(quint16 oucs)
+{
+    if (oucs >= 0x20 && oucs < 0x7f)
+        return 1;
+
+    return widthTables->cjk.width(oucs);
+}
+
+int konsole_wcwidth_ucs4(uint ucs)
+{
+    if (ucs < 0x10000)
+        return konsole_wcwidth(ucs);
+
+    // the few characters outside of the basic multilingual plane which
+    // are used are not worth a table
+    return characterWidth(ucs);
+}
+
+int string_width(const QString& text)
+{
+    const WidthTable& table = widthTables->normal;
+
+    int w = 0;
+    for (int i = 0; i < text.length(); ++i) {
+        const ushort ucs = text.at(i).unicode();
+        w += (ucs >= 0x20 && ucs < 0x7f) ? 1 : table.width(ucs);
+    }
+    return w;
 }
 
 int string_width_cjk(const QString& text)
 {
+    const WidthTable& table = widthTables->cjk;
+
     int w = 0;
-    for (int i = 0; i < text.length(); ++i)
-        w += konsole_wcwidth_cjk(text[i].unicode());
+    for (int i = 0; i < text.length(); ++i) {
+        const ushort ucs = text.at(i).unicode();
+        w += (ucs >= 0x20 && ucs < 0x7f) ? 1 : table.width(ucs);
+    }
     return w;
 }
@@ -11,6 +11,8 @@
 
 int konsole_wcwidth(quint16 oucs);
 int konsole_wcwidth_cjk(quint16 oucs);
+// same as konsole_wcwidth(), for any unicode code point
+int konsole_wcwidth_ucs4(uint ucs);
 
 int string_width(const QString& text);
 int string_width_cjk(const QString& text);
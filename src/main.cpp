@@ -20,6 +20,7 @@
 // Own
 #include "Application.h"
 #include "MainWindow.h"
+#include "StartupTrace.h"
 
 // OS specific
 #include <kde_file.h>
@@ -27,11 +28,15 @@
 // KDE
 #include <KAboutData>
 #include <KCmdLineArgs>
+#include <KComponentData>
+#include <KConfig>
+#include <KConfigGroup>
 #include <KLocale>
 
 #define KONSOLE_VERSION "2.10.999"
 
 using Konsole::Application;
+using Konsole::StartupTrace;
 
 // fill the KAboutData structure with information about contributors to Konsole.
 void fillAboutData(KAboutData& aboutData);
@@ -46,11 +51,17 @@ bool shouldUseNewProcess();
 // restore sessions saved by KDE.
 void restoreSession(Application& app);
 
+// select the OpenGL graphics system if the user enabled it.
+// this has to happen before the application object is created.
+void setupGraphicsSystem(const KAboutData& aboutData);
+
 // ***
 // Entry point into the Konsole terminal application.
 // ***
 extern "C" int KDE_EXPORT kdemain(int argc, char** argv)
 {
+    StartupTrace::mark("main()");
+
     KAboutData about("konsole",
                      0,
                      ki18nc("@title", "<application>Konsole</application>"),
@@ -67,6 +78,9 @@ extern "C" int KDE_EXPORT kdemain(int argc, char** argv)
     fillCommandLineOptions(konsoleOptions);
     KCmdLineArgs::addCmdLineOptions(konsoleOptions);
 
+    if (KCmdLineArgs::parsedArgs()->isSet("trace-startup"))
+        StartupTrace::setEnabled(true);
+
     KUniqueApplication::StartFlags startFlags;
     if (shouldUseNewProcess())
         startFlags = KUniqueApplication::NonUniqueInstance;
@@ -76,8 +90,12 @@ extern "C" int KDE_EXPORT kdemain(int argc, char** argv)
     if (!KUniqueApplication::start(startFlags)) {
         exit(0);
     }
+    StartupTrace::mark("KUniqueApplication::start()");
+
+    setupGraphicsSystem(about);
 
     Application app;
+    StartupTrace::mark("Application constructed");
 
     // make sure the d&d popup menu provided by libkonq get translated.
     KGlobal::locale()->insertCatalog("libkonq");
@@ -132,6 +150,11 @@ bool shouldUseNewProcess()
 
     const KCmdLineArgs* konsoleArgs = KCmdLineArgs::parsedArgs();
 
+    // the startup of an existing process cannot be traced
+    if (konsoleArgs->isSet("trace-startup")) {
+        return true;
+    }
+
     // the only way to create new tab is to reuse existing Konsole process.
     if (konsoleArgs->isSet("new-tab")) {
         return false;
@@ -177,6 +200,8 @@ void fillCommandLineOptions(KCmdLineOptions& options)
                 ki18nc("@info:shell", "Disable transparent backgrounds, even if the system"
                       " supports them."));
     options.add("list-profiles", ki18nc("@info:shell", "List the available profiles"));
+    options.add("trace-startup",
+                ki18nc("@info:shell", "Print how long the phases of starting Konsole took"));
     options.add("list-profile-properties",
                 ki18nc("@info:shell", "List all the profile properties names and their type"
                       " (for use with -p)"));
@@ -280,3 +305,16 @@ void restoreSession(Application& app)
     }
 }
 
+
+void setupGraphicsSystem(const KAboutData& aboutData)
+{
+    // the main component does not exist yet, so KonsoleSettings cannot be used
+    KComponentData componentData(&aboutData, KComponentData::SkipMainComponentRegistration);
+    KConfig config(componentData, "konsolerc");
+    const KConfigGroup group(&config, "KonsoleWindow");
+
+    // an explicit -graphicssystem argument still takes precedence, and Qt
+    // falls back to the raster engine if the OpenGL engine is not available
+    if (group.readEntry("UseOpenGLRendering", false))
+        QApplication::setGraphicsSystem("opengl");
+}
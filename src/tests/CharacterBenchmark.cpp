@@ -0,0 +1,189 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterBenchmark.h"
+
+// Qt
+#include <QtCore/QVector>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Character.h"
+#include "../ExtendedCharTable.h"
+#include "../konsole_wcwidth.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int LINE_LENGTH = 4096;
+// the number of different sequences of combining characters, which is
+// kept below the size at which the table is checked for unused sequences
+const int SEQUENCE_COUNT = 256;
+const int SEQUENCE_LENGTH = 3;
+
+// returns a line of text whose colors and rendition change every few
+// characters, as in the output of 'ls --color' or a syntax highlighter
+QVector<Character> createLine()
+{
+    static const char text[] = "konsole_wcwidth(character) == 1 && ";
+
+    QVector<Character> line(LINE_LENGTH);
+    for (int i = 0; i < LINE_LENGTH; i++) {
+        const int word = i / 8;
+        line[i] = Character(text[i % (sizeof(text) - 1)],
+                            CharacterColor(COLOR_SPACE_SYSTEM, word % 8),
+                            CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR),
+                            (word % 3 == 0) ? RE_BOLD : DEFAULT_RENDITION);
+    }
+    return line;
+}
+
+// returns the sequences of a base character with combining marks which
+// are used by the ExtendedCharTable benchmarks
+QVector<ushort> createSequences()
+{
+    QVector<ushort> sequences(SEQUENCE_COUNT * SEQUENCE_LENGTH);
+    for (int i = 0; i < SEQUENCE_COUNT; i++) {
+        ushort* sequence = sequences.data() + i * SEQUENCE_LENGTH;
+        sequence[0] = 'a' + i % 26;
+        sequence[1] = 0x0300 + i % 0x70;
+        sequence[2] = 0x0300 + (i / 0x70) % 0x70;
+    }
+    return sequences;
+}
+}
+
+void CharacterBenchmark::benchmarkEquals()
+{
+    const QVector<Character> line = createLine();
+    const QVector<Character> other = line;
+    int equal = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < LINE_LENGTH; i++) {
+            if (line[i] == other[i])
+                equal++;
+        }
+    }
+
+    QVERIFY(equal != 0);
+}
+
+void CharacterBenchmark::benchmarkEqualsFormat()
+{
+    const QVector<Character> line = createLine();
+    int equal = 0;
+
+    // compares each character with the next one, as when the characters of
+    // a line are gathered into runs of the same format for drawing
+    QBENCHMARK {
+        for (int i = 1; i < LINE_LENGTH; i++) {
+            if (line[i].equalsFormat(line[i - 1]))
+                equal++;
+        }
+    }
+
+    QVERIFY(equal != 0);
+}
+
+void CharacterBenchmark::benchmarkWcwidth_data()
+{
+    QTest::addColumn<uint>("first");
+    QTest::addColumn<uint>("last");
+
+    QTest::newRow("ascii") << 0x20u << 0x7eu;
+    QTest::newRow("latin") << 0xa0u << 0x24fu;
+    QTest::newRow("combining") << 0x300u << 0x36fu;
+    QTest::newRow("cjk") << 0x4e00u << 0x9fffu;
+    QTest::newRow("emoji") << 0x1f300u << 0x1f64fu;
+}
+
+void CharacterBenchmark::benchmarkWcwidth()
+{
+    QFETCH(uint, first);
+    QFETCH(uint, last);
+
+    QVector<uint> codePoints(LINE_LENGTH);
+    for (int i = 0; i < LINE_LENGTH; i++)
+        codePoints[i] = first + i % (last - first + 1);
+
+    int width = 0;
+
+    if (last > 0xffff) {
+        QBENCHMARK {
+            for (int i = 0; i < LINE_LENGTH; i++)
+                width += konsole_wcwidth_ucs4(codePoints[i]);
+        }
+    } else {
+        QBENCHMARK {
+            for (int i = 0; i < LINE_LENGTH; i++)
+                width += konsole_wcwidth(codePoints[i]);
+        }
+    }
+
+    QVERIFY(width != 0);
+}
+
+void CharacterBenchmark::benchmarkCreateExtendedChar()
+{
+    const QVector<ushort> sequences = createSequences();
+    int sum = 0;
+
+    // after the first iteration every sequence is in the table already,
+    // which is the common case of the same accented letters recurring
+    QBENCHMARK {
+        for (int i = 0; i < SEQUENCE_COUNT; i++) {
+            sum += ExtendedCharTable::instance.createExtendedChar(
+                       sequences.constData() + i * SEQUENCE_LENGTH, SEQUENCE_LENGTH);
+        }
+    }
+
+    QVERIFY(sum != 0);
+}
+
+void CharacterBenchmark::benchmarkLookupExtendedChar()
+{
+    const QVector<ushort> sequences = createSequences();
+    QVector<ushort> hashes(SEQUENCE_COUNT);
+    for (int i = 0; i < SEQUENCE_COUNT; i++) {
+        hashes[i] = ExtendedCharTable::instance.createExtendedChar(
+                        sequences.constData() + i * SEQUENCE_LENGTH, SEQUENCE_LENGTH);
+    }
+
+    int sum = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < SEQUENCE_COUNT; i++) {
+            ushort length = 0;
+            const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(hashes[i], length);
+            if (chars)
+                sum += length;
+        }
+    }
+
+    QVERIFY(sum != 0);
+}
+
+QTEST_KDEMAIN_CORE(CharacterBenchmark)
+
+#include "CharacterBenchmark.moc"
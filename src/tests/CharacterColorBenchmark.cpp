@@ -0,0 +1,120 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterColorBenchmark.h"
+
+// Qt
+#include <QtCore/QVector>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../CharacterColor.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int COLOR_COUNT = 4096;
+
+// returns a color table of grays
+const ColorEntry* colorTable()
+{
+    static ColorEntry table[TABLE_COLORS];
+    if (!table[0].color.isValid()) {
+        for (int i = 0; i < TABLE_COLORS; i++)
+            table[i] = ColorEntry(QColor(i * 12, i * 12, i * 12));
+    }
+    return table;
+}
+
+// returns COLOR_COUNT colors of the given color space
+QVector<CharacterColor> createColors(int colorSpace)
+{
+    QVector<CharacterColor> colors(COLOR_COUNT);
+    for (int i = 0; i < COLOR_COUNT; i++) {
+        switch (colorSpace) {
+        case COLOR_SPACE_RGB:
+            // a few hundred different colors, as in a true color image
+            colors[i] = CharacterColor(colorSpace, (i % 512) * 0x8081);
+            break;
+        default:
+            colors[i] = CharacterColor(colorSpace, i);
+        }
+    }
+    return colors;
+}
+
+void addColorSpaces()
+{
+    QTest::addColumn<int>("colorSpace");
+
+    QTest::newRow("system") << COLOR_SPACE_SYSTEM;
+    QTest::newRow("256 colors") << COLOR_SPACE_256;
+    QTest::newRow("rgb") << COLOR_SPACE_RGB;
+}
+}
+
+void CharacterColorBenchmark::benchmarkColor_data()
+{
+    addColorSpaces();
+}
+
+void CharacterColorBenchmark::benchmarkColor()
+{
+    QFETCH(int, colorSpace);
+
+    const QVector<CharacterColor> colors = createColors(colorSpace);
+    const ColorEntry* table = colorTable();
+    QRgb sum = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < COLOR_COUNT; i++)
+            sum += colors[i].color(table).rgb();
+    }
+
+    QVERIFY(sum != 0);
+}
+
+void CharacterColorBenchmark::benchmarkRgb_data()
+{
+    addColorSpaces();
+}
+
+void CharacterColorBenchmark::benchmarkRgb()
+{
+    QFETCH(int, colorSpace);
+
+    const QVector<CharacterColor> colors = createColors(colorSpace);
+    const ColorEntry* table = colorTable();
+    QRgb sum = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < COLOR_COUNT; i++)
+            sum += colors[i].rgb(table);
+    }
+
+    QVERIFY(sum != 0);
+}
+
+QTEST_KDEMAIN_CORE(CharacterColorBenchmark)
+
+#include "CharacterColorBenchmark.moc"
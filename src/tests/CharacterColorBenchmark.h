@@ -0,0 +1,46 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef CHARACTERCOLORBENCHMARK_H
+#define CHARACTERCOLORBENCHMARK_H
+
+#include <QtCore/QObject>
+
+namespace Konsole
+{
+
+/**
+ * Measures how long resolving the colors of a line of characters takes
+ * with CharacterColor::color() and with CharacterColor::rgb(), for each
+ * of the color spaces.
+ */
+class CharacterColorBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void benchmarkColor_data();
+    void benchmarkColor();
+    void benchmarkRgb_data();
+    void benchmarkRgb();
+};
+
+}
+
+#endif // CHARACTERCOLORBENCHMARK_H
@@ -27,6 +27,9 @@
 // KDE
 #include <qtest_kde.h>
 
+// Konsole
+#include "../Character.h"
+
 using namespace Konsole;
 
 const ColorEntry CharacterColorTest::DefaultColorTable[TABLE_COLORS] = {
@@ -113,6 +116,119 @@ void CharacterColorTest::testColorSpaceSystem()
     //QCOMPARE(result, expected);
 }
 
+void CharacterColorTest::testColorSpaceRGB()
+{
+    const QColor expected(0x12, 0x34, 0x56);
+
+    CharacterColor charColor(COLOR_SPACE_RGB, expected.rgb() & 0xffffff);
+    QCOMPARE(charColor.color(DefaultColorTable), expected);
+
+    // the same color must be represented by the same value
+    QVERIFY(charColor == CharacterColor(COLOR_SPACE_RGB, 0x123456));
+    QVERIFY(charColor != CharacterColor(COLOR_SPACE_RGB, 0x123457));
+}
+
+void CharacterColorTest::testRgbColorReuse()
+{
+    // no screen uses the colors, so once the table is full the earlier
+    // colors are freed and new colors are still exact
+    const quint64 generation = rgbColorGeneration();
+    for (int i = 0; i < 3 * CharacterColor::MAX_RGB_INDEX; i++) {
+        const CharacterColor charColor(COLOR_SPACE_RGB, 0x200000 + i);
+        QVERIFY(charColor.isRgb());
+        QCOMPARE(charColor.rgb(DefaultColorTable), QRgb(0xff200000 + i));
+    }
+    QVERIFY(rgbColorGeneration() != generation);
+}
+
+void CharacterColorTest::testPaletteIndex()
+{
+    // a palette resolved from the color table gives the same colors as
+    // resolving each color on its own
+    QColor palette[PALETTE_COLORS];
+    for (int i = 0; i < TABLE_COLORS; i++)
+        palette[i] = DefaultColorTable[i].color;
+    for (int i = 0; i < 256; i++)
+        palette[TABLE_COLORS + i] = color256(i, DefaultColorTable);
+
+    QList<CharacterColor> colors;
+    for (int i = 0; i < 2; i++)
+        colors << CharacterColor(COLOR_SPACE_DEFAULT, i);
+    for (int i = 0; i < 16; i++)
+        colors << CharacterColor(COLOR_SPACE_SYSTEM, i);
+    for (int i = 0; i < 256; i++)
+        colors << CharacterColor(COLOR_SPACE_256, i);
+
+    foreach(CharacterColor color, colors) {
+        QCOMPARE(palette[color.paletteIndex()], color.color(DefaultColorTable));
+        color.setIntensive();
+        QCOMPARE(palette[color.paletteIndex()], color.color(DefaultColorTable));
+    }
+
+    QCOMPARE(CharacterColor(COLOR_SPACE_RGB, 0x123456).paletteIndex(), -1);
+    QCOMPARE(CharacterColor().paletteIndex(), -1);
+}
+
+void CharacterColorTest::testColor256()
+{
+    // the precomputed colors match the xterm color cube and grays
+    for (int i = 16; i < 256; i++) {
+        QColor expected;
+        if (i < 232) {
+            const int r = ((i - 16) / 36) % 6;
+            const int g = ((i - 16) / 6) % 6;
+            const int b = (i - 16) % 6;
+            expected = QColor(r ? r * 40 + 55 : 0, g ? g * 40 + 55 : 0, b ? b * 40 + 55 : 0);
+        } else {
+            const int gray = (i - 232) * 10 + 8;
+            expected = QColor(gray, gray, gray);
+        }
+
+        QCOMPARE(color256(i, DefaultColorTable), expected);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        QCOMPARE(color256(i, DefaultColorTable), DefaultColorTable[2 + i].color);
+        QCOMPARE(color256(i + 8, DefaultColorTable),
+                 DefaultColorTable[2 + BASE_COLORS + i].color);
+    }
+}
+
+void CharacterColorTest::testRgb()
+{
+    QList<CharacterColor> colors;
+    for (int i = 0; i < 2; i++)
+        colors << CharacterColor(COLOR_SPACE_DEFAULT, i);
+    for (int i = 0; i < 16; i++)
+        colors << CharacterColor(COLOR_SPACE_SYSTEM, i);
+    for (int i = 0; i < 256; i++)
+        colors << CharacterColor(COLOR_SPACE_256, i);
+    colors << CharacterColor(COLOR_SPACE_RGB, 0x123456);
+
+    foreach(CharacterColor color, colors) {
+        QCOMPARE(color.rgb(DefaultColorTable), color.color(DefaultColorTable).rgb());
+        color.setIntensive();
+        QCOMPARE(color.rgb(DefaultColorTable), color.color(DefaultColorTable).rgb());
+    }
+
+    QCOMPARE(CharacterColor().rgb(DefaultColorTable), QRgb(0));
+}
+
+void CharacterColorTest::testCharacterSize()
+{
+    QCOMPARE(sizeof(CharacterColor), sizeof(quint16));
+    QCOMPARE(sizeof(Character), sizeof(quint64));
+
+    // isRealCharacter is not taken into account when comparing characters
+    Character a('x');
+    Character b('x');
+    b.isRealCharacter = false;
+    QVERIFY(a == b);
+
+    b.backgroundColor = CharacterColor(COLOR_SPACE_SYSTEM, 1);
+    QVERIFY(a != b);
+}
+
 QTEST_KDEMAIN_CORE(CharacterColorTest)
 
 #include "CharacterColorTest.moc"
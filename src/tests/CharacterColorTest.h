@@ -38,6 +38,12 @@ private slots:
     void testColorSpaceDefault();
     void testColorSpaceSystem_data();
     void testColorSpaceSystem();
+    void testColorSpaceRGB();
+    void testRgbColorReuse();
+    void testPaletteIndex();
+    void testColor256();
+    void testRgb();
+    void testCharacterSize();
 
 private:
     static const ColorEntry DefaultColorTable[];
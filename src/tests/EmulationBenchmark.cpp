@@ -0,0 +1,227 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "EmulationBenchmark.h"
+
+// Qt
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTextCodec>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../History.h"
+#include "../SessionRecording.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int LINES = 40;
+const int COLUMNS = 120;
+const int HISTORY_LINES = 1000;
+// the size in which the pty passes on the output
+const int CHUNK_SIZE = 4096;
+// the approximate size of each of the generated streams
+const int STREAM_SIZE = 1024 * 1024;
+
+QByteArray repeated(const QByteArray& text)
+{
+    QByteArray stream;
+    stream.reserve(STREAM_SIZE + text.size());
+    while (stream.size() < STREAM_SIZE)
+        stream += text;
+    return stream;
+}
+
+// eg. the output of cat or a compiler
+QByteArray plainText()
+{
+    QByteArray text;
+    for (int i = 0; i < 50; i++)
+        text += "The quick brown fox jumps over the lazy dog " + QByteArray::number(i) + "\r\n";
+    return repeated(text);
+}
+
+// eg. the output of ls --color or a colored log
+QByteArray colorText()
+{
+    QByteArray text;
+    for (int i = 0; i < 50; i++) {
+        text += "\033[1;34mdirectory\033[0m  \033[32mexecutable\033[0m  file  ";
+        text += "\033[38;5;" + QByteArray::number(i * 5) + "m256 colors\033[0m  ";
+        text += "\033[48;5;" + QByteArray::number(255 - i) + "mbackground\033[m\r\n";
+    }
+    return repeated(text);
+}
+
+// full screen applications such as vim or htop, which move the cursor
+// around and rewrite parts of the screen
+QByteArray screenRedraw()
+{
+    QByteArray text = "\033[?1049h\033[H\033[2J";
+    for (int line = 1; line <= LINES; line++) {
+        text += "\033[" + QByteArray::number(line) + ";1H\033[K";
+        text += "\033[7m" + QByteArray::number(line) + "\033[27m ";
+        text += "\033[33mint\033[39m value = \033[31m" + QByteArray::number(line * 7) + "\033[39m;";
+        text += "\033[" + QByteArray::number(line) + ";100H\033[1m|||||\033[22m";
+    }
+    text += "\033[" + QByteArray::number(LINES) + ";1H\033[7m-- INSERT --\033[0m";
+    text += "\033[10;20r\033[10;1H\033M\033M\033[r";
+    return repeated(text);
+}
+
+// text from a few scripts, including double width characters and
+// box drawing characters
+QByteArray unicodeText()
+{
+    const QString text = QString::fromUtf8(
+                             "Ελληνικά Русский текст 日本語の文章 한국어 텍스트 ┌──┬──┐ │ä│ö│ └──┴──┘ "
+                             "∮ E⋅da = Q, n → ∞, ∑ f(i) = ∏ g(i) 😀🚀\r\n");
+    return repeated(text.toUtf8());
+}
+
+// decomposed text, in which many characters have several combining marks
+QByteArray combiningText()
+{
+    const QString text = QString::fromUtf8(
+                             "Tie\xcc\x82\xcc\x81ng Vie\xcc\xa3\xcc\x82t co\xcc\x81 nhie\xcc\x82\xcc\x80u da\xcc\x82\xcc\x81u "
+                             "a\xcc\x80\xcc\x81\xcc\x82\xcc\x83\xcc\x88 filename-nfd-e\xcc\x81\xcc\x81.txt\r\n");
+    return repeated(text.toUtf8());
+}
+
+bool isRecording(const QString& fileName)
+{
+    SessionRecordingReader reader(fileName);
+    return reader.open();
+}
+
+QFileInfoList captureFiles()
+{
+    const QByteArray captures = qgetenv("KONSOLE_BENCHMARK_CAPTURES");
+    if (captures.isEmpty())
+        return QFileInfoList();
+
+    const QDir dir(QFile::decodeName(captures));
+    return dir.entryInfoList(QDir::Files, QDir::Name);
+}
+
+void printRate(qint64 bytes, qint64 elapsed)
+{
+    if (elapsed > 0) {
+        qDebug("%s: %.1f MB/s, %.2f ns/byte", QTest::currentDataTag(),
+               bytes / (elapsed / 1000.0) / (1024 * 1024),
+               elapsed * 1000000.0 / bytes);
+    }
+}
+}
+
+void EmulationBenchmark::benchmarkReceiveData_data()
+{
+    QTest::addColumn<QByteArray>("stream");
+
+    QTest::newRow("plain text") << plainText();
+    QTest::newRow("colors") << colorText();
+    QTest::newRow("screen redraw") << screenRedraw();
+    QTest::newRow("unicode") << unicodeText();
+    QTest::newRow("combining characters") << combiningText();
+
+    foreach(const QFileInfo& info, captureFiles()) {
+        if (isRecording(info.filePath()))
+            continue;
+
+        QFile file(info.filePath());
+        if (file.open(QIODevice::ReadOnly))
+            QTest::newRow(QFile::encodeName(info.fileName()).constData()) << file.readAll();
+    }
+}
+
+void EmulationBenchmark::benchmarkReceiveData()
+{
+    QFETCH(QByteArray, stream);
+    QVERIFY(!stream.isEmpty());
+
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(CompactHistoryType(HISTORY_LINES));
+    emulation.setImageSize(LINES, COLUMNS);
+
+    qint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        for (int i = 0; i < stream.size(); i += CHUNK_SIZE)
+            emulation.receiveData(stream.constData() + i, qMin(CHUNK_SIZE, stream.size() - i));
+        bytes += stream.size();
+    }
+
+    printRate(bytes, timer.elapsed());
+}
+
+void EmulationBenchmark::benchmarkReplay_data()
+{
+    QTest::addColumn<QString>("fileName");
+
+    foreach(const QFileInfo& info, captureFiles()) {
+        if (isRecording(info.filePath()))
+            QTest::newRow(QFile::encodeName(info.fileName()).constData()) << info.filePath();
+    }
+}
+
+void EmulationBenchmark::benchmarkReplay()
+{
+    QFETCH(QString, fileName);
+
+    QList<RecordedEvent> events;
+    qint64 recordingSize = 0;
+
+    SessionRecordingReader reader(fileName);
+    QVERIFY(reader.open());
+    RecordedEvent event;
+    while (reader.readEvent(&event)) {
+        events << event;
+        recordingSize += event.data.size();
+    }
+    QVERIFY2(reader.errorString().isEmpty(), qPrintable(reader.errorString()));
+
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(CompactHistoryType(HISTORY_LINES));
+    emulation.setImageSize(LINES, COLUMNS);
+
+    qint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK {
+        foreach(const RecordedEvent& recordedEvent, events)
+            SessionReplay::replayEvent(recordedEvent, &emulation);
+        bytes += recordingSize;
+    }
+
+    printRate(bytes, timer.elapsed());
+}
+
+QTEST_KDEMAIN_CORE(EmulationBenchmark)
+
+#include "EmulationBenchmark.moc"
@@ -0,0 +1,50 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef EMULATIONBENCHMARK_H
+#define EMULATIONBENCHMARK_H
+
+#include <QtCore/QObject>
+
+namespace Konsole
+{
+
+/**
+ * Measures how fast output is processed by a Vt102Emulation and its
+ * screens, without a display or a pty.
+ *
+ * Besides the generated streams, each file in the directory named by the
+ * KONSOLE_BENCHMARK_CAPTURES environment variable is replayed, which
+ * allows captured output (eg. of vim or htop, recorded with script(1))
+ * to be measured.  Recordings made with Session::setRecordingFile() are
+ * replayed at maximum speed, including the changes of the terminal size.
+ * Run with -iterations to get more stable numbers.
+ */
+class EmulationBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void benchmarkReceiveData_data();
+    void benchmarkReceiveData();
+    void benchmarkReplay_data();
+    void benchmarkReplay();
+};
+
+}
+
+#endif // EMULATIONBENCHMARK_H
@@ -0,0 +1,194 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "EmulationFuzzTest.h"
+
+// Qt
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTextCodec>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../History.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int LINES = 40;
+const int COLUMNS = 120;
+const int HISTORY_LINES = 1000;
+// the size in which the pty passes on the output
+const int CHUNK_SIZE = 4096;
+
+// each stream is received at two sizes, the larger one SIZE_FACTOR times
+// the smaller.  The smaller size is doubled from MINIMUM_SIZE until the
+// stream takes at least MINIMUM_TIME milliseconds or MAXIMUM_SIZE is reached
+const int MINIMUM_SIZE = 16 * 1024;
+const int MAXIMUM_SIZE = 1024 * 1024;
+const int MINIMUM_TIME = 50;
+const int SIZE_FACTOR = 4;
+// the times are the best of this many runs, to leave out the noise
+const int RUNS = 3;
+// work which is linear in the size of the stream takes the same time per
+// byte at both sizes.  The larger stream may take this many times as long
+// per byte before the work counts as super-linear
+const double MAXIMUM_SLOWDOWN = 3.0;
+
+// the random changes of the mutated streams are the same for each run
+const uint RANDOM_SEED = 1;
+// the pieces which are inserted into the mutated streams, parts of
+// control sequences and text which the parser and the screen treat
+// specially
+const char* const FRAGMENTS[] = {
+    "\033", "\033[", "\033]", "\033P", "\033[?", "\033(0", ";", "9999", "\030",
+    "\007", "\033\\", "\xcc\x81", "\xe6\x97\xa5", "\xf0\x9f\x98\x80", "\xc3", "\x9b",
+    "\r\n", "\t", "\010", "\033[?1049h", "\033[?1049l", "\033[2J", "\033[10;20r"
+};
+const int FRAGMENT_COUNT = sizeof(FRAGMENTS) / sizeof(FRAGMENTS[0]);
+
+// returns 'prefix' followed by 'seed' repeated until the stream is 'size'
+// bytes long.  When 'mutate' is set, random pieces of the seed are repeated
+// instead, with random fragments between them.  The stream of a smaller
+// size is the start of the stream of a larger one
+QByteArray generateStream(const QByteArray& prefix, const QByteArray& seed, bool mutate, int size)
+{
+    QByteArray stream;
+    stream.reserve(size + seed.size() + 64);
+    stream += prefix;
+
+    qsrand(RANDOM_SEED);
+    while (stream.size() < size) {
+        if (mutate) {
+            const int start = qrand() % seed.size();
+            const int length = 1 + qrand() % qMin(seed.size() - start, 256);
+            stream.append(seed.constData() + start, length);
+            stream += FRAGMENTS[qrand() % FRAGMENT_COUNT];
+        } else {
+            stream += seed;
+        }
+    }
+
+    stream.truncate(size);
+    return stream;
+}
+
+// returns the time in milliseconds which an emulation takes to receive
+// 'stream'
+qint64 receiveTime(const QByteArray& stream)
+{
+    qint64 bestTime = -1;
+    for (int run = 0; run < RUNS; run++) {
+        Vt102Emulation emulation;
+        emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+        emulation.setHistory(CompactHistoryType(HISTORY_LINES));
+        emulation.setImageSize(LINES, COLUMNS);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < stream.size(); i += CHUNK_SIZE)
+            emulation.receiveData(stream.constData() + i, qMin(CHUNK_SIZE, stream.size() - i));
+
+        const qint64 time = timer.elapsed();
+        if (bestTime == -1 || time < bestTime)
+            bestTime = time;
+    }
+    return bestTime;
+}
+
+// the corpus in tests/fuzz, followed by the UTF-8 test files
+QFileInfoList corpusFiles()
+{
+    const QDir testDir(QLatin1String(KONSOLE_TEST_DATA_DIR));
+
+    QFileInfoList files = QDir(testDir.filePath("fuzz")).entryInfoList(QDir::Files, QDir::Name);
+    files << QFileInfo(testDir.filePath("UTF-8-test.txt"))
+          << QFileInfo(testDir.filePath("UTF-8-demo.txt"));
+    return files;
+}
+}
+
+void EmulationFuzzTest::testLinearTime_data()
+{
+    QTest::addColumn<QByteArray>("prefix");
+    QTest::addColumn<QByteArray>("seed");
+    QTest::addColumn<bool>("mutate");
+
+    // sequences which never end, or which are much longer than the
+    // limits of the parser
+    QTest::newRow("endless CSI") << QByteArray("\033[") << QByteArray("1;") << false;
+    QTest::newRow("long CSI") << QByteArray()
+                              << "\033[" + QByteArray("1;").repeated(1000) + "m" << false;
+    QTest::newRow("huge CSI arguments") << QByteArray()
+                                        << QByteArray("\033[99999999999999;99999999999999H") << false;
+    QTest::newRow("endless OSC") << QByteArray("\033]0;") << QByteArray("title ") << false;
+    QTest::newRow("endless DCS") << QByteArray("\033P") << QByteArray("data ") << false;
+
+    // each combining mark is added to the sequence of the character before
+    QTest::newRow("endless combining marks") << QByteArray("x") << QByteArray("\xcc\x81") << false;
+    QTest::newRow("combining marks on wide characters")
+            << QByteArray() << "\xe6\x97\xa5" + QByteArray("\xcc\x81").repeated(100) << false;
+
+    QTest::newRow("scrolling") << QByteArray() << QByteArray("line\r\n") << false;
+
+    foreach(const QFileInfo& info, corpusFiles()) {
+        QFile file(info.filePath());
+        QVERIFY2(file.open(QIODevice::ReadOnly), qPrintable(info.filePath()));
+        const QByteArray seed = file.readAll();
+
+        const QByteArray name = QFile::encodeName(info.fileName());
+        QTest::newRow(name.constData()) << QByteArray() << seed << false;
+        QTest::newRow((name + " mutated").constData()) << QByteArray() << seed << true;
+    }
+}
+
+void EmulationFuzzTest::testLinearTime()
+{
+    QFETCH(QByteArray, prefix);
+    QFETCH(QByteArray, seed);
+    QFETCH(bool, mutate);
+    QVERIFY(!seed.isEmpty());
+
+    int size = MINIMUM_SIZE;
+    qint64 time = receiveTime(generateStream(prefix, seed, mutate, size));
+    while (time < MINIMUM_TIME && size < MAXIMUM_SIZE) {
+        size *= 2;
+        time = receiveTime(generateStream(prefix, seed, mutate, size));
+    }
+
+    const int largeSize = SIZE_FACTOR * size;
+    const qint64 largeTime = receiveTime(generateStream(prefix, seed, mutate, largeSize));
+
+    // times below MINIMUM_TIME are too short to compare
+    const double slowdown = double(largeTime) / SIZE_FACTOR / qMax(time, qint64(MINIMUM_TIME));
+    QVERIFY2(slowdown < MAXIMUM_SLOWDOWN,
+             qPrintable(QString("%1 bytes took %2 ms, %3 bytes took %4 ms")
+                        .arg(size).arg(time).arg(largeSize).arg(largeTime)));
+}
+
+QTEST_KDEMAIN_CORE(EmulationFuzzTest)
+
+#include "EmulationFuzzTest.moc"
+
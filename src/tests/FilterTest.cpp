@@ -0,0 +1,291 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "FilterTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Filter.h"
+
+using namespace Konsole;
+
+static const int LINES = 4;
+static const int COLUMNS = 20;
+
+// fills line 'line' of 'image' with 'text', followed by spaces
+static void setLine(QVector<Character>& image, int line, const QString& text)
+{
+    for (int column = 0; column < COLUMNS; column++) {
+        const QChar c = column < text.length() ? text.at(column) : QChar(' ');
+        image[line * COLUMNS + column] = Character(c.unicode());
+    }
+}
+
+void FilterTest::testRegExpFilter()
+{
+    QVector<Character> image(LINES * COLUMNS);
+    const QVector<LineProperty> properties(LINES, LINE_DEFAULT);
+    setLine(image, 0, "foo");
+    setLine(image, 1, "bar");
+    setLine(image, 2, "a foo b foo");
+    setLine(image, 3, QString());
+
+    TerminalImageFilterChain chain;
+    RegExpFilter* filter = new RegExpFilter();
+    filter->setRegExp(QRegExp("foo"));
+    chain.addFilter(filter);
+
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    chain.process();
+
+    QCOMPARE(chain.hotSpots().count(), 3);
+    QVERIFY(chain.hotSpotAt(0, 0));
+    QVERIFY(!chain.hotSpotAt(1, 0));
+    QCOMPARE(chain.hotSpotAt(2, 2)->startColumn(), 2);
+    QCOMPARE(chain.hotSpotAt(2, 8)->startColumn(), 8);
+    QCOMPARE(chain.hotSpotAt(2, 8)->endColumn(), 11);
+
+    // matches do not extend past the end of a line
+    filter->setRegExp(QRegExp("foo\\s+bar"));
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    chain.process();
+    QCOMPARE(chain.hotSpots().count(), 0);
+}
+
+void FilterTest::testScrolledImage()
+{
+    QVector<Character> image(LINES * COLUMNS);
+    const QVector<LineProperty> properties(LINES, LINE_DEFAULT);
+    setLine(image, 0, "foo");
+    setLine(image, 1, "bar");
+    setLine(image, 2, "a foo b foo");
+    setLine(image, 3, QString());
+
+    TerminalImageFilterChain chain;
+    RegExpFilter* filter = new RegExpFilter();
+    filter->setRegExp(QRegExp("fo+"));
+    chain.addFilter(filter);
+
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    chain.process();
+    QCOMPARE(chain.hotSpots().count(), 3);
+
+    // scroll the image up by one line and add a new line at the bottom.  the
+    // hotspots of the lines which were reused must move along with them
+    setLine(image, 0, "bar");
+    setLine(image, 1, "a foo b foo");
+    setLine(image, 2, QString());
+    setLine(image, 3, "fooo");
+
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    chain.process();
+
+    QCOMPARE(chain.hotSpots().count(), 3);
+    QVERIFY(!chain.hotSpotAt(0, 0));
+    QCOMPARE(chain.hotSpotAt(1, 2)->startLine(), 1);
+    QCOMPARE(chain.hotSpotAt(1, 2)->startColumn(), 2);
+    QCOMPARE(chain.hotSpotAt(1, 9)->startColumn(), 8);
+    QCOMPARE(chain.hotSpotAt(3, 0)->endColumn(), 4);
+}
+
+void FilterTest::testWrappedLines()
+{
+    QVector<Character> image(LINES * COLUMNS);
+    QVector<LineProperty> properties(LINES, LINE_DEFAULT);
+    setLine(image, 0, "a foo");
+    setLine(image, 1, "xxxxxxxxxxxxxxxx foo");
+    setLine(image, 2, "bar foo");
+    setLine(image, 3, "bar");
+    properties[1] = LINE_WRAPPED;
+
+    TerminalImageFilterChain chain;
+    RegExpFilter* filter = new RegExpFilter();
+    filter->setRegExp(QRegExp("foo\\w*"));
+    chain.addFilter(filter);
+
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    chain.process();
+    QCOMPARE(chain.hotSpots().count(), 3);
+
+    // a match continues on the line which a wrapped line continues on
+    Filter::HotSpot* spot = chain.hotSpotAt(2, 1);
+    QVERIFY(spot);
+    QCOMPARE(spot->startLine(), 1);
+    QCOMPARE(spot->startColumn(), 17);
+    QCOMPARE(spot->endLine(), 2);
+    QCOMPARE(spot->endColumn(), 3);
+
+    // but not on the line after a line which is not wrapped
+    QCOMPARE(chain.hotSpotAt(2, 4)->endColumn(), 7);
+    QVERIFY(!chain.hotSpotAt(3, 0));
+
+    // the space at the end of a wrapped line separates it from the next one
+    setLine(image, 0, "xxxxxxxxxxxxxxxxfoo ");
+    setLine(image, 1, "bar");
+    properties[0] = LINE_WRAPPED;
+    properties[1] = LINE_DEFAULT;
+
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    chain.process();
+    spot = chain.hotSpotAt(0, 16);
+    QVERIFY(spot);
+    QCOMPARE(spot->endLine(), 0);
+    QCOMPARE(spot->endColumn(), 19);
+    QVERIFY(!chain.hotSpotAt(1, 0));
+}
+
+void FilterTest::testFixedString()
+{
+    QVector<Character> image(LINES * COLUMNS);
+    const QVector<LineProperty> properties(LINES, LINE_DEFAULT);
+    setLine(image, 0, "a.b A.B a.b");
+    setLine(image, 1, "axb");
+    setLine(image, 2, QString());
+    setLine(image, 3, QString());
+
+    TerminalImageFilterChain chain;
+    RegExpFilter* filter = new RegExpFilter();
+    filter->setRegExp(QRegExp("a.b", Qt::CaseInsensitive, QRegExp::FixedString));
+    chain.addFilter(filter);
+
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    chain.process();
+
+    QCOMPARE(chain.hotSpots().count(), 3);
+    QVERIFY(!chain.hotSpotAt(1, 0));
+
+    RegExpFilter::HotSpot* spot = static_cast<RegExpFilter::HotSpot*>(chain.hotSpotAt(0, 4));
+    QVERIFY(spot);
+    QCOMPARE(spot->startColumn(), 4);
+    QCOMPARE(spot->endColumn(), 7);
+    QCOMPARE(spot->capturedTexts(), QStringList() << "A.B");
+}
+
+void FilterTest::testSearches()
+{
+    QVector<Character> image(LINES * COLUMNS);
+    const QVector<LineProperty> properties(LINES, LINE_DEFAULT);
+    setLine(image, 0, "foo");
+    setLine(image, 1, "bar");
+    setLine(image, 2, "a foo b foo");
+    setLine(image, 3, "foo");
+
+    TerminalImageFilterChain chain;
+    RegExpFilter* filter = new RegExpFilter();
+    filter->setRegExp(QRegExp("foo"));
+    chain.addFilter(filter);
+
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    QList<RegExpFilter::Search> searches = chain.searches();
+    QCOMPARE(searches.count(), 1);
+    QVERIFY(searches[0].lines.contains("a foo b foo"));
+    QCOMPARE(searches[0].lines.count("foo"), 1);
+
+    // once the results of the searches are added, there is nothing left
+    // to search and processing the chain uses them
+    searches[0].run();
+    chain.addSearchResults(searches);
+    QVERIFY(chain.searches().isEmpty());
+    chain.process();
+    QCOMPARE(chain.hotSpots().count(), 4);
+
+    setLine(image, 1, "foo bar");
+    chain.setImage(image.constData(), LINES, COLUMNS, properties);
+    searches = chain.searches();
+    QCOMPARE(searches.count(), 1);
+    QCOMPARE(searches[0].lines, QStringList() << "foo bar");
+
+    // the results of a search for another regular expression are ignored
+    searches[0].run();
+    filter->setRegExp(QRegExp("bar"));
+    chain.addSearchResults(searches);
+    chain.process();
+    QCOMPARE(chain.hotSpots().count(), 1);
+    QCOMPARE(chain.hotSpotAt(1, 4)->startColumn(), 4);
+}
+
+void FilterTest::testSharedMatches()
+{
+    QVector<Character> image(LINES * COLUMNS);
+    const QVector<LineProperty> properties(LINES, LINE_DEFAULT);
+    setLine(image, 0, "shared1 shared2");
+    setLine(image, 1, "shared3");
+
+    TerminalImageFilterChain first;
+    RegExpFilter* firstFilter = new RegExpFilter();
+    firstFilter->setRegExp(QRegExp("shared\\d"));
+    first.addFilter(firstFilter);
+    first.setImage(image.constData(), LINES, COLUMNS, properties);
+    QCOMPARE(first.searches().count(), 1);
+    first.process();
+    QCOMPARE(first.hotSpots().count(), 3);
+
+    // another view of the same output has nothing left to search
+    TerminalImageFilterChain second;
+    RegExpFilter* secondFilter = new RegExpFilter();
+    secondFilter->setRegExp(QRegExp("shared\\d"));
+    second.addFilter(secondFilter);
+    second.setImage(image.constData(), LINES, COLUMNS, properties);
+    QVERIFY(second.searches().isEmpty());
+    second.process();
+    QCOMPARE(second.hotSpots().count(), 3);
+    QCOMPARE(second.hotSpotAt(0, 9)->startColumn(), 8);
+
+    // but a filter with other required texts does
+    secondFilter->setRequiredTexts(QStringList() << "shared");
+    second.setImage(image.constData(), LINES, COLUMNS, properties);
+    QCOMPARE(second.searches().count(), 1);
+}
+
+void FilterTest::testHotSpotIndex()
+{
+    RegExpFilter::HotSpot first(0, 2, 0, 6);
+    RegExpFilter::HotSpot second(0, 4, 2, 3);
+    RegExpFilter::HotSpot third(1, 0, 1, 5);
+
+    HotSpotIndex index;
+    index.addHotSpot(&first);
+    index.addHotSpot(&second);
+    index.addHotSpot(&third);
+
+    QCOMPARE(index.lineCount(), 3);
+    QVERIFY(!index.hotSpotAt(0, 1));
+    QVERIFY(index.hotSpotAt(0, 2) == &first);
+    // where hotspots overlap, the one added first is found
+    QVERIFY(index.hotSpotAt(0, 6) == &first);
+    QVERIFY(index.hotSpotAt(0, 7) == &second);
+    QVERIFY(index.hotSpotAt(0, 500) == &second);
+    QVERIFY(index.hotSpotAt(1, 0) == &second);
+    QVERIFY(index.hotSpotAt(2, 3) == &second);
+    QVERIFY(!index.hotSpotAt(2, 4));
+    QVERIFY(!index.hotSpotAt(3, 0));
+
+    QCOMPARE(index.spans(0).count(), 2);
+    QCOMPARE(index.spans(0)[1].startColumn, 7);
+    QCOMPARE(index.spans(1).count(), 1);
+
+    index.clear();
+    QCOMPARE(index.lineCount(), 0);
+    QVERIFY(!index.hotSpotAt(0, 2));
+}
+
+QTEST_KDEMAIN_CORE(FilterTest)
+
+#include "FilterTest.moc"
@@ -0,0 +1,283 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryBenchmark.h"
+
+// Qt
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../History.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int LINE_COUNT = 100000;
+const int READ_COUNT = 10000;
+const int CONVERSION_RUNS = 3;
+const int CONVERSION_LINE_LENGTH = 80;
+
+enum HistoryKind {
+    NoHistory,
+    FileHistory,
+    CompactHistory,
+    CompressedHistory
+};
+
+const char* const KIND_NAMES[] = { "none", "file", "compact", "compressed" };
+const int KIND_COUNT = sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]);
+
+// how often the attributes change within a line
+enum Density {
+    // never, eg. the output of cat
+    PlainDensity,
+    // every few words, eg. a colored log
+    WordDensity,
+    // in every cell, eg. a color test
+    CellDensity
+};
+
+const char* const DENSITY_NAMES[] = { "plain", "words", "every cell" };
+const int DENSITY_COUNT = sizeof(DENSITY_NAMES) / sizeof(DENSITY_NAMES[0]);
+
+const int LINE_LENGTHS[] = { 10, 80, 400 };
+const int LINE_LENGTH_COUNT = sizeof(LINE_LENGTHS) / sizeof(LINE_LENGTHS[0]);
+
+HistoryType* createType(int kind, const QString& directory)
+{
+    switch (kind) {
+    case FileHistory:
+        return new HistoryTypeFile(directory + "/history");
+    case CompactHistory:
+        return new CompactHistoryType(LINE_COUNT);
+    case CompressedHistory:
+        return new CompressedHistoryType(LINE_COUNT);
+    default:
+        return new HistoryTypeNone();
+    }
+}
+
+QVector<Character> createLine(int line, int length, int density)
+{
+    QVector<Character> cells(length);
+    for (int column = 0; column < length; column++) {
+        Character& c = cells[column];
+        c.character = 'a' + (line + column) % 26;
+
+        int run = -1;
+        if (density == WordDensity)
+            run = column / 8;
+        else if (density == CellDensity)
+            run = column;
+
+        if (run >= 0) {
+            c.foregroundColor = CharacterColor(COLOR_SPACE_256, (line + run) % 256);
+            c.rendition = (run % 3 == 0) ? RE_BOLD : DEFAULT_RENDITION;
+        }
+    }
+    return cells;
+}
+
+void fill(HistoryScroll* history, int length, int density)
+{
+    // the lines repeat, only the first few are created
+    QVector<QVector<Character> > lines;
+    for (int i = 0; i < 26; i++)
+        lines << createLine(i, length, density);
+
+    for (int i = 0; i < LINE_COUNT; i++) {
+        const QVector<Character>& line = lines.at(i % lines.count());
+        history->addCells(line.constData(), line.count());
+        history->addLine(i % 4 == 0);
+    }
+}
+
+qint64 diskUsage(const QString& directory)
+{
+    qint64 size = 0;
+    foreach(const QFileInfo& info, QDir(directory).entryInfoList(QDir::Files))
+        size += info.size();
+    return size;
+}
+
+void removeFiles(const QString& directory)
+{
+    QDir dir(directory);
+    foreach(const QString& name, dir.entryList(QDir::Files))
+        dir.remove(name);
+}
+
+void addRows()
+{
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        for (int length = 0; length < LINE_LENGTH_COUNT; length++) {
+            for (int density = 0; density < DENSITY_COUNT; density++) {
+                const QByteArray name = QByteArray(KIND_NAMES[kind]) + ", " +
+                                        QByteArray::number(LINE_LENGTHS[length]) + " columns, " +
+                                        DENSITY_NAMES[density];
+                QTest::newRow(name.constData()) << kind << LINE_LENGTHS[length] << density;
+            }
+        }
+    }
+}
+}
+
+void HistoryBenchmark::initTestCase()
+{
+    _directory = QDir::tempPath() + "/konsole-historybenchmark-" +
+                 QString::number(QCoreApplication::applicationPid());
+    QVERIFY(QDir().mkpath(_directory));
+}
+
+void HistoryBenchmark::cleanupTestCase()
+{
+    removeFiles(_directory);
+    QDir().rmdir(_directory);
+}
+
+void HistoryBenchmark::benchmarkAddLines_data()
+{
+    QTest::addColumn<int>("kind");
+    QTest::addColumn<int>("length");
+    QTest::addColumn<int>("density");
+
+    addRows();
+}
+
+void HistoryBenchmark::benchmarkAddLines()
+{
+    QFETCH(int, kind);
+    QFETCH(int, length);
+    QFETCH(int, density);
+
+    HistoryType* type = createType(kind, _directory);
+    HistoryScroll* history = 0;
+    qint64 elapsed = 0;
+
+    QBENCHMARK {
+        delete history;
+        removeFiles(_directory);
+        history = type->scroll(0);
+
+        QElapsedTimer timer;
+        timer.start();
+        fill(history, length, density);
+        elapsed = timer.elapsed();
+    }
+
+    // the footprint of the last run, scaled to a million lines
+    const qint64 size = (kind == FileHistory) ? diskUsage(_directory) : history->memoryUsage();
+    qDebug("%s: %.0f lines/s, %.1f MB per million lines", QTest::currentDataTag(),
+           elapsed > 0 ? LINE_COUNT / (elapsed / 1000.0) : 0.0,
+           size * (1000000.0 / LINE_COUNT) / (1024 * 1024));
+
+    delete history;
+    delete type;
+    removeFiles(_directory);
+}
+
+void HistoryBenchmark::benchmarkGetCells_data()
+{
+    benchmarkAddLines_data();
+}
+
+void HistoryBenchmark::benchmarkGetCells()
+{
+    QFETCH(int, kind);
+    QFETCH(int, length);
+    QFETCH(int, density);
+
+    HistoryType* type = createType(kind, _directory);
+    HistoryScroll* history = type->scroll(0);
+    fill(history, length, density);
+
+    // the same random lines in each run
+    QVector<int> lines(READ_COUNT);
+    qsrand(1);
+    const int lineCount = history->getLines();
+    for (int i = 0; i < READ_COUNT; i++)
+        lines[i] = lineCount > 0 ? qrand() % lineCount : 0;
+
+    QVector<Character> cells(length);
+    QBENCHMARK {
+        for (int i = 0; i < READ_COUNT && lineCount > 0; i++) {
+            const int line = lines.at(i);
+            history->getCells(line, 0, history->getLineLen(line), cells.data());
+        }
+    }
+
+    delete history;
+    delete type;
+    removeFiles(_directory);
+}
+
+void HistoryBenchmark::benchmarkConversion_data()
+{
+    QTest::addColumn<int>("from");
+    QTest::addColumn<int>("to");
+
+    for (int from = FileHistory; from < KIND_COUNT; from++) {
+        for (int to = 0; to < KIND_COUNT; to++) {
+            if (from == to)
+                continue;
+            const QByteArray name = QByteArray(KIND_NAMES[from]) + " to " + KIND_NAMES[to];
+            QTest::newRow(name.constData()) << from << to;
+        }
+    }
+}
+
+void HistoryBenchmark::benchmarkConversion()
+{
+    QFETCH(int, from);
+    QFETCH(int, to);
+
+    HistoryType* fromType = createType(from, _directory);
+    HistoryType* toType = createType(to, _directory);
+
+    // filling the history is not part of the conversion, so the
+    // conversions are timed one by one instead of with QBENCHMARK
+    qint64 elapsed = 0;
+    for (int i = 0; i < CONVERSION_RUNS; i++) {
+        HistoryScroll* history = fromType->scroll(0);
+        fill(history, CONVERSION_LINE_LENGTH, WordDensity);
+
+        QElapsedTimer timer;
+        timer.start();
+        history = toType->scroll(history);
+        elapsed += timer.elapsed();
+
+        delete history;
+        removeFiles(_directory);
+    }
+
+    qDebug("%s: %.1f ms for %d lines", QTest::currentDataTag(),
+           double(elapsed) / CONVERSION_RUNS, LINE_COUNT);
+
+    delete fromType;
+    delete toType;
+}
+
+QTEST_KDEMAIN_CORE(HistoryBenchmark)
+
+#include "HistoryBenchmark.moc"
@@ -0,0 +1,54 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYBENCHMARK_H
+#define HISTORYBENCHMARK_H
+
+#include <QtCore/QObject>
+
+namespace Konsole
+{
+
+/**
+ * Measures the history implementations: how fast lines are added, how
+ * long reading the cells of random lines takes, how much memory or disk
+ * space a million lines take and how long converting a history from one
+ * type to another takes.  Each is measured for a few line lengths and
+ * for lines in which the attributes change rarely or often.
+ */
+class HistoryBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void benchmarkAddLines_data();
+    void benchmarkAddLines();
+    void benchmarkGetCells_data();
+    void benchmarkGetCells();
+    void benchmarkConversion_data();
+    void benchmarkConversion();
+
+private:
+    QString _directory;
+};
+
+}
+
+#endif // HISTORYBENCHMARK_H
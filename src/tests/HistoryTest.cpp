@@ -0,0 +1,739 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryTest.h"
+
+// Qt
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../ExtendedCharTable.h"
+#include "../History.h"
+
+using namespace Konsole;
+
+// returns the character which line 'line' of the test history has in
+// column 'column'
+static Character testCharacter(int line, int column)
+{
+    Character c('a' + (line + column) % 26);
+    if (column >= 40) {
+        c.foregroundColor = CharacterColor(COLOR_SPACE_SYSTEM, line % 8);
+        c.rendition = RE_BOLD;
+    }
+    return c;
+}
+
+void HistoryTest::testCompressedHistory()
+{
+    CompressedHistoryType type;
+    HistoryScroll* history = type.scroll(0);
+
+    // enough lines for several compressed blocks
+    const int lineCount = 5000;
+    const int columns = 80;
+    Character line[columns];
+    for (int i = 0; i < lineCount; i++) {
+        const int length = i % columns + 1;
+        for (int column = 0; column < length; column++)
+            line[column] = testCharacter(i, column);
+        history->addCells(line, length);
+        history->addLine(i % 3 == 0);
+    }
+
+    QCOMPARE(history->getLines(), lineCount);
+
+    // read the lines back in reverse order, which moves between blocks
+    for (int i = lineCount - 1; i >= 0; i--) {
+        const int length = i % columns + 1;
+        QCOMPARE(history->getLineLen(i), length);
+        QCOMPARE(history->isWrappedLine(i), i % 3 == 0);
+
+        history->getCells(i, 0, length, line);
+        for (int column = 0; column < length; column++)
+            QVERIFY(line[column] == testCharacter(i, column));
+    }
+
+    // part of a line, starting in its second format
+    history->getCells(79, 50, 10, line);
+    for (int column = 0; column < 10; column++)
+        QVERIFY(line[column] == testCharacter(79, column + 50));
+
+    delete history;
+}
+
+void HistoryTest::testCompressedHistoryMaxLines()
+{
+    const int maxLineCount = 1000;
+    CompressedHistoryType type(maxLineCount);
+    HistoryScroll* history = type.scroll(0);
+    QCOMPARE(history->getType().maximumLineCount(), maxLineCount);
+
+    // enough lines for the oldest blocks to be discarded
+    const int lineCount = 5000;
+    const int columns = 80;
+    Character line[columns];
+    for (int i = 0; i < lineCount; i++) {
+        for (int column = 0; column < columns; column++)
+            line[column] = testCharacter(i, column);
+        history->addCells(line, columns);
+        history->addLine(false);
+    }
+    QCOMPARE(history->getLines(), maxLineCount);
+
+    for (int i = 0; i < maxLineCount; i += 7) {
+        history->getCells(i, 0, columns, line);
+        for (int column = 0; column < columns; column++)
+            QVERIFY(line[column] == testCharacter(lineCount - maxLineCount + i, column));
+    }
+
+    delete history;
+}
+
+// a character which compresses badly, for filling compressed histories
+static Character noiseCharacter(int line, int column)
+{
+    quint32 value = line * 80 + column;
+    value ^= value >> 13;
+    value *= 0x5bd1e995;
+    value ^= value >> 15;
+    return Character(0x4e00 + value % 20000);
+}
+
+void HistoryTest::testCompressedHistoryFileCompaction()
+{
+    const int maxLineCount = 1000;
+    HistoryScroll* history = CompressedHistoryType(maxLineCount).scroll(0);
+
+    // far more lines than are kept, whose blocks would take tens of
+    // megabytes in the file if their space was never given back
+    const int lineCount = 200000;
+    const int columns = 80;
+    Character line[columns];
+    for (int i = 0; i < lineCount; i++) {
+        for (int column = 0; column < columns; column++)
+            line[column] = noiseCharacter(i, column);
+        history->addCells(line, columns);
+        history->addLine(false);
+    }
+    QCOMPARE(history->getLines(), maxLineCount);
+    QVERIFY(history->fileSize() < 10 * 1024 * 1024);
+
+    for (int i = 0; i < maxLineCount; i++) {
+        history->getCells(i, 0, columns, line);
+        for (int column = 0; column < columns; column++)
+            QVERIFY(line[column] == noiseCharacter(lineCount - maxLineCount + i, column));
+    }
+
+    delete history;
+}
+
+void HistoryTest::testCompactHistory()
+{
+    const int maxLineCount = 100;
+    CompactHistoryType type(maxLineCount);
+    HistoryScroll* history = type.scroll(0);
+
+    // keep adding lines long after the history is full, the oldest lines
+    // make room for the new ones
+    const int lineCount = 5000;
+    const int columns = 80;
+    Character line[columns];
+    for (int i = 0; i < lineCount; i++) {
+        const int length = i % columns + 1;
+        for (int column = 0; column < length; column++)
+            line[column] = testCharacter(i, column);
+        history->addCells(line, length);
+        history->addLine(i % 3 == 0);
+    }
+
+    const int lines = history->getLines();
+    QVERIFY(lines >= maxLineCount);
+
+    for (int i = 0; i < lines; i++) {
+        const int lineNumber = lineCount - lines + i;
+        const int length = lineNumber % columns + 1;
+        QCOMPARE(history->getLineLen(i), length);
+        QCOMPARE(history->isWrappedLine(i), lineNumber % 3 == 0);
+
+        history->getCells(i, 0, length, line);
+        for (int column = 0; column < length; column++)
+            QVERIFY(line[column] == testCharacter(lineNumber, column));
+    }
+
+    delete history;
+}
+
+void HistoryTest::testCompactHistoryCompaction()
+{
+    CompactHistoryType type(10);
+    HistoryScroll* history = type.scroll(0);
+
+    // a burst of long lines grows the history
+    const int longLength = 2000;
+    QVector<Character> longLine(longLength, testCharacter(0, 0));
+    for (int i = 0; i < 20; i++) {
+        history->addCellsVector(longLine);
+        history->addLine(false);
+    }
+    const qint64 usageAfterBurst = history->memoryUsage();
+
+    // which is given back once it only holds short lines
+    Character shortLine = testCharacter(1, 0);
+    for (int i = 0; i < 20; i++) {
+        history->addCells(&shortLine, 1);
+        history->addLine(false);
+    }
+    history->compact();
+    QVERIFY(history->memoryUsage() < usageAfterBurst);
+
+    for (int i = 0; i < history->getLines(); i++) {
+        QCOMPARE(history->getLineLen(i), 1);
+        Character c;
+        history->getCells(i, 0, 1, &c);
+        QVERIFY(c == shortLine);
+    }
+
+    delete history;
+}
+
+void HistoryTest::testSharedHistory()
+{
+    const int poolLines = HistoryLinePool::instance.lineCount();
+
+    SharedHistoryType type(10);
+    HistoryScroll* first = type.scroll(0);
+    HistoryScroll* second = type.scroll(0);
+
+    // both histories receive the same output
+    const int columns = 20;
+    Character line[columns];
+    for (int i = 0; i < 5; i++) {
+        for (int column = 0; column < columns; column++)
+            line[column] = testCharacter(i, column);
+        first->addCells(line, columns);
+        first->addLine(false);
+        second->addCells(line, columns);
+        second->addLine(i % 2 == 0);
+    }
+    QCOMPARE(HistoryLinePool::instance.lineCount(), poolLines + 5);
+
+    // lines which only differ in whether their characters are real are
+    // not shared
+    line[0].isRealCharacter = !line[0].isRealCharacter;
+    second->addCells(line, columns);
+    second->addLine(false);
+    QCOMPARE(HistoryLinePool::instance.lineCount(), poolLines + 6);
+
+    Character cells[columns];
+    second->getCells(5, 0, columns, cells);
+    QCOMPARE(cells[0].isRealCharacter, line[0].isRealCharacter);
+
+    for (int i = 0; i < 5; i++) {
+        QCOMPARE(second->isWrappedLine(i), i % 2 == 0);
+        second->getCells(i, 0, columns, cells);
+        for (int column = 0; column < columns; column++)
+            QVERIFY(cells[column] == testCharacter(i, column));
+    }
+
+    delete first;
+    QCOMPARE(HistoryLinePool::instance.lineCount(), poolLines + 6);
+    delete second;
+    QCOMPARE(HistoryLinePool::instance.lineCount(), poolLines);
+}
+
+void HistoryTest::testReadLines_data()
+{
+    QTest::addColumn<QString>("type");
+
+    QTest::newRow("file") << "file";
+    QTest::newRow("compact") << "compact";
+}
+
+void HistoryTest::testReadLines()
+{
+    QFETCH(QString, type);
+
+    HistoryScroll* history;
+    if (type == "file")
+        history = HistoryTypeFile().scroll(0);
+    else
+        history = CompactHistoryType(1000).scroll(0);
+
+    const int columns = 80;
+    Character line[columns];
+    for (int i = 0; i < 200; i++) {
+        const int length = (i * 7) % columns;
+        for (int column = 0; column < length; column++)
+            line[column] = testCharacter(i, column);
+        history->addCells(line, length);
+        history->addLine(i % 5 == 0);
+    }
+
+    HistoryLines lines;
+    history->readLines(50, 100, lines);
+    QVERIFY(!lines.contains(49));
+    QVERIFY(lines.contains(50));
+    QVERIFY(lines.contains(149));
+    QVERIFY(!lines.contains(150));
+
+    for (int i = 50; i < 150; i++) {
+        const int length = (i * 7) % columns;
+        QCOMPARE(lines.lineLength(i), length);
+        QCOMPARE(lines.isWrapped(i), i % 5 == 0);
+        for (int column = 0; column < length; column++)
+            QVERIFY(lines.cells(i)[column] == testCharacter(i, column));
+    }
+
+    delete history;
+}
+
+void HistoryTest::testPersistentHistory()
+{
+    const QString fileName = QDir::tempPath() + "/konsole-historytest-" +
+                             QString::number(QCoreApplication::applicationPid());
+
+    const int columns = 10;
+    Character line[columns];
+    HistoryScroll* history = HistoryTypeFile(fileName).scroll(0);
+    for (int i = 0; i < 30; i++) {
+        for (int column = 0; column < columns; column++)
+            line[column] = testCharacter(i, column);
+        history->addCells(line, columns);
+        history->addLine(i % 2 == 0);
+    }
+    delete history;
+
+    // an index entry whose cells were never written, as if Konsole had
+    // crashed while adding a line
+    QFile index(fileName + ".lengths");
+    QVERIFY(index.open(QIODevice::Append));
+    const quint32 length = 1000;
+    index.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    index.close();
+    QFile flags(fileName + ".flags");
+    QVERIFY(flags.open(QIODevice::Append));
+    flags.write("\0", 1);
+    flags.close();
+
+    // the lines are back once the history is created again
+    history = HistoryTypeFile(fileName).scroll(0);
+    QCOMPARE(history->getLines(), 30);
+    for (int i = 0; i < 30; i++) {
+        QCOMPARE(history->getLineLen(i), columns);
+        QCOMPARE(history->isWrappedLine(i), i % 2 == 0);
+        history->getCells(i, 0, columns, line);
+        for (int column = 0; column < columns; column++)
+            QVERIFY(line[column] == testCharacter(i, column));
+    }
+
+    // and new lines are added after them
+    history->addCells(line, columns);
+    history->addLine(false);
+    QCOMPARE(history->getLines(), 31);
+    delete history;
+
+    HistoryScrollFile::removeFiles(fileName);
+    QVERIFY(!QFile::exists(fileName + ".lengths"));
+    QVERIFY(!QFile::exists(fileName + ".cells"));
+    QVERIFY(!QFile::exists(fileName + ".flags"));
+}
+
+void HistoryTest::testPersistentHistoryFormat()
+{
+    const QString fileName = QDir::tempPath() + "/konsole-historytest-format-" +
+                             QString::number(QCoreApplication::applicationPid());
+
+    Character line[10];
+    for (int column = 0; column < 10; column++)
+        line[column] = testCharacter(0, column);
+
+    HistoryScroll* history = HistoryTypeFile(fileName).scroll(0);
+    history->addCells(line, 10);
+    history->addLine(false);
+    delete history;
+
+    // the history is only accessible to the user
+    const QFile::Permissions others = QFile::ReadGroup | QFile::WriteGroup |
+                                      QFile::ReadOther | QFile::WriteOther;
+    QCOMPARE(QFile(fileName + ".cells").permissions() & others, QFile::Permissions(0));
+    QCOMPARE(QFile(fileName + ".format").permissions() & others, QFile::Permissions(0));
+
+    history = HistoryTypeFile(fileName).scroll(0);
+    QCOMPARE(history->getLines(), 1);
+    delete history;
+
+    // files in another format are started over
+    QFile format(fileName + ".format");
+    QVERIFY(format.open(QIODevice::ReadWrite));
+    format.write("KONSHIST\x7f", 9);
+    format.close();
+
+    history = HistoryTypeFile(fileName).scroll(0);
+    QCOMPARE(history->getLines(), 0);
+    delete history;
+
+    // as are files without a format
+    history = HistoryTypeFile(fileName).scroll(0);
+    history->addCells(line, 10);
+    history->addLine(false);
+    delete history;
+    QVERIFY(QFile::remove(fileName + ".format"));
+
+    history = HistoryTypeFile(fileName).scroll(0);
+    QCOMPARE(history->getLines(), 0);
+    delete history;
+
+    HistoryScrollFile::removeFiles(fileName);
+    QVERIFY(!QFile::exists(fileName + ".format"));
+}
+
+void HistoryTest::testPersistentHistoryColors()
+{
+    const QString fileName = QDir::tempPath() + "/konsole-historytest-colors-" +
+                             QString::number(QCoreApplication::applicationPid());
+
+    // colors which are at other positions of the table of this process
+    // than in the files of the history
+    for (int i = 0; i < 5; i++)
+        CharacterColor(COLOR_SPACE_RGB, 0x010203 * i);
+
+    Character line[2];
+    line[0].foregroundColor = CharacterColor(COLOR_SPACE_RGB, 0x123456);
+    line[1].backgroundColor = CharacterColor(COLOR_SPACE_RGB, 0xfedcba);
+    line[1].foregroundColor = CharacterColor(COLOR_SPACE_RGB, 0x123456);
+
+    HistoryScroll* history = HistoryTypeFile(fileName).scroll(0);
+    history->addCells(line, 2);
+    history->addLine(false);
+    delete history;
+
+    // the files hold the RGB values of the colors, in the order in which
+    // they were first used
+    QFile colors(fileName + ".colors");
+    QVERIFY(colors.open(QIODevice::ReadOnly));
+    QCOMPARE(colors.size(), qint64(2 * sizeof(QRgb)));
+    QRgb values[2];
+    colors.read(reinterpret_cast<char*>(values), sizeof(values));
+    colors.close();
+    QCOMPARE(values[0], qRgb(0x12, 0x34, 0x56));
+    QCOMPARE(values[1], qRgb(0xfe, 0xdc, 0xba));
+
+    history = HistoryTypeFile(fileName).scroll(0);
+    Character cells[2];
+    history->getCells(0, 0, 2, cells);
+    QVERIFY(cells[0] == line[0]);
+    QVERIFY(cells[1] == line[1]);
+    QCOMPARE(cells[1].backgroundColor.rgb(0), qRgb(0xfe, 0xdc, 0xba));
+
+    HistoryLines lines;
+    history->readLines(0, 1, lines);
+    QVERIFY(lines.cells(0)[1] == line[1]);
+    delete history;
+
+    HistoryScrollFile::removeFiles(fileName);
+}
+
+void HistoryTest::testPersistentHistoryExtendedChars()
+{
+    const QString fileName = QDir::tempPath() + "/konsole-historytest-chars-" +
+                             QString::number(QCoreApplication::applicationPid());
+
+    ExtendedCharTable& table = ExtendedCharTable::instance;
+    const ushort sequence[] = { 'e', 0x0301 };
+    Character line[2];
+    line[0] = Character('a');
+    line[1].character = table.createExtendedChar(sequence, 2);
+    line[1].rendition = RE_EXTENDED_CHAR;
+
+    HistoryScroll* history = HistoryTypeFile(fileName).scroll(0);
+    history->addCells(line, 2);
+    history->addLine(false);
+    delete history;
+
+    // like a new process, the table no longer knows the sequence.  Without
+    // any screens, all of the sequences are removed once it is swept
+    const quint64 generation = table.generation();
+    for (ushort i = 0; table.generation() == generation && i < 0xffff; i++) {
+        const ushort other[] = { 'x', i };
+        table.createExtendedChar(other, 2);
+    }
+    QVERIFY(table.generation() != generation);
+
+    history = HistoryTypeFile(fileName).scroll(0);
+    Character cells[2];
+    history->getCells(0, 0, 2, cells);
+    QVERIFY(cells[0] == line[0]);
+    QVERIFY(cells[1].rendition & RE_EXTENDED_CHAR);
+    ushort length = 0;
+    const ushort* chars = table.lookupExtendedChar(cells[1].character, length);
+    QCOMPARE(length, ushort(2));
+    QCOMPARE(chars[0], sequence[0]);
+    QCOMPARE(chars[1], sequence[1]);
+
+    HistoryLines lines;
+    history->readLines(0, 1, lines);
+    QCOMPARE(lines.cells(0)[1].character, cells[1].character);
+    delete history;
+
+    HistoryScrollFile::removeFiles(fileName);
+}
+
+void HistoryTest::testFileReadAhead()
+{
+    HistoryScroll* history = HistoryTypeFile().scroll(0);
+
+    // more cells than are read ahead at a time
+    const int columns = 60;
+    Character line[columns];
+    for (int i = 0; i < 3000; i++) {
+        for (int column = 0; column < columns; column++)
+            line[column] = testCharacter(i, column);
+        history->addCells(line, columns);
+        history->addLine(i % 3 == 0);
+    }
+
+    // forwards, as when saving or searching
+    for (int i = 0; i < 1000; i++) {
+        QCOMPARE(history->isWrappedLine(i), i % 3 == 0);
+        history->getCells(i, 0, columns, line);
+        for (int column = 0; column < columns; column++)
+            QVERIFY(line[column] == testCharacter(i, column));
+    }
+
+    // backwards, as when scrolling up, and parts of lines
+    for (int i = 2999; i >= 2000; i--) {
+        QCOMPARE(history->isWrappedLine(i), i % 3 == 0);
+        history->getCells(i, 10, 20, line);
+        for (int column = 0; column < 20; column++)
+            QVERIFY(line[column] == testCharacter(i, column + 10));
+    }
+
+    // lines added after the reads
+    for (int column = 0; column < columns; column++)
+        line[column] = testCharacter(3000, column);
+    history->addCells(line, columns);
+    history->addLine(true);
+    QCOMPARE(history->isWrappedLine(3000), true);
+    history->getCells(3000, 0, columns, line);
+    QVERIFY(line[columns - 1] == testCharacter(3000, columns - 1));
+
+    // the lines kept in memory are dropped along with the history
+    history->clear();
+    for (int column = 0; column < columns; column++)
+        line[column] = testCharacter(7, column);
+    history->addCells(line, columns);
+    history->addLine(false);
+    history->getCells(0, 0, columns, line);
+    for (int column = 0; column < columns; column++)
+        QVERIFY(line[column] == testCharacter(7, column));
+
+    delete history;
+}
+
+void HistoryTest::testClear_data()
+{
+    QTest::addColumn<QString>("type");
+
+    QTest::newRow("file") << "file";
+    QTest::newRow("compact") << "compact";
+    QTest::newRow("compressed") << "compressed";
+    QTest::newRow("shared") << "shared";
+}
+
+void HistoryTest::testClear()
+{
+    QFETCH(QString, type);
+
+    HistoryScroll* history;
+    if (type == "file")
+        history = HistoryTypeFile().scroll(0);
+    else if (type == "compact")
+        history = CompactHistoryType(1000).scroll(0);
+    else if (type == "compressed")
+        history = CompressedHistoryType().scroll(0);
+    else
+        history = SharedHistoryType(1000).scroll(0);
+
+    const int columns = 40;
+    Character line[columns];
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 500; i++) {
+            for (int column = 0; column < columns; column++)
+                line[column] = testCharacter(i + round, column);
+            history->addCells(line, columns);
+            history->addLine(false);
+        }
+        QCOMPARE(history->getLines(), 500);
+
+        // the lines added after clearing the history replace the old ones
+        for (int i = 0; i < 500; i += 11) {
+            history->getCells(i, 0, columns, line);
+            for (int column = 0; column < columns; column++)
+                QVERIFY(line[column] == testCharacter(i + round, column));
+        }
+
+        history->clear();
+        QCOMPARE(history->getLines(), 0);
+    }
+
+    delete history;
+}
+
+void HistoryTest::testTakeCells_data()
+{
+    testClear_data();
+}
+
+void HistoryTest::testTakeCells()
+{
+    QFETCH(QString, type);
+
+    HistoryScroll* history;
+    if (type == "file")
+        history = HistoryTypeFile().scroll(0);
+    else if (type == "compact")
+        history = CompactHistoryType(1000).scroll(0);
+    else if (type == "compressed")
+        history = CompressedHistoryType().scroll(0);
+    else
+        history = SharedHistoryType(1000).scroll(0);
+
+    // the same vector is reused for every line, like a line of the screen
+    const int columns = 40;
+    QVector<Character> cells;
+    for (int i = 0; i < 100; i++) {
+        const int length = i % columns + 1;
+        cells.resize(length);
+        for (int column = 0; column < length; column++)
+            cells[column] = testCharacter(i, column);
+        history->takeCellsVector(cells);
+        history->addLine(i % 2 == 0);
+    }
+    QCOMPARE(history->getLines(), 100);
+
+    Character line[columns];
+    for (int i = 0; i < 100; i++) {
+        const int length = i % columns + 1;
+        QCOMPARE(history->getLineLen(i), length);
+        QCOMPARE(history->isWrappedLine(i), i % 2 == 0);
+        history->getCells(i, 0, length, line);
+        for (int column = 0; column < length; column++)
+            QVERIFY(line[column] == testCharacter(i, column));
+    }
+
+    delete history;
+}
+
+void HistoryTest::testSearchIndex()
+{
+    HistorySearchIndex index;
+    index.addLine("first line", false);
+    index.addLine("Second Line", false);
+    index.addLine("third line wraps here a", true);
+    index.addLine("nd continues", false);
+    index.addLine("last line", false);
+    QCOMPARE(index.lineCount(), 5);
+
+    // the lines are narrowed down to those which may contain the text,
+    // regardless of case
+    int startLine = 0;
+    int endLine = 4;
+    QVERIFY(index.findCandidateLines("SECOND", 5, startLine, endLine));
+    QCOMPARE(startLine, 1);
+    QCOMPARE(endLine, 1);
+
+    // text across a wrap is found in the line where it ends, and the search
+    // starts at the line where it begins
+    startLine = 0;
+    endLine = 4;
+    QVERIFY(index.findCandidateLines("and cont", 5, startLine, endLine));
+    QCOMPARE(startLine, 2);
+    QCOMPARE(endLine, 3);
+
+    startLine = 0;
+    endLine = 4;
+    QVERIFY(!index.findCandidateLines("missing", 5, startLine, endLine));
+
+    // short text and the lines after the history may always match
+    startLine = 0;
+    endLine = 4;
+    QVERIFY(index.findCandidateLines("xy", 5, startLine, endLine));
+    QCOMPARE(startLine, 0);
+    QCOMPARE(endLine, 4);
+
+    startLine = 0;
+    endLine = 6;
+    QVERIFY(index.findCandidateLines("missing", 5, startLine, endLine));
+    QCOMPARE(startLine, 5);
+    QCOMPARE(endLine, 6);
+
+    // once lines are removed, the latest lines are still those of the index
+    index.keepLines(2);
+    QCOMPARE(index.lineCount(), 2);
+    startLine = 0;
+    endLine = 9;
+    QVERIFY(index.findCandidateLines("last", 10, startLine, endLine));
+    QCOMPARE(startLine, 0);
+    QCOMPARE(endLine, 9);
+    startLine = 8;
+    endLine = 9;
+    QVERIFY(index.findCandidateLines("last", 10, startLine, endLine));
+    QCOMPARE(startLine, 9);
+    QCOMPARE(endLine, 9);
+
+    index.clear();
+    QCOMPARE(index.lineCount(), 0);
+}
+
+void HistoryTest::testFileHistoryUsage()
+{
+    HistoryScroll* history = HistoryTypeFile().scroll(0);
+    QCOMPARE(history->fileSize(), qint64(0));
+
+    const int lineCount = 100;
+    const int columns = 80;
+    Character line[columns];
+    for (int i = 0; i < lineCount; i++) {
+        for (int column = 0; column < columns; column++)
+            line[column] = testCharacter(i, column);
+        history->addCells(line, columns);
+        history->addLine(false);
+    }
+
+    // the cells, the index and the flags of each line
+    QVERIFY(history->fileSize() >= qint64(lineCount) * columns * sizeof(Character));
+
+    // reading lines caches them, compacting the history drops the cache
+    history->getCells(0, 0, columns, line);
+    QVERIFY(history->memoryUsage() > 0);
+    history->compact();
+    QCOMPARE(history->memoryUsage(), qint64(0));
+    QVERIFY(line[0] == testCharacter(0, 0));
+
+    delete history;
+}
+
+QTEST_KDEMAIN_CORE(HistoryTest)
+
+#include "HistoryTest.moc"
+
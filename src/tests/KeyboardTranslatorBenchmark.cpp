@@ -0,0 +1,95 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "KeyboardTranslatorBenchmark.h"
+
+// Qt
+#include <QtCore/QFile>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../KeyboardTranslator.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int LOOKUP_COUNT = 4096;
+
+// the states which are looked up in turn, as a terminal running a shell,
+// an editor and a pager changes between them
+const KeyboardTranslator::State states[] = {
+    KeyboardTranslator::AnsiState,
+    KeyboardTranslator::State(KeyboardTranslator::AnsiState | KeyboardTranslator::CursorKeysState),
+    KeyboardTranslator::State(KeyboardTranslator::AnsiState | KeyboardTranslator::AlternateScreenState)
+};
+const int stateCount = 3;
+}
+
+void KeyboardTranslatorBenchmark::benchmarkFindEntry_data()
+{
+    QTest::addColumn<int>("keyCode");
+    QTest::addColumn<int>("modifiers");
+    QTest::addColumn<bool>("bound");
+
+    // letters have no entries, their text is sent as it is
+    QTest::newRow("letter") << int(Qt::Key_A) << int(Qt::NoModifier) << false;
+    QTest::newRow("return") << int(Qt::Key_Return) << int(Qt::NoModifier) << true;
+    QTest::newRow("up") << int(Qt::Key_Up) << int(Qt::NoModifier) << true;
+    QTest::newRow("control up") << int(Qt::Key_Up) << int(Qt::ControlModifier) << true;
+    QTest::newRow("keypad home") << int(Qt::Key_Home) << int(Qt::KeypadModifier) << true;
+    QTest::newRow("shift f5") << int(Qt::Key_F5) << int(Qt::ShiftModifier) << true;
+}
+
+void KeyboardTranslatorBenchmark::benchmarkFindEntry()
+{
+    QFETCH(int, keyCode);
+    QFETCH(int, modifiers);
+    QFETCH(bool, bound);
+
+    QFile source(QLatin1String(KONSOLE_KEYBOARD_LAYOUTS_DIR "default.keytab"));
+    QVERIFY(source.open(QIODevice::ReadOnly));
+
+    KeyboardTranslator translator("default");
+    KeyboardTranslatorReader reader(&source);
+    while (reader.hasNextEntry())
+        translator.addEntry(reader.nextEntry());
+    QVERIFY(!reader.parseError());
+
+    const Qt::KeyboardModifiers keyModifiers(modifiers);
+    int found = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < LOOKUP_COUNT; i++) {
+            const KeyboardTranslator::Entry entry =
+                translator.findEntry(keyCode, keyModifiers, states[i % stateCount]);
+            if (!entry.isNull())
+                found++;
+        }
+    }
+
+    QCOMPARE(found != 0, bound);
+}
+
+QTEST_KDEMAIN_CORE(KeyboardTranslatorBenchmark)
+
+#include "KeyboardTranslatorBenchmark.moc"
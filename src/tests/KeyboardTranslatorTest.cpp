@@ -0,0 +1,129 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "KeyboardTranslatorTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../KeyboardTranslator.h"
+
+using namespace Konsole;
+
+// entries from default.keytab, which test the modifiers and states in
+// various ways
+static const char* const entries[][2] = {
+    { "Up -Shift-Ansi", "\\EA" },
+    { "Up -Shift-AnyMod+Ansi+AppCuKeys", "\\EOA" },
+    { "Up -Shift-AnyMod+Ansi-AppCuKeys", "\\E[A" },
+    { "Up -Shift+AnyMod+Ansi", "\\E[1;*A" },
+    { "Up +Shift+AppScreen", "\\E[1;*A" },
+    { "Up -Shift+Ansi+AppCuKeys+KeyPad", "\\EOA" },
+    { "Up +Shift-AppScreen", "scrollLineUp" },
+    { "Home +AppCuKeys+KeyPad", "\\EOH" },
+    { "Home -AnyMod-AppCuKeys", "\\E[H" },
+    { "Home +AnyMod", "\\E[1;*H" },
+    { "Return-Shift-NewLine", "\\r" },
+    { "Return-Shift+NewLine", "\\r\\n" },
+    { "Return+Shift", "\\EOM" },
+    { 0, 0 }
+};
+
+static const Qt::KeyboardModifier modifiers[] = {
+    Qt::ShiftModifier, Qt::ControlModifier, Qt::AltModifier, Qt::MetaModifier,
+    Qt::KeypadModifier
+};
+static const int modifierCount = 5;
+static const int stateCount = 64;
+
+// compares findEntry() with testing each of the entries
+static void verifyKey(const KeyboardTranslator& translator, int keyCode)
+{
+    const QList<KeyboardTranslator::Entry> entryList = translator.entries();
+
+    for (int modifierBits = 0; modifierBits < (1 << modifierCount); modifierBits++) {
+        Qt::KeyboardModifiers testModifiers = Qt::NoModifier;
+        for (int i = 0; i < modifierCount; i++) {
+            if (modifierBits & (1 << i))
+                testModifiers |= modifiers[i];
+        }
+
+        for (int stateBits = 0; stateBits < stateCount; stateBits++) {
+            const KeyboardTranslator::States testState(static_cast<KeyboardTranslator::State>(stateBits));
+
+            QList<KeyboardTranslator::Entry> matching;
+            foreach(const KeyboardTranslator::Entry& entry, entryList) {
+                if (entry.matches(keyCode, testModifiers, testState))
+                    matching << entry;
+            }
+
+            const KeyboardTranslator::Entry found =
+                translator.findEntry(keyCode, testModifiers, testState);
+
+            if (matching.isEmpty())
+                QVERIFY(found.isNull());
+            else
+                QVERIFY(matching.contains(found));
+        }
+    }
+}
+
+void KeyboardTranslatorTest::testFindEntry()
+{
+    KeyboardTranslator translator("test");
+    for (int i = 0; entries[i][0] != 0; i++)
+        translator.addEntry(KeyboardTranslatorReader::createEntry(entries[i][0], entries[i][1]));
+
+    verifyKey(translator, Qt::Key_Up);
+    verifyKey(translator, Qt::Key_Home);
+    verifyKey(translator, Qt::Key_Return);
+
+    QCOMPARE(translator.findEntry(Qt::Key_Up, Qt::NoModifier,
+                                  KeyboardTranslator::AnsiState).text(),
+             QByteArray("\033[A"));
+    QCOMPARE(translator.findEntry(Qt::Key_Up, Qt::ControlModifier,
+                                  KeyboardTranslator::AnsiState).text(true, Qt::ControlModifier),
+             QByteArray("\033[1;5A"));
+    QCOMPARE(translator.findEntry(Qt::Key_Home, Qt::KeypadModifier,
+                                  KeyboardTranslator::CursorKeysState).text(),
+             QByteArray("\033OH"));
+    QVERIFY(translator.findEntry(Qt::Key_Down, Qt::NoModifier).isNull());
+}
+
+void KeyboardTranslatorTest::testRemoveEntry()
+{
+    KeyboardTranslator translator("test");
+    const KeyboardTranslator::Entry entry =
+        KeyboardTranslatorReader::createEntry("Return-Shift", "\\r");
+    translator.addEntry(entry);
+    QCOMPARE(translator.findEntry(Qt::Key_Return, Qt::NoModifier), entry);
+
+    const KeyboardTranslator::Entry replacement =
+        KeyboardTranslatorReader::createEntry("Return-Shift", "\\r\\n");
+    translator.replaceEntry(entry, replacement);
+    QCOMPARE(translator.findEntry(Qt::Key_Return, Qt::NoModifier), replacement);
+
+    translator.removeEntry(replacement);
+    QVERIFY(translator.findEntry(Qt::Key_Return, Qt::NoModifier).isNull());
+}
+
+QTEST_KDEMAIN_CORE(KeyboardTranslatorTest)
+
+#include "KeyboardTranslatorTest.moc"
+
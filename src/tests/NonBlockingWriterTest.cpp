@@ -0,0 +1,114 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "NonBlockingWriterTest.h"
+
+// Unix
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Qt
+#include <QtCore/QFile>
+#include <QtCore/QPointer>
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <KTempDir>
+#include <qtest_kde.h>
+
+// Konsole
+#include "../NonBlockingWriter.h"
+
+using namespace Konsole;
+
+// data which takes several writes and more than fits into a pipe
+static QByteArray testData()
+{
+    QByteArray data;
+    for (int i = 0; i < 20000; i++)
+        data += "line " + QByteArray::number(i) + '\n';
+    return data;
+}
+
+void NonBlockingWriterTest::testRegularFile()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "lines";
+    const QByteArray data = testData();
+
+    QPointer<NonBlockingWriter> writer = new NonBlockingWriter(fileName, data);
+    QSignalSpy spy(writer, SIGNAL(finished(bool)));
+    QVERIFY(writer->start());
+
+    for (int i = 0; i < 100 && writer; i++)
+        QTest::qWait(10);
+    QVERIFY(!writer);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().first().toBool(), true);
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), data);
+}
+
+void NonBlockingWriterTest::testNamedPipe()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "pipe";
+    const QByteArray encodedName = QFile::encodeName(fileName);
+    QCOMPARE(mkfifo(encodedName.constData(), 0600), 0);
+
+    const QByteArray data = testData();
+
+    // the pipe is not written to until somebody reads from it
+    NonBlockingWriter* unread = new NonBlockingWriter(fileName, data);
+    QVERIFY(!unread->start());
+    QVERIFY(!unread->errorString().isEmpty());
+    delete unread;
+
+    const int fd = open(encodedName.constData(), O_RDONLY | O_NONBLOCK);
+    QVERIFY(fd >= 0);
+
+    QPointer<NonBlockingWriter> writer = new NonBlockingWriter(fileName, data);
+    QVERIFY(writer->start());
+
+    // the data is written as it is read, until the end of the file
+    QByteArray received;
+    for (int i = 0; i < 1000; i++) {
+        char buffer[4096];
+        const ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length == 0)
+            break;
+        if (length > 0)
+            received.append(buffer, length);
+        else
+            QTest::qWait(1);
+    }
+    close(fd);
+
+    QCOMPARE(received, data);
+    QTest::qWait(10);
+    QVERIFY(!writer);
+}
+
+QTEST_KDEMAIN_CORE(NonBlockingWriterTest)
+
+#include "NonBlockingWriterTest.moc"
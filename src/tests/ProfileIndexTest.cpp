@@ -0,0 +1,108 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ProfileIndexTest.h"
+
+// System
+#include <utime.h>
+
+// Qt
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+// KDE
+#include <KTempDir>
+#include <qtest_kde.h>
+
+// Konsole
+#include "../ProfileIndex.h"
+
+using namespace Konsole;
+
+static void writeProfile(const QString& path, const QByteArray& general)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("[General]\n" + general);
+}
+
+void ProfileIndexTest::testEntries()
+{
+    KTempDir dir;
+    const QString first = dir.name() + "First.profile";
+    const QString second = dir.name() + "Second.profile";
+    writeProfile(first, "Name=First Profile\nIcon=konsole\n");
+    writeProfile(second, "Parent=First.profile\n");
+
+    ProfileIndex index(dir.name() + "profiles.index");
+    index.update(QStringList() << first << second);
+
+    QCOMPARE(index.paths(), QStringList() << first << second);
+    QCOMPARE(index.entry(first).name, QString("First Profile"));
+    QCOMPARE(index.entry(first).icon, QString("konsole"));
+    // without a name, the file name is used
+    QCOMPARE(index.entry(second).name, QString("Second"));
+    QCOMPARE(index.entry(second).parent, QString("First.profile"));
+    QVERIFY(index.entry(dir.name() + "Missing.profile").path.isEmpty());
+
+    index.update(QStringList() << second);
+    QCOMPARE(index.paths(), QStringList() << second);
+    QVERIFY(index.entry(first).path.isEmpty());
+}
+
+void ProfileIndexTest::testCache()
+{
+    KTempDir dir;
+    const QString path = dir.name() + "Cached.profile";
+    const QString cacheFileName = dir.name() + "profiles.index";
+    writeProfile(path, "Name=Before\n");
+
+    {
+        ProfileIndex index(cacheFileName);
+        index.update(QStringList() << path);
+    }
+    QVERIFY(QFile::exists(cacheFileName));
+
+    // a profile which has not changed in size and modification time is
+    // taken from the cache rather than being read again
+    const QDateTime modified = QFileInfo(path).lastModified();
+    writeProfile(path, "Name=Behind\n");
+    struct utimbuf times;
+    times.actime = modified.toTime_t();
+    times.modtime = modified.toTime_t();
+    QCOMPARE(utime(QFile::encodeName(path).constData(), &times), 0);
+    {
+        ProfileIndex index(cacheFileName);
+        index.update(QStringList() << path);
+        QCOMPARE(index.entry(path).name, QString("Before"));
+    }
+
+    // a profile which changes on disk is read again
+    writeProfile(path, "Name=Changed Name\n");
+    {
+        ProfileIndex index(cacheFileName);
+        index.update(QStringList() << path);
+        QCOMPARE(index.entry(path).name, QString("Changed Name"));
+    }
+}
+
+QTEST_KDEMAIN_CORE(ProfileIndexTest)
+
+#include "ProfileIndexTest.moc"
+
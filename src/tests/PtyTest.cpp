@@ -20,12 +20,17 @@
 // Own
 #include "PtyTest.h"
 
+// System
+#include <termios.h>
+
 // Qt
 #include <QtCore/QSize>
 #include <QtCore/QStringList>
+#include <QtTest/QSignalSpy>
 
 // KDE
 #include <qtest_kde.h>
+#include <KPtyDevice>
 
 using namespace Konsole;
 
@@ -46,6 +51,39 @@ void PtyTest::testFlowControl()
     QCOMPARE(output, input);
 }
 
+void PtyTest::testOutputResumeSent()
+{
+    Pty pty;
+    QCOMPARE(pty.start("sh", QStringList() << "sh", QStringList()), 0);
+
+    QSignalSpy spy(&pty, SIGNAL(outputResumeSent()));
+    pty.sendData("true\n", 5);
+    QCOMPARE(spy.count(), 0);
+
+    // an Xon or an interrupt anywhere in the data, as in a paste
+    pty.sendData("a\021b", 3);
+    QCOMPARE(spy.count(), 1);
+    pty.sendData("\003", 1);
+    QCOMPARE(spy.count(), 2);
+
+    // the characters are those of the terminal
+    struct ::termios ttmode;
+    QVERIFY(pty.pty()->tcGetAttr(&ttmode));
+    ttmode.c_cc[VSTART] = '\001';
+    ttmode.c_iflag &= ~IXANY;
+    QVERIFY(pty.pty()->tcSetAttr(&ttmode));
+    pty.sendData("\021", 1);
+    QCOMPARE(spy.count(), 2);
+    pty.sendData("\001", 1);
+    QCOMPARE(spy.count(), 3);
+
+    // with IXANY, any input resumes the output
+    ttmode.c_iflag |= IXANY;
+    QVERIFY(pty.pty()->tcSetAttr(&ttmode));
+    pty.sendData("x", 1);
+    QCOMPARE(spy.count(), 4);
+}
+
 void PtyTest::testEraseChar()
 {
     Pty pty;
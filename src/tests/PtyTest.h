@@ -34,6 +34,7 @@ private slots:
     void cleanup();
 
     void testFlowControl();
+    void testOutputResumeSent();
     void testEraseChar();
     void testUseUtmp();
     void testWindowSize();
@@ -0,0 +1,231 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "RenderingBenchmark.h"
+
+// System
+#include <time.h>
+
+// Qt
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTextCodec>
+#include <QtCore/QVector>
+#include <QtCore/QtAlgorithms>
+#include <QtGui/QImage>
+#include <QtGui/QLinearGradient>
+#include <QtGui/QPainter>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../ColorScheme.h"
+#include "../Filter.h"
+#include "../TerminalDisplay.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+Q_DECLARE_METATYPE(QVector<QByteArray>)
+
+namespace
+{
+const int LINES = 40;
+const int COLUMNS = 120;
+const int FRAME_COUNT = 200;
+
+QByteArray cursorTo(int line, int column)
+{
+    return "\033[" + QByteArray::number(line) + ';' + QByteArray::number(column) + 'H';
+}
+
+// every cell changes in every frame
+QVector<QByteArray> fullRedraw()
+{
+    QVector<QByteArray> frames;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        QByteArray frame;
+        for (int line = 1; line <= LINES; line++) {
+            frame += cursorTo(line, 1);
+            for (int column = 0; column < COLUMNS; column++)
+                frame += char('a' + (i + line + column) % 26);
+        }
+        frames << frame;
+    }
+    return frames;
+}
+
+// a new line at the bottom of the screen, eg. a log which is followed
+QVector<QByteArray> scrollByOne()
+{
+    QVector<QByteArray> frames;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        QByteArray frame = (i == 0) ? cursorTo(LINES, 1) : QByteArray("\r\n");
+        frame += "Dec 24 12:00:" + QByteArray::number(i % 60) + " host output line " +
+                 QByteArray::number(i) + " with a http://www.kde.org/ link";
+        frames << frame;
+    }
+    return frames;
+}
+
+// a few cells change, eg. a clock or a progress indicator
+QVector<QByteArray> sparseUpdates()
+{
+    QVector<QByteArray> frames;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        frames << cursorTo(1, COLUMNS - 8) + QByteArray::number(100000 + i) +
+               cursorTo(LINES / 2, COLUMNS / 2) + "\033[1m" + QByteArray::number(i % 10) + "\033[m";
+    }
+    return frames;
+}
+
+// a different 256 color background in each cell
+QVector<QByteArray> manyColors()
+{
+    QVector<QByteArray> frames;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        QByteArray frame;
+        for (int line = 1; line <= LINES; line++) {
+            frame += cursorTo(line, 1);
+            for (int column = 0; column < COLUMNS; column++) {
+                frame += "\033[48;5;" + QByteArray::number((line * column + i) % 256) + "m" +
+                         char('A' + column % 26);
+            }
+            frame += "\033[m";
+        }
+        frames << frame;
+    }
+    return frames;
+}
+
+// boxes as drawn by mc or dialog, which konsole draws itself
+QVector<QByteArray> boxDrawing()
+{
+    const char* const boxCharacters[] = { "─", "│", "┌", "┐", "└", "┘", "┼", "├", "┤" };
+    const int count = sizeof(boxCharacters) / sizeof(boxCharacters[0]);
+
+    QVector<QByteArray> frames;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        QByteArray frame;
+        for (int line = 1; line <= LINES; line++) {
+            frame += cursorTo(line, 1);
+            for (int column = 0; column < COLUMNS; column++)
+                frame += boxCharacters[(i + line * column) % count];
+        }
+        frames << frame;
+    }
+    return frames;
+}
+
+qint64 nanoseconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void reportPercentiles(const char* step, QVector<qint64> times)
+{
+    qSort(times);
+    const int last = times.count() - 1;
+    qDebug("%s, %s: median %.3f ms, 90%% %.3f ms, 99%% %.3f ms, max %.3f ms",
+           QTest::currentDataTag(), step,
+           times[last / 2] / 1000000.0, times[last * 9 / 10] / 1000000.0,
+           times[last * 99 / 100] / 1000000.0, times[last] / 1000000.0);
+}
+}
+
+void RenderingBenchmark::benchmarkFrames_data()
+{
+    QTest::addColumn<QVector<QByteArray> >("frames");
+    QTest::addColumn<bool>("wallpaper");
+
+    QTest::newRow("full redraw") << fullRedraw() << false;
+    QTest::newRow("full redraw, wallpaper") << fullRedraw() << true;
+    QTest::newRow("scroll by 1") << scrollByOne() << false;
+    QTest::newRow("scroll by 1, wallpaper") << scrollByOne() << true;
+    QTest::newRow("sparse updates") << sparseUpdates() << false;
+    QTest::newRow("sparse updates, wallpaper") << sparseUpdates() << true;
+    QTest::newRow("256 colors") << manyColors() << false;
+    QTest::newRow("256 colors, wallpaper") << manyColors() << true;
+    QTest::newRow("box drawing") << boxDrawing() << false;
+    QTest::newRow("box drawing, wallpaper") << boxDrawing() << true;
+}
+
+void RenderingBenchmark::benchmarkFrames()
+{
+    QFETCH(QVector<QByteArray>, frames);
+    QFETCH(bool, wallpaper);
+
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(LINES, COLUMNS);
+
+    TerminalDisplay display;
+    display.setAttribute(Qt::WA_DontShowOnScreen);
+    display.setScreenWindow(emulation.createWindow());
+    display.filterChain()->addFilter(new UrlFilter());
+    display.setSize(COLUMNS, LINES);
+    display.resize(display.sizeHint());
+
+    QTemporaryFile wallpaperFile("XXXXXX.png");
+    if (wallpaper) {
+        QImage image(1024, 768, QImage::Format_RGB32);
+        QPainter painter(&image);
+        QLinearGradient gradient(0, 0, image.width(), image.height());
+        gradient.setColorAt(0, Qt::darkBlue);
+        gradient.setColorAt(1, Qt::darkGreen);
+        painter.fillRect(image.rect(), gradient);
+        painter.end();
+
+        QVERIFY(wallpaperFile.open());
+        QVERIFY(image.save(&wallpaperFile, "PNG"));
+        wallpaperFile.close();
+
+        ColorSchemeWallpaper::Ptr picture(new ColorSchemeWallpaper(wallpaperFile.fileName()));
+        picture->load();
+        QVERIFY(!picture->isNull());
+        display.setWallpaper(picture);
+    }
+
+    display.show();
+    QTest::qWaitForWindowShown(&display);
+
+    QVector<qint64> updateTimes;
+    QVector<qint64> paintTimes;
+    foreach(const QByteArray& frame, frames) {
+        emulation.receiveData(frame.constData(), frame.size());
+
+        const qint64 start = nanoseconds();
+        display.updateImage();
+        const qint64 updated = nanoseconds();
+        // paints the region which updateImage() marked as changed
+        QCoreApplication::sendPostedEvents(&display, QEvent::UpdateRequest);
+        const qint64 painted = nanoseconds();
+
+        updateTimes << updated - start;
+        paintTimes << painted - updated;
+    }
+
+    reportPercentiles("updateImage()", updateTimes);
+    reportPercentiles("paint", paintTimes);
+}
+
+QTEST_KDEMAIN(RenderingBenchmark, GUI)
+
+#include "RenderingBenchmark.moc"
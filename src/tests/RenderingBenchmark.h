@@ -0,0 +1,45 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef RENDERINGBENCHMARK_H
+#define RENDERINGBENCHMARK_H
+
+#include <QtCore/QObject>
+
+namespace Konsole
+{
+
+/**
+ * Measures how long a TerminalDisplay takes to update its image from
+ * the screen and to paint the changes, for a number of scripted frames.
+ *
+ * The display is not shown on the screen, it paints into its backing
+ * store.  The median, 90th and 99th percentile and the maximum time of
+ * the frames are reported for both steps.
+ */
+class RenderingBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void benchmarkFrames_data();
+    void benchmarkFrames();
+};
+
+}
+
+#endif // RENDERINGBENCHMARK_H
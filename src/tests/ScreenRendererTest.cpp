@@ -0,0 +1,110 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ScreenRendererTest.h"
+
+// Qt
+#include <QtGui/QFontMetrics>
+#include <QtGui/QImage>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Screen.h"
+#include "../ScreenRenderer.h"
+
+using namespace Konsole;
+
+// writes 'text' at the cursor
+static void writeText(Screen& screen, const char* text)
+{
+    for (const char* c = text; *c; c++)
+        screen.displayCharacter(*c);
+}
+
+void ScreenRendererTest::testSnapshot()
+{
+    Screen screen(5, 10);
+    writeText(screen, "abc");
+
+    ScreenRenderer renderer;
+    renderer.setLines(&screen, 1, 3);
+    QCOMPARE(renderer.lineCount(), 3);
+    QCOMPARE(renderer.columnCount(), 10);
+
+    // the snapshot does not change along with the screen
+    const QImage before = renderer.toImage();
+    screen.setCursorYX(2, 1);
+    writeText(screen, "changed");
+    QCOMPARE(renderer.toImage(), before);
+}
+
+void ScreenRendererTest::testImage()
+{
+    Screen screen(3, 10);
+    screen.setCursorYX(2, 3);
+    screen.setBackColor(COLOR_SPACE_RGB, 0xff0000);
+    writeText(screen, "  ");
+
+    QFont font("Monospace");
+    font.setStyleHint(QFont::TypeWriter);
+
+    ColorEntry table[TABLE_COLORS];
+    for (int i = 0; i < TABLE_COLORS; i++)
+        table[i] = ColorEntry(QColor(i, i, i));
+
+    ScreenRenderer renderer;
+    renderer.setFont(font);
+    renderer.setColorTable(table);
+    renderer.setLines(&screen, 0, 2);
+
+    const QImage image = renderer.toImage();
+    QCOMPARE(image.size(), renderer.size());
+
+    const QFontMetrics fm(font);
+    QCOMPARE(image.height(), 3 * fm.height());
+
+    // the cells with a background of their own are filled with it, the
+    // others with the default background
+    const int cellWidth = image.width() / 10;
+    const QPoint redCell(cellWidth * 2 + cellWidth / 2, fm.height() + fm.height() / 2);
+    QCOMPARE(QColor(image.pixel(redCell)), QColor(0xff, 0, 0));
+    QCOMPARE(QColor(image.pixel(0, 0)), table[DEFAULT_BACK_COLOR].color);
+}
+
+void ScreenRendererTest::testPrinterFriendly()
+{
+    Screen screen(3, 10);
+    screen.setBackColor(COLOR_SPACE_RGB, 0xff0000);
+    writeText(screen, "  ");
+
+    ScreenRenderer renderer;
+    renderer.setPrinterFriendly(true);
+    renderer.setLines(&screen, 0, 2);
+
+    // nothing but the text is drawn
+    const QImage image = renderer.toImage();
+    QCOMPARE(QColor(image.pixel(1, 1)), QColor(Qt::white));
+}
+
+QTEST_KDEMAIN(ScreenRendererTest, GUI)
+
+#include "ScreenRendererTest.moc"
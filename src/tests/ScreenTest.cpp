@@ -0,0 +1,869 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ScreenTest.h"
+
+// Qt
+#include <QtCore/QTextStream>
+#include <QtCore/QtConcurrentRun>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../History.h"
+#include "../Screen.h"
+#include "../ScreenSnapshot.h"
+#include "../ScreenWindow.h"
+#include "../TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+void ScreenTest::testLineGeneration()
+{
+    Screen screen(5, 10);
+    const quint64 generation = screen.generation();
+
+    screen.setCursorYX(3, 1);
+    screen.displayCharacter('a');
+
+    QVERIFY(screen.generation() > generation);
+    QVERIFY(screen.lineGeneration(2) > generation);
+    QVERIFY(screen.lineGeneration(0) <= generation);
+    QVERIFY(screen.lineGeneration(4) <= generation);
+
+    // the selection is not part of the image, changing it changes no line
+    const quint64 selectionGeneration = screen.generation();
+    screen.setSelectionStart(0, 0, false);
+    screen.setSelectionEnd(5, 3);
+    screen.clearSelection();
+    QCOMPARE(screen.generation(), selectionGeneration);
+
+    // changes to the MODE_Screen mode affect every line
+    screen.setMode(MODE_Screen);
+    QVERIFY(screen.lineGeneration(0) > selectionGeneration);
+    QVERIFY(screen.lineGeneration(4) > selectionGeneration);
+}
+
+void ScreenTest::testDirtyLines()
+{
+    Screen screen(5, 10);
+    ScreenWindow window;
+    window.setScreen(&screen);
+    window.setWindowLines(5);
+
+    // all lines are dirty when the image is first retrieved
+    window.getImage();
+    for (int line = 0; line < 5; line++)
+        QVERIFY(window.isLineDirty(line));
+
+    window.resetDirtyLines();
+    QVERIFY(!window.isLineDirty(0));
+
+    screen.setCursorYX(3, 1);
+    screen.displayCharacter('a');
+    window.notifyOutputChanged();
+    window.getImage();
+
+    QVERIFY(window.isLineDirty(2));
+    // the cursor has moved off the first line
+    QVERIFY(window.isLineDirty(0));
+    QVERIFY(!window.isLineDirty(1));
+    QVERIFY(!window.isLineDirty(3));
+    QVERIFY(!window.isLineDirty(4));
+}
+
+void ScreenTest::testLineProperties()
+{
+    Screen screen(3, 4);
+    screen.setScroll(CompactHistoryType(10));
+
+    // a line which wraps onto the next one, and then enough lines to move
+    // it into the history
+    screen.setCursorYX(1, 1);
+    const char text[] = "abcdef";
+    for (int i = 0; text[i]; i++)
+        screen.displayCharacter(text[i]);
+    screen.setCursorYX(3, 1);
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 1);
+
+    ScreenWindow window;
+    window.setScreen(&screen);
+    window.setWindowLines(5);
+    window.setTrackOutput(false);
+    window.scrollTo(0);
+
+    const QVector<LineProperty> properties = window.getLineProperties();
+    QCOMPARE(properties.count(), 5);
+    QVERIFY(properties[0] & LINE_WRAPPED);
+    QVERIFY(!(properties[1] & LINE_WRAPPED));
+    // beyond the end of the screen
+    QCOMPARE(properties[4], LineProperty(LINE_DEFAULT));
+
+    // the properties are only retrieved again once the screen changes
+    QCOMPARE(window.getLineProperties().constData(), properties.constData());
+
+    screen.setCursorYX(2, 1);
+    for (int i = 0; text[i]; i++)
+        screen.displayCharacter(text[i]);
+    QVERIFY(window.getLineProperties()[2] & LINE_WRAPPED);
+}
+
+void ScreenTest::testScrollUp()
+{
+    Screen screen(3, 4);
+
+    // line N starts with the letter 'a' + N
+    for (int line = 0; line < 3; line++) {
+        screen.setCursorYX(line + 1, 1);
+        screen.displayCharacter('a' + line);
+    }
+
+    // scroll the whole screen
+    screen.setCursorYX(3, 1);
+    screen.index();
+
+    Character image[3 * 4];
+    screen.getImage(image, 3 * 4, 0, 2);
+    QCOMPARE(image[0 * 4].character, quint16('b'));
+    QCOMPARE(image[1 * 4].character, quint16('c'));
+    QCOMPARE(image[2 * 4].character, quint16(' '));
+
+    screen.setCursorYX(3, 1);
+    screen.displayCharacter('d');
+
+    // scroll the two bottom lines only
+    screen.setMargins(2, 3);
+    screen.setCursorYX(3, 1);
+    screen.index();
+
+    screen.getImage(image, 3 * 4, 0, 2);
+    QCOMPARE(image[0 * 4].character, quint16('b'));
+    QCOMPARE(image[1 * 4].character, quint16('d'));
+    QCOMPARE(image[2 * 4].character, quint16(' '));
+
+    // lines keep their order when the screen is resized
+    screen.resizeImage(4, 4);
+    screen.getImage(image, 3 * 4, 0, 2);
+    QCOMPARE(image[0 * 4].character, quint16('b'));
+    QCOMPARE(image[1 * 4].character, quint16('d'));
+}
+
+void ScreenTest::testScrollRegion()
+{
+    Screen screen(5, 4);
+
+    for (int line = 0; line < 5; line++) {
+        screen.setCursorYX(line + 1, 1);
+        screen.displayCharacter('a' + line);
+    }
+
+    screen.setMargins(2, 4);
+
+    Character image[5 * 4];
+    screen.setCursorYX(2, 1);
+    screen.deleteLines(1);
+    screen.getImage(image, 5 * 4, 0, 4);
+    QCOMPARE(image[0 * 4].character, quint16('a'));
+    QCOMPARE(image[1 * 4].character, quint16('c'));
+    QCOMPARE(image[2 * 4].character, quint16('d'));
+    QCOMPARE(image[3 * 4].character, quint16(' '));
+    QCOMPARE(image[4 * 4].character, quint16('e'));
+
+    screen.setCursorYX(3, 1);
+    screen.insertLines(1);
+    screen.getImage(image, 5 * 4, 0, 4);
+    QCOMPARE(image[1 * 4].character, quint16('c'));
+    QCOMPARE(image[2 * 4].character, quint16(' '));
+    QCOMPARE(image[3 * 4].character, quint16('d'));
+    QCOMPARE(image[4 * 4].character, quint16('e'));
+
+    // the lines which were moved do not share their cells with others
+    screen.setCursorYX(3, 1);
+    screen.displayCharacter('x');
+    screen.setCursorYX(4, 2);
+    screen.displayCharacter('y');
+    screen.getImage(image, 5 * 4, 0, 4);
+    QCOMPARE(image[1 * 4].character, quint16('c'));
+    QCOMPARE(image[2 * 4].character, quint16('x'));
+    QCOMPARE(image[3 * 4].character, quint16('d'));
+    QCOMPARE(image[3 * 4 + 1].character, quint16('y'));
+    QCOMPARE(image[2 * 4 + 1].character, quint16(' '));
+}
+
+void ScreenTest::testReflowLines()
+{
+    Screen screen(3, 4);
+    screen.setReflowLines(true);
+
+    // "abcdef" wraps after the fourth column
+    const unsigned short text[] = { 'a', 'b', 'c', 'd', 'e', 'f' };
+    screen.displayCharacters(text, 6);
+    QCOMPARE(screen.getCursorY(), 1);
+
+    screen.resizeImage(3, 6);
+
+    Character image[3 * 6];
+    screen.getImage(image, 3 * 6, 0, 2);
+    for (int i = 0; i < 6; i++)
+        QCOMPARE(image[i].character, quint16(text[i]));
+    QCOMPARE(image[6].character, quint16(' '));
+    QCOMPARE(screen.getCursorY(), 0);
+
+    screen.resizeImage(3, 3);
+
+    screen.getImage(image, 3 * 3, 0, 2);
+    QCOMPARE(image[0].character, quint16('a'));
+    QCOMPARE(image[3].character, quint16('d'));
+    QCOMPARE(image[6].character, quint16(' '));
+    QCOMPARE(screen.getCursorY(), 1);
+}
+
+void ScreenTest::testClearWithColor()
+{
+    Screen screen(2, 6);
+    const CharacterColor blue(COLOR_SPACE_SYSTEM, 4);
+
+    screen.displayCharacter('a');
+    screen.setBackColor(COLOR_SPACE_SYSTEM, 4);
+    screen.setCursorYX(1, 3);
+    screen.clearToEndOfLine();
+
+    Character image[2 * 6];
+    screen.getImage(image, 2 * 6, 0, 1);
+    QCOMPARE(image[0].character, quint16('a'));
+    QVERIFY(image[1].backgroundColor != blue);
+    for (int i = 2; i < 6; i++)
+        QVERIFY(image[i].backgroundColor == blue);
+    QVERIFY(image[6].backgroundColor != blue);
+
+    // writing past the end of the cleared part keeps the blank cells before it
+    screen.setDefaultRendition();
+    screen.setCursorYX(1, 6);
+    screen.displayCharacter('b');
+
+    screen.getImage(image, 2 * 6, 0, 1);
+    QCOMPARE(image[5].character, quint16('b'));
+    QVERIFY(image[5].backgroundColor != blue);
+    QVERIFY(image[4].backgroundColor == blue);
+}
+
+void ScreenTest::testSelectionInHistory()
+{
+    Screen screen(2, 4);
+    screen.setScroll(CompactHistoryType(1));
+
+    screen.displayCharacter('a');
+    screen.setSelectionStart(0, 0, false);
+    screen.setSelectionEnd(0, 0);
+    QCOMPARE(screen.selectedText(false), QString("a"));
+
+    // the selection stays with its line as it moves into the history
+    screen.setCursorYX(2, 1);
+    screen.index();
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 2);
+    QCOMPARE(screen.selectedText(false), QString("a"));
+
+    int column = -1;
+    int line = -1;
+    screen.getSelectionStart(column, line);
+    QCOMPARE(column, 0);
+    QCOMPARE(line, 0);
+
+    // the selection is gone once its line has been discarded
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 2);
+    QVERIFY(screen.selectedText(false).isEmpty());
+}
+
+void ScreenTest::testSelectionClearedByWrite()
+{
+    Screen screen(2, 4);
+    screen.setScroll(CompactHistoryType(10));
+
+    const unsigned short text[] = { 'a', 'b', 'c', 'd' };
+    screen.displayCharacters(text, 4);
+    screen.setSelectionStart(1, 0, false);
+    screen.setSelectionEnd(2, 0);
+    QCOMPARE(screen.selectedText(false), QString("bc"));
+
+    // writing next to the selection keeps it, writing over it clears it
+    screen.setCursorYX(1, 4);
+    screen.displayCharacter('x');
+    QCOMPARE(screen.selectedText(false), QString("bc"));
+    screen.setCursorYX(1, 2);
+    screen.displayCharacters(text, 2);
+    QVERIFY(screen.selectedText(false).isEmpty());
+
+    // a selection in the history stays, whatever is written on the screen
+    screen.setSelectionStart(0, 0, false);
+    screen.setSelectionEnd(3, 0);
+    screen.setCursorYX(2, 1);
+    screen.index();
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 2);
+    for (int line = 1; line <= 2; line++) {
+        screen.setCursorYX(line, 1);
+        screen.displayCharacters(text, 4);
+    }
+    QCOMPARE(screen.selectedText(false), QString("aabx"));
+}
+
+void ScreenTest::testScrollIntoHistory()
+{
+    Screen screen(4, 4);
+    screen.setScroll(CompactHistoryType(100));
+
+    for (int line = 0; line < 4; line++) {
+        screen.setCursorYX(line + 1, 1);
+        screen.displayCharacter('a' + line);
+    }
+
+    // the line below the region is selected and moves down with the screen
+    screen.setMargins(1, 3);
+    screen.setSelectionStart(0, 3, false);
+    screen.setSelectionEnd(0, 3);
+    QCOMPARE(screen.selectedText(false), QString("d"));
+
+    // several lines are scrolled into the history at once
+    screen.scrollUp(2);
+    QCOMPARE(screen.getHistLines(), 2);
+    QCOMPARE(screen.selectedText(false), QString("d"));
+
+    Character image[6 * 4];
+    screen.getImage(image, 6 * 4, 0, 5);
+    QCOMPARE(image[0 * 4].character, quint16('a'));
+    QCOMPARE(image[1 * 4].character, quint16('b'));
+    QCOMPARE(image[2 * 4].character, quint16('c'));
+    QCOMPARE(image[3 * 4].character, quint16(' '));
+    QCOMPARE(image[4 * 4].character, quint16(' '));
+    QCOMPARE(image[5 * 4].character, quint16('d'));
+
+    // more lines than the region holds
+    screen.clearEntireScreen();
+    QCOMPARE(screen.getHistLines(), 5);
+    screen.getImage(image, 6 * 4, 0, 5);
+    QCOMPARE(image[2 * 4].character, quint16('c'));
+    QCOMPARE(image[3 * 4].character, quint16(' '));
+}
+
+// compares the image of the window with the lines read from the screen
+static void compareWindowImage(ScreenWindow& window, Screen& screen)
+{
+    const int lines = window.windowLines();
+    const int columns = window.windowColumns();
+    const int firstLine = window.currentLine();
+
+    QVector<Character> expected(lines * columns);
+    screen.getImage(expected.data(), expected.count(), firstLine, firstLine + lines - 1);
+
+    const Character* image = window.getImage();
+    for (int i = 0; i < expected.count(); i++) {
+        QCOMPARE(image[i].character, expected[i].character);
+        QCOMPARE(image[i].rendition, expected[i].rendition);
+    }
+}
+
+void ScreenTest::testScrollBack()
+{
+    Screen screen(4, 4);
+    screen.setScroll(CompactHistoryType(100));
+
+    // each line of the output starts with a different letter
+    for (int line = 0; line < 20; line++) {
+        screen.setCursorYX(4, 1);
+        screen.displayCharacter('a' + line);
+        screen.index();
+    }
+    QCOMPARE(screen.getHistLines(), 20);
+
+    ScreenWindow window;
+    window.setScreen(&screen);
+    window.setWindowLines(4);
+    window.setTrackOutput(false);
+
+    // scroll by less than the window height, by more, and to the ends
+    const int positions[] = { 16, 15, 13, 14, 7, 0, 2, 9, 20 };
+    for (uint i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+        window.scrollTo(positions[i]);
+        QCOMPARE(window.currentLine(), positions[i]);
+        compareWindowImage(window, screen);
+
+        // let the window prefetch the lines around it
+        QTest::qWait(0);
+    }
+
+    // reversing the screen changes the prefetched lines
+    window.scrollTo(8);
+    compareWindowImage(window, screen);
+    QTest::qWait(0);
+    screen.setMode(MODE_Screen);
+    window.notifyOutputChanged();
+    window.scrollTo(5);
+    compareWindowImage(window, screen);
+
+    // a full history drops its oldest lines, which moves the prefetched
+    // lines up
+    Screen fullScreen(4, 4);
+    fullScreen.setScroll(CompactHistoryType(20));
+    for (int line = 0; line < 24; line++) {
+        fullScreen.setCursorYX(4, 1);
+        fullScreen.displayCharacter('a' + line);
+        fullScreen.index();
+    }
+    QCOMPARE(fullScreen.getHistLines(), 20);
+
+    ScreenWindow fullWindow;
+    fullWindow.setScreen(&fullScreen);
+    fullWindow.setWindowLines(4);
+    fullWindow.setTrackOutput(false);
+    fullWindow.scrollTo(8);
+    compareWindowImage(fullWindow, fullScreen);
+    QTest::qWait(0);
+
+    for (int line = 0; line < 2; line++) {
+        fullScreen.setCursorYX(4, 1);
+        fullScreen.displayCharacter('A' + line);
+        fullScreen.index();
+    }
+    fullWindow.notifyOutputChanged();
+    fullScreen.resetDroppedLines();
+    QCOMPARE(fullWindow.currentLine(), 6);
+    compareWindowImage(fullWindow, fullScreen);
+    fullWindow.scrollTo(9);
+    compareWindowImage(fullWindow, fullScreen);
+}
+
+void ScreenTest::testHistoryConversion()
+{
+    Screen screen(2, 4);
+    screen.setScroll(CompactHistoryType(20000));
+
+    // more lines than are converted at once
+    const int lineCount = 15000;
+    for (int i = 0; i < lineCount; i++) {
+        screen.setCursorYX(2, 1);
+        screen.displayCharacter('a' + i % 26);
+        screen.index();
+    }
+    const int histLines = screen.getHistLines();
+    QVERIFY(histLines > 10000);
+
+    screen.setScroll(SharedHistoryType(20000));
+    QVERIFY(screen.isConvertingHistory());
+    QCOMPARE(screen.getHistLines(), histLines);
+
+    // lines keep being added while the history is converted
+    screen.convertHistory(1000);
+    screen.setCursorYX(2, 1);
+    screen.displayCharacter('z');
+    screen.index();
+    QCOMPARE(screen.getHistLines(), histLines + 1);
+
+    while (screen.convertHistory(1000)) {}
+    QVERIFY(!screen.isConvertingHistory());
+    QCOMPARE(screen.getHistLines(), histLines + 1);
+    QCOMPARE(screen.getScroll().maximumLineCount(), 20000);
+
+    Character image[4];
+    for (int line = 1; line <= histLines; line += 997) {
+        screen.getImage(image, 4, line, line);
+        QCOMPARE(image[0].character, quint16('a' + (line - 1) % 26));
+    }
+    screen.getImage(image, 4, histLines + 1, histLines + 1);
+    QCOMPARE(image[0].character, quint16('z'));
+}
+
+void ScreenTest::testWideLineText()
+{
+    // wider than the lines which could be copied before
+    const int columns = 2000;
+    Screen screen(2, columns);
+    screen.setScroll(CompactHistoryType(10));
+
+    QString text;
+    for (int i = 0; i < columns; i++) {
+        const QChar c('a' + i % 26);
+        screen.displayCharacter(c.unicode());
+        text.append(c);
+    }
+
+    screen.setSelectionStart(0, 0, false);
+    screen.setSelectionEnd(columns - 1, 0);
+    QCOMPARE(screen.selectedText(true), text);
+
+    // the same text is read back from the history
+    screen.setCursorYX(2, 1);
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 1);
+    QCOMPARE(screen.selectedText(true), text);
+}
+
+void ScreenTest::testNonBmpCharacters()
+{
+    QCOMPARE(sizeof(Character), size_t(8));
+
+    Screen screen(2, 10);
+    screen.setScroll(CompactHistoryType(10));
+
+    // a wide emoji, U+10000 which does not fit into the cells directly and
+    // a narrow Deseret letter, followed by a combining mark
+    const uint codePoints[] = { 'a', 0x1F600, 0x10000, 0x10400, 0x0301 };
+    QString text;
+    for (uint i = 0; i < sizeof(codePoints) / sizeof(codePoints[0]); i++) {
+        if (codePoints[i] >= 0x10000) {
+            screen.displayCharacter(QChar::highSurrogate(codePoints[i]));
+            screen.displayCharacter(QChar::lowSurrogate(codePoints[i]));
+            text.append(QChar(QChar::highSurrogate(codePoints[i])));
+            text.append(QChar(QChar::lowSurrogate(codePoints[i])));
+        } else {
+            screen.displayCharacter(codePoints[i]);
+            text.append(QChar(codePoints[i]));
+        }
+    }
+    QCOMPARE(screen.getCursorX(), 5);
+
+    Character line[10];
+    screen.getImage(line, 10, 0, 0);
+    QCOMPARE(line[1].codePoint(), 0x1F600u);
+    QCOMPARE(line[2].character, quint16(0));
+    QVERIFY(line[3].rendition & RE_EXTENDED_CHAR);
+    QVERIFY(line[4].rendition & RE_EXTENDED_CHAR);
+
+    screen.setSelectionStart(0, 0, false);
+    screen.setSelectionEnd(4, 0);
+    QCOMPARE(screen.selectedText(true), text);
+
+    // the characters come back unchanged from the history
+    screen.setCursorYX(2, 1);
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 1);
+    QCOMPARE(screen.selectedText(true), text);
+}
+
+// returns the characters of the first line of 'screen'
+static QString firstLine(Screen& screen)
+{
+    QVector<Character> image(screen.getColumns());
+    screen.getImage(image.data(), image.size(), 0, 0);
+
+    QString text;
+    for (int i = 0; i < image.size(); i++)
+        text.append(QChar(image[i].character));
+    return text;
+}
+
+void ScreenTest::testWriteModes()
+{
+    Screen screen(2, 4);
+    const unsigned short text[] = { 'a', 'b', 'c', 'd', 'e', 'f' };
+
+    // without wrapping, the characters beyond the end of the line
+    // overwrite its last column
+    screen.resetMode(MODE_Wrap);
+    screen.displayCharacters(text, 6);
+    QCOMPARE(firstLine(screen), QString("abcf"));
+    QCOMPARE(screen.getCursorY(), 0);
+
+    // in insert mode, the rest of the line moves to the right
+    const unsigned short inserted[] = { 'X', 'Y' };
+    screen.setCursorYX(1, 1);
+    screen.setMode(MODE_Insert);
+    screen.displayCharacters(inserted, 2);
+    QCOMPARE(firstLine(screen), QString("XYab"));
+
+    // the saved mode, overwriting, is restored
+    screen.restoreMode(MODE_Insert);
+    screen.displayCharacter('Z');
+    QCOMPARE(firstLine(screen), QString("XYZb"));
+
+    // with wrapping, the line is continued on the next one
+    screen.setMode(MODE_Wrap);
+    screen.displayCharacters(text, 2);
+    QCOMPARE(firstLine(screen), QString("XYZa"));
+    QCOMPARE(screen.getCursorY(), 1);
+}
+
+// returns the text of all lines of 'snapshot'
+static QString snapshotText(const ScreenSnapshot& snapshot)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    snapshot.writeLinesToStream(&decoder, snapshot.firstLine(), snapshot.lastLine());
+    decoder.end();
+    stream.flush();
+    return text;
+}
+
+// returns the text of the lines from 'startLine' to 'endLine' of 'screen'
+static QString screenText(const Screen& screen, int startLine, int endLine)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    screen.writeLinesToStream(&decoder, startLine, endLine);
+    decoder.end();
+    stream.flush();
+    return text;
+}
+
+void ScreenTest::testSnapshot()
+{
+    Screen screen(3, 6);
+    screen.setScroll(CompactHistoryType(10));
+
+    // lines in the history and on the screen, one of them with a combining
+    // mark and one of them cleared with a color
+    const unsigned short text[] = { 'a', 'b', 'c', 'd', 'e', 'f' };
+    for (int line = 1; line <= 3; line++) {
+        screen.setCursorYX(line, 1);
+        screen.displayCharacters(text, line * 2);
+    }
+    screen.displayCharacter(0x0301);
+    screen.setCursorYX(3, 1);
+    screen.index();
+    screen.index();
+    screen.setCursorYX(2, 3);
+    screen.setBackColor(COLOR_SPACE_SYSTEM, 1);
+    screen.clearToEndOfLine();
+    QCOMPARE(screen.getHistLines(), 2);
+
+    const int lastLine = screen.getHistLines() + screen.getLines() - 1;
+    const QString expected = screenText(screen, 0, lastLine);
+    const ScreenSnapshot snapshot = screen.snapshot(0, lastLine);
+    QCOMPARE(snapshot.historyLines(), 2);
+    QCOMPARE(snapshotText(snapshot), expected);
+
+    // the snapshot stays the same while the screen changes
+    for (int line = 1; line <= 3; line++) {
+        screen.setCursorYX(line, 1);
+        screen.displayCharacters(text + 2, 4);
+    }
+    screen.index();
+    screen.clearEntireScreen();
+    QVERIFY(screenText(screen, 0, lastLine) != expected);
+    QCOMPARE(snapshotText(snapshot), expected);
+
+    // and it can be read on another thread
+    QCOMPARE(QtConcurrent::run(snapshotText, snapshot).result(), expected);
+
+    // a part of the output
+    const ScreenSnapshot part = screen.snapshot(1, 3);
+    QCOMPARE(snapshotText(part), screenText(screen, 1, 3));
+}
+
+// returns the text between two indices of 'snapshot'
+static QString snapshotRangeText(const ScreenSnapshot& snapshot, int startIndex, int endIndex,
+                                 bool blockSelection, bool preserveLineBreaks, bool trimTrailingSpaces)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    snapshot.writeToStream(&decoder, startIndex, endIndex, blockSelection,
+                           preserveLineBreaks, trimTrailingSpaces);
+    decoder.end();
+    stream.flush();
+    return text;
+}
+
+// returns the text between two indices of 'screen', read with a snapshot
+// of one line at a time
+static QString lineByLineRangeText(const Screen& screen, int startIndex, int endIndex,
+                                   bool blockSelection, bool preserveLineBreaks,
+                                   bool trimTrailingSpaces)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    const int columns = screen.getColumns();
+    for (int line = startIndex / columns; line <= endIndex / columns; line++) {
+        screen.snapshot(line, line).writeToStream(&decoder, startIndex, endIndex, line, line,
+                                                  blockSelection, preserveLineBreaks,
+                                                  trimTrailingSpaces);
+    }
+    decoder.end();
+    stream.flush();
+    return text;
+}
+
+void ScreenTest::testSnapshotRange()
+{
+    Screen screen(3, 6);
+    screen.setScroll(CompactHistoryType(10));
+
+    const unsigned short text[] = { 'a', 'b', 'c', 'd', 'e', 'f' };
+    for (int line = 1; line <= 3; line++) {
+        screen.setCursorYX(line, 1);
+        screen.displayCharacters(text, line * 2);
+    }
+    screen.setCursorYX(3, 1);
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 1);
+
+    // ranges which start in the history and end on the screen, in the
+    // middle of a line and beyond its end
+    const int columns = screen.getColumns();
+    const int ranges[][2] = { { 1, 2 * columns + 3 }, { 0, 3 * columns - 1 },
+                              { columns + 1, 2 * columns + 4 } };
+    for (int i = 0; i < 3; i++) {
+        const int startIndex = ranges[i][0];
+        const int endIndex = ranges[i][1];
+        const ScreenSnapshot snapshot = screen.snapshot(startIndex / columns, endIndex / columns);
+
+        for (int mode = 0; mode < 8; mode++) {
+            const bool blockSelection = mode & 1;
+            const bool preserveLineBreaks = mode & 2;
+            const bool trimTrailingSpaces = mode & 4;
+            const QString expected = screen.rangeText(startIndex, endIndex, blockSelection,
+                                                      preserveLineBreaks, trimTrailingSpaces);
+            QCOMPARE(snapshotRangeText(snapshot, startIndex, endIndex, blockSelection,
+                                       preserveLineBreaks, trimTrailingSpaces), expected);
+            QCOMPARE(lineByLineRangeText(screen, startIndex, endIndex, blockSelection,
+                                         preserveLineBreaks, trimTrailingSpaces), expected);
+        }
+    }
+
+    // the range stays readable after the output has changed
+    const ScreenSnapshot snapshot = screen.snapshot(0, 2);
+    const QString expected = screen.rangeText(2, 2 * columns + 2, false, true);
+    screen.clearEntireScreen();
+    QCOMPARE(snapshotRangeText(snapshot, 2, 2 * columns + 2, false, true, false), expected);
+}
+
+// returns the lines of 'snapshot' as HTML
+static QString snapshotHtml(const ScreenSnapshot& snapshot)
+{
+    QString text;
+    QTextStream stream(&text);
+    HTMLDecoder decoder;
+    decoder.begin(&stream);
+    snapshot.writeLinesToStream(&decoder, snapshot.firstLine(), snapshot.lastLine());
+    decoder.end();
+    stream.flush();
+    return text;
+}
+
+void ScreenTest::testSnapshotColors()
+{
+    Screen screen(2, 6);
+
+    const unsigned short text[] = { 'a', 'b', 'c' };
+    screen.setForeColor(COLOR_SPACE_RGB, 0x123456);
+    screen.displayCharacters(text, 3);
+
+    QString expected;
+    QTextStream stream(&expected);
+    HTMLDecoder decoder;
+    decoder.begin(&stream);
+    screen.writeLinesToStream(&decoder, 0, 1);
+    decoder.end();
+    stream.flush();
+    QVERIFY(expected.contains("#123456"));
+
+    // the RGB colors are looked up in the snapshot on another thread
+    const ScreenSnapshot snapshot = screen.snapshot(0, 1);
+    QCOMPARE(QtConcurrent::run(snapshotHtml, snapshot).result(), expected);
+}
+
+void ScreenTest::testUsedExtendedChars()
+{
+    Screen screen(2, 4);
+    screen.setScroll(CompactHistoryType(1));
+
+    // two lines with a combining mark each, which are moved into the
+    // history, which only has room for one of them
+    QList<ushort> hashes;
+    QVector<Character> line(screen.getColumns());
+    for (int i = 0; i < 2; i++) {
+        screen.setCursorYX(1, 1);
+        screen.displayCharacter('a' + i);
+        screen.displayCharacter(0x0301);
+        const int histLines = screen.getHistLines();
+        screen.getImage(line.data(), line.count(), histLines, histLines);
+        QVERIFY(line[0].rendition & RE_EXTENDED_CHAR);
+        hashes << line[0].character;
+        screen.index();
+        screen.index();
+    }
+    QCOMPARE(screen.getHistLines(), 1);
+
+    // the lines added to the history are remembered, the history is
+    // only read for the exact result
+    const QSet<ushort> used = screen.usedExtendedChars();
+    QVERIFY(used.contains(hashes[0]));
+    QVERIFY(used.contains(hashes[1]));
+
+    const QSet<ushort> exact = screen.usedExtendedChars(true);
+    QVERIFY(!exact.contains(hashes[0]));
+    QVERIFY(exact.contains(hashes[1]));
+    QCOMPARE(screen.usedExtendedChars(), exact);
+
+    screen.clearHistory();
+    QVERIFY(screen.usedExtendedChars().isEmpty());
+}
+
+void ScreenTest::testUsedRgbColors()
+{
+    Screen screen(2, 4);
+    screen.setScroll(CompactHistoryType(1));
+
+    // a line which is moved into the history
+    screen.setCursorYX(2, 1);
+    screen.setForeColor(COLOR_SPACE_RGB, 0xabcdef);
+    screen.displayCharacter('h');
+    screen.index();
+    screen.index();
+    QCOMPARE(screen.getHistLines(), 1);
+
+    // many more colors than the table holds, only the last ones are left
+    // on the screen and the others are freed for the new colors
+    const quint64 generation = rgbColorGeneration();
+    const int columns = screen.getColumns();
+    const int cells = screen.getLines() * columns;
+    const int count = 3 * CharacterColor::MAX_RGB_INDEX;
+    for (int i = 0; i < count; i++) {
+        screen.setCursorYX(1 + (i % cells) / columns, 1 + i % columns);
+        screen.setForeColor(COLOR_SPACE_RGB, 0x010000 + i);
+        screen.displayCharacter('x');
+    }
+    QVERIFY(rgbColorGeneration() != generation);
+
+    QVector<Character> image((1 + screen.getLines()) * columns);
+    screen.getImage(image.data(), image.count(), 0, screen.getLines());
+
+    QVERIFY(image[0].foregroundColor.isRgb());
+    QCOMPARE(rgbColorValue(image[0].foregroundColor.rgbIndex()), qRgb(0xab, 0xcd, 0xef));
+    for (int i = count - cells; i < count; i++) {
+        const CharacterColor& color = image[columns + i % cells].foregroundColor;
+        QVERIFY(color.isRgb());
+        QCOMPARE(rgbColorValue(color.rgbIndex()), QRgb(0xff010000 + i));
+    }
+    QVERIFY(screen.currentForeground().isRgb());
+}
+
+QTEST_KDEMAIN_CORE(ScreenTest)
+
+#include "ScreenTest.moc"
+
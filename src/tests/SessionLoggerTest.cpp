@@ -0,0 +1,102 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "SessionLoggerTest.h"
+
+// Qt
+#include <QtCore/QFile>
+
+// KDE
+#include <KTempDir>
+#include <qtest_kde.h>
+
+// Konsole
+#include "../SessionLogger.h"
+
+using namespace Konsole;
+
+static QByteArray readFile(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+void SessionLoggerTest::testRawOutput()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "session.log";
+
+    const QByteArray output("\033[1mbold\033[0m text\r\n");
+    {
+        SessionLogger logger(fileName);
+        logger.logOutput(output.constData(), output.size());
+        logger.logOutput(output.constData(), output.size());
+    }
+
+    QCOMPARE(readFile(fileName), output + output);
+}
+
+void SessionLoggerTest::testPlainTextOutput()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "session.log";
+
+    // the sequences are split across calls to logOutput()
+    const QByteArray output("\033[1;3mbold\033[0m\ttext\r\n"
+                            "\033]0;title\007\033(Bline\033]2;x\033\\\n"
+                            "\033[3");
+    const QByteArray rest("8;5;1mcolored\bX\n");
+    {
+        SessionLogger logger(fileName, SessionLogger::PlainTextOutput);
+        for (int i = 0; i < output.size(); i++)
+            logger.logOutput(output.constData() + i, 1);
+        logger.logOutput(rest.constData(), rest.size());
+    }
+
+    QCOMPARE(readFile(fileName), QByteArray("bold\ttext\nline\ncoloredX\n"));
+}
+
+void SessionLoggerTest::testRotation()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "session.log";
+
+    const QByteArray first(70 * 1024, 'a');
+    const QByteArray second(70 * 1024, 'b');
+    const QByteArray third(70 * 1024, 'c');
+
+    // each logger appends to the log left by the previous one
+    const QByteArray outputs[] = { first, second, third };
+    for (int i = 0; i < 3; i++) {
+        SessionLogger logger(fileName);
+        logger.setMaximumFileSize(100 * 1024);
+        logger.setRotationCount(1);
+        logger.logOutput(outputs[i].constData(), outputs[i].size());
+    }
+
+    QCOMPARE(readFile(fileName), third);
+    QCOMPARE(readFile(fileName + ".1"), second);
+    QVERIFY(!QFile::exists(fileName + ".2"));
+}
+
+QTEST_KDEMAIN_CORE(SessionLoggerTest)
+
+#include "SessionLoggerTest.moc"
+
@@ -0,0 +1,150 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+// Own
+#include "SessionRecordingTest.h"
+
+// Qt
+#include <QtCore/QFile>
+#include <QtCore/QTextCodec>
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <KTempDir>
+#include <qtest_kde.h>
+
+// Konsole
+#include "../SessionRecording.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+void SessionRecordingTest::testRoundTrip()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "session.recording";
+
+    // large enough to need several bytes for its length
+    const QByteArray output(1000, 'x');
+    {
+        SessionRecorder recorder(fileName);
+        QVERIFY(recorder.open());
+        recorder.recordResize(24, 80);
+        recorder.recordOutput("\033[1mbold\033[0m\r\n", 15);
+        recorder.recordOutput(output.constData(), output.size());
+        recorder.recordResize(50, 132);
+    }
+
+    SessionRecordingReader reader(fileName);
+    QVERIFY(reader.open());
+
+    RecordedEvent event;
+    QVERIFY(reader.readEvent(&event));
+    QCOMPARE(event.type, RecordedEvent::Resize);
+    QCOMPARE(event.lines, 24);
+    QCOMPARE(event.columns, 80);
+    qint64 time = event.time;
+
+    QVERIFY(reader.readEvent(&event));
+    QCOMPARE(event.type, RecordedEvent::Output);
+    QCOMPARE(event.data, QByteArray("\033[1mbold\033[0m\r\n"));
+    QVERIFY(event.time >= time);
+    time = event.time;
+
+    QVERIFY(reader.readEvent(&event));
+    QCOMPARE(event.type, RecordedEvent::Output);
+    QCOMPARE(event.data, output);
+    QVERIFY(event.time >= time);
+
+    QVERIFY(reader.readEvent(&event));
+    QCOMPARE(event.type, RecordedEvent::Resize);
+    QCOMPARE(event.lines, 50);
+    QCOMPARE(event.columns, 132);
+
+    QVERIFY(!reader.readEvent(&event));
+    QVERIFY(reader.errorString().isEmpty());
+}
+
+void SessionRecordingTest::testTruncatedRecording()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "session.recording";
+    {
+        SessionRecorder recorder(fileName);
+        QVERIFY(recorder.open());
+        recorder.recordOutput("some output", 11);
+    }
+
+    QFile file(fileName);
+    QVERIFY(file.resize(file.size() - 3));
+
+    SessionRecordingReader reader(fileName);
+    QVERIFY(reader.open());
+
+    RecordedEvent event;
+    QVERIFY(!reader.readEvent(&event));
+    QVERIFY(!reader.errorString().isEmpty());
+
+    // a file which is no recording at all
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("plain output\r\n");
+    file.close();
+
+    SessionRecordingReader otherReader(fileName);
+    QVERIFY(!otherReader.open());
+}
+
+void SessionRecordingTest::testReplay()
+{
+    KTempDir dir;
+    const QString fileName = dir.name() + "session.recording";
+    {
+        SessionRecorder recorder(fileName);
+        QVERIFY(recorder.open());
+        recorder.recordResize(10, 40);
+        recorder.recordOutput("first line\r\n", 12);
+        recorder.recordOutput("second line", 11);
+    }
+
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(24, 80);
+
+    SessionReplay replay(fileName, &emulation, SessionReplay::MaximumSpeed);
+    QSignalSpy finishedSpy(&replay, SIGNAL(finished()));
+    QVERIFY(replay.start());
+
+    QTest::qWait(100);
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(emulation.imageSize(), QSize(40, 10));
+    QCOMPARE(emulation.processingStatistics().receivedBytes, qint64(23));
+
+    // an emulation which is resized by its session is asked to resize
+    emulation.setImageSize(24, 80);
+    SessionReplay requestReplay(fileName, &emulation, SessionReplay::MaximumSpeed);
+    requestReplay.setResizeEmulation(false);
+    QSignalSpy resizeSpy(&requestReplay, SIGNAL(resizeRequest(QSize)));
+    QVERIFY(requestReplay.start());
+
+    QTest::qWait(100);
+    QCOMPARE(resizeSpy.count(), 1);
+    QCOMPARE(resizeSpy.first().first().toSize(), QSize(40, 10));
+    QCOMPARE(emulation.imageSize(), QSize(80, 24));
+}
+
+QTEST_KDEMAIN_CORE(SessionRecordingTest)
+
+#include "SessionRecordingTest.moc"
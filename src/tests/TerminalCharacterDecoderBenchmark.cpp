@@ -0,0 +1,121 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "TerminalCharacterDecoderBenchmark.h"
+
+// Qt
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int LINE_COUNT = 200;
+const int COLUMNS = 120;
+
+enum DecoderType {
+    PlainText,
+    Utf8PlainText,
+    Html,
+    HtmlStyleSheet
+};
+
+// returns LINE_COUNT lines of COLUMNS characters.  If 'colored' is true,
+// the foreground color changes every few characters
+QVector<Character> createLines(bool colored)
+{
+    static const char text[] = "drwxr-xr-x  2 user users  4096 Oct 14 12:00 konsole ";
+
+    QVector<Character> lines(LINE_COUNT * COLUMNS);
+    for (int i = 0; i < lines.count(); i++) {
+        Character& character = lines[i];
+        character.character = text[i % (sizeof(text) - 1)];
+        if (colored && (i / 6) % 2 == 0)
+            character.foregroundColor = CharacterColor(COLOR_SPACE_SYSTEM, (i / 12) % 8);
+    }
+    return lines;
+}
+}
+
+void TerminalCharacterDecoderBenchmark::benchmarkDecodeLine_data()
+{
+    QTest::addColumn<int>("decoderType");
+    QTest::addColumn<bool>("colored");
+
+    QTest::newRow("plain text") << int(PlainText) << false;
+    QTest::newRow("plain text, colored") << int(PlainText) << true;
+    QTest::newRow("utf-8 plain text") << int(Utf8PlainText) << false;
+    QTest::newRow("utf-8 plain text, colored") << int(Utf8PlainText) << true;
+    QTest::newRow("html") << int(Html) << false;
+    QTest::newRow("html, colored") << int(Html) << true;
+    QTest::newRow("html with style sheet") << int(HtmlStyleSheet) << false;
+    QTest::newRow("html with style sheet, colored") << int(HtmlStyleSheet) << true;
+}
+
+void TerminalCharacterDecoderBenchmark::benchmarkDecodeLine()
+{
+    QFETCH(int, decoderType);
+    QFETCH(bool, colored);
+
+    const QVector<Character> lines = createLines(colored);
+
+    PlainTextDecoder plainTextDecoder;
+    Utf8PlainTextDecoder utf8Decoder;
+    HTMLDecoder htmlDecoder;
+    htmlDecoder.setUseStyleSheet(decoderType == HtmlStyleSheet);
+
+    TerminalCharacterDecoder* decoder = &plainTextDecoder;
+    if (decoderType == Utf8PlainText)
+        decoder = &utf8Decoder;
+    else if (decoderType == Html || decoderType == HtmlStyleSheet)
+        decoder = &htmlDecoder;
+
+    int outputSize = 0;
+
+    QBENCHMARK {
+        QString outputString;
+        QByteArray outputBytes;
+        QTextStream outputStream(&outputString);
+
+        if (decoderType == Utf8PlainText)
+            utf8Decoder.begin(&outputBytes);
+        else
+            decoder->begin(&outputStream);
+
+        for (int line = 0; line < LINE_COUNT; line++)
+            decoder->decodeLine(lines.constData() + line * COLUMNS, COLUMNS, LINE_DEFAULT);
+
+        decoder->end();
+        outputSize += outputString.length() + outputBytes.size();
+    }
+
+    QVERIFY(outputSize != 0);
+}
+
+QTEST_KDEMAIN_CORE(TerminalCharacterDecoderBenchmark)
+
+#include "TerminalCharacterDecoderBenchmark.moc"
@@ -0,0 +1,44 @@
+/*
+    This file is part of Konsole, a terminal emulator for KDE.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef TERMINALCHARACTERDECODERBENCHMARK_H
+#define TERMINALCHARACTERDECODERBENCHMARK_H
+
+#include <QtCore/QObject>
+
+namespace Konsole
+{
+
+/**
+ * Measures how long decoding lines of characters takes with each of the
+ * TerminalCharacterDecoder classes, for plain lines and for lines whose
+ * colors change every few characters.
+ */
+class TerminalCharacterDecoderBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void benchmarkDecodeLine_data();
+    void benchmarkDecodeLine();
+};
+
+}
+
+#endif // TERMINALCHARACTERDECODERBENCHMARK_H
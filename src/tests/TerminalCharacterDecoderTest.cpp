@@ -27,6 +27,9 @@
 // KDE
 #include <qtest_kde.h>
 
+// Konsole
+#include "../ExtendedCharTable.h"
+
 using namespace Konsole;
 
 void TerminalCharacterDecoderTest::init()
@@ -57,6 +60,89 @@ void TerminalCharacterDecoderTest::testPlainTextDecoder()
     delete decoder;
 }
 
+void TerminalCharacterDecoderTest::testUtf8PlainTextDecoder()
+{
+    // characters which take one to four bytes in UTF-8
+    const QString text = QString::fromUtf8("a\xc3\xa9\xe2\x82\xac \xf0\x9f\x98\x80");
+    QVector<Character> characters;
+    for (int i = 0; i < text.length(); i++) {
+        if (text[i].isLowSurrogate())
+            continue;
+
+        if (text[i].isHighSurrogate()) {
+            const ushort surrogates[] = { text[i].unicode(), text[i + 1].unicode() };
+            Character character(ExtendedCharTable::instance.createExtendedChar(surrogates, 2));
+            character.rendition |= RE_EXTENDED_CHAR;
+            characters << character;
+        } else {
+            characters << Character(text[i].unicode());
+        }
+    }
+    characters << Character(' ') << Character(' ');
+
+    Utf8PlainTextDecoder decoder;
+    decoder.setTrailingWhitespace(false);
+    decoder.setRecordLinePositions(true);
+
+    QByteArray output("start");
+    decoder.begin(&output);
+    decoder.decodeLine(characters.constData(), characters.count(), LINE_DEFAULT);
+    decoder.decodeLine(characters.constData(), 1, LINE_DEFAULT);
+    decoder.end();
+
+    const QByteArray line = text.toUtf8();
+    QCOMPARE(output, QByteArray("start") + line + 'a');
+    QCOMPARE(decoder.linePositions().count(), 2);
+    QCOMPARE(decoder.linePositions()[0], 5);
+    QCOMPARE(decoder.linePositions()[1], 5 + line.size());
+
+    // the same text is written to a text stream
+    QString outputString;
+    QTextStream outputStream(&outputString);
+    decoder.begin(&outputStream);
+    decoder.decodeLine(characters.constData(), characters.count(), LINE_DEFAULT);
+    decoder.end();
+    QCOMPARE(outputString, text);
+}
+
+void TerminalCharacterDecoderTest::testHTMLDecoderStyleSheet()
+{
+    HTMLDecoder decoder;
+    decoder.setUseStyleSheet(true);
+
+    Character characters[4];
+    characters[0] = Character('a');
+    characters[1] = Character('<');
+    characters[1].foregroundColor = CharacterColor(COLOR_SPACE_SYSTEM, 1);
+    characters[1].rendition = RE_BOLD;
+    characters[2] = Character('&');
+    characters[2].foregroundColor = CharacterColor(COLOR_SPACE_RGB, 0x102030);
+    characters[3] = Character('b');
+
+    QString outputString;
+    QTextStream outputStream(&outputString);
+    decoder.begin(&outputStream);
+    decoder.decodeLine(characters, 4, LINE_DEFAULT);
+    decoder.end();
+
+    // the style sheet comes first, and each run of characters has the
+    // classes of its appearance
+    QVERIFY(outputString.startsWith("<style type=\"text/css\">"));
+    QVERIFY(outputString.contains(".f3{color:"));
+    QVERIFY(outputString.contains("<span class=\"f0 b1\">a</span>"));
+    QVERIFY(outputString.contains("<span class=\"B f3 b1\">&lt;</span>"));
+    QVERIFY(outputString.contains("<span class=\"b1\" style=\"color:#102030;\">&amp;</span>"));
+    QVERIFY(outputString.contains("<span class=\"f0 b1\">b</span><br>"));
+
+    // which is only written once
+    outputString.clear();
+    decoder.begin(&outputStream);
+    decoder.decodeLine(characters, 1, LINE_DEFAULT);
+    decoder.end();
+    QVERIFY(!outputString.contains("<style"));
+    QVERIFY(outputString.contains("<span class=\"f0 b1\">a</span>"));
+}
+
 QTEST_KDEMAIN_CORE(TerminalCharacterDecoderTest)
 
 #include "TerminalCharacterDecoderTest.moc"
@@ -34,6 +34,8 @@ private slots:
     void cleanup();
 
     void testPlainTextDecoder();
+    void testUtf8PlainTextDecoder();
+    void testHTMLDecoderStyleSheet();
 };
 
 }
@@ -0,0 +1,326 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+// Own
+#include "Vt102EmulationTest.h"
+
+// Qt
+#include <QtCore/QTextCodec>
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../ScreenWindow.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+void Vt102EmulationTest::testGraphicRendition()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(5, 20);
+    ScreenWindow* window = emulation.createWindow();
+    window->setWindowLines(5);
+
+    const QByteArray output("\033[1;4;31ma"
+                            "\033[22;24;39;44mb"
+                            "\033[38;2;255;0;0;48;5;100mc"
+                            "\033[7;38;1md"
+                            "\033[0me");
+    emulation.receiveData(output.constData(), output.size());
+
+    const Character* image = window->getImage();
+    QCOMPARE(image[0].character, quint16('a'));
+    QCOMPARE(image[4].character, quint16('e'));
+
+    // bold makes the foreground color intensive
+    CharacterColor red(COLOR_SPACE_SYSTEM, 1);
+    red.setIntensive();
+    QCOMPARE(int(image[0].rendition), RE_BOLD | RE_UNDERLINE);
+    QVERIFY(image[0].foregroundColor == red);
+    QVERIFY(image[0].backgroundColor == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR));
+
+    QCOMPARE(int(image[1].rendition), DEFAULT_RENDITION);
+    QVERIFY(image[1].foregroundColor == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR));
+    QVERIFY(image[1].backgroundColor == CharacterColor(COLOR_SPACE_SYSTEM, 4));
+
+    QVERIFY(image[2].foregroundColor == CharacterColor(COLOR_SPACE_RGB, 0xff0000));
+    QVERIFY(image[2].backgroundColor == CharacterColor(COLOR_SPACE_256, 100));
+
+    // an incomplete extended color selects the default color, and the
+    // arguments after it still apply.  Reverse swaps the colors
+    QCOMPARE(int(image[3].rendition), RE_REVERSE | RE_BOLD);
+    QVERIFY(image[3].foregroundColor == CharacterColor(COLOR_SPACE_256, 100));
+    CharacterColor defaultForeground(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR);
+    QVERIFY(image[3].backgroundColor == defaultForeground);
+
+    QCOMPARE(int(image[4].rendition), DEFAULT_RENDITION);
+    QVERIFY(image[4].foregroundColor == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR));
+    QVERIFY(image[4].backgroundColor == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR));
+
+}
+
+void Vt102EmulationTest::testTitleUpdates()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(5, 20);
+    QSignalSpy titleSpy(&emulation, SIGNAL(titleChanged(int,QString)));
+
+    const QByteArray prompt("\033]0;user@host: ~\007$ ");
+    emulation.receiveData(prompt.constData(), prompt.size());
+    QTest::qWait(50);
+    QCOMPARE(titleSpy.count(), 1);
+    QCOMPARE(titleSpy[0][0].toInt(), 0);
+    QCOMPARE(titleSpy[0][1].toString(), QString("user@host: ~"));
+
+    // setting the same title again with the next prompt changes nothing
+    emulation.receiveData(prompt.constData(), prompt.size());
+    QTest::qWait(50);
+    QCOMPARE(titleSpy.count(), 1);
+
+    // unless a program changed the window title in between
+    const QByteArray windowTitle("\033]2;vim\007");
+    emulation.receiveData(windowTitle.constData(), windowTitle.size());
+    QTest::qWait(50);
+    emulation.receiveData(prompt.constData(), prompt.size());
+    QTest::qWait(50);
+    QCOMPARE(titleSpy.count(), 3);
+    QCOMPARE(titleSpy[2][1].toString(), QString("user@host: ~"));
+}
+
+void Vt102EmulationTest::testSynchronizedUpdate()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(5, 20);
+    QSignalSpy updateSpy(&emulation, SIGNAL(outputChanged()));
+
+    // the frame is only shown once it is complete
+    const QByteArray begin("\033[?2026h\033[Hfirst half");
+    emulation.receiveData(begin.constData(), begin.size());
+    QTest::qWait(100);
+    QCOMPARE(updateSpy.count(), 0);
+
+    const QByteArray end(", second half\033[?2026l");
+    emulation.receiveData(end.constData(), end.size());
+    QTest::qWait(50);
+    QCOMPARE(updateSpy.count(), 1);
+
+    // a frame which is never ended is shown after a while
+    updateSpy.clear();
+    emulation.receiveData(begin.constData(), begin.size());
+    QTest::qWait(50);
+    QCOMPARE(updateSpy.count(), 0);
+    QTest::qWait(300);
+    QCOMPARE(updateSpy.count(), 1);
+}
+
+void Vt102EmulationTest::testBracketedPasteMode()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(5, 20);
+    QSignalSpy modeSpy(&emulation, SIGNAL(programBracketedPasteModeChanged(bool)));
+    QVERIFY(!emulation.programBracketedPasteMode());
+
+    const QByteArray enable("\033[?2004h");
+    emulation.receiveData(enable.constData(), enable.size());
+    QVERIFY(emulation.programBracketedPasteMode());
+    QCOMPARE(modeSpy.count(), 1);
+    QCOMPARE(modeSpy.last().at(0).toBool(), true);
+
+    const QByteArray disable("\033[?2004l");
+    emulation.receiveData(disable.constData(), disable.size());
+    QVERIFY(!emulation.programBracketedPasteMode());
+    QCOMPARE(modeSpy.last().at(0).toBool(), false);
+
+    // a reset turns the mode off
+    emulation.receiveData(enable.constData(), enable.size());
+    emulation.reset();
+    QVERIFY(!emulation.programBracketedPasteMode());
+}
+
+void Vt102EmulationTest::testBinaryOutput()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(5, 20);
+    ScreenWindow* window = emulation.createWindow();
+    window->setWindowLines(5);
+
+    // text with the occasional control sequence is not binary
+    QByteArray text;
+    for (int i = 0; i < 20; i++)
+        text += "\033[1;32mtext\033[0m \t line\r\n";
+    emulation.receiveData(text.constData(), text.size());
+    QVERIFY(!emulation.binaryOutputMode());
+
+    // binary output is not interpreted, so the ESC in it does not clear
+    // the screen and the bytes are shown as dots
+    QByteArray binary("\033[2J\033[H");
+    for (int i = 0; i < 511; i++)
+        binary += char(i % 8);
+    binary += "ab";
+    emulation.receiveData(binary.constData(), binary.size());
+    QVERIFY(emulation.binaryOutputMode());
+
+    const int bottomLine = 4 * 20;
+    const Character* image = window->getImage();
+    QCOMPARE(image[bottomLine + 18].character, quint16('a'));
+    QCOMPARE(image[bottomLine + 17].character, quint16('.'));
+
+    // the prompt after the file ends the binary output
+    const QByteArray prompt("\r\n\033[1m$ \033[0m");
+    emulation.receiveData(prompt.constData(), prompt.size());
+    QVERIFY(!emulation.binaryOutputMode());
+
+    // and so does a reset
+    emulation.receiveData(binary.constData(), binary.size());
+    QVERIFY(emulation.binaryOutputMode());
+    emulation.reset();
+    QVERIFY(!emulation.binaryOutputMode());
+
+    // binary output which interrupts a control sequence is not taken as
+    // the rest of it
+    const QByteArray partial("\033[5;1H\033[1;3");
+    emulation.receiveData(partial.constData(), partial.size());
+    QByteArray file;
+    for (int i = 0; i < 518; i++)
+        file += char(i % 8);
+    file += "ab";
+    emulation.receiveData(file.constData(), file.size());
+    QVERIFY(emulation.binaryOutputMode());
+    const Character* fileImage = window->getImage();
+    QCOMPARE(fileImage[bottomLine + 18].character, quint16('a'));
+    emulation.reset();
+
+    // full screen programs on the alternate screen are left alone
+    const QByteArray alternate("\033[?1049h");
+    emulation.receiveData(alternate.constData(), alternate.size());
+    emulation.receiveData(binary.constData(), binary.size());
+    QVERIFY(!emulation.binaryOutputMode());
+}
+
+void Vt102EmulationTest::testFastForward_data()
+{
+    QTest::addColumn<QByteArray>("output");
+
+    QByteArray lines;
+    for (int i = 0; i < 100; i++)
+        lines += "\033[3" + QByteArray::number(i % 8) + "mline " + QByteArray::number(i) + "\r\n";
+
+    QTest::newRow("lines") << QByteArray("\033[1m" + lines + "end");
+    // the cursor moves back up before the last lines
+    QTest::newRow("cursor movement") << QByteArray(lines + "\033[2;3Hup\r\n\n" + lines.left(40));
+    QTest::newRow("title") << QByteArray(lines + "\033]2;title\007" + lines + "\033[?7l" + lines);
+    QTest::newRow("few lines") << QByteArray(lines.left(50));
+}
+
+void Vt102EmulationTest::testFastForward()
+{
+    QFETCH(QByteArray, output);
+
+    // the screen looks the same whether the output is skipped or not
+    Vt102Emulation emulations[2];
+    ScreenWindow* windows[2];
+    for (int i = 0; i < 2; i++) {
+        emulations[i].setCodec(QTextCodec::codecForName("UTF-8"));
+        emulations[i].setImageSize(5, 20);
+        emulations[i].setFastForwardEnabled(i == 1);
+        windows[i] = emulations[i].createWindow();
+        windows[i]->setWindowLines(5);
+        emulations[i].receiveData(output.constData(), output.size());
+    }
+
+    const Character* image = windows[0]->getImage();
+    const Character* skippedImage = windows[1]->getImage();
+    for (int i = 0; i < 5 * 20; i++) {
+        QCOMPARE(skippedImage[i].character, image[i].character);
+        QCOMPARE(skippedImage[i].rendition, image[i].rendition);
+        QVERIFY(skippedImage[i].foregroundColor == image[i].foregroundColor);
+    }
+    QCOMPARE(windows[1]->cursorPosition(), windows[0]->cursorPosition());
+
+    const qint64 tokens = emulations[0].processingStatistics().tokenCount;
+    const qint64 skippedTokens = emulations[1].processingStatistics().tokenCount;
+    if (QByteArray(QTest::currentDataTag()) == "few lines")
+        QCOMPARE(skippedTokens, tokens);
+    else
+        QVERIFY(skippedTokens < tokens);
+}
+
+void Vt102EmulationTest::testUtf8Decoding_data()
+{
+    QTest::addColumn<QByteArray>("output");
+    QTest::addColumn<QString>("text");
+
+    const QString replacement(QChar(0xfffd));
+
+    QTest::newRow("ascii") << QByteArray("abcdefghijklmnopqrstuvwxyz0123456789")
+                           << QString("abcdefghijklmnopqrstuvwxyz0123456789");
+    QTest::newRow("mixed") << QByteArray("abcdefghijklmnop\xc3\xa9qrstuvwxyz\xe2\x82\xac!")
+                           << QString::fromUtf8("abcdefghijklmnop\xc3\xa9qrstuvwxyz\xe2\x82\xac!");
+    QTest::newRow("four bytes") << QByteArray("a\xf0\x9f\x98\x80" "b")
+                                << QString::fromUtf8("a\xf0\x9f\x98\x80" "b");
+    QTest::newRow("overlong") << QByteArray("a\xc0\x80" "b") << QString("a" + replacement + "b");
+    QTest::newRow("surrogate") << QByteArray("a\xed\xa0\x80" "b") << QString("a" + replacement + "b");
+    QTest::newRow("beyond U+10FFFF") << QByteArray("a\xf4\x90\x80\x80" "b")
+                                     << QString("a" + replacement + "b");
+    QTest::newRow("truncated") << QByteArray("a\xe2\x82" "b") << QString("a" + replacement + "b");
+    QTest::newRow("stray continuation") << QByteArray("a\x80" "b") << QString("a" + replacement + "b");
+    QTest::newRow("invalid lead") << QByteArray("a\xf8" "b") << QString("a" + replacement + "b");
+}
+
+void Vt102EmulationTest::testUtf8Decoding()
+{
+    QFETCH(QByteArray, output);
+    QFETCH(QString, text);
+
+    // the output is decoded the same whether it arrives at once or a byte
+    // at a time, which splits every sequence across calls
+    Vt102Emulation emulations[2];
+    ScreenWindow* windows[2];
+    for (int i = 0; i < 2; i++) {
+        emulations[i].setCodec(QTextCodec::codecForName("UTF-8"));
+        emulations[i].setImageSize(5, 40);
+        windows[i] = emulations[i].createWindow();
+        windows[i]->setWindowLines(5);
+    }
+
+    emulations[0].receiveData(output.constData(), output.size());
+    for (int i = 0; i < output.size(); i++)
+        emulations[1].receiveData(output.constData() + i, 1);
+
+    const QVector<uint> codePoints = text.toUcs4();
+    for (int i = 0; i < 2; i++) {
+        // the second half of a double width character is skipped
+        const Character* image = windows[i]->getImage();
+        QVector<uint> line;
+        for (int column = 0; column < 40 && line.count() < codePoints.count(); column++) {
+            if (image[column].codePoint() != 0)
+                line << image[column].codePoint();
+        }
+        QCOMPARE(line, codePoints);
+    }
+}
+
+QTEST_KDEMAIN_CORE(Vt102EmulationTest)
+
+#include "Vt102EmulationTest.moc"
@@ -0,0 +1,270 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Vt102ParserTest.h"
+
+// Qt
+#include <QtCore/QList>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Vt102Parser.h"
+
+using namespace Konsole;
+
+namespace
+{
+struct Token {
+    int code;
+    int p;
+    int q;
+};
+
+// records the tokens passed on by the parser
+class RecordingHandler : public Vt102Parser::Handler
+{
+public:
+    RecordingHandler() : attribute(-1), errors(0) {}
+
+    virtual void processToken(int code, int p, int q) {
+        Token token = { code, p, q };
+        tokens << token;
+    }
+    virtual void processGraphicRendition(const int* arguments, int count) {
+        QList<int> rendition;
+        for (int i = 0; i < count; i++)
+            rendition << arguments[i];
+        renditions << rendition;
+    }
+    virtual void processWindowAttributeChange(int attr, const QString& value) {
+        attribute = attr;
+        attributeValue = value;
+    }
+    virtual void reportDecodingError() {
+        errors++;
+    }
+
+    QList<Token> tokens;
+    QList<QList<int> > renditions;
+    int attribute;
+    QString attributeValue;
+    int errors;
+};
+
+void feed(Vt102Parser& parser, const char* text)
+{
+    for (const char* c = text; *c; c++)
+        parser.receiveChar(static_cast<unsigned char>(*c));
+}
+}
+
+#define COMPARE_TOKEN(index, expectedCode, expectedP, expectedQ) \
+    QCOMPARE(handler.tokens[index].code, (int)(expectedCode)); \
+    QCOMPARE(handler.tokens[index].p, (int)(expectedP)); \
+    QCOMPARE(handler.tokens[index].q, (int)(expectedQ));
+
+void Vt102ParserTest::testPrintableCharacters()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "ab");
+    parser.receiveChar(0x263a);
+
+    QCOMPARE(handler.tokens.count(), 3);
+    COMPARE_TOKEN(0, TY_CHR(), 'a', 0);
+    COMPARE_TOKEN(1, TY_CHR(), 'b', 0);
+    COMPARE_TOKEN(2, TY_CHR(), 0x263a, 0);
+    QVERIFY(parser.isInGroundState());
+}
+
+void Vt102ParserTest::testControlCharacters()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\r\n\x7f");
+
+    // DEL is ignored
+    QCOMPARE(handler.tokens.count(), 2);
+    COMPARE_TOKEN(0, TY_CTL('M'), 0, 0);
+    COMPARE_TOKEN(1, TY_CTL('J'), 0, 0);
+}
+
+void Vt102ParserTest::testControlWithinSequence()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    // control characters are executed without aborting the sequence
+    feed(parser, "\033[1\b0H");
+
+    QCOMPARE(handler.tokens.count(), 2);
+    COMPARE_TOKEN(0, TY_CTL('H'), 0, 0);
+    COMPARE_TOKEN(1, TY_CSI_PN('H'), 10, 0);
+}
+
+void Vt102ParserTest::testCancel()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\033[12\030H");
+
+    QCOMPARE(handler.tokens.count(), 2);
+    COMPARE_TOKEN(0, TY_CTL('X'), 0, 0);
+    COMPARE_TOKEN(1, TY_CHR(), 'H', 0);
+}
+
+void Vt102ParserTest::testEscape()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\033M\033#8");
+
+    QCOMPARE(handler.tokens.count(), 2);
+    COMPARE_TOKEN(0, TY_ESC('M'), 0, 0);
+    COMPARE_TOKEN(1, TY_ESC_DE('8'), 0, 0);
+}
+
+void Vt102ParserTest::testCharset()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\033(0\033)B");
+
+    QCOMPARE(handler.tokens.count(), 2);
+    COMPARE_TOKEN(0, TY_ESC_CS('(', '0'), 0, 0);
+    COMPARE_TOKEN(1, TY_ESC_CS(')', 'B'), 0, 0);
+}
+
+void Vt102ParserTest::testCsiArguments()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\033[1;2H\033[8;24;80t\033[0;1m\033[m");
+
+    QCOMPARE(handler.tokens.count(), 2);
+    COMPARE_TOKEN(0, TY_CSI_PN('H'), 1, 2);
+    COMPARE_TOKEN(1, TY_CSI_PS('t', 8), 24, 80);
+
+    // the arguments of "ESC[...m" are passed on together
+    QCOMPARE(handler.renditions.count(), 2);
+    QCOMPARE(handler.renditions[0], QList<int>() << 0 << 1);
+    QCOMPARE(handler.renditions[1], QList<int>() << 0);
+
+    // the arguments of previous sequences must not leak into later ones
+    handler.tokens.clear();
+    feed(parser, "\033[H");
+
+    QCOMPARE(handler.tokens.count(), 1);
+    COMPARE_TOKEN(0, TY_CSI_PN('H'), 0, 0);
+}
+
+void Vt102ParserTest::testCsiPrivate()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\033[?25;1049l\033[>c\033[!p");
+
+    QCOMPARE(handler.tokens.count(), 4);
+    COMPARE_TOKEN(0, TY_CSI_PR('l', 25), 0, 0);
+    COMPARE_TOKEN(1, TY_CSI_PR('l', 1049), 0, 0);
+    COMPARE_TOKEN(2, TY_CSI_PG('c'), 0, 0);
+    COMPARE_TOKEN(3, TY_CSI_PE('p'), 0, 0);
+}
+
+void Vt102ParserTest::testEightBitCsi()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    parser.receiveChar(0x9b);
+    feed(parser, "5A");
+
+    QCOMPARE(handler.tokens.count(), 1);
+    COMPARE_TOKEN(0, TY_CSI_PN('A'), 5, 0);
+}
+
+void Vt102ParserTest::testExtendedColors()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\033[38;2;1;2;3;48;5;100m");
+
+    // the extended colors are left to the handler to interpret
+    QCOMPARE(handler.tokens.count(), 0);
+    QCOMPARE(handler.renditions.count(), 1);
+    QCOMPARE(handler.renditions[0], QList<int>() << 38 << 2 << 1 << 2 << 3 << 48 << 5 << 100);
+}
+
+void Vt102ParserTest::testWindowAttributeChange()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    feed(parser, "\033]2;Konsole\007x");
+
+    QCOMPARE(handler.attribute, 2);
+    QCOMPARE(handler.attributeValue, QString("Konsole"));
+    QCOMPARE(handler.tokens.count(), 1);
+    COMPARE_TOKEN(0, TY_CHR(), 'x', 0);
+    QCOMPARE(handler.errors, 0);
+
+    // titles longer than the other sequences may be are kept whole
+    const QByteArray title(1000, 'a');
+    feed(parser, ("\033]0;" + title + "\007").constData());
+    QCOMPARE(handler.attribute, 0);
+    QCOMPARE(handler.attributeValue, QString(title));
+
+    // the attribute must be a number followed by ';'
+    feed(parser, "\033]2x;title\007");
+    QCOMPARE(handler.errors, 1);
+    QCOMPARE(handler.attribute, 0);
+}
+
+void Vt102ParserTest::testVt52()
+{
+    RecordingHandler handler;
+    Vt102Parser parser(&handler);
+
+    parser.setAnsiMode(false);
+    QVERIFY(!parser.isInGroundState());
+
+    feed(parser, "a\033A\033Y%*");
+
+    QCOMPARE(handler.tokens.count(), 3);
+    COMPARE_TOKEN(0, TY_CHR(), 'a', 0);
+    COMPARE_TOKEN(1, TY_VT52('A'), 0, 0);
+    COMPARE_TOKEN(2, TY_VT52('Y'), '%', '*');
+
+    parser.setAnsiMode(true);
+    QVERIFY(parser.isInGroundState());
+}
+
+QTEST_KDEMAIN_CORE(Vt102ParserTest)
+
+#include "Vt102ParserTest.moc"
+